@@ -7,6 +7,8 @@
 TARGET = common-gui
 TEMPLATE = lib
 CONFIG += staticlib c++11
+# Entry and Debug log lines are compiled out of release builds
+CONFIG(release, debug|release): DEFINES += SXLOG_MIN_LEVEL=2
 
 QT += gui widgets network concurrent
 
@@ -43,6 +45,7 @@ HEADERS += \
     versioncheck.h \
     downloaddialog.h \
     logtableview.h \
+    logsearchmodel.h \
     logsmodel.h
 
 SOURCES += \
@@ -62,7 +65,8 @@ SOURCES += \
     versioncheck.cpp \
     downloaddialog.cpp \
     logsmodel.cpp \
-    logtableview.cpp
+    logtableview.cpp \
+    logsearchmodel.cpp
 
 INCLUDEPATH += $$PWD/../sx-api
 DEPENDPATH += $$PWD/../sx-api
@@ -0,0 +1,223 @@
+/*
+ *  Copyright (C) 2012-2016 Skylable Ltd. <info-copyright@skylable.com>
+ *
+ *  This program is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public License
+ *  as published by the Free Software Foundation; either version 2
+ *  of the License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA.
+ *
+ *  Special exception for linking this software with OpenSSL:
+ *
+ *  In addition, as a special exception, Skylable Ltd. gives permission to
+ *  link the code of this program with the OpenSSL library and distribute
+ *  linked combinations including the two. You must obey the GNU General
+ *  Public License in all respects for all of the code used other than
+ *  OpenSSL. You may extend this exception to your version of the program,
+ *  but you are not obligated to do so. If you do not wish to do so, delete
+ *  this exception statement from your version.
+ */
+
+#include "logsearchmodel.h"
+#include "logsmodel.h"
+#include "sxlog.h"
+#include <QFile>
+#include <QMutexLocker>
+#include <QStringList>
+#include <QtConcurrent>
+
+LogSearchModel::LogSearchModel(QObject *parent)
+    : QAbstractTableModel(parent)
+{
+    mLines.setMaxCost(1000);
+    mSearching = false;
+}
+
+LogSearchModel::~LogSearchModel()
+{
+    cancel();
+    _closeFiles();
+}
+
+int LogSearchModel::rowCount(const QModelIndex &parent) const
+{
+    Q_UNUSED(parent);
+    return mMatches.count();
+}
+
+int LogSearchModel::columnCount(const QModelIndex &parent) const
+{
+    Q_UNUSED(parent);
+    return 2;
+}
+
+QVariant LogSearchModel::data(const QModelIndex &index, int role) const
+{
+    if (index.row() < 0 || index.row() >= mMatches.count())
+        return QVariant();
+    if (role != Qt::DisplayRole && role != Qt::BackgroundRole)
+        return QVariant();
+    // LEVEL | thread | time | function | message
+    QStringList fields = line(index.row()).split(" | ");
+    if (fields.count() < 5)
+        return role == Qt::DisplayRole && index.column() ? fields.join(" | ") : QVariant();
+    if (role == Qt::BackgroundRole) {
+        const QString &level = fields.at(0);
+        if (level.startsWith("ERROR"))
+            return LogsModel::levelColor(LogLevel::Error);
+        if (level.startsWith("WARN"))
+            return LogsModel::levelColor(LogLevel::Warning);
+        if (level.startsWith("VERB"))
+            return LogsModel::levelColor(LogLevel::Verbose);
+        if (level.startsWith("DEBUG"))
+            return LogsModel::levelColor(LogLevel::Debug);
+        if (level.startsWith("ENTRY"))
+            return LogsModel::levelColor(LogLevel::Entry);
+        return LogsModel::levelColor(LogLevel::Info);
+    }
+    if (index.column() == 0)
+        return fields.at(2).left(19).replace('T', ' ');
+    return QStringList(fields.mid(4)).join(" | ");
+}
+
+QString LogSearchModel::line(int row) const
+{
+    if (row < 0 || row >= mMatches.count())
+        return QString();
+    if (QString *cached = mLines.object(row))
+        return *cached;
+    const Match &match = mMatches.at(row);
+    QFile *file = mFiles.at(match.file);
+    if (!file->seek(match.offset))
+        return QString();
+    QByteArray raw = file->readLine();
+    if (raw.endsWith('\n'))
+        raw.chop(1);
+    QString text = QString::fromLocal8Bit(raw);
+    mLines.insert(row, new QString(text));
+    return text;
+}
+
+QString LogSearchModel::text() const
+{
+    return mText;
+}
+
+bool LogSearchModel::isSearching() const
+{
+    return mSearching;
+}
+
+void LogSearchModel::search(const QString &text)
+{
+    cancel();
+    beginResetModel();
+    mMatches.clear();
+    mLines.clear();
+    _closeFiles();
+    mText = text;
+    endResetModel();
+    if (text.isEmpty())
+        return;
+
+    SxLog::instance().flush();
+    // the scanning thread and the model read through their own handles,
+    // both opened now so a log rotation doesn't move the lines under them
+    QList<QFile*> files;
+    QList<qint64> sizes;
+    foreach (const QString &name, SxLog::instance().logFiles()) {
+        QFile *shown = new QFile(name);
+        QFile *scanned = new QFile(name);
+        if (!shown->open(QIODevice::ReadOnly) || !scanned->open(QIODevice::ReadOnly)) {
+            delete shown;
+            delete scanned;
+            continue;
+        }
+        mFiles.append(shown);
+        files.append(scanned);
+        sizes.append(shown->size());
+    }
+    mSearching = true;
+    mFuture = QtConcurrent::run(&LogSearchModel::_scan, this, files, sizes, text.toLower().toLocal8Bit(), mGeneration.load());
+}
+
+void LogSearchModel::cancel()
+{
+    mGeneration.ref();
+    mFuture.waitForFinished();
+    mSearching = false;
+    QMutexLocker locker(&mPendingMutex);
+    mPending.clear();
+}
+
+void LogSearchModel::_takeMatches(int generation, bool finished)
+{
+    if (generation != mGeneration.load())
+        return;
+    QMutexLocker locker(&mPendingMutex);
+    QVector<Match> matches;
+    matches.swap(mPending);
+    locker.unlock();
+    if (!matches.isEmpty()) {
+        beginInsertRows(QModelIndex(), mMatches.count(), mMatches.count()+matches.count()-1);
+        mMatches += matches;
+        endInsertRows();
+    }
+    if (finished) {
+        mSearching = false;
+        emit searchFinished(mMatches.count());
+    }
+}
+
+void LogSearchModel::_scan(LogSearchModel *model, QList<QFile*> files, QList<qint64> sizes, QByteArray needle, int generation)
+{
+    QVector<Match> batch;
+    int found = 0;
+    bool cancelled = false;
+    auto push = [&](bool finished) {
+        QMutexLocker locker(&model->mPendingMutex);
+        if (model->mGeneration.load() != generation)
+            return;
+        model->mPending += batch;
+        locker.unlock();
+        batch.clear();
+        QMetaObject::invokeMethod(model, "_takeMatches", Qt::QueuedConnection, Q_ARG(int, generation), Q_ARG(bool, finished));
+    };
+    for (int i=0; i<files.count() && !cancelled && found < sMaxMatches; i++) {
+        QFile *file = files.at(i);
+        qint64 offset = 0;
+        while (offset < sizes.at(i) && found < sMaxMatches) {
+            if (model->mGeneration.load() != generation) {
+                cancelled = true;
+                break;
+            }
+            QByteArray line = file->readLine();
+            if (line.isEmpty())
+                break;
+            if (line.toLower().contains(needle)) {
+                batch.append({i, offset});
+                ++found;
+            }
+            offset += line.size();
+            if (batch.count() >= sBatchSize)
+                push(false);
+        }
+    }
+    if (!cancelled)
+        push(true);
+    qDeleteAll(files);
+}
+
+void LogSearchModel::_closeFiles()
+{
+    qDeleteAll(mFiles);
+    mFiles.clear();
+}
@@ -0,0 +1,85 @@
+/*
+ *  Copyright (C) 2012-2016 Skylable Ltd. <info-copyright@skylable.com>
+ *
+ *  This program is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public License
+ *  as published by the Free Software Foundation; either version 2
+ *  of the License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA.
+ *
+ *  Special exception for linking this software with OpenSSL:
+ *
+ *  In addition, as a special exception, Skylable Ltd. gives permission to
+ *  link the code of this program with the OpenSSL library and distribute
+ *  linked combinations including the two. You must obey the GNU General
+ *  Public License in all respects for all of the code used other than
+ *  OpenSSL. You may extend this exception to your version of the program,
+ *  but you are not obligated to do so. If you do not wish to do so, delete
+ *  this exception statement from your version.
+ */
+
+#ifndef LOGSEARCHMODEL_H
+#define LOGSEARCHMODEL_H
+
+#include <QAbstractTableModel>
+#include <QAtomicInt>
+#include <QCache>
+#include <QFuture>
+#include <QList>
+#include <QMutex>
+#include <QVector>
+
+class QFile;
+
+/* Lines of the on-disk log files matching a search,
+ * only their offsets are kept and the text is read back when a row is shown */
+class LogSearchModel : public QAbstractTableModel
+{
+    Q_OBJECT
+public:
+    explicit LogSearchModel(QObject *parent = nullptr);
+    ~LogSearchModel();
+    int rowCount(const QModelIndex &parent) const override;
+    int columnCount(const QModelIndex &parent) const override;
+    QVariant data(const QModelIndex &index, int role) const override;
+    QString line(int row) const;
+    QString text() const;
+    bool isSearching() const;
+    void search(const QString &text);
+    void cancel();
+
+signals:
+    void searchFinished(int matches);
+
+private slots:
+    void _takeMatches(int generation, bool finished);
+
+private:
+    struct Match {
+        int file;
+        qint64 offset;
+    };
+    static void _scan(LogSearchModel *model, QList<QFile*> files, QList<qint64> sizes, QByteArray needle, int generation);
+    void _closeFiles();
+    QString mText;
+    QList<QFile*> mFiles;
+    QVector<Match> mMatches;
+    mutable QCache<int, QString> mLines;
+    QMutex mPendingMutex;
+    QVector<Match> mPending;
+    QAtomicInt mGeneration;
+    QFuture<void> mFuture;
+    bool mSearching;
+    static const int sBatchSize = 256;
+    static const int sMaxMatches = 100000;
+};
+
+#endif // LOGSEARCHMODEL_H
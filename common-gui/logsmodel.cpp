@@ -35,8 +35,10 @@
 #include <QColor>
 #include <QVariant>
 
-LogsModel::LogsModel()
+LogsModel::LogsModel() : m_ring(log_limit)
 {
+    m_first = 0;
+    m_count = 0;
     m_showLogsTimer = new QTimer();
     m_newLogs = new QList<LogData>();
     connect(m_showLogsTimer, &QTimer::timeout, this, &LogsModel::showLogs);
@@ -54,14 +56,29 @@ LogsModel::~LogsModel()
     if (m_newLogs != nullptr)
         delete m_newLogs;
     delete m_showLogsTimer;
-    m_list.clear();
+}
+
+const LogsModel::LogData &LogsModel::_at(int row) const
+{
+    return m_ring.at((m_first + row) % m_ring.size());
+}
+
+const QString &LogsModel::_intern(const QString &string)
+{
+    // function and thread names repeat, records share a single copy of each
+    if (m_strings.size() > 4096)
+        m_strings.clear();
+    auto it = m_strings.find(string);
+    if (it == m_strings.end())
+        it = m_strings.insert(string, string);
+    return it.value();
 }
 
 int LogsModel::rowCount(const QModelIndex &parent) const
 {
     Q_UNUSED(parent);
     //QMutexLocker locker(&m_mutex);
-    return m_list.count();
+    return m_count;
 }
 
 int LogsModel::columnCount(const QModelIndex &parent) const
@@ -73,39 +90,46 @@ int LogsModel::columnCount(const QModelIndex &parent) const
 QVariant LogsModel::data(const QModelIndex &index, int role) const
 {
     //QMutexLocker locker(&m_mutex);
-    if (index.row() < 0 || index.row() >= m_list.count())
+    if (index.row() < 0 || index.row() >= m_count)
         return QVariant();
+    const LogData &log = _at(index.row());
     if (role==Qt::DisplayRole)
     {
         if (index.column()==0)
         {
-            return m_list[index.row()].mTime.toString("yyyy-MM-dd hh:mm:ss");
+            return QDateTime::fromMSecsSinceEpoch(log.mTime).toString("yyyy-MM-dd hh:mm:ss");
         }
         else
         {
-            return m_list[index.row()].mMessage;
+            return log.mMessage;
         }
     }
     else if (role==Qt::BackgroundRole)
     {
-        switch (m_list[index.row()].mType) {
-        case LogLevel::Error:
-            return QColor::fromRgb(255,0,0);
-        case LogLevel::Warning:
-            return QColor::fromRgb(230,200,40);
-        case LogLevel::Info:
-            return QColor::fromRgb(255,255,255);
-        case LogLevel::Verbose:
-            return QColor::fromRgb(230,230,230);
-        case LogLevel::Debug:
-            return QColor::fromRgb(200,200,200);
-        case LogLevel::Entry:
-            return QColor::fromRgb(255,150,0);
-        }
+        return levelColor(log.mType);
     }
     return QVariant();
 }
 
+QColor LogsModel::levelColor(LogLevel type)
+{
+    switch (type) {
+    case LogLevel::Error:
+        return QColor::fromRgb(255,0,0);
+    case LogLevel::Warning:
+        return QColor::fromRgb(230,200,40);
+    case LogLevel::Info:
+        return QColor::fromRgb(255,255,255);
+    case LogLevel::Verbose:
+        return QColor::fromRgb(230,230,230);
+    case LogLevel::Debug:
+        return QColor::fromRgb(200,200,200);
+    case LogLevel::Entry:
+        return QColor::fromRgb(255,150,0);
+    }
+    return QColor();
+}
+
 void LogsModel::appendLog(LogLevel type, const QString &func, const QString &message, const QDateTime &dateTime, const QString &thread)
 {
     QMutexLocker appendLocker(&m_mutexOnAppend);
@@ -117,11 +141,12 @@ void LogsModel::appendLog(LogLevel type, const QString &func, const QString &mes
 QString LogsModel::line(int row) const
 {
     //QMutexLocker locker(&m_mutex);
-    if (row < 0 || row >= m_list.count())
+    if (row < 0 || row >= m_count)
         return QString();
+    const LogData &log = _at(row);
 
     QString logLine;
-    switch (m_list[row].mType) {
+    switch (log.mType) {
     case LogLevel::Entry: {
         logLine = "ENTRY";
     } break;
@@ -141,22 +166,22 @@ QString LogsModel::line(int row) const
         logLine = "ERROR";
     } break;
     }
-    QString thread = m_list[row].mThread;
-    QString time = m_list[row].mTime.toString(Qt::ISODate);
-    QString func = m_list[row].mFunc;
-    QString message = m_list[row].mMessage;
+    QString time = QDateTime::fromMSecsSinceEpoch(log.mTime).toString(Qt::ISODate);
     //locker.unlock();
-    logLine += QString(" | %1 | %2 | %3 | %4").arg(thread, time, func, message);
+    logLine += QString(" | %1 | %2 | %3 | %4").arg(log.mThread, time, log.mFunc, log.mMessage);
     return logLine;
 }
 
 void LogsModel::removeLogs()
 {
     QMutexLocker appendLocker(&m_mutexOnAppend);
-    int rows = rowCount(QModelIndex());
-    emit beginRemoveRows(QModelIndex(), 0, rows-1);
+    if (m_count == 0)
+        return;
+    emit beginRemoveRows(QModelIndex(), 0, m_count-1);
     //QMutexLocker locker(&m_mutex);
-    m_list.clear();
+    m_ring.fill(LogData());
+    m_first = 0;
+    m_count = 0;
     //locker.unlock();
     emit endRemoveRows();
 }
@@ -171,22 +196,36 @@ void LogsModel::showLogs()
         delete logs;
         return;
     }
-    int rows = rowCount(QModelIndex());
-    emit beginInsertRows(QModelIndex(), rows, rows+logs->count()-1);
-    foreach(const LogData& line, *logs) {
-        m_list.append(line);
+    const int capacity = m_ring.size();
+    int skip = qMax(0, logs->count() - capacity);
+    int incoming = logs->count() - skip;
+    // the oldest rows make room in a single removal, their slots are reused below
+    int overflow = m_count + incoming - capacity;
+    if (overflow > 0) {
+        emit beginRemoveRows(QModelIndex(), 0, overflow-1);
+        m_first = (m_first + overflow) % capacity;
+        m_count -= overflow;
+        emit endRemoveRows();
+    }
+    emit beginInsertRows(QModelIndex(), m_count, m_count+incoming-1);
+    for (int i=skip; i<logs->count(); i++) {
+        LogData &slot = m_ring[(m_first + m_count) % capacity];
+        const LogData &log = logs->at(i);
+        slot.mType = log.mType;
+        slot.mTime = log.mTime;
+        slot.mMessage = log.mMessage;
+        slot.mFunc = _intern(log.mFunc);
+        slot.mThread = _intern(log.mThread);
+        ++m_count;
     }
     emit endInsertRows();
     delete logs;
+}
 
-    if (log_limit && m_list.count() > 2*log_limit) {
-        int toRemove = m_list.count() - log_limit;
-        emit beginRemoveRows(QModelIndex(), 0, toRemove-1);
-
-        for (int i=0; i<toRemove; i++)
-            m_list.removeFirst();
-        emit endRemoveRows();
-    }
+LogsModel::LogData::LogData()
+{
+    mType = LogLevel::Info;
+    mTime = 0;
 }
 
 LogsModel::LogData::LogData(LogLevel type, const QString &func, const QString &message, const QDateTime &dateTime, const QString &thread)
@@ -194,6 +233,6 @@ LogsModel::LogData::LogData(LogLevel type, const QString &func, const QString &m
     mType = type;
     mFunc = func;
     mMessage = message;
-    mTime = dateTime;
+    mTime = dateTime.toMSecsSinceEpoch();
     mThread = thread;
 }
@@ -34,6 +34,9 @@
 #include <QMutexLocker>
 #include <QDateTime>
 #include <QList>
+#include <QVector>
+#include <QHash>
+#include <QColor>
 #include "sxlog.h"
 
 class QTimer;
@@ -49,6 +52,7 @@ public:
     QVariant data(const QModelIndex &index, int role) const override;
     void appendLog(LogLevel type, const QString &func, const QString &message, const QDateTime &dateTime, const QString &thread) override;
     QString line(int row) const;
+    static QColor levelColor(LogLevel type);
 
 public slots:
     void removeLogs();
@@ -59,17 +63,24 @@ private slots:
 private:
     struct LogData
     {
+        LogData();
         LogData(LogLevel type, const QString &func, const QString &message, const QDateTime &dateTime, const QString &thread);
         LogLevel mType;
         QString mFunc;
         QString mMessage;
-        QDateTime mTime;
+        qint64 mTime;
         QString mThread;
     };
     LogsModel();
+    const LogData &_at(int row) const;
+    const QString &_intern(const QString &string);
     //mutable QMutex m_mutex;
     QMutex m_mutexOnAppend;
-    QList<LogData> m_list;
+    // fixed capacity ring, rows are counted from m_first
+    QVector<LogData> m_ring;
+    int m_first;
+    int m_count;
+    QHash<QString, QString> m_strings;
     QList<LogData> *m_newLogs;
     QTimer *m_showLogsTimer;
     const int log_limit = 10000;
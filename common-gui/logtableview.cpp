@@ -27,6 +27,7 @@
  */
 
 #include "logsmodel.h"
+#include "logsearchmodel.h"
 #include "logtableview.h"
 #include <QKeyEvent>
 #include <QApplication>
@@ -36,6 +37,8 @@
 #include <QMenu>
 #include <QAction>
 #include <QScrollBar>
+#include <QInputDialog>
+#include <QItemSelectionModel>
 
 LogTableView::LogTableView(QWidget *parent)
     :QTableView(parent)
@@ -43,6 +46,13 @@ LogTableView::LogTableView(QWidget *parent)
     m_menu = new QMenu(this);
     m_actionCopy = m_menu->addAction(tr("copy"));
     connect(m_actionCopy, &QAction::triggered, this, &LogTableView::copyToClipboard);
+    m_actionSearch = m_menu->addAction(tr("search log files..."));
+    connect(m_actionSearch, &QAction::triggered, this, &LogTableView::searchLogFiles);
+    m_actionLive = m_menu->addAction(tr("show live logs"));
+    connect(m_actionLive, &QAction::triggered, this, &LogTableView::showLiveLogs);
+    m_actionLive->setVisible(false);
+    m_liveModel = nullptr;
+    m_searchModel = nullptr;
     //connect(verticalScrollBar(), &QScrollBar::valueChanged, this, &LogTableView::onVerticalScrollBarValueChanged);
 }
 
@@ -56,6 +66,14 @@ void LogTableView::keyPressEvent(QKeyEvent *event)
     {
         copyToClipboard();
     }
+    else if (event->key()== Qt::Key_F && (event->modifiers() & Qt::ControlModifier))
+    {
+        searchLogFiles();
+    }
+    else if (event->key()== Qt::Key_Escape && m_searchModel && model() == m_searchModel)
+    {
+        showLiveLogs();
+    }
 }
 
 void LogTableView::contextMenuEvent(QContextMenuEvent *event)
@@ -104,15 +122,52 @@ void LogTableView::copyToClipboard()
             cells.removeOne(cell);
     }
     auto *logModel = qobject_cast<LogsModel*>(model());
+    auto *searchModel = qobject_cast<LogSearchModel*>(model());
+    if (!logModel && !searchModel)
+        return;
     QString output;
     foreach (const QModelIndex &cell, cells) {
         int row = cell.row();
-        output += logModel->line(row)+"\n";
+        output += (logModel ? logModel->line(row) : searchModel->line(row))+"\n";
     }
     QApplication::clipboard()->setText(output);
 
 }
 
+void LogTableView::searchLogFiles()
+{
+    bool ok;
+    QString text = QInputDialog::getText(this, tr("Search log files"), tr("Search for:"), QLineEdit::Normal,
+                                         m_searchModel ? m_searchModel->text() : QString(), &ok);
+    if (!ok || text.isEmpty())
+        return;
+    if (m_searchModel == nullptr)
+        m_searchModel = new LogSearchModel(this);
+    if (model() != m_searchModel) {
+        m_liveModel = model();
+        _switchModel(m_searchModel);
+    }
+    m_actionLive->setVisible(true);
+    m_searchModel->search(text);
+}
+
+void LogTableView::showLiveLogs()
+{
+    if (m_searchModel == nullptr || model() != m_searchModel)
+        return;
+    m_searchModel->search(QString());
+    m_actionLive->setVisible(false);
+    _switchModel(m_liveModel);
+    scrollToBottom();
+}
+
+void LogTableView::_switchModel(QAbstractItemModel *model)
+{
+    QItemSelectionModel *selection = selectionModel();
+    setModel(model);
+    delete selection;
+}
+
 void LogTableView::onVerticalScrollBarValueChanged(int value)
 {
     QModelIndex b = indexAt(QPoint(1,height()-1));
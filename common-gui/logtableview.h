@@ -33,6 +33,8 @@
 
 class QMenu;
 class QAction;
+class QAbstractItemModel;
+class LogSearchModel;
 
 class LogTableView : public QTableView
 {
@@ -49,11 +51,18 @@ protected:
 
 protected slots:
     void copyToClipboard();
+    void searchLogFiles();
+    void showLiveLogs();
     void onVerticalScrollBarValueChanged(int value);
 
 private:
+    void _switchModel(QAbstractItemModel *model);
     QMenu *m_menu;
     QAction *m_actionCopy;
+    QAction *m_actionSearch;
+    QAction *m_actionLive;
+    QAbstractItemModel *m_liveModel;
+    LogSearchModel *m_searchModel;
 };
 
 #endif // LOGTABLEVIEW_H
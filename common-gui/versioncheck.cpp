@@ -109,7 +109,7 @@ bool VersionCheck::SxVersion::operator ==(const VersionCheck::SxVersion &other)
         return (m_version == other.m_version);
 }
 
-VersionCheck::VersionCheck()
+VersionCheck::VersionCheck() : m_downloadHash(QCryptographicHash::Sha256)
 {
     mParentWidget = nullptr;
     m_enabled = 0;
@@ -119,6 +119,7 @@ VersionCheck::VersionCheck()
     m_downloadFromBetaRepo = false;
     m_timer.setSingleShot(true);
     m_tempfile = 0;
+    m_downloadSize = -1;
     m_versionFile = QStandardPaths::writableLocation(QStandardPaths::CacheLocation)+"/"+mApplicationName.toLower()+".version";
 }
 
@@ -252,7 +253,24 @@ void VersionCheck::replyFinished(QNetworkReply *reply)
             logError("tempfile is missing");
             return;
         }
-        logVerbose("Downloading update finished " + m_availableVersion);
+        if (reply->isOpen() && reply->bytesAvailable() > 0) {
+            QByteArray data = reply->readAll();
+            m_tempfile->write(data);
+            m_downloadHash.addData(data);
+        }
+        m_tempfile->close();
+        if (m_downloadSize >= 0 && m_tempfile->size() != m_downloadSize) {
+            logWarning(QString("Downloaded update is incomplete: %1 of %2 bytes").arg(m_tempfile->size()).arg(m_downloadSize));
+            m_tempfile->remove();
+            delete m_tempfile;
+            m_tempfile = 0;
+            if (m_initlalCheck) {
+                m_initlalCheck = false;
+                emit initialCheckFinished();
+            }
+            return;
+        }
+        logVerbose("Downloading update finished " + m_availableVersion + ", sha256 " + QString::fromLatin1(m_downloadHash.result().toHex()));
         m_updateVersion = m_availableVersion;
         writeVersionFile();
 
@@ -319,28 +337,55 @@ void VersionCheck::downloadProgress(qint64, qint64)
         logError("tempfile is missing");
         return;
     }
-    if (!m_tempfile->open()) {
-        logError("unable to open tempfile");
+    if (!reply->property("started").isValid() && !_startDownloadData(reply)) {
+        reply->abort();
+        return;
     }
 
-    m_tempfile->seek(m_tempfile->size());
     m_timer.stop();
 
     if (reply->isOpen()) {
         auto data = reply->readAll();
-        m_tempfile->write(data);
-
-        if (m_tempfile->flush()) {
-            m_tempfile->close();
-            m_timer.start(timeoutSec*1000);
-        }
-        else {
-            logWarning("unable to flush tempfile");
-            reply->finished();
+        if (m_tempfile->write(data) != data.size()) {
+            logWarning("unable to write tempfile");
+            reply->abort();
+            return;
         }
+        m_downloadHash.addData(data);
+        m_timer.start(timeoutSec*1000);
     }
 }
 
+bool VersionCheck::_startDownloadData(QNetworkReply *reply)
+{
+    reply->setProperty("started", true);
+    if (!m_tempfile->isOpen() && !m_tempfile->open()) {
+        logError("unable to open tempfile");
+        return false;
+    }
+    int status = reply->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt();
+    qint64 offset = reply->property("offset").toLongLong();
+    if (status == 206 && offset == m_tempfile->size()) {
+        // Content-Range: bytes first-last/total
+        QString range = QString::fromLatin1(reply->rawHeader("Content-Range"));
+        qint64 total = range.mid(range.lastIndexOf('/')+1).toLongLong();
+        m_downloadSize = total > 0 ? total : -1;
+        logVerbose(QString("Resuming update download at %1").arg(offset));
+    }
+    else {
+        // the server sent the whole file, anything kept from previous attempts is dropped
+        reply->setProperty("offset", 0);
+        m_tempfile->resize(0);
+        m_downloadHash.reset();
+        qint64 length = reply->header(QNetworkRequest::ContentLengthHeader).toLongLong();
+        m_downloadSize = length > 0 ? length : -1;
+    }
+    m_tempfile->seek(m_tempfile->size());
+    if (reply->hasRawHeader("ETag"))
+        m_downloadEtag = reply->rawHeader("ETag");
+    return true;
+}
+
 void VersionCheck::onNetworkTimeout()
 {
     foreach (auto r, m_replies) {
@@ -510,6 +555,9 @@ void VersionCheck::downloadUpdate(QString version, bool downloadFromBetaRepo)
 #endif
     auto const tempPath = QStandardPaths::writableLocation(QStandardPaths::TempLocation);
     m_tempfile = new QTemporaryFile(tempPath+"/XXXXXXXXXX"+ext);
+    m_downloadHash.reset();
+    m_downloadEtag.clear();
+    m_downloadSize = -1;
 
     QString url = (downloadFromBetaRepo?mUrlBeta:mUrlRelease)+mUrlTemplateDownload.arg(version+ext);
     QNetworkRequest request(url);
@@ -527,6 +575,14 @@ void VersionCheck::downloadUpdate(QString version, bool downloadFromBetaRepo)
 
 void VersionCheck::_sendDownloadQuerry(QNetworkRequest request, DownloadDialog *d, int attempt)
 {
+    // a retry continues after the bytes already on disk, If-Range makes the server
+    // send the whole file again if it has changed in the meantime
+    qint64 offset = m_tempfile->isOpen() ? m_tempfile->size() : 0;
+    if (offset > 0) {
+        request.setRawHeader("Range", QString("bytes=%1-").arg(offset).toLatin1());
+        if (!m_downloadEtag.isEmpty())
+            request.setRawHeader("If-Range", m_downloadEtag);
+    }
     QNetworkReply *reply = m_netAccMan->get(request);
     if (!reply) {
         logWarning("Unable to download update. QNetworkAccessManager failed.");
@@ -537,21 +593,28 @@ void VersionCheck::_sendDownloadQuerry(QNetworkRequest request, DownloadDialog *
     }
 
     reply->setProperty("attempt", attempt);
+    reply->setProperty("offset", offset);
     m_replies.append(reply);
 
     connect(reply, &QNetworkReply::downloadProgress, this, &VersionCheck::downloadProgress);
-    connect(reply, &QNetworkReply::downloadProgress, d, &DownloadDialog::setDownloadProgress);
+    connect(reply, &QNetworkReply::downloadProgress, d, [d, reply](qint64 received, qint64 total) {
+        qint64 start = reply->property("offset").toLongLong();
+        d->setDownloadProgress(static_cast<quint64>(start+received), total > 0 ? static_cast<quint64>(start+total) : 0);
+    });
     connect(&m_timer, &QTimer::timeout, this, &VersionCheck::onNetworkTimeout);
 
     QMetaObject::Connection *conn = new QMetaObject::Connection();
     auto lambda = [d, this, conn](QNetworkReply *r) {
-        if (r->error() == QNetworkReply::TimeoutError || r->error() == QNetworkReply::OperationCanceledError) {
+        if (r->error() == QNetworkReply::TimeoutError || r->error() == QNetworkReply::OperationCanceledError
+                || r->error() == QNetworkReply::RemoteHostClosedError || r->error() == QNetworkReply::TemporaryNetworkFailureError) {
             int attempt = r->property("attempt").toInt();
-            if (attempt < 3) {
+            if (attempt < downloadAttempts) {
                 m_netAccMan->deleteLater();
                 m_netAccMan = new QNetworkAccessManager();
                 connect(m_netAccMan, &QNetworkAccessManager::finished, this, &VersionCheck::replyFinished);
                 QNetworkRequest request = r->request();
+                request.setRawHeader("Range", QByteArray());
+                request.setRawHeader("If-Range", QByteArray());
                 if (!request.hasRawHeader("Cache-control"))
                     request.setRawHeader("Cache-control", "max-age=60");
                 _sendDownloadQuerry(request, d, attempt+1);
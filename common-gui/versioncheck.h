@@ -33,6 +33,7 @@
 #include <QTimer>
 #include <QTemporaryFile>
 #include <QNetworkRequest>
+#include <QCryptographicHash>
 #include "downloaddialog.h"
 
 class QNetworkAccessManager;
@@ -43,6 +44,7 @@ class VersionCheck: public QObject
     Q_OBJECT
     const int timeoutSec = 15;
     const int retrySec = 120;
+    const int downloadAttempts = 5;
 
 public:
     static void initializeVersionCheck(const QString &applicationName, const QString &version, const QString &urlRepoRelease, const QString &urlRepoBeta, const QString &urlTemplateCheck, const QString &urlTemplateDownload, const QString &updateScriptName);
@@ -97,6 +99,7 @@ private:
     void readVersionFile();
     void downloadUpdate(QString version, bool downloadFromBetaRepo);
     void _sendDownloadQuerry(QNetworkRequest request, DownloadDialog *d, int attempt);
+    bool _startDownloadData(QNetworkReply *reply);
 
 private:
     QNetworkAccessManager *m_netAccMan;
@@ -112,6 +115,10 @@ private:
     bool m_downloadFromBetaRepo;
     QTimer m_timer;
     QTemporaryFile *m_tempfile;
+    // digest of the bytes written to m_tempfile, across resumed requests
+    QCryptographicHash m_downloadHash;
+    QByteArray m_downloadEtag;
+    qint64 m_downloadSize;
     QString mUrlRelease;
     QString mUrlBeta;
     QString mUrlTemplateCheck;
@@ -48,6 +48,7 @@ SOURCES += aboutdialog.cpp \
     synchistorymodel.cpp \
     sxprogressbar.cpp \
     volumeswidget.cpp \
+    warningsmodel.cpp \
     warningstable.cpp \
     shareconfig.cpp \
     wizard/wizardchoosevolumepage.cpp \
@@ -69,6 +70,7 @@ HEADERS  += aboutdialog.h \
     synchistorymodel.h \
     sxprogressbar.h \
     volumeswidget.h \
+    warningsmodel.h \
     warningstable.h \
     shareconfig.h \
     wizard/wizardchoosevolumepage.h \
@@ -108,6 +110,8 @@ equals(QT_MAJOR_VERSION, 5) {
 
 CONFIG += c++11
 CONFIG += debug_and_release
+# Entry and Debug log lines are compiled out of release builds
+CONFIG(release, debug|release): DEFINES += SXLOG_MIN_LEVEL=2
 
 QMAKE_MAC_SDK = macosx10.11
 ICON = ../assets/$$WHITELABEL/sxdrive.icns
@@ -178,7 +182,12 @@ macx {
     LIBS += -L$$PWD/../3rdparty/openssl-osx/lib/ -lssl -lcrypto
     PRE_TARGETDEPS += $$PWD/../3rdparty/openssl-osx/lib/libssl.a
     PRE_TARGETDEPS += $$PWD/../3rdparty/openssl-osx/lib/libcrypto.a
+    LIBS += -framework CoreServices
 }
 else:unix:  LIBS += -lssl -lcrypto
+unix:       LIBS += -lz
 else:win32:LIBS += -L$$PWD/../3rdparty/openssl-win32/lib/ -llibeay32 -lssleay32
 
+# power source and user idle time for the sync governor
+macx: LIBS += -framework IOKit -framework ApplicationServices
+win32: LIBS += -luser32
@@ -49,12 +49,14 @@
 #include <QLocalServer>
 #include <QLocalSocket>
 #include <QProcess>
+#include <QTimer>
 #include <sxcluster.h>
 #include "sxfilter/fake_sx.h"
 #include "profilemanager.h"
 #include "whitelabel.h"
 #include <iostream>
 #include "sxlog.h"
+#include "sxprofiler.h"
 #include "sxstate.h"
 #include "logsmodel.h"
 #include "coloredframe.h"
@@ -98,6 +100,9 @@ int get_input(sxc_input_t type, const char* prompt, char *in, int insize)
     }
 }
 
+// work that is not needed to show the tray icon waits until the login burst is over
+static const int sDeferredStartupDelay = 20;
+
 static const char* s_text_warning  = QT_TRANSLATE_NOOP("Main", "Warning");
 static const char* s_text_ssl_missing  = QT_TRANSLATE_NOOP("Main", "Application directory is missing some OpenSSL dll files.");
 
@@ -121,6 +126,7 @@ QString initializeCommandLineParser(QCommandLineParser &parser, const QStringLis
 
     parser.addOption(QCommandLineOption("open-settings", "Open settings window"));
     parser.addOption(QCommandLineOption("open-directory", "Open local directory"));
+    parser.addOption(QCommandLineOption("profiling", "Print the time spent in every sync phase on exit"));
 
 #if defined Q_OS_MAC || defined Q_OS_WIN
     parser.addOption(QCommandLineOption("update-failed", ""));
@@ -210,8 +216,20 @@ void handleLocalSocketConnection(QLocalSocket *socket,  MainController* controll
 {
     QString message;
     socket->waitForReadyRead();
-    message = QString::fromLocal8Bit(socket->readAll());
-    if (message == "status")
+    QByteArray data = socket->readAll();
+    message = QString::fromLocal8Bit(data);
+    if (data.startsWith("share ") || data.startsWith("rev "))
+    {
+        // forwarded by forwardToRunningInstance, answered before the dialog opens
+        socket->write("ack");
+        socket->flush();
+        socket->waitForBytesWritten();
+        QString forwarded = QString::fromUtf8(data);
+        QTimer::singleShot(0, [forwarded, controller]() {
+            handleMessage(forwarded, controller);
+        });
+    }
+    else if (message == "status")
     {
         //SxConfig config(controller->profile());
         QString state = controller->getState().toString();
@@ -224,6 +242,18 @@ void handleLocalSocketConnection(QLocalSocket *socket,  MainController* controll
         socket->flush();
         socket->waitForBytesWritten();
     }
+    else if (message.startsWith("path-status\n"))
+    {
+        // one local path per line, answered with one state per line
+        QStringList paths = message.mid(12).split("\n", QString::SkipEmptyParts);
+        QStringList states;
+        foreach (QString path, paths) {
+            states.append(controller ? controller->pathStatus(path) : "none");
+        }
+        socket->write(states.join("\n").toUtf8());
+        socket->flush();
+        socket->waitForBytesWritten();
+    }
     socket->close();
     socket->deleteLater();
     if (message == "close") {
@@ -231,6 +261,31 @@ void handleLocalSocketConnection(QLocalSocket *socket,  MainController* controll
     }
 }
 
+/* shell extensions start a new process for every --share or --rev click, the
+ * command is handed to the running instance before any GUI initialization */
+bool forwardToRunningInstance(int &argc, char **argv, QCommandLineParser &parser, const QString &profile)
+{
+    QString message;
+    if (parser.isSet("share"))
+        message = "share "+parser.value("share");
+    else if (parser.isSet("rev"))
+        message = "rev "+parser.value("rev");
+    else
+        return false;
+
+    QCoreApplication launcher(argc, argv);
+    QLocalSocket socket;
+    socket.connectToServer(ProfileManager::getLocalServerName(profile));
+    if (!socket.waitForConnected(1000))
+        return false;
+    socket.write(message.toUtf8());
+    socket.flush();
+    if (!socket.waitForReadyRead(5000) || socket.readAll() != "ack")
+        return false;
+    socket.disconnectFromServer();
+    return true;
+}
+
 void handleCommandLineArguments(QtSingleApplication &app, QCommandLineParser& parser, QString &profile, bool &openFolder)
 {
     if (parser.isSet("start"))
@@ -241,6 +296,8 @@ void handleCommandLineArguments(QtSingleApplication &app, QCommandLineParser& pa
             argments << "--profile" << profile;
         if (parser.isSet("open-directory"))
             argments << "--open-directory";
+        if (parser.isSet("profiling"))
+            argments << "--profiling";
         p.startDetached(QApplication::applicationFilePath(), argments);
         exit(0);
     }
@@ -497,6 +554,10 @@ int main(int argc, char **argv) {
     QCommandLineParser parser;
     QString profile=initializeCommandLineParser(parser, arguments);
 
+    // instances which do not answer on the local server still get the message below
+    if (forwardToRunningInstance(argc, argv, parser, profile))
+        return 0;
+
     QtSingleApplication app(__applicationId+(profile.isEmpty()?"":"-"+profile), argc, argv);
     app.setOrganizationName(__organizationName);
     app.setOrganizationDomain(__organizationDomain);
@@ -539,6 +600,7 @@ int main(int argc, char **argv) {
     SxLog::instance().setLogModel(LogsModel::instance());
     LogLevel logLevel = static_cast<LogLevel>(static_cast<int>(LogLevel::Info)-config.desktopConfig().logLevel());
     SxLog::instance().setLogLevel(logLevel);
+    SxProfiler::instance().setEnabled(parser.isSet("profiling") || config.desktopConfig().debugLog());
 
     QString startMessage = QString("%1 version %2 started").arg(__applicationName).arg(SXVERSION);
     logInfo(QString(startMessage.length(), '-'));
@@ -555,7 +617,11 @@ int main(int argc, char **argv) {
     }
 
     ShellExtensions::instance()->setConfig(&config);
-    ShellExtensions::instance()->disable();
+    QTimer::singleShot(sDeferredStartupDelay*1000, []() {
+        // drop entries left behind by a previous run, unless sharing registered the current ones already
+        if (!ShellExtensions::instance()->enabled())
+            ShellExtensions::instance()->disable();
+    });
 
     SxCluster::setClientVersion(__applicationName+"-"+SXVERSION);
     controller = new MainController(&config);
@@ -613,12 +679,12 @@ int main(int argc, char **argv) {
 #if defined Q_OS_WIN || defined Q_OS_MAC
             startMaincontroller = !vc->initialCheck();
 #else
-            vc->checkNow();
+            QTimer::singleShot(sDeferredStartupDelay*1000, vc, SLOT(checkNow()));
 #endif
         }
     }
     if (startMaincontroller)
-        controller->startMainControler();
+        QTimer::singleShot(0, controller, SLOT(startMainControler()));
 
 #if defined Q_OS_LINUX
     QTimer timer;
@@ -654,6 +720,12 @@ int main(int argc, char **argv) {
     bool retVal = app.exec();
     delete controller;
     ShellExtensions::instance()->disable();
+    ShellExtensions::instance()->waitForRegistration();
+    if (SxProfiler::instance().isEnabled()) {
+        QString report = SxProfiler::instance().report();
+        logInfo("time spent per phase:\n"+report);
+        std::cerr << report.toLocal8Bit().constData() << std::endl;
+    }
 
     return retVal;
 }
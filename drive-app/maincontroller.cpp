@@ -35,6 +35,9 @@
 #include "util.h"
 #include "wizard/drivewizard.h"
 #include "changepassworddialog.h"
+#include "sxmetricsserver.h"
+#include "sxmetrics.h"
+#include "sxsyncstatus.h"
 #include <QMenu>
 #include <QMessageBox>
 #include <QApplication>
@@ -152,7 +155,20 @@ MainController::MainController(SxConfig *config, QObject *parent)
     connect(mSxController, &SxController::sig_gotVcluster,          this, &MainController::onGotVCluster);
     connect(mSxController, &SxController::sig_volumeNameChanged,    this, &MainController::onVolumeNameChanged);
     connect(&m_notificationTimer, &QTimer::timeout,                 this, &MainController::showFilesNotification);
-    connect(&SxDatabase::instance(), &SxDatabase::sig_volumeListUpdated, this, &MainController::onVolumeListUpdated);
+    // opening the database is left for after the tray icon is shown
+    QTimer::singleShot(0, this, [this]() {
+        connect(&SxDatabase::instance(), &SxDatabase::sig_volumeListUpdated, this, &MainController::onVolumeListUpdated);
+    });
+    // opt-in, queue gauges are only collected while the endpoint is up
+    mMetricsServer = nullptr;
+    int metricsPort = config->desktopConfig().metricsPort();
+    if (metricsPort > 0 && metricsPort <= 65535) {
+        mMetricsServer = new SxMetricsServer(this);
+        if (!mMetricsServer->listen(static_cast<quint16>(metricsPort))) {
+            delete mMetricsServer;
+            mMetricsServer = nullptr;
+        }
+    }
     lastEtaAction = EtaAction::Inactive;
     setupSystemTray();
 
@@ -234,13 +250,15 @@ static QString EtaActionToString(EtaAction action) {
         return QCoreApplication::translate("MainController", "Removing");
     case EtaAction::RemoveLocalFile:
         return QCoreApplication::translate("MainController", "Removing");
+    case EtaAction::MoveRemoteFile:
+        return QCoreApplication::translate("MainController", "Moving");
     }
     return QString();
 }
 
 void MainController::setEtaAction(EtaAction action, qint64 taskCounter, QString file, qint64 size, qint64 speed)
 {
-    static QList<EtaAction> regularActions = {EtaAction::DownloadFile, EtaAction::UploadFile, EtaAction::RemoveLocalFile, EtaAction::RemoveRemoteFile};
+    static QList<EtaAction> regularActions = {EtaAction::DownloadFile, EtaAction::UploadFile, EtaAction::RemoveLocalFile, EtaAction::RemoveRemoteFile, EtaAction::MoveRemoteFile};
     static QList<EtaAction> specialActions = {EtaAction::ListClusterNodes, EtaAction::ListRemoteFiles, EtaAction::ListVolumes, EtaAction::VolumeInitialScan};
 
     bool showStatusMenu = regularActions.contains(action) || (taskCounter > 0 && specialActions.contains(action));
@@ -279,6 +297,8 @@ void MainController::setEtaCounters(uint upload, qint64 uploadSize, uint downloa
 {
     mUploadSize =uploadSize;
     mDownloadSize = downloadSize;
+    if (mMetricsServer != nullptr)
+        SxMetrics::instance().setQueueState(upload, uploadSize, download, downloadSize, remove);
     if (!mContextMenu.statusMenu)
         return;
     QString text = tr("upload: %1").arg(upload);
@@ -425,6 +445,11 @@ QString MainController::profile() const
     return mConfig->profile();
 }
 
+QString MainController::pathStatus(const QString &localPath) const
+{
+    return SxSyncStatus::toString(SxSyncStatus::instance().localPathState(mConfig, localPath));
+}
+
 bool MainController::isWizardVisible() const
 {
     return (m_wizard && m_wizard->isVisible());
@@ -496,7 +521,6 @@ void MainController::updateShellExtensions()
 {
     if (!ShellExtensions::instance()->enabled())
         return;
-    ShellExtensions::instance()->disable();
     ShellExtensions::instance()->enable(!m_sxshareAddress.isEmpty());
 }
 
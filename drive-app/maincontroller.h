@@ -112,6 +112,8 @@ struct ContextMenu {
     void setStatusMenuEnabled(bool enabled);
 };
 
+class SxMetricsServer;
+
 class MainController: public QObject
 {
     Q_OBJECT
@@ -134,6 +136,7 @@ private:
     const int cInitializationTimeListLimit = 30;
     bool m_started;
     SxController *mSxController;
+    SxMetricsServer *mMetricsServer;
     SxConfig* mConfig;
     ContextMenu mContextMenu;
     QString m_sxwebAddress;
@@ -167,6 +170,7 @@ public:
     void pause();
     void resume();
     QString profile() const;
+    QString pathStatus(const QString &localPath) const;
     bool isWizardVisible() const;
     void loadRecentHistory();
     std::function<bool(QSslCertificate&,bool)> mCheckCertCallback;
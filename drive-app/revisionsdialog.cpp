@@ -181,26 +181,53 @@ void RevisionsDialog::hideBrowseButton()
 
 void RevisionsDialog::getFileRevisions()
 {
-    ui->messageLabel->setVisible(true);
-    ui->revisions->setVisible(false);
-    ui->messageLabel->setText(tr("Waiting for file revisions"));
-
-    if (!mCluster->reloadVolumes()) {
-        ui->messageLabel->setText(mCluster->lastError().errorMessageTr());
-        return;
-    }
-
     QString localPath = m_config->volume(m_volume).localPath();
     if (!localPath.endsWith("/"))
         localPath+="/";
     QString file = m_file.mid(localPath.size()-1);
-    SxVolume *volume = mCluster->getSxVolume(m_volume);
-    QList<std::tuple<QString, qint64, quint32>> list;
-    if (!mCluster->listFileRevisions(volume, file, list)) {
-        ui->messageLabel->setText(mCluster->lastError().errorMessageTr());
+    // the last known list is shown at once, the cluster is asked in the background
+    SxRevisionCache::RevisionList cached;
+    bool fromCache = SxRevisionCache::instance().get(mCluster->uuid(), m_volume, file, cached);
+    mShownRevisions.clear();
+    if (fromCache)
+        showRevisions(cached);
+    else {
+        ui->messageLabel->setVisible(true);
+        ui->revisions->setVisible(false);
+        ui->messageLabel->setText(tr("Waiting for file revisions"));
+    }
+
+    if (!mCluster->reloadVolumes()) {
+        if (!fromCache)
+            ui->messageLabel->setText(mCluster->lastError().errorMessageTr());
         return;
     }
+    SxVolume *volume = mCluster->getSxVolume(m_volume);
+    if (volume == nullptr)
+        return;
+    QString requested = m_file;
+    mCluster->listFileRevisionsAsync(volume, file, [this, requested, fromCache](bool success, const SxRevisionCache::RevisionList &list) {
+        if (requested != m_file)
+            return;
+        if (!success) {
+            if (!fromCache)
+                ui->messageLabel->setText(mCluster->lastError().errorMessageTr());
+            return;
+        }
+        showRevisions(list);
+    });
+}
+
+void RevisionsDialog::showRevisions(const SxRevisionCache::RevisionList &list)
+{
+    // a refresh that brings nothing new keeps the current selection
+    if (ui->revisions->isVisible() && list == mShownRevisions)
+        return;
+    mShownRevisions = list;
+    m_selectedIndex = 0;
+    ui->buttonBox->button(QDialogButtonBox::Ok)->setEnabled(false);
     ui->revisions->clearContents();
+    ui->revisions->setRowCount(0);
     int count = list.count();
     foreach (auto rev, list) {
         QString revStr = std::get<0>(rev);
@@ -33,6 +33,7 @@
 #include <QString>
 #include "sxcluster.h"
 #include "sxconfig.h"
+#include "sxrevisioncache.h"
 #include <QRadioButton>
 
 namespace Ui {
@@ -61,6 +62,7 @@ private slots:
     void on_pushButton_clicked();
 
 private:
+    void showRevisions(const SxRevisionCache::RevisionList &list);
     Ui::RevisionsDialog *ui;
     int m_selectedIndex;
     QString m_createdAt;
@@ -68,6 +70,7 @@ private:
     QString m_volume;
     SxConfig *m_config;
     SxCluster *mCluster;
+    SxRevisionCache::RevisionList mShownRevisions;
 };
 
 #endif // REVISIONSDIALOG_H
@@ -46,6 +46,11 @@
 #include <QComboBox>
 #include <QBitmap>
 #include <QColorDialog>
+#include <QPlainTextEdit>
+#include <QPushButton>
+#include <QTimer>
+#include <QFutureWatcher>
+#include <QtConcurrent>
 #include "sxconfig.h"
 #include "synchistoryitemdelegate.h"
 #include "util.h"
@@ -59,6 +64,8 @@
 #include "getpassworddialog.h"
 #include "sxauth.h"
 #include "warningstable.h"
+#include "sxmetrics.h"
+#include "sxprofiler.h"
 
 #define CLASS_NAME "SettingsDialog:"
 
@@ -120,6 +127,7 @@ SettingsDialog::SettingsDialog(SxConfig *config, QHash<QString, VolumeEncryption
     setupProfileManagerPage();
     setupWarningsPage();
     setupLoggingPage();
+    setupPerformancePage();
 
     m_currentPageIndex = 0;
     configPagesList->setCurrentRow(m_currentPageIndex);
@@ -385,6 +393,54 @@ void SettingsDialog::setupWarningsPage()
     pageWarnings->layout()->addWidget(table);
 }
 
+void SettingsDialog::setupPerformancePage()
+{
+    QWidget *page = new QWidget(configPagesStack);
+    QVBoxLayout *layout = new QVBoxLayout(page);
+    QPlainTextEdit *report = new QPlainTextEdit(page);
+    report->setReadOnly(true);
+    report->setLineWrapMode(QPlainTextEdit::NoWrap);
+    QFont font("Monospace");
+    font.setStyleHint(QFont::TypeWriter);
+    report->setFont(font);
+    QHBoxLayout *buttons = new QHBoxLayout();
+    QPushButton *resetButton = new QPushButton(tr("Reset"), page);
+    QPushButton *exportButton = new QPushButton(tr("Export..."), page);
+    buttons->addStretch();
+    buttons->addWidget(resetButton);
+    buttons->addWidget(exportButton);
+    layout->addWidget(report);
+    layout->addLayout(buttons);
+    configPagesList->addItem(tr("Performance"));
+    configPagesStack->addWidget(page);
+
+    // the report is only rebuilt while the page is visible
+    auto refresh = [this, page, report]() {
+        if (configPagesStack->currentWidget() == page)
+            report->setPlainText(SxMetrics::instance().report());
+    };
+    QTimer *timer = new QTimer(page);
+    connect(timer, &QTimer::timeout, refresh);
+    connect(configPagesStack, &QStackedWidget::currentChanged, page, refresh);
+    connect(resetButton, &QPushButton::clicked, page, [refresh]() {
+        SxMetrics::instance().reset();
+        refresh();
+    });
+    connect(exportButton, &QPushButton::clicked, this, &SettingsDialog::onExportMetrics);
+    timer->start(1000);
+}
+
+void SettingsDialog::onExportMetrics()
+{
+    QString filename = QString("%1-metrics-%2.json").arg(__applicationName.toLower()).arg(QDateTime::currentDateTime().toString("yyyyMMdd-hhmm"));
+    QString file = QFileDialog::getSaveFileName(this, tr("Export performance metrics"),
+                                                QDir(QStandardPaths::writableLocation(QStandardPaths::DocumentsLocation)).filePath(filename), "*.json");
+    if (file.isEmpty())
+        return;
+    if (!SxMetrics::instance().exportJson(file))
+        QMessageBox::warning(this, __applicationName, tr("Exporting metrics failed"));
+}
+
 void SettingsDialog::setupLoggingPage()
 {
     enableDebugLog->setChecked(mConfig->desktopConfig().debugLog());
@@ -494,7 +550,8 @@ void SettingsDialog::onLogsInserted(const QModelIndex &, int first, int last)
     */
     Q_UNUSED(first);
     Q_UNUSED(last);
-    if (m_scrolledToBottom)
+    // the view may be showing search results instead of the live logs
+    if (m_scrolledToBottom && logView->model() == LogsModel::instance())
         logView->scrollToBottom();
 }
 
@@ -557,6 +614,7 @@ void SettingsDialog::storeSettings()
     desktopConfig.setAutostart(autoStart->isChecked());
     desktopConfig.setCheckUpdates(checkNewVersion->isChecked(), checkBetaVersion->isChecked());
     desktopConfig.setDebugLog(enableDebugLog->isChecked());
+    SxProfiler::instance().setEnabled(enableDebugLog->isChecked() || QCoreApplication::arguments().contains("--profiling"));
     desktopConfig.setLogLevel(comboBoxLogLevel->currentIndex());
     LogLevel logLevel = static_cast<LogLevel>(static_cast<int>(LogLevel::Info)-comboBoxLogLevel->currentIndex());
     SxLog::instance().setLogLevel(logLevel);
@@ -1179,8 +1237,17 @@ void SettingsDialog::on_sendLogsButton_clicked()
 #endif
 
     if (dialog.exec()) {
-        if (!SxLog::instance().exportLogs(dialog.selectedFiles().first()))
-            QMessageBox::warning(this, __applicationName, "Exporting logs failed");
+        // the logs are compressed in the background, the dialog stays responsive meanwhile
+        QString file = dialog.selectedFiles().first();
+        auto watcher = new QFutureWatcher<bool>(this);
+        connect(watcher, &QFutureWatcher<bool>::finished, this, [this, watcher]() {
+            sendLogsButton->setEnabled(true);
+            if (!watcher->result())
+                QMessageBox::warning(this, __applicationName, "Exporting logs failed");
+            watcher->deleteLater();
+        });
+        sendLogsButton->setEnabled(false);
+        watcher->setFuture(QtConcurrent::run([file]() { return SxLog::instance().exportLogs(file); }));
     }
 }
 
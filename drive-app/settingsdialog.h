@@ -63,7 +63,8 @@ public:
         SelectiveSync,
         ProfileManager,
         Warnings,
-        Advanced
+        Advanced,
+        Performance
     };
 
     SettingsDialog(SxConfig* config, QHash<QString, VolumeEncryptionType> &encryptedVolumesTypes, QSet<QString> &lockedVolumes, const SxState* sxState);
@@ -77,6 +78,7 @@ private:
     void setupProfileManagerPage();
     void setupWarningsPage();
     void setupLoggingPage();
+    void setupPerformancePage();
 
 public:
     void storeSettings();
@@ -88,6 +90,7 @@ public:
 private slots:
     void updateVolumeList();
     void onOpenLog();
+    void onExportMetrics();
 
 Q_SIGNALS:
     void sig_forcePause();
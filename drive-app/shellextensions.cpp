@@ -33,6 +33,7 @@
 #include <QApplication>
 #include <QDir>
 #include <QStringList>
+#include <QtConcurrent>
 #include "whitelabel.h"
 
 ShellExtensions *ShellExtensions::instance()
@@ -41,6 +42,9 @@ ShellExtensions *ShellExtensions::instance()
     return &_instance;
 }
 
+static const char *sFileShellRoot = "*\\shell";
+static const char *sFolderShellRoot = "Folder\\shell";
+
 void ShellExtensions::enable(bool useSxShare)
 {
 #ifdef Q_OS_WIN
@@ -48,6 +52,7 @@ void ShellExtensions::enable(bool useSxShare)
         return;
     mEnabled = true;
     QString profile = mConfig->profile();
+    Registration registration;
 
     foreach (QString volume, mConfig->volumes()) {
         QString applicationName = QApplication::applicationName() + "#" + volume;
@@ -57,24 +62,25 @@ void ShellExtensions::enable(bool useSxShare)
         if (!profile.isEmpty())
             cmd+= " --profile "+profile;
 
-        QSettings key("HKEY_CURRENT_USER\\Software\\Classes\\*\\shell\\"+applicationName, QSettings::NativeFormat);
-        key.setValue("MUIVerb", __applicationName);
-        key.setValue("SubCommands", "");
-        key.setValue("AppliesTo", "System.ItemPathDisplay:~< \""+nativePath+"\"");
-        key.setValue("shell/cmd1/.", tr("Share file"));
-        key.setValue("shell/cmd1/command/.", cmd+" --share \"%1\"");
-        key.setValue("shell/cmd2/.", tr("Show revisions"));
-        key.setValue("shell/cmd2/command/.", cmd+" --rev \"%1\"");
+        Values &key = registration[sFileShellRoot][applicationName];
+        key.insert("MUIVerb", __applicationName);
+        key.insert("SubCommands", "");
+        key.insert("AppliesTo", "System.ItemPathDisplay:~< \""+nativePath+"\"");
+        key.insert("shell/cmd1/.", tr("Share file"));
+        key.insert("shell/cmd1/command/.", cmd+" --share \"%1\"");
+        key.insert("shell/cmd2/.", tr("Show revisions"));
+        key.insert("shell/cmd2/command/.", cmd+" --rev \"%1\"");
 
         if (useSxShare) {
-            QSettings dir_key("HKEY_CURRENT_USER\\Software\\Classes\\Folder\\shell\\"+applicationName, QSettings::NativeFormat);
-            dir_key.setValue("MUIVerb", __applicationName);
-            dir_key.setValue("SubCommands", "");
-            dir_key.setValue("AppliesTo", QString("System.ItemPathDisplay:~< \"%1\" AND System.ItemPathDisplay:<> \"%1\"").arg(nativePath));
-            dir_key.setValue("shell/cmd1/.", tr("Share directory"));
-            dir_key.setValue("shell/cmd1/command/.", cmd+" --share \"%1/\"");
+            Values &dir_key = registration[sFolderShellRoot][applicationName];
+            dir_key.insert("MUIVerb", __applicationName);
+            dir_key.insert("SubCommands", "");
+            dir_key.insert("AppliesTo", QString("System.ItemPathDisplay:~< \"%1\" AND System.ItemPathDisplay:<> \"%1\"").arg(nativePath));
+            dir_key.insert("shell/cmd1/.", tr("Share directory"));
+            dir_key.insert("shell/cmd1/command/.", cmd+" --share \"%1/\"");
         }
     }
+    _schedule(registration);
 #else
     Q_UNUSED(useSxShare)
 #endif
@@ -84,25 +90,7 @@ void ShellExtensions::disable()
 {
 #ifdef Q_OS_WIN
     mEnabled = false;
-    QString applicationName = QApplication::applicationName();
-    QStringList toRemove = { applicationName };
-    QSettings key("HKEY_CURRENT_USER\\Software\\Classes\\*\\shell", QSettings::NativeFormat);
-    foreach (QString entry, key.childGroups()) {
-        if (entry.startsWith(applicationName+"#"))
-            toRemove.append(entry);
-    }
-    foreach (QString entry, toRemove) {
-        key.remove(entry);
-    }
-    toRemove = QStringList{ applicationName };
-    QSettings dir_key("HKEY_CURRENT_USER\\Software\\Classes\\Folder\\shell", QSettings::NativeFormat);
-    foreach (QString entry, dir_key.childGroups()) {
-        if (entry.startsWith(applicationName+"#"))
-            toRemove.append(entry);
-    }
-    foreach (QString entry, toRemove) {
-        dir_key.remove(entry);
-    }
+    _schedule(Registration());
 #endif
 }
 
@@ -116,9 +104,77 @@ bool ShellExtensions::enabled() const
     return mEnabled;
 }
 
+void ShellExtensions::waitForRegistration()
+{
+    mMutex.lock();
+    QFuture<void> worker = mWorker;
+    mMutex.unlock();
+    worker.waitForFinished();
+}
+
 ShellExtensions::ShellExtensions() : QObject(0)
 {
     mConfig = nullptr;
     mEnabled = false;
+    mHavePending = false;
+    mWorkerRunning = false;
+    mAppliedValid = false;
 }
 
+void ShellExtensions::_schedule(const Registration &registration)
+{
+    QMutexLocker locker(&mMutex);
+    // only the latest registration is written, older pending ones are dropped
+    mPending = registration;
+    mHavePending = true;
+    if (!mWorkerRunning) {
+        mWorkerRunning = true;
+        mWorker = QtConcurrent::run([this]() { _apply(); });
+    }
+}
+
+void ShellExtensions::_apply()
+{
+    forever {
+        Registration registration;
+        {
+            QMutexLocker locker(&mMutex);
+            if (!mHavePending) {
+                mWorkerRunning = false;
+                return;
+            }
+            registration = mPending;
+            mHavePending = false;
+        }
+        if (mAppliedValid && registration == mApplied)
+            continue;
+        _applyRoot(sFileShellRoot, registration.value(sFileShellRoot));
+        _applyRoot(sFolderShellRoot, registration.value(sFolderShellRoot));
+        mApplied = registration;
+        mAppliedValid = true;
+    }
+}
+
+void ShellExtensions::_applyRoot(const QString &root, const Entries &entries)
+{
+#ifdef Q_OS_WIN
+    QString applicationName = QApplication::applicationName();
+    QSettings key("HKEY_CURRENT_USER\\Software\\Classes\\"+root, QSettings::NativeFormat);
+    foreach (QString entry, key.childGroups()) {
+        if ((entry == applicationName || entry.startsWith(applicationName+"#")) && !entries.contains(entry))
+            key.remove(entry);
+    }
+    for (auto entry = entries.constBegin(); entry != entries.constEnd(); ++entry) {
+        key.beginGroup(entry.key());
+        for (auto value = entry.value().constBegin(); value != entry.value().constEnd(); ++value) {
+            QVariant current = key.value(value.key());
+            if (!current.isValid() || current.toString() != value.value())
+                key.setValue(value.key(), value.value());
+        }
+        key.endGroup();
+    }
+#else
+    Q_UNUSED(root)
+    Q_UNUSED(entries)
+#endif
+}
@@ -31,8 +31,13 @@
 
 #include <QString>
 #include <QObject>
+#include <QHash>
+#include <QMutex>
+#include <QFuture>
 #include "sxconfig.h"
 
+/* Explorer context menu entries. The wanted entries are compared with the
+ * registry on a worker thread and only the differences are written */
 class ShellExtensions: public QObject
 {
     Q_OBJECT
@@ -42,10 +47,26 @@ public:
     void disable();
     void setConfig(SxConfig *config);
     bool enabled() const;
+    void waitForRegistration();
 private:
+    // root key -> entry -> registry values
+    typedef QHash<QString, QString> Values;
+    typedef QHash<QString, Values> Entries;
+    typedef QHash<QString, Entries> Registration;
+
     ShellExtensions();
+    void _schedule(const Registration &registration);
+    void _apply();
+    static void _applyRoot(const QString &root, const Entries &entries);
     SxConfig *mConfig;
     bool mEnabled;
+    QMutex mMutex;
+    Registration mPending;
+    bool mHavePending;
+    bool mWorkerRunning;
+    QFuture<void> mWorker;
+    Registration mApplied;
+    bool mAppliedValid;
 };
 
 #endif // SHELLEXTENSIONS_H
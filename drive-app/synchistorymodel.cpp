@@ -34,14 +34,17 @@
 
 SyncHistoryModel::SyncHistoryModel()
 {
-    SxDatabase::instance().getHistoryRowIds(mRowIds);
+    mCanFetchMore = true;
+    SxDatabase::instance().getHistoryEntries(mEntries, -1, sPageSize);
+    if (mEntries.size() < sPageSize)
+        mCanFetchMore = false;
     connect(&SxDatabase::instance(), &SxDatabase::sig_historyChanged, this, &SyncHistoryModel::onHistoryChanged);
 }
 
 QModelIndex SyncHistoryModel::index(int row, int column, const QModelIndex &parent) const
 {
     Q_UNUSED(parent);
-    if (column == 0 && row < mRowIds.size())
+    if (column == 0 && row < mEntries.size())
         return createIndex(row, column);
     return QModelIndex();
 }
@@ -55,7 +58,31 @@ QModelIndex SyncHistoryModel::parent(const QModelIndex &child) const
 int SyncHistoryModel::rowCount(const QModelIndex &parent) const
 {
     Q_UNUSED(parent);
-    return mRowIds.count();
+    return mEntries.count();
+}
+
+bool SyncHistoryModel::canFetchMore(const QModelIndex &parent) const
+{
+    if (parent.isValid())
+        return false;
+    return mCanFetchMore && !mEntries.isEmpty() && mEntries.size() < sMaxRows;
+}
+
+void SyncHistoryModel::fetchMore(const QModelIndex &parent)
+{
+    if (parent.isValid() || mEntries.isEmpty())
+        return;
+    QList<SxDatabase::HistoryEntry> page;
+    int limit = qMin(sPageSize, sMaxRows - mEntries.size());
+    if (!SxDatabase::instance().getHistoryEntries(page, mEntries.last().rowId, limit) || page.isEmpty()) {
+        mCanFetchMore = false;
+        return;
+    }
+    if (page.size() < limit)
+        mCanFetchMore = false;
+    beginInsertRows(QModelIndex(), mEntries.size(), mEntries.size()+page.size()-1);
+    mEntries.append(page);
+    endInsertRows();
 }
 
 int SyncHistoryModel::columnCount(const QModelIndex &parent) const
@@ -101,52 +128,47 @@ QString SyncHistoryModel::timestampToFriendlyString(const QDateTime &now, const
 QVariant SyncHistoryModel::data(const QModelIndex &index, int role) const
 {
     if ((role == Qt::DisplayRole || role == PathRole || role == EventDateRole || role == IconRole || role == ActionRole)
-            && index.row() < mRowIds.size())
+            && index.row() < mEntries.size())
     {
-        QString path;
-        uint32_t eventDate;
-        SxDatabase::ACTION eventType;
-        qint64 rowId = mRowIds.value(index.row());
-        if (SxDatabase::instance().getHistoryEntry(rowId, path, eventDate, eventType )) {
-            if (role == EventDateRole)
-            {
-                return QVariant(timestampToFriendlyString(QDateTime::currentDateTimeUtc(), QDateTime::fromTime_t(eventDate)));
-            }
-            else if (role == PathRole)
-            {
-                return QVariant(path);
-            }
-            else if (role == ActionRole)
-            {
-                QString iconName;
-                switch (eventType) {
-                case SxDatabase::ACTION::UPLOAD:
-                    iconName = "activity-upload";
-                    break;
-                case SxDatabase::ACTION::DOWNLOAD:
-                    iconName = "activity-download";
-                    break;
-                case SxDatabase::ACTION::REMOVE_LOCAL:
-                    iconName = "activity-removed-l";
-                    break;
-                case SxDatabase::ACTION::REMOVE_REMOTE:
-                    iconName = "activity-removed-r";
-                    break;
-                case SxDatabase::ACTION::SKIP:
-                    return QVariant();
-                }
-                if (isRetina())
-                    iconName += "@2x";
-                iconName += ".png";
-                return QPixmap(":/mime/"+iconName);
-            }
-            else // IconRole
-            {
-                QMimeDatabase mimeDatabase;
-                auto mimeType = mimeDatabase.mimeTypeForName(path);
-                auto iconName = builtInIconForMime(mimeType.genericIconName());
-                return QPixmap(":/mime/"+iconName);
+        const SxDatabase::HistoryEntry &entry = mEntries.at(index.row());
+        if (role == EventDateRole)
+        {
+            return QVariant(timestampToFriendlyString(QDateTime::currentDateTimeUtc(), QDateTime::fromTime_t(entry.eventDate)));
+        }
+        else if (role == PathRole)
+        {
+            return QVariant(entry.path);
+        }
+        else if (role == ActionRole)
+        {
+            QString iconName;
+            switch (entry.action) {
+            case SxDatabase::ACTION::UPLOAD:
+                iconName = "activity-upload";
+                break;
+            case SxDatabase::ACTION::DOWNLOAD:
+                iconName = "activity-download";
+                break;
+            case SxDatabase::ACTION::REMOVE_LOCAL:
+                iconName = "activity-removed-l";
+                break;
+            case SxDatabase::ACTION::REMOVE_REMOTE:
+                iconName = "activity-removed-r";
+                break;
+            case SxDatabase::ACTION::SKIP:
+                return QVariant();
             }
+            if (isRetina())
+                iconName += "@2x";
+            iconName += ".png";
+            return QPixmap(":/mime/"+iconName);
+        }
+        else // IconRole
+        {
+            QMimeDatabase mimeDatabase;
+            auto mimeType = mimeDatabase.mimeTypeForName(entry.path);
+            auto iconName = builtInIconForMime(mimeType.genericIconName());
+            return QPixmap(":/mime/"+iconName);
         }
     }
     return QVariant();
@@ -154,15 +176,31 @@ QVariant SyncHistoryModel::data(const QModelIndex &index, int role) const
 
 void SyncHistoryModel::onHistoryChanged(qint64 rowId, qint64 removeRowId)
 {
-    beginInsertRows(QModelIndex(), 0, 0);
-    mRowIds.insert(0, rowId);
-    endInsertRows();
-    if (removeRowId != -1) {
-        int index = mRowIds.indexOf(removeRowId);
-        while (index < mRowIds.size()-1) {
-            beginRemoveRows(QModelIndex(), index+1, index+1);
-            mRowIds.removeAt(index+1);
-            endRemoveRows();
+    if (mEntries.isEmpty() || rowId > mEntries.first().rowId) {
+        // one query brings in every row added since the newest cached one
+        QList<SxDatabase::HistoryEntry> newEntries;
+        qint64 newestRowId = mEntries.isEmpty() ? -1 : mEntries.first().rowId;
+        if (SxDatabase::instance().getNewHistoryEntries(newEntries, newestRowId, sMaxRows) && !newEntries.isEmpty()) {
+            beginInsertRows(QModelIndex(), 0, newEntries.size()-1);
+            newEntries.append(mEntries);
+            mEntries.swap(newEntries);
+            endInsertRows();
         }
     }
+    if (removeRowId != -1) {
+        int index = mEntries.size();
+        while (index > 1 && mEntries.at(index-1).rowId < removeRowId)
+            index--;
+        _evictRows(index);
+    }
+    _evictRows(sMaxRows);
+}
+
+void SyncHistoryModel::_evictRows(int first)
+{
+    if (first >= mEntries.size())
+        return;
+    beginRemoveRows(QModelIndex(), first, mEntries.size()-1);
+    mEntries.erase(mEntries.begin()+first, mEntries.end());
+    endRemoveRows();
 }
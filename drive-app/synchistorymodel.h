@@ -48,13 +48,19 @@ public:
     QModelIndex parent(const QModelIndex &child) const override;
     int rowCount(const QModelIndex &parent) const override;
     int columnCount(const QModelIndex &parent) const override;
+    bool canFetchMore(const QModelIndex &parent) const override;
+    void fetchMore(const QModelIndex &parent) override;
     QVariant data(const QModelIndex &index, int role) const override;
 private slots:
     void onHistoryChanged(qint64 rowId, qint64 removeRowId);
 private:
     static QString timestampToFriendlyString(const QDateTime& now, const QDateTime& pastDate);
 private:
-    QList<qint64> mRowIds;
+    void _evictRows(int first);
+    QList<SxDatabase::HistoryEntry> mEntries;
+    bool mCanFetchMore;
+    static const int sPageSize = 100;
+    static const int sMaxRows = 1000;
 };
 
 #endif // SYNCHISTORYMODEL_H
@@ -57,8 +57,13 @@ TrayIconController::TrayIconController(QSystemTrayIcon *tray, ContextMenu *conte
     mTimer = new QTimer(this);
     mAnimationFrame = 0;
     mTray->setIcon(generateIcon());
-    connect(mTimer, &QTimer::timeout, this, &TrayIconController::updateIcon);
-    mTimer->start(200);
+    connect(mTimer, &QTimer::timeout, this, &TrayIconController::nextFrame);
+    const SxState *state = &mSxController->sxState();
+    connect(state, &SxState::sig_statusChanged, this, &TrayIconController::updateIcon);
+    connect(state, &SxState::sig_appendRow, this, &TrayIconController::updateIcon);
+    connect(state, &SxState::sig_removeRow, this, &TrayIconController::updateIcon);
+    connect(state, &SxState::sig_clear, this, &TrayIconController::updateIcon);
+    updateTimer();
 }
 
 void TrayIconController::generateShape()
@@ -87,13 +92,18 @@ void TrayIconController::generateShape()
 QIcon TrayIconController::generateIcon()
 {
     QStringList stateIcons = sBaseIcons.value(static_cast<int>(mLastStatus));
-    QString iconPath = stateIcons.at(mAnimationFrame);
+    int frame = mAnimationFrame;
+    mAnimationFrame = (mAnimationFrame + 1) % stateIcons.length();
+    int key = static_cast<int>(mLastStatus) << 8 | (mWarnings ? 0x80 : 0) | frame;
+    auto cached = mFrames.constFind(key);
+    if (cached != mFrames.constEnd())
+        return cached.value();
+    QString iconPath = stateIcons.at(frame);
     if (!mShape.isNull())
         iconPath = mBaseDir + iconPath.mid(8);
     QPixmap pixmap(iconPath);
     QPixmap result(pixmap.size());
     result.fill(Qt::transparent);
-    mAnimationFrame = (mAnimationFrame + 1) % stateIcons.length();
     QPainter painter(&result);
     QRectF target(0, 0, pixmap.width(), pixmap.height());
     if (!mShape.isNull()) {
@@ -109,7 +119,25 @@ QIcon TrayIconController::generateIcon()
         QRectF source(0, 0, warningPixmap.width(), warningPixmap.height());
         painter.drawPixmap(target, warningPixmap, source);
     }
-    return QIcon(result);
+    painter.end();
+    QIcon icon(result);
+    mFrames.insert(key, icon);
+    return icon;
+}
+
+void TrayIconController::updateTimer()
+{
+    if (sBaseIcons.value(static_cast<int>(mLastStatus)).count() > 1) {
+        if (!mTimer->isActive())
+            mTimer->start(sAnimationInterval);
+    }
+    else
+        mTimer->stop();
+}
+
+void TrayIconController::nextFrame()
+{
+    mTray->setIcon(generateIcon());
 }
 
 void TrayIconController::updateIcon()
@@ -174,11 +202,7 @@ void TrayIconController::updateIcon()
         emit sig_stateChanged(mLastStatus);
         mAnimationFrame = 0;
         mTray->setIcon(generateIcon());
-    }
-    else {
-        if (sBaseIcons.value(static_cast<int>(mLastStatus)).count() > 1) {
-            mTray->setIcon(generateIcon());
-        }
+        updateTimer();
     }
 }
 
@@ -186,5 +210,6 @@ void TrayIconController::updateShape(QPair<QString, QString> &shapeDesc)
 {
     mShapeDesc = shapeDesc;
     generateShape();
+    mFrames.clear();
     mTray->setIcon(generateIcon());
 }
@@ -29,6 +29,7 @@
 #ifndef TRAYICONCONTROLLER_H
 #define TRAYICONCONTROLLER_H
 
+#include <QHash>
 #include <QObject>
 #include "sxcontroller.h"
 #include <QSystemTrayIcon>
@@ -44,10 +45,12 @@ public:
 private:
     void generateShape();
     QIcon generateIcon();
+    void updateTimer();
 public slots:
     void updateShape(QPair<QString, QString> &shapeDesc);
 private slots:
     void updateIcon();
+    void nextFrame();
 signals:
     void sig_stateChanged(SxStatus status);
 private:
@@ -61,6 +64,9 @@ private:
     QPair<QString, QString> mShapeDesc;
     QPixmap mShape;
     QString mBaseDir;
+    // rendered icons by status, warning flag and animation frame, dropped when the mark changes
+    QHash<int, QIcon> mFrames;
+    static const int sAnimationInterval = 200;
 };
 
 #endif // TRAYICONCONTROLLER_H
@@ -30,6 +30,7 @@
 #include "whitelabel.h"
 #include "util.h"
 #include "getpassworddialog.h"
+#include "sxdatabase.h"
 #include <QDir>
 #include <QMessageBox>
 #include <QSet>
@@ -269,6 +270,13 @@ void VolumesWidget::updateVolumes(QString vcluster, QList<SxVolumeEntry> &volume
             bar->setMaximum(100);
             if(vol.size())
                 bar->setValue(static_cast<int>(100.0*vol.usedSize()/vol.size()));
+            SxDatabase::VolumeStats stats;
+            if (config.contains(volume) && SxDatabase::instance().getVolumeStats(volume, stats))
+                bar->setToolTip(tr("%1 of %2 files synchronised (%3 / %4)")
+                                .arg(stats.localFiles).arg(stats.remoteFiles)
+                                .arg(formatSize(stats.localBytes)).arg(formatSize(stats.remoteBytes)));
+            else
+                bar->setToolTip(QString());
             bar->show();
         }
         else
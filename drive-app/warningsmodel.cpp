@@ -0,0 +1,92 @@
+/*
+ *  Copyright (C) 2012-2016 Skylable Ltd. <info-copyright@skylable.com>
+ *
+ *  This program is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public License
+ *  as published by the Free Software Foundation; either version 2
+ *  of the License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA.
+ *
+ *  Special exception for linking this software with OpenSSL:
+ *
+ *  In addition, as a special exception, Skylable Ltd. gives permission to
+ *  link the code of this program with the OpenSSL library and distribute
+ *  linked combinations including the two. You must obey the GNU General
+ *  Public License in all respects for all of the code used other than
+ *  OpenSSL. You may extend this exception to your version of the program,
+ *  but you are not obligated to do so. If you do not wish to do so, delete
+ *  this exception statement from your version.
+ */
+
+#include "warningsmodel.h"
+#include <QCoreApplication>
+
+WarningsModel::WarningsModel(const SxState *sxState, QObject *parent) : QAbstractTableModel(parent)
+{
+    mSxState = sxState;
+    mRows = mSxState->warningsCount();
+    connect(mSxState, &SxState::sig_appendRow, this, &WarningsModel::onAppendRow);
+    connect(mSxState, &SxState::sig_removeRow, this, &WarningsModel::onRemoveRow);
+    connect(mSxState, &SxState::sig_clear, this, &WarningsModel::onClear);
+}
+
+int WarningsModel::rowCount(const QModelIndex &parent) const
+{
+    if (parent.isValid())
+        return 0;
+    return mRows;
+}
+
+int WarningsModel::columnCount(const QModelIndex &parent) const
+{
+    if (parent.isValid())
+        return 0;
+    return 2;
+}
+
+QVariant WarningsModel::data(const QModelIndex &index, int role) const
+{
+    if (!index.isValid() || index.row() >= mRows || role != Qt::DisplayRole)
+        return QVariant();
+    const SxWarning &warning = mSxState->warning(index.row());
+    if (index.column() == 0)
+        return warning.eventDate().toString("dd.MM.yyyy hh:mm:ss");
+    return warning.message();
+}
+
+QVariant WarningsModel::headerData(int section, Qt::Orientation orientation, int role) const
+{
+    if (orientation != Qt::Horizontal || role != Qt::DisplayRole)
+        return QAbstractTableModel::headerData(section, orientation, role);
+    // the strings were translated for the table widget this model replaced
+    return section == 0 ? QCoreApplication::translate("WarningsTable", "date") : QCoreApplication::translate("WarningsTable", "message");
+}
+
+void WarningsModel::onRemoveRow(int index)
+{
+    beginRemoveRows(QModelIndex(), index, index);
+    --mRows;
+    endRemoveRows();
+}
+
+void WarningsModel::onAppendRow()
+{
+    beginInsertRows(QModelIndex(), mRows, mRows);
+    ++mRows;
+    endInsertRows();
+}
+
+void WarningsModel::onClear()
+{
+    beginResetModel();
+    mRows = 0;
+    endResetModel();
+}
@@ -0,0 +1,55 @@
+/*
+ *  Copyright (C) 2012-2016 Skylable Ltd. <info-copyright@skylable.com>
+ *
+ *  This program is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public License
+ *  as published by the Free Software Foundation; either version 2
+ *  of the License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA.
+ *
+ *  Special exception for linking this software with OpenSSL:
+ *
+ *  In addition, as a special exception, Skylable Ltd. gives permission to
+ *  link the code of this program with the OpenSSL library and distribute
+ *  linked combinations including the two. You must obey the GNU General
+ *  Public License in all respects for all of the code used other than
+ *  OpenSSL. You may extend this exception to your version of the program,
+ *  but you are not obligated to do so. If you do not wish to do so, delete
+ *  this exception statement from your version.
+ */
+
+#ifndef WARNINGSMODEL_H
+#define WARNINGSMODEL_H
+
+#include <QAbstractTableModel>
+#include "sxstate.h"
+
+/* Date and message of every warning in SxState, read only for the rows a view asks for */
+class WarningsModel : public QAbstractTableModel
+{
+    Q_OBJECT
+public:
+    WarningsModel(const SxState *sxState, QObject *parent = nullptr);
+    int rowCount(const QModelIndex &parent) const override;
+    int columnCount(const QModelIndex &parent) const override;
+    QVariant data(const QModelIndex &index, int role) const override;
+    QVariant headerData(int section, Qt::Orientation orientation, int role) const override;
+private slots:
+    void onRemoveRow(int index);
+    void onAppendRow();
+    void onClear();
+private:
+    const SxState *mSxState;
+    // follows the signals of SxState, which change its warnings before they are emitted
+    int mRows;
+};
+
+#endif // WARNINGSMODEL_H
@@ -27,61 +27,17 @@
  */
 
 #include "warningstable.h"
+#include "warningsmodel.h"
+#include <QDateTime>
 #include <QHeaderView>
-#include <QTimer>
 
-WarningsTable::WarningsTable(const SxState *sxState, QWidget *parent) : QTableWidget(parent)
+WarningsTable::WarningsTable(const SxState *sxState, QWidget *parent) : QTableView(parent)
 {
-    mFirstPaint = true;
-    mSxState = sxState;
-    setColumnCount(2);
-    setHorizontalHeaderItem(0, new QTableWidgetItem(tr("date")));
-    setHorizontalHeaderItem(1, new QTableWidgetItem(tr("message")));
+    setModel(new WarningsModel(sxState, this));
     horizontalHeader()->setStretchLastSection(true);
-    QTimer::singleShot(0, this, SLOT(reloadWarnings()));
-    connect(mSxState, &SxState::sig_appendRow, this, &WarningsTable::onAppendRow);
-    connect(mSxState, &SxState::sig_removeRow, this, &WarningsTable::onRemoveRow);
-    connect(mSxState, &SxState::sig_clear, this, &WarningsTable::onClear);
-}
-
-void WarningsTable::reloadWarnings()
-{
-    auto warnings = mSxState->warnings();
-    setRowCount(warnings.count());
-    for (int i=0; i<warnings.count(); i++) {
-        const SxWarning &w = warnings.at(i);
-        setItem(i, 0, new QTableWidgetItem(w.eventDate().toString("dd.MM.yyyy hh:mm:ss")));
-        setItem(i, 1, new QTableWidgetItem(w.message()));
-    }
-    resizeColumnToContents(0);
-}
-
-void WarningsTable::onRemoveRow(int index)
-{
-    removeRow(index);
-}
-
-void WarningsTable::onAppendRow(const QDateTime &eventDate, const QString &message)
-{
-    int index = rowCount();
-    insertRow(index);
-    setItem(index, 0, new QTableWidgetItem(eventDate.toString("dd.MM.yyyy hh:mm:ss")));
-    setItem(index, 1, new QTableWidgetItem(message));
-    resizeColumnToContents(0);
-    resizeRowToContents(index);
-}
-
-void WarningsTable::onClear()
-{
-    clearContents();
-    setRowCount(0);
-}
-
-void WarningsTable::paintEvent(QPaintEvent *e)
-{
-    if (mFirstPaint) {
-        mFirstPaint = false;
-        QTimer::singleShot(0, this, SLOT(resizeRowsToContents()));
-    }
-    QTableWidget::paintEvent(e);
+    // fixed sizes, resizing to contents would measure every row
+    verticalHeader()->setSectionResizeMode(QHeaderView::Fixed);
+    verticalHeader()->setDefaultSectionSize(fontMetrics().height()+6);
+    setColumnWidth(0, fontMetrics().width(QDateTime::currentDateTime().toString("dd.MM.yyyy hh:mm:ss"))+12);
+    setWordWrap(false);
 }
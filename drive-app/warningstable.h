@@ -29,24 +29,14 @@
 #ifndef WARNINGSTABLE_H
 #define WARNINGSTABLE_H
 
-#include <QTableWidget>
+#include <QTableView>
 #include "sxstate.h"
 
-class WarningsTable : public QTableWidget
+class WarningsTable : public QTableView
 {
     Q_OBJECT
 public:
     explicit WarningsTable(const SxState* sxState, QWidget *parent = 0);
-private slots:
-    void reloadWarnings();
-    void onRemoveRow(int index);
-    void onAppendRow(const QDateTime &eventDate, const QString &message);
-    void onClear();
-    void paintEvent(QPaintEvent *e) override;
-private:
-    const SxState *mSxState;
-    bool mFirstPaint;
-
 };
 
 #endif // WARNINGSTABLE_H
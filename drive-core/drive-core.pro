@@ -5,31 +5,55 @@
 #-------------------------------------------------
 
 QT       -= gui
-QT       += sql network core
+QT       += sql network core concurrent
 
 TARGET = drive-core
 TEMPLATE = lib
 CONFIG += staticlib c++11
 CONFIG += debug_and_release
+# Entry and Debug log lines are compiled out of release builds
+CONFIG(release, debug|release): DEFINES += SXLOG_MIN_LEVEL=2
 DEFINES += LIB_LIBRARY
 QMAKE_MAC_SDK = macosx10.11
 
 SOURCES += sxconfig.cpp \
     sxdatabase.cpp \
+    sxdatabasewriter.cpp \
+    sxfileindex.cpp \
     sxcontroller.cpp \
     sxqueue.cpp \
     sxfilesystem.cpp \
     sxstate.cpp \
     sxvolumeentry.cpp \
+    sxblockreuse.cpp \
+    sxtransferlane.cpp \
+    sxmetricsserver.cpp \
+    sxpeerexchange.cpp \
+    sxpathmatcher.cpp \
+    sxpathtable.cpp \
+    sxgovernor.cpp \
+    sxsyncstatus.cpp \
+    sxprogressaggregator.cpp \
     uploadqueue.cpp
 
 HEADERS += sxconfig.h \
     sxdatabase.h \
+    sxdatabasewriter.h \
+    sxfileindex.h \
     sxcontroller.h \
     sxqueue.h \
     sxfilesystem.h \
     sxstate.h \
     sxvolumeentry.h \
+    sxblockreuse.h \
+    sxtransferlane.h \
+    sxmetricsserver.h \
+    sxpeerexchange.h \
+    sxpathmatcher.h \
+    sxpathtable.h \
+    sxgovernor.h \
+    sxsyncstatus.h \
+    sxprogressaggregator.h \
     uploadqueue.h
 
 unix {
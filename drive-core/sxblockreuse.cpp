@@ -0,0 +1,123 @@
+/*
+ *  Copyright (C) 2012-2016 Skylable Ltd. <info-copyright@skylable.com>
+ *
+ *  This program is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public License
+ *  as published by the Free Software Foundation; either version 2
+ *  of the License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA.
+ *
+ *  Special exception for linking this software with OpenSSL:
+ *
+ *  In addition, as a special exception, Skylable Ltd. gives permission to
+ *  link the code of this program with the OpenSSL library and distribute
+ *  linked combinations including the two. You must obey the GNU General
+ *  Public License in all respects for all of the code used other than
+ *  OpenSSL. You may extend this exception to your version of the program,
+ *  but you are not obligated to do so. If you do not wish to do so, delete
+ *  this exception statement from your version.
+ */
+
+#include "sxblockreuse.h"
+#include "sxblock.h"
+#include "sxbufferpool.h"
+#include "sxlog.h"
+#include "xfile.h"
+
+#include <algorithm>
+#include <cstring>
+#include <QMutex>
+#include <QtConcurrent>
+
+SxBlockReuse::SxBlockReuse(int blockSize, const QByteArray &salt)
+{
+    mBlockSize = blockSize;
+    mSalt = salt;
+}
+
+void SxBlockReuse::addCandidate(const QString &sourceFile, qint64 offset, const QString &hash)
+{
+    mCandidates[sourceFile].append({offset, hash});
+}
+
+bool SxBlockReuse::fill(QFile *target, qint64 fileSize, const QHash<QString, QList<qint64>> &targetOffsets, QSet<QString> &missingBlocks)
+{
+    QMutex mutex;
+    bool writeFailed = false;
+    // reflinks share the extents of the source instead of writing a copy, the first
+    // failure before any success means the filesystem (or the pair of files) can't do it
+    bool cloneSupported = true;
+    int cloned = 0;
+    QSet<QString> found;
+
+    auto processFile = [&](const QString &sourceFile) {
+        QList<Candidate> candidates = mCandidates.value(sourceFile);
+        std::sort(candidates.begin(), candidates.end(), [](const Candidate &c1, const Candidate &c2) {
+            return c1.offset < c2.offset;
+        });
+        QFile localFile(sourceFile);
+        if (!localFile.open(QIODevice::ReadOnly))
+            return;
+        SxPooledBuffer data(mBlockSize);
+        foreach (const Candidate &candidate, candidates) {
+            {
+                QMutexLocker locker(&mutex);
+                if (writeFailed)
+                    return;
+                if (found.contains(candidate.hash))
+                    continue;
+            }
+            if (localFile.pos() != candidate.offset && !localFile.seek(candidate.offset))
+                continue;
+            qint64 bytes = localFile.read(data.data(), mBlockSize);
+            if (bytes <= 0)
+                break;
+            if (bytes < mBlockSize)
+                memset(data.data()+bytes, 0, static_cast<size_t>(mBlockSize-bytes));
+            if (QString::fromUtf8(SxBlock::hashBlock(data.constData(), mBlockSize, mSalt)) != candidate.hash)
+                continue;
+
+            QMutexLocker locker(&mutex);
+            if (found.contains(candidate.hash))
+                continue;
+            found.insert(candidate.hash);
+            foreach (qint64 writeOffset, targetOffsets.value(candidate.hash)) {
+                qint64 toWrite = mBlockSize;
+                if (writeOffset + mBlockSize > fileSize)
+                    toWrite = fileSize - writeOffset;
+                if (cloneSupported) {
+                    if (XFile::cloneRange(&localFile, candidate.offset, target, writeOffset, toWrite)) {
+                        ++cloned;
+                        continue;
+                    }
+                    if (!cloned) {
+                        logVerbose("block cloning not supported, copying data");
+                        cloneSupported = false;
+                    }
+                }
+                if (!XFile::writeAt(target, writeOffset, data.constData(), toWrite)) {
+                    logWarning("write failed");
+                    writeFailed = true;
+                    return;
+                }
+            }
+        }
+    };
+
+    QStringList sourceFiles = mCandidates.keys();
+    QtConcurrent::blockingMap(sourceFiles, processFile);
+    if (writeFailed)
+        return false;
+    if (cloned)
+        logVerbose(QString("cloned %1 local blocks").arg(cloned));
+    missingBlocks = targetOffsets.keys().toSet() - found;
+    return true;
+}
@@ -55,6 +55,14 @@ namespace configKeys
     static const char *TRAY_ICON_MARK {"trayIconMark"};
     static const char *TRAY_ICON_MARK_COLOR {"trayIconMarkColor"};
     static const char *NEXT_SURVEY_TIME {"nextSurveyTime"};
+    static const char *UPLOAD_LIMIT {"uploadLimit"};
+    static const char *DOWNLOAD_LIMIT {"downloadLimit"};
+    static const char *BANDWIDTH_SCHEDULE {"bandwidthSchedule"};
+    static const char *SMALL_TASK_SIZE {"smallTaskSize"};
+    static const char *LARGE_TASK_MAX_WAIT {"largeTaskMaxWait"};
+    static const char *TRANSFER_MEMORY_BUDGET {"transferMemoryBudget"};
+    static const char *METRICS_PORT {"metricsPort"};
+    static const char *PEER_EXCHANGE_PORT {"peerExchangePort"};
 //VOLUMES_CONFIG
     static const char *SX_VOLUME{ "sxVolume" };
     static const char *IGNORED_PATHS { "ignoredPaths" };
@@ -69,7 +77,10 @@ SxConfig::SxConfig(QString profile)
     mSettings = new QSettings();
     mClusterConfig = new ClusterConfig(*mSettings, mMutex);
     convertOldVolume();
-    mDesktopConfig = new DesktopConfig(*mSettings, mProfile, mMutex);
+    mDesktopConfig = new DesktopConfig(*mSettings, mProfile, mMutex, *this);
+    mMutex.lock();
+    _publishSnapshot();
+    mMutex.unlock();
     testVolumes();
 }
 
@@ -100,18 +111,12 @@ QString SxConfig::profile() const
 
 QStringList SxConfig::volumes() const
 {
-    QMutexLocker locker(&mMutex);
-    QStringList list;
-    mSettings->beginGroup("volumes");
-    list = mSettings->childGroups();
-    mSettings->endGroup();
-    return list;
+    return snapshot()->volumes;
 }
 
 VolumeConfig SxConfig::volume(QString name) const
 {
-    QMutexLocker locker(&mMutex);
-    return VolumeConfig(*mSettings, name, mMutex);
+    return VolumeConfig(*this, name);
 }
 
 ClusterConfig &SxConfig::clusterConfig()
@@ -131,6 +136,7 @@ void SxConfig::addVolumeConfig(const QString &volume, const QString &localPath)
     QMutexLocker locker(&mMutex);
     mSettings->setValue(VolumeConfig::_configKey(volume, configKeys::LOCAL_PATH), localPath);
     mSettings->sync();
+    _publishSnapshot();
 }
 
 void SxConfig::addVolumeConfig(const QString &volume, const QHash<QString, QVariant> &config)
@@ -141,6 +147,7 @@ void SxConfig::addVolumeConfig(const QString &volume, const QHash<QString, QVari
         mSettings->setValue(VolumeConfig::_configKey(volume, key), val);
     }
     mSettings->sync();
+    _publishSnapshot();
 }
 
 void SxConfig::removeVolumeConfig(const QString &volume)
@@ -162,6 +169,7 @@ void SxConfig::removeVolumeConfig(const QString &volume)
     mSettings->endGroup();
 #endif
     mSettings->sync();
+    _publishSnapshot();
 }
 
 void SxConfig::syncConfig()
@@ -171,9 +179,16 @@ void SxConfig::syncConfig()
 
 void SxConfig::clear()
 {
+    QMutexLocker locker(&mMutex);
     foreach (QString key, mSettings->allKeys()) {
         mSettings->remove(key);
     }
+    _publishSnapshot();
+}
+
+std::shared_ptr<const SxConfigSnapshot> SxConfig::snapshot() const
+{
+    return std::atomic_load(&mSnapshot);
 }
 
 void SxConfig::convertOldVolume()
@@ -211,6 +226,58 @@ void SxConfig::testVolumes()
     }
 }
 
+void SxConfig::_publishSnapshot() const
+{
+    // called with the mutex held; the path matchers of unchanged volumes are reused
+    auto previous = snapshot();
+    auto next = std::make_shared<SxConfigSnapshot>();
+    mSettings->beginGroup(DesktopConfig::mSettingsGroup);
+    foreach (QString key, mSettings->allKeys()) {
+        next->desktop.insert(key, mSettings->value(key));
+    }
+    mSettings->endGroup();
+    foreach (QVariant entry, next->desktop.value(configKeys::BANDWIDTH_SCHEDULE).toList()) {
+        QVariantMap map = entry.toMap();
+        BandwidthSchedule item;
+        item.days = map.value("days", 0x7f).toInt();
+        item.start = QTime::fromString(map.value("start").toString(), "HH:mm");
+        item.end = QTime::fromString(map.value("end").toString(), "HH:mm");
+        item.uploadLimit = map.value("upload", 0).toLongLong();
+        item.downloadLimit = map.value("download", 0).toLongLong();
+        if (item.start.isValid() && item.end.isValid())
+            next->bandwidthSchedule.append(item);
+    }
+    mSettings->beginGroup("volumes");
+    next->volumes = mSettings->childGroups();
+    foreach (QString name, next->volumes) {
+        SxConfigSnapshot::Volume volume;
+        mSettings->beginGroup(name);
+        foreach (QString key, mSettings->childKeys()) {
+            volume.settings.insert(key, mSettings->value(key));
+        }
+        mSettings->endGroup();
+        volume.localPath = volume.settings.value(configKeys::LOCAL_PATH).toString();
+        volume.ignoredPaths = volume.settings.value(configKeys::IGNORED_PATHS).toStringList();
+        volume.whitelist = volume.settings.value(configKeys::WHITELIST, false).toBool();
+        foreach (auto value, volume.settings.value(configKeys::REG_EXP).toList()) {
+            QRegExp regexp = value.toRegExp();
+            if (!regexp.isEmpty())
+                volume.regExpList.append(regexp);
+        }
+        if (previous && previous->volumeConfigs.contains(name)) {
+            const SxConfigSnapshot::Volume &old = previous->volumeConfigs[name];
+            if (old.localPath == volume.localPath && old.ignoredPaths == volume.ignoredPaths
+                    && old.whitelist == volume.whitelist && old.regExpList == volume.regExpList)
+                volume.pathMatcher = old.pathMatcher;
+        }
+        if (!volume.pathMatcher)
+            volume.pathMatcher = std::make_shared<SxPathMatcher>(volume.localPath, volume.ignoredPaths, volume.whitelist, volume.regExpList);
+        next->volumeConfigs.insert(name, volume);
+    }
+    mSettings->endGroup();
+    std::atomic_store(&mSnapshot, std::shared_ptr<const SxConfigSnapshot>(next));
+}
+
 
 
 const QString DesktopConfig::_configKey(const QString key)
@@ -220,78 +287,74 @@ const QString DesktopConfig::_configKey(const QString key)
 
 QString DesktopConfig::language() const
 {
-    QMutexLocker locker(&mMutex);
-    return mSettings.value(_configKey(configKeys::LANGUAGE), "en").toString();
+    return _value(configKeys::LANGUAGE, "en").toString();
 }
 
 void DesktopConfig::setLanguage(const QString &language)
 {
     QMutexLocker locker(&mMutex);
     mSettings.setValue(_configKey(configKeys::LANGUAGE), language);
+    mConfig._publishSnapshot();
 }
 
 bool DesktopConfig::notifications() const
 {
-    QMutexLocker locker(&mMutex);
-    return mSettings.value(_configKey(configKeys::NOTIFICATIONS), true).toBool();
+    return _value(configKeys::NOTIFICATIONS, true).toBool();
 }
 
 void DesktopConfig::setNotifications(bool enabled)
 {
     QMutexLocker locker(&mMutex);
     mSettings.setValue(_configKey(configKeys::NOTIFICATIONS), enabled);
+    mConfig._publishSnapshot();
 }
 
 /*
 bool DesktopConfig::usageReports() const
 {
-    QMutexLocker locker(&mMutex);
-    return mSettings.value(_configKey(configKeys::USAGE_REPORTS), false).toBool();
+    return _value(configKeys::USAGE_REPORTS, false).toBool();
 }
 */
 
 bool DesktopConfig::debugLog() const
 {
-    QMutexLocker locker(&mMutex);
-    return mSettings.value(_configKey(configKeys::DEBUG_LOG), true).toBool();
+    return _value(configKeys::DEBUG_LOG, true).toBool();
 }
 
 void DesktopConfig::setDebugLog(bool enabled)
 {
     QMutexLocker locker(&mMutex);
     mSettings.setValue(_configKey(configKeys::DEBUG_LOG), enabled);
+    mConfig._publishSnapshot();
 }
 
 int DesktopConfig::logLevel() const
 {
-    QMutexLocker locker(&mMutex);
-    return mSettings.value(_configKey(configKeys::DEBUG_LEVEL), 1).toInt();
+    return _value(configKeys::DEBUG_LEVEL, 1).toInt();
 }
 
 void DesktopConfig::setLogLevel(int level)
 {
     QMutexLocker locker(&mMutex);
     mSettings.setValue(_configKey(configKeys::DEBUG_LEVEL), level);
+    mConfig._publishSnapshot();
 }
 
 /*
 int DesktopConfig::verboseLogging() const
 {
-    QMutexLocker locker(&mMutex);
-    return mSettings.value(_configKey(configKeys::DEBUG_VERBOSE), false).toBool();
+    return _value(configKeys::DEBUG_VERBOSE, false).toBool();
 }
 */
 
 bool DesktopConfig::checkUpdates() const
 {
-    QMutexLocker locker(&mMutex);
-    return (mProfile=="default")?mSettings.value(_configKey(configKeys::UPDATES), true).toBool():false;
+    return (mProfile=="default")?_value(configKeys::UPDATES, true).toBool():false;
 }
 
 bool DesktopConfig::checkBetaVersions() const
 {
-    QMutexLocker locker(&mMutex);
-    return (mProfile=="default")?mSettings.value(_configKey(configKeys::BETA_UPDATES), false).toBool():false;
+    return (mProfile=="default")?_value(configKeys::BETA_UPDATES, false).toBool():false;
 }
 
 void DesktopConfig::setCheckUpdates(bool checkUpdates, bool betaVersions)
@@ -299,30 +362,31 @@ void DesktopConfig::setCheckUpdates(bool checkUpdates, bool betaVersions)
     QMutexLocker locker(&mMutex);
     mSettings.setValue(_configKey(configKeys::UPDATES), checkUpdates);
     mSettings.setValue(_configKey(configKeys::BETA_UPDATES), checkUpdates ? betaVersions : false);
+    mConfig._publishSnapshot();
 }
 
 int DesktopConfig::linkExpirationTime() const
 {
-    QMutexLocker locker(&mMutex);
-    return mSettings.value(_configKey(configKeys::LINK_EXP_TIME), -1).toInt();
+    return _value(configKeys::LINK_EXP_TIME, -1).toInt();
 }
 
 void DesktopConfig::setLinkExpirationTime(int expirationTime)
 {
     QMutexLocker locker(&mMutex);
-    mSettings.value(_configKey(configKeys::LINK_EXP_TIME), expirationTime);
+    mSettings.setValue(_configKey(configKeys::LINK_EXP_TIME), expirationTime);
+    mConfig._publishSnapshot();
 }
 
 QString DesktopConfig::linkNotifyEmail() const
 {
-    QMutexLocker locker(&mMutex);
-    return mSettings.value(_configKey(configKeys::NOTIFY_EMAIL)).toString();
+    return _value(configKeys::NOTIFY_EMAIL).toString();
 }
 
 void DesktopConfig::setLinkNotifyEmail(const QString &email)
 {
     QMutexLocker locker(&mMutex);
     mSettings.setValue(_configKey(configKeys::NOTIFY_EMAIL), email);
+    mConfig._publishSnapshot();
 }
 
 bool DesktopConfig::autostart() const
@@ -416,9 +480,8 @@ void DesktopConfig::setAutostart(bool autostart)
 
 QPair<QString, QString> DesktopConfig::trayIconMark() const
 {
-    QMutexLocker locker(&mMutex);
-    QString shape = mSettings.value(_configKey(configKeys::TRAY_ICON_MARK)).toString();
-    QString color = mSettings.value(_configKey(configKeys::TRAY_ICON_MARK_COLOR)).toString();
+    QString shape = _value(configKeys::TRAY_ICON_MARK).toString();
+    QString color = _value(configKeys::TRAY_ICON_MARK_COLOR).toString();
     return QPair<QString, QString>(shape, color);
 }
 
@@ -427,19 +490,145 @@ void DesktopConfig::setTrayIconMark(QString shape, QString colorName)
     QMutexLocker locker(&mMutex);
     mSettings.setValue(_configKey(configKeys::TRAY_ICON_MARK), shape);
     mSettings.setValue(_configKey(configKeys::TRAY_ICON_MARK_COLOR), colorName);
+    mConfig._publishSnapshot();
 }
 
 QDateTime DesktopConfig::nextSurveyTime() const
 {
-    QMutexLocker locker(&mMutex);
     static const int firstSurveyDelay = 10*60;
-    return mSettings.value(_configKey(configKeys::NEXT_SURVEY_TIME), QDateTime::currentDateTime().addMSecs(firstSurveyDelay*1000)).toDateTime();
+    return _value(configKeys::NEXT_SURVEY_TIME, QDateTime::currentDateTime().addMSecs(firstSurveyDelay*1000)).toDateTime();
 }
 
 void DesktopConfig::setNextSurveyTime(const QDateTime &time)
 {
     QMutexLocker locker(&mMutex);
     mSettings.setValue(_configKey(configKeys::NEXT_SURVEY_TIME), time);
+    mConfig._publishSnapshot();
+}
+
+qint64 DesktopConfig::uploadLimit() const
+{
+    return _value(configKeys::UPLOAD_LIMIT, 0).toLongLong();
+}
+
+void DesktopConfig::setUploadLimit(qint64 limit)
+{
+    QMutexLocker locker(&mMutex);
+    mSettings.setValue(_configKey(configKeys::UPLOAD_LIMIT), limit);
+    mConfig._publishSnapshot();
+}
+
+qint64 DesktopConfig::downloadLimit() const
+{
+    return _value(configKeys::DOWNLOAD_LIMIT, 0).toLongLong();
+}
+
+void DesktopConfig::setDownloadLimit(qint64 limit)
+{
+    QMutexLocker locker(&mMutex);
+    mSettings.setValue(_configKey(configKeys::DOWNLOAD_LIMIT), limit);
+    mConfig._publishSnapshot();
+}
+
+QList<BandwidthSchedule> DesktopConfig::bandwidthSchedule() const
+{
+    return mConfig.snapshot()->bandwidthSchedule;
+}
+
+void DesktopConfig::setBandwidthSchedule(const QList<BandwidthSchedule> &schedule)
+{
+    QMutexLocker locker(&mMutex);
+    QVariantList list;
+    foreach (const BandwidthSchedule &item, schedule) {
+        QVariantMap map;
+        map.insert("days", item.days);
+        map.insert("start", item.start.toString("HH:mm"));
+        map.insert("end", item.end.toString("HH:mm"));
+        map.insert("upload", item.uploadLimit);
+        map.insert("download", item.downloadLimit);
+        list.append(map);
+    }
+    mSettings.setValue(_configKey(configKeys::BANDWIDTH_SCHEDULE), list);
+    mConfig._publishSnapshot();
+}
+
+QPair<qint64, qint64> DesktopConfig::bandwidthLimits(const QDateTime &time) const
+{
+    int today = time.date().dayOfWeek() - 1;
+    int yesterday = (today + 6) % 7;
+    QTime now = time.time();
+    auto snapshot = mConfig.snapshot();
+    foreach (const BandwidthSchedule &item, snapshot->bandwidthSchedule) {
+        bool active;
+        if (item.start <= item.end)
+            active = (item.days & (1 << today)) && now >= item.start && now < item.end;
+        else
+            active = ((item.days & (1 << today)) && now >= item.start) || ((item.days & (1 << yesterday)) && now < item.end);
+        if (active)
+            return {item.uploadLimit, item.downloadLimit};
+    }
+    return {snapshot->desktop.value(configKeys::UPLOAD_LIMIT, 0).toLongLong(),
+            snapshot->desktop.value(configKeys::DOWNLOAD_LIMIT, 0).toLongLong()};
+}
+
+qint64 DesktopConfig::smallTaskSize() const
+{
+    return _value(configKeys::SMALL_TASK_SIZE, 4*1024*1024).toLongLong();
+}
+
+void DesktopConfig::setSmallTaskSize(qint64 size)
+{
+    QMutexLocker locker(&mMutex);
+    mSettings.setValue(_configKey(configKeys::SMALL_TASK_SIZE), size);
+    mConfig._publishSnapshot();
+}
+
+int DesktopConfig::largeTaskMaxWait() const
+{
+    return _value(configKeys::LARGE_TASK_MAX_WAIT, 60).toInt();
+}
+
+void DesktopConfig::setLargeTaskMaxWait(int seconds)
+{
+    QMutexLocker locker(&mMutex);
+    mSettings.setValue(_configKey(configKeys::LARGE_TASK_MAX_WAIT), seconds);
+    mConfig._publishSnapshot();
+}
+
+qint64 DesktopConfig::transferMemoryBudget() const
+{
+    return _value(configKeys::TRANSFER_MEMORY_BUDGET, 256*1024*1024).toLongLong();
+}
+
+void DesktopConfig::setTransferMemoryBudget(qint64 budget)
+{
+    QMutexLocker locker(&mMutex);
+    mSettings.setValue(_configKey(configKeys::TRANSFER_MEMORY_BUDGET), budget);
+    mConfig._publishSnapshot();
+}
+
+int DesktopConfig::metricsPort() const
+{
+    return _value(configKeys::METRICS_PORT, 0).toInt();
+}
+
+void DesktopConfig::setMetricsPort(int port)
+{
+    QMutexLocker locker(&mMutex);
+    mSettings.setValue(_configKey(configKeys::METRICS_PORT), port);
+    mConfig._publishSnapshot();
+}
+
+int DesktopConfig::peerExchangePort() const
+{
+    return _value(configKeys::PEER_EXCHANGE_PORT, 0).toInt();
+}
+
+void DesktopConfig::setPeerExchangePort(int port)
+{
+    QMutexLocker locker(&mMutex);
+    mSettings.setValue(_configKey(configKeys::PEER_EXCHANGE_PORT), port);
+    mConfig._publishSnapshot();
 }
 
 QString DesktopConfig::_autostartFile() const
@@ -475,8 +664,13 @@ QString DesktopConfig::_autostartFile() const
 #endif
 }
 
-DesktopConfig::DesktopConfig(QSettings &settings, const QString& profile, QMutex &mutex)
-    : mSettings(settings), mProfile(profile), mMutex(mutex)
+QVariant DesktopConfig::_value(const QString &key, const QVariant &defaultValue) const
+{
+    return mConfig.snapshot()->desktop.value(key, defaultValue);
+}
+
+DesktopConfig::DesktopConfig(QSettings &settings, const QString& profile, QMutex &mutex, const SxConfig &config)
+    : mSettings(settings), mProfile(profile), mMutex(mutex), mConfig(config)
 {
     auto desktopKeys = {configKeys::LANGUAGE,
                         configKeys::NOTIFICATIONS,
@@ -501,110 +695,85 @@ DesktopConfig::DesktopConfig(QSettings &settings, const QString& profile, QMutex
 
 QString VolumeConfig::name() const
 {
-    QMutexLocker locker(&mMutex);
     return mVolumeName;
 }
 
 QString VolumeConfig::localPath() const
 {
-    QMutexLocker locker(&mMutex);
-    return mSettings.value(_configKey(mVolumeName, configKeys::LOCAL_PATH)).toString();
+    return mVolume->localPath;
 }
 
 QStringList VolumeConfig::ignoredPaths() const
 {
-    QMutexLocker locker(&mMutex);
-    return mSettings.value(_configKey(mVolumeName, configKeys::IGNORED_PATHS)).toStringList();
+    return mVolume->ignoredPaths;
 }
 
 bool VolumeConfig::whitelistMode() const
 {
-    QMutexLocker locker(&mMutex);
-    return mSettings.value(_configKey(mVolumeName, configKeys::WHITELIST), false).toBool();
+    return mVolume->whitelist;
 }
 
 QList<QRegExp> VolumeConfig::regExpList() const
 {
-    QMutexLocker locker(&mMutex);
-    QList<QRegExp> list;
-    auto tmp = mSettings.value(_configKey(mVolumeName, configKeys::REG_EXP)).toList();
-    foreach (auto value, tmp) {
-        QRegExp regexp = value.toRegExp();
-        if (!regexp.isEmpty())
-            list.append(regexp);
-    }
-    return list;
+    return mVolume->regExpList;
 }
 
 VolumeConfig::VolumeConfig(const VolumeConfig &other)
-    : mSettings(other.mSettings), mMutex(other.mMutex)
+    : mConfig(other.mConfig)
 {
     mVolumeName = other.mVolumeName;
+    _setSnapshot(other.mSnapshot);
 }
 
 void VolumeConfig::setSelectiveSync(const QStringList &ignoredPaths, bool whitelist, const QList<QRegExp> &regexpList)
 {
-    QMutexLocker locker(&mMutex);
-    mSettings.setValue(_configKey(mVolumeName, configKeys::IGNORED_PATHS), ignoredPaths);
-    mSettings.setValue(_configKey(mVolumeName, configKeys::WHITELIST), whitelist);
+    QMutexLocker locker(&mConfig.mMutex);
+    QSettings &settings = *mConfig.mSettings;
+    settings.setValue(_configKey(mVolumeName, configKeys::IGNORED_PATHS), ignoredPaths);
+    settings.setValue(_configKey(mVolumeName, configKeys::WHITELIST), whitelist);
     QList<QVariant> list;
     foreach (auto regexp, regexpList) {
         list.append(regexp);
     }
-    mSettings.setValue(_configKey(mVolumeName, configKeys::REG_EXP), list);
+    settings.setValue(_configKey(mVolumeName, configKeys::REG_EXP), list);
+    mConfig._publishSnapshot();
+    _setSnapshot(mConfig.snapshot());
 }
 
 bool VolumeConfig::isPathIgnored(const QString &path, bool local)
 {
-    QString relativePath;
-    if (local) {
-        QFileInfo fileInfo(path);
-        QFileInfo rootInfo(localPath());
-        if (fileInfo.absoluteFilePath()==rootInfo.absoluteFilePath())
-            return false;
-        if (!fileInfo.absoluteFilePath().startsWith(rootInfo.absoluteFilePath()+"/"))
-            return true;
-        relativePath = fileInfo.absoluteFilePath().mid(rootInfo.absoluteFilePath().size());
-    }
-    else
-        relativePath = path;
-    foreach (QString ignoredDir, ignoredPaths()) {
-        if (relativePath == ignoredDir)
-            return true;
-        if (relativePath.startsWith(ignoredDir+"/"))
-            return true;
-    }
-    bool whitelist = whitelistMode();
-    auto list = regExpList();
-    if (whitelist && list.isEmpty())
-        return true;
-    foreach (QRegExp regexp, list) {
-        if (regexp.exactMatch(relativePath))
-            return !whitelist;
-    }
-    return whitelist;
+    return mVolume->pathMatcher->isPathIgnored(path, local);
 }
 
 QHash<QString, QVariant> VolumeConfig::toHashtable() const
 {
-    QMutexLocker locker(&mMutex);
-    QHash<QString, QVariant> result;
-    mSettings.beginGroup("volumes");
-    mSettings.beginGroup(mVolumeName);
-    auto keys = mSettings.childKeys();
-    //auto list = QStringList{configKeys::IGNORED_PATHS, configKeys::LOCAL_PATH, configKeys::WHITELIST, configKeys::REG_EXP};
-    foreach (auto key, keys){
-        result.insert(key, mSettings.value(key));
-    }
-    mSettings.endGroup();
-    mSettings.endGroup();
-    return result;
+    return mVolume->settings;
 }
 
-VolumeConfig::VolumeConfig(QSettings &settings, const QString &name, QMutex &mutex)
-    : mSettings(settings), mMutex(mutex)
+VolumeConfig::VolumeConfig(const SxConfig &config, const QString &name)
+    : mConfig(config)
 {
     mVolumeName = name;
+    _setSnapshot(mConfig.snapshot());
+}
+
+const SxConfigSnapshot::Volume &VolumeConfig::_emptyVolume()
+{
+    static const SxConfigSnapshot::Volume empty = []() {
+        SxConfigSnapshot::Volume volume;
+        volume.whitelist = false;
+        volume.pathMatcher = std::make_shared<SxPathMatcher>(QString(), QStringList(), false, QList<QRegExp>());
+        return volume;
+    }();
+    return empty;
+}
+
+void VolumeConfig::_setSnapshot(const std::shared_ptr<const SxConfigSnapshot> &snapshot)
+{
+    // the snapshot is kept alive by this object, so the volume entry can be used without a lookup
+    mSnapshot = snapshot;
+    auto it = mSnapshot->volumeConfigs.constFind(mVolumeName);
+    mVolume = it != mSnapshot->volumeConfigs.constEnd() ? &it.value() : &_emptyVolume();
 }
 
 const QString VolumeConfig::_configKey(const QString &volume, const QString key) {
@@ -31,9 +31,39 @@
 
 #include <QSettings>
 #include <QMutex>
+#include <QTime>
+#include <memory>
 #include "clusterconfig.h"
+#include "sxpathmatcher.h"
 
 class SxAuth;
+class SxConfig;
+
+struct BandwidthSchedule {
+    int days;               // bit 0 is Monday
+    QTime start;
+    QTime end;
+    qint64 uploadLimit;     // bytes per second, 0 means unlimited
+    qint64 downloadLimit;
+};
+
+/* volume and desktop settings as read from QSettings, rebuilt by SxConfig
+ * after every write and published atomically, so readers don't take the
+ * config mutex */
+struct SxConfigSnapshot {
+    struct Volume {
+        QHash<QString, QVariant> settings;
+        QString localPath;
+        QStringList ignoredPaths;
+        bool whitelist;
+        QList<QRegExp> regExpList;
+        std::shared_ptr<const SxPathMatcher> pathMatcher;
+    };
+    QStringList volumes;
+    QHash<QString, Volume> volumeConfigs;
+    QHash<QString, QVariant> desktop;
+    QList<BandwidthSchedule> bandwidthSchedule;
+};
 
 class DesktopConfig {
 public:
@@ -58,17 +88,36 @@ public:
     void setTrayIconMark(QString shape, QString colorName);
     QDateTime nextSurveyTime() const;
     void setNextSurveyTime(const QDateTime &time);
+    qint64 uploadLimit() const;
+    void setUploadLimit(qint64 limit);
+    qint64 downloadLimit() const;
+    void setDownloadLimit(qint64 limit);
+    QList<BandwidthSchedule> bandwidthSchedule() const;
+    void setBandwidthSchedule(const QList<BandwidthSchedule> &schedule);
+    QPair<qint64, qint64> bandwidthLimits(const QDateTime &time) const;
+    qint64 smallTaskSize() const;
+    void setSmallTaskSize(qint64 size);
+    int largeTaskMaxWait() const;
+    void setLargeTaskMaxWait(int seconds);
+    qint64 transferMemoryBudget() const;
+    void setTransferMemoryBudget(qint64 budget);
+    int metricsPort() const;
+    void setMetricsPort(int port);
+    int peerExchangePort() const;
+    void setPeerExchangePort(int port);
 
 private:
     QString _autostartFile() const;
+    QVariant _value(const QString &key, const QVariant &defaultValue = QVariant()) const;
     static inline const QString _configKey(const QString key);
 public:
     static const QString mSettingsGroup;
 private:
-    DesktopConfig(QSettings &settings, const QString &profile, QMutex &mutex);
+    DesktopConfig(QSettings &settings, const QString &profile, QMutex &mutex, const SxConfig &config);
     QSettings &mSettings;
     const QString &mProfile;
     QMutex &mMutex;
+    const SxConfig &mConfig;
     friend class SxConfig;
 };
 
@@ -85,12 +134,15 @@ public:
     bool isPathIgnored(const QString& path, bool local);
     QHash<QString, QVariant> toHashtable() const;
 private:
-    VolumeConfig(QSettings &settings, const QString &name, QMutex &mutex);
+    VolumeConfig(const SxConfig &config, const QString &name);
     static inline const QString _configKey(const QString& volume, const QString key);
+    static const SxConfigSnapshot::Volume &_emptyVolume();
+    void _setSnapshot(const std::shared_ptr<const SxConfigSnapshot> &snapshot);
 
-    QSettings &mSettings;
-    QMutex &mMutex;
+    const SxConfig &mConfig;
     QString mVolumeName;
+    std::shared_ptr<const SxConfigSnapshot> mSnapshot;
+    const SxConfigSnapshot::Volume *mVolume;
     friend class SxConfig;
 };
 
@@ -111,15 +163,19 @@ public:
     void removeVolumeConfig(const QString &volume);
     void syncConfig();
     void clear();
+    std::shared_ptr<const SxConfigSnapshot> snapshot() const;
 
 private:
     void convertOldVolume();
     void testVolumes();
+    void _publishSnapshot() const;
     ClusterConfig *mClusterConfig;
     DesktopConfig *mDesktopConfig;
     QSettings *mSettings;
     QString mProfile;
     mutable QMutex mMutex;
+    // accessed only with std::atomic_load/atomic_store
+    mutable std::shared_ptr<const SxConfigSnapshot> mSnapshot;
 
     friend class ClusterConfig;
     friend class DesktopConfig;
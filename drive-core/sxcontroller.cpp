@@ -41,11 +41,34 @@ SxController::SxController(SxConfig *config, std::function<bool(QSslCertificate
     mFilesystem = nullptr;
     mFilesystemScannerThread = nullptr;
     mQueueThread = nullptr;
+    mProgress = new SxProgressAggregator(this);
+    connect(mProgress, &SxProgressAggregator::sig_setEtaAction,     this, &SxController::sig_setEtaAction);
+    connect(mProgress, &SxProgressAggregator::sig_setEtaCounters,   this, &SxController::sig_setEtaCounters);
+    connect(mProgress, &SxProgressAggregator::sig_setProgress,      this, &SxController::sig_setProgress);
+    // opt-in, lives in its own thread so serving peers never waits for the queue
+    mPeerExchangeThread = nullptr;
+    mPeerExchange = nullptr;
+    int peerPort = config->desktopConfig().peerExchangePort();
+    if (peerPort > 0 && peerPort <= 65535) {
+        mPeerExchangeThread = new QThread();
+        mPeerExchangeThread->setProperty("name", "PEER_EXCHANGE");
+        mPeerExchangeThread->start();
+        mPeerExchange = new SxPeerExchange(config, static_cast<quint16>(peerPort));
+        mPeerExchange->moveToThread(mPeerExchangeThread);
+        QMetaObject::invokeMethod(mPeerExchange, "start", Qt::QueuedConnection);
+    }
 }
 
 SxController::~SxController()
 {
     _destroyCluster();
+    if (mPeerExchangeThread) {
+        QMetaObject::invokeMethod(mPeerExchange, "stop", Qt::BlockingQueuedConnection);
+        mPeerExchangeThread->quit();
+        if (mPeerExchangeThread->wait())
+            delete mPeerExchangeThread;
+        delete mPeerExchange;
+    }
 }
 
 SxStatus SxController::status() const
@@ -101,6 +124,12 @@ void SxController::unlockVolume(const QString &volume)
     emit sig_unlockVolume(volume);
 }
 
+void SxController::boostPaths(const QString &volume, const QStringList &paths)
+{
+    if (mQueue)
+        mQueue->boostPaths(volume, paths);
+}
+
 void SxController::_initCluster()
 {
     mState.clearWarnings();
@@ -115,19 +144,13 @@ void SxController::_initCluster()
 #endif
     if (mConfig->isValid()) {
         mQueue = new SxQueue(mConfig, mCheckSslCallback, mAskGuiCallback);
+        mQueue->setPeerExchange(mPeerExchange);
         mQueue->moveToThread(mQueueThread);
-        mFilesystem = new SxFilesystem(mConfig);
-        mFilesystem->moveToThread(mFilesystemScannerThread);
-        connect(mFilesystem, &SxFilesystem::sig_fileModified, mQueue, &SxQueue::localFileModified);
-        connect(mFilesystem, &SxFilesystem::sig_cancelUploadTask, mQueue, &SxQueue::cancelUploadTask);
-        connect(mFilesystem, &SxFilesystem::sig_cancelUploadTask, [this](const QString &volume, const QString &path) {
-            mState.removeWarning(volume, path);
-        });
         connect(mQueue, &SxQueue::sig_satusChanged,         this, &SxController::onSatusChanged, Qt::QueuedConnection);
         connect(mQueue, &SxQueue::sig_fileSynchronised,     this, &SxController::sig_fileSynchronised);
-        connect(mQueue, &SxQueue::sig_setEtaAction,         this, &SxController::sig_setEtaAction);
-        connect(mQueue, &SxQueue::sig_setEtaCounters,       this, &SxController::sig_setEtaCounters);
-        connect(mQueue, &SxQueue::sig_setProgress,          this, &SxController::sig_setProgress);
+        connect(mQueue, &SxQueue::sig_setEtaAction,         mProgress, &SxProgressAggregator::setEtaAction, Qt::DirectConnection);
+        connect(mQueue, &SxQueue::sig_setEtaCounters,       mProgress, &SxProgressAggregator::setEtaCounters, Qt::DirectConnection);
+        connect(mQueue, &SxQueue::sig_setProgress,          mProgress, &SxProgressAggregator::setProgress, Qt::DirectConnection);
         connect(mQueue, &SxQueue::sig_clusterInitialized,   this, &SxController::sig_clusterInitialized);
         connect(mQueue, &SxQueue::sig_fileNotification,     this, &SxController::sig_fileNotification);
         connect(mQueue, &SxQueue::sig_lockVolume,           this, &SxController::sig_lockVolume);
@@ -139,7 +162,7 @@ void SxController::_initCluster()
         connect(this,   &SxController::sig_requestVolumeList, mQueue, &SxQueue::requestVolumeList);
         connect(mQueue, &SxQueue::sig_addWarning, &mState, &SxState::addWarning);
         connect(mQueue, &SxQueue::sig_removeWarning, &mState, &SxState::removeWarning);
-        mQueue->requestInitialScan();
+        _createFilesystem(true);
     }
     else {
         mQueue = nullptr;
@@ -173,6 +196,11 @@ void SxController::onSatusChanged(SxStatus status)
 }
 
 void SxController::restartFilesystem()
+{
+    _restartFilesystem(false);
+}
+
+void SxController::_restartFilesystem(bool initialScan)
 {
     if (mFilesystem != nullptr) {
         mFilesystem->disconnect();
@@ -188,16 +216,31 @@ void SxController::restartFilesystem()
         mFilesystemScannerThread->setPriority(QThread::LowestPriority);
 #endif
 
-        mFilesystem = new SxFilesystem(mConfig);
-        mFilesystem->moveToThread(mFilesystemScannerThread);
-        connect(mFilesystem, &SxFilesystem::sig_fileModified, mQueue, &SxQueue::localFileModified);
-        connect(mFilesystem, &SxFilesystem::sig_cancelUploadTask, mQueue, &SxQueue::cancelUploadTask);
-        connect(mFilesystem, &SxFilesystem::sig_cancelUploadTask, [this](const QString &volume, const QString &path) {
-            mState.removeWarning(volume, path);
-        });
+        _createFilesystem(initialScan);
+    }
+    else if (initialScan && mQueue != nullptr) {
+        mQueue->requestInitialScan();
     }
 }
 
+void SxController::_createFilesystem(bool initialScan)
+{
+    // the watches are added on the watcher thread, the initial scan follows once they are in place
+    mFilesystem = new SxFilesystem(mConfig);
+    mFilesystem->moveToThread(mFilesystemScannerThread);
+    connect(mFilesystem, &SxFilesystem::sig_fileModified, mQueue, &SxQueue::localFileModified);
+    connect(mFilesystem, &SxFilesystem::sig_filesModified, mQueue, &SxQueue::localFilesModified);
+    connect(mFilesystem, &SxFilesystem::sig_fileSettling, mQueue, &SxQueue::speculateUpload);
+    connect(mFilesystem, &SxFilesystem::sig_cancelUploadTask, mQueue, &SxQueue::cancelUploadTask);
+    connect(mFilesystem, &SxFilesystem::sig_watchOverflow, mQueue, &SxQueue::scanChangedDirs);
+    connect(mFilesystem, &SxFilesystem::sig_cancelUploadTask, [this](const QString &volume, const QString &path) {
+        mState.removeWarning(volume, path);
+    });
+    if (initialScan)
+        connect(mFilesystem, &SxFilesystem::sig_watching, mQueue, &SxQueue::requestInitialScan);
+    QMetaObject::invokeMethod(mFilesystem, "startWatching", Qt::QueuedConnection);
+}
+
 void SxController::startCluster()
 {
     if (mStarted)
@@ -229,6 +272,5 @@ void SxController::clearWarnings()
 
 void SxController::onVolumeNameChanged()
 {
-    restartFilesystem();
-    mQueue->requestInitialScan();
+    _restartFilesystem(true);
 }
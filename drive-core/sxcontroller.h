@@ -32,6 +32,8 @@
 #include "sxqueue.h"
 #include "sxfilesystem.h"
 #include "sxstate.h"
+#include "sxprogressaggregator.h"
+#include "sxpeerexchange.h"
 
 #include <QObject>
 #include <QThread>
@@ -51,6 +53,7 @@ public:
     bool resume();
     void reinitCluster();
     void unlockVolume(const QString &volume);
+    void boostPaths(const QString &volume, const QStringList &paths);
 
 private:
     void _initCluster();
@@ -79,6 +82,8 @@ public slots:
 private slots:
     void onVolumeNameChanged();
 private:
+    void _createFilesystem(bool initialScan);
+    void _restartFilesystem(bool initialScan);
     const int initializationRetryTime = 60;
     QThread* mQueueThread;
     QThread* mFilesystemScannerThread;
@@ -86,6 +91,9 @@ private:
     SxQueue *mQueue;
     SxFilesystem *mFilesystem;
     SxState mState;
+    SxProgressAggregator *mProgress;
+    QThread *mPeerExchangeThread;
+    SxPeerExchange *mPeerExchange;
     SxConfig *mConfig;
     std::function<bool(QSslCertificate&, bool)> mCheckSslCallback;
     std::function<bool(QString)> mAskGuiCallback;
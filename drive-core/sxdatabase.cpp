@@ -34,8 +34,10 @@
 #include <QPair>
 #include <QDebug>
 #include <QDir>
+#include <QFileInfo>
 #include <QSqlError>
 #include <QMutexLocker>
+#include <QCoreApplication>
 #include <sxfilter.h>
 #include "util.h"
 
@@ -43,10 +45,16 @@
 #include "sxfileentry.h"
 #include "sxdatabase.h"
 #include "sxlog.h"
+#include "sxtrace.h"
+#include "sxmetrics.h"
+#include "sxprofiler.h"
+#include "sxrevisioncache.h"
+#include <QElapsedTimer>
 #include "sxfilesystem.h"
 
 QString SxDatabase::sOldVolumeName;
-QHash<QThread*, QString> SxDatabase::sConnections;
+QMultiHash<QThread*, QString> SxDatabase::sConnections;
+QMutex SxDatabase::sConnectionsMutex;
 
 SxDatabase &SxDatabase::instance()
 {
@@ -73,8 +81,23 @@ void SxDatabase::setOldVolumeName(const QString &volume)
     logDebug(str);                                          \
     } while(0)                                              \
 
+/* files below a directory are the paths in the [dir/, dir0) range ('0' follows '/'),
+ * which the (volume, path) primary key can search directly */
+static QString dirLowerBound(const QString &dir)
+{
+    return dir.endsWith("/") ? dir : dir+"/";
+}
+
+static QString dirUpperBound(const QString &dir)
+{
+    QString upper = dirLowerBound(dir);
+    upper[upper.length()-1] = QChar('/'+1);
+    return upper;
+}
+
 bool SxDatabase::updateVolumes(const QList<const SxVolume *> &list, QHash<QString, QString> &modifiedNames)
 {
+    mWriter->flush();
     modifiedNames.clear();
     QHash<QString, QString> oldNames;
     QSqlQuery query("update sxVolumes set toRemove = 1", getThreadConnection());
@@ -164,6 +187,9 @@ bool SxDatabase::updateVolumes(const QList<const SxVolume *> &list, QHash<QStrin
     if(!query.exec("delete from sxVolumes where toRemove = 1")) {
         goto onSqlError;
     }
+    // files of renamed and removed volumes followed them by cascade
+    if (!modifiedNames.isEmpty() || query.numRowsAffected() > 0)
+        _loadFileIndex(QString());
     emit sig_volumeListUpdated();
     return true;
     onSqlError:
@@ -189,20 +215,34 @@ bool SxDatabase::getVolumeList(QList<SxVolumeEntry> &volumeList) const
     return true;
 }
 
-bool SxDatabase::startUpdatingFiles(std::function<bool()> abortedCB)
+/* opens an update session of a single volume, the actions marked during the session
+ * are reset when it ends; only rows of that volume which were marked get written */
+bool SxDatabase::startUpdatingFiles(const QString &volume, std::function<bool()> abortedCB)
 {
+    mWriter->flush();
     mMutex.lock();
     mStartTime = QDateTime::currentDateTime();
     mAbortedCB = abortedCB;
+    mSessionVolume = volume;
+    ++mSessionGeneration;
+    // leftovers of a session which never ended
+    QSqlQuery query(getThreadConnection());
+    query.prepare("update sxFiles set action=0 where action>0 and volume=:volume");
+    query.bindValue(":volume", volume);
+    if (!query.exec())
+        logWarning(query.lastError().text());
     return true;
 }
 
 bool SxDatabase::endUpdatingFiles()
 {
+    mWriter->flush();
     mAbortedCB = nullptr;
 
     QSqlQuery query(getThreadConnection());
-    if (!query.exec("update sxFiles set action=0")) {
+    query.prepare("update sxFiles set action=0 where action>0 and volume=:volume");
+    query.bindValue(":volume", mSessionVolume);
+    if (!query.exec()) {
         logWarning(query.lastError().text());
     }
     if (!mSuppressedFiles.isEmpty()) {
@@ -212,6 +252,8 @@ bool SxDatabase::endUpdatingFiles()
                 continue;
             QString volume = file.mid(0, index);
             QString path = file.mid(index+1);
+            if (volume != mSessionVolume)
+                continue;
             QSqlQuery q(getThreadConnection());
             q.prepare("update sxFiles set action=1 where volume=:volume and path=:path");
             q.bindValue(":volume", volume);
@@ -221,32 +263,53 @@ bool SxDatabase::endUpdatingFiles()
             }
         }
     }
-    if (!query.exec("delete from sxFiles where localRevision is null and remoteRevision is null and action=0")) {
+    query.prepare("delete from sxFiles where volume=:volume and localRevision is null and remoteRevision is null and action=0");
+    query.bindValue(":volume", mSessionVolume);
+    if (!query.exec()) {
         logWarning(query.lastError().text());
     }
+    // bulk updates of the session are picked up by one reload
+    _loadFileIndex(mSessionVolume);
     logDebug(QString("lock time: %1").arg(formatEta(mStartTime.secsTo(QDateTime::currentDateTime()))));
+    mSessionVolume.clear();
     mMutex.unlock();
     return true;
 }
 
 bool SxDatabase::updateRemoteFiles(const QString &volume, const QList<SxFileEntry *> &list)
 {
+    sxProfile("update remote files");
+    return beginRemoteFiles(volume) && addRemoteFiles(volume, list) && finishRemoteFiles(volume);
+}
+
+bool SxDatabase::beginRemoteFiles(const QString &volume)
+{
+    Q_UNUSED(volume);
+    mWriter->flush();
     QSqlQuery q(getThreadConnection());
-    if (!q.exec("begin transaction"))
-        return false;
+    if (!q.exec("create temp table if not exists sxRemoteFiles "
+                "(path text primary key, revision text not null, size integer not null, suppressed integer not null, action integer)"))
+        goto onSqlError;
+    if (!q.exec("delete from sxRemoteFiles"))
+        goto onSqlError;
+    return true;
+    onSqlError:
+    logWarning(q.lastError().text());
+    return false;
+}
+
+bool SxDatabase::addRemoteFiles(const QString &volume, const QList<SxFileEntry *> &list)
+{
+    static const QStringList forbiddenList = {
+        #ifdef Q_OS_WIN
+        "\\", ":", "*", "?", "<", ">", "|",
+        #endif
+        "/../", "/./"
+    };
+    static const QStringList ignoredNames = {".", "..", ".DS_Store", "._.DS_Store"};
+
+    QVariantList paths, revisions, sizes, suppressed;
     foreach (SxFileEntry* fileEntry, list) {
-        if (mAbortedCB!=nullptr && mAbortedCB()) {
-            q.exec("rollback transaction");
-            return false;
-        }
-        static const QStringList forbiddenList = {
-            #ifdef Q_OS_WIN
-            "\\", ":", "*", "?", "<", ">", "|",
-            #endif
-            "/../", "/./"
-        };
-
-        static QStringList ignoredNames = {".", "..", ".DS_Store", "._.DS_Store"};
         if (ignoredNames.contains(fileEntry->path().split("/").last())) {
             continue;
         }
@@ -259,223 +322,448 @@ bool SxDatabase::updateRemoteFiles(const QString &volume, const QList<SxFileEntr
         }
         if (skipFile)
             continue;
-
-        QSqlQuery query(getThreadConnection());
-        query.prepare("select localRevision, remoteSize, mTime from sxFiles where volume=:volume and path=:path");
-        query.bindValue(":volume", volume);
-        query.bindValue(":path", fileEntry->path());
-        //printSqlQuery(query);
-        if (!query.exec()) {
-            logWarning(query.lastError().text());
-            q.exec("rollback transaction");
-            return false;
-        }
-        if (query.first()) {
-            ACTION action = ACTION::SKIP;
-            if (!mSuppressedFiles.contains(volume+"/"+fileEntry->path())) {
-                if (query.isNull(0)) {
-                    action = query.isNull(2) ? ACTION::DOWNLOAD : ACTION::UPLOAD;
-                }
-                else {
-                    QString localRevision = query.value(0).toString();
-                    if (fileEntry->revision() > localRevision)
-                        action = ACTION::DOWNLOAD;
-                }
-            }
-            query = QSqlQuery(getThreadConnection());
-            query.prepare("update sxFiles set remoteRevision=:revision, remoteSize=:size, action=:action where volume=:volume and path=:path");
-            query.bindValue(":action", static_cast<int>(action));
-        }
-        else {
-            query = QSqlQuery(getThreadConnection());
-            query.prepare("insert into sxFiles (volume, path, remoteRevision, remoteSize, action) values (:volume, :path, :revision, :size, :action)");
-            ACTION action = mSuppressedFiles.contains(volume+"/"+fileEntry->path()) ? ACTION::SKIP : ACTION::DOWNLOAD;
-            query.bindValue(":action", static_cast<int>(action));
-        }
-        query.bindValue(":volume", volume);
-        query.bindValue(":path", fileEntry->path());
-        query.bindValue(":revision", fileEntry->revision());
-        query.bindValue(":size", fileEntry->size());
-        //printSqlQuery(query);
-        if (!query.exec()) {
-            logWarning(query.lastError().text());
-            q.exec("rollback transaction");
-            return false;
-        }
+        paths.append(fileEntry->path());
+        revisions.append(fileEntry->revision());
+        sizes.append(fileEntry->size());
+        suppressed.append(mSuppressedFiles.contains(volume+"/"+fileEntry->path()) ? 1 : 0);
     }
-    q.exec("commit transaction");
-    return  true;
+
+    // stage the listing with a single prepared statement, it is merged set-wise by finishRemoteFiles
+    QSqlQuery q(getThreadConnection());
+    if (!q.exec("begin transaction"))
+        goto onSqlError;
+    q.prepare("insert or replace into sxRemoteFiles (path, revision, size, suppressed) values (?, ?, ?, ?)");
+    q.addBindValue(paths);
+    q.addBindValue(revisions);
+    q.addBindValue(sizes);
+    q.addBindValue(suppressed);
+    if (!q.execBatch())
+        goto onRollback;
+    if (!q.exec("commit transaction"))
+        goto onSqlError;
+    return true;
+    onRollback:
+    logWarning(q.lastError().text());
+    q.exec("rollback transaction");
+    return false;
+    onSqlError:
+    logWarning(q.lastError().text());
+    return false;
 }
 
-bool SxDatabase::updateLocalFiles(const QString &volume, const QList<QString> &list, const QDir &volumeRootDir)
+bool SxDatabase::finishRemoteFiles(const QString &volume)
 {
+    mWriter->flush();
     QSqlQuery q(getThreadConnection());
-    if (!q.exec("begin transaction"))
+    if (mAbortedCB!=nullptr && mAbortedCB())
         return false;
+    if (!q.exec("begin transaction"))
+        goto onSqlError;
 
+    // the actions are worked out in the staging table, only rows which change are written
+    q.prepare("update sxRemoteFiles set action=(select case "
+              "when sxRemoteFiles.suppressed then :skip "
+              "when f.localRevision is null then (case when f.mTime is null then :download else :upload end) "
+              "when sxRemoteFiles.revision > f.localRevision then :download "
+              "else :skip end "
+              "from sxFiles f where f.volume=:volume and f.path=sxRemoteFiles.path)");
+    q.bindValue(":skip", static_cast<int>(ACTION::SKIP));
+    q.bindValue(":download", static_cast<int>(ACTION::DOWNLOAD));
+    q.bindValue(":upload", static_cast<int>(ACTION::UPLOAD));
+    q.bindValue(":volume", volume);
+    if (!q.exec())
+        goto onRollback;
+
+    q.prepare("update sxFiles set "
+              "remoteRevision=(select s.revision from sxRemoteFiles s where s.path=sxFiles.path), "
+              "remoteSize=(select s.size from sxRemoteFiles s where s.path=sxFiles.path), "
+              "action=(select s.action from sxRemoteFiles s where s.path=sxFiles.path) "
+              "where rowid in (select f.rowid from sxRemoteFiles s, sxFiles f where f.volume=:volume and f.path=s.path and "
+              "(f.remoteRevision is not s.revision or f.remoteSize is not s.size or f.action is not s.action))");
+    q.bindValue(":volume", volume);
+    if (!q.exec())
+        goto onRollback;
+
+    // files missing from the listing were removed remotely
+    q.prepare("update sxFiles set action=:removeLocal "
+              "where volume=:volume and action!=:removeLocal and path not in (select path from sxRemoteFiles)");
+    q.bindValue(":removeLocal", static_cast<int>(ACTION::REMOVE_LOCAL));
+    q.bindValue(":volume", volume);
+    if (!q.exec())
+        goto onRollback;
+
+    q.prepare("insert or ignore into sxFiles (volume, path, remoteRevision, remoteSize, action) "
+              "select :volume, path, revision, size, case when suppressed then :skip else :download end from sxRemoteFiles");
+    q.bindValue(":volume", volume);
+    q.bindValue(":skip", static_cast<int>(ACTION::SKIP));
+    q.bindValue(":download", static_cast<int>(ACTION::DOWNLOAD));
+    if (!q.exec())
+        goto onRollback;
+
+    if (!q.exec("delete from sxRemoteFiles"))
+        goto onRollback;
+    if (!q.exec("commit transaction"))
+        goto onSqlError;
+    return true;
+    onRollback:
+    logWarning(q.lastError().text());
+    q.exec("rollback transaction");
+    return false;
+    onSqlError:
+    logWarning(q.lastError().text());
+    return false;
+}
+
+bool SxDatabase::updateLocalFiles(const QString &volume, const QList<QString> &list, const QDir &volumeRootDir)
+{
+    QVector<SxLocalFile> files;
     foreach (auto file, list) {
-        QDateTime time = QDateTime::currentDateTime();
-        if (mAbortedCB!=nullptr && mAbortedCB()) {
-            q.exec("rollback transaction");
+        if (mAbortedCB!=nullptr && mAbortedCB())
             return false;
-        }
         QFileInfo fileInfo(volumeRootDir.absolutePath()+file);
         if (!fileInfo.exists() || !fileInfo.isFile())
             continue;
-        static QStringList ignoredNames = {".DS_Store", "._.DS_Store"};
-        if (ignoredNames.contains(file.split("/").last()))
+        files.append(SxLocalFile{file, fileInfo.size(), fileInfo.lastModified().toTime_t()});
+    }
+    return updateLocalFiles(volume, files);
+}
+
+/* with removeMissing the list covers the whole volume, synced files not in it are
+ * marked to be removed remotely */
+bool SxDatabase::updateLocalFiles(const QString &volume, const QVector<SxLocalFile> &files, bool removeMissing)
+{
+    mWriter->flush();
+    static const QStringList ignoredNames = {".DS_Store", "._.DS_Store"};
+    QVariantList paths, mTimes;
+    foreach (const SxLocalFile &file, files) {
+        if (ignoredNames.contains(file.path.section('/', -1)))
             continue;
+        paths.append(file.path);
+        mTimes.append(file.mTime);
+    }
+    if (mAbortedCB!=nullptr && mAbortedCB())
+        return false;
 
-        QSqlQuery query(getThreadConnection());
-        query.prepare("select mTime from sxFiles where volume=:volume and path=:path");
-        query.bindValue(":volume", volume);
-        query.bindValue(":path", file);
-        //printSqlQuery(query);
-        if (!query.exec()) {
-            logWarning(query.lastError().text());
-            q.exec("rollback transaction");
-            return false;
-        }
-        QDateTime time2 = QDateTime::currentDateTime();
-        bool needUpload = false;
-        QString queryString;
-        if (query.first()) {
-            if (query.isNull(0))
-                needUpload = true;
-            else {
-                uint mTimeDb = query.value(0).toUInt();
-                uint mTimeFile = fileInfo.lastModified().toTime_t();
-                if (mTimeDb != mTimeFile)
-                    needUpload = true;
-            }
-            queryString = "update sxFiles set ";
-            if (needUpload)
-                queryString += "localRevision=NULL, ";
-            queryString += "action=:action, mTime=:mTime where volume=:volume and path=:path";
-            if (!needUpload)
-                queryString += " and action!=:removeAction";
-        }
-        else {
-            needUpload = true;
-            queryString = "insert into sxFiles (volume, path, action, mTime) values (:volume, :path, :action, :mTime)";
-        }
-        query = QSqlQuery(getThreadConnection());
-        query.prepare(queryString);
-        query.bindValue(":action", static_cast<int>(needUpload ? ACTION::UPLOAD : ACTION::SKIP));
-        query.bindValue(":removeAction", static_cast<int>(ACTION::REMOVE_LOCAL));
-        query.bindValue(":volume", volume);
-        query.bindValue(":path", file);
-        query.bindValue(":mTime", fileInfo.lastModified().toTime_t());
-        //printSqlQuery(query);
-        if (!query.exec()) {
-            logWarning(query.lastError().text());
-            q.exec("rollback transaction");
-            return false;
-        }
+    QSqlQuery q(getThreadConnection());
+    if (!q.exec("create temp table if not exists sxLocalFiles (path text primary key, mTime integer not null)"))
+        goto onSqlError;
+    if (!q.exec("begin transaction"))
+        goto onSqlError;
+    if (!q.exec("delete from sxLocalFiles"))
+        goto onRollback;
+    q.prepare("insert or replace into sxLocalFiles (path, mTime) values (?, ?)");
+    q.addBindValue(paths);
+    q.addBindValue(mTimes);
+    if (!q.execBatch())
+        goto onRollback;
+    if (mAbortedCB!=nullptr && mAbortedCB()) {
+        q.exec("rollback transaction");
+        return false;
     }
-    q.exec("commit transaction");
+
+    if (removeMissing) {
+        q.prepare("update sxFiles set action=:removeRemote "
+                  "where volume=:volume and action=:skip and path not in (select path from sxLocalFiles)");
+        q.bindValue(":removeRemote", static_cast<int>(ACTION::REMOVE_REMOTE));
+        q.bindValue(":skip", static_cast<int>(ACTION::SKIP));
+        q.bindValue(":volume", volume);
+        if (!q.exec())
+            goto onRollback;
+    }
+
+    // unchanged files, must run before the modified ones get their new mTime
+    q.prepare("update sxFiles set action=:skip "
+              "where volume=:volume and action!=:removeLocal and action!=:skip and "
+              "mTime=(select l.mTime from sxLocalFiles l where l.path=sxFiles.path)");
+    q.bindValue(":skip", static_cast<int>(ACTION::SKIP));
+    q.bindValue(":removeLocal", static_cast<int>(ACTION::REMOVE_LOCAL));
+    q.bindValue(":volume", volume);
+    if (!q.exec())
+        goto onRollback;
+
+    q.prepare("update sxFiles set localRevision=NULL, action=:upload, "
+              "mTime=(select l.mTime from sxLocalFiles l where l.path=sxFiles.path) "
+              "where volume=:volume and path in (select path from sxLocalFiles) and "
+              "(mTime is null or mTime!=(select l.mTime from sxLocalFiles l where l.path=sxFiles.path))");
+    q.bindValue(":upload", static_cast<int>(ACTION::UPLOAD));
+    q.bindValue(":volume", volume);
+    if (!q.exec())
+        goto onRollback;
+
+    q.prepare("insert or ignore into sxFiles (volume, path, action, mTime) "
+              "select :volume, path, :upload, mTime from sxLocalFiles");
+    q.bindValue(":volume", volume);
+    q.bindValue(":upload", static_cast<int>(ACTION::UPLOAD));
+    if (!q.exec())
+        goto onRollback;
+
+    if (!q.exec("delete from sxLocalFiles"))
+        goto onRollback;
+    if (!q.exec("commit transaction"))
+        goto onSqlError;
     return true;
+    onRollback:
+    logWarning(q.lastError().text());
+    q.exec("rollback transaction");
+    return false;
+    onSqlError:
+    logWarning(q.lastError().text());
+    return false;
 }
 
 bool SxDatabase::updateLocalDirs(const QString &volume, const QList<QString> &list, const QDir &volumeRootDir)
 {
-    foreach (auto dir, list) {
-        if (mAbortedCB!=nullptr && mAbortedCB())
-            return false;
-        QSqlQuery query(getThreadConnection());
-        query.prepare("select count(*) from sxFiles where volume=:volume and path like :path");
-        query.bindValue(":volume", volume);
-        query.bindValue(":path", dir+"/%");
-        //printSqlQuery(query);
-        if (!query.exec()) {
-            logWarning(query.lastError().text());
+    mWriter->flush();
+    QVariantList dirs;
+    QVariantList newFiles;
+    QVariantList volumes, actions;
+    foreach (auto dir, list)
+        dirs.append(dir);
+
+    QSqlQuery q(getThreadConnection());
+    if (!q.exec("create temp table if not exists sxLocalDirs (path text primary key)"))
+        goto onSqlError;
+    if (!q.exec("begin transaction"))
+        goto onSqlError;
+    if (!q.exec("delete from sxLocalDirs"))
+        goto onRollback;
+    q.prepare("insert or replace into sxLocalDirs (path) values (?)");
+    q.addBindValue(dirs);
+    if (!q.execBatch())
+        goto onRollback;
+
+    q.prepare("select d.path from sxLocalDirs d where not exists "
+              "(select 1 from sxFiles f where f.volume=:volume and f.path>=d.path||'/' and f.path<d.path||'0')");
+    q.bindValue(":volume", volume);
+    if (!q.exec())
+        goto onRollback;
+    while (q.next()) {
+        if (mAbortedCB && mAbortedCB()) {
+            q.finish();
+            q.exec("rollback transaction");
             return false;
         }
-        query.first();
-        if (query.value(0).toInt()==0) {
-            QDir targetDir(volumeRootDir.absolutePath()+"/"+dir);
-            auto files = SxFilesystem::getDirectoryContents(targetDir, true, dir);
-            foreach (QString file, files) {
-                if (mAbortedCB && mAbortedCB())
-                    return false;
-                query = QSqlQuery(getThreadConnection());
-                query.prepare("insert into sxFiles (volume, path, action) values (:volume, :path, :action)");
-                query.bindValue(":volume", volume);
-                query.bindValue(":path", file);
-                query.bindValue(":action", static_cast<int>(ACTION::UPLOAD));
-                if (!query.exec()) {
-                    logWarning(query.lastError().text());
-                    return false;
-                }
-            }
-        }
-        else {
-            query = QSqlQuery(getThreadConnection());
-            query.prepare("update sxFiles set action=0 where volume=:volume and path like :path");
-            query.bindValue(":volume", volume);
-            query.bindValue(":path", dir+"/%");
-            if (!query.exec()) {
-                logWarning(query.lastError().text());
-                return false;
-            }
+        QString dir = q.value(0).toString();
+        QDir targetDir(volumeRootDir.absolutePath()+"/"+dir);
+        foreach (QString file, SxFilesystem::getDirectoryContents(targetDir, true, dir)) {
+            newFiles.append(file);
+            volumes.append(volume);
+            actions.append(static_cast<int>(ACTION::UPLOAD));
         }
     }
+
+    q.prepare("update sxFiles set action=0 where rowid in "
+              "(select f.rowid from sxLocalDirs d, sxFiles f where f.volume=:volume and f.path>=d.path||'/' and f.path<d.path||'0')");
+    q.bindValue(":volume", volume);
+    if (!q.exec())
+        goto onRollback;
+
+    q.prepare("insert or ignore into sxFiles (volume, path, action) values (?, ?, ?)");
+    q.addBindValue(volumes);
+    q.addBindValue(newFiles);
+    q.addBindValue(actions);
+    if (!q.execBatch())
+        goto onRollback;
+
+    if (!q.exec("delete from sxLocalDirs"))
+        goto onRollback;
+    if (!q.exec("commit transaction"))
+        goto onSqlError;
     return true;
+    onRollback:
+    logWarning(q.lastError().text());
+    q.exec("rollback transaction");
+    return false;
+    onSqlError:
+    logWarning(q.lastError().text());
+    return false;
 }
 
 QList<QString> SxDatabase::getMarkedFiles(const QString &volume, ACTION action) const
 {
     QList<QString> result;
+    qint64 afterRowId = 0;
+    while (getMarkedFiles(volume, action, 0, afterRowId, sMarkedFilesPage, result));
+    return result;
+}
+
+/* appends up to limit marked files following afterRowId to page and advances afterRowId,
+ * returns false when there are no more rows; generation 0 reads the marks of the running
+ * update session, any other one the files saved by saveMarkedFiles. unsettledOnly skips
+ * saved files already handled, i.e. removed or downloaded in the meantime */
+bool SxDatabase::getMarkedFiles(const QString &volume, ACTION action, qint64 generation, qint64 &afterRowId, int limit, QList<QString> &page, bool unsettledOnly) const
+{
+    mWriter->flush();
     QSqlQuery query(getThreadConnection());
-    query.prepare("select path from sxFiles where volume=:volume and action=:action");
+    if (generation == 0)
+        query.prepare("select rowid, path from sxFiles where action=:action and rowid>:rowid and volume=:volume order by rowid limit :limit");
+    else if (unsettledOnly) {
+        query.prepare("select m.rowid, m.path from sxMarkedFiles m where m.volume=:volume and m.generation=:generation and m.action=:action and m.rowid>:rowid "
+                      "and exists (select 1 from sxFiles f where f.volume=m.volume and f.path=m.path "
+                      "and (m.action<>:download or f.localRevision is null or f.localRevision<>f.remoteRevision)) "
+                      "order by m.rowid limit :limit");
+        query.bindValue(":generation", generation);
+        query.bindValue(":download", static_cast<int>(ACTION::DOWNLOAD));
+    }
+    else {
+        query.prepare("select rowid, path from sxMarkedFiles where volume=:volume and generation=:generation and action=:action and rowid>:rowid "
+                      "order by rowid limit :limit");
+        query.bindValue(":generation", generation);
+    }
     query.bindValue(":volume", volume);
     query.bindValue(":action", static_cast<int>(action));
+    query.bindValue(":rowid", afterRowId);
+    query.bindValue(":limit", limit);
     //printSqlQuery(query);
-    if (query.exec()) {
-        while (query.next()) {
-            QString path = query.value(0).toString();
-            if (mSuppressedFiles.contains(volume+"/"+path))
-                continue;
-            static QStringList ignoredNames = {".DS_Store", "._.DS_Store"};
-            if (ignoredNames.contains(path.split("/").last()))
-                continue;
-            result.append(path);
-        }
+    if (!query.exec()) {
+        logWarning(query.lastError().text());
+        return false;
     }
-    return result;
+    int rows = 0;
+    while (query.next()) {
+        ++rows;
+        afterRowId = query.value(0).toLongLong();
+        QString path = query.value(1).toString();
+        if (mSuppressedFiles.contains(volume+"/"+path))
+            continue;
+        static QStringList ignoredNames = {".DS_Store", "._.DS_Store"};
+        if (ignoredNames.contains(path.split("/").last()))
+            continue;
+        page.append(path);
+    }
+    return rows == limit;
 }
 
-bool SxDatabase::getLocalFileMtime(const QString &volume, const QString &path, uint32_t &mtime) const
+/* keeps the files marked in the running update session past its end, returns the generation
+ * to read them with */
+qint64 SxDatabase::saveMarkedFiles()
+{
+    QSqlQuery query(getThreadConnection());
+    query.prepare("insert into sxMarkedFiles (volume, generation, action, path) "
+                  "select volume, :generation, action, path from sxFiles where action>0 and volume=:volume");
+    query.bindValue(":volume", mSessionVolume);
+    query.bindValue(":generation", mSessionGeneration);
+    if (!query.exec()) {
+        logWarning(query.lastError().text());
+        return 0;
+    }
+    return mSessionGeneration;
+}
+
+void SxDatabase::discardMarkedFiles(qint64 generation)
 {
     QSqlQuery query(getThreadConnection());
-    query.prepare("select mtime from sxFiles where volume=:volume and path=:path");
+    query.prepare("delete from sxMarkedFiles where generation=:generation");
+    query.bindValue(":generation", generation);
+    if (!query.exec())
+        logWarning(query.lastError().text());
+    query.prepare("delete from sxSyncCheckpoints where generation=:generation");
+    query.bindValue(":generation", generation);
+    if (!query.exec())
+        logWarning(query.lastError().text());
+}
+
+bool SxDatabase::saveSyncCheckpoint(const QString &volume, const SyncCheckpoint &checkpoint)
+{
+    QSqlQuery query(getThreadConnection());
+    query.prepare("insert or replace into sxSyncCheckpoints (generation, volume, action, afterRowId, etag, listingDigest, remoteCount, savedTime) "
+                  "values (:generation, :volume, :action, :afterRowId, :etag, :listingDigest, :remoteCount, :savedTime)");
+    query.bindValue(":generation", checkpoint.generation);
     query.bindValue(":volume", volume);
-    query.bindValue(":path", path);
+    query.bindValue(":action", static_cast<int>(checkpoint.action));
+    query.bindValue(":afterRowId", checkpoint.afterRowId);
+    query.bindValue(":etag", checkpoint.etag);
+    query.bindValue(":listingDigest", checkpoint.listingDigest);
+    query.bindValue(":remoteCount", checkpoint.remoteCount);
+    query.bindValue(":savedTime", QDateTime::currentDateTime().toTime_t());
     if (!query.exec()) {
-        logError(query.lastError().text());
+        logWarning(query.lastError().text());
         return false;
     }
-    if (!query.first())
+    return true;
+}
+
+bool SxDatabase::updateSyncCheckpoint(qint64 generation, ACTION action, qint64 afterRowId)
+{
+    QSqlQuery query(getThreadConnection());
+    query.prepare("update sxSyncCheckpoints set action=:action, afterRowId=:afterRowId, savedTime=:savedTime where generation=:generation");
+    query.bindValue(":generation", generation);
+    query.bindValue(":action", static_cast<int>(action));
+    query.bindValue(":afterRowId", afterRowId);
+    query.bindValue(":savedTime", QDateTime::currentDateTime().toTime_t());
+    if (!query.exec()) {
+        logWarning(query.lastError().text());
         return false;
-    mtime = query.value(0).toUInt();
+    }
     return true;
 }
 
-bool SxDatabase::isLocalDir(const QString &volume, const QString &path)
+// checkpoints of the volume, oldest generation first
+bool SxDatabase::getSyncCheckpoints(const QString &volume, QList<SyncCheckpoint> &checkpoints) const
 {
     QSqlQuery query(getThreadConnection());
-    query.prepare("select count(*) from sxFiles where volume=:volume and path like :path");
+    query.prepare("select generation, action, afterRowId, etag, listingDigest, remoteCount from sxSyncCheckpoints "
+                  "where volume=:volume order by generation");
     query.bindValue(":volume", volume);
-    query.bindValue(":path", path+"/%");
-    if (!query.exec() || !query.first()) {
-        logError(query.lastError().text());
+    if (!query.exec()) {
+        logWarning(query.lastError().text());
         return false;
     }
-    int count = query.value(0).toInt();
-    return count > 0;
+    while (query.next()) {
+        SyncCheckpoint checkpoint;
+        checkpoint.generation = query.value(0).toLongLong();
+        checkpoint.action = static_cast<ACTION>(query.value(1).toInt());
+        checkpoint.afterRowId = query.value(2).toLongLong();
+        checkpoint.etag = query.value(3).toString();
+        checkpoint.listingDigest = query.value(4).toByteArray();
+        checkpoint.remoteCount = query.value(5).toInt();
+        checkpoints.append(checkpoint);
+    }
+    return true;
 }
 
-void SxDatabase::onFileUploaded(const QString &volume, const SxFileEntry &fileEntry, bool _registerEvent)
+SxDatabase::MarkedFilesCursor::MarkedFilesCursor(const QString &volume, qint64 generation, ACTION action, int pageSize, qint64 afterRowId, bool unsettledOnly)
+    : mVolume(volume), mGeneration(generation), mAction(action), mPageSize(pageSize)
+{
+    mLastRowId = afterRowId;
+    mUnsettledOnly = unsettledOnly;
+    mFinished = false;
+}
+
+SxDatabase::ACTION SxDatabase::MarkedFilesCursor::action() const
+{
+    return mAction;
+}
+
+qint64 SxDatabase::MarkedFilesCursor::lastRowId() const
+{
+    return mLastRowId;
+}
+
+bool SxDatabase::MarkedFilesCursor::next(QList<QString> &page)
+{
+    page.clear();
+    if (mFinished)
+        return false;
+    mFinished = !SxDatabase::instance().getMarkedFiles(mVolume, mAction, mGeneration, mLastRowId, mPageSize, page, mUnsettledOnly);
+    return !page.isEmpty() || !mFinished;
+}
+
+bool SxDatabase::getLocalFileMtime(const QString &volume, const QString &path, uint32_t &mtime) const
+{
+    SxFileIndex::Entry entry;
+    if (!mFileIndex.find(volume, path, entry))
+        return false;
+    mtime = entry.mTime;
+    return true;
+}
+
+bool SxDatabase::isLocalDir(const QString &volume, const QString &path)
+{
+    return mFileIndex.hasFilesBelow(volume, path);
+}
+
+void SxDatabase::_onFileUploaded(const QString &volume, const SxFileEntry &fileEntry, bool _registerEvent)
 {
     logDebug(QString("%1/%2:%3 [%4]").arg(volume).arg(fileEntry.path()).arg(fileEntry.revision()).arg(_registerEvent));
     //QMutexLocker lock(&mMutex);
@@ -514,7 +802,7 @@ void SxDatabase::onFileUploaded(const QString &volume, const SxFileEntry &fileEn
         registerEvent(volume, fileEntry.path(), ACTION::UPLOAD);
 }
 
-void SxDatabase::onFileUploaded(const QString &volume, const QString &path, QString rev, quint32 mTime)
+void SxDatabase::_onFileUploaded(const QString &volume, const QString &path, QString rev, quint32 mTime)
 {
     logDebug(QString("%1/%2:%3").arg(volume).arg(path).arg(rev));
     QSqlQuery query(getThreadConnection());
@@ -531,9 +819,8 @@ void SxDatabase::onFileUploaded(const QString &volume, const QString &path, QStr
     registerEvent(volume, path, ACTION::UPLOAD);
 }
 
-void SxDatabase::onFileDownloaded(const QString &volume, const SxFileEntry &fileEntry)
+void SxDatabase::_onFileDownloaded(const QString &volume, const SxFileEntry &fileEntry)
 {
-    //QMutexLocker lock(&mMutex);
     QSqlQuery query(getThreadConnection());
     query.prepare("update sxFiles set localRevision=:revision, mTime=:mTime, remoteSize=:size, action=0, blockSize=:blockSize where volume=:volume and path=:path");
     query.bindValue(":volume", volume);
@@ -558,9 +845,8 @@ void SxDatabase::onFileDownloaded(const QString &volume, const SxFileEntry &file
     }
 }
 
-void SxDatabase::onRemoteFileRemoved(const QString &volume, const QString &file)
+void SxDatabase::_onFileRemoved(const QString &volume, const QString &file, ACTION action)
 {
-    //QMutexLocker lock(&mMutex);
     QSqlQuery query(getThreadConnection());
     query.prepare("delete from sxFiles where volume=:volume and path=:path");
     query.bindValue(":volume", volume);
@@ -569,97 +855,302 @@ void SxDatabase::onRemoteFileRemoved(const QString &volume, const QString &file)
         logWarning(query.lastError().text());
         return;
     }
-    registerEvent(volume, file, ACTION::REMOVE_REMOTE);
+    query.prepare("delete from sxFingerprints where volume=:volume and path=:path");
+    query.bindValue(":volume", volume);
+    query.bindValue(":path", file);
+    if (!query.exec())
+        logWarning(query.lastError().text());
+    if (action == ACTION::REMOVE_LOCAL)
+        removeFileBlocks(volume, file);
+    registerEvent(volume, file, action);
+}
+
+void SxDatabase::onFileUploaded(const QString &volume, const SxFileEntry &fileEntry, bool _registerEvent)
+{
+    SxRevisionCache::instance().invalidate(volume, fileEntry.path());
+    SxFileIndex::Entry entry;
+    mFileIndex.find(volume, fileEntry.path(), entry);
+    entry.local = !fileEntry.revision().isEmpty();
+    entry.mTime = entry.local ? fileEntry.createdTime() : 0;
+    entry.remoteSize = fileEntry.size();
+    mFileIndex.insert(volume, fileEntry.path(), entry);
+    mWriter->enqueue([this, volume, fileEntry, _registerEvent]() {
+        _onFileUploaded(volume, fileEntry, _registerEvent);
+    });
+}
+
+void SxDatabase::onFileUploaded(const QString &volume, const QString &path, QString rev, quint32 mTime)
+{
+    SxRevisionCache::instance().invalidate(volume, path);
+    SxFileIndex::Entry entry;
+    if (mFileIndex.find(volume, path, entry)) {
+        entry.local = !rev.isEmpty();
+        entry.mTime = entry.local ? mTime : 0;
+        mFileIndex.insert(volume, path, entry);
+    }
+    mWriter->enqueue([this, volume, path, rev, mTime]() {
+        _onFileUploaded(volume, path, rev, mTime);
+    });
+}
+
+void SxDatabase::onFileDownloaded(const QString &volume, const SxFileEntry &fileEntry)
+{
+    _indexDownloadedFile(volume, fileEntry);
+    mWriter->enqueue([this, volume, fileEntry]() {
+        _onFileDownloaded(volume, fileEntry);
+    });
+}
+
+/* a single write, so the files of a batch download land in the same transaction */
+void SxDatabase::onFilesDownloaded(const QString &volume, const QList<SxFileEntry> &fileEntries)
+{
+    foreach (const SxFileEntry &fileEntry, fileEntries) {
+        _indexDownloadedFile(volume, fileEntry);
+    }
+    mWriter->enqueue([this, volume, fileEntries]() {
+        foreach (const SxFileEntry &fileEntry, fileEntries) {
+            _onFileDownloaded(volume, fileEntry);
+        }
+    });
+}
+
+void SxDatabase::_indexDownloadedFile(const QString &volume, const SxFileEntry &fileEntry)
+{
+    SxRevisionCache::instance().invalidate(volume, fileEntry.path());
+    SxFileIndex::Entry entry;
+    if (mFileIndex.find(volume, fileEntry.path(), entry)) {
+        entry.local = !fileEntry.revision().isEmpty();
+        entry.mTime = entry.local ? fileEntry.createdTime() : 0;
+        entry.remoteSize = fileEntry.size();
+        mFileIndex.insert(volume, fileEntry.path(), entry);
+    }
+}
+
+void SxDatabase::onRemoteFileRemoved(const QString &volume, const QString &file)
+{
+    SxRevisionCache::instance().invalidate(volume, file);
+    mFileIndex.remove(volume, file);
+    mWriter->enqueue([this, volume, file]() {
+        _onFileRemoved(volume, file, ACTION::REMOVE_REMOTE);
+    });
 }
 
 void SxDatabase::onLocalFileRemoved(const QString &volume, const QString &file)
 {
-    //QMutexLocker lock(&mMutex);
+    mFileIndex.remove(volume, file);
+    mWriter->enqueue([this, volume, file]() {
+        _onFileRemoved(volume, file, ACTION::REMOVE_LOCAL);
+    });
+}
+
+void SxDatabase::_loadFileIndex(const QString &volume)
+{
     QSqlQuery query(getThreadConnection());
-    query.prepare("delete from sxFiles where volume=:volume and path=:path");
-    query.bindValue(":volume", volume);
-    query.bindValue(":path", file);
+    query.setForwardOnly(true);
+    QString queryString = "select volume, path, remoteRevision, remoteSize, localRevision is not null, mTime from sxFiles";
+    if (!volume.isEmpty()) {
+        query.prepare(queryString+" where volume=:volume");
+        query.bindValue(":volume", volume);
+    }
+    else
+        query.prepare(queryString);
     if (!query.exec()) {
         logWarning(query.lastError().text());
         return;
     }
-    removeFileBlocks(volume, file);
-    registerEvent(volume, file, ACTION::REMOVE_LOCAL);
+    QHash<SxPathKey, SxFileIndex::Entry> entries;
+    while (query.next()) {
+        SxFileIndex::Entry entry;
+        entry.remote = !query.isNull(2);
+        entry.remoteRevision = query.value(2).toString().toLatin1();
+        entry.remoteSize = query.value(3).toLongLong();
+        entry.local = query.value(4).toBool();
+        entry.mTime = query.value(5).toUInt();
+        entries.insert(SxPathTable::instance().intern(query.value(0).toString(), query.value(1).toString()), entry);
+    }
+    mFileIndex.reset(volume, entries);
+    logVerbose(QString("file index: %1 files of %2").arg(entries.count()).arg(volume.isEmpty() ? QString("all volumes") : volume));
 }
 
-bool SxDatabase::getHistoryRowIds(QList<qint64>& list) const
+void SxDatabase::flushWrites()
+{
+    mWriter->flush();
+}
+
+void SxDatabase::commitWrites(const QList<SxDatabaseWriter::Write> &writes)
 {
-    //QMutexLocker lock(&mMutex);
     QSqlQuery query(getThreadConnection());
-    query.prepare(QString("SELECT rowId FROM sxHistory ORDER BY eventDate DESC, rowId DESC limit %1").arg(sShowHistoryLimit));
-    if (!query.exec())
-        return false;
+    quint32 traceId = SxTrace::instance().begin(SxTraceEvent::DatabaseCommit, "writes");
+    QElapsedTimer timer;
+    timer.start();
+    bool transaction = query.exec("begin immediate transaction");
+    if (!transaction)
+        logWarning(query.lastError().text());
+    foreach (const SxDatabaseWriter::Write &write, writes) {
+        write();
+    }
+    if (transaction && !query.exec("commit transaction")) {
+        logWarning(query.lastError().text());
+        query.exec("rollback transaction");
+        transaction = false;
+    }
+    SxMetrics::instance().addDatabaseTransaction(timer.elapsed());
+    SxTrace::instance().end(SxTraceEvent::DatabaseCommit, traceId, writes.count(), transaction ? 0 : 1);
+}
+
+static qint64 pragmaValue(QSqlQuery &query, const QString &pragma)
+{
+    if (!query.exec("PRAGMA "+pragma) || !query.first()) {
+        logWarning(query.lastError().text());
+        return -1;
+    }
+    return query.value(0).toLongLong();
+}
+
+bool SxDatabase::runMaintenance(int vacuumPages)
+{
+    // an update session holds the lock for its whole duration, try again later
+    if (!mMutex.tryLock())
+        return true;
+    QSqlDatabase connection = getThreadConnection();
+    QSqlQuery query(connection);
+    QElapsedTimer timer;
+    timer.start();
+    if (!query.exec("PRAGMA wal_checkpoint(PASSIVE)"))
+        logWarning(query.lastError().text());
+    if (!query.exec("PRAGMA optimize"))
+        logWarning(query.lastError().text());
+    qint64 freePages = pragmaValue(query, "freelist_count");
+    if (freePages > 0) {
+        if (pragmaValue(query, "auto_vacuum") == sAutoVacuumIncremental) {
+            // frees one page per step
+            if (query.exec(QString("PRAGMA incremental_vacuum(%1)").arg(vacuumPages))) {
+                while (query.next());
+            }
+            else
+                logWarning(query.lastError().text());
+        }
+        else if (freePages*sVacuumFreeRatio > pragmaValue(query, "page_count")) {
+            /* databases created before incremental vacuum was enabled can
+             * only switch to it with a full rebuild, done once */
+            logInfo(QString("rebuilding database, %1 free pages").arg(freePages));
+            if (!query.exec("PRAGMA auto_vacuum=INCREMENTAL") || !query.exec("VACUUM"))
+                logWarning(query.lastError().text());
+        }
+        freePages = pragmaValue(query, "freelist_count");
+    }
+    mMutex.unlock();
+    QString dbFile = connection.databaseName();
+    SxMetrics::instance().setDatabaseSize(QFileInfo(dbFile).size(), QFileInfo(dbFile+"-wal").size());
+    logVerbose(QString("database maintenance took %1 ms, %2 free pages left").arg(timer.elapsed()).arg(freePages));
+    return freePages > 0;
+}
+
+static void readHistoryEntries(QSqlQuery &query, QList<SxDatabase::HistoryEntry> &list)
+{
     list.clear();
     while (query.next()) {
-        list.push_back(query.value(0).toLongLong());
+        SxDatabase::HistoryEntry entry;
+        entry.rowId = query.value(0).toLongLong();
+        entry.path = query.value(1).toString() + query.value(2).toString();
+        entry.eventDate = query.value(3).toUInt();
+        entry.action = static_cast<SxDatabase::ACTION>(query.value(4).toInt());
+        list.append(entry);
     }
-    return true;
 }
 
-bool SxDatabase::getHistoryEntry(qint64 rowId, QString &path, uint32_t &eventDate, ACTION &eventType) const
+bool SxDatabase::getHistoryEntries(QList<HistoryEntry> &list, qint64 beforeRowId, int limit) const
 {
-    //QMutexLocker lock(&mMutex);
-    QSqlQuery query(getThreadConnection());
-    query.prepare("SELECT volume, path, eventDate, action FROM sxHistory WHERE rowId=?");
-    query.addBindValue(rowId);
+    mWriter->flush();
+    QSqlQuery query(getReadConnection());
+    if (limit < 0 || limit > sShowHistoryLimit)
+        limit = sShowHistoryLimit;
+    if (beforeRowId < 0) {
+        query.prepare("SELECT rowId, volume, path, eventDate, action FROM sxHistory ORDER BY eventDate DESC, rowId DESC limit :limit");
+    }
+    else {
+        query.prepare("SELECT h.rowId, h.volume, h.path, h.eventDate, h.action FROM sxHistory h, (SELECT eventDate, rowId FROM sxHistory WHERE rowId=:rowId) k "
+                      "WHERE h.eventDate <= k.eventDate AND (h.eventDate < k.eventDate OR h.rowId < k.rowId) "
+                      "ORDER BY h.eventDate DESC, h.rowId DESC limit :limit");
+        query.bindValue(":rowId", beforeRowId);
+    }
+    query.bindValue(":limit", limit);
     if (!query.exec()) {
         logWarning(query.lastError().text());
         return false;
     }
-    if (query.next()) {
-        path = query.value(0).toString() + query.value(1).toString();
-        eventDate = query.value(2).toUInt();
-        eventType = static_cast<ACTION>(query.value(3).toInt());
+    readHistoryEntries(query, list);
+    return true;
+}
+
+bool SxDatabase::getNewHistoryEntries(QList<HistoryEntry> &list, qint64 afterRowId, int limit) const
+{
+    mWriter->flush();
+    QSqlQuery query(getReadConnection());
+    if (limit < 0 || limit > sShowHistoryLimit)
+        limit = sShowHistoryLimit;
+    query.prepare("SELECT rowId, volume, path, eventDate, action FROM sxHistory WHERE rowId > :rowId "
+                  "ORDER BY eventDate DESC, rowId DESC limit :limit");
+    query.bindValue(":rowId", afterRowId);
+    query.bindValue(":limit", limit);
+    if (!query.exec()) {
+        logWarning(query.lastError().text());
+        return false;
     }
+    readHistoryEntries(query, list);
     return true;
 }
 
 qint64 SxDatabase::getRemoteFileSize(const QString &volume, const QString &path)
 {
-    QSqlQuery query(getThreadConnection());
-    query.prepare("select remoteSize from sxFiles where volume=:volume and path=:path");
-    query.bindValue(":volume", volume);
-    query.bindValue(":path", path);
-    if (!query.exec() || !query.first())
+    SxFileIndex::Entry entry;
+    if (!mFileIndex.find(volume, path, entry))
         return 0;
-    return query.value(0).toLongLong();
+    return entry.remoteSize;
 }
 
 QString SxDatabase::getRemoteFileRevision(const QString &volume, const QString &path)
 {
-    QSqlQuery query(getThreadConnection());
-    query.prepare("select remoteRevision from sxFiles where volume=:volume and path=:path");
-    query.bindValue(":volume", volume);
-    query.bindValue(":path", path);
-    if (!query.exec() || !query.first())
+    SxFileIndex::Entry entry;
+    if (!mFileIndex.find(volume, path, entry))
         return "";
-    return query.value(0).toString();
+    return QString::fromLatin1(entry.remoteRevision);
 }
 
 bool SxDatabase::removeVolumeFiles(const QString &volume)
 {
+    mWriter->flush();
     QMutexLocker lock(&mMutex);
     QSqlQuery query(getThreadConnection());
+    query.prepare("delete from sxDirJournal where volume=:volume");
+    query.bindValue(":volume", volume);
+    if (!query.exec())
+        return false;
+    query.prepare("delete from sxFingerprints where volume=:volume");
+    query.bindValue(":volume", volume);
+    if (!query.exec())
+        return false;
     query.prepare("delete from sxFiles where volume=:volume");
     query.bindValue(":volume", volume);
-    return query.exec();
+    if (!query.exec())
+        return false;
+    mFileIndex.clearVolume(volume);
+    return true;
 }
 
 bool SxDatabase::removeVolumeHistory(const QString &volume)
 {
+    mWriter->flush();
     QSqlQuery query(getThreadConnection());
     query.prepare("delete from sxHistory where volume=:volume");
     query.bindValue(":volume", volume);
+    mHistoryCount.store(-1);
     return query.exec();
 }
 
 QList<QPair<QString, QString>> SxDatabase::getRecentHistory(bool shareHistory, int limit) const
 {
+    mWriter->flush();
     QList<QPair<QString, QString>> result;
     QString queryString = "select h.volume, h.path from sxHistory h";
     if (!shareHistory)
@@ -668,7 +1159,7 @@ QList<QPair<QString, QString>> SxDatabase::getRecentHistory(bool shareHistory, i
         queryString += ", sxVolumes v where action = 4 and h.volume=v.name and v.filterType=0 ";
     }
     queryString += "ORDER BY h.eventDate DESC, h.rowId DESC limit "+QString::number(limit);
-    QSqlQuery query(getThreadConnection());
+    QSqlQuery query(getReadConnection());
     if (!query.exec(queryString)) {
         logWarning(query.lastError().text());
         return result;
@@ -679,59 +1170,100 @@ QList<QPair<QString, QString>> SxDatabase::getRecentHistory(bool shareHistory, i
     return result;
 }
 
+bool SxDatabase::getVolumesActivity(QHash<QString, qint64> &lastEvents) const
+{
+    mWriter->flush();
+    lastEvents.clear();
+    QSqlQuery query(getReadConnection());
+    if (!query.exec("select volume, max(eventDate) from sxHistory group by volume")) {
+        logWarning(query.lastError().text());
+        return false;
+    }
+    while (query.next()) {
+        lastEvents.insert(query.value(0).toString(), query.value(1).toLongLong());
+    }
+    return true;
+}
+
 void SxDatabase::updateFileBlocks(const QString &volume, const SxFileEntry &fileEntry)
 {
     auto time1 = QDateTime::currentDateTime();
-    QMutexLocker locker(&mMutex);
-    auto time2 = QDateTime::currentDateTime();
+    auto blocks = fileEntry.blocks();
+    qint64 fileId;
+    auto checksums = fileEntry.checksums();
+    QVariantList fileIds, offsets, blockSizes, hashes, weakSums;
     QSqlQuery query(getThreadConnection());
-    query.prepare("delete from sxBlocks where volume=:volume and path=:path");
+    // usually runs inside a group commit of the database writer
+    if (!query.exec("savepoint fileBlocks"))
+        return;
+    auto time2 = QDateTime::currentDateTime();
+    query.prepare("insert or ignore into sxBlockFiles (volume, path) values (:volume, :path)");
     query.bindValue(":volume", volume);
     query.bindValue(":path", fileEntry.path());
-    if (!query.exec()) {
-        logWarning(query.lastError().text());
-        printSqlQuery(query);
-        return;
-    }
-    auto time3 = QDateTime::currentDateTime();
-    auto blocks = fileEntry.blocks();
-    int i;
-    qint64 offset;
-    query = QSqlQuery(getThreadConnection());
-    if (!query.exec("begin immediate transaction"))
-        return;
-    for (i=0, offset=0; i<blocks.count(); i++, offset+=fileEntry.blockSize()) {
-        query = QSqlQuery(getThreadConnection());
-        query.prepare("insert into sxBlocks (volume, path, offset, blockSize, hash) values (:volume, :path, :offset, :blockSize, :hash)");
-        query.bindValue(":volume", volume);
-        query.bindValue(":path", fileEntry.path());
-        query.bindValue(":offset", offset);
-        query.bindValue(":blockSize", fileEntry.blockSize());
-        query.bindValue(":hash", blocks.at(i));
-        if (!query.exec()) {
-            logWarning(query.lastError().text());
-            query = QSqlQuery(getThreadConnection());
-            query.exec("rollback transaction");
-            return;
+    if (!query.exec())
+        goto onSqlError;
+    query.prepare("select id from sxBlockFiles where volume=:volume and path=:path");
+    query.bindValue(":volume", volume);
+    query.bindValue(":path", fileEntry.path());
+    if (!query.exec() || !query.first())
+        goto onSqlError;
+    fileId = query.value(0).toLongLong();
+    query.prepare("delete from sxBlocks where fileId=:fileId");
+    query.bindValue(":fileId", fileId);
+    if (!query.exec())
+        goto onSqlError;
+    {
+        auto time3 = QDateTime::currentDateTime();
+        qint64 offset = 0;
+        for (int i=0; i<blocks.count(); i++) {
+            fileIds.append(fileId);
+            offsets.append(offset);
+            blockSizes.append(fileEntry.blockSize());
+            hashes.append(blocks.digest(i));
+            // blocks received from the server have no checksum
+            weakSums.append(checksums.size() == blocks.count() ? QVariant(static_cast<qint64>(checksums.at(i))) : QVariant(QVariant::LongLong));
+            offset += fileEntry.blockSize();
+        }
+        query.prepare("insert into sxBlocks (fileId, offset, blockSize, hash, checksum) values (?, ?, ?, ?, ?)");
+        query.addBindValue(fileIds);
+        query.addBindValue(offsets);
+        query.addBindValue(blockSizes);
+        query.addBindValue(hashes);
+        query.addBindValue(weakSums);
+        if (!query.execBatch())
+            goto onSqlError;
+        query.exec("release fileBlocks");
+        auto time4 = QDateTime::currentDateTime();
+        if (time1.msecsTo(time4) > 1000) {
+            auto line = QString("begin: %1ms, delete: %2ms, insert: %3ms (count: %4)")
+                    .arg(time1.msecsTo(time2))
+                    .arg(time2.msecsTo(time3))
+                    .arg(time3.msecsTo(time4))
+                    .arg(blocks.count());
+            logWarning(line);
         }
     }
-    query = QSqlQuery(getThreadConnection());
-    query.exec("commit transaction");
-    auto time4 = QDateTime::currentDateTime();
-    if (time1.msecsTo(time4) > 1000) {
-        auto line = QString("lock: %1ms, delete: %2ms, insert: %3ms (count: %4)")
-                .arg(time1.msecsTo(time2))
-                .arg(time2.msecsTo(time3))
-                .arg(time3.msecsTo(time4))
-                .arg(blocks.count());
-        logWarning(line);
-    }
+    return;
+    onSqlError:
+    logWarning(query.lastError().text());
+    printSqlQuery(query);
+    query.exec("rollback to fileBlocks");
+    query.exec("release fileBlocks");
 }
 
 void SxDatabase::removeFileBlocks(const QString &volume, const QString &path)
 {
+    mWriter->flush();
     QSqlQuery query(getThreadConnection());
-    query.prepare("delete from sxBlocks where volume=:volume and path=:path");
+    query.prepare("delete from sxBlocks where fileId in (select id from sxBlockFiles where volume=:volume and path=:path)");
+    query.bindValue(":volume", volume);
+    query.bindValue(":path", path);
+    if (!query.exec()) {
+        logWarning(query.lastError().text());
+        printSqlQuery(query);
+        return;
+    }
+    query.prepare("delete from sxBlockFiles where volume=:volume and path=:path");
     query.bindValue(":volume", volume);
     query.bindValue(":path", path);
     if (!query.exec()) {
@@ -742,12 +1274,13 @@ void SxDatabase::removeFileBlocks(const QString &volume, const QString &path)
 
 bool SxDatabase::findBlock(const QString &hash, int blockSize, QList<std::tuple<QString, QString, qint64> > &result)
 {
+    mWriter->flush();
     result.clear();
     QSqlQuery query(getThreadConnection());
-    query.prepare("select volume, path, offset from sxBlocks where "
-                  "blockSize = :blockSize and hash = :hash");
+    query.prepare("select f.volume, f.path, b.offset from sxBlocks b, sxBlockFiles f where "
+                  "b.blockSize = :blockSize and b.hash = :hash and f.id = b.fileId");
     query.bindValue(":blockSize", blockSize);
-    query.bindValue(":hash", hash);
+    query.bindValue(":hash", QByteArray::fromHex(hash.toLatin1()));
     if (!query.exec()) {
         logWarning(query.lastError().text());
         printSqlQuery(query);
@@ -758,54 +1291,165 @@ bool SxDatabase::findBlock(const QString &hash, int blockSize, QList<std::tuple<
     return true;
 }
 
+bool SxDatabase::findBlocks(const QStringList &hashes, int blockSize, QHash<QString, QList<std::tuple<QString, QString, qint64> > > &result)
+{
+    mWriter->flush();
+    static const int batchSize = 500;
+    result.clear();
+    for (int i=0; i<hashes.count(); i+=batchSize) {
+        QStringList batch = hashes.mid(i, batchSize);
+        QStringList placeholders;
+        for (int j=0; j<batch.count(); j++)
+            placeholders.append("?");
+        QSqlQuery query(getThreadConnection());
+        query.prepare("select b.hash, f.volume, f.path, b.offset from sxBlocks b, sxBlockFiles f where "
+                      "b.blockSize = ? and b.hash in (" + placeholders.join(",") + ") and f.id = b.fileId");
+        query.addBindValue(blockSize);
+        foreach (QString hash, batch) {
+            query.addBindValue(QByteArray::fromHex(hash.toLatin1()));
+        }
+        if (!query.exec()) {
+            logWarning(query.lastError().text());
+            printSqlQuery(query);
+            return false;
+        }
+        while (query.next())
+            result[QString::fromLatin1(query.value(0).toByteArray().toHex())].append(std::make_tuple(query.value(1).toString(), query.value(2).toString(), query.value(3).toLongLong()));
+    }
+    return true;
+}
+
 bool SxDatabase::findIdenticalFiles(const QString &volume, qint64 remoteFileSize, int blockSize, const QStringList &blocks, QList<QPair<QString, quint32> > &result)
 {
+    mWriter->flush();
     result.clear();
     QSqlQuery query(getThreadConnection());
-    query.prepare("select f.path, f.mTime from sxBlocks b, sxFiles f where "
-                  "b.volume=f.volume and b.path=f.path and "
-                  "b.volume=:volume and f.remoteSize=:remoteSize and "
+    query.prepare("select f.path, f.mTime, bf.id from sxBlocks b, sxBlockFiles bf, sxFiles f where "
+                  "b.fileId=bf.id and bf.volume=f.volume and bf.path=f.path and "
+                  "f.volume=:volume and f.remoteSize=:remoteSize and "
                   "b.offset=0 and b.hash=:hash and b.blockSize=:blockSize");
     query.bindValue(":volume", volume);
     query.bindValue(":remoteSize", remoteFileSize);
-    query.bindValue(":hash", blocks.first());
+    query.bindValue(":hash", QByteArray::fromHex(blocks.first().toLatin1()));
     query.bindValue(":blockSize", blockSize);
     if (!query.exec()) {
         logWarning(query.lastError().text());
         printSqlQuery(query);
         return false;
     }
-    QHash<QString, quint32> files;
+    QHash<QString, QPair<quint32, qint64>> files;
     while (query.next()) {
-        files.insert(query.value(0).toString(), query.value(1).toUInt());
+        files.insert(query.value(0).toString(), {query.value(1).toUInt(), query.value(2).toLongLong()});
     }
     foreach (QString file, files.keys()) {
         query = QSqlQuery(getThreadConnection());
-        query.prepare("select offset, hash from sxBlocks where "
-                      "volume=:volume and path=:path "
-                      "order by offset");
-        query.bindValue(":volume", volume);
-        query.bindValue(":path", file);
+        query.prepare("select offset, hash from sxBlocks where "
+                      "fileId=:fileId "
+                      "order by offset");
+        query.bindValue(":fileId", files.value(file).second);
+        if (!query.exec()) {
+            logWarning(query.lastError().text());
+            printSqlQuery(query);
+            continue;
+        }
+        qint64 offset = 0;
+        int counter=0;
+        while (query.next()) {
+            if (query.value(0).toLongLong() != offset)
+                goto nextLoop;
+            if (counter >= blocks.size() || query.value(1).toByteArray().toHex() != blocks.at(counter).toLatin1())
+                goto nextLoop;
+            ++counter;
+            offset+=blockSize;
+        }
+        if (counter != blocks.size())
+            continue;
+        result.append({file, files.value(file).first});
+        nextLoop:
+        continue;
+    }
+    return true;
+}
+
+bool SxDatabase::getKnownBlocks(const QString &volume, const QString &path, int blockSize, QVector<QPair<quint64, QString>> &blocks)
+{
+    mWriter->flush();
+    blocks.clear();
+    QSqlQuery query(getThreadConnection());
+    query.prepare("select b.offset, b.checksum, b.hash from sxBlocks b, sxBlockFiles f where "
+                  "b.fileId=f.id and f.volume=:volume and f.path=:path and b.blockSize=:blockSize "
+                  "order by b.offset");
+    query.bindValue(":volume", volume);
+    query.bindValue(":path", path);
+    query.bindValue(":blockSize", blockSize);
+    if (!query.exec()) {
+        logWarning(query.lastError().text());
+        printSqlQuery(query);
+        return false;
+    }
+    qint64 offset = 0;
+    while (query.next()) {
+        if (query.value(0).toLongLong() != offset)
+            break;
+        // an empty hash marks a block without a checksum, it is always hashed again
+        if (query.value(1).isNull())
+            blocks.append({0, QString()});
+        else
+            blocks.append({static_cast<quint64>(query.value(1).toLongLong()), QString::fromLatin1(query.value(2).toByteArray().toHex())});
+        offset += blockSize;
+    }
+    return true;
+}
+
+bool SxDatabase::findCopyCandidates(const QString &volume, const QString &path, qint64 fileSize, int limit, QList<std::tuple<QString, quint32, int, QStringList>> &result)
+{
+    mWriter->flush();
+    result.clear();
+    QSqlQuery query(getThreadConnection());
+    // only files in sync with the server, their blocks are known to be stored there
+    query.prepare("select f.path, f.mTime, f.blockSize, bf.id from sxFiles f, sxBlockFiles bf where "
+                  "bf.volume=f.volume and bf.path=f.path and "
+                  "f.volume=:volume and f.remoteSize=:remoteSize and f.path!=:path and "
+                  "f.localRevision is not null and f.localRevision=f.remoteRevision "
+                  "limit :limit");
+    query.bindValue(":volume", volume);
+    query.bindValue(":remoteSize", fileSize);
+    query.bindValue(":path", path);
+    query.bindValue(":limit", limit);
+    if (!query.exec()) {
+        logWarning(query.lastError().text());
+        printSqlQuery(query);
+        return false;
+    }
+    QList<std::tuple<QString, quint32, int, qint64>> files;
+    while (query.next()) {
+        files.append(std::make_tuple(query.value(0).toString(), query.value(1).toUInt(), query.value(2).toInt(), query.value(3).toLongLong()));
+    }
+    foreach (auto file, files) {
+        int blockSize = std::get<2>(file);
+        if (blockSize <= 0)
+            continue;
+        query = QSqlQuery(getThreadConnection());
+        query.prepare("select offset, hash from sxBlocks where fileId=:fileId order by offset");
+        query.bindValue(":fileId", std::get<3>(file));
         if (!query.exec()) {
             logWarning(query.lastError().text());
             printSqlQuery(query);
             continue;
         }
+        QStringList blocks;
         qint64 offset = 0;
-        int counter=0;
+        bool complete = true;
         while (query.next()) {
-            if (query.value(0).toLongLong() != offset)
-                goto nextLoop;
-            if (query.value(1).toString() != blocks.at(counter))
-                goto nextLoop;
-            ++counter;
-            offset+=blockSize;
+            if (query.value(0).toLongLong() != offset) {
+                complete = false;
+                break;
+            }
+            blocks.append(QString::fromLatin1(query.value(1).toByteArray().toHex()));
+            offset += blockSize;
         }
-        if (counter != blocks.size())
-            continue;
-        result.append({file, files.value(file)});
-        nextLoop:
-        continue;
+        if (complete && offset >= fileSize && offset - fileSize < blockSize)
+            result.append(std::make_tuple(std::get<0>(file), std::get<1>(file), blockSize, blocks));
     }
     return true;
 }
@@ -824,21 +1468,35 @@ void SxDatabase::removeSuppression(const QString &volume, const QString &path)
 
 bool SxDatabase::getFilesCount(const QString &volume, bool localFiles, quint32 &count)
 {
+    VolumeStats stats;
+    if (!getVolumeStats(volume, stats))
+        return false;
+    count = static_cast<quint32>(localFiles ? stats.localFiles : stats.remoteFiles);
+    return true;
+}
+
+bool SxDatabase::getVolumeStats(const QString &volume, VolumeStats &stats)
+{
+    mWriter->flush();
     QSqlQuery query(getThreadConnection());
-    query.prepare(QString("select count(*) from sxFiles where volume=:volume and ") +
-                  (localFiles ? "localRevision not null" : "remoteRevision not null"));
+    query.prepare("select localFiles, remoteFiles, localBytes, remoteBytes from sxVolumeStats where volume=:volume");
     query.bindValue(":volume", volume);
     if (!query.exec()) {
+        logWarning(query.lastError().text());
         return false;
     }
     if (!query.first())
         return false;
-    count = query.value(0).toUInt();
+    stats.localFiles = query.value(0).toLongLong();
+    stats.remoteFiles = query.value(1).toLongLong();
+    stats.localBytes = query.value(2).toLongLong();
+    stats.remoteBytes = query.value(3).toLongLong();
     return true;
 }
 
 bool SxDatabase::testHistoryRevision(const QString &volume, const QString &file, const QString &revision, int &count)
 {
+    mWriter->flush();
     if (volume.isEmpty() || file.isEmpty() || revision.isEmpty())
         return false;
     QSqlQuery query(getThreadConnection());
@@ -857,6 +1515,7 @@ bool SxDatabase::testHistoryRevision(const QString &volume, const QString &file,
 
 bool SxDatabase::updateInconsistentFile(const QString &volume, const QString &file, const QStringList &revisions)
 {
+    mWriter->flush();
     QSqlQuery query(getThreadConnection());
     query.prepare("delete from sxInconsistentFiles where volume=:volume and path=:file");
     query.bindValue(":volume", volume);
@@ -877,6 +1536,7 @@ bool SxDatabase::updateInconsistentFile(const QString &volume, const QString &fi
 
 bool SxDatabase::getInconsistentFile(const QString &volume, const QString &file, QStringList &revisions)
 {
+    mWriter->flush();
     QSqlQuery query(getThreadConnection());
     query.prepare("select (revision) from sxInconsistentFiles where volume=:volume and path=:file");
     query.bindValue(":volume", volume);
@@ -890,11 +1550,286 @@ bool SxDatabase::getInconsistentFile(const QString &volume, const QString &file,
     return true;
 }
 
-QSqlDatabase SxDatabase::getThreadConnection()
+bool SxDatabase::getUploadState(const QString &volume, const QString &path, SxUploadState &state)
+{
+    mWriter->flush();
+    QSqlQuery query(getThreadConnection());
+    query.prepare("select size, mTime, blockSize, uploadToken, pollTarget, blocks from sxUploads where volume=:volume and path=:path");
+    query.bindValue(":volume", volume);
+    query.bindValue(":path", path);
+    if (!query.exec()) {
+        logWarning(query.lastError().text());
+        printSqlQuery(query);
+        return false;
+    }
+    if (!query.next())
+        return false;
+    state.size = query.value(0).toLongLong();
+    state.mtime = query.value(1).toUInt();
+    state.blockSize = query.value(2).toInt();
+    state.uploadToken = query.value(3).toString();
+    state.pollTarget = query.value(4).toString();
+    state.blocks = query.value(5).toString().split(",", QString::SkipEmptyParts);
+    return true;
+}
+
+void SxDatabase::updateUploadState(const QString &volume, const QString &path, const SxUploadState &state)
+{
+    mWriter->flush();
+    QSqlQuery query(getThreadConnection());
+    query.prepare("insert or replace into sxUploads (volume, path, size, mTime, blockSize, uploadToken, pollTarget, blocks) "
+                  "values (:volume, :path, :size, :mTime, :blockSize, :uploadToken, :pollTarget, :blocks)");
+    query.bindValue(":volume", volume);
+    query.bindValue(":path", path);
+    query.bindValue(":size", state.size);
+    query.bindValue(":mTime", state.mtime);
+    query.bindValue(":blockSize", state.blockSize);
+    query.bindValue(":uploadToken", state.uploadToken);
+    query.bindValue(":pollTarget", state.pollTarget);
+    query.bindValue(":blocks", state.blocks.join(","));
+    if (!query.exec()) {
+        logWarning(query.lastError().text());
+        printSqlQuery(query);
+    }
+}
+
+bool SxDatabase::getFingerprint(const QString &volume, const QString &path, SxFingerprint &fingerprint)
+{
+    mWriter->flush();
+    QSqlQuery query(getThreadConnection());
+    query.prepare("select size, inode, cTime, sample from sxFingerprints where volume=:volume and path=:path");
+    query.bindValue(":volume", volume);
+    query.bindValue(":path", path);
+    if (!query.exec()) {
+        logWarning(query.lastError().text());
+        printSqlQuery(query);
+        return false;
+    }
+    if (!query.next())
+        return false;
+    fingerprint.size = query.value(0).toLongLong();
+    fingerprint.inode = static_cast<quint64>(query.value(1).toLongLong());
+    fingerprint.cTime = query.value(2).toLongLong();
+    fingerprint.sample = query.value(3).toByteArray();
+    return true;
+}
+
+void SxDatabase::updateFingerprint(const QString &volume, const QString &path, const SxFingerprint &fingerprint)
+{
+    mWriter->flush();
+    QSqlQuery query(getThreadConnection());
+    query.prepare("insert or replace into sxFingerprints (volume, path, size, inode, cTime, sample) "
+                  "values (:volume, :path, :size, :inode, :cTime, :sample)");
+    query.bindValue(":volume", volume);
+    query.bindValue(":path", path);
+    query.bindValue(":size", fingerprint.size);
+    query.bindValue(":inode", static_cast<qint64>(fingerprint.inode));
+    query.bindValue(":cTime", fingerprint.cTime);
+    query.bindValue(":sample", fingerprint.sample);
+    if (!query.exec()) {
+        logWarning(query.lastError().text());
+        printSqlQuery(query);
+    }
+}
+
+bool SxDatabase::acceptUnchangedFile(const QString &volume, const QString &path, quint32 mTime)
+{
+    mWriter->flush();
+    QSqlQuery query(getThreadConnection());
+    query.prepare("update sxFiles set mTime=:mTime where volume=:volume and path=:path and localRevision is not null");
+    query.bindValue(":volume", volume);
+    query.bindValue(":path", path);
+    query.bindValue(":mTime", mTime);
+    if (!query.exec()) {
+        logWarning(query.lastError().text());
+        printSqlQuery(query);
+        return false;
+    }
+    if (query.numRowsAffected() <= 0)
+        return false;
+    SxFileIndex::Entry entry;
+    if (mFileIndex.find(volume, path, entry)) {
+        entry.mTime = mTime;
+        mFileIndex.insert(volume, path, entry);
+    }
+    return true;
+}
+
+/* writes the synchronised files of a volume with their block lists and fingerprint samples
+ * to a separate database, for seeding the database of another machine holding a copy of
+ * the same local tree */
+bool SxDatabase::exportSyncState(const QString &volume, const QString &fileName)
+{
+    static const QStringList statements = {
+        "create table seed.sxSyncState (volume text not null, version integer not null, exportedAt integer not null)",
+        "insert into seed.sxSyncState (volume, version, exportedAt) values (:volume, :version, strftime('%s', 'now'))",
+        "create table seed.sxFiles as select path, remoteRevision, localRevision, mTime, remoteSize, blockSize from sxFiles "
+        "where volume=:volume and action=0 and localRevision is not null and remoteRevision is not null",
+        "create unique index seed.sxFiles_path_index on sxFiles (path)",
+        "create table seed.sxBlocks as select f.path as path, b.offset as offset, b.blockSize as blockSize, b.hash as hash, b.checksum as checksum "
+        "from sxBlockFiles f join sxBlocks b on b.fileId=f.id join seed.sxFiles s on s.path=f.path where f.volume=:volume",
+        "create index seed.sxBlocks_path_index on sxBlocks (path)",
+        "create table seed.sxFingerprints as select p.path as path, p.size as size, p.sample as sample "
+        "from sxFingerprints p join seed.sxFiles s on s.path=p.path where p.volume=:volume"
+    };
+    mWriter->flush();
+    QFile::remove(fileName);
+    QSqlQuery query(getThreadConnection());
+    query.prepare("attach database :file as seed");
+    query.bindValue(":file", fileName);
+    if (!query.exec()) {
+        logWarning(query.lastError().text());
+        return false;
+    }
+    bool result = true;
+    foreach (const QString &statement, statements) {
+        query.prepare(statement);
+        if (statement.contains(":volume"))
+            query.bindValue(":volume", volume);
+        if (statement.contains(":version"))
+            query.bindValue(":version", sSyncStateVersion);
+        if (!query.exec()) {
+            logWarning(query.lastError().text());
+            printSqlQuery(query);
+            result = false;
+            break;
+        }
+    }
+    query.finish();
+    if (!query.exec("detach database seed"))
+        logWarning(query.lastError().text());
+    if (!result)
+        QFile::remove(fileName);
+    return result;
+}
+
+/* takes over the files of an exported sync state which are not known yet and whose local
+ * copy has the exported size and modification time; their block lists are trusted, so
+ * the initial scan neither hashes them nor asks the cluster about them. The fingerprints
+ * get the inode and change time of the local copy. Files which don't match are left to
+ * the initial scan */
+bool SxDatabase::importSyncState(const QString &volume, const QString &fileName, const QString &volumeRootDir, int &imported, int &skipped)
+{
+    imported = 0;
+    skipped = 0;
+    QVariantList paths, inodes, cTimes;
+    mWriter->flush();
+    QSqlQuery query(getThreadConnection());
+    query.prepare("attach database :file as seed");
+    query.bindValue(":file", fileName);
+    if (!query.exec()) {
+        logWarning(query.lastError().text());
+        return false;
+    }
+    // rows of sxFiles need the volume, which is known after the first volume listing
+    query.prepare("select count(*) from sxVolumes where name=:volume");
+    query.bindValue(":volume", volume);
+    if (!query.exec() || !query.next())
+        goto onSqlError;
+    if (query.value(0).toInt() == 0) {
+        logWarning(QString("volume %1 is not known yet, start the synchronisation once before importing").arg(volume));
+        goto onError;
+    }
+    if (!query.exec("select version from seed.sxSyncState") || !query.next())
+        goto onSqlError;
+    if (query.value(0).toInt() != sSyncStateVersion) {
+        logWarning(QString("unsupported sync state version %1").arg(query.value(0).toInt()));
+        goto onError;
+    }
+
+    query.setForwardOnly(true);
+    query.prepare("select s.path, s.mTime, s.remoteSize from seed.sxFiles s "
+                  "where not exists (select 1 from sxFiles f where f.volume=:volume and f.path=s.path)");
+    query.bindValue(":volume", volume);
+    if (!query.exec())
+        goto onSqlError;
+    while (query.next()) {
+        QString path = query.value(0).toString();
+        QString localPath = volumeRootDir + (path.startsWith("/") ? path : "/"+path);
+        SxFingerprint fingerprint;
+        if (!SxFilesystem::getFingerprint(localPath, false, fingerprint) || fingerprint.size != query.value(2).toLongLong() ||
+                QFileInfo(localPath).lastModified().toTime_t() != query.value(1).toUInt()) {
+            skipped++;
+            continue;
+        }
+        paths.append(path);
+        inodes.append(static_cast<qint64>(fingerprint.inode));
+        cTimes.append(fingerprint.cTime);
+    }
+    query.finish();
+
+    if (!query.exec("begin transaction"))
+        goto onSqlError;
+    if (!query.exec("create temp table sxSeedPaths (path text primary key, inode integer not null, cTime integer not null) without rowid"))
+        goto onRollback;
+    query.prepare("insert into temp.sxSeedPaths (path, inode, cTime) values (?, ?, ?)");
+    query.addBindValue(paths);
+    query.addBindValue(inodes);
+    query.addBindValue(cTimes);
+    if (!query.execBatch())
+        goto onRollback;
+    foreach (const QString &statement, QStringList({
+        "insert or ignore into sxFiles (volume, path, remoteRevision, localRevision, mTime, remoteSize, action, blockSize) "
+        "select :volume, s.path, s.remoteRevision, s.localRevision, s.mTime, s.remoteSize, 0, s.blockSize "
+        "from temp.sxSeedPaths p join seed.sxFiles s on s.path=p.path",
+        "insert or ignore into sxBlockFiles (volume, path) select :volume, path from temp.sxSeedPaths",
+        "insert or ignore into sxBlocks (fileId, offset, blockSize, hash, checksum) "
+        "select f.id, b.offset, b.blockSize, b.hash, b.checksum from temp.sxSeedPaths p "
+        "join seed.sxBlocks b on b.path=p.path join sxBlockFiles f on f.volume=:volume and f.path=p.path",
+        "insert or ignore into sxFingerprints (volume, path, size, inode, cTime, sample) "
+        "select :volume, p.path, s.size, p.inode, p.cTime, s.sample from temp.sxSeedPaths p join seed.sxFingerprints s on s.path=p.path"})) {
+        query.prepare(statement);
+        query.bindValue(":volume", volume);
+        if (!query.exec())
+            goto onRollback;
+    }
+    if (!query.exec("drop table temp.sxSeedPaths"))
+        goto onRollback;
+    if (!query.exec("commit"))
+        goto onRollback;
+    query.exec("detach database seed");
+    imported = paths.count();
+    _loadFileIndex(volume);
+    logInfo(QString("imported the sync state of %1 files of %2, %3 files left to the initial scan").arg(imported).arg(volume).arg(skipped));
+    return true;
+
+    onRollback:
+    logWarning(query.lastError().text());
+    printSqlQuery(query);
+    query.exec("rollback");
+    query.exec("detach database seed");
+    return false;
+    onSqlError:
+    logWarning(query.lastError().text());
+    printSqlQuery(query);
+    onError:
+    query.finish();
+    query.exec("detach database seed");
+    return false;
+}
+
+void SxDatabase::removeUploadState(const QString &volume, const QString &path)
+{
+    mWriter->flush();
+    QSqlQuery query(getThreadConnection());
+    query.prepare("delete from sxUploads where volume=:volume and path=:path");
+    query.bindValue(":volume", volume);
+    query.bindValue(":path", path);
+    if (!query.exec()) {
+        logWarning(query.lastError().text());
+        printSqlQuery(query);
+    }
+}
+
+QSqlDatabase SxDatabase::openConnection(const QString &prefix, bool readOnly)
 {
     QThread *t = QThread::currentThread();
-    if (sConnections.contains(t))
-        return QSqlDatabase::database(sConnections.value(t));
+    QString connectionName = QString("%1_%2").arg(prefix).arg(reinterpret_cast<quintptr>(t));
+    {
+        QMutexLocker locker(&sConnectionsMutex);
+        if (sConnections.contains(t, connectionName))
+            return QSqlDatabase::database(connectionName);
+    }
 
     static QDir cacheDir(QStandardPaths::writableLocation(QStandardPaths::CacheLocation));
     if (!cacheDir.mkpath(".")) {
@@ -902,22 +1837,42 @@ QSqlDatabase SxDatabase::getThreadConnection()
     }
     static QString dbFile = cacheDir.absoluteFilePath("sxsync.db");
 
-    QString connectionName = QString("sxdrive_%1").arg(reinterpret_cast<quintptr>(t));
     QSqlDatabase connection = QSqlDatabase::addDatabase("QSQLITE", connectionName);
     connection.setDatabaseName(dbFile);
+    if (readOnly)
+        connection.setConnectOptions("QSQLITE_OPEN_READONLY");
     if (!connection.open()) {
         throw std::runtime_error("Cannot open the database");
     }
-    sConnections.insert(t, connectionName);
-    connect(t, &QThread::finished, [t]() {
-        if (sConnections.contains(t)) {
-            QSqlDatabase::removeDatabase(sConnections.value(t));
+    QSqlQuery query(connection);
+    query.exec("PRAGMA synchronous=NORMAL");
+    if (readOnly)
+        query.exec("PRAGMA query_only=1");
+
+    QMutexLocker locker(&sConnectionsMutex);
+    if (!sConnections.contains(t)) {
+        connect(t, &QThread::finished, [t]() {
+            QMutexLocker locker(&sConnectionsMutex);
+            foreach (const QString &name, sConnections.values(t)) {
+                QSqlDatabase::removeDatabase(name);
+            }
             sConnections.remove(t);
-        }
-    });
+        });
+    }
+    sConnections.insert(t, connectionName);
     return connection;
 }
 
+QSqlDatabase SxDatabase::getThreadConnection()
+{
+    return openConnection("sxdrive", false);
+}
+
+QSqlDatabase SxDatabase::getReadConnection()
+{
+    return openConnection("sxdrive_ro", true);
+}
+
 void SxDatabase::registerEvent(const QString &volume, const QString &path, SxDatabase::ACTION action, const QString &revision)
 {
     static const QStringList ignoredFiles = {".sxnewdir", ".DS_Store", "._.DS_Store"};
@@ -940,15 +1895,7 @@ void SxDatabase::registerEvent(const QString &volume, const QString &path, SxDat
     if (query.exec("SELECT last_insert_rowid()") && query.first()) {
         rowId = query.value(0).toLongLong();
     }
-    if (query.exec(QString("select min(rowId) from (select rowId from sxHistory order by eventDate DESC, rowId DESC limit %1)").arg(sHistoryLimit)) && query.first()) {
-        removeId = query.value(0).toUInt();
-        query = QSqlQuery(getThreadConnection());
-        query.prepare("delete from sxHistory where rowId < :rowId");
-        query.bindValue(":rowId", removeId);
-        if (!query.exec()) {
-            logWarning(query.lastError().text());
-        }
-    }
+    pruneHistory();
     if (rowId != -1) {
         if (rowId-sShowHistoryLimit > removeId ) {
             removeId = rowId-sShowHistoryLimit;
@@ -957,8 +1904,37 @@ void SxDatabase::registerEvent(const QString &volume, const QString &path, SxDat
     }
 }
 
+void SxDatabase::pruneHistory()
+{
+    QSqlQuery query(getThreadConnection());
+    int count = mHistoryCount.load();
+    if (count < 0) {
+        if (!query.exec("select count(*) from sxHistory") || !query.first()) {
+            logWarning(query.lastError().text());
+            return;
+        }
+        count = query.value(0).toInt();
+    }
+    else
+        count++;
+    // drop the oldest events in chunks instead of trimming on every insert
+    if (count >= sHistoryLimit + sHistoryPruneChunk) {
+        query.prepare("delete from sxHistory where rowId in "
+                      "(select rowId from sxHistory order by eventDate, rowId limit :count)");
+        query.bindValue(":count", count - sHistoryLimit);
+        if (!query.exec()) {
+            logWarning(query.lastError().text());
+            mHistoryCount.store(-1);
+            return;
+        }
+        count -= query.numRowsAffected();
+    }
+    mHistoryCount.store(count);
+}
+
 bool SxDatabase::markVolumeFilesToRemove(const QString &volume, bool removeRemote, bool onlySkipped)
 {
+    mWriter->flush();
     QSqlQuery q(getThreadConnection());
     if (!q.exec("begin transaction"))
         return false;
@@ -985,25 +1961,19 @@ bool SxDatabase::markVolumeFilesToRemove(const QString &volume, bool removeRemot
 
 bool SxDatabase::markLocalDirFilesToRemove(const QString &volume, const QString &dir, bool onlyExisting)
 {
+    mWriter->flush();
     QSqlQuery q(getThreadConnection());
     if (!q.exec("begin transaction"))
         return false;
     QSqlQuery query(getThreadConnection());
-    if(!query.exec("update sxFiles set action=0")) {
-        logWarning(query.lastError().text());
-        q.exec("rollback transaction");
-        return false;
-    }
-    QString queryString = "update sxFiles set action=:action where volume=:volume and path like :path";
+    QString queryString = "update sxFiles set action=:action where volume=:volume and path>=:lower and path<:upper";
     if (onlyExisting)
         queryString += " and localRevision not null";
     query.prepare(queryString);
     query.bindValue(":volume", volume);
     query.bindValue(":action", static_cast<int>(ACTION::REMOVE_REMOTE));
-    if (dir.endsWith("/"))
-        query.bindValue(":path", dir+"%");
-    else
-        query.bindValue(":path", dir+"/%");
+    query.bindValue(":lower", dirLowerBound(dir));
+    query.bindValue(":upper", dirUpperBound(dir));
     //printSqlQuery(query);
     if (!query.exec()) {
         logWarning(query.lastError().text());
@@ -1014,27 +1984,108 @@ bool SxDatabase::markLocalDirFilesToRemove(const QString &volume, const QString
     return true;
 }
 
-bool SxDatabase::remoteFileExists(const QString &volume, const QString &file)
+bool SxDatabase::markChangedDirsFilesToRemove(const QString &volume, const QStringList &changedDirs, const QStringList &removedDirs)
 {
-    //QMutexLocker lock(&mMutex);
+    mWriter->flush();
+    QSqlQuery q(getThreadConnection());
+    if (!q.exec("begin transaction"))
+        return false;
+    // only the files directly inside a changed directory, its subdirectories have their own entries
+    q.prepare("update sxFiles set action=:action where volume=:volume and action=:actionSkip "
+              "and path>=:lower and path<:upper and instr(substr(path, :offset), '/')=0");
+    foreach (const QString &dir, changedDirs) {
+        q.bindValue(":action", static_cast<int>(ACTION::REMOVE_REMOTE));
+        q.bindValue(":volume", volume);
+        q.bindValue(":actionSkip", static_cast<int>(ACTION::SKIP));
+        q.bindValue(":lower", dirLowerBound(dir));
+        q.bindValue(":upper", dirUpperBound(dir));
+        q.bindValue(":offset", dirLowerBound(dir).length()+1);
+        if (!q.exec())
+            goto onRollback;
+    }
+    q.prepare("update sxFiles set action=:action where volume=:volume and action=:actionSkip "
+              "and path>=:lower and path<:upper");
+    foreach (const QString &dir, removedDirs) {
+        q.bindValue(":action", static_cast<int>(ACTION::REMOVE_REMOTE));
+        q.bindValue(":volume", volume);
+        q.bindValue(":actionSkip", static_cast<int>(ACTION::SKIP));
+        q.bindValue(":lower", dirLowerBound(dir));
+        q.bindValue(":upper", dirUpperBound(dir));
+        if (!q.exec())
+            goto onRollback;
+    }
+    if (!q.exec("commit transaction"))
+        goto onSqlError;
+    return true;
+    onRollback:
+    logWarning(q.lastError().text());
+    q.exec("rollback transaction");
+    return false;
+    onSqlError:
+    logWarning(q.lastError().text());
+    return false;
+}
+
+bool SxDatabase::getDirJournal(const QString &volume, QHash<QString, qint64> &dirs)
+{
+    mWriter->flush();
+    dirs.clear();
     QSqlQuery query(getThreadConnection());
-    query.prepare("select remoteRevision from sxFiles where volume=:volume and path=:path");
+    query.prepare("select path, mTime from sxDirJournal where volume=:volume");
     query.bindValue(":volume", volume);
-    query.bindValue(":path", file);
-    //printSqlQuery(query);
     if (!query.exec()) {
         logWarning(query.lastError().text());
         return false;
     }
-    if (!query.first())
-        return false;
-    if (query.isNull(0))
-        return false;
+    while (query.next()) {
+        dirs.insert(query.value(0).toString(), query.value(1).toLongLong());
+    }
+    return true;
+}
+
+bool SxDatabase::saveDirJournal(const QString &volume, const QHash<QString, qint64> &dirs)
+{
+    mWriter->flush();
+    QVariantList volumes, paths, mTimes;
+    for (auto it = dirs.constBegin(); it != dirs.constEnd(); ++it) {
+        volumes.append(volume);
+        paths.append(it.key());
+        mTimes.append(it.value());
+    }
+    QSqlQuery q(getThreadConnection());
+    if (!q.exec("begin transaction"))
+        goto onSqlError;
+    q.prepare("delete from sxDirJournal where volume=:volume");
+    q.bindValue(":volume", volume);
+    if (!q.exec())
+        goto onRollback;
+    q.prepare("insert into sxDirJournal (volume, path, mTime) values (?, ?, ?)");
+    q.addBindValue(volumes);
+    q.addBindValue(paths);
+    q.addBindValue(mTimes);
+    if (!q.execBatch())
+        goto onRollback;
+    if (!q.exec("commit transaction"))
+        goto onSqlError;
     return true;
+    onRollback:
+    logWarning(q.lastError().text());
+    q.exec("rollback transaction");
+    return false;
+    onSqlError:
+    logWarning(q.lastError().text());
+    return false;
+}
+
+bool SxDatabase::remoteFileExists(const QString &volume, const QString &file)
+{
+    SxFileIndex::Entry entry;
+    return mFileIndex.find(volume, file, entry) && entry.remote;
 }
 
 bool SxDatabase::dropFileEntry(const QString &volume, const QString &file)
 {
+    mWriter->flush();
     //QMutexLocker lock(&mMutex);
     QSqlQuery query(getThreadConnection());
     query.prepare("delete from sxFiles where volume=:volume and path=:path");
@@ -1045,13 +2096,100 @@ bool SxDatabase::dropFileEntry(const QString &volume, const QString &file)
         logWarning(query.lastError().text());
         return false;
     }
+    mFileIndex.remove(volume, file);
     return query.numRowsAffected() > 0;
 }
 
+bool SxDatabase::moveFileEntries(const QString &volume, const QString &source, const QString &destination, const QList<SxFileEntry *> &movedFiles)
+{
+    mWriter->flush();
+    // directories end with a slash, their entries keep the part of the path below the moved directory
+    bool isDir = source.endsWith("/");
+    QVariantList revisions, sizes, volumes, paths;
+    foreach (SxFileEntry *entry, movedFiles) {
+        if (isDir ? !entry->path().startsWith(destination) : entry->path() != destination)
+            continue;
+        revisions.append(entry->revision());
+        sizes.append(entry->size());
+        volumes.append(volume);
+        paths.append(entry->path());
+    }
+
+    QSqlQuery q(getThreadConnection());
+    if (!q.exec("begin transaction"))
+        goto onSqlError;
+    foreach (QString table, QStringList({"sxFiles", "sxFingerprints"})) {
+        if (isDir) {
+            q.prepare(QString("delete from %1 where volume=:volume and path>=:lower and path<:upper").arg(table));
+            q.bindValue(":lower", dirLowerBound(destination));
+            q.bindValue(":upper", dirUpperBound(destination));
+        }
+        else {
+            q.prepare(QString("delete from %1 where volume=:volume and path=:path").arg(table));
+            q.bindValue(":path", destination);
+        }
+        q.bindValue(":volume", volume);
+        if (!q.exec())
+            goto onRollback;
+        if (isDir) {
+            q.prepare(QString("update %1 set path=:destination||substr(path, :offset) where volume=:volume and path>=:lower and path<:upper").arg(table));
+            q.bindValue(":destination", destination);
+            q.bindValue(":offset", source.length()+1);
+            q.bindValue(":lower", dirLowerBound(source));
+            q.bindValue(":upper", dirUpperBound(source));
+        }
+        else {
+            q.prepare(QString("update %1 set path=:destination where volume=:volume and path=:source").arg(table));
+            q.bindValue(":destination", destination);
+            q.bindValue(":source", source);
+        }
+        q.bindValue(":volume", volume);
+        if (!q.exec())
+            goto onRollback;
+    }
+    // the server gives moved files a new revision, files still waiting for download stay that way
+    if (!paths.isEmpty()) {
+        q.prepare("update sxFiles set remoteRevision=?, remoteSize=?, "
+                  "localRevision=case when localRevision is null then null else ? end "
+                  "where volume=? and path=?");
+        q.addBindValue(revisions);
+        q.addBindValue(sizes);
+        q.addBindValue(revisions);
+        q.addBindValue(volumes);
+        q.addBindValue(paths);
+        if (!q.execBatch())
+            goto onRollback;
+    }
+    if (!q.exec("commit transaction"))
+        goto onSqlError;
+    _loadFileIndex(volume);
+    registerEvent(volume, destination, ACTION::UPLOAD);
+    return true;
+    onRollback:
+    logWarning(q.lastError().text());
+    q.exec("rollback transaction");
+    return false;
+    onSqlError:
+    logWarning(q.lastError().text());
+    return false;
+}
+
 SxDatabase::SxDatabase() : QObject(nullptr)
 {
     mAbortedCB = nullptr;
+    mSessionGeneration = 0;
+    mHistoryCount.store(-1);
     setupTables();
+    _loadFileIndex(QString());
+    mWriter = new SxDatabaseWriter([this](const QList<SxDatabaseWriter::Write> &writes) {
+        commitWrites(writes);
+    });
+    mWriter->start();
+    if (QCoreApplication::instance()) {
+        connect(QCoreApplication::instance(), &QCoreApplication::aboutToQuit, [this]() {
+            mWriter->stop();
+        });
+    }
 }
 
 static const QHash<QString, QPair<int,QString>> createTableQueries = {
@@ -1073,21 +2211,107 @@ static const QHash<QString, QPair<int,QString>> createTableQueries = {
     {"sxHistory",   {2, "create table if not exists sxHistory "
                      "(volume text references sxVolumes(name) on delete cascade on update cascade, path text, revision text, "
                      "action integer not null, eventDate integer not null)"}},
-    {"sxBlocks",    {1, "create table if not exists sxBlocks "
-                     "(volume text not null, path text not null, blockSize integer not null, offset integer not null, hash text not null, "
-                     "foreign key (volume, path) references sxFiles(volume, path) on delete cascade on update cascade, "
-                     "primary key (volume, path, offset))"
+    {"sxBlockFiles", {1, "create table if not exists sxBlockFiles "
+                      "(id integer primary key, volume text not null, path text not null, "
+                      "foreign key (volume, path) references sxFiles(volume, path) on delete cascade on update cascade, "
+                      "unique (volume, path))"
+    }},
+    {"sxBlocks",    {3, "create table if not exists sxBlocks "
+                     "(fileId integer not null references sxBlockFiles(id) on delete cascade, "
+                     "offset integer not null, blockSize integer not null, hash blob not null, checksum integer, "
+                     "primary key (fileId, offset)) without rowid"
+    }},
+    {"sxUploads",   {1, "create table if not exists sxUploads "
+                     "(volume text not null references sxVolumes(name) on delete cascade on update cascade, path text not null, "
+                     "size integer not null, mTime integer not null, blockSize integer not null, "
+                     "uploadToken text not null, pollTarget text not null, blocks text not null, "
+                     "primary key (volume, path))"
+    }},
+    {"sxDirJournal", {1, "create table if not exists sxDirJournal "
+                      "(volume text not null references sxVolumes(name) on delete cascade on update cascade, path text not null, "
+                      "mTime integer not null, "
+                      "primary key (volume, path)) without rowid"
+    }},
+    {"sxFingerprints", {1, "create table if not exists sxFingerprints "
+                        "(volume text not null references sxVolumes(name) on delete cascade on update cascade, path text not null, "
+                        "size integer not null, inode integer not null, cTime integer not null, sample blob not null, "
+                        "primary key (volume, path)) without rowid"
+    }},
+    {"sxMarkedFiles", {1, "create table if not exists sxMarkedFiles "
+                       "(volume text not null references sxVolumes(name) on delete cascade on update cascade, "
+                       "generation integer not null, action integer not null, path text not null)"
+    }},
+    {"sxVolumeStats", {1, "create table if not exists sxVolumeStats "
+                       "(volume text primary key references sxVolumes(name) on delete cascade on update cascade, "
+                       "localFiles integer not null default 0, remoteFiles integer not null default 0, "
+                       "localBytes integer not null default 0, remoteBytes integer not null default 0) without rowid"
+    }},
+    {"sxSyncCheckpoints", {1, "create table if not exists sxSyncCheckpoints "
+                           "(generation integer primary key, "
+                           "volume text not null references sxVolumes(name) on delete cascade on update cascade, "
+                           "action integer not null, afterRowId integer not null, "
+                           "etag text not null, listingDigest blob not null, remoteCount integer not null, "
+                           "savedTime integer not null)"
     }}
 };
 
+/* the counters move with every row of sxFiles written, in the transaction of the write;
+ * volume renames cascade to the counters themselves, so they are not tracked per file */
+static const QStringList volumeStatsTriggers = {
+    "create trigger if not exists sxVolumeStats_addVolume after insert on sxVolumes begin "
+    "insert or ignore into sxVolumeStats (volume) values (new.name); end",
+    "create trigger if not exists sxVolumeStats_insertFile after insert on sxFiles begin "
+    "update sxVolumeStats set localFiles=localFiles+(new.localRevision is not null), remoteFiles=remoteFiles+(new.remoteRevision is not null), "
+    "localBytes=localBytes+(case when new.localRevision is null then 0 else ifnull(new.remoteSize, 0) end), "
+    "remoteBytes=remoteBytes+(case when new.remoteRevision is null then 0 else ifnull(new.remoteSize, 0) end) "
+    "where volume=new.volume; end",
+    "create trigger if not exists sxVolumeStats_deleteFile after delete on sxFiles begin "
+    "update sxVolumeStats set localFiles=localFiles-(old.localRevision is not null), remoteFiles=remoteFiles-(old.remoteRevision is not null), "
+    "localBytes=localBytes-(case when old.localRevision is null then 0 else ifnull(old.remoteSize, 0) end), "
+    "remoteBytes=remoteBytes-(case when old.remoteRevision is null then 0 else ifnull(old.remoteSize, 0) end) "
+    "where volume=old.volume; end",
+    "create trigger if not exists sxVolumeStats_updateFile after update of localRevision, remoteRevision, remoteSize on sxFiles begin "
+    "update sxVolumeStats set localFiles=localFiles+(new.localRevision is not null)-(old.localRevision is not null), "
+    "remoteFiles=remoteFiles+(new.remoteRevision is not null)-(old.remoteRevision is not null), "
+    "localBytes=localBytes+(case when new.localRevision is null then 0 else ifnull(new.remoteSize, 0) end)"
+    "-(case when old.localRevision is null then 0 else ifnull(old.remoteSize, 0) end), "
+    "remoteBytes=remoteBytes+(case when new.remoteRevision is null then 0 else ifnull(new.remoteSize, 0) end)"
+    "-(case when old.remoteRevision is null then 0 else ifnull(old.remoteSize, 0) end) "
+    "where volume=new.volume; end"
+};
+
 void SxDatabase::report_error(const QString &msg, const QSqlError &error) const {
     throw std::runtime_error(msg.toStdString() + ": " + error.text().toStdString());
 }
 
 
+/* installs the triggers keeping sxVolumeStats, counting the existing files once when the
+ * table is new */
+void SxDatabase::setupVolumeStats(bool rebuild)
+{
+    QSqlQuery query(getThreadConnection());
+    foreach (const QString &trigger, volumeStatsTriggers) {
+        if (!query.exec(trigger))
+            report_error("Failed to create volume statistics trigger", query.lastError());
+    }
+    if (!rebuild)
+        return;
+    logInfo("counting volume files");
+    if (!query.exec("insert or ignore into sxVolumeStats (volume) select name from sxVolumes"))
+        report_error("Failed to fill table sxVolumeStats", query.lastError());
+    if (!query.exec("update sxVolumeStats set "
+                    "localFiles=(select count(*) from sxFiles where volume=sxVolumeStats.volume and localRevision is not null), "
+                    "remoteFiles=(select count(*) from sxFiles where volume=sxVolumeStats.volume and remoteRevision is not null), "
+                    "localBytes=(select ifnull(sum(remoteSize), 0) from sxFiles where volume=sxVolumeStats.volume and localRevision is not null), "
+                    "remoteBytes=(select ifnull(sum(remoteSize), 0) from sxFiles where volume=sxVolumeStats.volume and remoteRevision is not null)"))
+        report_error("Failed to fill table sxVolumeStats", query.lastError());
+}
+
 void SxDatabase::setupTables()
 {
     QSqlQuery query(getThreadConnection());
+    // takes effect only on a new database, before any table is created
+    query.exec("PRAGMA auto_vacuum=INCREMENTAL");
     query.exec("PRAGMA journal_mode=WAL");
     query.exec("PRAGMA synchronous=NORMAL");
     query.exec("PRAGMA foreign_keys = ON");
@@ -1123,10 +2347,15 @@ void SxDatabase::setupTables()
     query.exec("drop if exists history");
 
     auto sxTables = tables();
-    static const QStringList tableList{"sxVolumes", "sxFiles", "sxHistory", "sxInconsistentFiles", "sxBlocks"};
+    static const QStringList tableList{"sxVolumes", "sxFiles", "sxHistory", "sxInconsistentFiles", "sxBlockFiles", "sxBlocks", "sxUploads", "sxDirJournal", "sxFingerprints", "sxMarkedFiles", "sxSyncCheckpoints", "sxVolumeStats"};
+    bool rebuildVolumeStats = false;
     foreach (QString table, tableList) {
-        if (sxTables.contains(table))
+        if (sxTables.contains(table)) {
+            // an upgrade may rebuild the tables the counters are kept for
+            if ((table == "sxVolumes" || table == "sxFiles") && sxTables.value(table) < createTableQueries.value(table).first)
+                rebuildVolumeStats = true;
             updateSxTable(table, sxTables.value(table));
+        }
         else {
             int version = createTableQueries.value(table).first;
             QString createString = createTableQueries.value(table).second;
@@ -1138,15 +2367,32 @@ void SxDatabase::setupTables()
             }
             if (!query.exec(insertString))
                 report_error("Failed to register table "+table, query.lastError());
+            if (table == "sxVolumeStats")
+                rebuildVolumeStats = true;
         }
     }
+    setupVolumeStats(rebuildVolumeStats);
 
     if (!query.exec("create index if not exists sxBlocks_index on sxBlocks (blockSize, hash)"))
         report_error("Failed to create index sxBlocks_index", query.lastError());
     if (!query.exec("create index if not exists sxFiles_action_index on sxFiles (action)"))
         report_error("Failed to create index sxFiles_action_index", query.lastError());
+    if (!query.exec("create index if not exists sxFiles_size_index on sxFiles (volume, remoteSize)"))
+        report_error("Failed to create index sxFiles_size_index", query.lastError());
+    if (!query.exec("create index if not exists sxHistory_eventDate_index on sxHistory (eventDate)"))
+        report_error("Failed to create index sxHistory_eventDate_index", query.lastError());
     if (!query.exec("create index if not exists sxInconsistentFiles_index on sxInconsistentFiles (volume, path)"))
         report_error("Failed to create index sxFiles_action_index", query.lastError());
+    if (!query.exec("create index if not exists sxMarkedFiles_index on sxMarkedFiles (volume, generation, action)"))
+        report_error("Failed to create index sxMarkedFiles_index", query.lastError());
+    // the queue keeps only the work of checkpointed generations across restarts
+    query.prepare("delete from sxSyncCheckpoints where savedTime<:minTime");
+    query.bindValue(":minTime", QDateTime::currentDateTime().toTime_t() - sSyncCheckpointMaxAge);
+    query.exec();
+    query.exec("delete from sxMarkedFiles where generation not in (select generation from sxSyncCheckpoints)");
+    // new sessions must not reuse a saved generation
+    if (query.exec("select max(generation) from sxMarkedFiles") && query.next())
+        mSessionGeneration = query.value(0).toLongLong();
 
     if (!sOldVolumeName.isEmpty()) {
         query = QSqlQuery(getThreadConnection());
@@ -1251,22 +2497,57 @@ void SxDatabase::updateSxTable(QString table, int fromVersion)
     }
     if (table == "sxBlocks") {
         QString createString = createTableQueries.value(table).second;
-        QString dropString = "drop table sxBlocks";
+        QString dropString = "drop table if exists sxBlocks_old";
         QSqlQuery query(getThreadConnection());
         QString updateString = QString("update sxTables set version=%2 where name=\"%1\"")
                 .arg(table).arg(createTableQueries.value(table).first);
         query.exec("PRAGMA foreign_keys = OFF");
-        if (!query.exec(dropString))
+        query.exec(dropString);
+        if (!query.exec("begin transaction"))
+            goto onSxBlocks;
+        if (!query.exec("alter table sxBlocks rename to sxBlocks_old"))
             goto onSxBlocks;
         if (!query.exec(createString))
             goto onSxBlocks;
+        if (fromVersion == 1) {
+            // version 2 interns the file names and keeps hashes as 20 byte blobs
+            if (!query.exec("insert or ignore into sxBlockFiles (volume, path) select distinct volume, path from sxBlocks_old"))
+                goto onSxBlocks;
+            if (!query.exec("select f.id, b.offset, b.blockSize, b.hash from sxBlocks_old b, sxBlockFiles f "
+                            "where f.volume=b.volume and f.path=b.path"))
+                goto onSxBlocks;
+            QVariantList fileIds, offsets, blockSizes, hashes;
+            while (query.next()) {
+                fileIds.append(query.value(0));
+                offsets.append(query.value(1));
+                blockSizes.append(query.value(2));
+                hashes.append(QByteArray::fromHex(query.value(3).toString().toLatin1()));
+            }
+            query.prepare("insert or ignore into sxBlocks (fileId, offset, blockSize, hash) values (?, ?, ?, ?)");
+            query.addBindValue(fileIds);
+            query.addBindValue(offsets);
+            query.addBindValue(blockSizes);
+            query.addBindValue(hashes);
+            if (!query.execBatch())
+                goto onSxBlocks;
+        }
+        else if (fromVersion == 2) {
+            // version 3 adds the checksums used to skip rehashing unchanged blocks
+            if (!query.exec("insert into sxBlocks (fileId, offset, blockSize, hash) select fileId, offset, blockSize, hash from sxBlocks_old"))
+                goto onSxBlocks;
+        }
+        if (!query.exec("drop table sxBlocks_old"))
+            goto onSxBlocks;
         if (!query.exec(updateString))
             goto onSxBlocks;
+        if (!query.exec("commit transaction"))
+            goto onSxBlocks;
         query.exec("PRAGMA foreign_keys = ON");
         return;
         onSxBlocks:
         logWarning(query.lastError().text());
-        throw std::runtime_error("Altering table sxFiles failed");
+        query.exec("rollback transaction");
+        throw std::runtime_error("Altering table sxBlocks failed");
     }
     if (table == "sxHistory") {
         QString createString = createTableQueries.value(table).second;
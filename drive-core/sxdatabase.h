@@ -33,13 +33,22 @@
 #include <QFile>
 #include <QObject>
 #include <QSqlDatabase>
+#include <QAtomicInt>
+#include <QHash>
 #include <QMutex>
 #include <QSet>
+#include <QVector>
 #include "sxvolume.h"
 #include "sxfileentry.h"
 #include "sxvolumeentry.h"
+#include "sxuploadstate.h"
+#include "sxdatabasewriter.h"
+#include "sxfileindex.h"
 #include <functional>
 
+struct SxLocalFile;
+struct SxFingerprint;
+
 #ifdef Q_OS_WIN
 using uint32_t = uint;
 #endif
@@ -56,6 +65,52 @@ public:
         UPLOAD = 4
     };
 
+    struct HistoryEntry {
+        qint64 rowId;
+        QString path;
+        uint32_t eventDate;
+        ACTION action;
+    };
+
+    /* walks the files marked for an action in a saved update session in pages,
+     * so the whole list is never held at once */
+    class MarkedFilesCursor {
+    public:
+        MarkedFilesCursor(const QString &volume, qint64 generation, ACTION action, int pageSize, qint64 afterRowId = 0, bool unsettledOnly = false);
+        ACTION action() const;
+        qint64 lastRowId() const;
+        // false once every marked file was returned
+        bool next(QList<QString> &page);
+    private:
+        QString mVolume;
+        qint64 mGeneration;
+        ACTION mAction;
+        int mPageSize;
+        qint64 mLastRowId;
+        bool mUnsettledOnly;
+        bool mFinished;
+    };
+
+    /* how far the queue got through the files saved by saveMarkedFiles, with the listing
+     * they were marked against; kept across restarts until the generation is discarded */
+    struct SyncCheckpoint {
+        qint64 generation;
+        ACTION action;
+        qint64 afterRowId;
+        QString etag;
+        QByteArray listingDigest;
+        int remoteCount;
+    };
+
+    /* counters kept up to date by triggers on sxFiles; local files are the ones
+     * synchronised to the local folder, their bytes are counted at the remote size */
+    struct VolumeStats {
+        qint64 localFiles;
+        qint64 remoteFiles;
+        qint64 localBytes;
+        qint64 remoteBytes;
+    };
+
     SxDatabase(const SxDatabase&) = delete;
     SxDatabase& operator=(const SxDatabase&) = delete;
 
@@ -64,40 +119,72 @@ public:
 
     bool updateVolumes(const QList<const SxVolume*> &list, QHash<QString, QString> &modifiedNames);
     bool getVolumeList(QList<SxVolumeEntry> &volumeList) const;
-    bool startUpdatingFiles(std::function<bool()> abortedCB);
+    bool startUpdatingFiles(const QString &volume, std::function<bool()> abortedCB);
     bool endUpdatingFiles();
     bool updateRemoteFiles(const QString &volume, const QList<SxFileEntry*> &list);
+    bool beginRemoteFiles(const QString &volume);
+    bool addRemoteFiles(const QString &volume, const QList<SxFileEntry*> &list);
+    bool finishRemoteFiles(const QString &volume);
     bool updateLocalFiles(const QString &volume, const QList<QString> &list, const QDir &volumeRootDir);
+    bool updateLocalFiles(const QString &volume, const QVector<SxLocalFile> &files, bool removeMissing = false);
     bool updateLocalDirs(const QString &volume, const QList<QString> &list, const QDir &volumeRootDir);
     bool markVolumeFilesToRemove(const QString& volume, bool removeRemote, bool onlySkipped);
     bool markLocalDirFilesToRemove(const QString& volume, const QString& dir, bool onlyExisting=false);
+    bool markChangedDirsFilesToRemove(const QString& volume, const QStringList &changedDirs, const QStringList &removedDirs);
+    bool getDirJournal(const QString &volume, QHash<QString, qint64> &dirs);
+    bool saveDirJournal(const QString &volume, const QHash<QString, qint64> &dirs);
     bool remoteFileExists(const QString& volume, const QString& file);
     bool dropFileEntry(const QString& volume, const QString& file);
+    bool moveFileEntries(const QString& volume, const QString& source, const QString& destination, const QList<SxFileEntry*> &movedFiles);
     QList<QString> getMarkedFiles(const QString& volume, ACTION action) const ;
+    bool getMarkedFiles(const QString& volume, ACTION action, qint64 generation, qint64 &afterRowId, int limit, QList<QString> &page, bool unsettledOnly = false) const;
+    qint64 saveMarkedFiles();
+    void discardMarkedFiles(qint64 generation);
+    bool saveSyncCheckpoint(const QString &volume, const SyncCheckpoint &checkpoint);
+    bool updateSyncCheckpoint(qint64 generation, ACTION action, qint64 afterRowId);
+    bool getSyncCheckpoints(const QString &volume, QList<SyncCheckpoint> &checkpoints) const;
     bool getLocalFileMtime(const QString &volume, const QString &path, uint32_t &mtime) const;
     bool isLocalDir(const QString& volume, const QString& path);
     void onFileUploaded(const QString &volume, const SxFileEntry &fileEntry, bool _registerEvent);
     void onFileUploaded(const QString &volume, const QString &path, QString rev, quint32 mTime);
     void onFileDownloaded(const QString &volume, const SxFileEntry &fileEntry);
+    void onFilesDownloaded(const QString &volume, const QList<SxFileEntry> &fileEntries);
     void onRemoteFileRemoved(const QString &volume, const QString &file);
     void onLocalFileRemoved(const QString &volume, const QString &file);
-    bool getHistoryRowIds(QList<qint64> &list) const;
-    bool getHistoryEntry(qint64 rowId, QString &path, uint32_t &eventDate, ACTION &eventType) const;
+    bool getHistoryEntries(QList<HistoryEntry> &list, qint64 beforeRowId = -1, int limit = -1) const;
+    bool getNewHistoryEntries(QList<HistoryEntry> &list, qint64 afterRowId, int limit = -1) const;
     qint64 getRemoteFileSize(const QString& volume, const QString &path);
     QString getRemoteFileRevision(const QString& volume, const QString &path);
     bool removeVolumeFiles(const QString &volume);
     bool removeVolumeHistory(const QString &volume);
     QList<QPair<QString, QString> > getRecentHistory(bool shareHistory, int limit) const;
+    bool getVolumesActivity(QHash<QString, qint64> &lastEvents) const;
     void updateFileBlocks(const QString &volume, const SxFileEntry &fileEntry);
     void removeFileBlocks(const QString &volume, const QString& path);
     bool findBlock(const QString &hash, int blockSize, QList<std::tuple<QString, QString, qint64>>& result);
+    bool findBlocks(const QStringList &hashes, int blockSize, QHash<QString, QList<std::tuple<QString, QString, qint64>>>& result);
     bool findIdenticalFiles(const QString &volume, qint64 remoteFileSize, int blockSize, const QStringList& blocks, QList<QPair<QString, quint32>> &result);
+    bool findCopyCandidates(const QString &volume, const QString &path, qint64 fileSize, int limit, QList<std::tuple<QString, quint32, int, QStringList>> &result);
+    bool getKnownBlocks(const QString &volume, const QString &path, int blockSize, QVector<QPair<quint64, QString>> &blocks);
     void addSuppression(const QString &volume, const QString &path);
     void removeSuppression(const QString &volume, const QString &path);
     bool getFilesCount(const QString& volume, bool localFiles, quint32 &count);
+    bool getVolumeStats(const QString &volume, VolumeStats &stats);
     bool testHistoryRevision(const QString &volume, const QString &file, const QString &revision, int &count);
     bool updateInconsistentFile(const QString &volume, const QString &file, const QStringList &revisions);
     bool getInconsistentFile(const QString &volume, const QString &file, QStringList &revisions);
+    bool getUploadState(const QString &volume, const QString &path, SxUploadState &state);
+    void updateUploadState(const QString &volume, const QString &path, const SxUploadState &state);
+    void removeUploadState(const QString &volume, const QString &path);
+    bool getFingerprint(const QString &volume, const QString &path, SxFingerprint &fingerprint);
+    void updateFingerprint(const QString &volume, const QString &path, const SxFingerprint &fingerprint);
+    bool acceptUnchangedFile(const QString &volume, const QString &path, quint32 mTime);
+    bool exportSyncState(const QString &volume, const QString &fileName);
+    bool importSyncState(const QString &volume, const QString &fileName, const QString &volumeRootDir, int &imported, int &skipped);
+    void flushWrites();
+    /* passive WAL checkpoint, query planner statistics and reclaiming up to
+     * vacuumPages free pages; true while free pages are left */
+    bool runMaintenance(int vacuumPages);
 
 signals:
     void sig_historyChanged(qint64 rowId, qint64 removeId);
@@ -105,17 +192,39 @@ signals:
     void sig_possibleInconsistencyDetected(const QString &volume, const QString &file);
 
 private:
+    static QSqlDatabase openConnection(const QString &prefix, bool readOnly);
     static QSqlDatabase getThreadConnection();
+    static QSqlDatabase getReadConnection();
     void registerEvent(const QString& volume, const QString& path, ACTION action, const QString &revision="");
+    void pruneHistory();
+    void commitWrites(const QList<SxDatabaseWriter::Write> &writes);
+    void _onFileUploaded(const QString &volume, const SxFileEntry &fileEntry, bool _registerEvent);
+    void _onFileUploaded(const QString &volume, const QString &path, QString rev, quint32 mTime);
+    void _onFileDownloaded(const QString &volume, const SxFileEntry &fileEntry);
+    void _indexDownloadedFile(const QString &volume, const SxFileEntry &fileEntry);
+    void _onFileRemoved(const QString &volume, const QString &file, ACTION action);
+    void _loadFileIndex(const QString &volume);
     static const int sShowHistoryLimit = 1000;
+    static const int sMarkedFilesPage = 10000;
     static const int sHistoryLimit = 100000;
+    static const int sHistoryPruneChunk = 1000;
+    static const int sAutoVacuumIncremental = 2;
+    // rebuild a database without incremental vacuum once a quarter of it is free
+    static const int sVacuumFreeRatio = 4;
+    // saved work older than this is reconciled from scratch
+    static const qint64 sSyncCheckpointMaxAge = 7*24*60*60;
+    static const int sSyncStateVersion = 1;
     SxDatabase();
     void setupTables();
+    void setupVolumeStats(bool rebuild);
     QHash<QString, int> tables();
-    static QHash<QThread*, QString> sConnections;
+    static QMultiHash<QThread*, QString> sConnections;
+    static QMutex sConnectionsMutex;
     QDateTime mStartTime;
     void updateSxTable(QString table, int fromVersion);
     std::function<bool()> mAbortedCB;
+    QString mSessionVolume;
+    qint64 mSessionGeneration;
     QSet<QString> mSuppressedFiles;
 
 #ifdef Q_OS_WIN
@@ -125,6 +234,9 @@ private:
 #endif
 
     mutable QMutex mMutex;
+    SxDatabaseWriter *mWriter;
+    SxFileIndex mFileIndex;
+    QAtomicInt mHistoryCount;
     static QString sOldVolumeName;
 };
 
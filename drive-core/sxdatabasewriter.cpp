@@ -0,0 +1,107 @@
+/*
+ *  Copyright (C) 2012-2016 Skylable Ltd. <info-copyright@skylable.com>
+ *
+ *  This program is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public License
+ *  as published by the Free Software Foundation; either version 2
+ *  of the License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA.
+ *
+ *  Special exception for linking this software with OpenSSL:
+ *
+ *  In addition, as a special exception, Skylable Ltd. gives permission to
+ *  link the code of this program with the OpenSSL library and distribute
+ *  linked combinations including the two. You must obey the GNU General
+ *  Public License in all respects for all of the code used other than
+ *  OpenSSL. You may extend this exception to your version of the program,
+ *  but you are not obligated to do so. If you do not wish to do so, delete
+ *  this exception statement from your version.
+ */
+
+#include "sxdatabasewriter.h"
+
+SxDatabaseWriter::SxDatabaseWriter(std::function<void(const QList<Write>&)> commit) : QThread()
+{
+    mCommit = commit;
+    mEnqueuedCount = 0;
+    mCommittedCount = 0;
+    mFlushRequested = false;
+    mStopped = false;
+}
+
+SxDatabaseWriter::~SxDatabaseWriter()
+{
+    stop();
+}
+
+void SxDatabaseWriter::enqueue(Write write)
+{
+    QMutexLocker locker(&mMutex);
+    if (mStopped) {
+        locker.unlock();
+        mCommit({write});
+        return;
+    }
+    mPending.append(write);
+    ++mEnqueuedCount;
+    if (mPending.count() == 1 || mPending.count() >= sMaxGroupSize)
+        mQueued.wakeAll();
+}
+
+void SxDatabaseWriter::flush()
+{
+    if (QThread::currentThread() == this)
+        return;
+    QMutexLocker locker(&mMutex);
+    const quint64 target = mEnqueuedCount;
+    while (mCommittedCount < target && isRunning()) {
+        mFlushRequested = true;
+        mQueued.wakeAll();
+        mCommitted.wait(&mMutex);
+    }
+}
+
+void SxDatabaseWriter::stop()
+{
+    {
+        QMutexLocker locker(&mMutex);
+        if (mStopped)
+            return;
+        mStopped = true;
+        mQueued.wakeAll();
+    }
+    wait();
+    QMutexLocker locker(&mMutex);
+    mCommitted.wakeAll();
+}
+
+void SxDatabaseWriter::run()
+{
+    QMutexLocker locker(&mMutex);
+    forever {
+        while (mPending.isEmpty() && !mStopped)
+            mQueued.wait(&mMutex);
+        if (mPending.isEmpty())
+            break;
+        // give the following mutations a moment to join the same transaction
+        if (!mStopped && !mFlushRequested && mPending.count() < sMaxGroupSize)
+            mQueued.wait(&mMutex, sCommitDelay);
+        QList<Write> writes = mPending;
+        mPending.clear();
+        mFlushRequested = false;
+        const quint64 count = mEnqueuedCount;
+        locker.unlock();
+        mCommit(writes);
+        locker.relock();
+        mCommittedCount = count;
+        mCommitted.wakeAll();
+    }
+}
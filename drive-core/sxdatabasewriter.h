@@ -0,0 +1,67 @@
+/*
+ *  Copyright (C) 2012-2016 Skylable Ltd. <info-copyright@skylable.com>
+ *
+ *  This program is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public License
+ *  as published by the Free Software Foundation; either version 2
+ *  of the License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA.
+ *
+ *  Special exception for linking this software with OpenSSL:
+ *
+ *  In addition, as a special exception, Skylable Ltd. gives permission to
+ *  link the code of this program with the OpenSSL library and distribute
+ *  linked combinations including the two. You must obey the GNU General
+ *  Public License in all respects for all of the code used other than
+ *  OpenSSL. You may extend this exception to your version of the program,
+ *  but you are not obligated to do so. If you do not wish to do so, delete
+ *  this exception statement from your version.
+ */
+
+#ifndef SXDATABASEWRITER_H
+#define SXDATABASEWRITER_H
+
+#include <QList>
+#include <QMutex>
+#include <QThread>
+#include <QWaitCondition>
+#include <functional>
+
+/* Runs database mutations on a dedicated thread and commits them in groups,
+ * so the sync thread does not wait for a transaction per finished transfer */
+class SxDatabaseWriter : public QThread
+{
+public:
+    typedef std::function<void()> Write;
+    explicit SxDatabaseWriter(std::function<void(const QList<Write>&)> commit);
+    ~SxDatabaseWriter();
+    void enqueue(Write write);
+    void flush();
+    void stop();
+
+protected:
+    void run() override;
+
+private:
+    std::function<void(const QList<Write>&)> mCommit;
+    QMutex mMutex;
+    QWaitCondition mQueued;
+    QWaitCondition mCommitted;
+    QList<Write> mPending;
+    quint64 mEnqueuedCount;
+    quint64 mCommittedCount;
+    bool mFlushRequested;
+    bool mStopped;
+    static const int sCommitDelay = 20;
+    static const int sMaxGroupSize = 256;
+};
+
+#endif // SXDATABASEWRITER_H
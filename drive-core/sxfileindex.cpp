@@ -0,0 +1,131 @@
+/*
+ *  Copyright (C) 2012-2016 Skylable Ltd. <info-copyright@skylable.com>
+ *
+ *  This program is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public License
+ *  as published by the Free Software Foundation; either version 2
+ *  of the License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA.
+ *
+ *  Special exception for linking this software with OpenSSL:
+ *
+ *  In addition, as a special exception, Skylable Ltd. gives permission to
+ *  link the code of this program with the OpenSSL library and distribute
+ *  linked combinations including the two. You must obey the GNU General
+ *  Public License in all respects for all of the code used other than
+ *  OpenSSL. You may extend this exception to your version of the program,
+ *  but you are not obligated to do so. If you do not wish to do so, delete
+ *  this exception statement from your version.
+ */
+
+#include "sxfileindex.h"
+
+SxFileIndex::SxFileIndex()
+{
+}
+
+void SxFileIndex::reset(const QString &volume, const QHash<SxPathKey, Entry> &entries)
+{
+    QWriteLocker locker(&mLock);
+    if (volume.isEmpty()) {
+        mEntries.clear();
+        mDirFiles.clear();
+    }
+    else
+        _removeVolume(SxPathTable::instance().volumeId(volume));
+    for (auto it = entries.constBegin(); it != entries.constEnd(); ++it) {
+        if (!mEntries.contains(it.key()))
+            _addToDirs(it.key(), 1);
+        mEntries.insert(it.key(), it.value());
+    }
+}
+
+void SxFileIndex::clearVolume(const QString &volume)
+{
+    QWriteLocker locker(&mLock);
+    _removeVolume(SxPathTable::instance().volumeId(volume));
+}
+
+void SxFileIndex::insert(const QString &volume, const QString &path, const Entry &entry)
+{
+    SxPathKey key = SxPathTable::instance().intern(volume, path);
+    QWriteLocker locker(&mLock);
+    if (!mEntries.contains(key))
+        _addToDirs(key, 1);
+    mEntries.insert(key, entry);
+}
+
+void SxFileIndex::remove(const QString &volume, const QString &path)
+{
+    SxPathKey key = SxPathTable::instance().find(volume, path);
+    if (key.isNull())
+        return;
+    QWriteLocker locker(&mLock);
+    if (mEntries.remove(key))
+        _addToDirs(key, -1);
+}
+
+bool SxFileIndex::find(const QString &volume, const QString &path, Entry &entry) const
+{
+    SxPathKey key = SxPathTable::instance().find(volume, path);
+    if (key.isNull())
+        return false;
+    QReadLocker locker(&mLock);
+    auto it = mEntries.constFind(key);
+    if (it == mEntries.constEnd())
+        return false;
+    entry = it.value();
+    return true;
+}
+
+bool SxFileIndex::hasFilesBelow(const QString &volume, const QString &dir) const
+{
+    SxPathKey key = SxPathTable::instance().find(volume, dir.endsWith("/") ? dir.left(dir.length()-1) : dir);
+    if (key.isNull())
+        return false;
+    QReadLocker locker(&mLock);
+    return mDirFiles.value(key, 0) > 0;
+}
+
+int SxFileIndex::count() const
+{
+    QReadLocker locker(&mLock);
+    return mEntries.count();
+}
+
+void SxFileIndex::_addToDirs(const SxPathKey &key, int delta)
+{
+    SxPathTable &table = SxPathTable::instance();
+    for (SxPathKey dir = table.parent(key); !dir.isNull(); dir = table.parent(dir)) {
+        int &files = mDirFiles[dir];
+        files += delta;
+        if (files <= 0)
+            mDirFiles.remove(dir);
+    }
+}
+
+void SxFileIndex::_removeVolume(quint32 volume)
+{
+    if (volume == 0)
+        return;
+    for (auto it = mEntries.begin(); it != mEntries.end();) {
+        if (it.key().volume == volume)
+            it = mEntries.erase(it);
+        else
+            ++it;
+    }
+    for (auto it = mDirFiles.begin(); it != mDirFiles.end();) {
+        if (it.key().volume == volume)
+            it = mDirFiles.erase(it);
+        else
+            ++it;
+    }
+}
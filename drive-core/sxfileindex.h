@@ -0,0 +1,76 @@
+/*
+ *  Copyright (C) 2012-2016 Skylable Ltd. <info-copyright@skylable.com>
+ *
+ *  This program is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public License
+ *  as published by the Free Software Foundation; either version 2
+ *  of the License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA.
+ *
+ *  Special exception for linking this software with OpenSSL:
+ *
+ *  In addition, as a special exception, Skylable Ltd. gives permission to
+ *  link the code of this program with the OpenSSL library and distribute
+ *  linked combinations including the two. You must obey the GNU General
+ *  Public License in all respects for all of the code used other than
+ *  OpenSSL. You may extend this exception to your version of the program,
+ *  but you are not obligated to do so. If you do not wish to do so, delete
+ *  this exception statement from your version.
+ */
+
+#ifndef SXFILEINDEX_H
+#define SXFILEINDEX_H
+
+#include <QByteArray>
+#include <QHash>
+#include <QReadWriteLock>
+#include <QString>
+#include "sxpathtable.h"
+
+/*
+ * In-memory copy of the sxFiles columns the queue and the filesystem watcher
+ * look up one file at a time. SxDatabase keeps it in step with its writes:
+ * single file changes are applied when they are queued for the writer,
+ * bulk updates reload the whole volume.
+ */
+class SxFileIndex
+{
+public:
+    struct Entry {
+        Entry() : remoteSize(0), mTime(0), remote(false), local(false) {}
+        QByteArray remoteRevision;
+        qint64 remoteSize;
+        quint32 mTime;
+        bool remote;
+        bool local;
+    };
+    SxFileIndex();
+    SxFileIndex(const SxFileIndex &) = delete;
+    SxFileIndex &operator= (const SxFileIndex &) = delete;
+    // replaces the entries of volume, or of every volume when it is empty
+    void reset(const QString &volume, const QHash<SxPathKey, Entry> &entries);
+    void clearVolume(const QString &volume);
+    void insert(const QString &volume, const QString &path, const Entry &entry);
+    void remove(const QString &volume, const QString &path);
+    bool find(const QString &volume, const QString &path, Entry &entry) const;
+    bool hasFilesBelow(const QString &volume, const QString &dir) const;
+    int count() const;
+
+private:
+    void _addToDirs(const SxPathKey &key, int delta);
+    void _removeVolume(quint32 volume);
+    mutable QReadWriteLock mLock;
+    QHash<SxPathKey, Entry> mEntries;
+    // number of files below every directory holding any
+    QHash<SxPathKey, int> mDirFiles;
+};
+
+#endif // SXFILEINDEX_H
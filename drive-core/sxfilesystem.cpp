@@ -30,133 +30,277 @@
 #include "sxfilesystem.h"
 #include "sxlog.h"
 #include <QTimer>
+#include <QDateTime>
+#include <QDirIterator>
+#include <QWaitCondition>
+#include <QtConcurrent>
+#include <QCryptographicHash>
+
+#ifndef Q_OS_WIN
+    #include <sys/stat.h>
+#endif
+
+#if defined Q_OS_LINUX && defined FAN_REPORT_DFID_NAME
+    #include <fcntl.h>
+    #include <sys/statfs.h>
+#endif
 
 #ifdef Q_OS_WIN
 
 #include <Windows.h>
 
+// several reads stay queued per watched root, so changes keep being collected while one is processed
+static const int sChangeRequests = 4;
+// the largest buffer ReadDirectoryChangesW accepts on network shares
+static const DWORD sChangeBufferSize = 64*1024;
+
 class WatchedDir{
 public:
-    WatchedDir(HANDLE dir, SxFilesystem *filesystemWatcher);
+    struct Request {
+        OVERLAPPED overlapped;
+        WatchedDir *dir;
+        DWORD *buffer;
+    };
+    WatchedDir(HANDLE dir, const QString &path);
     ~WatchedDir();
-    bool watch();
+    bool watch(Request *request);
     void unwatch();
     HANDLE mDir;
-    OVERLAPPED mOverlaped;
-    const int mBufferSize = 16384;
-    char *mBuffer;
-    unsigned long mDwBytes;
-    SxFilesystem *mFilesystemWatcher;
-    bool destroy;
+    const QString mPath;
+    Request mRequests[sChangeRequests];
+    QAtomicInt mPending;
+    QAtomicInt mClosing;
 };
 
-void notifyFileChange(WatchedDir* dir, const QString &path ) {
-    SxFilesystem *watcher = dir->mFilesystemWatcher;
-    QString rootDir = watcher->mDirHandlers.value(dir, "");
-    if (rootDir.isEmpty()) {
-        logError("logic error");
-        return;
-    }
-    QString volume = watcher->mWatchedDirectories.key(rootDir, "");
-    if (volume.isEmpty()) {
-        logError("logic error");
-        return;
+/* completion port shared by all watched roots, the reads are completed and
+ * issued again on its own thread, the parsed changes are queued to SxFilesystem */
+class WinChangesPort : public QThread {
+public:
+    explicit WinChangesPort(SxFilesystem *filesystem);
+    ~WinChangesPort();
+    bool add(WatchedDir *dir);
+    void stop();
+protected:
+    void run() override;
+private:
+    void _completed(WatchedDir::Request *request, DWORD bytes, DWORD error);
+    void _release(WatchedDir *dir);
+    HANDLE mPort;
+    SxFilesystem *mFilesystem;
+    QAtomicInt mDirs;
+    QAtomicInt mStopping;
+};
+
+WatchedDir::WatchedDir(HANDLE dir, const QString &path) : mPath(path) {
+    mDir = dir;
+    for (int i=0; i<sChangeRequests; i++) {
+        ZeroMemory(&mRequests[i].overlapped, sizeof(OVERLAPPED));
+        mRequests[i].dir = this;
+        // DWORD elements keep the FILE_NOTIFY_INFORMATION records aligned
+        mRequests[i].buffer = new DWORD[sChangeBufferSize/sizeof(DWORD)];
     }
+}
 
-    uint32_t mtime;
-    QFileInfo fileInfo(rootDir+"/"+path);
-    if (fileInfo.isFile() && SxDatabase::instance().getLocalFileMtime(volume, "/"+path, mtime)) {
-        if (mtime == fileInfo.lastModified().toTime_t())
-            return;
+WatchedDir::~WatchedDir() {
+    if (mDir != INVALID_HANDLE_VALUE)
+        CloseHandle(mDir);
+    for (int i=0; i<sChangeRequests; i++) {
+        delete [] mRequests[i].buffer;
     }
+}
+
+bool WatchedDir::watch(Request *request) {
+    ZeroMemory(&request->overlapped, sizeof(OVERLAPPED));
+    mPending.ref();
+    if (ReadDirectoryChangesW(
+                mDir,
+                request->buffer,
+                sChangeBufferSize,
+                TRUE,
+                FILE_NOTIFY_CHANGE_LAST_WRITE | FILE_NOTIFY_CHANGE_CREATION | FILE_NOTIFY_CHANGE_FILE_NAME | FILE_NOTIFY_CHANGE_DIR_NAME,
+                NULL,
+                &request->overlapped,
+                NULL))
+        return true;
+    mPending.deref();
+    return false;
+}
 
-    watcher->mNotifyFiles.insert(volume+"/"+path);
+void WatchedDir::unwatch()
+{
+    // the queued reads complete as aborted, the port thread deletes the object after the last one
+    mClosing.store(1);
+    CloseHandle(mDir);
+    mDir = INVALID_HANDLE_VALUE;
+}
 
-    if (watcher->mNotifyTimer == nullptr) {
-        watcher->mNotifyTimer = new QTimer();
-        watcher->mNotifyTimer->setSingleShot(true);
-        QObject::connect(watcher->mNotifyTimer, &QTimer::timeout, watcher, &SxFilesystem::inotifyProcess);
-    }
-    watcher->mNotifyTimer->start(watcher->sSignalDelay*1000);
+WinChangesPort::WinChangesPort(SxFilesystem *filesystem)
+{
+    mFilesystem = filesystem;
+    mPort = CreateIoCompletionPort(INVALID_HANDLE_VALUE, NULL, 0, 1);
+    if (mPort == NULL)
+        logError(QString("CreateIoCompletionPort failed: %1").arg(GetLastError()));
 }
 
-QString getWatchedDirPath(WatchedDir* dir) {
-    SxFilesystem *watcher = dir->mFilesystemWatcher;
-    return watcher->mDirHandlers.value(dir);
+WinChangesPort::~WinChangesPort()
+{
+    if (mPort != NULL)
+        CloseHandle(mPort);
 }
 
-VOID CALLBACK NotificationCompletion(DWORD dwErrorCode, DWORD dwNumberOfBytesTransfered, LPOVERLAPPED lpOverlapped) {
-    Q_UNUSED(dwErrorCode);
-    Q_UNUSED(dwNumberOfBytesTransfered);
-    WatchedDir* dir = (WatchedDir*) lpOverlapped->hEvent;
-    if (dir->destroy) {
-        delete dir;
-        return;
+bool WinChangesPort::add(WatchedDir *dir)
+{
+    if (mPort == NULL || CreateIoCompletionPort(dir->mDir, mPort, 0, 0) == NULL)
+        return false;
+    if (!dir->watch(&dir->mRequests[0]))
+        return false;
+    mDirs.ref();
+    for (int i=1; i<sChangeRequests; i++) {
+        if (!dir->watch(&dir->mRequests[i]))
+            logWarning(QString("ReadDirectoryChangesW failed for %1").arg(dir->mPath));
     }
-    DWORD index = 0;
-    FILE_NOTIFY_INFORMATION *info = (FILE_NOTIFY_INFORMATION*) &dir->mBuffer[index];
+    return true;
+}
+
+void WinChangesPort::stop()
+{
+    mStopping.store(1);
+    if (mPort != NULL)
+        PostQueuedCompletionStatus(mPort, 0, 0, NULL);
+}
 
-    while (true) {
-        QString path = QDir::fromNativeSeparators(QString::fromUtf16((const ushort*)info->FileName, info->FileNameLength/2));
-        if (info->Action == FILE_ACTION_MODIFIED) {
-            QFileInfo fileInfo(getWatchedDirPath(dir)+"/"+path);
-            if (fileInfo.isFile() && !path.split("/").last().startsWith("._sdrvtmp")) {
-                notifyFileChange(dir, path);
+void WinChangesPort::run()
+{
+    if (mPort == NULL)
+        return;
+    forever {
+        DWORD bytes = 0;
+        ULONG_PTR key = 0;
+        OVERLAPPED *overlapped = nullptr;
+        BOOL ok = GetQueuedCompletionStatus(mPort, &bytes, &key, &overlapped, INFINITE);
+        if (overlapped == nullptr) {
+            if (!ok) {
+                logError(QString("GetQueuedCompletionStatus failed: %1").arg(GetLastError()));
+                return;
             }
         }
-        else {
-            if (!path.split("/").last().startsWith("._sdrvtmp"))
-                notifyFileChange(dir, path);
-        }
-        if (info->NextEntryOffset == 0)
-            break;
-        else {
-            index += info->NextEntryOffset;
-            info = (FILE_NOTIFY_INFORMATION*) &dir->mBuffer[index];
-        }
+        else
+            _completed(reinterpret_cast<WatchedDir::Request*>(overlapped), bytes, ok ? ERROR_SUCCESS : GetLastError());
+        if (mStopping.load() && mDirs.load() == 0)
+            return;
     }
+}
 
-    if (!dir->watch()) {
-        logError("ReadDirectoryChangesW failed");
+void WinChangesPort::_release(WatchedDir *dir)
+{
+    if (!dir->mPending.deref() && dir->mClosing.load()) {
+        delete dir;
+        mDirs.deref();
     }
 }
 
-WatchedDir::WatchedDir(HANDLE dir, SxFilesystem *filesystemWatcher) {
-    mDir = dir;
-    mBuffer = new char[mBufferSize];
-    mFilesystemWatcher = filesystemWatcher;
-    ZeroMemory(&mOverlaped, sizeof(mOverlaped));
-    mOverlaped.hEvent = this;
-    destroy = false;
+void WinChangesPort::_completed(WatchedDir::Request *request, DWORD bytes, DWORD error)
+{
+    WatchedDir *dir = request->dir;
+    if (dir->mClosing.load()) {
+        _release(dir);
+        return;
+    }
+    // nothing returned means the kernel buffer overflowed, the changes it would have held are lost
+    bool overflow = error != ERROR_SUCCESS || bytes == 0;
+    if (error != ERROR_SUCCESS && error != ERROR_NOTIFY_ENUM_DIR)
+        logWarning(QString("ReadDirectoryChangesW completed with error %1 for %2").arg(error).arg(dir->mPath));
+    QStringList paths;
+    QByteArray actions;
+    if (!overflow) {
+        const char *buffer = reinterpret_cast<const char*>(request->buffer);
+        DWORD offset = 0;
+        forever {
+            auto info = reinterpret_cast<const FILE_NOTIFY_INFORMATION*>(buffer+offset);
+            paths.append(QDir::fromNativeSeparators(QString::fromUtf16(reinterpret_cast<const ushort*>(info->FileName), info->FileNameLength/2)));
+            actions.append(static_cast<char>(info->Action));
+            if (info->NextEntryOffset == 0)
+                break;
+            offset += info->NextEntryOffset;
+        }
+    }
+    // the buffer is copied out, so the read is queued again before the changes are delivered
+    QString rootDir = dir->mPath;
+    bool watching = dir->watch(request);
+    _release(dir);
+    if (!watching) {
+        logError("ReadDirectoryChangesW failed");
+        overflow = true;
+    }
+    QMetaObject::invokeMethod(mFilesystem, "winChangesReceived", Qt::QueuedConnection,
+                              Q_ARG(QString, rootDir), Q_ARG(QStringList, paths), Q_ARG(QByteArray, actions), Q_ARG(bool, overflow));
 }
+#endif
 
-WatchedDir::~WatchedDir() {
-    delete [] mBuffer;
+#if defined Q_OS_LINUX && defined FAN_REPORT_DFID_NAME
+static QByteArray fanotifyKey(const void *fsid, size_t fsidSize, const struct file_handle *handle)
+{
+    QByteArray key(static_cast<const char*>(fsid), static_cast<int>(fsidSize));
+    key.append(reinterpret_cast<const char*>(&handle->handle_type), sizeof(handle->handle_type));
+    key.append(reinterpret_cast<const char*>(handle->f_handle), static_cast<int>(handle->handle_bytes));
+    return key;
 }
 
-bool WatchedDir::watch() {
-    return ReadDirectoryChangesW(
-                mDir,
-                mBuffer,
-                mBufferSize,
-                TRUE,
-                FILE_NOTIFY_CHANGE_LAST_WRITE | FILE_NOTIFY_CHANGE_CREATION | FILE_NOTIFY_CHANGE_FILE_NAME | FILE_NOTIFY_CHANGE_DIR_NAME,
-                &mDwBytes,
-                &mOverlaped,
-                &NotificationCompletion);
+static QByteArray fanotifyDirKey(const QString &path)
+{
+    QByteArray nativePath = QFile::encodeName(path);
+    struct statfs fs;
+    if (statfs(nativePath.constData(), &fs) != 0)
+        return QByteArray();
+    alignas(struct file_handle) char buffer[sizeof(struct file_handle) + MAX_HANDLE_SZ];
+    struct file_handle *handle = reinterpret_cast<struct file_handle*>(buffer);
+    handle->handle_bytes = MAX_HANDLE_SZ;
+    int mountId;
+    if (name_to_handle_at(AT_FDCWD, nativePath.constData(), handle, &mountId, 0) != 0)
+        return QByteArray();
+    return fanotifyKey(&fs.f_fsid, sizeof(fs.f_fsid), handle);
 }
+#endif
 
-void WatchedDir::unwatch()
+#ifdef Q_OS_MAC
+static void fsEventsCallback(ConstFSEventStreamRef stream, void *info, size_t numEvents, void *eventPaths,
+                             const FSEventStreamEventFlags eventFlags[], const FSEventStreamEventId eventIds[])
 {
-    CloseHandle(mDir);
-    destroy = true;
+    Q_UNUSED(stream);
+    Q_UNUSED(eventIds);
+    static const FSEventStreamEventFlags rescanFlags = kFSEventStreamEventFlagMustScanSubDirs | kFSEventStreamEventFlagItemIsDir;
+    static const FSEventStreamEventFlags droppedFlags = kFSEventStreamEventFlagUserDropped | kFSEventStreamEventFlagKernelDropped;
+    char **paths = static_cast<char**>(eventPaths);
+    QStringList changed;
+    bool dropped = false;
+    for (size_t i=0; i<numEvents; i++) {
+        if (eventFlags[i] & droppedFlags) {
+            dropped = true;
+            continue;
+        }
+        QString path = QString::fromUtf8(paths[i]);
+        if (path.endsWith("/"))
+            path.chop(1);
+        // directories are marked with a trailing slash and rescanned as a whole
+        if (eventFlags[i] & rescanFlags)
+            path.append("/");
+        changed.append(path);
+    }
+    QMetaObject::invokeMethod(static_cast<SxFilesystem*>(info), "fsEventsReceived", Qt::QueuedConnection, Q_ARG(QStringList, changed));
+    if (dropped)
+        QMetaObject::invokeMethod(static_cast<SxFilesystem*>(info), "fsEventsDropped", Qt::QueuedConnection);
 }
 #endif
 
 SxFilesystem::SxFilesystem(SxConfig *config) : QObject(0)
 {
+    static auto registerFileChanges = qRegisterMetaType<QList<SxFileChange>>("QList<SxFileChange>");
+    Q_UNUSED(registerFileChanges);
+    mConfig = config;
 #if defined Q_OS_WIN
     mNotifyTimer = nullptr;
+    mChangesPort = new WinChangesPort(this);
+    mChangesPort->start();
 #elif defined Q_OS_LINUX
     mInotifyDesc = inotify_init1(IN_NONBLOCK);
     if (mInotifyDesc == -1) {
@@ -165,26 +309,67 @@ SxFilesystem::SxFilesystem(SxConfig *config) : QObject(0)
     }
     mPollDesc[0].fd = mInotifyDesc;
     mPollDesc[0].events = POLLIN;
+    mPollDesc[1].fd = -1;
+    mPollDesc[1].events = POLLIN;
     mNotifyTimer = nullptr;
+#ifdef FAN_REPORT_DFID_NAME
+    // filesystem wide marks need CAP_SYS_ADMIN, without it every directory gets its own inotify watch
+    mFanotifyDesc = fanotify_init(FAN_CLASS_NOTIF | FAN_REPORT_DFID_NAME | FAN_NONBLOCK | FAN_CLOEXEC, O_RDONLY);
+    if (mFanotifyDesc == -1)
+        logVerbose(QString("fanotify_init failed: %1").arg(strerror(errno)));
+    mPollDesc[1].fd = mFanotifyDesc;
+#endif
+#elif defined Q_OS_MAC
+    mNotifyTimer = nullptr;
+    mEventStream = nullptr;
+    mEventQueue = dispatch_queue_create("sxdrive.fsevents", DISPATCH_QUEUE_SERIAL);
 #else
     connect(&mQtWatcher, &QFileSystemWatcher::directoryChanged, this, &SxFilesystem::directoryChanged);
 #endif
-    foreach (QString volName, config->volumes()) {
-        VolumeConfig volume = config->volume(volName);
+}
+
+void SxFilesystem::startWatching()
+{
+    // adding the watches walks every volume, so it runs on the watcher thread
+#ifdef Q_OS_LINUX
+    if (mInotifyDesc == -1) {
+        emit sig_watching();
+        return;
+    }
+#endif
+    foreach (QString volName, mConfig->volumes()) {
+        VolumeConfig volume = mConfig->volume(volName);
         QString localPath = volume.localPath();
         if (!watchDirectory(volName, localPath)) {
             logWarning(QString("unable to watch directory \"%1\"").arg(localPath));
         }
     }
 #ifdef Q_OS_LINUX
-    if (!mDirsDesc.isEmpty())
+    bool watching = !mDirsDesc.isEmpty();
+#ifdef FAN_REPORT_DFID_NAME
+    watching = watching || !mDirHandles.isEmpty();
+#endif
+    if (watching)
         QTimer::singleShot(0, this, SLOT(inotifyPoll()));
 #endif
+    emit sig_watching();
 }
 
 SxFilesystem::~SxFilesystem()
 {
-#if !defined Q_OS_WIN && !defined Q_OS_LINUX
+#if defined Q_OS_LINUX && defined FAN_REPORT_DFID_NAME
+    if (mFanotifyDesc != -1)
+        close(mFanotifyDesc);
+#endif
+#ifdef Q_OS_MAC
+    if (mEventStream != nullptr) {
+        FSEventStreamStop(mEventStream);
+        FSEventStreamInvalidate(mEventStream);
+        FSEventStreamRelease(mEventStream);
+    }
+    dispatch_release(mEventQueue);
+#endif
+#if !defined Q_OS_WIN && !defined Q_OS_LINUX && !defined Q_OS_MAC
     foreach (QTimer* timer, mTimers) {
         timer->stop();
         timer->deleteLater();
@@ -195,6 +380,11 @@ SxFilesystem::~SxFilesystem()
         dir->unwatch();
     }
     mDirHandlers.clear();
+    mChangesPort->stop();
+    if (mChangesPort->wait(5000))
+        delete mChangesPort;
+    else
+        logWarning("directory watcher thread did not stop");
 #endif
 }
 
@@ -241,7 +431,9 @@ QList<QString> SxFilesystem::getDirectoryContents(QDir &rootDir, bool recursive,
             else if (entryInfo.isFile()) {
                 QString name = entryInfo.fileName().split("/").last();
                 if (name.startsWith("._sdrvtmp")) {
-                    if (removeTempfiles)
+                    // partial downloads are kept for a while so they can be resumed
+                    bool resumable = name.startsWith("._sdrvtmp-") && entryInfo.lastModified().daysTo(QDateTime::currentDateTime()) < sPartialDownloadMaxAge;
+                    if (removeTempfiles && !resumable)
                         entryInfo.dir().remove(name);
                     continue;
                 }
@@ -265,6 +457,238 @@ QList<QString> SxFilesystem::getDirectoryContents(QDir &rootDir, bool recursive,
     return result;
 }
 
+void SxFilesystem::walkDirectory(const QDir &rootDir, bool recursive, const QString &prefix, bool removeTempfiles,
+                                 QVector<SxLocalFile> &files, QHash<QString, qint64> *dirMTimes)
+{
+    logEntry(rootDir.absolutePath());
+    const QString absoluteRootPath = rootDir.absolutePath();
+    const QString pathPrefix = prefix.endsWith("/") ? prefix.left(prefix.length()-1) : prefix;
+    QMutex mutex;
+    QWaitCondition wakeUp;
+    QStringList pending {""};
+    int busy = 0;
+    // directory times are taken before their contents are listed, relative to rootDir with "" for rootDir itself
+    if (dirMTimes != nullptr)
+        dirMTimes->insert("", QFileInfo(absoluteRootPath).lastModified().toMSecsSinceEpoch());
+
+    // the workers share one queue of directories, the listing order is not preserved
+    auto worker = [&]() {
+        QVector<SxLocalFile> found;
+        QHash<QString, qint64> foundDirs;
+        QStringList subdirs;
+        QMutexLocker locker(&mutex);
+        forever {
+            while (pending.isEmpty() && busy > 0)
+                wakeUp.wait(&mutex);
+            if (pending.isEmpty())
+                break;
+            const QString dir = pending.takeFirst();
+            ++busy;
+            locker.unlock();
+
+            static const auto flag = QDir::Dirs | QDir::Files | QDir::NoSymLinks | QDir::Hidden | QDir::NoDotAndDotDot;
+            QDirIterator it(absoluteRootPath+dir, flag);
+            bool empty = true;
+            while (it.hasNext()) {
+                it.next();
+                empty = false;
+                const QFileInfo entryInfo = it.fileInfo();
+                const QString name = entryInfo.fileName();
+                if (entryInfo.isDir()) {
+                    if (recursive) {
+                        subdirs.append(dir+"/"+name);
+                        if (dirMTimes != nullptr)
+                            foundDirs.insert(dir+"/"+name, entryInfo.lastModified().toMSecsSinceEpoch());
+                    }
+                }
+                else if (entryInfo.isFile()) {
+                    if (name.startsWith("._sdrvtmp")) {
+                        // partial downloads are kept for a while so they can be resumed
+                        bool resumable = name.startsWith("._sdrvtmp-") && entryInfo.lastModified().daysTo(QDateTime::currentDateTime()) < sPartialDownloadMaxAge;
+                        if (removeTempfiles && !resumable)
+                            QFile::remove(entryInfo.absoluteFilePath());
+                        continue;
+                    }
+                    found.append(SxLocalFile{pathPrefix+dir+"/"+name, entryInfo.size(), entryInfo.lastModified().toTime_t()});
+                }
+            }
+            if (empty && prefix != "/" && (!prefix.isEmpty() || !dir.isEmpty())) {
+                QFile sxnewdir(absoluteRootPath+dir+"/.sxnewdir");
+                if (sxnewdir.open(QIODevice::WriteOnly)) {
+                    sxnewdir.close();
+                    found.append(SxLocalFile{pathPrefix+dir+"/.sxnewdir", 0, QFileInfo(sxnewdir).lastModified().toTime_t()});
+                }
+            }
+
+            locker.relock();
+            --busy;
+            pending.append(subdirs);
+            subdirs.clear();
+            wakeUp.wakeAll();
+        }
+        files += found;
+        if (dirMTimes != nullptr)
+            dirMTimes->unite(foundDirs);
+    };
+
+    int threads = recursive ? qBound(1, QThread::idealThreadCount(), static_cast<int>(sWalkerThreads)) : 1;
+    QList<QFuture<void>> futures;
+    for (int i=1; i<threads; i++) {
+        futures.append(QtConcurrent::run(worker));
+    }
+    // the calling thread walks too, so a busy thread pool does not stall the scan
+    worker();
+    foreach (auto future, futures) {
+        future.waitForFinished();
+    }
+}
+
+void SxFilesystem::getDirectoryMTimes(QDir &rootDir, QHash<QString, qint64> &dirMTimes)
+{
+    logEntry(rootDir.absolutePath());
+    dirMTimes.clear();
+    dirMTimes.insert("", QFileInfo(rootDir.absolutePath()).lastModified().toMSecsSinceEpoch());
+    QStringList list {""};
+    while (!list.isEmpty()) {
+        QString dir = list.takeFirst();
+        QDir d(rootDir.absolutePath()+dir);
+        static const auto flag = QDir::Dirs | QDir::NoSymLinks | QDir::Hidden | QDir::NoDotAndDotDot;
+        foreach (auto entryInfo, d.entryInfoList(flag)) {
+            QString path = dir+"/"+entryInfo.fileName();
+            dirMTimes.insert(path, entryInfo.lastModified().toMSecsSinceEpoch());
+            list.append(path);
+        }
+    }
+}
+
+bool SxFilesystem::getFingerprint(const QString &path, bool withSample, SxFingerprint &fingerprint)
+{
+    // cTime stays 0 where the change time is unknown, such files always get sampled
+    fingerprint.cTime = 0;
+#ifdef Q_OS_WIN
+    HANDLE handle = CreateFile((LPCWSTR)QDir::toNativeSeparators(path).utf16(), 0,
+                               FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, NULL, OPEN_EXISTING, 0, NULL);
+    if (handle == INVALID_HANDLE_VALUE)
+        return false;
+    BY_HANDLE_FILE_INFORMATION info;
+    bool result = GetFileInformationByHandle(handle, &info);
+    CloseHandle(handle);
+    if (!result)
+        return false;
+    fingerprint.size = (static_cast<qint64>(info.nFileSizeHigh) << 32) | info.nFileSizeLow;
+    fingerprint.inode = (static_cast<quint64>(info.nFileIndexHigh) << 32) | info.nFileIndexLow;
+#else
+    struct stat st;
+    if (stat(QFile::encodeName(path).constData(), &st) != 0 || !S_ISREG(st.st_mode))
+        return false;
+    fingerprint.size = st.st_size;
+    fingerprint.inode = st.st_ino;
+#if defined Q_OS_MAC
+    fingerprint.cTime = static_cast<qint64>(st.st_ctimespec.tv_sec)*1000000000 + st.st_ctimespec.tv_nsec;
+#elif defined Q_OS_LINUX
+    fingerprint.cTime = static_cast<qint64>(st.st_ctim.tv_sec)*1000000000 + st.st_ctim.tv_nsec;
+#endif
+#endif
+    fingerprint.sample.clear();
+    if (!withSample)
+        return true;
+    // evenly spaced chunks, the first and the last one included
+    QFile file(path);
+    if (!file.open(QIODevice::ReadOnly))
+        return false;
+    QCryptographicHash hash(QCryptographicHash::Sha1);
+    qint64 span = qMax<qint64>(0, fingerprint.size - sSampleSize);
+    for (int i=0; i<sSampleCount; i++) {
+        if (!file.seek(span*i/(sSampleCount-1)))
+            return false;
+        QByteArray data = file.read(sSampleSize);
+        if (data.size() != qMin<qint64>(sSampleSize, fingerprint.size))
+            return false;
+        hash.addData(data);
+        if (span == 0)
+            break;
+    }
+    fingerprint.sample = hash.result();
+    return true;
+}
+
+/* the filesystem (st_dev) or the volume serial number the path is stored on */
+bool SxFilesystem::getDeviceId(const QString &path, quint64 &deviceId)
+{
+#ifdef Q_OS_WIN
+    HANDLE handle = CreateFile((LPCWSTR)QDir::toNativeSeparators(path).utf16(), 0,
+                               FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, NULL, OPEN_EXISTING, FILE_FLAG_BACKUP_SEMANTICS, NULL);
+    if (handle == INVALID_HANDLE_VALUE)
+        return false;
+    BY_HANDLE_FILE_INFORMATION info;
+    bool result = GetFileInformationByHandle(handle, &info);
+    CloseHandle(handle);
+    if (!result)
+        return false;
+    deviceId = info.dwVolumeSerialNumber;
+#else
+    struct stat st;
+    if (stat(QFile::encodeName(path).constData(), &st) != 0)
+        return false;
+    deviceId = static_cast<quint64>(st.st_dev);
+#endif
+    return true;
+}
+
+QMutex SxFilesystem::sWriteTokensMutex;
+QHash<QString, SxFilesystem::WriteToken> SxFilesystem::sWriteTokens;
+
+/* called right before tmpFile is renamed to path, the rename keeps both its inode and mtime */
+void SxFilesystem::addWriteToken(const QString &tmpFile, const QString &path)
+{
+    SxFingerprint fingerprint;
+    if (!getFingerprint(tmpFile, false, fingerprint))
+        return;
+    qint64 mTime = QFileInfo(tmpFile).lastModified().toMSecsSinceEpoch();
+    qint64 now = QDateTime::currentMSecsSinceEpoch();
+    QMutexLocker locker(&sWriteTokensMutex);
+    if (sWriteTokens.count() >= sWriteTokensPurge) {
+        for (auto it = sWriteTokens.begin(); it != sWriteTokens.end(); ) {
+            if (it.value().expires < now)
+                it = sWriteTokens.erase(it);
+            else
+                ++it;
+        }
+    }
+    sWriteTokens.insert(QDir::cleanPath(path), {fingerprint.inode, mTime, now + sWriteTokenTtl*1000});
+}
+
+/* a token is kept until it expires, renaming a file into place raises several events;
+ * once the file no longer matches, the user touched it and the token is dropped */
+bool SxFilesystem::isOwnWrite(const QString &path) const
+{
+    if (path.endsWith("/"))
+        return false;
+    QString localPath = path;
+#ifdef Q_OS_WIN
+    // paths are reported as <volume>/<path>
+    int index = path.indexOf('/');
+    localPath = mWatchedDirectories.value(path.left(index)) + path.mid(index);
+#endif
+    localPath = QDir::cleanPath(localPath);
+    WriteToken token;
+    {
+        QMutexLocker locker(&sWriteTokensMutex);
+        auto it = sWriteTokens.constFind(localPath);
+        if (it == sWriteTokens.constEnd())
+            return false;
+        token = it.value();
+    }
+    SxFingerprint fingerprint;
+    bool matches = token.expires >= QDateTime::currentMSecsSinceEpoch() && getFingerprint(localPath, false, fingerprint)
+            && fingerprint.inode == token.inode && QFileInfo(localPath).lastModified().toMSecsSinceEpoch() == token.mTime;
+    if (!matches) {
+        QMutexLocker locker(&sWriteTokensMutex);
+        sWriteTokens.remove(localPath);
+    }
+    return matches;
+}
+
 QList<QString> SxFilesystem::getSubdirectories(QDir &rootDir, const QString &prefix)
 {
     logEntry(rootDir.absolutePath());
@@ -289,8 +713,17 @@ bool SxFilesystem::watchDirectory(const QString &volume, const QString &director
         if (directory.startsWith(dir+"/"))
             return false;
     }
-    if (watchDirRecursively(directory)) {
+    bool watched;
+#if defined Q_OS_LINUX && defined FAN_REPORT_DFID_NAME
+    watched = fanotifyWatch(directory) || watchDirRecursively(directory);
+#else
+    watched = watchDirRecursively(directory);
+#endif
+    if (watched) {
         mWatchedDirectories.insert(volume, directory);
+#ifdef Q_OS_MAC
+        fsEventsRestart();
+#endif
         return true;
     }
     return false;
@@ -304,7 +737,7 @@ bool SxFilesystem::unwatchDirectory(const QString &volume)
 
 void SxFilesystem::directoryChanged(const QString &path)
 {
-#if defined Q_OS_WIN || defined Q_OS_LINUX
+#if defined Q_OS_WIN || defined Q_OS_LINUX || defined Q_OS_MAC
     Q_UNUSED(path);
 #else
     logDebug(path);
@@ -324,7 +757,7 @@ void SxFilesystem::directoryChanged(const QString &path)
 
 void SxFilesystem::scanDirectory(const QString &path)
 {
-#if defined Q_OS_WIN || defined Q_OS_LINUX
+#if defined Q_OS_WIN || defined Q_OS_LINUX || defined Q_OS_MAC
     Q_UNUSED(path);
 #else
     logDebug(path);
@@ -366,7 +799,7 @@ void SxFilesystem::scanDirectory(const QString &path)
     SxDatabase &db = SxDatabase::instance();
     QStringList filesToUpload;
     QStringList filestoRemoveRemote;
-    db.startUpdatingFiles(nullptr);
+    db.startUpdatingFiles(volume, nullptr);
     if (db.markLocalDirFilesToRemove(volume, dir, true)) {
         QDir volumeRootDir(mWatchedDirectories.value(volume));
         if (db.updateLocalFiles(volume, localFiles, volumeRootDir) &&
@@ -398,10 +831,14 @@ void SxFilesystem::scanDirectory(const QString &path)
 void SxFilesystem::inotifyPoll()
 {
 #ifdef Q_OS_LINUX
-    int poll_num = poll(mPollDesc, 1, 10);
+    int poll_num = poll(mPollDesc, 2, 10);
     if (poll_num > 0) {
         if (mPollDesc[0].revents & POLLIN)
             inotifyHandleEvents();
+#ifdef FAN_REPORT_DFID_NAME
+        if (mPollDesc[1].revents & POLLIN)
+            fanotifyHandleEvents();
+#endif
     }
     QTimer::singleShot(100, this, SLOT(inotifyPoll()));
 #endif
@@ -412,9 +849,19 @@ void SxFilesystem::inotifyProcess()
     logEntry("");
     #ifdef Q_OS_WIN
 
-    QStringList files =  mNotifyFiles.toList();
-    mNotifyFiles.clear();
-    qSort(files);
+    QHash<QString, QString> renames;
+    QStringList files = takeReadyChanges(&renames);
+    for (auto it = renames.constBegin(); it != renames.constEnd(); ++it) {
+        int index = it.key().indexOf("/");
+        QString rootDir = mWatchedDirectories.value(it.key().mid(0, index));
+        QString destination = it.value();
+        if (rootDir.isEmpty() || mWatchedDirectories.value(destination.mid(0, destination.indexOf("/"))) != rootDir)
+            continue;
+        if (fileMoved(rootDir+it.key().mid(index), rootDir+destination.mid(destination.indexOf("/")))) {
+            files.removeOne(it.key());
+            files.removeOne(destination);
+        }
+    }
 
     SxDatabase &db = SxDatabase::instance();
 
@@ -459,7 +906,7 @@ void SxFilesystem::inotifyProcess()
             }
             else if (wasDir) {
                 removeDir = true;
-                db.startUpdatingFiles(nullptr);
+                db.startUpdatingFiles(volume, nullptr);
                 db.markLocalDirFilesToRemove(volume, path, true);
                 if (fileInfo.isDir()) {
                     QDir volumeRootDir(mWatchedDirectories.value(volume));
@@ -495,7 +942,7 @@ void SxFilesystem::inotifyProcess()
         }
         else {
             if (wasDir) {
-                db.startUpdatingFiles(nullptr);
+                db.startUpdatingFiles(volume, nullptr);
                 db.markLocalDirFilesToRemove(volume, path, true);
                 QStringList list = db.getMarkedFiles(volume, SxDatabase::ACTION::REMOVE_REMOTE);
                 db.endUpdatingFiles();
@@ -510,10 +957,15 @@ void SxFilesystem::inotifyProcess()
     }
 
     #endif
-    #ifdef Q_OS_LINUX
-    QStringList files =  mNotifyFiles.toList();
-    mNotifyFiles.clear();
-    qSort(files);
+    #if defined Q_OS_LINUX || defined Q_OS_MAC
+    QHash<QString, QString> renames;
+    QStringList files = takeReadyChanges(&renames);
+    for (auto it = renames.constBegin(); it != renames.constEnd(); ++it) {
+        if (fileMoved(it.key(), it.value())) {
+            files.removeOne(it.key());
+            files.removeOne(it.value());
+        }
+    }
     foreach (QString path, files) {
         QString volume;
         QString rootDir;
@@ -550,7 +1002,7 @@ void SxFilesystem::inotifyProcess()
             }
             else {
                 SxDatabase &db = SxDatabase::instance();
-                db.startUpdatingFiles(nullptr);
+                db.startUpdatingFiles(volume, nullptr);
                 db.markLocalDirFilesToRemove(volume, relativePath, true);
                 QStringList list = db.getMarkedFiles(volume, SxDatabase::ACTION::REMOVE_REMOTE);
                 db.endUpdatingFiles();
@@ -558,6 +1010,7 @@ void SxFilesystem::inotifyProcess()
                     fileModified(volume, f, true, 0);
                 }
 
+#ifdef Q_OS_LINUX
                 foreach (int d, mDirsDesc.keys()) {
                     if (mDirsDesc.value(d).startsWith(path+"/"))
                         mDirsDesc.remove(d);
@@ -565,6 +1018,10 @@ void SxFilesystem::inotifyProcess()
                 int desc = mDirsDesc.key(path, -1);
                 if (desc != -1)
                     mDirsDesc.remove(desc);
+#ifdef FAN_REPORT_DFID_NAME
+                fanotifyRemoveDirs(path);
+#endif
+#endif
             }
         }
         else {
@@ -612,8 +1069,9 @@ bool SxFilesystem::watchDirRecursively(const QString &path)
         logError("Unable to create directory handle");
         return false;
     }
-    WatchedDir* watchedDir = new WatchedDir(dir, this);
-    if (!watchedDir->watch()) {
+    WatchedDir* watchedDir = new WatchedDir(dir, path);
+    if (!mChangesPort->add(watchedDir)) {
+        logError("Unable to watch directory handle");
         delete watchedDir;
         return false;
     }
@@ -621,6 +1079,9 @@ bool SxFilesystem::watchDirRecursively(const QString &path)
     return true;
 
 
+#elif defined Q_OS_MAC
+    // a single FSEvents stream covers the whole tree
+    return true;
 #else
     QStringList list = {path};
     QStringList watchlist;
@@ -665,22 +1126,85 @@ void SxFilesystem::fileModified(const QString &volume, const QString &path, bool
     else {
         mQueuedUploads.append(task);
         mQuededTaskByName.insert(volume+path, {&mQueuedUploads, task});
+        // the queue may hash the file while the change waits for delivery
+        emit sig_fileSettling(volume, path, size);
     }
 }
 
-void SxFilesystem::emitQueuedSignals()
+bool SxFilesystem::fileMoved(const QString &source, const QString &destination)
 {
-    mQuededTaskByName.clear();
-    foreach (auto task, mQueuedUploads) {
-        emit sig_fileModified(task->volume, task->path, false, task->size);
-        delete task;
+    // a move is done on the server only if the source is fully known there and nothing else changed
+    QString sourcePath = source.endsWith("/") ? source.mid(0, source.length()-1) : source;
+    QString destinationPath = destination.endsWith("/") ? destination.mid(0, destination.length()-1) : destination;
+    QString volume;
+    QString rootDir;
+    foreach (QString volName, mWatchedDirectories.keys()) {
+        QString dir = mWatchedDirectories.value(volName);
+        if (sourcePath.startsWith(dir+"/")) {
+            volume = volName;
+            rootDir = dir;
+            break;
+        }
     }
-    mQueuedUploads.clear();
-    foreach (auto task, mQueuedRemovals) {
-        emit sig_fileModified(task->volume, task->path, true, task->size);
-        delete task;
+    if (volume.isEmpty() || !destinationPath.startsWith(rootDir+"/"))
+        return false;
+    QFileInfo sourceInfo(sourcePath);
+    QFileInfo destinationInfo(destinationPath);
+    if (sourceInfo.exists() || !destinationInfo.exists())
+        return false;
+    QString relativeSource = sourcePath.mid(rootDir.length());
+    QString relativeDestination = destinationPath.mid(rootDir.length());
+
+    SxDatabase &db = SxDatabase::instance();
+    if (destinationInfo.isDir()) {
+        if (!db.isLocalDir(volume, relativeSource) || db.isLocalDir(volume, relativeDestination))
+            return false;
+        relativeSource.append("/");
+        relativeDestination.append("/");
+#ifdef Q_OS_LINUX
+        foreach (int d, mDirsDesc.keys()) {
+            if (mDirsDesc.value(d).startsWith(sourcePath+"/"))
+                mDirsDesc.remove(d);
+        }
+        int desc = mDirsDesc.key(sourcePath, -1);
+        if (desc != -1)
+            mDirsDesc.remove(desc);
+#endif
+    }
+    else {
+        uint32_t mtime;
+        if (!db.getLocalFileMtime(volume, relativeSource, mtime) || destinationInfo.lastModified().toTime_t() != mtime)
+            return false;
+        if (!db.remoteFileExists(volume, relativeSource) || db.remoteFileExists(volume, relativeDestination))
+            return false;
     }
-    mQueuedRemovals.clear();
+    logDebug(QString("%1: %2 moved to %3").arg(volume).arg(relativeSource).arg(relativeDestination));
+    mQueuedMoves.append(SxFileChange{volume, relativeDestination, false, 0, relativeSource});
+    return true;
+}
+
+void SxFilesystem::emitQueuedSignals()
+{
+    mQuededTaskByName.clear();
+    // moves go first since later changes below a moved directory refer to its new location,
+    // uploads before removals so that the new side of a rename is queued before the old one gets removed
+    QList<SxFileChange> changes = mQueuedMoves;
+    mQueuedMoves.clear();
+    auto deliver = [this, &changes](QList<QuededTask*> &tasks, bool removed) {
+        foreach (auto task, tasks) {
+            changes.append(SxFileChange{task->volume, task->path, removed, task->size});
+            delete task;
+            if (changes.size() == sDeliveryBatch) {
+                emit sig_filesModified(changes);
+                changes.clear();
+            }
+        }
+        tasks.clear();
+    };
+    deliver(mQueuedUploads, false);
+    deliver(mQueuedRemovals, true);
+    if (!changes.isEmpty())
+        emit sig_filesModified(changes);
 }
 
 #ifdef Q_OS_LINUX
@@ -692,6 +1216,7 @@ bool SxFilesystem::inotifyHandleEvents()
     const struct inotify_event *event;
     ssize_t len;
     char *ptr;
+    bool overflow = false;
 
     for (;;) {
         len = read(mInotifyDesc, buf, sizeof buf);
@@ -704,6 +1229,10 @@ bool SxFilesystem::inotifyHandleEvents()
 
         for (ptr = buf; ptr < buf + len; ptr += sizeof(struct inotify_event) + event->len) {
             event = reinterpret_cast<const struct inotify_event *>(ptr);
+            if (event->mask & IN_Q_OVERFLOW) {
+                overflow = true;
+                continue;
+            }
             if (event->len==0)
                 continue;
             QString path = mDirsDesc.value(event->wd)+"/"+QString::fromLocal8Bit(event->name);
@@ -718,17 +1247,324 @@ bool SxFilesystem::inotifyHandleEvents()
                 }
                 path.append("/");
             }
-            mNotifyFiles.insert(path);
+            notifyChange(path);
+            if (event->mask & IN_MOVED_FROM)
+                mMoveCookies.insert(event->cookie, path);
+            else if ((event->mask & IN_MOVED_TO) && mMoveCookies.contains(event->cookie))
+                notifyRename(mMoveCookies.take(event->cookie), path);
         }
     }
-    if (!mNotifyFiles.isEmpty()) {
-        if (mNotifyTimer == nullptr) {
-            mNotifyTimer = new QTimer();
-            mNotifyTimer->setSingleShot(true);
-            connect(mNotifyTimer, &QTimer::timeout, this, &SxFilesystem::inotifyProcess);
+    // both halves of a move are delivered in one read, anything left was moved out of the watched trees
+    mMoveCookies.clear();
+    if (overflow) {
+        foreach (QString volume, mWatchedDirectories.keys()) {
+            QString rootDir = mWatchedDirectories.value(volume);
+            if (mDirsDesc.key(rootDir, -1) == -1)
+                continue;
+            // directories created while the events were lost are not watched yet
+            watchDirRecursively(rootDir);
+            watchOverflow(volume);
         }
-        mNotifyTimer->start(sSignalDelay*1000);
     }
     return true;
 }
+
+#ifdef FAN_REPORT_DFID_NAME
+bool SxFilesystem::fanotifyWatch(const QString &path)
+{
+    logEntry(path);
+    if (mFanotifyDesc == -1 || !QFileInfo(path).isDir())
+        return false;
+    static const uint64_t mask = FAN_CREATE | FAN_DELETE | FAN_MOVED_FROM | FAN_MOVED_TO | FAN_CLOSE_WRITE | FAN_ONDIR;
+    if (fanotify_mark(mFanotifyDesc, FAN_MARK_ADD | FAN_MARK_FILESYSTEM, mask, AT_FDCWD, QFile::encodeName(path).constData()) != 0) {
+        logVerbose(QString("fanotify_mark failed: %1").arg(strerror(errno)));
+        if (mDirHandles.isEmpty()) {
+            close(mFanotifyDesc);
+            mFanotifyDesc = -1;
+            mPollDesc[1].fd = -1;
+        }
+        return false;
+    }
+    // events identify the parent directory by its file handle, only the known handles belong to watched trees
+    fanotifyAddDirs(path);
+    return true;
+}
+
+void SxFilesystem::fanotifyAddDirs(const QString &path)
+{
+    QStringList list = {path};
+    while (!list.isEmpty()) {
+        QString dir = list.takeFirst();
+        QByteArray key = fanotifyDirKey(dir);
+        if (key.isEmpty()) {
+            logWarning(QString("name_to_handle_at failed for %1: %2").arg(dir).arg(strerror(errno)));
+            continue;
+        }
+        mDirHandles.insert(key, dir);
+        QDir d(dir);
+        foreach (QFileInfo info, d.entryInfoList(QDir::Dirs | QDir::NoDotAndDotDot)) {
+            list.append(info.absoluteFilePath());
+        }
+    }
+}
+
+void SxFilesystem::fanotifyRemoveDirs(const QString &path)
+{
+    auto it = mDirHandles.begin();
+    while (it != mDirHandles.end()) {
+        if (it.value() == path || it.value().startsWith(path+"/"))
+            it = mDirHandles.erase(it);
+        else
+            ++it;
+    }
+}
+
+bool SxFilesystem::fanotifyHandleEvents()
+{
+    char buf[8192]
+            __attribute__ ((aligned(__alignof__(struct fanotify_event_metadata))));
+    ssize_t len;
+    bool overflow = false;
+
+    for (;;) {
+        len = read(mFanotifyDesc, buf, sizeof buf);
+        if (len == -1 && errno != EAGAIN) {
+            logError(QString("read error: %1").arg(strerror(errno)));
+            return false;
+        }
+        if (len <= 0)
+            break;
+
+        struct fanotify_event_metadata *event = reinterpret_cast<struct fanotify_event_metadata *>(buf);
+        for (; FAN_EVENT_OK(event, len); event = FAN_EVENT_NEXT(event, len)) {
+            if (event->mask & FAN_Q_OVERFLOW) {
+                overflow = true;
+                continue;
+            }
+            const struct fanotify_event_info_fid *fid = reinterpret_cast<const struct fanotify_event_info_fid *>(event + 1);
+            if (event->event_len < sizeof(*event) + sizeof(*fid) || fid->hdr.info_type != FAN_EVENT_INFO_TYPE_DFID_NAME)
+                continue;
+            const struct file_handle *handle = reinterpret_cast<const struct file_handle *>(fid->handle);
+            // the whole filesystem is reported, anything outside the watched trees is dropped here
+            QString dir = mDirHandles.value(fanotifyKey(&fid->fsid, sizeof(fid->fsid), handle));
+            if (dir.isEmpty())
+                continue;
+            QString name = QFile::decodeName(reinterpret_cast<const char *>(handle->f_handle + handle->handle_bytes));
+            if (name == "." || name.startsWith("._sdrvtmp"))
+                continue;
+            QString path = dir+"/"+name;
+            if (event->mask & FAN_ONDIR) {
+                if (QFileInfo(path).isDir())
+                    fanotifyAddDirs(path);
+                path.append("/");
+            }
+            notifyChange(path);
+        }
+    }
+    if (overflow) {
+        foreach (QString volume, mWatchedDirectories.keys()) {
+            QString rootDir = mWatchedDirectories.value(volume);
+            if (mDirHandles.key(rootDir).isEmpty())
+                continue;
+            // directories created while the events were lost have no known handle yet
+            fanotifyAddDirs(rootDir);
+            watchOverflow(volume);
+        }
+    }
+    return true;
+}
+#endif
+#endif
+
+#ifdef Q_OS_MAC
+void SxFilesystem::fsEventsRestart()
+{
+    if (mEventStream != nullptr) {
+        FSEventStreamStop(mEventStream);
+        FSEventStreamInvalidate(mEventStream);
+        FSEventStreamRelease(mEventStream);
+        mEventStream = nullptr;
+    }
+    if (mWatchedDirectories.isEmpty())
+        return;
+    CFMutableArrayRef paths = CFArrayCreateMutable(nullptr, 0, &kCFTypeArrayCallBacks);
+    foreach (QString dir, mWatchedDirectories.values()) {
+        CFStringRef path = CFStringCreateWithCString(nullptr, dir.toUtf8().constData(), kCFStringEncodingUTF8);
+        CFArrayAppendValue(paths, path);
+        CFRelease(path);
+    }
+    FSEventStreamContext context = {0, this, nullptr, nullptr, nullptr};
+    mEventStream = FSEventStreamCreate(nullptr, &fsEventsCallback, &context, paths, kFSEventStreamEventIdSinceNow, 1.0,
+                                       kFSEventStreamCreateFlagFileEvents | kFSEventStreamCreateFlagNoDefer | kFSEventStreamCreateFlagWatchRoot);
+    CFRelease(paths);
+    if (mEventStream == nullptr) {
+        logError("FSEventStreamCreate failed");
+        return;
+    }
+    FSEventStreamSetDispatchQueue(mEventStream, mEventQueue);
+    if (!FSEventStreamStart(mEventStream))
+        logError("FSEventStreamStart failed");
+}
 #endif
+
+void SxFilesystem::fsEventsReceived(const QStringList &paths)
+{
+#ifdef Q_OS_MAC
+    foreach (QString path, paths) {
+        QString name = path.endsWith("/") ? path.section('/', -2, -2) : path.section('/', -1);
+        if (name.startsWith("._sdrvtmp"))
+            continue;
+        notifyChange(path);
+    }
+#else
+    Q_UNUSED(paths);
+#endif
+}
+
+void SxFilesystem::fsEventsDropped()
+{
+#ifdef Q_OS_MAC
+    foreach (QString volume, mWatchedDirectories.keys()) {
+        watchOverflow(volume);
+    }
+#endif
+}
+
+void SxFilesystem::winChangesReceived(const QString &rootDir, const QStringList &paths, const QByteArray &actions, bool overflow)
+{
+#ifdef Q_OS_WIN
+    QString volume = mWatchedDirectories.key(rootDir, "");
+    if (volume.isEmpty()) {
+        logError("logic error");
+        return;
+    }
+    auto isTempFile = [](const QString &path) {
+        return path.mid(path.lastIndexOf('/')+1).startsWith("._sdrvtmp");
+    };
+    auto changed = [this, &volume, &rootDir](const QString &path) {
+        uint32_t mtime;
+        QFileInfo fileInfo(rootDir+"/"+path);
+        if (fileInfo.isFile() && SxDatabase::instance().getLocalFileMtime(volume, "/"+path, mtime)) {
+            if (mtime == fileInfo.lastModified().toTime_t())
+                return;
+        }
+        notifyChange(volume+"/"+path);
+    };
+    QString renamedFrom;
+    for (int i=0; i<paths.count(); i++) {
+        const QString &path = paths.at(i);
+        DWORD action = static_cast<DWORD>(actions.at(i));
+        if (action == FILE_ACTION_MODIFIED) {
+            if (!isTempFile(path) && QFileInfo(rootDir+"/"+path).isFile())
+                changed(path);
+        }
+        else if (action == FILE_ACTION_RENAMED_OLD_NAME) {
+            // the new name always follows in the same buffer
+            renamedFrom = path;
+        }
+        else if (action == FILE_ACTION_RENAMED_NEW_NAME && !renamedFrom.isEmpty()) {
+            if (isTempFile(renamedFrom) || isTempFile(path)) {
+                if (!isTempFile(path))
+                    changed(path);
+                if (!isTempFile(renamedFrom))
+                    changed(renamedFrom);
+            }
+            else {
+                changed(renamedFrom);
+                changed(path);
+                notifyRename(volume+"/"+renamedFrom, volume+"/"+path);
+            }
+            renamedFrom.clear();
+        }
+        else if (!isTempFile(path)) {
+            changed(path);
+        }
+    }
+    if (overflow)
+        watchOverflow(volume);
+#else
+    Q_UNUSED(rootDir);
+    Q_UNUSED(paths);
+    Q_UNUSED(actions);
+    Q_UNUSED(overflow);
+#endif
+}
+
+void SxFilesystem::watchOverflow(const QString &volume)
+{
+    logWarning(QString("filesystem events of volume %1 were lost, rescanning changed directories").arg(volume));
+    emit sig_watchOverflow(volume);
+}
+
+void SxFilesystem::notifyChange(const QString &path)
+{
+#if defined Q_OS_WIN || defined Q_OS_LINUX || defined Q_OS_MAC
+    if (isOwnWrite(path)) {
+        logDebug("skipping own write "+path);
+        return;
+    }
+    qint64 now = QDateTime::currentMSecsSinceEpoch();
+    auto it = mNotifyFiles.find(path);
+    if (it == mNotifyFiles.end())
+        mNotifyFiles.insert(path, {now, now});
+    else
+        it->lastSeen = now;
+    // the timer ticks at a fixed rate instead of being restarted, so a steady stream of events can't hold back the others
+    if (mNotifyTimer == nullptr) {
+        mNotifyTimer = new QTimer();
+        mNotifyTimer->setInterval(sNotifyTick);
+        connect(mNotifyTimer, &QTimer::timeout, this, &SxFilesystem::inotifyProcess);
+    }
+    if (!mNotifyTimer->isActive())
+        mNotifyTimer->start();
+#else
+    Q_UNUSED(path);
+#endif
+}
+
+void SxFilesystem::notifyRename(const QString &source, const QString &destination)
+{
+#if defined Q_OS_WIN || defined Q_OS_LINUX || defined Q_OS_MAC
+    mRenamePairs.insert(source, destination);
+    mRenamePairs.insert(destination, source);
+    mRenames.insert(source, destination);
+#else
+    Q_UNUSED(source);
+    Q_UNUSED(destination);
+#endif
+}
+
+QStringList SxFilesystem::takeReadyChanges(QHash<QString, QString> *renames)
+{
+    QStringList ready;
+#if defined Q_OS_WIN || defined Q_OS_LINUX || defined Q_OS_MAC
+    qint64 now = QDateTime::currentMSecsSinceEpoch();
+    // a path is ready once it has been quiet for sSignalDelay, or once it has been waiting for sMaxSignalDelay
+    auto isReady = [now](const PendingChange &change) {
+        return now - change.lastSeen >= sSignalDelay*1000 || now - change.firstSeen >= sMaxSignalDelay*1000;
+    };
+    for (auto it = mNotifyFiles.constBegin(); it != mNotifyFiles.constEnd(); ++it) {
+        if (!isReady(it.value()))
+            continue;
+        auto partner = mNotifyFiles.constFind(mRenamePairs.value(it.key()));
+        if (partner != mNotifyFiles.constEnd() && !isReady(partner.value()))
+            continue;
+        ready.append(it.key());
+    }
+    foreach (QString path, ready) {
+        mNotifyFiles.remove(path);
+        mRenamePairs.remove(path);
+    }
+    foreach (QString path, ready) {
+        QString destination = mRenames.take(path);
+        if (renames != nullptr && !destination.isEmpty() && !mNotifyFiles.contains(destination))
+            renames->insert(path, destination);
+    }
+    if (mNotifyFiles.isEmpty() && mNotifyTimer != nullptr)
+        mNotifyTimer->stop();
+    qSort(ready);
+#else
+    Q_UNUSED(renames);
+#endif
+    return ready;
+}
@@ -31,10 +31,12 @@
 
 #include <QDir>
 #include <QHash>
+#include <QMutex>
 #include <QObject>
 #include "sxconfig.h"
 #include <QTimer>
 #include <QSet>
+#include <QVector>
 
 #if defined Q_OS_WIN
 #elif defined Q_OS_LINUX
@@ -42,15 +44,44 @@
     #include <poll.h>
     #include <stdlib.h>
     #include <sys/inotify.h>
+    #include <sys/fanotify.h>
     #include <unistd.h>
+#elif defined Q_OS_MAC
+    #include <CoreServices/CoreServices.h>
 #else
     #include <QFileSystemWatcher>
 #endif
 
 #ifdef Q_OS_WIN
     class WatchedDir;
+    class WinChangesPort;
 #endif
 
+struct SxLocalFile
+{
+    QString path;
+    qint64 size;
+    uint mTime;
+};
+
+struct SxFingerprint
+{
+    qint64 size;
+    quint64 inode;
+    qint64 cTime;
+    QByteArray sample;
+};
+
+struct SxFileChange
+{
+    QString volume;
+    QString path;
+    bool removed;
+    qint64 size;
+    QString source;
+};
+Q_DECLARE_METATYPE(SxFileChange)
+
 
 class SxFilesystem : public QObject
 {
@@ -59,15 +90,29 @@ public:
     explicit SxFilesystem(SxConfig *config);
     ~SxFilesystem();
     static QList<QString> getDirectoryContents(QDir &rootDir, bool recursive, const QString &prefix=QString(), bool removeTempfiles = false);
+    static void walkDirectory(const QDir &rootDir, bool recursive, const QString &prefix, bool removeTempfiles,
+                              QVector<SxLocalFile> &files, QHash<QString, qint64> *dirMTimes = nullptr);
+    static void getDirectoryMTimes(QDir &rootDir, QHash<QString, qint64> &dirMTimes);
+    static bool getFingerprint(const QString &path, bool withSample, SxFingerprint &fingerprint);
+    static bool getDeviceId(const QString &path, quint64 &deviceId);
     static QList<QString> getSubdirectories(QDir &rootDir, const QString &prefix=QString());
+    static void addWriteToken(const QString &tmpFile, const QString &path);
     bool watchDirectory(const QString &volume, const QString &directory);
     bool unwatchDirectory(const QString &volume);
 
+public slots:
+    void startWatching();
+
 signals:
     void sig_fileModified(QString volume, QString path, bool removed, qint64 size);
+    void sig_filesModified(const QList<SxFileChange> &changes);
+    void sig_fileSettling(const QString &volume, const QString &path, qint64 size);
     void sig_cancelUploadTask(const QString &volume, const QString &path);
+    void sig_watchOverflow(const QString &volume);
+    void sig_watching();
 
 private:
+    SxConfig *mConfig;
 
     struct QuededTask{
         QuededTask(QString volume, QString path, qint64 size) {
@@ -84,33 +129,78 @@ private:
     QList<QuededTask*> mQueuedUploads;
     QList<QuededTask*> mQueuedRemovals;
     QHash<QString, QPair<QList<QuededTask*>*, QuededTask*>> mQuededTaskByName;
+    QList<SxFileChange> mQueuedMoves;
 
     static const int sSignalDelay = 5;
+    static const int sMaxSignalDelay = 30;
+    static const int sNotifyTick = 1000;
+    static const int sDeliveryBatch = 500;
+    static const int sPartialDownloadMaxAge = 7;
+    static const int sWalkerThreads = 8;
+    static const int sSampleSize = 64*1024;
+    static const int sSampleCount = 16;
+    static const int sWriteTokenTtl = 60;
+    static const int sWriteTokensPurge = 1000;
+    // files the engine is about to put in place, events matching their inode and mtime are its own
+    struct WriteToken {
+        quint64 inode;
+        qint64 mTime;
+        qint64 expires;
+    };
+    static QMutex sWriteTokensMutex;
+    static QHash<QString, WriteToken> sWriteTokens;
+    bool isOwnWrite(const QString &path) const;
     bool watchDirRecursively(const QString &path);
     void fileModified(const QString &volume, const QString &path, bool removed, qint64 size);
+    bool fileMoved(const QString &source, const QString &destination);
     void emitQueuedSignals();
+    void notifyChange(const QString &path);
+    void notifyRename(const QString &source, const QString &destination);
+    void watchOverflow(const QString &volume);
+    QStringList takeReadyChanges(QHash<QString, QString> *renames = nullptr);
 
 private slots:
     void directoryChanged(const QString &path);
     void scanDirectory(const QString &path);
     void inotifyPoll();
     void inotifyProcess();
+    void fsEventsReceived(const QStringList &paths);
+    void fsEventsDropped();
+    void winChangesReceived(const QString &rootDir, const QStringList &paths, const QByteArray &actions, bool overflow);
 
 private:
-#if defined Q_OS_WIN || defined Q_OS_LINUX
+#if defined Q_OS_WIN || defined Q_OS_LINUX || defined Q_OS_MAC
+    struct PendingChange {
+        qint64 firstSeen;
+        qint64 lastSeen;
+    };
     QTimer *mNotifyTimer;
-    QSet<QString> mNotifyFiles;
+    QHash<QString, PendingChange> mNotifyFiles;
+    QHash<QString, QString> mRenamePairs;
+    QHash<QString, QString> mRenames;
 #endif
 
 #if defined Q_OS_WIN
     QHash<WatchedDir*, QString> mDirHandlers;
-    friend void notifyFileChange(WatchedDir* dir, const QString &path );
-    friend QString getWatchedDirPath(WatchedDir* dir);
+    WinChangesPort *mChangesPort;
 #elif defined Q_OS_LINUX
     bool inotifyHandleEvents();
     int mInotifyDesc;
     QHash<int, QString> mDirsDesc;
-    struct pollfd mPollDesc[1];
+    QHash<uint32_t, QString> mMoveCookies;
+    struct pollfd mPollDesc[2];
+#ifdef FAN_REPORT_DFID_NAME
+    bool fanotifyWatch(const QString &path);
+    void fanotifyAddDirs(const QString &path);
+    void fanotifyRemoveDirs(const QString &path);
+    bool fanotifyHandleEvents();
+    int mFanotifyDesc;
+    QHash<QByteArray, QString> mDirHandles;
+#endif
+#elif defined Q_OS_MAC
+    void fsEventsRestart();
+    FSEventStreamRef mEventStream;
+    dispatch_queue_t mEventQueue;
 #else
     QFileSystemWatcher mQtWatcher;
     QHash<QString, QTimer*> mTimers;
@@ -0,0 +1,160 @@
+/*
+ *  Copyright (C) 2012-2016 Skylable Ltd. <info-copyright@skylable.com>
+ *
+ *  This program is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public License
+ *  as published by the Free Software Foundation; either version 2
+ *  of the License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA.
+ *
+ *  Special exception for linking this software with OpenSSL:
+ *
+ *  In addition, as a special exception, Skylable Ltd. gives permission to
+ *  link the code of this program with the OpenSSL library and distribute
+ *  linked combinations including the two. You must obey the GNU General
+ *  Public License in all respects for all of the code used other than
+ *  OpenSSL. You may extend this exception to your version of the program,
+ *  but you are not obligated to do so. If you do not wish to do so, delete
+ *  this exception statement from your version.
+ */
+
+#include "sxgovernor.h"
+#include "sxlog.h"
+
+#include <QDateTime>
+#include <QDir>
+#include <QFile>
+#include <QNetworkConfigurationManager>
+#include <QThread>
+
+#if defined Q_OS_WIN
+#include <windows.h>
+#elif defined Q_OS_MAC
+#include <ApplicationServices/ApplicationServices.h>
+#include <IOKit/ps/IOPowerSources.h>
+#include <IOKit/ps/IOPSKeys.h>
+#endif
+
+SxGovernor &SxGovernor::instance()
+{
+    static SxGovernor sInstance;
+    return sInstance;
+}
+
+SxGovernor::SxGovernor()
+{
+    mLastRefresh = 0;
+    mPolicy = {false, 1, 0, 0};
+}
+
+SxGovernor::~SxGovernor()
+{
+}
+
+SxGovernor::Policy SxGovernor::policy()
+{
+    QMutexLocker locker(&mMutex);
+    qint64 now = QDateTime::currentMSecsSinceEpoch();
+    if (mLastRefresh == 0 || now - mLastRefresh >= sRefreshInterval) {
+        mLastRefresh = now;
+        _refresh();
+    }
+    return mPolicy;
+}
+
+void SxGovernor::_refresh()
+{
+    bool battery = _onBattery();
+    bool metered = _meteredNetwork();
+    qint64 idle = _idleSeconds();
+    // unknown idle time counts as idle, the machine is then governed by power and network only
+    bool userActive = idle >= 0 && idle < sUserIdleTime;
+
+    Policy policy = {false, 1, 0, 0};
+    if (battery || metered)
+        policy.timerScale = sSavingTimerScale;
+    if (battery || metered || userActive)
+        policy.deferHeavyWork = true;
+    if (battery)
+        policy.hashingThreads = 1;
+    else if (userActive)
+        policy.hashingThreads = qMax(1, QThread::idealThreadCount()/2);
+    if (metered)
+        policy.bandwidthCap = sMeteredBandwidth;
+
+    if (policy.deferHeavyWork != mPolicy.deferHeavyWork || policy.bandwidthCap != mPolicy.bandwidthCap || policy.hashingThreads != mPolicy.hashingThreads)
+        logInfo(QString("battery: %1, metered: %2, idle: %3s").arg(battery).arg(metered).arg(idle));
+    mPolicy = policy;
+}
+
+bool SxGovernor::_onBattery()
+{
+#if defined Q_OS_WIN
+    SYSTEM_POWER_STATUS status;
+    if (!GetSystemPowerStatus(&status))
+        return false;
+    return status.ACLineStatus == 0;
+#elif defined Q_OS_MAC
+    CFTypeRef info = IOPSCopyPowerSourcesInfo();
+    if (info == nullptr)
+        return false;
+    bool battery = false;
+    CFStringRef source = IOPSGetProvidingPowerSourceType(info);
+    if (source != nullptr)
+        battery = CFStringCompare(source, CFSTR(kIOPSBatteryPowerValue), 0) == kCFCompareEqualTo;
+    CFRelease(info);
+    return battery;
+#else
+    QDir dir("/sys/class/power_supply");
+    foreach (const QString &supply, dir.entryList(QDir::Dirs | QDir::NoDotAndDotDot)) {
+        QFile type(dir.filePath(supply+"/type"));
+        if (!type.open(QIODevice::ReadOnly) || type.readAll().trimmed() != "Battery")
+            continue;
+        QFile status(dir.filePath(supply+"/status"));
+        if (status.open(QIODevice::ReadOnly) && status.readAll().trimmed() == "Discharging")
+            return true;
+    }
+    return false;
+#endif
+}
+
+/* seconds since the last keyboard or mouse input, -1 where there is no way to tell */
+qint64 SxGovernor::_idleSeconds()
+{
+#if defined Q_OS_WIN
+    LASTINPUTINFO info;
+    info.cbSize = sizeof(info);
+    if (!GetLastInputInfo(&info))
+        return -1;
+    return static_cast<qint64>(GetTickCount() - info.dwTime) / 1000;
+#elif defined Q_OS_MAC
+    return static_cast<qint64>(CGEventSourceSecondsSinceLastEventType(kCGEventSourceStateCombinedSessionState, kCGAnyInputEventType));
+#else
+    return -1;
+#endif
+}
+
+bool SxGovernor::_meteredNetwork()
+{
+    if (!mNetworkManager)
+        mNetworkManager.reset(new QNetworkConfigurationManager());
+    QNetworkConfiguration config = mNetworkManager->defaultConfiguration();
+    if (!config.isValid())
+        return false;
+    switch (config.bearerTypeFamily()) {
+    case QNetworkConfiguration::Bearer2G:
+    case QNetworkConfiguration::Bearer3G:
+    case QNetworkConfiguration::Bearer4G:
+        return true;
+    default:
+        return false;
+    }
+}
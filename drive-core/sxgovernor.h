@@ -0,0 +1,72 @@
+/*
+ *  Copyright (C) 2012-2016 Skylable Ltd. <info-copyright@skylable.com>
+ *
+ *  This program is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public License
+ *  as published by the Free Software Foundation; either version 2
+ *  of the License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA.
+ *
+ *  Special exception for linking this software with OpenSSL:
+ *
+ *  In addition, as a special exception, Skylable Ltd. gives permission to
+ *  link the code of this program with the OpenSSL library and distribute
+ *  linked combinations including the two. You must obey the GNU General
+ *  Public License in all respects for all of the code used other than
+ *  OpenSSL. You may extend this exception to your version of the program,
+ *  but you are not obligated to do so. If you do not wish to do so, delete
+ *  this exception statement from your version.
+ */
+
+#ifndef SXGOVERNOR_H
+#define SXGOVERNOR_H
+
+#include <QMutex>
+#include <memory>
+
+class QNetworkConfigurationManager;
+
+/* Tells the sync engine how hard to work: on battery, on a metered network or while the
+ * user is busy the heavy background work waits, rescans come less often and hashing
+ * leaves cores free. Sources are polled at most every 30 seconds */
+class SxGovernor
+{
+public:
+    struct Policy {
+        bool deferHeavyWork;
+        int timerScale;
+        int hashingThreads;
+        qint64 bandwidthCap;
+    };
+    static SxGovernor& instance();
+    SxGovernor(const SxGovernor &) = delete;
+    SxGovernor &operator= (const SxGovernor &) = delete;
+    ~SxGovernor();
+    Policy policy();
+
+private:
+    SxGovernor();
+    void _refresh();
+    static bool _onBattery();
+    static qint64 _idleSeconds();
+    bool _meteredNetwork();
+
+    static const qint64 sRefreshInterval = 30*1000;
+    static const qint64 sUserIdleTime = 5*60;
+    static const qint64 sMeteredBandwidth = 256*1024;
+    static const int sSavingTimerScale = 4;
+    QMutex mMutex;
+    qint64 mLastRefresh;
+    Policy mPolicy;
+    std::unique_ptr<QNetworkConfigurationManager> mNetworkManager;
+};
+
+#endif // SXGOVERNOR_H
@@ -0,0 +1,86 @@
+/*
+ *  Copyright (C) 2012-2016 Skylable Ltd. <info-copyright@skylable.com>
+ *
+ *  This program is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public License
+ *  as published by the Free Software Foundation; either version 2
+ *  of the License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA.
+ *
+ *  Special exception for linking this software with OpenSSL:
+ *
+ *  In addition, as a special exception, Skylable Ltd. gives permission to
+ *  link the code of this program with the OpenSSL library and distribute
+ *  linked combinations including the two. You must obey the GNU General
+ *  Public License in all respects for all of the code used other than
+ *  OpenSSL. You may extend this exception to your version of the program,
+ *  but you are not obligated to do so. If you do not wish to do so, delete
+ *  this exception statement from your version.
+ */
+
+#include "sxmetricsserver.h"
+#include "sxmetrics.h"
+#include "sxlog.h"
+
+#include <QTcpSocket>
+
+SxMetricsServer::SxMetricsServer(QObject *parent) : QObject(parent)
+{
+    connect(&mServer, &QTcpServer::newConnection, this, &SxMetricsServer::onNewConnection);
+}
+
+bool SxMetricsServer::listen(quint16 port)
+{
+    // never reachable from other machines
+    if (!mServer.listen(QHostAddress::LocalHost, port)) {
+        logWarning(QString("unable to listen on port %1: %2").arg(port).arg(mServer.errorString()));
+        return false;
+    }
+    logInfo(QString("metrics available at http://127.0.0.1:%1/metrics").arg(port));
+    return true;
+}
+
+void SxMetricsServer::onNewConnection()
+{
+    while (mServer.hasPendingConnections()) {
+        QTcpSocket *socket = mServer.nextPendingConnection();
+        connect(socket, &QTcpSocket::disconnected, socket, &QTcpSocket::deleteLater);
+        connect(socket, &QTcpSocket::readyRead, this, [this, socket]() {
+            _reply(socket);
+        });
+    }
+}
+
+void SxMetricsServer::_reply(QTcpSocket *socket)
+{
+    // wait for the whole request head, only the request line matters
+    QByteArray request = socket->peek(sRequestSizeLimit);
+    if (!request.contains("\r\n\r\n") && request.size() < sRequestSizeLimit)
+        return;
+    socket->readAll();
+    disconnect(socket, &QTcpSocket::readyRead, this, 0);
+    QList<QByteArray> requestLine = request.left(request.indexOf("\r\n")).split(' ');
+    QByteArray status = "200 OK";
+    QByteArray body;
+    if (requestLine.count() < 2 || requestLine.at(0) != "GET")
+        status = "405 Method Not Allowed";
+    else if (requestLine.at(1) != "/metrics" && !requestLine.at(1).startsWith("/metrics?"))
+        status = "404 Not Found";
+    else
+        body = SxMetrics::instance().openMetrics();
+    QByteArray reply = "HTTP/1.1 "+status+"\r\n";
+    reply += "Content-Type: application/openmetrics-text; version=1.0.0; charset=utf-8\r\n";
+    reply += "Content-Length: "+QByteArray::number(body.size())+"\r\n";
+    reply += "Connection: close\r\n\r\n";
+    reply += body;
+    socket->write(reply);
+    socket->disconnectFromHost();
+}
@@ -0,0 +1,220 @@
+/*
+ *  Copyright (C) 2012-2016 Skylable Ltd. <info-copyright@skylable.com>
+ *
+ *  This program is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public License
+ *  as published by the Free Software Foundation; either version 2
+ *  of the License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA.
+ *
+ *  Special exception for linking this software with OpenSSL:
+ *
+ *  In addition, as a special exception, Skylable Ltd. gives permission to
+ *  link the code of this program with the OpenSSL library and distribute
+ *  linked combinations including the two. You must obey the GNU General
+ *  Public License in all respects for all of the code used other than
+ *  OpenSSL. You may extend this exception to your version of the program,
+ *  but you are not obligated to do so. If you do not wish to do so, delete
+ *  this exception statement from your version.
+ */
+
+#include "sxpathmatcher.h"
+#include <QFileInfo>
+#include "sxlog.h"
+
+SxPathMatcher::SxPathMatcher(const QString &localPath, const QStringList &ignoredPaths, bool whitelist, const QList<QRegExp> &regexpList)
+{
+    mRootPath = QFileInfo(localPath).absoluteFilePath();
+    mWhitelist = whitelist;
+    mHasPatterns = !regexpList.isEmpty();
+
+    foreach (const QString &ignoredPath, ignoredPaths) {
+        Node *node = &mRoot;
+        foreach (const QString &name, ignoredPath.split('/')) {
+            Node *child = node->children.value(name, nullptr);
+            if (child == nullptr) {
+                child = new Node();
+                node->children.insert(name, child);
+            }
+            node = child;
+        }
+        node->ignored = true;
+    }
+
+    static const QRegularExpression backReference("\\\\[1-9]");
+    QStringList combined;
+    QList<QRegularExpression> combinedSeparate;
+    foreach (const QRegExp &regexp, regexpList) {
+        QString pattern;
+        if (!_translatePattern(regexp, pattern)) {
+            mFallback.append(regexp);
+            continue;
+        }
+        QRegularExpression::PatternOptions options = regexp.caseSensitivity() == Qt::CaseInsensitive ?
+                    QRegularExpression::CaseInsensitiveOption : QRegularExpression::NoPatternOption;
+        QRegularExpression separate("\\A(?:"+pattern+")\\z", options);
+        if (!separate.isValid()) {
+            mFallback.append(regexp);
+            continue;
+        }
+        // back references are numbered across the whole expression, such patterns stay on their own
+        if (backReference.match(pattern).hasMatch()) {
+            separate.optimize();
+            mPatterns.append(separate);
+            continue;
+        }
+        combined.append((options & QRegularExpression::CaseInsensitiveOption ? "(?i:" : "(?:")+pattern+")");
+        combinedSeparate.append(separate);
+    }
+    if (!combined.isEmpty()) {
+        QRegularExpression regexp("\\A(?:"+combined.join('|')+")\\z");
+        if (regexp.isValid()) {
+            regexp.optimize();
+            mPatterns.prepend(regexp);
+        }
+        else {
+            logWarning("unable to combine selective sync patterns: "+regexp.errorString());
+            foreach (QRegularExpression separate, combinedSeparate) {
+                separate.optimize();
+                mPatterns.append(separate);
+            }
+        }
+    }
+}
+
+bool SxPathMatcher::isPathIgnored(const QString &path, bool local) const
+{
+    QString relativePath;
+    if (local) {
+        QString absolutePath = QFileInfo(path).absoluteFilePath();
+        if (absolutePath == mRootPath)
+            return false;
+        if (!absolutePath.startsWith(mRootPath+"/"))
+            return true;
+        relativePath = absolutePath.mid(mRootPath.size());
+    }
+    else
+        relativePath = path;
+    if (_isPrefixIgnored(relativePath))
+        return true;
+    if (mWhitelist && !mHasPatterns)
+        return true;
+    if (_matchesPattern(relativePath))
+        return !mWhitelist;
+    return mWhitelist;
+}
+
+bool SxPathMatcher::_isPrefixIgnored(const QString &relativePath) const
+{
+    // a path is ignored when an ignored directory matches its leading components
+    const Node *node = &mRoot;
+    int start = 0;
+    forever {
+        int end = relativePath.indexOf('/', start);
+        if (end == -1)
+            end = relativePath.size();
+        const QString name = QString::fromRawData(relativePath.constData()+start, end-start);
+        node = node->children.value(name, nullptr);
+        if (node == nullptr)
+            return false;
+        if (node->ignored)
+            return true;
+        if (end == relativePath.size())
+            return false;
+        start = end+1;
+    }
+}
+
+bool SxPathMatcher::_matchesPattern(const QString &relativePath) const
+{
+    foreach (const QRegularExpression &regexp, mPatterns) {
+        if (regexp.match(relativePath).hasMatch())
+            return true;
+    }
+    if (mFallback.isEmpty())
+        return false;
+    QMutexLocker locker(&mFallbackMutex);
+    foreach (const QRegExp &regexp, mFallback) {
+        if (regexp.exactMatch(relativePath))
+            return true;
+    }
+    return false;
+}
+
+bool SxPathMatcher::_translatePattern(const QRegExp &regexp, QString &pattern)
+{
+    const QString source = regexp.pattern();
+    switch (regexp.patternSyntax()) {
+    case QRegExp::RegExp:
+    case QRegExp::RegExp2:
+        pattern = source;
+        return true;
+    case QRegExp::FixedString:
+        pattern = QRegularExpression::escape(source);
+        return true;
+    case QRegExp::Wildcard:
+    case QRegExp::WildcardUnix: {
+        // same translation as QRegExp does internally
+        const bool escaping = regexp.patternSyntax() == QRegExp::WildcardUnix;
+        pattern.clear();
+        int i = 0;
+        while (i < source.size()) {
+            const QChar c = source.at(i++);
+            switch (c.unicode()) {
+            case '\\':
+                if (escaping) {
+                    pattern += "\\";
+                    if (i < source.size())
+                        pattern += source.at(i++);
+                }
+                else
+                    pattern += "\\\\";
+                break;
+            case '*':
+                pattern += ".*";
+                break;
+            case '?':
+                pattern += ".";
+                break;
+            case '$':
+            case '(':
+            case ')':
+            case '+':
+            case '.':
+            case '^':
+            case '{':
+            case '|':
+            case '}':
+                pattern += "\\";
+                pattern += c;
+                break;
+            case '[':
+                pattern += c;
+                if (i < source.size() && source.at(i) == '^')
+                    pattern += source.at(i++);
+                if (i < source.size() && source.at(i) == ']')
+                    pattern += source.at(i++);
+                while (i < source.size() && source.at(i) != ']') {
+                    if (source.at(i) == '\\')
+                        pattern += "\\";
+                    pattern += source.at(i++);
+                }
+                break;
+            default:
+                pattern += c;
+            }
+        }
+        return true;
+    }
+    default:
+        return false;
+    }
+}
@@ -0,0 +1,73 @@
+/*
+ *  Copyright (C) 2012-2016 Skylable Ltd. <info-copyright@skylable.com>
+ *
+ *  This program is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public License
+ *  as published by the Free Software Foundation; either version 2
+ *  of the License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA.
+ *
+ *  Special exception for linking this software with OpenSSL:
+ *
+ *  In addition, as a special exception, Skylable Ltd. gives permission to
+ *  link the code of this program with the OpenSSL library and distribute
+ *  linked combinations including the two. You must obey the GNU General
+ *  Public License in all respects for all of the code used other than
+ *  OpenSSL. You may extend this exception to your version of the program,
+ *  but you are not obligated to do so. If you do not wish to do so, delete
+ *  this exception statement from your version.
+ */
+
+#ifndef SXPATHMATCHER_H
+#define SXPATHMATCHER_H
+
+#include <QHash>
+#include <QList>
+#include <QMutex>
+#include <QRegExp>
+#include <QRegularExpression>
+#include <QStringList>
+
+/*
+ * Selective sync rules of a volume compiled for matching: the ignored
+ * directories form a trie of path components and the patterns are merged
+ * into a single expression. The matcher never changes once built, so it
+ * is queried without locking.
+ */
+class SxPathMatcher
+{
+public:
+    SxPathMatcher(const QString &localPath, const QStringList &ignoredPaths, bool whitelist, const QList<QRegExp> &regexpList);
+    bool isPathIgnored(const QString &path, bool local) const;
+
+private:
+    Q_DISABLE_COPY(SxPathMatcher)
+    struct Node {
+        Node() : ignored(false) {}
+        ~Node() { qDeleteAll(children); }
+        bool ignored;
+        QHash<QString, Node*> children;
+    };
+    bool _isPrefixIgnored(const QString &relativePath) const;
+    bool _matchesPattern(const QString &relativePath) const;
+    static bool _translatePattern(const QRegExp &regexp, QString &pattern);
+
+    QString mRootPath;
+    Node mRoot;
+    bool mWhitelist;
+    bool mHasPatterns;
+    QList<QRegularExpression> mPatterns;
+    // patterns without an equivalent QRegularExpression, QRegExp keeps match state and is not shared between threads
+    QList<QRegExp> mFallback;
+    mutable QMutex mFallbackMutex;
+};
+
+#endif // SXPATHMATCHER_H
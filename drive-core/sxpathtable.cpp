@@ -0,0 +1,132 @@
+/*
+ *  Copyright (C) 2012-2016 Skylable Ltd. <info-copyright@skylable.com>
+ *
+ *  This program is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public License
+ *  as published by the Free Software Foundation; either version 2
+ *  of the License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA.
+ *
+ *  Special exception for linking this software with OpenSSL:
+ *
+ *  In addition, as a special exception, Skylable Ltd. gives permission to
+ *  link the code of this program with the OpenSSL library and distribute
+ *  linked combinations including the two. You must obey the GNU General
+ *  Public License in all respects for all of the code used other than
+ *  OpenSSL. You may extend this exception to your version of the program,
+ *  but you are not obligated to do so. If you do not wish to do so, delete
+ *  this exception statement from your version.
+ */
+
+#include "sxpathtable.h"
+#include <QStringList>
+
+SxPathTable &SxPathTable::instance()
+{
+    static SxPathTable sInstance;
+    return sInstance;
+}
+
+SxPathTable::SxPathTable()
+{
+    mVolumes.append(QString());
+    mNodes.append({0, QString()});
+}
+
+SxPathKey SxPathTable::intern(const QString &volume, const QString &path)
+{
+    SxPathKey key = find(volume, path);
+    if (!key.isNull())
+        return key;
+    QWriteLocker locker(&mLock);
+    key.volume = mVolumeIds.value(volume, 0);
+    if (key.volume == 0) {
+        key.volume = static_cast<quint32>(mVolumes.count());
+        mVolumes.append(volume);
+        mVolumeIds.insert(volume, key.volume);
+    }
+    // splitting keeps empty components, so joining them gives back the same path
+    quint32 node = 0;
+    foreach (const QString &name, path.split('/')) {
+        quint32 child = mChildren.value({node, name}, 0);
+        if (child == 0) {
+            child = static_cast<quint32>(mNodes.count());
+            mNodes.append({node, name});
+            mChildren.insert({node, name}, child);
+        }
+        node = child;
+    }
+    key.node = node;
+    return key;
+}
+
+SxPathKey SxPathTable::find(const QString &volume, const QString &path) const
+{
+    QReadLocker locker(&mLock);
+    SxPathKey key;
+    quint32 volumeId = mVolumeIds.value(volume, 0);
+    if (volumeId == 0)
+        return key;
+    quint32 node = 0;
+    foreach (const QString &name, path.split('/')) {
+        node = mChildren.value({node, name}, 0);
+        if (node == 0)
+            return key;
+    }
+    key.volume = volumeId;
+    key.node = node;
+    return key;
+}
+
+QString SxPathTable::volume(const SxPathKey &key) const
+{
+    QReadLocker locker(&mLock);
+    return mVolumes.value(static_cast<int>(key.volume));
+}
+
+QString SxPathTable::path(const SxPathKey &key) const
+{
+    QReadLocker locker(&mLock);
+    QStringList names;
+    for (quint32 node = key.node; node != 0; node = mNodes.at(static_cast<int>(node)).parent)
+        names.prepend(mNodes.at(static_cast<int>(node)).name);
+    return names.join('/');
+}
+
+quint32 SxPathTable::volumeId(const QString &volume) const
+{
+    QReadLocker locker(&mLock);
+    return mVolumeIds.value(volume, 0);
+}
+
+SxPathKey SxPathTable::parent(const SxPathKey &key) const
+{
+    SxPathKey parent;
+    if (key.isNull())
+        return parent;
+    QReadLocker locker(&mLock);
+    parent.node = mNodes.at(static_cast<int>(key.node)).parent;
+    if (parent.node != 0)
+        parent.volume = key.volume;
+    return parent;
+}
+
+bool SxPathTable::isBelow(const SxPathKey &key, const SxPathKey &dir) const
+{
+    if (key.volume != dir.volume || dir.isNull())
+        return false;
+    QReadLocker locker(&mLock);
+    for (quint32 node = mNodes.at(static_cast<int>(key.node)).parent; node != 0; node = mNodes.at(static_cast<int>(node)).parent) {
+        if (node == dir.node)
+            return true;
+    }
+    return false;
+}
@@ -0,0 +1,93 @@
+/*
+ *  Copyright (C) 2012-2016 Skylable Ltd. <info-copyright@skylable.com>
+ *
+ *  This program is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public License
+ *  as published by the Free Software Foundation; either version 2
+ *  of the License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA.
+ *
+ *  Special exception for linking this software with OpenSSL:
+ *
+ *  In addition, as a special exception, Skylable Ltd. gives permission to
+ *  link the code of this program with the OpenSSL library and distribute
+ *  linked combinations including the two. You must obey the GNU General
+ *  Public License in all respects for all of the code used other than
+ *  OpenSSL. You may extend this exception to your version of the program,
+ *  but you are not obligated to do so. If you do not wish to do so, delete
+ *  this exception statement from your version.
+ */
+
+#ifndef SXPATHTABLE_H
+#define SXPATHTABLE_H
+
+#include <QHash>
+#include <QPair>
+#include <QReadWriteLock>
+#include <QString>
+#include <QVector>
+
+/* Volume and path of a queued or indexed file, both interned in SxPathTable */
+struct SxPathKey
+{
+    SxPathKey() : volume(0), node(0) {}
+    quint32 volume;
+    quint32 node;
+    bool isNull() const { return node == 0; }
+    bool operator==(const SxPathKey &other) const { return volume == other.volume && node == other.node; }
+    bool operator!=(const SxPathKey &other) const { return !(*this == other); }
+};
+
+inline uint qHash(const SxPathKey &key, uint seed = 0)
+{
+    return qHash((static_cast<quint64>(key.volume) << 32) | key.node, seed);
+}
+
+/*
+ * Process wide table of the paths known to the queue and the file index.
+ * Every path is a chain of nodes holding one component each, so a directory
+ * shared by many files is stored once and keys are compared without
+ * touching the strings.
+ * Entries are never removed, the table only grows with the distinct paths seen.
+ */
+class SxPathTable
+{
+public:
+    static SxPathTable& instance();
+    SxPathTable(const SxPathTable &) = delete;
+    SxPathTable &operator= (const SxPathTable &) = delete;
+    SxPathKey intern(const QString &volume, const QString &path);
+    // returns a null key for paths which were never interned
+    SxPathKey find(const QString &volume, const QString &path) const;
+    QString volume(const SxPathKey &key) const;
+    QString path(const SxPathKey &key) const;
+    // returns 0 for volumes which were never interned
+    quint32 volumeId(const QString &volume) const;
+    // the directory holding key, a null key above the first component
+    SxPathKey parent(const SxPathKey &key) const;
+    // true when the path of key lies below the path of dir
+    bool isBelow(const SxPathKey &key, const SxPathKey &dir) const;
+
+private:
+    SxPathTable();
+    struct Node {
+        quint32 parent;
+        QString name;
+    };
+    mutable QReadWriteLock mLock;
+    QVector<QString> mVolumes;
+    QHash<QString, quint32> mVolumeIds;
+    // node 0 is the root, it is the parent of the first component
+    QVector<Node> mNodes;
+    QHash<QPair<quint32, QString>, quint32> mChildren;
+};
+
+#endif // SXPATHTABLE_H
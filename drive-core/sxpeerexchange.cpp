@@ -0,0 +1,295 @@
+/*
+ *  Copyright (C) 2012-2016 Skylable Ltd. <info-copyright@skylable.com>
+ *
+ *  This program is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public License
+ *  as published by the Free Software Foundation; either version 2
+ *  of the License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA.
+ *
+ *  Special exception for linking this software with OpenSSL:
+ *
+ *  In addition, as a special exception, Skylable Ltd. gives permission to
+ *  link the code of this program with the OpenSSL library and distribute
+ *  linked combinations including the two. You must obey the GNU General
+ *  Public License in all respects for all of the code used other than
+ *  OpenSSL. You may extend this exception to your version of the program,
+ *  but you are not obligated to do so. If you do not wish to do so, delete
+ *  this exception statement from your version.
+ */
+
+#include "sxpeerexchange.h"
+#include "sxblock.h"
+#include "sxconfig.h"
+#include "sxdatabase.h"
+#include "sxlog.h"
+
+#include <QCryptographicHash>
+#include <QDateTime>
+#include <QFile>
+#include <QTcpSocket>
+#include <QUuid>
+#include <algorithm>
+
+SxPeerExchange::SxPeerExchange(SxConfig *config, quint16 port)
+    : mPort(port), mInstanceId(QUuid::createUuid().toRfc4122().toHex().left(16))
+{
+    mConfig = config;
+    mUdpSocket = nullptr;
+    mServer = nullptr;
+    mAnnounceTimer = nullptr;
+}
+
+void SxPeerExchange::start()
+{
+    mUdpSocket = new QUdpSocket(this);
+    if (!mUdpSocket->bind(QHostAddress::AnyIPv4, mPort, QUdpSocket::ShareAddress | QUdpSocket::ReuseAddressHint)) {
+        logWarning(QString("peer exchange: unable to bind port %1: %2").arg(mPort).arg(mUdpSocket->errorString()));
+        stop();
+        return;
+    }
+    connect(mUdpSocket, &QUdpSocket::readyRead, this, &SxPeerExchange::onDatagram);
+    mServer = new QTcpServer(this);
+    if (!mServer->listen(QHostAddress::AnyIPv4, mPort)) {
+        logWarning(QString("peer exchange: unable to listen on port %1: %2").arg(mPort).arg(mServer->errorString()));
+        stop();
+        return;
+    }
+    connect(mServer, &QTcpServer::newConnection, this, &SxPeerExchange::onNewConnection);
+    mAnnounceTimer = new QTimer(this);
+    mAnnounceTimer->setInterval(sAnnounceInterval);
+    connect(mAnnounceTimer, &QTimer::timeout, this, &SxPeerExchange::announce);
+    mAnnounceTimer->start();
+    announce();
+    logInfo(QString("peer exchange listening on port %1").arg(mPort));
+}
+
+void SxPeerExchange::stop()
+{
+    delete mAnnounceTimer;
+    mAnnounceTimer = nullptr;
+    delete mServer;
+    mServer = nullptr;
+    delete mUdpSocket;
+    mUdpSocket = nullptr;
+    QMutexLocker locker(&mMutex);
+    mPeers.clear();
+}
+
+/* peers of other clusters on the same network ignore each other */
+QByteArray SxPeerExchange::_clusterTag() const
+{
+    QByteArray uuid = mConfig->clusterConfig().uuid();
+    if (uuid.isEmpty())
+        return QByteArray();
+    return QCryptographicHash::hash("sxpeer:" + uuid, QCryptographicHash::Sha1).toHex().left(16);
+}
+
+void SxPeerExchange::announce()
+{
+    QByteArray tag = _clusterTag();
+    if (tag.isEmpty() || !mUdpSocket)
+        return;
+    QByteArray datagram = "SXPEER 1 " + tag + " " + mInstanceId + " " + QByteArray::number(mPort);
+    mUdpSocket->writeDatagram(datagram, QHostAddress::Broadcast, mPort);
+}
+
+void SxPeerExchange::onDatagram()
+{
+    QByteArray tag = _clusterTag();
+    while (mUdpSocket->hasPendingDatagrams()) {
+        QByteArray datagram(static_cast<int>(qMax<qint64>(0, mUdpSocket->pendingDatagramSize())), '\0');
+        QHostAddress sender;
+        if (mUdpSocket->readDatagram(datagram.data(), datagram.size(), &sender) < 0)
+            continue;
+        QList<QByteArray> parts = datagram.split(' ');
+        if (parts.count() != 5 || parts.at(0) != "SXPEER" || parts.at(1) != "1" || parts.at(2) != tag || parts.at(3) == mInstanceId)
+            continue;
+        bool ok;
+        quint16 port = parts.at(4).toUShort(&ok);
+        if (!ok || port == 0)
+            continue;
+        QMutexLocker locker(&mMutex);
+        if (!mPeers.contains(sender.toString()))
+            logVerbose(QString("peer exchange: found peer %1:%2").arg(sender.toString()).arg(port));
+        mPeers.insert(sender.toString(), {port, QDateTime::currentMSecsSinceEpoch()});
+    }
+}
+
+QList<QPair<QHostAddress, quint16>> SxPeerExchange::_peers()
+{
+    QMutexLocker locker(&mMutex);
+    qint64 now = QDateTime::currentMSecsSinceEpoch();
+    QList<QPair<qint64, QString>> order;
+    for (auto it = mPeers.begin(); it != mPeers.end(); ) {
+        if (now - it.value().lastSeen > sPeerTimeout) {
+            it = mPeers.erase(it);
+            continue;
+        }
+        order.append({-it.value().lastSeen, it.key()});
+        ++it;
+    }
+    std::sort(order.begin(), order.end());
+    QList<QPair<QHostAddress, quint16>> result;
+    foreach (auto pair, order) {
+        if (result.count() >= sMaxPeersPerFetch)
+            break;
+        result.append({QHostAddress(pair.second), mPeers.value(pair.second).port});
+    }
+    return result;
+}
+
+static int hashesPerRequest(int blockSize)
+{
+    static const int sBatchBytes = 16*1024*1024;
+    return qBound(1, sBatchBytes / blockSize, 64);
+}
+
+void SxPeerExchange::onNewConnection()
+{
+    while (mServer->hasPendingConnections()) {
+        QTcpSocket *socket = mServer->nextPendingConnection();
+        connect(socket, &QTcpSocket::disconnected, socket, &QTcpSocket::deleteLater);
+        connect(socket, &QTcpSocket::readyRead, this, [this, socket]() {
+            _serve(socket);
+        });
+    }
+}
+
+/* request: GET <cluster tag> <block size> <hash>,<hash>,...\n
+ * reply, for every hash in order: '1' followed by the block, or '0' */
+void SxPeerExchange::_serve(QTcpSocket *socket)
+{
+    QByteArray request = socket->peek(sRequestSizeLimit);
+    int end = request.indexOf('\n');
+    if (end < 0) {
+        if (request.size() >= sRequestSizeLimit)
+            socket->abort();
+        return;
+    }
+    socket->read(end+1);
+    disconnect(socket, &QTcpSocket::readyRead, this, 0);
+    QList<QByteArray> parts = request.left(end).split(' ');
+    bool ok = false;
+    int blockSize = parts.count() == 4 ? parts.at(2).toInt(&ok) : 0;
+    if (!ok || parts.at(0) != "GET" || parts.at(1) != _clusterTag() || blockSize <= 0 || blockSize > 64*1024*1024) {
+        socket->abort();
+        return;
+    }
+    QStringList hashes = QString::fromLatin1(parts.at(3)).split(',');
+    if (hashes.count() > hashesPerRequest(blockSize)) {
+        socket->abort();
+        return;
+    }
+    QHash<QString, QList<std::tuple<QString, QString, qint64> > > hits;
+    if (!SxDatabase::instance().findBlocks(hashes, blockSize, hits))
+        hits.clear();
+    const QByteArray salt = mConfig->clusterConfig().uuid();
+    QByteArray data;
+    int served = 0;
+    foreach (const QString &hash, hashes) {
+        bool found = false;
+        foreach (auto hit, hits.value(hash)) {
+            QString volume = std::get<0>(hit);
+            if (!mConfig->volumes().contains(volume))
+                continue;
+            QString volumeRoot = mConfig->volume(volume).localPath();
+            if (volumeRoot.isEmpty())
+                continue;
+            QFile file(volumeRoot + std::get<1>(hit));
+            if (!file.open(QIODevice::ReadOnly) || !file.seek(std::get<2>(hit)))
+                continue;
+            data = file.read(blockSize);
+            if (data.isEmpty())
+                continue;
+            if (data.size() < blockSize)
+                data.append(QByteArray(blockSize - data.size(), '\0'));
+            // the file may have changed since it was indexed
+            if (QString::fromUtf8(SxBlock::hashBlock(data, salt)) != hash)
+                continue;
+            found = true;
+            break;
+        }
+        if (found) {
+            socket->write("1");
+            socket->write(data);
+            ++served;
+        }
+        else
+            socket->write("0");
+    }
+    if (served)
+        logVerbose(QString("peer exchange: served %1 of %2 blocks to %3").arg(served).arg(hashes.count()).arg(socket->peerAddress().toString()));
+    socket->disconnectFromHost();
+}
+
+static bool readExact(QTcpSocket &socket, int size, QByteArray &data, int timeout)
+{
+    data.clear();
+    while (data.size() < size) {
+        if (socket.bytesAvailable() == 0 && !socket.waitForReadyRead(timeout))
+            return false;
+        data.append(socket.read(size - data.size()));
+    }
+    return true;
+}
+
+/* asks the peers seen most recently for the blocks, called from the queue thread;
+ * store gets every verified block and returns false if it couldn't be used */
+bool SxPeerExchange::fetchBlocks(int blockSize, const QStringList &hashes, std::function<bool(const QString &, const QByteArray &)> store)
+{
+    const QByteArray tag = _clusterTag();
+    const QByteArray salt = mConfig->clusterConfig().uuid();
+    if (tag.isEmpty() || blockSize <= 0 || hashes.isEmpty())
+        return false;
+    const int batchSize = hashesPerRequest(blockSize);
+    QStringList remaining = hashes;
+    int received = 0;
+    QByteArray status, data;
+    foreach (auto peer, _peers()) {
+        if (remaining.isEmpty())
+            break;
+        QStringList failed;
+        for (int i=0; i<remaining.count(); i+=batchSize) {
+            QStringList batch = remaining.mid(i, batchSize);
+            QTcpSocket socket;
+            socket.connectToHost(peer.first, peer.second);
+            if (!socket.waitForConnected(sConnectTimeout)) {
+                failed += remaining.mid(i);
+                break;
+            }
+            socket.write("GET " + tag + " " + QByteArray::number(blockSize) + " " + batch.join(",").toLatin1() + "\n");
+            bool connectionOk = true;
+            foreach (const QString &hash, batch) {
+                if (connectionOk && !readExact(socket, 1, status, sReadTimeout))
+                    connectionOk = false;
+                if (!connectionOk || status != "1") {
+                    failed.append(hash);
+                    continue;
+                }
+                if (!readExact(socket, blockSize, data, sReadTimeout)) {
+                    connectionOk = false;
+                    failed.append(hash);
+                    continue;
+                }
+                if (QString::fromUtf8(SxBlock::hashBlock(data, salt)) != hash || !store(hash, data)) {
+                    failed.append(hash);
+                    continue;
+                }
+                ++received;
+            }
+        }
+        remaining = failed;
+    }
+    if (received)
+        logVerbose(QString("peer exchange: received %1 of %2 blocks").arg(received).arg(hashes.count()));
+    return received > 0;
+}
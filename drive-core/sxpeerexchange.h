@@ -0,0 +1,93 @@
+/*
+ *  Copyright (C) 2012-2016 Skylable Ltd. <info-copyright@skylable.com>
+ *
+ *  This program is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public License
+ *  as published by the Free Software Foundation; either version 2
+ *  of the License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA.
+ *
+ *  Special exception for linking this software with OpenSSL:
+ *
+ *  In addition, as a special exception, Skylable Ltd. gives permission to
+ *  link the code of this program with the OpenSSL library and distribute
+ *  linked combinations including the two. You must obey the GNU General
+ *  Public License in all respects for all of the code used other than
+ *  OpenSSL. You may extend this exception to your version of the program,
+ *  but you are not obligated to do so. If you do not wish to do so, delete
+ *  this exception statement from your version.
+ */
+
+#ifndef SXPEEREXCHANGE_H
+#define SXPEEREXCHANGE_H
+
+#include <QObject>
+#include <QHash>
+#include <QHostAddress>
+#include <QMutex>
+#include <QStringList>
+#include <QTcpServer>
+#include <QTimer>
+#include <QUdpSocket>
+#include <functional>
+
+class QTcpSocket;
+class SxConfig;
+
+/* Opt-in exchange of blocks between clients of the same cluster on the local network.
+ * Clients announce themselves with UDP broadcasts and serve the blocks of their
+ * synchronised files over TCP, looked up in the sxBlocks index. Every block is
+ * verified against its salted hash by the receiver, knowing the hashes of a file
+ * (which takes access to the file on the cluster) is what allows to fetch it */
+class SxPeerExchange : public QObject
+{
+    Q_OBJECT
+public:
+    SxPeerExchange(SxConfig *config, quint16 port);
+    bool fetchBlocks(int blockSize, const QStringList &hashes, std::function<bool(const QString &, const QByteArray &)> store);
+
+public slots:
+    void start();
+    void stop();
+
+private slots:
+    void onDatagram();
+    void onNewConnection();
+    void announce();
+
+private:
+    struct Peer {
+        quint16 port;
+        qint64 lastSeen;
+    };
+    QByteArray _clusterTag() const;
+    void _serve(QTcpSocket *socket);
+    bool _readLocalBlock(int blockSize, const QString &hash, QByteArray &data);
+    QList<QPair<QHostAddress, quint16>> _peers();
+
+    SxConfig *mConfig;
+    const quint16 mPort;
+    const QByteArray mInstanceId;
+    QUdpSocket *mUdpSocket;
+    QTcpServer *mServer;
+    QTimer *mAnnounceTimer;
+    QMutex mMutex;
+    QHash<QString, Peer> mPeers;
+
+    static const int sAnnounceInterval = 30*1000;
+    static const qint64 sPeerTimeout = 2*60*1000;
+    static const int sConnectTimeout = 300;
+    static const int sReadTimeout = 5000;
+    static const int sMaxPeersPerFetch = 4;
+    static const int sRequestSizeLimit = 64*1024;
+};
+
+#endif // SXPEEREXCHANGE_H
@@ -0,0 +1,142 @@
+/*
+ *  Copyright (C) 2012-2016 Skylable Ltd. <info-copyright@skylable.com>
+ *
+ *  This program is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public License
+ *  as published by the Free Software Foundation; either version 2
+ *  of the License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA.
+ *
+ *  Special exception for linking this software with OpenSSL:
+ *
+ *  In addition, as a special exception, Skylable Ltd. gives permission to
+ *  link the code of this program with the OpenSSL library and distribute
+ *  linked combinations including the two. You must obey the GNU General
+ *  Public License in all respects for all of the code used other than
+ *  OpenSSL. You may extend this exception to your version of the program,
+ *  but you are not obligated to do so. If you do not wish to do so, delete
+ *  this exception statement from your version.
+ */
+
+#include "sxprogressaggregator.h"
+
+#include <QTimer>
+
+SxProgressAggregator::SxProgressAggregator(QObject *parent) : QObject(parent)
+{
+    mRequested = false;
+    mTimerActive = false;
+    mHasAction = false;
+    mHasCounters = false;
+    mHasProgress = false;
+    mAction = EtaAction::Idle;
+    mTaskCounter = 0;
+    mActionSize = 0;
+    mActionSpeed = 0;
+    mUpload = 0;
+    mUploadSize = 0;
+    mDownload = 0;
+    mDownloadSize = 0;
+    mRemove = 0;
+    mProgressSize = 0;
+    mProgressSpeed = 0;
+}
+
+void SxProgressAggregator::setEtaAction(EtaAction action, qint64 taskCounter, QString file, qint64 size, qint64 speed)
+{
+    QMutexLocker locker(&mMutex);
+    mHasAction = true;
+    mAction = action;
+    mTaskCounter = taskCounter;
+    mFile = file;
+    mActionSize = size;
+    mActionSpeed = speed;
+    // progress reported for the previous action is stale now
+    mHasProgress = false;
+    _requestDelivery();
+}
+
+void SxProgressAggregator::setEtaCounters(uint upload, qint64 uploadSize, uint download, qint64 downloadSize, uint remove)
+{
+    QMutexLocker locker(&mMutex);
+    mHasCounters = true;
+    mUpload = upload;
+    mUploadSize = uploadSize;
+    mDownload = download;
+    mDownloadSize = downloadSize;
+    mRemove = remove;
+    _requestDelivery();
+}
+
+void SxProgressAggregator::setProgress(qint64 size, qint64 speed)
+{
+    QMutexLocker locker(&mMutex);
+    mHasProgress = true;
+    mProgressSize = size;
+    mProgressSpeed = speed;
+    _requestDelivery();
+}
+
+void SxProgressAggregator::_requestDelivery()
+{
+    // mMutex held, at most one queued call is pending at any time
+    if (mRequested)
+        return;
+    mRequested = true;
+    QMetaObject::invokeMethod(this, "_scheduleDelivery", Qt::QueuedConnection);
+}
+
+void SxProgressAggregator::_scheduleDelivery()
+{
+    if (mTimerActive)
+        return;
+    qint64 elapsed = mLastDelivery.isValid() ? mLastDelivery.elapsed() : sDeliveryInterval;
+    if (elapsed >= sDeliveryInterval) {
+        _deliver();
+        return;
+    }
+    mTimerActive = true;
+    QTimer::singleShot(static_cast<int>(sDeliveryInterval - elapsed), this, SLOT(_deliver()));
+}
+
+void SxProgressAggregator::_deliver()
+{
+    mTimerActive = false;
+    mLastDelivery.start();
+    mMutex.lock();
+    mRequested = false;
+    bool hasAction = mHasAction;
+    bool hasCounters = mHasCounters;
+    bool hasProgress = mHasProgress;
+    EtaAction action = mAction;
+    qint64 taskCounter = mTaskCounter;
+    QString file = mFile;
+    qint64 actionSize = mActionSize;
+    qint64 actionSpeed = mActionSpeed;
+    uint upload = mUpload;
+    qint64 uploadSize = mUploadSize;
+    uint download = mDownload;
+    qint64 downloadSize = mDownloadSize;
+    uint remove = mRemove;
+    qint64 progressSize = mProgressSize;
+    qint64 progressSpeed = mProgressSpeed;
+    mHasAction = false;
+    mHasCounters = false;
+    mHasProgress = false;
+    mMutex.unlock();
+
+    if (hasAction)
+        emit sig_setEtaAction(action, taskCounter, file, actionSize, actionSpeed);
+    if (hasCounters)
+        emit sig_setEtaCounters(upload, uploadSize, download, downloadSize, remove);
+    if (hasProgress)
+        emit sig_setProgress(progressSize, progressSpeed);
+}
@@ -0,0 +1,89 @@
+/*
+ *  Copyright (C) 2012-2016 Skylable Ltd. <info-copyright@skylable.com>
+ *
+ *  This program is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public License
+ *  as published by the Free Software Foundation; either version 2
+ *  of the License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA.
+ *
+ *  Special exception for linking this software with OpenSSL:
+ *
+ *  In addition, as a special exception, Skylable Ltd. gives permission to
+ *  link the code of this program with the OpenSSL library and distribute
+ *  linked combinations including the two. You must obey the GNU General
+ *  Public License in all respects for all of the code used other than
+ *  OpenSSL. You may extend this exception to your version of the program,
+ *  but you are not obligated to do so. If you do not wish to do so, delete
+ *  this exception statement from your version.
+ */
+
+#ifndef SXPROGRESSAGGREGATOR_H
+#define SXPROGRESSAGGREGATOR_H
+
+#include "sxqueue.h"
+
+#include <QObject>
+#include <QMutex>
+#include <QElapsedTimer>
+
+/* Collects eta and progress updates from the sync threads and hands them to
+ * the GUI thread at most once per sDeliveryInterval, only the latest value of
+ * each kind is delivered. The set* slots are thread safe and are meant to be
+ * connected with Qt::DirectConnection */
+class SxProgressAggregator : public QObject
+{
+    Q_OBJECT
+public:
+    explicit SxProgressAggregator(QObject *parent = nullptr);
+
+public slots:
+    void setEtaAction(EtaAction action, qint64 taskCounter, QString file, qint64 size, qint64 speed);
+    void setEtaCounters(uint upload, qint64 uploadSize, uint download, qint64 downloadSize, uint remove);
+    void setProgress(qint64 size, qint64 speed);
+
+signals:
+    void sig_setEtaAction(EtaAction action, qint64 taskCounter, QString file, qint64 size, qint64 speed);
+    void sig_setEtaCounters(uint upload, qint64 uploadSize, uint download, qint64 downloadSize, uint remove);
+    void sig_setProgress(qint64 size, qint64 speed);
+
+private slots:
+    void _scheduleDelivery();
+    void _deliver();
+
+private:
+    void _requestDelivery();
+    static const int sDeliveryInterval = 200;
+    QMutex mMutex;
+    bool mRequested;
+    bool mTimerActive;
+    QElapsedTimer mLastDelivery;
+
+    bool mHasAction;
+    EtaAction mAction;
+    qint64 mTaskCounter;
+    QString mFile;
+    qint64 mActionSize;
+    qint64 mActionSpeed;
+
+    bool mHasCounters;
+    uint mUpload;
+    qint64 mUploadSize;
+    uint mDownload;
+    qint64 mDownloadSize;
+    uint mRemove;
+
+    bool mHasProgress;
+    qint64 mProgressSize;
+    qint64 mProgressSpeed;
+};
+
+#endif // SXPROGRESSAGGREGATOR_H
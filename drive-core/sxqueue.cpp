@@ -26,21 +26,63 @@
  *  this exception statement from your version.
  */
 
+#include <QCryptographicHash>
 #include <QMutexLocker>
 #include <QThread>
+#include <QtConcurrent>
+#include <algorithm>
 
 #include "sxdatabase.h"
+#include "sxblock.h"
+#include "sxbufferpool.h"
+#include "sxblockreuse.h"
+#include "sxpathtable.h"
+#include "sxpeerexchange.h"
+#include "xfile.h"
 #include "sxfilesystem.h"
+#include "sxgovernor.h"
 #include "sxqueue.h"
 #include "sxlog.h"
 #include "sxauth.h"
 #include "sxcluster.h"
+#include "sxfilter.h"
 #include "sxlog.h"
+#include "sxtransferlane.h"
+#include "sxtrace.h"
+#include "sxmetrics.h"
+#include "sxprofiler.h"
+#include "sxsyncstatus.h"
+#include "sxsyncblocks.h"
+#include "sxsyncrecorder.h"
 
 quint64 SxQueue::Task::sCounter = 0;
-QSet<quint64> SxQueue::Task::sLivingTasks;
 
-#define _reportError(task, errorMessage) logWarning(QString("Task ID %1: %2").arg(task->id()).arg(errorMessage))
+// the order the marked files of a volume are queued in, uploads first
+static const SxDatabase::ACTION sAdmitOrder[] = {SxDatabase::ACTION::UPLOAD, SxDatabase::ACTION::REMOVE_REMOTE, SxDatabase::ACTION::DOWNLOAD, SxDatabase::ACTION::REMOVE_LOCAL};
+
+/* digest of the entries of a remote listing, which comes in a stable order */
+static void addToListingDigest(QCryptographicHash &hash, const QList<SxFileEntry*> &list)
+{
+    foreach (const SxFileEntry *entry, list) {
+        hash.addData(entry->path().toUtf8());
+        hash.addData("\0", 1);
+        hash.addData(entry->revision().toUtf8());
+        hash.addData(QByteArray::number(entry->size()));
+        hash.addData("\n", 1);
+    }
+}
+
+/* exponential backoff in milliseconds for the given attempt, randomised over its upper half
+ * so the retries of tasks failed together don't come back together */
+static qint64 backoffDelay(int base, int max, int attempt)
+{
+    qint64 delay = static_cast<qint64>(max)*1000;
+    if (attempt < 30)
+        delay = qMin(delay, (static_cast<qint64>(base)*1000) << attempt);
+    return delay/2 + static_cast<qint64>(qrand()) % (delay/2+1);
+}
+
+#define _reportError(task, errorMessage) (SxMetrics::instance().addTaskError(), logWarning(QString("Task ID %1: %2").arg(task->id()).arg(errorMessage)))
 
 SxQueue::SxQueue(SxConfig *config, std::function<bool(QSslCertificate&,bool)> checkSslCallback, std::function<bool(QString)> askGuiCallback)
 {
@@ -48,11 +90,28 @@ SxQueue::SxQueue(SxConfig *config, std::function<bool(QSslCertificate&,bool)> ch
     Q_UNUSED(registerEtaAction);
     logEntry("");
     mPaused = false;
-    mAborted = false;
     mConfig = config;
     mCluster = nullptr;
     mCurrentTask = nullptr;
+    mPreempting = false;
+    mLargeTransferLane = nullptr;
+    mPeerExchange = nullptr;
     mQueueIsWorking = false;
+    mTasksSinceBackgroundScan = 0;
+    mAsyncConsistencyChecks = 0;
+    mNetworkFailures = 0;
+    mOffline = false;
+    mProbeAttempts = 0;
+    mHeavyWorkDeferredSince = 0;
+    mLastMaintenance = 0;
+    mLastCensusLog = 0;
+    mVacuumPending = false;
+    mMaintenanceTimer = new QTimer(this);
+    mMaintenanceTimer->setSingleShot(true);
+    connect(mMaintenanceTimer, &QTimer::timeout, this, &SxQueue::runDatabaseMaintenance);
+    mPreparePool.setMaxThreadCount(1);
+    mSpeculationPool.setMaxThreadCount(1);
+    mSpeculationCounter = 0;
     mCheckSslCallback = checkSslCallback;
     mAskGuiCallback = askGuiCallback;
     connect(this, &SxQueue::sig_start_task, this, &SxQueue::startCurrentTask, Qt::QueuedConnection);
@@ -75,10 +134,20 @@ SxQueue::SxQueue(SxConfig *config, std::function<bool(QSslCertificate&,bool)> ch
         SxDatabase::instance().removeSuppression(volName, path);
     };
     connect(&SxDatabase::instance(), &SxDatabase::sig_possibleInconsistencyDetected, this, &SxQueue::onPossibleInconsistency);
+    // a file that failed to sync is shown as pending until it is retried
+    connect(this, &SxQueue::sig_addWarning, [](const QString &volume, const QString &file, const QString &, bool) {
+        if (!file.isEmpty())
+            SxSyncStatus::instance().setPending(volume, file);
+    });
 }
 
 SxQueue::~SxQueue()
 {
+    mPrepareToken.cancel();
+    mPreparePool.waitForDone();
+    mSpeculationPool.waitForDone();
+    if (mLargeTransferLane)
+        delete mLargeTransferLane;
     if (mCurrentTask)
         delete mCurrentTask;
     clear();
@@ -102,6 +171,7 @@ void SxQueue::addTask(SxQueue::Task *task)
             emit sig_removeWarning(task->volume(), task->path());
             if (mPendingUploads.contains(task->volume()))
                 mPendingUploads.value(task->volume())->removeTask(task->path());
+            _preemptCurrentTask(task);
         }
     }
     emit sig_start_task();
@@ -113,11 +183,42 @@ void SxQueue::clear()
     QMutexLocker locker(&mMutex);
     mEtaCounters.clear();
     emit sig_setEtaCounters(0, 0, 0, 0, 0);
+    mListingDigests.clear();
+    mListIntervals.clear();
+    {
+        QMutexLocker preparedLocker(&mPreparedMutex);
+        mPreparedUploads.clear();
+        foreach (const SpeculativeHash &hash, mSpeculativeHashes) {
+            hash.token.cancel();
+        }
+        mSpeculativeHashes.clear();
+    }
+    mRemoteCounts.clear();
     mTaskByPath.clear();
-    foreach (Task *task, mTaskList) {
+    // the saved marks stay checkpointed, the next initial scan resumes them if nothing changed
+    mPendingAdmissions.clear();
+    mBackgroundScans.clear();
+    foreach (auto deviceScan, mDeviceScans) {
+        QMutexLocker scanLocker(&deviceScan->mutex);
+        deviceScan->cancelled = true;
+    }
+    mDeviceScans.clear();
+    mPendingConsistencyChecks.clear();
+    foreach (const SxCancelToken &token, mConsistencyTokens)
+        token.cancel();
+    mConsistencyTokens.clear();
+    SxSyncStatus::instance().clear();
+    foreach (Task *task, mTaskList.tasks()) {
         delete task;
     }
     mTaskList.clear();
+    foreach (Task *task, mRetryTasks) {
+        delete task;
+    }
+    mRetryTasks.clear();
+    mNetworkFailures = 0;
+    mOffline = false;
+    mProbeAttempts = 0;
     emit sig_delete_timers();
     if (mCluster != nullptr) {
         mCluster->clearUploadJobs();
@@ -128,13 +229,37 @@ void SxQueue::clear(const QString &volume)
 {
     logEntry(volume);
     QMutexLocker locker(&mMutex);
-    foreach (Task *task, mTaskList) {
+    mListingDigests.remove(volume);
+    mRemoteCounts.remove(volume);
+    mListIntervals.remove(volume);
+    mBackgroundScans.removeAll(volume);
+    mDeviceScans.remove(volume);
+    mPendingConsistencyChecks.remove(volume);
+    mConsistencyTokens.take(volume).cancel();
+    for (auto it = mPendingAdmissions.begin(); it != mPendingAdmissions.end(); ) {
+        if (it->volume == volume) {
+            SxDatabase::instance().discardMarkedFiles(it->generation);
+            it = mPendingAdmissions.erase(it);
+        }
+        else
+            ++it;
+    }
+    SxSyncStatus::instance().clear(volume);
+    foreach (Task *task, mTaskList.tasks()) {
         if (task->volume() == volume) {
-            mTaskList.removeOne(task);
-            mTaskByPath.remove(task->volume()+"/"+task->path());
+            mTaskList.remove(task);
+            mTaskByPath.remove(task->key());
             delete task;
         }
     }
+    for (auto it = mRetryTasks.begin(); it != mRetryTasks.end(); ) {
+        if (it.value()->volume() == volume) {
+            delete it.value();
+            it = mRetryTasks.erase(it);
+        }
+        else
+            ++it;
+    }
 }
 
 void SxQueue::requestInitialScan()
@@ -153,11 +278,25 @@ void SxQueue::requestInitialScan()
         _instertPriorityTask(listVolumesTask);
 
         emit sig_removeWarning("", "");
-        foreach (QString volume, mConfig->volumes()) {
-            mPendingUploads.insert(volume, new UploadQueue());
-            Task *task = new Task(TaskType::VolumeInitialScan, volume, "", 99, 0);
-            addTask(task);
+        // the most recently active volume is scanned first, the others are
+        // scanned one at a time in between the tasks of the watchers
+        QStringList volumes = mConfig->volumes();
+        QHash<QString, qint64> lastEvents;
+        SxDatabase::instance().getVolumesActivity(lastEvents);
+        std::stable_sort(volumes.begin(), volumes.end(), [&lastEvents](const QString &a, const QString &b) {
+            return lastEvents.value(a, 0) > lastEvents.value(b, 0);
+        });
+        QMutexLocker locker(&mMutex);
+        mBackgroundScans.clear();
+        foreach (QString volume, volumes) {
+            if (!mPendingUploads.contains(volume))
+                mPendingUploads.insert(volume, new UploadQueue());
+            if (volume != volumes.first())
+                mBackgroundScans.append(volume);
         }
+        locker.unlock();
+        Task *task = new Task(TaskType::VolumeInitialScan, volumes.first(), "", 99, 0);
+        addTask(task);
         QTimer *timer = new QTimer(this);
         timer->setSingleShot(true);
         mTimers.insert(timer);
@@ -166,10 +305,24 @@ void SxQueue::requestInitialScan()
             timer->deleteLater();
             this->requestInitialScan();
         });
-        timer->start(sTimeoutFullScan*1000);
+        timer->start(sTimeoutFullScan*1000*SxGovernor::instance().policy().timerScale);
     }
 }
 
+void SxQueue::scanChangedDirs(const QString &volume)
+{
+    if (!mConfig->volumes().contains(volume))
+        return;
+    logVerbose("SCAN CHANGED DIRECTORIES OF "+volume);
+    // lost filesystem events are recovered by listing only the directories changed since the last scan
+    mFullyScannedVolumes.remove(volume);
+    mMutex.lock();
+    mBackgroundScans.removeAll(volume);
+    mMutex.unlock();
+    Task *task = new Task(TaskType::VolumeInitialScan, volume, "", 99, 0);
+    addTask(task);
+}
+
 void SxQueue::requestRemoteList(const QString &volume)
 {
     logEntry(volume);
@@ -203,19 +356,30 @@ bool SxQueue::paused()
     return mPaused;
 }
 
+void SxQueue::setPeerExchange(SxPeerExchange *peerExchange)
+{
+    mPeerExchange = peerExchange;
+}
+
 bool SxQueue::abortCurrentTask()
 {
     QMutexLocker locker(&mMutex);
+    bool result = false;
+    if (mLargeTransferLane != nullptr && mLargeTransferLane->busy()) {
+        mLargeTransferLane->abort();
+        result = true;
+    }
     if (mCurrentTask != nullptr) {
-        mAborted = true;
+        mTaskToken.cancel();
         emit sig_abort_task();
         return true;
     }
-    return false;
+    return result;
 }
 
 void SxQueue::localFileModified(QString volume, QString path, bool removed, qint64 size)
 {
+    SxSyncRecorder::instance().fileChanged(volume, path, removed, size);
     if (removed)
         SxDatabase::instance().removeFileBlocks(volume, path);
     if (mPaused)
@@ -225,23 +389,50 @@ void SxQueue::localFileModified(QString volume, QString path, bool removed, qint
     if (ignoredFiles.contains(path.split("/").last()))
         return;
 
-
+    mMutex.lock();
+    // the user is working in this volume, scan it before the other ones
+    if (mBackgroundScans.removeAll(volume))
+        mBackgroundScans.prepend(volume);
+    mMutex.unlock();
+    _resetListInterval(volume);
 
     Task *task = new Task(removed ? TaskType::RemoveRemoteFile : TaskType::UploadFile, volume, path, 0, size);
     addTask(task);
 }
 
+void SxQueue::localFilesModified(const QList<SxFileChange> &changes)
+{
+    foreach (const SxFileChange &change, changes) {
+        if (change.source.isEmpty())
+            localFileModified(change.volume, change.path, change.removed, change.size);
+        else
+            localFileMoved(change.volume, change.source, change.path);
+    }
+}
+
+void SxQueue::localFileMoved(const QString &volume, const QString &source, const QString &destination)
+{
+    SxSyncRecorder::instance().fileMoved(volume, source, destination);
+    if (mPaused)
+        return;
+    cancelUploadTask(volume, source);
+    Task *task = new Task(TaskType::MoveRemoteFile, volume, destination, 0, 0);
+    task->setSource(source);
+    addTask(task);
+}
+
 void SxQueue::cancelUploadTask(const QString &volume, const QString &path)
 {
+    SxSyncStatus::instance().remove(volume, path);
     if (mPendingUploads.contains(volume)) {
         mPendingUploads.value(volume)->removeTask(path);
         return;
     }
-    QString taskPath = volume + "/" +path;
+    SxPathKey taskPath = SxPathTable::instance().find(volume, path);
     QMutexLocker locker(&mMutex);
-    if (mTaskByPath.contains(taskPath)) {
+    if (!taskPath.isNull() && mTaskByPath.contains(taskPath)) {
         auto task = mTaskByPath.take(taskPath);
-        mTaskList.removeOne(task);
+        mTaskList.remove(task);
     }
 }
 
@@ -249,6 +440,7 @@ void SxQueue::unlockVolume(const QString &volume)
 {
     if (mLockedVolumes.contains(volume)) {
         mLockedVolumes.remove(volume);
+        SxFilter::dropCachedContexts(volume);
         Task *task = new Task(TaskType::VolumeInitialScan, volume, "", 99, 0);
         addTask(task);
     }
@@ -256,8 +448,54 @@ void SxQueue::unlockVolume(const QString &volume)
 
 void SxQueue::onPossibleInconsistency(const QString &volume, const QString &path)
 {
-    Task *task = new Task(TaskType::CheckFileConsistency, volume, path, 95, 0);
-    addTask(task);
+    // collected per volume and checked in batches between regular tasks
+    QMutexLocker locker(&mMutex);
+    if (mLockedVolumes.contains(volume))
+        return;
+    mPendingConsistencyChecks[volume].insert(path);
+    emit sig_start_task();
+}
+
+/* moves the queued tasks of paths the user is waiting for to the front, a path ending
+ * with a slash stands for everything below it; the first path ends up first */
+void SxQueue::boostPaths(const QString &volume, const QStringList &paths)
+{
+    QMutexLocker locker(&mMutex);
+    int boosted = 0;
+    QList<SxPathKey> prefixes;
+    for (int i=paths.count()-1; i>=0; i--) {
+        const QString &path = paths.at(i);
+        if (path.endsWith('/')) {
+            SxPathKey dir = SxPathTable::instance().find(volume, path.left(path.length()-1));
+            if (!dir.isNull())
+                prefixes.append(dir);
+            continue;
+        }
+        Task *task = mTaskByPath.value(SxPathTable::instance().find(volume, path), nullptr);
+        if (task != nullptr && !task->boosted()) {
+            mTaskList.boost(task);
+            boosted++;
+        }
+    }
+    if (!prefixes.isEmpty()) {
+        for (auto it = mTaskByPath.constBegin(); it != mTaskByPath.constEnd(); ++it) {
+            if (it.value()->boosted())
+                continue;
+            foreach (const SxPathKey &prefix, prefixes) {
+                if (SxPathTable::instance().isBelow(it.key(), prefix)) {
+                    mTaskList.boost(it.value());
+                    boosted++;
+                    break;
+                }
+            }
+        }
+    }
+    if (boosted > 0) {
+        logVerbose(QString("%1 tasks of %2 moved to the front").arg(boosted).arg(volume));
+        if (!mTaskList.isEmpty())
+            _preemptCurrentTask(mTaskList.first());
+        emit sig_start_task();
+    }
 }
 
 void SxQueue::startCurrentTask()
@@ -268,7 +506,7 @@ void SxQueue::startCurrentTask()
     if (mCluster == nullptr) {
         mAuth = mConfig->clusterConfig().sxAuth();
         QString errorMessage;
-        mCluster = SxCluster::initializeCluster(mAuth, mConfig->clusterConfig().uuid(), mCheckSslCallback, errorMessage);
+        mCluster = SxCluster::initializeCluster(mAuth, mConfig->clusterConfig().uuid(), mCheckSslCallback, errorMessage, true);
         if (mCluster == nullptr) {
             logError("UNABLE TO INITIALIZE CLUSTER");
             emit sig_satusChanged(SxStatus::inactive);
@@ -284,15 +522,70 @@ void SxQueue::startCurrentTask()
         mCluster->setFindIdenticalFilesCallback([this](const QString& volume, qint64 fileSize, int blockSize, const QStringList &fileBlocks, QList<QPair<QString, quint32>>& files)->bool {
             return this->findIdenticalFiles(volume, fileSize, blockSize, fileBlocks, files);
         });
+        mCluster->setFindCopySourceCallback([this](const QString& volume, const QString &path, const QString &localFile, qint64 fileSize, int &blockSize, QStringList &fileBlocks)->bool {
+            return this->findCopySource(volume, path, localFile, fileSize, blockSize, fileBlocks);
+        });
+        mCluster->setKnownBlocksCallback([this](const QString &volume, const QString &path, int blockSize, QVector<QPair<quint64, QString>> &blocks)->bool {
+            if (_takePreparedBlocks(volume, path, blockSize, blocks))
+                return true;
+            if (mConfig->volumes().contains(volume) && _takeSpeculativeBlocks(mConfig->volume(volume).localPath()+"/"+path, blockSize, blocks))
+                return true;
+            return SxDatabase::instance().getKnownBlocks(volume, path, blockSize, blocks);
+        });
+        mCluster->setUploadStateCallbacks([](const QString &volume, const QString &path, SxUploadState &state)->bool {
+            return SxDatabase::instance().getUploadState(volume, path, state);
+        }, [](const QString &volume, const QString &path, const SxUploadState *state) {
+            if (state)
+                SxDatabase::instance().updateUploadState(volume, path, *state);
+            else
+                SxDatabase::instance().removeUploadState(volume, path);
+        });
+        mCluster->setCommitCallback([](const QString &tmpFile, const QString &path) {
+            SxFilesystem::addWriteToken(tmpFile, path);
+        });
         emit sig_satusChanged(SxStatus::idle);
         emit sig_setEtaAction(EtaAction::Idle, 0, "", 0, 0);
         connect(this, &SxQueue::sig_abort_task, mCluster, &SxCluster::abort); //, Qt::DirectConnection);
         connect(mCluster, &SxCluster::sig_setProgress, this, &SxQueue::sig_setProgress);
         mCluster->reloadVolumes();
+        SxAuth auth = mAuth;
+        QByteArray uuid = mConfig->clusterConfig().uuid();
+        auto checkSslCallback = mCheckSslCallback;
+        mLargeTransferLane = new SxTransferLane([this, auth, uuid, checkSslCallback]()->SxCluster* {
+            QString errorMessage;
+            SxCluster *cluster = SxCluster::initializeCluster(auth, uuid, checkSslCallback, errorMessage, true);
+            if (cluster == nullptr)
+                return nullptr;
+            cluster->setFindIdenticalFilesCallback([this](const QString& volume, qint64 fileSize, int blockSize, const QStringList &fileBlocks, QList<QPair<QString, quint32>>& files)->bool {
+                return this->findIdenticalFiles(volume, fileSize, blockSize, fileBlocks, files);
+            });
+            cluster->setCommitCallback([](const QString &tmpFile, const QString &path) {
+                SxFilesystem::addWriteToken(tmpFile, path);
+            });
+            if (mPeerExchange) {
+                // large files are the ones worth fetching from the local network
+                cluster->setGetLocalBlocksCallback([this](QFile *file, qint64 fileSize, int blockSize, const QStringList &fileBlocks, QSet<QString> &missingBlocks)->bool {
+                    return this->getLocalBlocks(file, fileSize, blockSize, fileBlocks, missingBlocks);
+                });
+            }
+            cluster->reloadVolumes();
+            return cluster;
+        });
+        mLargeTransferLane->start();
         requestVolumeList();
         emit sig_clusterInitialized(mCluster->sxwebAddress(), mCluster->sxshareAddress());
         emit sig_gotVcluster(mCluster->userInfo().vcluster());
     }
+    auto limits = mConfig->desktopConfig().bandwidthLimits(QDateTime::currentDateTime());
+    SxGovernor::Policy policy = SxGovernor::instance().policy();
+    if (policy.bandwidthCap > 0) {
+        limits.first = limits.first > 0 ? qMin(limits.first, policy.bandwidthCap) : policy.bandwidthCap;
+        limits.second = limits.second > 0 ? qMin(limits.second, policy.bandwidthCap) : policy.bandwidthCap;
+    }
+    SxFile::setHashingThreads(policy.hashingThreads);
+    SxBufferPool::instance().setBudget(mConfig->desktopConfig().transferMemoryBudget());
+    mCluster->setBandwidthLimits(limits.first, limits.second);
+    mTaskList.setSchedule(mConfig->desktopConfig().smallTaskSize(), mConfig->desktopConfig().largeTaskMaxWait());
     if (mCluster->checkNetworkConfigurationChanged()) {
         if (!mPaused) {
             logInfo("Network configuration changed. Restarting queue");
@@ -312,6 +605,18 @@ void SxQueue::startCurrentTask()
         mQueueIsWorking = false;
         return;
     }
+    // parked until the connectivity probe reaches the cluster
+    if (mOffline) {
+        mQueueIsWorking = false;
+        return;
+    }
+    {
+        qint64 now = QDateTime::currentMSecsSinceEpoch()/1000;
+        if (now - mLastCensusLog >= sCensusLogInterval) {
+            mLastCensusLog = now;
+            logDebug("live objects: " + SxCensus::report());
+        }
+    }
     foreach (QString volName, mPendingUploads.keys()) {
         UploadQueue *queue = mPendingUploads.value(volName);
         SxVolume *volume = mCluster->getSxVolume(volName);
@@ -327,17 +632,34 @@ void SxQueue::startCurrentTask()
         }
     }
 
-    if (mTaskList.isEmpty() && mCurrentTask == nullptr) {
-        emit sig_satusChanged(SxStatus::idle);
-        emit sig_setEtaAction(EtaAction::Idle, 0, "", 0, 0);
-        mQueueIsWorking = false;
-        return;
+    if (mTaskList.count() < sAdmitLowWater)
+        _admitMarkedFiles();
+    if (mCurrentTask == nullptr) {
+        _startLargeTransfer(limits.second);
+        mCurrentTask = _takeBackgroundScan();
+        if (mCurrentTask == nullptr)
+            mCurrentTask = _takeConsistencyCheck();
+        if (mCurrentTask == nullptr)
+            mCurrentTask = _takeNextTask();
+        if (mCurrentTask != nullptr)
+            mEtaCounters.removeTask(mCurrentTask);
     }
-    mAborted = false;
     if (mCurrentTask == nullptr) {
-        mCurrentTask = mTaskList.takeFirst();
-        mEtaCounters.removeTask(mCurrentTask);
+        if (mLargeTransferLane->busy() || mAsyncConsistencyChecks > 0) {
+            _emitEtaCounters();
+            emit sig_satusChanged(SxStatus::working);
+        }
+        else {
+            emit sig_satusChanged(SxStatus::idle);
+            emit sig_setEtaAction(EtaAction::Idle, 0, "", 0, 0);
+            _scheduleDatabaseMaintenance();
+        }
+        mQueueIsWorking = false;
+        return;
     }
+    // every task gets its own token, the cluster's operations are cancelled through it
+    mTaskToken = SxCancelToken();
+    mCluster->setCancelToken(mTaskToken);
     _emitEtaCounters();
     if (mCurrentTask->priority() > 0) {
         if (mTaskList.count() > 0 && mTaskList.last()->priority() == 0)
@@ -348,12 +670,25 @@ void SxQueue::startCurrentTask()
     else
         emit sig_satusChanged(SxStatus::working);
     logVerbose("start "+mCurrentTask->toString());
-    QString taskPath = mCurrentTask->volume()+"/"+mCurrentTask->path();
+    SxSyncRecorder::instance().taskStarted(Task::typeName(mCurrentTask->type()), mCurrentTask->volume(), mCurrentTask->path(),
+                                           mCurrentTask->source(), mCurrentTask->size());
+    SxPathKey taskPath = mCurrentTask->key();
     mTaskByPath.remove(taskPath);
+    if (!mCurrentTask->path().isEmpty())
+        mActivePaths.insert(taskPath);
+    if (_isFileTask(mCurrentTask))
+        SxSyncStatus::instance().setSyncing(mCurrentTask->volume(), mCurrentTask->path());
+    if (mCurrentTask->type() == TaskType::UploadFile)
+        _prepareNextUploads();
     locker.unlock();
+    qint64 taskSize = mCurrentTask->size();
+    quint32 traceId = SxTrace::instance().begin(SxTraceEvent::QueueTask, mCurrentTask->path().split("/").last());
+    mCluster->clearLastError();
     _executeCurrentTask();
+    SxTrace::instance().end(SxTraceEvent::QueueTask, traceId, taskSize, static_cast<int>(mCluster->lastError().errorCode()));
     if (mCluster->lastError().errorCode()==SxErrorCode::NetworkError) {
         emit sig_addWarning("", "", mCluster->lastError().errorMessageTr(), false);
+        _onNetworkError();
     }
     else if (mCluster->lastError().errorCode()==SxErrorCode::NotFound && mCluster->lastError().errorMessage()=="No such volume") {
         requestVolumeList();
@@ -361,6 +696,8 @@ void SxQueue::startCurrentTask()
     else if (!mConfig->volumes().isEmpty()){
         emit sig_removeWarning("", "");
     }
+    if (mCluster->lastError().errorCode() != SxErrorCode::NetworkError && mCluster->lastError().errorCode() != SxErrorCode::AbortedByUser)
+        mNetworkFailures = 0;
     mQueueIsWorking = false;
     _finishCurrentTask();
 }
@@ -374,11 +711,41 @@ void SxQueue::deleteTimers()
     mTimers.clear();
 }
 
+void SxQueue::runDatabaseMaintenance()
+{
+    {
+        QMutexLocker locker(&mMutex);
+        bool busy = mQueueIsWorking || mCurrentTask != nullptr || !mTaskList.isEmpty()
+                || (mLargeTransferLane && mLargeTransferLane->busy());
+        // the next idle period schedules it again
+        if (busy)
+            return;
+    }
+    if (SxGovernor::instance().policy().deferHeavyWork) {
+        mMaintenanceTimer->start(sMaintenanceIdleDelay*1000);
+        return;
+    }
+    mVacuumPending = SxDatabase::instance().runMaintenance(sVacuumStepPages);
+    mLastMaintenance = QDateTime::currentMSecsSinceEpoch()/1000;
+    if (mVacuumPending)
+        _scheduleDatabaseMaintenance();
+}
+
+void SxQueue::_scheduleDatabaseMaintenance()
+{
+    if (mMaintenanceTimer->isActive())
+        return;
+    // free pages are reclaimed in steps, one per idle delay
+    qint64 due = mVacuumPending ? 0 : mLastMaintenance + sMaintenanceInterval - QDateTime::currentMSecsSinceEpoch()/1000;
+    mMaintenanceTimer->start(static_cast<int>(qMax<qint64>(due, sMaintenanceIdleDelay))*1000);
+}
+
 void SxQueue::lockVolume(const QString &volume)
 {
     if (mLockedVolumes.contains(volume))
         return;
     mLockedVolumes.insert(volume);
+    SxFilter::dropCachedContexts(volume);
     clear(volume);
     emit sig_lockVolume(volume);
 }
@@ -394,51 +761,42 @@ bool SxQueue::getLocalBlocks(QFile *file, qint64 fileSize, int blockSize, const
             uniqueBlocks.insert(block, QList<qint64>{offset});
         offset+=blockSize;
     }
+    // zero blocks are already holes in the part file
+    uniqueBlocks.remove(QString::fromUtf8(SxBlock::zeroBlockHash(blockSize, mCluster->uuid())));
     missingBlocks = uniqueBlocks.keys().toSet();
-    QList<std::tuple<QString, QString, qint64> > list;
-    foreach (QString block, missingBlocks) {
-        if (!SxDatabase::instance().findBlock(block, blockSize, list))
-            continue;
-        foreach (auto tuple, list) {
-            QString volume = std::get<0>(tuple);
-            QString path = std::get<1>(tuple);
-            offset = std::get<2>(tuple);
-            if (!mConfig->volumes().contains(volume))
-                continue;
-            QString volumeRoot = mConfig->volume(volume).localPath();
-            if (volumeRoot.isEmpty())
-                continue;
-            QFile localFile(volumeRoot+path);
-            if (!localFile.open(QIODevice::ReadOnly))
-                continue;
-            if (!localFile.seek(offset))
-                continue;
-            QByteArray data = localFile.read(blockSize);
-            if (data.size() < blockSize) {
-                int index = data.size();
-                data.resize(blockSize);
-                for(;index<blockSize; index++)
-                    data[index] = 0;
+    QHash<QString, QList<std::tuple<QString, QString, qint64> > > hits;
+    if (SxDatabase::instance().findBlocks(uniqueBlocks.keys(), blockSize, hits)) {
+        SxBlockReuse blockReuse(blockSize, mCluster->uuid());
+        foreach (QString block, hits.keys()) {
+            foreach (auto tuple, hits.value(block)) {
+                QString volume = std::get<0>(tuple);
+                if (!mConfig->volumes().contains(volume))
+                    continue;
+                QString volumeRoot = mConfig->volume(volume).localPath();
+                if (volumeRoot.isEmpty())
+                    continue;
+                blockReuse.addCandidate(volumeRoot+std::get<1>(tuple), std::get<2>(tuple), block);
             }
-            QString hash = SxBlock::hashBlock(data, mCluster->uuid());
-            if (hash != block)
-                continue;
-            missingBlocks.remove(block);
-            foreach (auto writeOffset, uniqueBlocks.value(block)) {
-                if (!file->seek(writeOffset)) {
-                    logWarning("seek failed");
-                    return false;
-                }
-                qint64 toWrite = blockSize;
-                if (writeOffset + blockSize > fileSize)
-                    toWrite = fileSize-writeOffset;
-                if (!file->write(data.constData(), toWrite)) {
-                    logWarning("write failed");
+        }
+        if (!blockReuse.fill(file, fileSize, uniqueBlocks, missingBlocks))
+            return false;
+    }
+    // whatever isn't on this machine may be on another one in the same office
+    if (mPeerExchange && !missingBlocks.isEmpty()) {
+        bool writeFailed = false;
+        mPeerExchange->fetchBlocks(blockSize, missingBlocks.toList(), [&](const QString &hash, const QByteArray &data) -> bool {
+            foreach (qint64 writeOffset, uniqueBlocks.value(hash)) {
+                qint64 toWrite = qMin<qint64>(blockSize, fileSize - writeOffset);
+                if (!XFile::writeAt(file, writeOffset, data.constData(), toWrite)) {
+                    writeFailed = true;
                     return false;
                 }
             }
-            break;
-        }
+            missingBlocks.remove(hash);
+            return true;
+        });
+        if (writeFailed)
+            return false;
     }
     return true;
 }
@@ -460,6 +818,50 @@ bool SxQueue::findIdenticalFiles(const QString &volume, qint64 fileSize, int blo
     return true;
 }
 
+/* compares the files byte by byte, which is much cheaper than hashing them */
+static bool haveSameContent(const QString &file1, const QString &file2)
+{
+    static const qint64 bufferSize = 1024*1024;
+    QFile f1(file1);
+    QFile f2(file2);
+    if (!f1.open(QIODevice::ReadOnly) || !f2.open(QIODevice::ReadOnly) || f1.size() != f2.size())
+        return false;
+    while (!f1.atEnd()) {
+        QByteArray data1 = f1.read(bufferSize);
+        QByteArray data2 = f2.read(bufferSize);
+        if (data1.isEmpty() || data1 != data2)
+            return false;
+    }
+    return f2.atEnd();
+}
+
+bool SxQueue::findCopySource(const QString &volume, const QString &path, const QString &localFile, qint64 fileSize, int &blockSize, QStringList &fileBlocks)
+{
+    if (fileSize < sCopyDetectionMinSize || !mConfig->volumes().contains(volume))
+        return false;
+    QString volumeRoot = mConfig->volume(volume).localPath();
+    if (volumeRoot.isEmpty())
+        return false;
+    QList<std::tuple<QString, quint32, int, QStringList>> candidates;
+    if (!SxDatabase::instance().findCopyCandidates(volume, path, fileSize, sCopyCandidatesLimit, candidates))
+        return false;
+    foreach (auto candidate, candidates) {
+        // the stored blocks describe the candidate only while it is unchanged since it was synchronised
+        QFileInfo fileInfo(volumeRoot+std::get<0>(candidate));
+        if (!fileInfo.isFile() || fileInfo.lastModified().toTime_t() != std::get<1>(candidate))
+            continue;
+        if (!haveSameContent(localFile, fileInfo.absoluteFilePath()))
+            continue;
+        fileInfo.refresh();
+        if (fileInfo.lastModified().toTime_t() != std::get<1>(candidate))
+            continue;
+        blockSize = std::get<2>(candidate);
+        fileBlocks = std::get<3>(candidate);
+        return true;
+    }
+    return false;
+}
+
 bool SxQueue::_appendRegularTask(SxQueue::Task *task)
 {
     if (mConfig->volume(task->volume()).isPathIgnored(task->path(), false)) {
@@ -467,11 +869,11 @@ bool SxQueue::_appendRegularTask(SxQueue::Task *task)
         return false;
     }
     bool result = true;
-    QString taskPath = task->volume()+"/"+task->path();
+    SxPathKey taskPath = task->key();
     if (mTaskByPath.contains(taskPath)) {
         Task* oldTask = mTaskByPath.value(taskPath);
         if (oldTask->type() != task->type()) {
-            mTaskList.removeOne(oldTask);
+            mTaskList.remove(oldTask);
             mEtaCounters.removeTask(oldTask);
             delete oldTask;
             mTaskList.append(task);
@@ -488,188 +890,924 @@ bool SxQueue::_appendRegularTask(SxQueue::Task *task)
         mTaskByPath.insert(taskPath, task);
         mEtaCounters.addTask(task);
     }
+    if (result)
+        SxSyncStatus::instance().setPending(task->volume(), task->path());
     _emitEtaCounters();
     return result;
 }
 
 void SxQueue::_instertPriorityTask(SxQueue::Task *task)
 {
-    auto insertPosition = mTaskList.end();
-    for (auto it = mTaskList.begin(); it < mTaskList.end(); it++) {
-        if ((*it)->priority() <= task->priority()) {
-            insertPosition = it;
-            break;
-        }
-    }
-    if (insertPosition != mTaskList.end() && (*insertPosition)->priority()==task->priority()) {
-        for (auto it = insertPosition; it < mTaskList.end(); it++) {
-            if ((*it)->priority()==task->priority()) {
-                insertPosition = it;
-                if ((*insertPosition)->equal(*task)) {
-                    delete task;
-                    return;
-                }
-            }
-            else
-                break;
-        }
+    if (mTaskList.findEqual(task) != nullptr) {
+        delete task;
+        return;
     }
-    mTaskList.insert(insertPosition, task);
+    mTaskList.append(task);
 }
 
-void SxQueue::_finishCurrentTask()
+SxQueue::Task *SxQueue::_takeNextTask()
 {
-    QMutexLocker locker(&mMutex);
-    delete mCurrentTask;
-    mCurrentTask = nullptr;
-    logVerbose(QString("task finished, remaining tasks: %1").arg(mTaskList.count()));
-    emit sig_start_task();
+    Task *task = mTaskList.findFirst([this](const Task *task)->bool {
+        return !mActivePaths.contains(task->key()) || task->path().isEmpty();
+    });
+    if (task != nullptr) {
+        mTaskList.remove(task);
+        mTasksSinceBackgroundScan++;
+    }
+    return task;
 }
 
-bool SxQueue::_reloadVolumeFiles(SxVolume *volume, const QString& volumeRootDir, const QString &etag, bool scanLocalFiles)
+SxQueue::Task *SxQueue::_takeBackgroundScan()
 {
-    QString volName = volume->name();
-    if (!mCluster->_locateVolume(volume, 0, 0)) {
-        _reportError(mCurrentTask, "unable to locate volume "+volName);
-        return false;
+    if (mBackgroundScans.isEmpty())
+        return nullptr;
+    if (!mTaskList.isEmpty()) {
+        if (mTasksSinceBackgroundScan < sBackgroundScanInterleave || mTaskList.first()->priority() >= 99 || mTaskList.first()->boosted())
+            return nullptr;
     }
-    QString _etag = etag;
-    QList<SxFileEntry*> remoteFiles;
-    logDebug("list remote files");
-    if (!mCluster->_listFiles(volume, remoteFiles, _etag)) {
-        if (mCluster->lastError().errorCode() == SxErrorCode::NotChanged) {
-            logVerbose("Nothing changes");
-            return true;
-        }
-        _reportError(mCurrentTask, mCluster->lastError().errorMessage());
-        return false;
+    // full scans wait for power and an idle user, but never for longer than a few hours
+    qint64 now = QDateTime::currentMSecsSinceEpoch();
+    if (SxGovernor::instance().policy().deferHeavyWork) {
+        if (mHeavyWorkDeferredSince == 0)
+            mHeavyWorkDeferredSince = now;
+        if (now - mHeavyWorkDeferredSince < sMaxScanDeferral*1000)
+            return nullptr;
     }
-    logInfo(QString("got remote list (etag: %1)").arg(_etag));
-    mEtags.insert(volName, _etag);
-
-    bool inconsistentEtag = false;
-    QList<QPair<QString, QString> > etags;
-    mCluster->getAllVolnodesEtag(volume, etags);
-    _etag = etags.first().second;
-    for (int i=1; i<etags.count();i++) {
-        if (_etag != etags.at(i).second) {
-            inconsistentEtag = true;
-            logVerbose(QString("Detected etag mismatch on volume %1").arg(volName));
-            break;
-        }
+    mHeavyWorkDeferredSince = 0;
+    while (!mBackgroundScans.isEmpty()) {
+        QString volume = mBackgroundScans.takeFirst();
+        if (mLockedVolumes.contains(volume) || !mConfig->volumes().contains(volume))
+            continue;
+        mTasksSinceBackgroundScan = 0;
+        logVerbose("background scan of "+volume);
+        return new Task(TaskType::VolumeInitialScan, volume, "", 99, 0);
     }
-    if (inconsistentEtag)
-        mInconsistentVolumes.insert(volName);
-    else
-        mInconsistentVolumes.remove(volName);
-
-    SxDatabase& db = SxDatabase::instance();
+    return nullptr;
+}
 
-    QStringList localFiles;
-    if (scanLocalFiles) {
-        if (_aborted())
-            return true;
-        QDir rootDir(volumeRootDir);
-        logDebug("list local files");
-        localFiles = SxFilesystem::getDirectoryContents(rootDir, true, "", true);
-        if ((!localFiles.isEmpty() || !remoteFiles.isEmpty()) && mAskGuiCallback!= nullptr) {
-            if (localFiles.isEmpty()) {
-                quint32 count;
-                if (db.getFilesCount(volName, true, count)) {
-                    if (count != 0) {
-                        if (!mAskGuiCallback(tr("Local volume (%1) is empty. Do you want to remove remote files?").arg(volName))) {
-                            db.removeVolumeFiles(volName);
-                        }
-                    }
-                }
-            }
-            else if (remoteFiles.isEmpty()) {
-                quint32 count;
-                if (db.getFilesCount(volName, false, count)) {
-                    if (count != 0) {
-                        if (!mAskGuiCallback(tr("Remote volume (%1) is empty. Do you want to remove local files?").arg(volName))) {
-                            db.removeVolumeFiles(volName);
-                        }
-                    }
-                }
-            }
-        }
-    }
+/* idle volumes are listed less and less often, up to every few minutes; a change seen
+ * on the cluster brings the interval back to the base one */
+int SxQueue::_nextListInterval(const QString &volume, bool changed)
+{
+    int base = sTimeoutListFiles;
+    int max = sTimeoutListFilesMax;
+    QMutexLocker locker(&mMutex);
+    int interval = changed ? base : qMin(mListIntervals.value(volume, base)*2, max);
+    mListIntervals.insert(volume, interval);
+    return interval;
+}
 
-    db.startUpdatingFiles([this]()->bool {
-                              QMutexLocker locker(&mMutex);
-                              return mAborted;
-                          });
-    logDebug("update database - prepare");
-    db.markVolumeFilesToRemove(volName, false, false);
-    logDebug("update database - remote files");
-    db.updateRemoteFiles(volName, remoteFiles);
-    if (scanLocalFiles) {
-        logDebug("update database - local files");
-        db.markVolumeFilesToRemove(volName, true, true);
-        db.updateLocalFiles(volName, localFiles, volumeRootDir);
+/* local activity usually comes with remote activity, the next listing is brought forward */
+void SxQueue::_resetListInterval(const QString &volume)
+{
+    int base = sTimeoutListFiles;
+    {
+        QMutexLocker locker(&mMutex);
+        if (mListIntervals.value(volume, base) <= base)
+            return;
+        mListIntervals.insert(volume, base);
     }
-    logDebug("select task from database");
-    QList<QString> toUpload = db.getMarkedFiles(volName, SxDatabase::ACTION::UPLOAD);
-    foreach (QString file, toUpload) {
-        QFileInfo fileInfo(volumeRootDir+file);
-        Task *t = new Task(TaskType::UploadFile, volName, file, 0, fileInfo.size());
-        _appendRegularTask(t);
-    }
-    QList<QString> remoteToRemove = db.getMarkedFiles(volName, SxDatabase::ACTION::REMOVE_REMOTE);
-    foreach (QString file, remoteToRemove) {
-        SxDatabase::instance().removeFileBlocks(volName, file);
-        Task *t = new Task(TaskType::RemoveRemoteFile, volName, file, 0, 0);
-        _appendRegularTask(t);
-    }
-
-    QList<QString> toDownload = db.getMarkedFiles(volName, SxDatabase::ACTION::DOWNLOAD);
-    foreach (QString file, toDownload) {
-        QStringList inconsistentRevisions;
-        db.getInconsistentFile(volName, file, inconsistentRevisions);
-        if (!inconsistentRevisions.isEmpty()) {
-            QString rev = db.getRemoteFileRevision(volName, file);
-            if (inconsistentRevisions.contains(rev))
-                continue;
-        }
-        Task *t = new Task(TaskType::DownloadFile, volName, file, 0, db.getRemoteFileSize(volName, file));
-        _appendRegularTask(t);
+    int delay = base*1000*SxGovernor::instance().policy().timerScale;
+    foreach (QTimer *timer, mTimers) {
+        if (timer->property("ListFiles").toString() == volume && timer->remainingTime() > delay)
+            timer->start(delay);
     }
+}
 
-    QList<QString> localToRemove = db.getMarkedFiles(volName, SxDatabase::ACTION::REMOVE_LOCAL);
-    foreach (QString file, localToRemove) {
-        QStringList inconsistentRevisions;
-        db.getInconsistentFile(volName, file, inconsistentRevisions);
-        if (!inconsistentRevisions.isEmpty()) {
-            if (scanLocalFiles)
-                onPossibleInconsistency(volName, file);
-            continue;
-        }
-        Task *t = new Task(TaskType::RemoveLocalFile, volName, file, 0, 0);
-        _appendRegularTask(t);
+/* hashes the next uploads in the queue on a separate thread while the current task is
+ * transferring, called with the queue locked; only files whose block size is known from
+ * the locate cache are taken, the result is handed over as known blocks */
+void SxQueue::_prepareNextUploads()
+{
+    QMutexLocker locker(&mPreparedMutex);
+    // uploads cancelled or replaced in the meantime are never taken
+    for (auto it = mPreparedUploads.begin(); it != mPreparedUploads.end(); ) {
+        if (it->ready && !mTaskByPath.contains(it.key()))
+            it = mPreparedUploads.erase(it);
+        else
+            ++it;
     }
-    if (_aborted()) {
-        clear();
+    int blockSize = 0;
+    Task *task = nullptr;
+    if (mPreparedUploads.count() < sPrepareAhead) {
+        task = mTaskList.findFirst([this, &blockSize](const Task *task)->bool {
+            if (task->type() != TaskType::UploadFile || task->size() < sPrepareMinSize)
+                return false;
+            if (mPreparedUploads.contains(task->key()))
+                return false;
+            return mCluster->cachedBlockSize(task->volume(), task->size(), blockSize);
+        }, sPrepareLookahead);
     }
+    if (task == nullptr)
+        return;
+    const SxPathKey key = task->key();
+    const QString localFile = mConfig->volume(task->volume()).localPath()+"/"+task->path();
+    const QByteArray salt = mCluster->uuid();
+    mPreparedUploads.insert(key, {blockSize, false, false, {}});
+    QtConcurrent::run(&mPreparePool, [this, key, localFile, blockSize, salt]() {
+        QFileInfo before(localFile);
+        QVector<QPair<quint64, QString>> blocks;
+        bool result = before.isFile() && SxFile::prepareBlocks(localFile, blockSize, salt, blocks, mPrepareToken);
+        QFileInfo after(localFile);
+        // a file modified while it was read is left to the upload
+        if (after.size() != before.size() || after.lastModified() != before.lastModified())
+            result = false;
+        QMutexLocker locker(&mPreparedMutex);
+        auto it = mPreparedUploads.find(key);
+        if (it == mPreparedUploads.end())
+            return;
+        if (!result || it->discard) {
+            mPreparedUploads.erase(it);
+            return;
+        }
+        it->blocks = blocks;
+        it->ready = true;
+    });
+}
 
-    db.endUpdatingFiles();
-    foreach (SxFileEntry* entry, remoteFiles) {
-        delete entry;
+bool SxQueue::_takePreparedBlocks(const QString &volume, const QString &path, int blockSize, QVector<QPair<quint64, QString>> &blocks)
+{
+    QMutexLocker locker(&mPreparedMutex);
+    auto it = mPreparedUploads.find(SxPathTable::instance().find(volume, path));
+    if (it == mPreparedUploads.end())
+        return false;
+    if (!it->ready) {
+        // still being hashed, the upload does it itself
+        it->discard = true;
+        return false;
     }
-    return true;
+    bool result = it->blockSize == blockSize;
+    if (result)
+        blocks = it->blocks;
+    mPreparedUploads.erase(it);
+    return result;
 }
 
-void SxQueue::_emitEtaCounters()
+/* a file whose change is debounced by SxFilesystem is usually about to be uploaded, it is
+ * hashed in the meantime on a single low priority thread; a newer change of the file
+ * cancels the hashing of the previous one */
+void SxQueue::speculateUpload(const QString &volume, const QString &path, qint64 size)
 {
-    emit sig_setEtaCounters(mEtaCounters.uploadCount, mEtaCounters.uploadSize,
-                            mEtaCounters.downloadCount, mEtaCounters.downloadSize,
-                            mEtaCounters.removeCount);
+    if (mCluster == nullptr || mPaused || size < sPrepareMinSize || !mConfig->volumes().contains(volume))
+        return;
+    int blockSize = 0;
+    if (!mCluster->cachedBlockSize(volume, size, blockSize))
+        return;
+    const QString localFile = mConfig->volume(volume).localPath()+"/"+path;
+    SxFingerprint fingerprint;
+    if (!SxFilesystem::getFingerprint(localFile, false, fingerprint))
+        return;
+    const qint64 mTime = QFileInfo(localFile).lastModified().toMSecsSinceEpoch();
+    const qint64 now = QDateTime::currentMSecsSinceEpoch();
+    const QByteArray salt = mCluster->uuid();
+    const SxCancelToken token = mPrepareToken.child();
+    quint64 id;
+    {
+        QMutexLocker locker(&mPreparedMutex);
+        auto it = mSpeculativeHashes.find(localFile);
+        if (it != mSpeculativeHashes.end()) {
+            if (it->inode == fingerprint.inode && it->size == fingerprint.size && it->mTime == mTime && it->blockSize == blockSize)
+                return;
+            it->token.cancel();
+            mSpeculativeHashes.erase(it);
+        }
+        // results of files which were never uploaded
+        for (it = mSpeculativeHashes.begin(); it != mSpeculativeHashes.end(); ) {
+            if (it->ready && now - it->created > sSpeculativeHashMaxAge)
+                it = mSpeculativeHashes.erase(it);
+            else
+                ++it;
+        }
+        if (mSpeculativeHashes.count() >= sSpeculativeHashesLimit)
+            return;
+        id = ++mSpeculationCounter;
+        mSpeculativeHashes.insert(localFile, {id, fingerprint.inode, fingerprint.size, mTime, blockSize, now, false, token, {}});
+    }
+    QtConcurrent::run(&mSpeculationPool, [this, id, localFile, blockSize, salt, token]() {
+        QThread::currentThread()->setPriority(QThread::LowestPriority);
+        QVector<QPair<quint64, QString>> blocks;
+        bool result = SxFile::prepareBlocks(localFile, blockSize, salt, blocks, token);
+        QMutexLocker locker(&mPreparedMutex);
+        auto it = mSpeculativeHashes.find(localFile);
+        if (it == mSpeculativeHashes.end() || it->id != id)
+            return;
+        if (!result) {
+            mSpeculativeHashes.erase(it);
+            return;
+        }
+        it->blocks = blocks;
+        it->ready = true;
+    });
 }
 
-bool SxQueue::_aborted() const
+/* the file must still be the one which was hashed, a file modified during the hashing
+ * has another mtime */
+bool SxQueue::_takeSpeculativeBlocks(const QString &localFile, int blockSize, QVector<QPair<quint64, QString>> &blocks)
+{
+    SxFingerprint current;
+    bool exists = SxFilesystem::getFingerprint(localFile, false, current);
+    const qint64 mTime = QFileInfo(localFile).lastModified().toMSecsSinceEpoch();
+    QMutexLocker locker(&mPreparedMutex);
+    auto it = mSpeculativeHashes.find(localFile);
+    if (it == mSpeculativeHashes.end())
+        return false;
+    bool result = exists && it->ready && it->blockSize == blockSize &&
+            it->inode == current.inode && it->size == current.size && it->mTime == mTime;
+    if (result)
+        blocks = it->blocks;
+    else
+        it->token.cancel();
+    mSpeculativeHashes.erase(it);
+    return result;
+}
+
+SxQueue::Task *SxQueue::_takeConsistencyCheck()
+{
+    if (mPendingConsistencyChecks.isEmpty() || mAsyncConsistencyChecks >= sAsyncConsistencyChecks)
+        return nullptr;
+    if (!mTaskList.isEmpty()) {
+        if (mTasksSinceBackgroundScan < sBackgroundScanInterleave || mTaskList.first()->priority() > 0 || mTaskList.first()->boosted())
+            return nullptr;
+    }
+    mTasksSinceBackgroundScan = 0;
+    return new Task(TaskType::CheckFileConsistency, mPendingConsistencyChecks.constBegin().key(), "", 0, 0);
+}
+
+bool SxQueue::_isLargeTransfer(const Task *task) const
+{
+    return task->type() == TaskType::DownloadFile && task->size() >= sLargeTransferSize;
+}
+
+bool SxQueue::_isFileTask(const Task *task)
+{
+    switch (task->type()) {
+    case TaskType::UploadFile:
+    case TaskType::DownloadFile:
+    case TaskType::RemoveRemoteFile:
+    case TaskType::RemoveLocalFile:
+    case TaskType::MoveRemoteFile:
+        return !task->path().isEmpty();
+    default:
+        return false;
+    }
+}
+
+void SxQueue::_startLargeTransfer(qint64 downloadLimit)
+{
+    if (!mLargeTransferLane->available())
+        return;
+    Task *task = mTaskList.findFirst([this](const Task *task)->bool {
+        return _isLargeTransfer(task) && !mActivePaths.contains(task->key());
+    }, sLargeTransferLookahead);
+    if (task == nullptr)
+        return;
+    SxPathKey taskPath = task->key();
+    if (mLockedVolumes.contains(task->volume()) || !mConfig->volumes().contains(task->volume()))
+        return;
+    QString volumeRootDir = mConfig->volume(task->volume()).localPath();
+    bool started = mLargeTransferLane->execute([this, task, volumeRootDir, downloadLimit](SxCluster *cluster) {
+        if (cluster == nullptr) {
+            _finishLargeTransfer(task, true);
+            return;
+        }
+        SxVolume *volume = cluster->getSxVolume(task->volume());
+        if (volume == nullptr && cluster->reloadVolumes())
+            volume = cluster->getSxVolume(task->volume());
+        if (volume == nullptr) {
+            _reportError(task, "unable to find volume "+task->volume());
+            _finishLargeTransfer(task, false);
+            return;
+        }
+        logInfo("execute "+task->toString()+" (large transfer lane)");
+        SxSyncRecorder::instance().taskStarted(Task::typeName(task->type()), task->volume(), task->path(), task->source(), task->size());
+        cluster->setBandwidthLimits(0, downloadLimit);
+        _downloadFile(cluster, volume, task, volumeRootDir, 0, false);
+        _finishLargeTransfer(task, false);
+    });
+    if (!started)
+        return;
+    mTaskList.remove(task);
+    mTaskByPath.remove(taskPath);
+    mEtaCounters.removeTask(task);
+    mActivePaths.insert(taskPath);
+    SxSyncStatus::instance().setSyncing(task->volume(), task->path());
+}
+
+void SxQueue::_finishLargeTransfer(Task *task, bool requeue)
+{
+    QMutexLocker locker(&mMutex);
+    mActivePaths.remove(task->key());
+    if (requeue) {
+        mTaskList.prepend(task);
+        mTaskByPath.insert(task->key(), task);
+        mEtaCounters.addTask(task);
+        SxSyncStatus::instance().setPending(task->volume(), task->path());
+    }
+    else {
+        SxSyncStatus::instance().finish(task->volume(), task->path());
+        delete task;
+    }
+    emit sig_start_task();
+}
+
+/* a large upload or download is worth cancelling when a small or boosted file task is
+ * waiting behind it: the upload keeps its multipart checkpoint and the download its .part
+ * file with the block bitmap, so the transfer only loses the chunk in flight when it is
+ * picked up again; every task yields at most sMaxPreemptions times */
+bool SxQueue::_isPreemptible(const Task *task) const
+{
+    if (task->type() != TaskType::UploadFile && task->type() != TaskType::DownloadFile)
+        return false;
+    return task->size() >= sLargeTransferSize && task->preemptions() < sMaxPreemptions;
+}
+
+void SxQueue::_preemptCurrentTask(const Task *waiting)
+{
+    if (mCurrentTask == nullptr || mPreempting || !_isPreemptible(mCurrentTask))
+        return;
+    if (!waiting->boosted() && (!_isFileTask(waiting) || waiting->size() >= sInteractiveTaskSize))
+        return;
+    if (waiting->key() == mCurrentTask->key())
+        return;
+    logInfo("preempting "+mCurrentTask->toString()+" for "+waiting->toString());
+    mPreempting = true;
+    mTaskToken.cancel();
+    emit sig_abort_task();
+}
+
+void SxQueue::_finishCurrentTask()
 {
     QMutexLocker locker(&mMutex);
-    return mAborted;
+    if (!mCurrentTask->path().isEmpty())
+        mActivePaths.remove(mCurrentTask->key());
+    bool preempted = mPreempting && mCluster->lastError().errorCode() == SxErrorCode::AbortedByUser;
+    mPreempting = false;
+    // a newer task queued for the same path while this one was running supersedes it
+    if (preempted && !mTaskByPath.contains(mCurrentTask->key())) {
+        mCurrentTask->addPreemption();
+        mTaskList.prepend(mCurrentTask);
+        mTaskByPath.insert(mCurrentTask->key(), mCurrentTask);
+        mEtaCounters.addTask(mCurrentTask);
+        SxSyncStatus::instance().setPending(mCurrentTask->volume(), mCurrentTask->path());
+    }
+    else if (_isFileTask(mCurrentTask) && mCluster->lastError().errorCode() == SxErrorCode::NetworkError &&
+             mCurrentTask->retries() < sMaxRetries && !mTaskByPath.contains(mCurrentTask->key())) {
+        _scheduleRetry(mCurrentTask);
+    }
+    else {
+        if (_isFileTask(mCurrentTask))
+            SxSyncStatus::instance().finish(mCurrentTask->volume(), mCurrentTask->path());
+        delete mCurrentTask;
+    }
+    mCurrentTask = nullptr;
+    // requests made between tasks must not inherit the cancellation of the finished one
+    mTaskToken = SxCancelToken();
+    mCluster->setCancelToken(mTaskToken);
+    // the blocks of this sync are no longer wanted once it is over
+    if (mTaskList.isEmpty())
+        SxSyncBlocks::instance().clear();
+    logVerbose(QString("task finished, remaining tasks: %1").arg(mTaskList.count()));
+    emit sig_start_task();
+}
+
+/* called on the queue thread after a task failed with a network error */
+void SxQueue::_onNetworkError()
+{
+    if (mOffline || ++mNetworkFailures < sOfflineThreshold)
+        return;
+    mOffline = true;
+    mProbeAttempts = 0;
+    logWarning(QString("cluster unreachable after %1 failed tasks, queue parked").arg(mNetworkFailures));
+    _scheduleConnectivityProbe();
+}
+
+void SxQueue::_scheduleConnectivityProbe()
+{
+    foreach (QTimer *timer, mTimers) {
+        if (timer->property("ConnectivityProbe").isValid())
+            return;
+    }
+    QTimer *timer = new QTimer(this);
+    timer->setProperty("ConnectivityProbe", true);
+    timer->setSingleShot(true);
+    mTimers.insert(timer);
+    connect(timer, &QTimer::timeout, [timer, this]() {
+        mTimers.remove(timer);
+        timer->deleteLater();
+        this->_probeConnectivity();
+    });
+    timer->start(backoffDelay(sProbeDelay, sMaxProbeDelay, mProbeAttempts++));
+}
+
+/* one cheap request instead of every queued task failing on its own; once it gets
+ * through the parked retries are queued again together */
+void SxQueue::_probeConnectivity()
+{
+    if (!mOffline || mCluster == nullptr)
+        return;
+    if (!mCluster->reloadClusterNodes()) {
+        logVerbose(QString("connectivity probe %1 failed: %2").arg(mProbeAttempts).arg(mCluster->lastError().errorMessage()));
+        _scheduleConnectivityProbe();
+        return;
+    }
+    logInfo("cluster reachable again, resuming the queue");
+    mOffline = false;
+    mNetworkFailures = 0;
+    mProbeAttempts = 0;
+    emit sig_removeWarning("", "");
+    _releaseRetries(true);
+}
+
+/* called with the queue locked, takes over the task */
+void SxQueue::_scheduleRetry(Task *task)
+{
+    qint64 due = QDateTime::currentMSecsSinceEpoch() + backoffDelay(sRetryDelay, sMaxRetryDelay, task->retries());
+    task->addRetry();
+    mRetryTasks.insert(due, task);
+    SxSyncStatus::instance().setPending(task->volume(), task->path());
+    logVerbose(QString("%1 retried in %2 s").arg(task->toString()).arg((due - QDateTime::currentMSecsSinceEpoch())/1000));
+    _scheduleRetryTimer();
+}
+
+/* a single timer for the earliest retry, called with the queue locked */
+void SxQueue::_scheduleRetryTimer()
+{
+    if (mRetryTasks.isEmpty())
+        return;
+    qint64 delay = qMax<qint64>(0, mRetryTasks.firstKey() - QDateTime::currentMSecsSinceEpoch());
+    foreach (QTimer *timer, mTimers) {
+        if (timer->property("RetryTasks").isValid()) {
+            if (timer->remainingTime() > delay)
+                timer->start(delay);
+            return;
+        }
+    }
+    QTimer *timer = new QTimer(this);
+    timer->setProperty("RetryTasks", true);
+    timer->setSingleShot(true);
+    mTimers.insert(timer);
+    connect(timer, &QTimer::timeout, [timer, this]() {
+        mTimers.remove(timer);
+        timer->deleteLater();
+        this->_releaseRetries(false);
+    });
+    timer->start(delay);
+}
+
+/* queues the retries which are due again, or all of them; the retries stay parked while
+ * the queue is offline */
+void SxQueue::_releaseRetries(bool all)
+{
+    QMutexLocker locker(&mMutex);
+    if (mOffline)
+        return;
+    qint64 now = QDateTime::currentMSecsSinceEpoch();
+    int released = 0;
+    while (!mRetryTasks.isEmpty() && (all || mRetryTasks.firstKey() <= now)) {
+        Task *task = mRetryTasks.take(mRetryTasks.firstKey());
+        // a newer task for the same path supersedes the retry
+        if (mTaskByPath.contains(task->key()) || mActivePaths.contains(task->key())) {
+            delete task;
+            continue;
+        }
+        mTaskList.append(task);
+        mTaskByPath.insert(task->key(), task);
+        mEtaCounters.addTask(task);
+        released++;
+    }
+    if (released > 0)
+        logVerbose(QString("%1 failed tasks queued again").arg(released));
+    _scheduleRetryTimer();
+    emit sig_start_task();
+}
+
+bool SxQueue::_reloadVolumeFiles(SxVolume *volume, const QString& volumeRootDir, const QString &etag, bool scanLocalFiles)
+{
+    QString volName = volume->name();
+    if (!mCluster->_locateVolume(volume, 0, 0)) {
+        _reportError(mCurrentTask, "unable to locate volume "+volName);
+        return false;
+    }
+    QString _etag = etag;
+    SxDatabase& db = SxDatabase::instance();
+    if (!db.beginRemoteFiles(volName)) {
+        _reportError(mCurrentTask, "unable to prepare remote files update");
+        return false;
+    }
+    // the listing is staged in the database batch by batch while it is parsed
+    int remoteCount = 0;
+    QCryptographicHash digestHash(QCryptographicHash::Sha1);
+    auto consumer = [this, &db, &volName, &remoteCount, &digestHash](QList<SxFileEntry*> &batch)->bool {
+        bool result = !_aborted();
+        if (result) {
+            addToListingDigest(digestHash, batch);
+            result = db.addRemoteFiles(volName, batch);
+            remoteCount += batch.count();
+        }
+        foreach (SxFileEntry *entry, batch) {
+            delete entry;
+        }
+        batch.clear();
+        return result;
+    };
+    logDebug("list remote files");
+    // volumes known to be large are listed page by page from several nodes at once
+    bool listed;
+    if (mRemoteCounts.value(volName) >= sPagedListingThreshold)
+        listed = mCluster->listFilesPaged(volume, consumer, _etag);
+    else
+        listed = mCluster->_listFiles(volume, consumer, _etag);
+    if (!listed) {
+        if (mCluster->lastError().errorCode() == SxErrorCode::NotChanged) {
+            logVerbose("Nothing changes");
+            return true;
+        }
+        _reportError(mCurrentTask, mCluster->lastError().errorMessage());
+        return false;
+    }
+    logInfo(QString("got remote list (etag: %1)").arg(_etag));
+    mRemoteCounts.insert(volName, remoteCount);
+    // a changed etag does not have to mean a changed listing (e.g. volnodes with different etags)
+    QByteArray digest = digestHash.result();
+    bool listingChanged = scanLocalFiles || mListingDigests.value(volName) != digest;
+    if (mEtags.value(volName) != _etag)
+        mCluster->invalidateLocateCache(volName);
+    mEtags.insert(volName, _etag);
+
+    bool inconsistentEtag = false;
+    QList<QPair<QString, QString> > etags;
+    if (mCluster->getAllVolnodesEtag(volume, etags))
+        _etag = etags.first().second;
+    for (int i=1; i<etags.count();i++) {
+        if (_etag != etags.at(i).second) {
+            inconsistentEtag = true;
+            logVerbose(QString("Detected etag mismatch on volume %1").arg(volName));
+            break;
+        }
+    }
+    if (inconsistentEtag)
+        mInconsistentVolumes.insert(volName);
+    else
+        mInconsistentVolumes.remove(volName);
+
+    LocalScan scan;
+    scan.partial = false;
+    QVector<SxLocalFile> &localFiles = scan.files;
+    bool &partialScan = scan.partial;
+    if (scanLocalFiles) {
+        if (_aborted())
+            return true;
+        if (!_takeDeviceScan(volName, scan)) {
+            // the first scan after a start or after lost filesystem events only lists directories changed since the previous scan,
+            // files modified in place keep their directory time and are left to the periodic full scan
+            QHash<QString, qint64> journal;
+            if (!mFullyScannedVolumes.contains(volName))
+                db.getDirJournal(volName, journal);
+            _scanLocalFiles(volName, volumeRootDir, journal, scan);
+        }
+        if (!partialScan && (!localFiles.isEmpty() || remoteCount != 0) && mAskGuiCallback!= nullptr) {
+            if (localFiles.isEmpty()) {
+                quint32 count;
+                if (db.getFilesCount(volName, true, count)) {
+                    if (count != 0) {
+                        if (!mAskGuiCallback(tr("Local volume (%1) is empty. Do you want to remove remote files?").arg(volName))) {
+                            db.removeVolumeFiles(volName);
+                        }
+                    }
+                }
+            }
+            else if (remoteCount == 0) {
+                quint32 count;
+                if (db.getFilesCount(volName, false, count)) {
+                    if (count != 0) {
+                        if (!mAskGuiCallback(tr("Remote volume (%1) is empty. Do you want to remove local files?").arg(volName))) {
+                            db.removeVolumeFiles(volName);
+                        }
+                    }
+                }
+            }
+        }
+    }
+
+    const SxCancelToken taskToken = mTaskToken;
+    db.startUpdatingFiles(volName, [taskToken]()->bool {
+                              return taskToken.isCancelled();
+                          });
+    if (listingChanged) {
+        logDebug("update database - remote files");
+        if (db.finishRemoteFiles(volName))
+            mListingDigests.insert(volName, digest);
+        else
+            mListingDigests.remove(volName);
+    }
+    else
+        logVerbose("remote listing unchanged, skipping database update");
+    if (scanLocalFiles) {
+        logDebug("update database - local files");
+        bool marked = true;
+        if (partialScan)
+            marked = db.markChangedDirsFilesToRemove(volName, scan.changedDirs, scan.removedDirs);
+        if (marked && db.updateLocalFiles(volName, localFiles, !partialScan))
+            db.saveDirJournal(volName, scan.dirMTimes);
+        // the periodic scans list the whole volume again
+        mFullyScannedVolumes.insert(volName);
+    }
+    logDebug("select task from database");
+    // the marks are reset with the session, the queue reads them back from a saved copy
+    qint64 generation = db.saveMarkedFiles();
+    if (generation > 0) {
+        QMutexLocker locker(&mMutex);
+        PendingAdmission pending;
+        pending.volume = volName;
+        pending.generation = generation;
+        pending.checkInconsistent = scanLocalFiles;
+        for (SxDatabase::ACTION action : sAdmitOrder) {
+            pending.cursors.append(SxDatabase::MarkedFilesCursor(volName, generation, action, sAdmitPageSize));
+        }
+        SxDatabase::SyncCheckpoint checkpoint;
+        checkpoint.generation = generation;
+        checkpoint.action = sAdmitOrder[0];
+        checkpoint.afterRowId = 0;
+        checkpoint.etag = mEtags.value(volName);
+        checkpoint.listingDigest = mListingDigests.value(volName);
+        checkpoint.remoteCount = remoteCount;
+        // without a listing to compare against on restart the work is not resumable
+        if (!checkpoint.listingDigest.isEmpty())
+            db.saveSyncCheckpoint(volName, checkpoint);
+        mPendingAdmissions.append(pending);
+        _admitMarkedFiles();
+    }
+    if (_aborted()) {
+        clear();
+    }
+
+    db.endUpdatingFiles();
+    return true;
+}
+
+/* queues the marked files an earlier initial scan left checkpointed instead of reconciling
+ * the volume again, provided neither side changed since: the remote etag still matches and
+ * no local directory was modified. Otherwise the saved work is dropped and false returned */
+bool SxQueue::_resumeVolumeFiles(SxVolume *volume, const QString &volumeRootDir)
+{
+    QString volName = volume->name();
+    SxDatabase &db = SxDatabase::instance();
+    QList<SxDatabase::SyncCheckpoint> checkpoints;
+    if (!db.getSyncCheckpoints(volName, checkpoints) || checkpoints.isEmpty())
+        return false;
+    const SxDatabase::SyncCheckpoint &latest = checkpoints.last();
+    bool resumable = mCluster->_locateVolume(volume, 0, 0);
+    if (resumable) {
+        QString etag = latest.etag;
+        QList<SxFileEntry*> fileList;
+        resumable = !mCluster->_listFiles(volume, fileList, etag, QString(), 1) && mCluster->lastError().errorCode() == SxErrorCode::NotChanged;
+        qDeleteAll(fileList);
+    }
+    if (resumable && !_aborted()) {
+        QHash<QString, qint64> journal;
+        db.getDirJournal(volName, journal);
+        LocalScan scan;
+        if (!_takeDeviceScan(volName, scan))
+            _scanLocalFiles(volName, volumeRootDir, journal, scan);
+        resumable = scan.partial && scan.changedDirs.isEmpty() && scan.removedDirs.isEmpty();
+        if (!resumable) {
+            // handed over to the reconciliation instead of walking the volume twice
+            auto deviceScan = std::make_shared<DeviceScan>();
+            deviceScan->cancelled = false;
+            deviceScan->results.insert(volName, scan);
+            QMutexLocker locker(&mMutex);
+            mDeviceScans.insert(volName, deviceScan);
+        }
+    }
+    if (!resumable || _aborted()) {
+        logVerbose(QString("volume %1 changed since it was checkpointed, reconciling it again").arg(volName));
+        foreach (const SxDatabase::SyncCheckpoint &checkpoint, checkpoints) {
+            db.discardMarkedFiles(checkpoint.generation);
+        }
+        return false;
+    }
+    logInfo(QString("volume %1 unchanged, resuming %2 checkpointed generation(s)").arg(volName).arg(checkpoints.count()));
+    mEtags.insert(volName, latest.etag);
+    mListingDigests.insert(volName, latest.listingDigest);
+    mRemoteCounts.insert(volName, latest.remoteCount);
+    mFullyScannedVolumes.insert(volName);
+    QMutexLocker locker(&mMutex);
+    foreach (const SxDatabase::SyncCheckpoint &checkpoint, checkpoints) {
+        PendingAdmission pending;
+        pending.volume = volName;
+        pending.generation = checkpoint.generation;
+        pending.checkInconsistent = true;
+        bool reached = false;
+        for (SxDatabase::ACTION action : sAdmitOrder) {
+            reached = reached || action == checkpoint.action;
+            if (!reached)
+                continue;
+            qint64 afterRowId = action == checkpoint.action ? checkpoint.afterRowId : 0;
+            pending.cursors.append(SxDatabase::MarkedFilesCursor(volName, checkpoint.generation, action, sAdmitPageSize, afterRowId, true));
+        }
+        mPendingAdmissions.append(pending);
+    }
+    _admitMarkedFiles();
+    return true;
+}
+
+void SxQueue::_scanLocalFiles(const QString &volName, const QString &volumeRootDir, const QHash<QString, qint64> &journal, LocalScan &scan)
+{
+    QDir rootDir(volumeRootDir);
+    scan.files.clear();
+    scan.dirMTimes.clear();
+    scan.changedDirs.clear();
+    scan.removedDirs.clear();
+    scan.partial = rootDir.exists() && !journal.isEmpty();
+    scan.time = QDateTime::currentMSecsSinceEpoch();
+    sxProfile("local scan");
+    if (scan.partial) {
+        logDebug("list changed local directories");
+        SxFilesystem::getDirectoryMTimes(rootDir, scan.dirMTimes);
+        for (auto it = scan.dirMTimes.constBegin(); it != scan.dirMTimes.constEnd(); ++it) {
+            if (!journal.contains(it.key()) || journal.value(it.key()) != it.value())
+                scan.changedDirs.append(it.key());
+        }
+        foreach (const QString &dir, journal.keys()) {
+            if (!scan.dirMTimes.contains(dir))
+                scan.removedDirs.append(dir);
+        }
+        foreach (const QString &dir, scan.changedDirs) {
+            SxFilesystem::walkDirectory(QDir(volumeRootDir+dir), false, dir, true, scan.files);
+        }
+        logInfo(QString("volume %1: %2 of %3 directories changed, %4 removed since the last scan")
+                .arg(volName).arg(scan.changedDirs.count()).arg(scan.dirMTimes.count()).arg(scan.removedDirs.count()));
+    }
+    else {
+        logDebug("list local files");
+        SxFilesystem::walkDirectory(rootDir, true, "", true, scan.files, &scan.dirMTimes);
+    }
+}
+
+/* walks the volumes waiting for a background scan while the given one is scanned;
+ * volumes on the device being scanned are left to their own task, each other device
+ * gets a single walker, so walks running at the same time don't share a disk */
+void SxQueue::_startDeviceScans(const QString &volume, const QString &volumeRootDir)
+{
+    quint64 busyDevice;
+    if (!SxFilesystem::getDeviceId(volumeRootDir, busyDevice))
+        return;
+    QStringList volumes;
+    {
+        QMutexLocker locker(&mMutex);
+        foreach (const QString &name, mBackgroundScans) {
+            if (name != volume && !mDeviceScans.contains(name) && !mLockedVolumes.contains(name))
+                volumes.append(name);
+        }
+    }
+    QMap<quint64, QList<QPair<QString, QString>>> devices;
+    foreach (const QString &name, volumes) {
+        if (!mConfig->volumes().contains(name))
+            continue;
+        QString rootDir = mConfig->volume(name).localPath();
+        quint64 device;
+        if (!SxFilesystem::getDeviceId(rootDir, device) || device == busyDevice)
+            continue;
+        devices[device].append({name, rootDir});
+    }
+    SxDatabase &db = SxDatabase::instance();
+    for (auto it = devices.constBegin(); it != devices.constEnd(); ++it) {
+        auto deviceScan = std::make_shared<DeviceScan>();
+        deviceScan->cancelled = false;
+        QList<QHash<QString, qint64>> journals;
+        foreach (auto entry, it.value()) {
+            QHash<QString, qint64> journal;
+            if (!mFullyScannedVolumes.contains(entry.first))
+                db.getDirJournal(entry.first, journal);
+            journals.append(journal);
+            deviceScan->pending.append(entry.first);
+        }
+        {
+            QMutexLocker locker(&mMutex);
+            foreach (const QString &name, deviceScan->pending) {
+                mDeviceScans.insert(name, deviceScan);
+            }
+        }
+        logVerbose(QString("scanning %1 ahead on device %2").arg(deviceScan->pending.join(", ")).arg(it.key()));
+        auto entries = it.value();
+        QtConcurrent::run([deviceScan, entries, journals]() {
+            for (int i=0; i<entries.count(); i++) {
+                {
+                    QMutexLocker scanLocker(&deviceScan->mutex);
+                    if (deviceScan->cancelled)
+                        break;
+                }
+                LocalScan scan;
+                _scanLocalFiles(entries.at(i).first, entries.at(i).second, journals.at(i), scan);
+                QMutexLocker scanLocker(&deviceScan->mutex);
+                deviceScan->pending.removeOne(entries.at(i).first);
+                deviceScan->results.insert(entries.at(i).first, scan);
+                deviceScan->finished.wakeAll();
+            }
+            QMutexLocker scanLocker(&deviceScan->mutex);
+            deviceScan->pending.clear();
+            deviceScan->finished.wakeAll();
+        });
+    }
+}
+
+/* waits for the walker of the volume's device; results too old to trust are dropped */
+bool SxQueue::_takeDeviceScan(const QString &volume, LocalScan &scan)
+{
+    std::shared_ptr<DeviceScan> deviceScan;
+    {
+        QMutexLocker locker(&mMutex);
+        deviceScan = mDeviceScans.take(volume);
+    }
+    if (!deviceScan)
+        return false;
+    QMutexLocker locker(&deviceScan->mutex);
+    while (deviceScan->pending.contains(volume))
+        deviceScan->finished.wait(&deviceScan->mutex);
+    if (!deviceScan->results.contains(volume))
+        return false;
+    scan = deviceScan->results.take(volume);
+    if (QDateTime::currentMSecsSinceEpoch() - scan.time > sDeviceScanMaxAge*1000) {
+        logVerbose("discarding outdated scan of "+volume);
+        return false;
+    }
+    logDebug("using local scan of "+volume+" made ahead");
+    return true;
+}
+
+/* queues the marked files of reloaded volumes page by page, in the order the volumes were
+ * reloaded, until the task list holds sAdmitHighWater tasks; the rest waits in the database.
+ * Called with the queue locked */
+void SxQueue::_admitMarkedFiles()
+{
+    SxDatabase &db = SxDatabase::instance();
+    QList<QString> page;
+    while (!mPendingAdmissions.isEmpty() && mTaskList.count() < sAdmitHighWater) {
+        PendingAdmission &pending = mPendingAdmissions.first();
+        if (pending.cursors.isEmpty()) {
+            db.discardMarkedFiles(pending.generation);
+            mPendingAdmissions.removeFirst();
+            continue;
+        }
+        SxDatabase::MarkedFilesCursor &cursor = pending.cursors.first();
+        qint64 pageStart = cursor.lastRowId();
+        if (!cursor.next(page)) {
+            pending.cursors.removeFirst();
+            continue;
+        }
+        pending.pageStarts.append(qMakePair(cursor.action(), pageStart));
+        if (pending.pageStarts.count() > sCheckpointLagPages) {
+            pending.pageStarts.removeFirst();
+            db.updateSyncCheckpoint(pending.generation, pending.pageStarts.first().first, pending.pageStarts.first().second);
+        }
+        const QString &volume = pending.volume;
+        const QString volumeRootDir = mConfig->volume(volume).localPath();
+        foreach (const QString &file, page) {
+            Task *task = nullptr;
+            switch (cursor.action()) {
+            case SxDatabase::ACTION::UPLOAD:
+                task = new Task(TaskType::UploadFile, volume, file, 0, QFileInfo(volumeRootDir+file).size());
+                break;
+            case SxDatabase::ACTION::REMOVE_REMOTE:
+                db.removeFileBlocks(volume, file);
+                task = new Task(TaskType::RemoveRemoteFile, volume, file, 0, 0);
+                break;
+            case SxDatabase::ACTION::DOWNLOAD: {
+                QStringList inconsistentRevisions;
+                db.getInconsistentFile(volume, file, inconsistentRevisions);
+                if (!inconsistentRevisions.isEmpty() && inconsistentRevisions.contains(db.getRemoteFileRevision(volume, file)))
+                    continue;
+                task = new Task(TaskType::DownloadFile, volume, file, 0, db.getRemoteFileSize(volume, file));
+            } break;
+            case SxDatabase::ACTION::REMOVE_LOCAL: {
+                QStringList inconsistentRevisions;
+                db.getInconsistentFile(volume, file, inconsistentRevisions);
+                if (!inconsistentRevisions.isEmpty()) {
+                    if (pending.checkInconsistent && !mLockedVolumes.contains(volume))
+                        mPendingConsistencyChecks[volume].insert(file);
+                    continue;
+                }
+                task = new Task(TaskType::RemoveLocalFile, volume, file, 0, 0);
+            } break;
+            default:
+                continue;
+            }
+            _appendRegularTask(task);
+        }
+    }
+}
+
+void SxQueue::_emitEtaCounters()
+{
+    emit sig_setEtaCounters(mEtaCounters.uploadCount, mEtaCounters.uploadSize,
+                            mEtaCounters.downloadCount, mEtaCounters.downloadSize,
+                            mEtaCounters.removeCount);
+}
+
+/* the token is replaced only by the queue thread, other threads read it with the queue locked */
+bool SxQueue::_aborted() const
+{
+    return mTaskToken.isCancelled();
 }
 
 void SxQueue::_executeCurrentTask()
@@ -784,8 +1922,9 @@ void SxQueue::_executeCurrentTask()
         }
 
         emit sig_setEtaAction(EtaAction::VolumeInitialScan, taskCount, volName, 0, 0);
+        _startDeviceScans(volName, volumeRootDir);
         QDateTime time = QDateTime::currentDateTime();
-        if (!_reloadVolumeFiles(volume, volumeRootDir, "", true)) {
+        if (!_resumeVolumeFiles(volume, volumeRootDir) && !_reloadVolumeFiles(volume, volumeRootDir, "", true)) {
             if (mCluster->lastError().errorCode() == SxErrorCode::FilterError) {
                 lockVolume(volName);
                 emit sig_addWarning(volName, "", tr("Volume locked due to invalid configuration"), true);
@@ -794,6 +1933,7 @@ void SxQueue::_executeCurrentTask()
         }
         emit sig_removeWarning(volName, "");
         QTimer *timer = new QTimer(this);
+        timer->setProperty("ListFiles", volName);
         timer->setSingleShot(true);
         mTimers.insert(timer);
         connect(timer, &QTimer::timeout, [timer, this, volName]() {
@@ -801,12 +1941,14 @@ void SxQueue::_executeCurrentTask()
             timer->deleteLater();
             this->requestRemoteList(volName);
         });
-        timer->start(qMax(sTimeoutListFiles*1000, static_cast<int>(time.msecsTo(QDateTime::currentDateTime()))*5));
+        int interval = _nextListInterval(volName, true);
+        timer->start(qMax(interval*1000*SxGovernor::instance().policy().timerScale, static_cast<int>(time.msecsTo(QDateTime::currentDateTime()))*5));
     } break;
     case TaskType::ListRemoteFiles: {
         emit sig_setEtaAction(EtaAction::ListRemoteFiles, taskCount, volName, 0, 0);
         QDateTime time = QDateTime::currentDateTime();
-        if (!_reloadVolumeFiles(volume, volumeRootDir, mEtags.value(volName, ""), false)) {
+        QString previousEtag = mEtags.value(volName, "");
+        if (!_reloadVolumeFiles(volume, volumeRootDir, previousEtag, false)) {
             if (mCluster->lastError().errorCode() == SxErrorCode::FilterError) {
                 lockVolume(volName);
                 emit sig_addWarning(volName, "", tr("Volume locked due to invalid configuration"), true);
@@ -822,12 +1964,21 @@ void SxQueue::_executeCurrentTask()
             timer->deleteLater();
             this->requestRemoteList(volName);
         });
-        timer->start(qMax(sTimeoutListFiles*1000, static_cast<int>(time.msecsTo(QDateTime::currentDateTime()))*5));
+        int interval = _nextListInterval(volName, mEtags.value(volName, "") != previousEtag);
+        timer->start(qMax(interval*1000*SxGovernor::instance().policy().timerScale, static_cast<int>(time.msecsTo(QDateTime::currentDateTime()))*5));
     } break;
     case TaskType::UploadFile: {
         QFileInfo info(volumeRootDir+"/"+path);
+        if (_isUnchangedFile(volName, path, info.absoluteFilePath())) {
+            logVerbose(QString("only the metadata of %1%2 changed, skipping upload").arg(volName).arg(path));
+            break;
+        }
+        QList<Task*> batch = _takeEmptyFileBatch(volumeRootDir);
+        if (!batch.isEmpty() && _createEmptyFiles(volume, batch, volumeRootDir, taskCount))
+            break;
         emit sig_setEtaAction(EtaAction::UploadFile, taskCount, path.split("/").last(), info.size(), 0);
         SxFileEntry fileEntry;
+        qint64 replacedSize = SxDatabase::instance().getRemoteFileSize(volName, path);
         if (!mCluster->uploadFile(volume, path, volumeRootDir+"/"+path, fileEntry, mUploadDoneCallback)) {
             if (mCluster->lastError().errorCode() == SxErrorCode::AbortedByUser)
                 return;
@@ -842,6 +1993,7 @@ void SxQueue::_executeCurrentTask()
                 UploadQueue *queue = mPendingUploads.value(volName);
                 mCluster->_locateVolume(volume, 0, 0);
                 queue->addTask(path, size, volume->freeSize());
+                SxSyncStatus::instance().setPending(volName, path);
             }
             else if (mCluster->lastError().errorCode() == SxErrorCode::FilterError) {
                 emit sig_addWarning(volName, "", tr("Volume locked due to invalid configuration"), true);
@@ -859,6 +2011,7 @@ void SxQueue::_executeCurrentTask()
             }
             return;
         }
+        _addVolumeUsage(volName, info.size()-qMax<qint64>(replacedSize, 0));
         SxDatabase::instance().addSuppression(volName, path);
         if (fileEntry.revision().isEmpty())
             SxDatabase::instance().onFileUploaded(volName, fileEntry, false);
@@ -866,56 +2019,14 @@ void SxQueue::_executeCurrentTask()
             SxDatabase::instance().onFileUploaded(volName, fileEntry, true);
             SxDatabase::instance().removeSuppression(volName, fileEntry.path());
         }
+        _storeFingerprint(volName, path, info.absoluteFilePath());
     } break;
     case TaskType::DownloadFile: {
-        qint64 size = SxDatabase::instance().getRemoteFileSize(volName, path);
-        SxFileEntry fileEntry;
-        QString filePath = volumeRootDir;
-        if (path.startsWith("/"))
-            filePath += path;
+        QList<Task*> batch = _takeDownloadBatch(volumeRootDir);
+        if (batch.isEmpty())
+            _downloadFile(mCluster, volume, mCurrentTask, volumeRootDir, taskCount, true);
         else
-            filePath += "/"+path;
-        bool exists = QFileInfo::exists(filePath);
-        emit sig_setEtaAction(EtaAction::DownloadFile, taskCount, path.split("/").last(), size, 0);
-        if (size > 0) {
-            if (!mCluster->downloadFile(volume, path, filePath, fileEntry, sDownloadConnectionsLimit)) {
-                if (mCluster->lastError().errorCode() == SxErrorCode::AbortedByUser)
-                    _reportError(mCurrentTask, mCluster->lastError().errorMessage());
-                if (mCluster->lastError().errorCode() == SxErrorCode::FilterError) {
-                    lockVolume(volName);
-                    emit sig_addWarning(volName, "", tr("Volume locked due to invalid configuration"), true);
-                }
-                else if (mCluster->lastError().errorCode() != SxErrorCode::AbortedByUser){
-                    QString message = QCoreApplication::translate("SxErrorMessage", "Download file %1 failed: %2");
-                    emit sig_addWarning(volName, path,
-                                        message.arg(volName+path).arg(mCluster->lastError().errorMessageTr()),
-                                        false);
-                }
-                return;
-            }
-        }
-        else {
-            QFile file(filePath);
-            QFileInfo fileInfo(filePath);
-            QDir dir;
-            dir.mkpath(fileInfo.absolutePath());
-            if (!file.open(QIODevice::WriteOnly)) {
-                QString message = QCoreApplication::translate("SxErrorMessage", "Download file %1 failed: %2");
-                emit sig_addWarning(volName, path,
-                                    message.arg(volName+path).arg(QCoreApplication::translate("SxErrorMessage", ("unable to open file"))),
-                                    false);
-                qDebug() << message.arg(volName+path).arg(QCoreApplication::translate("SxErrorMessage", ("unable to open file")));
-                return;
-            }
-            file.close();
-            fileInfo.refresh();
-            fileEntry = SxFileEntry(path, 0, SxDatabase::instance().getRemoteFileRevision(volName, path), fileInfo.lastModified().toTime_t());
-        }
-        emit sig_removeWarning(volName, path);
-        emit sig_fileSynchronised(filePath, false);
-        emit sig_fileNotification(volName+path, exists ? "changed" : "added");
-        logDebug(QString("downloaded file '%1' rev '%2'").arg(filePath).arg(fileEntry.revision()));
-        SxDatabase::instance().onFileDownloaded(volName, fileEntry);
+            _downloadFiles(volume, batch, volumeRootDir, taskCount);
     } break;
     case TaskType::RemoveRemoteFile: {
         emit sig_setEtaAction(EtaAction::RemoveRemoteFile, taskCount, path.split("/").last(), 0, 0);
@@ -929,20 +2040,25 @@ void SxQueue::_executeCurrentTask()
             Task *task = mTaskList.first();
             if (task->type() != TaskType::RemoveRemoteFile || task->volume() != volName)
                 break;
+            if (mActivePaths.contains(task->key()))
+                break;
             toRemove.append(task->path());
             mEtaCounters.removeTask(task);
             tasks.insert(task->path(), mTaskList.takeFirst());
-            QString taskPath = task->volume()+"/"+task->path();
-            mTaskByPath.remove(taskPath);
+            mTaskByPath.remove(task->key());
         }
         mMutex.unlock();
 
-        auto onDelete = [volName, &tasks](const QString& path) {
+        qint64 removedSize = 0;
+        auto onDelete = [volName, &tasks, &removedSize](const QString& path) {
+            removedSize += qMax<qint64>(SxDatabase::instance().getRemoteFileSize(volName, path), 0);
             SxDatabase::instance().onRemoteFileRemoved(volName, path);
             tasks.remove(path);
         };
 
-        if (!mCluster->deleteFiles(volume, toRemove, onDelete)) {
+        bool deleted = mCluster->deleteFiles(volume, toRemove, onDelete);
+        _addVolumeUsage(volName, -removedSize);
+        if (!deleted) {
             _reportError(mCurrentTask, mCluster->lastError().errorMessage());
             foreach (Task* task, tasks.values()) {
                 _appendRegularTask(task);
@@ -989,32 +2105,357 @@ void SxQueue::_executeCurrentTask()
             emit sig_removeWarning(volName, path);
         SxDatabase::instance().onLocalFileRemoved(volName, path);
     } break;
+    case TaskType::MoveRemoteFile: {
+        QString source = mCurrentTask->source();
+        emit sig_setEtaAction(EtaAction::MoveRemoteFile, taskCount, path.endsWith("/") ? path.section('/', -2, -2) : path.section('/', -1), 0, 0);
+        if (!mCluster->rename(volume, source, path)) {
+            if (mCluster->lastError().errorCode() == SxErrorCode::AbortedByUser)
+                return;
+            _reportError(mCurrentTask, mCluster->lastError().errorMessage());
+            // a full scan uploads the destination and removes the source instead
+            Task *task = new Task(TaskType::VolumeInitialScan, volName, "", 99, 0);
+            addTask(task);
+            return;
+        }
+        QList<SxFileEntry*> movedFiles;
+        QString etag;
+        if (!mCluster->_listFiles(volume, path, path.endsWith("/"), movedFiles, etag))
+            logWarning(QString("unable to list moved files %1%2").arg(volName).arg(path));
+        SxDatabase::instance().moveFileEntries(volName, source, path, movedFiles);
+        qDeleteAll(movedFiles);
+    } break;
     case TaskType::CheckFileConsistency: {
-        QStringList revisions;
-        if (mCluster->checkFileConsistency(volume, path, revisions))
-            SxDatabase::instance().updateInconsistentFile(volName, path, revisions);
+        QStringList paths;
+        SxCancelToken token;
+        {
+            QMutexLocker locker(&mMutex);
+            auto pending = mPendingConsistencyChecks.find(volName);
+            if (pending == mPendingConsistencyChecks.end())
+                break;
+            for (auto it = pending->begin(); it != pending->end() && paths.count() < sConsistencyCheckBatch; ) {
+                paths.append(*it);
+                it = pending->erase(it);
+            }
+            if (pending->isEmpty())
+                mPendingConsistencyChecks.erase(pending);
+            token = mConsistencyTokens[volName];
+        }
+        // the listings complete on the event loop of this thread, the task is done once they are sent
+        bool async = mCluster->checkFilesConsistencyAsync(volume, paths, token, [this, volName, paths](const SxError &error, const QHash<QString, QStringList> &inconsistent) {
+            --mAsyncConsistencyChecks;
+            if (error.errorCode() == SxErrorCode::NoError)
+                _storeConsistencyCheck(volName, paths, inconsistent);
+            // an aborted batch belongs to a cleared volume, its next scan queues the files again
+            else if (error.errorCode() != SxErrorCode::AbortedByUser)
+                logWarning(QString("failed to check consistency of %1 files in %2").arg(paths.count()).arg(volName));
+            emit sig_start_task();
+        });
+        if (async) {
+            ++mAsyncConsistencyChecks;
+            break;
+        }
+        QHash<QString, QStringList> inconsistent;
+        if (mCluster->checkFilesConsistency(volume, paths, inconsistent))
+            _storeConsistencyCheck(volName, paths, inconsistent);
+        else if (mCluster->lastError().errorCode() == SxErrorCode::AbortedByUser) {
+            QMutexLocker locker(&mMutex);
+            mPendingConsistencyChecks[volName].unite(QSet<QString>::fromList(paths));
+        }
         else
-            logWarning(QString("failed to check file %1%2 consistency").arg(volName).arg(path));
+            logWarning(QString("failed to check consistency of %1 files in %2").arg(paths.count()).arg(volName));
     } break;
     }
 }
 
+void SxQueue::_storeConsistencyCheck(const QString &volume, const QStringList &paths, const QHash<QString, QStringList> &inconsistent)
+{
+    foreach (const QString &file, paths) {
+        QStringList revisions = inconsistent.value(file);
+        SxDatabase::instance().updateInconsistentFile(volume, file, revisions);
+        SxSyncStatus::instance().setConflict(volume, file, !revisions.isEmpty());
+    }
+}
+
+void SxQueue::_downloadFile(SxCluster *cluster, SxVolume *volume, Task *task, const QString &volumeRootDir, qint64 taskCount, bool reportEta)
+{
+    QString volName = task->volume();
+    QString path = task->path();
+    qint64 size = SxDatabase::instance().getRemoteFileSize(volName, path);
+    SxFileEntry fileEntry;
+    QString filePath = volumeRootDir;
+    if (path.startsWith("/"))
+        filePath += path;
+    else
+        filePath += "/"+path;
+    bool exists = QFileInfo::exists(filePath);
+    if (reportEta)
+        emit sig_setEtaAction(EtaAction::DownloadFile, taskCount, path.split("/").last(), size, 0);
+    if (size > 0) {
+        if (!cluster->downloadFile(volume, path, filePath, fileEntry, sDownloadConnectionsLimit)) {
+            if (cluster->lastError().errorCode() == SxErrorCode::AbortedByUser)
+                _reportError(task, cluster->lastError().errorMessage());
+            if (cluster->lastError().errorCode() == SxErrorCode::FilterError) {
+                QMetaObject::invokeMethod(this, "lockVolume", Qt::AutoConnection, Q_ARG(QString, volName));
+                emit sig_addWarning(volName, "", tr("Volume locked due to invalid configuration"), true);
+            }
+            else if (cluster->lastError().errorCode() != SxErrorCode::AbortedByUser){
+                QString message = QCoreApplication::translate("SxErrorMessage", "Download file %1 failed: %2");
+                emit sig_addWarning(volName, path,
+                                    message.arg(volName+path).arg(cluster->lastError().errorMessageTr()),
+                                    false);
+            }
+            return;
+        }
+    }
+    else {
+        QFile file(filePath);
+        QFileInfo fileInfo(filePath);
+        QDir dir;
+        dir.mkpath(fileInfo.absolutePath());
+        if (!file.open(QIODevice::WriteOnly)) {
+            QString message = QCoreApplication::translate("SxErrorMessage", "Download file %1 failed: %2");
+            emit sig_addWarning(volName, path,
+                                message.arg(volName+path).arg(QCoreApplication::translate("SxErrorMessage", ("unable to open file"))),
+                                false);
+            qDebug() << message.arg(volName+path).arg(QCoreApplication::translate("SxErrorMessage", ("unable to open file")));
+            return;
+        }
+        file.close();
+        fileInfo.refresh();
+        fileEntry = SxFileEntry(path, 0, SxDatabase::instance().getRemoteFileRevision(volName, path), fileInfo.lastModified().toTime_t());
+    }
+    _onFileDownloaded(volName, filePath, exists, fileEntry);
+}
+
+void SxQueue::_onFileDownloaded(const QString &volName, const QString &filePath, bool existed, const SxFileEntry &fileEntry)
+{
+    _notifyFileDownloaded(volName, filePath, existed, fileEntry);
+    SxDatabase::instance().onFileDownloaded(volName, fileEntry);
+    _storeFingerprint(volName, fileEntry.path(), filePath);
+}
+
+void SxQueue::_notifyFileDownloaded(const QString &volName, const QString &filePath, bool existed, const SxFileEntry &fileEntry)
+{
+    QString path = fileEntry.path();
+    emit sig_removeWarning(volName, path);
+    emit sig_fileSynchronised(filePath, false);
+    emit sig_fileNotification(volName+path, existed ? "changed" : "added");
+    logDebug(QString("downloaded file '%1' rev '%2'").arg(filePath).arg(fileEntry.revision()));
+}
+
+/* takes the small downloads queued right behind the current one, for fetching them
+ * together with SxCluster::downloadFiles() */
+QList<SxQueue::Task*> SxQueue::_takeDownloadBatch(const QString &volumeRootDir)
+{
+    QList<Task*> batch;
+    QString path = mCurrentTask->path();
+    if (mCurrentTask->size() > sBatchDownloadSize || QFileInfo::exists(volumeRootDir + (path.startsWith("/") ? path : "/"+path)))
+        return batch;
+    QMutexLocker locker(&mMutex);
+    while (batch.count() < sBatchDownloadLimit && !mTaskList.isEmpty()) {
+        Task *task = mTaskList.first();
+        if (task->type() != TaskType::DownloadFile || task->volume() != mCurrentTask->volume())
+            break;
+        if (task->size() > sBatchDownloadSize || mActivePaths.contains(task->key()))
+            break;
+        mEtaCounters.removeTask(task);
+        batch.append(mTaskList.takeFirst());
+        mTaskByPath.remove(task->key());
+        mActivePaths.insert(task->key());
+        SxSyncStatus::instance().setSyncing(task->volume(), task->path());
+    }
+    return batch;
+}
+
+void SxQueue::_downloadFiles(SxVolume *volume, const QList<Task*> &batch, const QString &volumeRootDir, qint64 taskCount)
+{
+    QString volName = mCurrentTask->volume();
+    QList<Task*> tasks = batch;
+    tasks.prepend(mCurrentTask);
+    QList<QPair<QString, QString>> files;
+    QHash<QString, bool> existed;
+    qint64 size = 0;
+    foreach (Task *task, tasks) {
+        QString filePath = volumeRootDir + (task->path().startsWith("/") ? task->path() : "/"+task->path());
+        files.append({task->path(), filePath});
+        existed.insert(task->path(), QFileInfo::exists(filePath));
+        size += task->size();
+    }
+    emit sig_setEtaAction(EtaAction::DownloadFile, taskCount, mCurrentTask->path().split("/").last(), size, 0);
+    QHash<QString, SxFileEntry> fileEntries;
+    bool ok = mCluster->downloadFiles(volume, files, fileEntries, sDownloadConnectionsLimit);
+    bool aborted = !ok && mCluster->lastError().errorCode() == SxErrorCode::AbortedByUser;
+    // the files put in place together are recorded in one transaction, they are all below
+    // the fingerprint size
+    QList<SxFileEntry> downloaded;
+    for (int i=0; i<tasks.count(); i++) {
+        Task *task = tasks.at(i);
+        auto entry = fileEntries.constFind(task->path());
+        if (entry != fileEntries.constEnd()) {
+            _notifyFileDownloaded(volName, files.at(i).second, existed.value(task->path()), entry.value());
+            downloaded.append(entry.value());
+        }
+        else if (aborted) {
+            if (task == mCurrentTask)
+                _reportError(task, mCluster->lastError().errorMessage());
+            else {
+                QMutexLocker locker(&mMutex);
+                mActivePaths.remove(task->key());
+                SxSyncStatus::instance().setPending(task->volume(), task->path());
+                _appendRegularTask(task);
+                continue;
+            }
+        }
+        else
+            _downloadFile(mCluster, volume, task, volumeRootDir, taskCount, task == mCurrentTask);
+        if (task != mCurrentTask) {
+            QMutexLocker locker(&mMutex);
+            mActivePaths.remove(task->key());
+            SxSyncStatus::instance().finish(task->volume(), task->path());
+            delete task;
+        }
+    }
+    if (!downloaded.isEmpty())
+        SxDatabase::instance().onFilesDownloaded(volName, downloaded);
+}
+
+static bool isEmptyDirMarker(const QString &path, qint64 size)
+{
+    return size == 0 && path.endsWith("/.sxnewdir");
+}
+
+/* takes the empty directory markers queued right behind the current one, for creating
+ * them together with SxCluster::createEmptyFiles() */
+QList<SxQueue::Task*> SxQueue::_takeEmptyFileBatch(const QString &volumeRootDir)
+{
+    QList<Task*> batch;
+    QString path = mCurrentTask->path();
+    if (!isEmptyDirMarker(path, QFileInfo(volumeRootDir+"/"+path).size()))
+        return batch;
+    QMutexLocker locker(&mMutex);
+    while (batch.count() < sEmptyFilesBatchLimit && !mTaskList.isEmpty()) {
+        Task *task = mTaskList.first();
+        if (task->type() != TaskType::UploadFile || task->volume() != mCurrentTask->volume())
+            break;
+        if (!isEmptyDirMarker(task->path(), task->size()) || mActivePaths.contains(task->key()))
+            break;
+        mEtaCounters.removeTask(task);
+        batch.append(mTaskList.takeFirst());
+        mTaskByPath.remove(task->key());
+        mActivePaths.insert(task->key());
+        SxSyncStatus::instance().setSyncing(task->volume(), task->path());
+    }
+    return batch;
+}
+
+/* returns false when the current marker is left to the regular upload, which reports
+ * its error; the other markers not created are queued again */
+bool SxQueue::_createEmptyFiles(SxVolume *volume, const QList<Task*> &batch, const QString &volumeRootDir, qint64 taskCount)
+{
+    QString volName = mCurrentTask->volume();
+    QList<Task*> tasks = batch;
+    tasks.prepend(mCurrentTask);
+    QList<QPair<QString, quint32>> files;
+    SxDatabase &db = SxDatabase::instance();
+    foreach (Task *task, tasks) {
+        QFileInfo info(volumeRootDir+"/"+task->path());
+        files.append({task->path(), info.lastModified().toTime_t()});
+        db.addSuppression(volName, task->path());
+    }
+    emit sig_setEtaAction(EtaAction::UploadFile, taskCount, mCurrentTask->path().split("/").last(), 0, 0);
+    QStringList created;
+    bool ok = mCluster->createEmptyFiles(volume, files, created, mUploadDoneCallback);
+    bool aborted = !ok && mCluster->lastError().errorCode() == SxErrorCode::AbortedByUser;
+    QSet<QString> createdSet = created.toSet();
+    bool result = true;
+    foreach (Task *task, tasks) {
+        if (createdSet.contains(task->path()))
+            db.onFileUploaded(volName, SxFileEntry(task->path(), 0), false);
+        else {
+            db.removeSuppression(volName, task->path());
+            if (task == mCurrentTask) {
+                if (aborted)
+                    _reportError(task, mCluster->lastError().errorMessage());
+                else
+                    result = false;
+            }
+            else {
+                QMutexLocker locker(&mMutex);
+                mActivePaths.remove(task->key());
+                SxSyncStatus::instance().setPending(task->volume(), task->path());
+                _appendRegularTask(task);
+                continue;
+            }
+        }
+        if (task != mCurrentTask) {
+            QMutexLocker locker(&mMutex);
+            mActivePaths.remove(task->key());
+            SxSyncStatus::instance().finish(task->volume(), task->path());
+            delete task;
+        }
+    }
+    return result;
+}
+
+// keeps the free size predicted for uploads waiting on the volume's quota current
+void SxQueue::_addVolumeUsage(const QString &volume, qint64 bytes)
+{
+    QMutexLocker locker(&mMutex);
+    UploadQueue *queue = mPendingUploads.value(volume);
+    if (queue != nullptr)
+        queue->addUsedBytes(bytes);
+}
+
+/* a touched file of the same size, still the same inode, is taken as unchanged
+ * when its change time or a sample of its content matches the last synchronised state */
+bool SxQueue::_isUnchangedFile(const QString &volume, const QString &path, const QString &localFile)
+{
+    SxDatabase &db = SxDatabase::instance();
+    SxFingerprint stored;
+    SxFingerprint current;
+    if (!db.getFingerprint(volume, path, stored) || !SxFilesystem::getFingerprint(localFile, false, current))
+        return false;
+    if (current.size < sFingerprintMinSize || current.size != stored.size || current.inode != stored.inode)
+        return false;
+    QFileInfo fileInfo(localFile);
+    if (current.cTime != 0 && current.cTime == stored.cTime)
+        current.sample = stored.sample;
+    else if (!SxFilesystem::getFingerprint(localFile, true, current) || current.sample != stored.sample)
+        return false;
+    if (!db.acceptUnchangedFile(volume, path, fileInfo.lastModified().toTime_t()))
+        return false;
+    db.updateFingerprint(volume, path, current);
+    return true;
+}
+
+void SxQueue::_storeFingerprint(const QString &volume, const QString &path, const QString &localFile)
+{
+    SxFingerprint fingerprint;
+    QFileInfo fileInfo(localFile);
+    if (fileInfo.size() < sFingerprintMinSize || !SxFilesystem::getFingerprint(localFile, true, fingerprint))
+        return;
+    SxDatabase::instance().updateFingerprint(volume, path, fingerprint);
+}
+
 SxQueue::Task::Task(const SxQueue::TaskType &type, const QString &volume, const QString &path, const int &priority, qint64 size)
-    : mId(sCounter++)
+    : mId(sCounter++), mCensus(sizeof(Task))
 {
     //logInfo(QString("create task: %1").arg(mId));
     mType = type;
-    mVolume = volume;
-    mPath = path;
+    mKey = SxPathTable::instance().intern(volume, path);
     mPriority = priority;
     mSize = size;
-    sLivingTasks.insert(mId);
+    mBucket = 0;
+    mQueuedTime = 0;
+    mQueued = false;
+    mBoosted = false;
+    mPreemptions = 0;
+    mRetries = 0;
 }
 
 SxQueue::Task::~Task()
 {
     //logInfo(QString("delete task: %1").arg(mId));
-    sLivingTasks.remove(mId);
 }
 
 SxQueue::TaskType SxQueue::Task::type() const
@@ -1024,12 +2465,27 @@ SxQueue::TaskType SxQueue::Task::type() const
 
 QString SxQueue::Task::volume() const
 {
-    return mVolume;
+    return SxPathTable::instance().volume(mKey);
 }
 
 QString SxQueue::Task::path() const
 {
-    return mPath;
+    return SxPathTable::instance().path(mKey);
+}
+
+SxPathKey SxQueue::Task::key() const
+{
+    return mKey;
+}
+
+QString SxQueue::Task::source() const
+{
+    return mSource;
+}
+
+void SxQueue::Task::setSource(const QString &source)
+{
+    mSource = source;
 }
 
 qint64 SxQueue::Task::size() const
@@ -1042,6 +2498,31 @@ int SxQueue::Task::priority() const
     return mPriority;
 }
 
+bool SxQueue::Task::boosted() const
+{
+    return mBoosted;
+}
+
+int SxQueue::Task::preemptions() const
+{
+    return mPreemptions;
+}
+
+void SxQueue::Task::addPreemption()
+{
+    mPreemptions++;
+}
+
+int SxQueue::Task::retries() const
+{
+    return mRetries;
+}
+
+void SxQueue::Task::addRetry()
+{
+    mRetries++;
+}
+
 quint64 SxQueue::Task::id() const
 {
     return  mId;
@@ -1053,46 +2534,46 @@ bool SxQueue::Task::equal(const SxQueue::Task &other) const
         return false;
     if (mType != other.mType)
         return false;
-    if (mVolume != other.mVolume)
+    if (mKey != other.mKey)
         return false;
-    if (mPath != other.mPath)
+    if (mSource != other.mSource)
         return false;
     return true;
 }
 
-QString SxQueue::Task::toString() const
+QString SxQueue::Task::typeName(TaskType type)
 {
-    QString result = "Task {type: ";
-    switch (mType) {
+    switch (type) {
     case TaskType::ListClusterNodes:
-        result += "ListClusterNodes";
-        break;
+        return "ListClusterNodes";
     case TaskType::ListVolumes:
-        result += "ListVolumes";
-        break;
+        return "ListVolumes";
     case TaskType::VolumeInitialScan:
-        result += "VolumeInitialScan";
-        break;
+        return "VolumeInitialScan";
     case TaskType::ListRemoteFiles:
-        result += "ListRemoteFiles";
-        break;
+        return "ListRemoteFiles";
     case TaskType::UploadFile:
-        result += "UploadFile";
-        break;
+        return "UploadFile";
     case TaskType::DownloadFile:
-        result += "DownloadFile";
-        break;
+        return "DownloadFile";
     case TaskType::RemoveRemoteFile:
-        result += "RemoveRemoteFile";
-        break;
+        return "RemoveRemoteFile";
     case TaskType::RemoveLocalFile:
-        result += "RemoveLocalFile";
-        break;
+        return "RemoveLocalFile";
     case TaskType::CheckFileConsistency:
-        result += "CheckFileConsistency";
-        break;
+        return "CheckFileConsistency";
+    case TaskType::MoveRemoteFile:
+        return "MoveRemoteFile";
     }
-    result += QString(", volume: \"%1\", path: \"%2\"}").arg(mVolume, mPath);
+    return QString();
+}
+
+QString SxQueue::Task::toString() const
+{
+    QString result = "Task {type: " + typeName(mType);
+    if (!mSource.isEmpty())
+        result += QString(", source: \"%1\"").arg(mSource);
+    result += QString(", volume: \"%1\", path: \"%2\"}").arg(volume(), path());
     return result;
 }
 
@@ -1142,3 +2623,170 @@ void SxQueue::EtaCounters::clear()
     uploadSize = 0;
     downloadSize = 0;
 }
+
+SxQueue::TaskList::TaskList()
+{
+    mCount = 0;
+    mSmallTaskSize = 0;
+    mMaxWait = 0;
+    mLastLargeTaskTime = 0;
+}
+
+void SxQueue::TaskList::setSchedule(qint64 smallTaskSize, int maxWait)
+{
+    mSmallTaskSize = smallTaskSize;
+    mMaxWait = static_cast<qint64>(maxWait)*1000;
+}
+
+bool SxQueue::TaskList::isEmpty() const
+{
+    return mCount == 0;
+}
+
+int SxQueue::TaskList::count() const
+{
+    return mCount;
+}
+
+int SxQueue::TaskList::bucket(const SxQueue::Task *task) const
+{
+    if (task->mBoosted)
+        return sBoostedBucket;
+    if (task->priority() == 0 && mSmallTaskSize > 0 && task->size() >= mSmallTaskSize
+            && (task->type() == TaskType::UploadFile || task->type() == TaskType::DownloadFile))
+        return sLargeTasksBucket;
+    return task->priority();
+}
+
+QList<const std::list<SxQueue::Task *> *> SxQueue::TaskList::orderedBuckets() const
+{
+    QList<const std::list<Task*>*> result;
+    auto large = mBuckets.find(sLargeTasksBucket);
+    bool promoteLarge = false;
+    if (large != mBuckets.end() && mBuckets.begin()->first <= 0) {
+        qint64 waitingSince = qMax(large->second.front()->mQueuedTime, mLastLargeTaskTime);
+        promoteLarge = QDateTime::currentMSecsSinceEpoch() - waitingSince >= mMaxWait;
+    }
+    if (promoteLarge)
+        result.append(&large->second);
+    for (auto it = mBuckets.begin(); it != mBuckets.end(); it++) {
+        if (!promoteLarge || it != large)
+            result.append(&it->second);
+    }
+    return result;
+}
+
+SxQueue::Task *SxQueue::TaskList::first() const
+{
+    if (mBuckets.empty())
+        return nullptr;
+    return orderedBuckets().first()->front();
+}
+
+SxQueue::Task *SxQueue::TaskList::last() const
+{
+    if (mBuckets.empty())
+        return nullptr;
+    return mBuckets.rbegin()->second.back();
+}
+
+SxQueue::Task *SxQueue::TaskList::takeFirst()
+{
+    Task *task = first();
+    if (task != nullptr)
+        remove(task);
+    return task;
+}
+
+void SxQueue::TaskList::append(SxQueue::Task *task)
+{
+    task->mBucket = bucket(task);
+    std::list<Task*> &list = mBuckets[task->mBucket];
+    task->mPosition = list.insert(list.end(), task);
+    task->mQueuedTime = QDateTime::currentMSecsSinceEpoch();
+    task->mQueued = true;
+    mCount++;
+}
+
+void SxQueue::TaskList::prepend(SxQueue::Task *task)
+{
+    task->mBucket = bucket(task);
+    std::list<Task*> &list = mBuckets[task->mBucket];
+    task->mPosition = list.insert(list.begin(), task);
+    if (task->mQueuedTime == 0)
+        task->mQueuedTime = QDateTime::currentMSecsSinceEpoch();
+    task->mQueued = true;
+    mCount++;
+}
+
+/* moves a queued task to the front of the boosted bucket, it stays there if it is requeued */
+void SxQueue::TaskList::boost(SxQueue::Task *task)
+{
+    if (!remove(task))
+        return;
+    task->mBoosted = true;
+    prepend(task);
+}
+
+bool SxQueue::TaskList::remove(SxQueue::Task *task)
+{
+    if (!task->mQueued)
+        return false;
+    auto list = mBuckets.find(task->mBucket);
+    list->second.erase(task->mPosition);
+    if (list->second.empty())
+        mBuckets.erase(list);
+    if (task->mBucket == sLargeTasksBucket)
+        mLastLargeTaskTime = QDateTime::currentMSecsSinceEpoch();
+    task->mQueued = false;
+    mCount--;
+    return true;
+}
+
+SxQueue::Task *SxQueue::TaskList::findEqual(const SxQueue::Task *task) const
+{
+    auto list = mBuckets.find(bucket(task));
+    if (list == mBuckets.end())
+        return nullptr;
+    for (Task *other : list->second) {
+        if (other->equal(*task))
+            return other;
+    }
+    return nullptr;
+}
+
+SxQueue::Task *SxQueue::TaskList::findFirst(std::function<bool (const SxQueue::Task *)> predicate, int limit) const
+{
+    foreach (const std::list<Task*> *list, orderedBuckets()) {
+        for (Task *task : *list) {
+            if (limit-- == 0)
+                return nullptr;
+            if (predicate(task))
+                return task;
+        }
+    }
+    return nullptr;
+}
+
+QList<SxQueue::Task *> SxQueue::TaskList::tasks() const
+{
+    QList<Task*> result;
+    result.reserve(mCount);
+    for (auto list = mBuckets.begin(); list != mBuckets.end(); list++) {
+        for (Task *task : list->second) {
+            result.append(task);
+        }
+    }
+    return result;
+}
+
+void SxQueue::TaskList::clear()
+{
+    for (auto list = mBuckets.begin(); list != mBuckets.end(); list++) {
+        for (Task *task : list->second) {
+            task->mQueued = false;
+        }
+    }
+    mBuckets.clear();
+    mCount = 0;
+}
@@ -30,22 +30,34 @@
 #define SXQUEUE_H
 
 #include "sxconfig.h"
+#include "sxdatabase.h"
 #include <QFile>
 #include <QHash>
+#include <QMap>
 #include <QMutex>
 #include <QObject>
 #include <QSet>
 #include <QSslCertificate>
+#include <QThreadPool>
 #include <QTimer>
+#include <QWaitCondition>
 #include <memory>
 #include "sxstate.h"
 #include "sxauth.h"
+#include "sxcanceltoken.h"
 #include "uploadqueue.h"
 #include "sxerror.h"
+#include "sxfilesystem.h"
+#include "sxpathtable.h"
+#include "sxcensus.h"
 #include <functional>
+#include <list>
+#include <map>
 
 class SxVolume;
 class SxCluster;
+class SxTransferLane;
+class SxPeerExchange;
 
 enum class EtaAction {
     Idle,
@@ -58,7 +70,8 @@ enum class EtaAction {
     UploadFile,
     DownloadFile,
     RemoveRemoteFile,
-    RemoveLocalFile
+    RemoveLocalFile,
+    MoveRemoteFile
 };
 
 Q_DECLARE_METATYPE(EtaAction);
@@ -75,9 +88,12 @@ class SxQueue : public QObject
         DownloadFile,
         RemoveRemoteFile,
         RemoveLocalFile,
-        CheckFileConsistency
+        CheckFileConsistency,
+        MoveRemoteFile
     };
 
+    class TaskList;
+
     class Task {
     public:
         Task(const TaskType &type, const QString &volume, const QString &path, const int &priority, qint64 size);
@@ -85,21 +101,71 @@ class SxQueue : public QObject
         TaskType type() const;
         QString volume() const;
         QString path() const;
+        SxPathKey key() const;
+        QString source() const;
+        void setSource(const QString &source);
         qint64 size() const;
         int priority() const;
+        bool boosted() const;
+        int preemptions() const;
+        void addPreemption();
+        int retries() const;
+        void addRetry();
         quint64 id() const;
         bool equal(const Task& other) const;
         QString toString() const;
+        static QString typeName(TaskType type);
     private:
         TaskType mType;
-        QString mVolume;
-        QString mPath;
+        SxPathKey mKey;
+        QString mSource;
         int mPriority;
         qint64 mSize;
         const quint64 mId;
         static quint64 sCounter;
+        std::list<Task*>::iterator mPosition;
+        int mBucket;
+        qint64 mQueuedTime;
+        bool mQueued;
+        bool mBoosted;
+        int mPreemptions;
+        int mRetries;
+        SxCensusEntry<SxCensus::Task> mCensus;
+        friend class TaskList;
+    };
+
+    /* tasks bucketed by priority, FIFO within a bucket; every task keeps
+     * its position so it can be removed without searching.
+     * Regular transfers above the small task size wait in their own bucket
+     * behind small ones, until the oldest of them has waited for maxWait */
+    class TaskList {
     public:
-        static QSet<quint64> sLivingTasks;
+        TaskList();
+        void setSchedule(qint64 smallTaskSize, int maxWait);
+        bool isEmpty() const;
+        int count() const;
+        Task *first() const;
+        Task *last() const;
+        Task *takeFirst();
+        void append(Task *task);
+        void prepend(Task *task);
+        void boost(Task *task);
+        bool remove(Task *task);
+        Task *findEqual(const Task *task) const;
+        Task *findFirst(std::function<bool(const Task*)> predicate, int limit = -1) const;
+        QList<Task*> tasks() const;
+        void clear();
+    private:
+        int bucket(const Task *task) const;
+        QList<const std::list<Task*>*> orderedBuckets() const;
+        std::map<int, std::list<Task*>, std::greater<int>> mBuckets;
+        int mCount;
+        qint64 mSmallTaskSize;
+        qint64 mMaxWait;
+        qint64 mLastLargeTaskTime;
+        static const int sLargeTasksBucket = -1;
+        // behind cluster and volume scans, ahead of every other task
+        static const int sBoostedBucket = 98;
     };
 
 public:
@@ -113,13 +179,19 @@ public:
     void setPaused(bool paused);
     bool paused();
     bool abortCurrentTask();
+    void setPeerExchange(SxPeerExchange *peerExchange);
 
 public slots:
     void requestInitialScan();
     void localFileModified(QString volume, QString path, bool removed, qint64 size);
+    void localFilesModified(const QList<SxFileChange> &changes);
+    void localFileMoved(const QString &volume, const QString &source, const QString &destination);
+    void scanChangedDirs(const QString &volume);
     void cancelUploadTask(const QString &volume, const QString &path);
     void unlockVolume(const QString& volume);
     void onPossibleInconsistency(const QString &volume, const QString &path);
+    void boostPaths(const QString &volume, const QStringList &paths);
+    void speculateUpload(const QString &volume, const QString &path, qint64 size);
 
 signals:
     void sig_start_task();
@@ -143,34 +215,169 @@ private slots:
     void startCurrentTask();
     void deleteTimers();
     void lockVolume(const QString& volume);
+    void runDatabaseMaintenance();
 
 private:
     bool _appendRegularTask(Task* task);
     void _instertPriorityTask(Task* task);
     void _executeCurrentTask();
     void _finishCurrentTask();
+    Task *_takeNextTask();
+    Task *_takeBackgroundScan();
+    Task *_takeConsistencyCheck();
+    void _storeConsistencyCheck(const QString &volume, const QStringList &paths, const QHash<QString, QStringList> &inconsistent);
+    int _nextListInterval(const QString &volume, bool changed);
+    void _resetListInterval(const QString &volume);
+    void _prepareNextUploads();
+    bool _takePreparedBlocks(const QString &volume, const QString &path, int blockSize, QVector<QPair<quint64, QString>> &blocks);
+    bool _takeSpeculativeBlocks(const QString &localFile, int blockSize, QVector<QPair<quint64, QString>> &blocks);
+    bool _isLargeTransfer(const Task *task) const;
+    static bool _isFileTask(const Task *task);
+    void _startLargeTransfer(qint64 downloadLimit);
+    void _finishLargeTransfer(Task *task, bool requeue);
+    bool _isPreemptible(const Task *task) const;
+    void _preemptCurrentTask(const Task *waiting);
+    void _onNetworkError();
+    void _scheduleConnectivityProbe();
+    void _probeConnectivity();
+    void _scheduleRetry(Task *task);
+    void _scheduleRetryTimer();
+    void _releaseRetries(bool all);
+    bool _isUnchangedFile(const QString &volume, const QString &path, const QString &localFile);
+    void _storeFingerprint(const QString &volume, const QString &path, const QString &localFile);
+    void _downloadFile(SxCluster *cluster, SxVolume *volume, Task *task, const QString &volumeRootDir, qint64 taskCount, bool reportEta);
+    void _onFileDownloaded(const QString &volName, const QString &filePath, bool existed, const SxFileEntry &fileEntry);
+    void _notifyFileDownloaded(const QString &volName, const QString &filePath, bool existed, const SxFileEntry &fileEntry);
+    QList<Task*> _takeDownloadBatch(const QString &volumeRootDir);
+    void _downloadFiles(SxVolume *volume, const QList<Task*> &batch, const QString &volumeRootDir, qint64 taskCount);
+    void _addVolumeUsage(const QString &volume, qint64 bytes);
+    QList<Task*> _takeEmptyFileBatch(const QString &volumeRootDir);
+    bool _createEmptyFiles(SxVolume *volume, const QList<Task*> &batch, const QString &volumeRootDir, qint64 taskCount);
     bool _reloadVolumeFiles(SxVolume *volume, const QString &volumeRootDir, const QString &etag, bool scanLocalFiles);
+    bool _resumeVolumeFiles(SxVolume *volume, const QString &volumeRootDir);
+    struct LocalScan;
+    static void _scanLocalFiles(const QString &volName, const QString &volumeRootDir, const QHash<QString, qint64> &journal, LocalScan &scan);
+    void _startDeviceScans(const QString &volume, const QString &volumeRootDir);
+    bool _takeDeviceScan(const QString &volume, LocalScan &scan);
+    void _admitMarkedFiles();
+    void _scheduleDatabaseMaintenance();
     void _emitEtaCounters();
     bool _aborted() const;
     bool getLocalBlocks(QFile *file, qint64 fileSize, int blockSize, const QStringList &fileBlocks, QSet<QString> &missingBlocks);
     bool findIdenticalFiles(const QString& volume, qint64 fileSize, int blockSize, const QStringList &fileBlocks, QList<QPair<QString, quint32>>& files);
+    bool findCopySource(const QString& volume, const QString &path, const QString &localFile, qint64 fileSize, int &blockSize, QStringList &fileBlocks);
 
     static const int sDownloadConnectionsLimit = 0; //use volume nodes count
-    static const int sRemoveRemoteFilesLimit = 10;
+    static const int sRemoveRemoteFilesLimit = 100;
+    static const qint64 sBatchDownloadSize = 256*1024;
+    static const int sBatchDownloadLimit = 63;
+    static const int sEmptyFilesBatchLimit = 1000;
     static const int sTimeoutFullScan = 60*60;
     static const int sTimeoutListVolumes = 15;
     static const int sTimeoutListFiles = 15;
+    static const int sTimeoutListFilesMax = 5*60;
+    static const int sBackgroundScanInterleave = 16;
+    static const int sDeviceScanMaxAge = 5*60;
+    static const qint64 sMaxScanDeferral = 4*60*60;
+    static const int sConsistencyCheckBatch = 1000;
+    static const int sAsyncConsistencyChecks = 4;
+    static const qint64 sLargeTransferSize = 64*1024*1024;
+    static const int sLargeTransferLookahead = 1000;
+    static const qint64 sInteractiveTaskSize = 4*1024*1024;
+    static const int sMaxPreemptions = 8;
+    static const int sOfflineThreshold = 3;
+    static const int sRetryDelay = 5;
+    static const int sMaxRetryDelay = 10*60;
+    static const int sMaxRetries = 8;
+    static const int sProbeDelay = 5;
+    static const int sMaxProbeDelay = 5*60;
+    static const int sPagedListingThreshold = 50000;
+    static const qint64 sCopyDetectionMinSize = 4*1024*1024;
+    static const int sCopyCandidatesLimit = 4;
+    static const qint64 sFingerprintMinSize = 16*1024*1024;
+    static const qint64 sPrepareMinSize = 4*1024*1024;
+    static const int sPrepareAhead = 2;
+    static const int sPrepareLookahead = 50;
+    static const int sSpeculativeHashesLimit = 64;
+    static const qint64 sSpeculativeHashMaxAge = 5*60*1000;
+    static const int sAdmitPageSize = 1000;
+    static const int sAdmitLowWater = 5000;
+    static const int sAdmitHighWater = 20000;
+    // a checkpoint trails admission by a full task list, admitted tasks may not have run yet
+    static const int sCheckpointLagPages = sAdmitHighWater/sAdmitPageSize + 1;
+    static const int sMaintenanceIdleDelay = 60;
+    static const int sMaintenanceInterval = 30*60;
+    static const int sVacuumStepPages = 1000;
+    static const int sCensusLogInterval = 10*60;
 
     SxConfig *mConfig;
     SxCluster *mCluster;
     Task* mCurrentTask;
-    QList<Task*> mTaskList;
-    QHash<QString, Task*> mTaskByPath;
+    bool mPreempting;
+    SxTransferLane *mLargeTransferLane;
+    SxPeerExchange *mPeerExchange;
+    QSet<SxPathKey> mActivePaths;
+    TaskList mTaskList;
+    QHash<SxPathKey, Task*> mTaskByPath;
     QHash<QString, QString> mEtags;
+    QHash<QString, QByteArray> mListingDigests;
+    QHash<QString, int> mRemoteCounts;
+    QHash<QString, int> mListIntervals;
+    QSet<QString> mFullyScannedVolumes;
+    QStringList mBackgroundScans;
+    int mTasksSinceBackgroundScan;
+    // consecutive tasks failed with a network error, the queue is parked once they reach
+    // sOfflineThreshold until a connectivity probe gets through
+    int mNetworkFailures;
+    bool mOffline;
+    int mProbeAttempts;
+    // file tasks failed with a network error, by the time they are queued again
+    QMultiMap<qint64, Task*> mRetryTasks;
+    qint64 mHeavyWorkDeferredSince;
+    QHash<QString, QSet<QString>> mPendingConsistencyChecks;
+    // batches checked on the event loop of the queue thread while other tasks run, accessed
+    // only by the queue thread; clearing a volume cancels its batches through its token
+    int mAsyncConsistencyChecks;
+    QHash<QString, SxCancelToken> mConsistencyTokens;
+    // marked files of reloaded volumes not queued yet, admitted as the task list drains
+    struct PendingAdmission {
+        QString volume;
+        qint64 generation;
+        bool checkInconsistent;
+        QList<SxDatabase::MarkedFilesCursor> cursors;
+        // where the recently admitted pages started, the oldest one is checkpointed
+        QList<QPair<SxDatabase::ACTION, qint64>> pageStarts;
+    };
+    QList<PendingAdmission> mPendingAdmissions;
+    // the local half of a volume scan, an empty journal means a full scan
+    struct LocalScan {
+        QVector<SxLocalFile> files;
+        QHash<QString, qint64> dirMTimes;
+        QStringList changedDirs;
+        QStringList removedDirs;
+        bool partial;
+        qint64 time;
+    };
+    /* volumes waiting for a background scan are walked ahead of their task, one walker
+     * per device; the results are picked up when the task runs */
+    struct DeviceScan {
+        QMutex mutex;
+        QWaitCondition finished;
+        QStringList pending;
+        QHash<QString, LocalScan> results;
+        bool cancelled;
+    };
+    QHash<QString, std::shared_ptr<DeviceScan>> mDeviceScans;
+    // database maintenance runs once the queue has been idle for a while
+    QTimer *mMaintenanceTimer;
+    qint64 mLastMaintenance;
+    bool mVacuumPending;
+    // the object census goes to the debug log at most every sCensusLogInterval
+    qint64 mLastCensusLog;
     mutable QMutex mMutex;
     std::function<bool(QSslCertificate&, bool)> mCheckSslCallback;
     bool mPaused;
-    bool mAborted;
+    SxCancelToken mTaskToken;
     QSet<QTimer*> mTimers;
     SxAuth mAuth;
     QSet<QString> mLockedVolumes;
@@ -192,6 +399,34 @@ private:
         void clear();
     };
     EtaCounters mEtaCounters;
+
+    // uploads queued behind the current task are hashed while it transfers
+    struct PreparedUpload {
+        int blockSize;
+        bool ready;
+        bool discard;
+        QVector<QPair<quint64, QString>> blocks;
+    };
+    QMutex mPreparedMutex;
+    QHash<SxPathKey, PreparedUpload> mPreparedUploads;
+    SxCancelToken mPrepareToken;
+    QThreadPool mPreparePool;
+    // files modified locally, hashed while SxFilesystem debounces their change; an entry
+    // only serves the upload of the same inode, size and mtime
+    struct SpeculativeHash {
+        quint64 id;
+        quint64 inode;
+        qint64 size;
+        qint64 mTime;
+        int blockSize;
+        qint64 created;
+        bool ready;
+        SxCancelToken token;
+        QVector<QPair<quint64, QString>> blocks;
+    };
+    QHash<QString, SpeculativeHash> mSpeculativeHashes;
+    quint64 mSpeculationCounter;
+    QThreadPool mSpeculationPool;
 };
 
 #endif // SXQUEUE_H
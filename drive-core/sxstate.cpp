@@ -28,6 +28,11 @@
 
 #include "sxstate.h"
 
+SxWarning::SxWarning()
+{
+    mCritical = false;
+}
+
 SxWarning::SxWarning(const QString &volume, const QString &file, const QString &message, bool critical)
 {
     mVolume = volume;
@@ -42,6 +47,11 @@ bool SxWarning::isEqual(const QString &volume, const QString &file) const
     return mVolume == volume && mFile == file;
 }
 
+QString SxWarning::key() const
+{
+    return mVolume+mFile;
+}
+
 QDateTime SxWarning::eventDate() const
 {
     return mEventDate;
@@ -55,6 +65,7 @@ QString SxWarning::message() const
 SxState::SxState(QObject *parent) : QObject(parent)
 {
     mStatus = SxStatus::inactive;
+    mCount = 0;
 }
 
 SxStatus SxState::status() const
@@ -64,17 +75,17 @@ SxStatus SxState::status() const
 
 int SxState::warningsCount() const
 {
-    return mWarnings.count();
+    return mCount;
 }
 
-const QList<SxWarning> &SxState::warnings() const
+const SxWarning &SxState::warning(int index) const
 {
-    return mWarnings;
+    return mSlots.at(_slotAt(index));
 }
 
 QString SxState::toString() const
 {
-    if (!mWarnings.isEmpty() && (mStatus == SxStatus::idle || mStatus == SxStatus::working))
+    if (mCount > 0 && (mStatus == SxStatus::idle || mStatus == SxStatus::working))
         return "warning";
     switch (mStatus) {
     case SxStatus::idle:
@@ -91,36 +102,101 @@ QString SxState::toString() const
 
 void SxState::addWarning(const QString &volume, const QString &file, const QString &message, bool critical)
 {
-    if (mWarningsSet.contains(volume+file)) {
-        if (mWarningsSet.value(volume+file)==message)
+    auto it = mWarningSlots.constFind(volume+file);
+    if (it != mWarningSlots.constEnd()) {
+        if (mSlots.at(it.value()).message() == message)
             return;
         removeWarning(volume, file);
     }
-    mWarnings.append(SxWarning(volume, file, message, critical));
-    mWarningsSet.insert(volume+file, message);
-    emit sig_appendRow(mWarnings.last().eventDate(), mWarnings.last().message());
+    int slot = mSlots.count();
+    mSlots.append(SxWarning(volume, file, message, critical));
+    mLive.append(true);
+    // a new node covers the slots (slot+1-lowbit, slot+1]
+    int node = slot+1;
+    int count = 1;
+    for (int i = node-1; i > node-(node & -node); i -= i & -i)
+        count += mCounts.at(i-1);
+    mCounts.append(count);
+    ++mCount;
+    mWarningSlots.insert(volume+file, slot);
+    emit sig_appendRow(mSlots.last().eventDate(), mSlots.last().message());
 }
 
 void SxState::removeWarning(const QString &volume, const QString &file)
 {
-    mWarningsSet.remove(volume+file);
-    for (int i=0; i<mWarnings.count(); i++) {
-        if (mWarnings.at(i).isEqual(volume, file)) {
-            mWarnings.removeAt(i);
-            emit sig_removeRow(i);
-            return;
-        }
-    }
+    auto it = mWarningSlots.find(volume+file);
+    if (it == mWarningSlots.end())
+        return;
+    int slot = it.value();
+    mWarningSlots.erase(it);
+    int index = _indexOf(slot);
+    mLive[slot] = false;
+    mSlots[slot] = SxWarning();
+    for (int i = slot+1; i <= mCounts.count(); i += i & -i)
+        --mCounts[i-1];
+    --mCount;
+    if (mSlots.count() - mCount >= qMax(mCount, sCompactMinHoles))
+        _compact();
+    emit sig_removeRow(index);
 }
 
 void SxState::setStatus(SxStatus status)
 {
+    if (mStatus == status)
+        return;
     mStatus = status;
+    emit sig_statusChanged(status);
 }
 
 void SxState::clearWarnings()
 {
-    mWarnings.clear();
-    mWarningsSet.clear();
+    mSlots.clear();
+    mLive.clear();
+    mCounts.clear();
+    mCount = 0;
+    mWarningSlots.clear();
     emit sig_clear();
 }
+
+int SxState::_indexOf(int slot) const
+{
+    int index = 0;
+    for (int i = slot; i > 0; i -= i & -i)
+        index += mCounts.at(i-1);
+    return index;
+}
+
+int SxState::_slotAt(int index) const
+{
+    int node = 0;
+    int step = 1;
+    while (step*2 <= mCounts.count())
+        step *= 2;
+    for (; step > 0; step /= 2) {
+        if (node+step <= mCounts.count() && mCounts.at(node+step-1) <= index) {
+            node += step;
+            index -= mCounts.at(node-1);
+        }
+    }
+    return node;
+}
+
+void SxState::_compact()
+{
+    QVector<SxWarning> slots;
+    slots.reserve(mCount);
+    mWarningSlots.clear();
+    for (int i=0; i<mSlots.count(); i++) {
+        if (!mLive.at(i))
+            continue;
+        const SxWarning &warning = mSlots.at(i);
+        mWarningSlots.insert(warning.key(), slots.count());
+        slots.append(warning);
+    }
+    mSlots = slots;
+    mLive = QVector<bool>(mCount, true);
+    // every live slot counts one, so each node covers exactly lowbit slots
+    mCounts.resize(mCount);
+    for (int node=1; node<=mCount; node++)
+        mCounts[node-1] = node & -node;
+}
@@ -30,8 +30,9 @@
 #define SXSTATE_H
 
 #include <QDateTime>
+#include <QHash>
 #include <QObject>
-#include <QSet>
+#include <QVector>
 
 enum class SxStatus {
     idle,
@@ -42,8 +43,10 @@ enum class SxStatus {
 
 class SxWarning {
 public:
+    SxWarning();
     SxWarning(const QString &volume, const QString &file, const QString &message, bool critical);
     bool isEqual(const QString &volume, const QString &file) const;
+    QString key() const;
     QDateTime eventDate() const;
     QString message() const;
 private:
@@ -61,7 +64,8 @@ public:
     SxState(QObject *parent = 0);
     SxStatus status() const;
     int warningsCount() const;
-    const QList<SxWarning>& warnings() const;
+    // warnings are numbered from the oldest one
+    const SxWarning &warning(int index) const;
     QString toString() const;
 
 public slots:
@@ -74,11 +78,22 @@ signals:
     void sig_removeRow(int index);
     void sig_appendRow(const QDateTime &eventDate, const QString &message);
     void sig_clear();
+    void sig_statusChanged(SxStatus status);
 
 private:
+    int _indexOf(int slot) const;
+    int _slotAt(int index) const;
+    void _compact();
     SxStatus mStatus;
-    QList<SxWarning> mWarnings;
-    QHash<QString, QString> mWarningsSet;
+    /* warnings in the order they were added; a removed one leaves a hole
+     * until holes outnumber warnings. mCounts is a Fenwick tree over the
+     * live slots, mapping between slots and indexes in O(log n) */
+    QVector<SxWarning> mSlots;
+    QVector<bool> mLive;
+    QVector<int> mCounts;
+    int mCount;
+    QHash<QString, int> mWarningSlots;
+    static const int sCompactMinHoles = 1024;
 };
 
 Q_DECLARE_METATYPE(SxStatus)
@@ -0,0 +1,163 @@
+/*
+ *  Copyright (C) 2012-2016 Skylable Ltd. <info-copyright@skylable.com>
+ *
+ *  This program is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public License
+ *  as published by the Free Software Foundation; either version 2
+ *  of the License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA.
+ *
+ *  Special exception for linking this software with OpenSSL:
+ *
+ *  In addition, as a special exception, Skylable Ltd. gives permission to
+ *  link the code of this program with the OpenSSL library and distribute
+ *  linked combinations including the two. You must obey the GNU General
+ *  Public License in all respects for all of the code used other than
+ *  OpenSSL. You may extend this exception to your version of the program,
+ *  but you are not obligated to do so. If you do not wish to do so, delete
+ *  this exception statement from your version.
+ */
+
+#include "sxsyncstatus.h"
+#include "sxconfig.h"
+
+#include <QDir>
+
+SxSyncStatus &SxSyncStatus::instance()
+{
+    static SxSyncStatus sInstance;
+    return sInstance;
+}
+
+SxSyncStatus::SxSyncStatus()
+{
+}
+
+QString SxSyncStatus::_normalizedPath(const QString &path)
+{
+    // queue paths are relative to the volume root, with or without the leading slash
+    if (path.startsWith("/"))
+        return path;
+    return "/"+path;
+}
+
+void SxSyncStatus::setPending(const QString &volume, const QString &path)
+{
+    QWriteLocker locker(&mLock);
+    SxPathState &state = mStates[volume][_normalizedPath(path)];
+    if (state != SxPathState::Conflict)
+        state = SxPathState::Pending;
+}
+
+void SxSyncStatus::setSyncing(const QString &volume, const QString &path)
+{
+    QWriteLocker locker(&mLock);
+    SxPathState &state = mStates[volume][_normalizedPath(path)];
+    if (state != SxPathState::Conflict)
+        state = SxPathState::Syncing;
+}
+
+void SxSyncStatus::finish(const QString &volume, const QString &path)
+{
+    // a file queued again or failed while it was transferred stays pending
+    QWriteLocker locker(&mLock);
+    auto it = mStates.find(volume);
+    if (it == mStates.end())
+        return;
+    auto entry = it->find(_normalizedPath(path));
+    if (entry != it->end() && entry.value() == SxPathState::Syncing)
+        it->erase(entry);
+}
+
+void SxSyncStatus::setConflict(const QString &volume, const QString &path, bool conflict)
+{
+    QWriteLocker locker(&mLock);
+    if (conflict)
+        mStates[volume][_normalizedPath(path)] = SxPathState::Conflict;
+    else if (mStates.contains(volume) && mStates[volume].value(_normalizedPath(path)) == SxPathState::Conflict)
+        mStates[volume].remove(_normalizedPath(path));
+}
+
+void SxSyncStatus::remove(const QString &volume, const QString &path)
+{
+    QWriteLocker locker(&mLock);
+    if (mStates.contains(volume))
+        mStates[volume].remove(_normalizedPath(path));
+}
+
+void SxSyncStatus::clear()
+{
+    QWriteLocker locker(&mLock);
+    mStates.clear();
+}
+
+void SxSyncStatus::clear(const QString &volume)
+{
+    QWriteLocker locker(&mLock);
+    mStates.remove(volume);
+}
+
+SxPathState SxSyncStatus::state(const QString &volume, const QString &path) const
+{
+    QString key = _normalizedPath(path);
+    QReadLocker locker(&mLock);
+    auto it = mStates.constFind(volume);
+    if (it == mStates.constEnd())
+        return SxPathState::Synced;
+    auto entry = it->constFind(key);
+    if (entry != it->constEnd())
+        return entry.value();
+    // a directory shows the most important state of the files below it
+    QString prefix = key.endsWith("/") ? key : key+"/";
+    SxPathState result = SxPathState::Synced;
+    for (entry = it->constBegin(); entry != it->constEnd(); ++entry) {
+        if (entry.key().startsWith(prefix) && static_cast<int>(entry.value()) > static_cast<int>(result)) {
+            result = entry.value();
+            if (result == SxPathState::Conflict)
+                break;
+        }
+    }
+    return result;
+}
+
+SxPathState SxSyncStatus::localPathState(const SxConfig *config, const QString &localPath) const
+{
+    QString path = QDir::fromNativeSeparators(localPath);
+    foreach (QString volume, config->volumes()) {
+        QString root = config->volume(volume).localPath();
+        if (root.isEmpty())
+            continue;
+        if (root.endsWith("/"))
+            root.chop(1);
+        if (path == root)
+            return state(volume, "/");
+        if (path.startsWith(root+"/"))
+            return state(volume, path.mid(root.length()));
+    }
+    return SxPathState::None;
+}
+
+QString SxSyncStatus::toString(SxPathState state)
+{
+    switch (state) {
+    case SxPathState::None:
+        return "none";
+    case SxPathState::Synced:
+        return "synced";
+    case SxPathState::Pending:
+        return "pending";
+    case SxPathState::Syncing:
+        return "syncing";
+    case SxPathState::Conflict:
+        return "conflict";
+    }
+    return QString();
+}
@@ -0,0 +1,73 @@
+/*
+ *  Copyright (C) 2012-2016 Skylable Ltd. <info-copyright@skylable.com>
+ *
+ *  This program is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public License
+ *  as published by the Free Software Foundation; either version 2
+ *  of the License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA.
+ *
+ *  Special exception for linking this software with OpenSSL:
+ *
+ *  In addition, as a special exception, Skylable Ltd. gives permission to
+ *  link the code of this program with the OpenSSL library and distribute
+ *  linked combinations including the two. You must obey the GNU General
+ *  Public License in all respects for all of the code used other than
+ *  OpenSSL. You may extend this exception to your version of the program,
+ *  but you are not obligated to do so. If you do not wish to do so, delete
+ *  this exception statement from your version.
+ */
+
+#ifndef SXSYNCSTATUS_H
+#define SXSYNCSTATUS_H
+
+#include <QHash>
+#include <QReadWriteLock>
+#include <QString>
+
+class SxConfig;
+
+enum class SxPathState {
+    None,
+    Synced,
+    Pending,
+    Syncing,
+    Conflict
+};
+
+/* Sync state of the files the queue is working on, kept in memory for the
+ * shell overlays. Only files which are not in sync are stored, any other
+ * path inside a volume is reported as synced */
+class SxSyncStatus
+{
+public:
+    static SxSyncStatus& instance();
+    SxSyncStatus(const SxSyncStatus &) = delete;
+    SxSyncStatus &operator= (const SxSyncStatus &) = delete;
+    void setPending(const QString &volume, const QString &path);
+    void setSyncing(const QString &volume, const QString &path);
+    void finish(const QString &volume, const QString &path);
+    void setConflict(const QString &volume, const QString &path, bool conflict);
+    void remove(const QString &volume, const QString &path);
+    void clear();
+    void clear(const QString &volume);
+    SxPathState state(const QString &volume, const QString &path) const;
+    SxPathState localPathState(const SxConfig *config, const QString &localPath) const;
+    static QString toString(SxPathState state);
+
+private:
+    SxSyncStatus();
+    static QString _normalizedPath(const QString &path);
+    mutable QReadWriteLock mLock;
+    QHash<QString, QHash<QString, SxPathState>> mStates;
+};
+
+#endif // SXSYNCSTATUS_H
@@ -0,0 +1,123 @@
+/*
+ *  Copyright (C) 2012-2016 Skylable Ltd. <info-copyright@skylable.com>
+ *
+ *  This program is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public License
+ *  as published by the Free Software Foundation; either version 2
+ *  of the License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA.
+ *
+ *  Special exception for linking this software with OpenSSL:
+ *
+ *  In addition, as a special exception, Skylable Ltd. gives permission to
+ *  link the code of this program with the OpenSSL library and distribute
+ *  linked combinations including the two. You must obey the GNU General
+ *  Public License in all respects for all of the code used other than
+ *  OpenSSL. You may extend this exception to your version of the program,
+ *  but you are not obligated to do so. If you do not wish to do so, delete
+ *  this exception statement from your version.
+ */
+
+#include "sxtransferlane.h"
+#include "sxcluster.h"
+#include "sxlog.h"
+
+SxTransferLane::SxTransferLane(std::function<SxCluster *()> createCluster) : QThread()
+{
+    mCreateCluster = createCluster;
+    mCluster = nullptr;
+    mBusy = false;
+    mFailed = false;
+    mStopped = false;
+}
+
+SxTransferLane::~SxTransferLane()
+{
+    stop();
+}
+
+bool SxTransferLane::available() const
+{
+    QMutexLocker locker(&mMutex);
+    return !mBusy && !mFailed && !mStopped;
+}
+
+bool SxTransferLane::busy() const
+{
+    QMutexLocker locker(&mMutex);
+    return mBusy;
+}
+
+bool SxTransferLane::execute(Job job)
+{
+    QMutexLocker locker(&mMutex);
+    if (mBusy || mFailed || mStopped)
+        return false;
+    mBusy = true;
+    mJob = job;
+    mJobQueued.wakeAll();
+    return true;
+}
+
+void SxTransferLane::abort()
+{
+    QMutexLocker locker(&mMutex);
+    if (mBusy && mCluster != nullptr)
+        mCluster->abort();
+}
+
+void SxTransferLane::stop()
+{
+    {
+        QMutexLocker locker(&mMutex);
+        if (mStopped)
+            return;
+        mStopped = true;
+        if (mBusy && mCluster != nullptr)
+            mCluster->abort();
+        mJobQueued.wakeAll();
+    }
+    wait();
+}
+
+void SxTransferLane::run()
+{
+    QMutexLocker locker(&mMutex);
+    forever {
+        while (!mBusy && !mStopped)
+            mJobQueued.wait(&mMutex);
+        if (mStopped)
+            break;
+        Job job = mJob;
+        mJob = nullptr;
+        bool create = mCluster == nullptr;
+        locker.unlock();
+        // the cluster is created here as it has to live in the lane thread
+        SxCluster *cluster = create ? mCreateCluster() : nullptr;
+        locker.relock();
+        if (create) {
+            mCluster = cluster;
+            if (mCluster == nullptr) {
+                logWarning("unable to initialize cluster for transfer lane");
+                mFailed = true;
+            }
+        }
+        cluster = mCluster;
+        locker.unlock();
+        job(cluster);
+        locker.relock();
+        mBusy = false;
+    }
+    SxCluster *cluster = mCluster;
+    mCluster = nullptr;
+    locker.unlock();
+    delete cluster;
+}
@@ -31,6 +31,8 @@
 UploadQueue::UploadQueue()
 {
     mLastFreeSize = 0;
+    mServerFreeSize = -1;
+    mUsedBytes = 0;
 }
 
 bool UploadQueue::isEmpty() const
@@ -60,7 +62,7 @@ void UploadQueue::addTask(QString path, qint64 size, qint64 volumeFreeSize)
     removeTask(path);
     mMap.insert(size, path);
     mSet.insert(path);
-    mLastFreeSize = volumeFreeSize;
+    mLastFreeSize = predictedFreeSize(volumeFreeSize);
 }
 
 void UploadQueue::removeTask(QString path)
@@ -77,12 +79,35 @@ qint64 UploadQueue::volumeFreeSize() const
     return mLastFreeSize;
 }
 
+/* the smallest waiting upload goes as soon as it fits the predicted free size, without
+ * waiting for the server to report one; after a failed upload only once space was freed */
 bool UploadQueue::canExecuteTask(qint64 volumeFreeSize)
 {
     if (mMap.isEmpty())
         return false;
-    if (mLastFreeSize != -1 && volumeFreeSize <= mLastFreeSize)
+    qint64 freeSize = predictedFreeSize(volumeFreeSize);
+    if (mLastFreeSize != -1 && freeSize <= mLastFreeSize)
         return false;
     qint64 size = mMap.firstKey();
-    return size < volumeFreeSize;
+    return size < freeSize;
+}
+
+void UploadQueue::addUsedBytes(qint64 bytes)
+{
+    mUsedBytes += bytes;
+}
+
+qint64 UploadQueue::predictedFreeSize(qint64 volumeFreeSize)
+{
+    _sync(volumeFreeSize);
+    return mServerFreeSize - mUsedBytes;
+}
+
+// a new free size from the server already includes the changes counted so far
+void UploadQueue::_sync(qint64 volumeFreeSize)
+{
+    if (volumeFreeSize == mServerFreeSize)
+        return;
+    mServerFreeSize = volumeFreeSize;
+    mUsedBytes = 0;
 }
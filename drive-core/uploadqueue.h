@@ -44,8 +44,15 @@ public:
     void removeTask(QString path);
     qint64 volumeFreeSize() const;
     bool canExecuteTask(qint64 volumeFreeSize);
+    // bytes uploaded (positive) or removed (negative) since the server reported the free size
+    void addUsedBytes(qint64 bytes);
+    qint64 predictedFreeSize(qint64 volumeFreeSize);
 private:
+    void _sync(qint64 volumeFreeSize);
+    // predicted free size when an upload last failed for lack of space
     qint64 mLastFreeSize;
+    qint64 mServerFreeSize;
+    qint64 mUsedBytes;
     QMultiMap<qint64, QString> mMap;
     QSet<QString> mSet;
 };
@@ -0,0 +1,147 @@
+/*
+ *  Copyright (C) 2012-2016 Skylable Ltd. <info-copyright@skylable.com>
+ *
+ *  This program is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public License
+ *  as published by the Free Software Foundation; either version 2
+ *  of the License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA.
+ *
+ *  Special exception for linking this software with OpenSSL:
+ *
+ *  In addition, as a special exception, Skylable Ltd. gives permission to
+ *  link the code of this program with the OpenSSL library and distribute
+ *  linked combinations including the two. You must obey the GNU General
+ *  Public License in all respects for all of the code used other than
+ *  OpenSSL. You may extend this exception to your version of the program,
+ *  but you are not obligated to do so. If you do not wish to do so, delete
+ *  this exception statement from your version.
+ */
+#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QDir>
+#include <QLocalSocket>
+#include <QSettings>
+#include <QThread>
+#include <iostream>
+#include "sxconfig.h"
+#include "sxcluster.h"
+#include "sxdatabase.h"
+#include "sxdaemon.h"
+#include "sxlog.h"
+#include "sxprofiler.h"
+#include "sxversion.h"
+
+// the desktop application's names, so both read the same settings and database
+static const QString sOrganizationName = "Skylable";
+static const QString sOrganizationDomain = "skylable.com";
+static const QString sApplicationName = "SXDrive";
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+    app.setOrganizationName(sOrganizationName);
+    app.setOrganizationDomain(sOrganizationDomain);
+    app.setApplicationVersion(SXVERSION);
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription(QString("Synchronises the volumes configured in %1 without a GUI").arg(sApplicationName));
+    parser.addHelpOption();
+    parser.addVersionOption();
+    parser.addOption(QCommandLineOption("profile", "Use configuration profile <name>", "name"));
+    parser.addOption(QCommandLineOption("config-dir", "Read the configuration from <dir> instead of the user's settings", "dir"));
+    parser.addOption(QCommandLineOption("accept-certificate", "Trust and store the certificate presented by the cluster"));
+    parser.addOption(QCommandLineOption("status", "Show the status of the running daemon"));
+    parser.addOption(QCommandLineOption("pause", "Pause the running daemon"));
+    parser.addOption(QCommandLineOption("resume", "Resume the running daemon"));
+    parser.addOption(QCommandLineOption("quit", "Stop the running daemon"));
+    parser.addOption(QCommandLineOption("volume", "Volume to export or import the sync state of", "name"));
+    parser.addOption(QCommandLineOption("export-sync-state", "Write the sync state of --volume to <file> and exit", "file"));
+    parser.addOption(QCommandLineOption("import-sync-state", "Seed the sync state of --volume from <file>, for a local copy of the volume made on another machine, and exit", "file"));
+    parser.process(app);
+
+    QString profile = parser.value("profile");
+    if (profile == "default")
+        profile.clear();
+    app.setApplicationName(sApplicationName+(profile.isEmpty() ? "" : "-"+profile));
+    const QString serverName = SxDaemon::serverName(profile);
+
+    foreach (const QString &command, QStringList({"status", "pause", "resume", "quit"})) {
+        if (!parser.isSet(command))
+            continue;
+        QString reply;
+        if (!SxDaemon::sendCommand(serverName, command, reply)) {
+            std::cerr << "daemon is not running" << std::endl;
+            return 1;
+        }
+        std::cout << reply.toStdString();
+        return 0;
+    }
+
+    if (parser.isSet("config-dir")) {
+        QString dir = QDir(parser.value("config-dir")).absolutePath();
+        QSettings::setDefaultFormat(QSettings::IniFormat);
+        QSettings::setPath(QSettings::IniFormat, QSettings::UserScope, dir);
+    }
+    // the desktop application and the daemon would share the database
+    foreach (const QString &name, QStringList({"mainInstanceOf"+sApplicationName+"-"+(profile.isEmpty() ? QString("default") : profile), serverName})) {
+        QLocalSocket socket;
+        socket.connectToServer(name);
+        if (socket.waitForConnected(1000)) {
+            std::cerr << sApplicationName.toStdString() << " is already running for this profile" << std::endl;
+            return 1;
+        }
+    }
+
+    SxConfig config(profile);
+    if (!config.isValid()) {
+        std::cerr << "the profile is not configured, set it up with " << sApplicationName.toStdString() << " first" << std::endl;
+        return 1;
+    }
+    QThread::currentThread()->setProperty("name", "MAIN_THREAD");
+    LogLevel logLevel = static_cast<LogLevel>(static_cast<int>(LogLevel::Info)-config.desktopConfig().logLevel());
+    SxLog::instance().setLogLevel(logLevel);
+    SxProfiler::instance().setEnabled(config.desktopConfig().debugLog());
+
+    if (parser.isSet("export-sync-state") || parser.isSet("import-sync-state")) {
+        QString volume = parser.value("volume");
+        if (!config.volumes().contains(volume)) {
+            std::cerr << "--volume must name a configured volume" << std::endl;
+            return 1;
+        }
+        if (parser.isSet("export-sync-state")) {
+            if (!SxDatabase::instance().exportSyncState(volume, parser.value("export-sync-state"))) {
+                std::cerr << "unable to export the sync state, see the log for details" << std::endl;
+                return 1;
+            }
+            return 0;
+        }
+        int imported = 0;
+        int skipped = 0;
+        if (!SxDatabase::instance().importSyncState(volume, parser.value("import-sync-state"), config.volume(volume).localPath(), imported, skipped)) {
+            std::cerr << "unable to import the sync state, see the log for details" << std::endl;
+            return 1;
+        }
+        std::cout << imported << " files imported, " << skipped << " files left to the initial scan" << std::endl;
+        return 0;
+    }
+    logInfo(QString("%1 daemon version %2 started").arg(sApplicationName).arg(SXVERSION));
+    SxCluster::setClientVersion(sApplicationName+"-daemon-"+SXVERSION);
+
+    SxDaemon daemon(&config, parser.isSet("accept-certificate"));
+    if (!daemon.start(serverName)) {
+        std::cerr << "unable to open the control socket" << std::endl;
+        return 1;
+    }
+    int result = app.exec();
+    logInfo("daemon stopped");
+    return result;
+}
@@ -0,0 +1,262 @@
+/*
+ *  Copyright (C) 2012-2016 Skylable Ltd. <info-copyright@skylable.com>
+ *
+ *  This program is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public License
+ *  as published by the Free Software Foundation; either version 2
+ *  of the License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA.
+ *
+ *  Special exception for linking this software with OpenSSL:
+ *
+ *  In addition, as a special exception, Skylable Ltd. gives permission to
+ *  link the code of this program with the OpenSSL library and distribute
+ *  linked combinations including the two. You must obey the GNU General
+ *  Public License in all respects for all of the code used other than
+ *  OpenSSL. You may extend this exception to your version of the program,
+ *  but you are not obligated to do so. If you do not wish to do so, delete
+ *  this exception statement from your version.
+ */
+#include "sxdaemon.h"
+#include "sxconfig.h"
+#include "sxcontroller.h"
+#include "sxmetricsserver.h"
+#include "sxlog.h"
+
+#include <QCoreApplication>
+#include <QCryptographicHash>
+#include <QLocalSocket>
+#include <QSocketNotifier>
+#include <QTimer>
+
+#ifdef Q_OS_WIN
+    #include <Windows.h>
+#else
+    #include <signal.h>
+    #include <sys/socket.h>
+    #include <unistd.h>
+#endif
+
+#ifndef Q_OS_WIN
+// the handler only writes to the pipe, the notifier quits from the event loop
+static int sSignalFds[2] = {-1, -1};
+
+static void signalHandler(int)
+{
+    char c = 1;
+    ssize_t written = ::write(sSignalFds[0], &c, sizeof(c));
+    Q_UNUSED(written);
+}
+#else
+static BOOL WINAPI consoleHandler(DWORD)
+{
+    QMetaObject::invokeMethod(QCoreApplication::instance(), "quit", Qt::QueuedConnection);
+    return TRUE;
+}
+#endif
+
+SxDaemon::SxDaemon(SxConfig *config, bool acceptNewCertificate, QObject *parent)
+    : QObject(parent)
+{
+    mConfig = config;
+    mAcceptNewCertificate = acceptNewCertificate;
+    mSignalNotifier = nullptr;
+    mUploadCount = 0;
+    mUploadSize = 0;
+    mDownloadCount = 0;
+    mDownloadSize = 0;
+    mRemoveCount = 0;
+    auto checkCert = [this](QSslCertificate &cert, bool secondaryCert) -> bool {
+        return _checkCertificate(cert, secondaryCert);
+    };
+    // nobody to ask, local files are never removed because the other side is empty
+    auto askGui = [](QString message) -> bool {
+        logWarning("answering no: "+message);
+        return false;
+    };
+    mController = new SxController(config, checkCert, askGui, this);
+    connect(mController, &SxController::sig_setEtaCounters, this, &SxDaemon::onEtaCounters);
+    mMetricsServer = nullptr;
+    int metricsPort = config->desktopConfig().metricsPort();
+    if (metricsPort > 0 && metricsPort <= 65535) {
+        mMetricsServer = new SxMetricsServer(this);
+        if (!mMetricsServer->listen(static_cast<quint16>(metricsPort))) {
+            delete mMetricsServer;
+            mMetricsServer = nullptr;
+        }
+    }
+    connect(&mServer, &QLocalServer::newConnection, this, &SxDaemon::onNewConnection);
+}
+
+SxDaemon::~SxDaemon()
+{
+    delete mController;
+#ifndef Q_OS_WIN
+    if (mSignalNotifier) {
+        signal(SIGTERM, SIG_DFL);
+        signal(SIGINT, SIG_DFL);
+        delete mSignalNotifier;
+        ::close(sSignalFds[0]);
+        ::close(sSignalFds[1]);
+        sSignalFds[0] = sSignalFds[1] = -1;
+    }
+#endif
+}
+
+QString SxDaemon::serverName(const QString &profile)
+{
+    return "daemonInstanceOfSXDrive-" + (profile.isEmpty() ? QString("default") : profile);
+}
+
+bool SxDaemon::start(const QString &serverName)
+{
+    QLocalServer::removeServer(serverName);
+    if (!mServer.listen(serverName)) {
+        logWarning("unable to listen on "+serverName+": "+mServer.errorString());
+        return false;
+    }
+#ifndef Q_OS_WIN
+    if (::socketpair(AF_UNIX, SOCK_STREAM, 0, sSignalFds) == 0) {
+        mSignalNotifier = new QSocketNotifier(sSignalFds[1], QSocketNotifier::Read, this);
+        connect(mSignalNotifier, &QSocketNotifier::activated, this, &SxDaemon::onSignal);
+        signal(SIGTERM, signalHandler);
+        signal(SIGINT, signalHandler);
+    }
+#else
+    SetConsoleCtrlHandler(consoleHandler, TRUE);
+#endif
+    QTimer::singleShot(0, mController, SLOT(startCluster()));
+    return true;
+}
+
+void SxDaemon::onSignal()
+{
+#ifndef Q_OS_WIN
+    char c;
+    ssize_t count = ::read(sSignalFds[1], &c, sizeof(c));
+    Q_UNUSED(count);
+#endif
+    logInfo("stopping on signal");
+    QCoreApplication::quit();
+}
+
+/* one command per connection, answered before the connection is closed */
+void SxDaemon::onNewConnection()
+{
+    while (QLocalSocket *socket = mServer.nextPendingConnection()) {
+        connect(socket, &QLocalSocket::disconnected, socket, &QLocalSocket::deleteLater);
+        connect(socket, &QLocalSocket::readyRead, this, [this, socket]() {
+            if (!socket->canReadLine()) {
+                if (socket->bytesAvailable() > sRequestSizeLimit)
+                    socket->abort();
+                return;
+            }
+            QString command = QString::fromUtf8(socket->readLine()).trimmed();
+            socket->write(_execute(command).toUtf8());
+            socket->flush();
+            socket->disconnectFromServer();
+        });
+    }
+}
+
+QString SxDaemon::_execute(const QString &command)
+{
+    logVerbose("control command: "+command);
+    if (command == "status")
+        return _status();
+    if (command == "pause")
+        return mController->pause() ? "paused\n" : "not running\n";
+    if (command == "resume")
+        return mController->resume() ? "resumed\n" : "not running\n";
+    if (command == "quit") {
+        QTimer::singleShot(0, QCoreApplication::instance(), SLOT(quit()));
+        return "quitting\n";
+    }
+    return "unknown command: "+command+"\n";
+}
+
+QString SxDaemon::_statusName(SxStatus status)
+{
+    switch (status) {
+    case SxStatus::idle:
+        return "idle";
+    case SxStatus::working:
+        return "working";
+    case SxStatus::paused:
+        return "paused";
+    case SxStatus::inactive:
+        return "inactive";
+    }
+    return "unknown";
+}
+
+QString SxDaemon::_status() const
+{
+    const SxState &state = mController->sxState();
+    QString result = QString("status: %1\n").arg(_statusName(state.status()));
+    result += QString("pending uploads: %1 (%2 bytes)\n").arg(mUploadCount).arg(mUploadSize);
+    result += QString("pending downloads: %1 (%2 bytes)\n").arg(mDownloadCount).arg(mDownloadSize);
+    result += QString("pending removals: %1\n").arg(mRemoveCount);
+    result += QString("warnings: %1\n").arg(state.warningsCount());
+    for (int i=0; i<state.warningsCount(); i++) {
+        const SxWarning &warning = state.warning(i);
+        result += QString("  %1 %2\n").arg(warning.eventDate().toString(Qt::ISODate), warning.message());
+    }
+    return result;
+}
+
+void SxDaemon::onEtaCounters(uint upload, qint64 uploadSize, uint download, qint64 downloadSize, uint remove)
+{
+    mUploadCount = upload;
+    mUploadSize = uploadSize;
+    mDownloadCount = download;
+    mDownloadSize = downloadSize;
+    mRemoveCount = remove;
+}
+
+/* called from the queue thread */
+bool SxDaemon::_checkCertificate(QSslCertificate &cert, bool secondaryCert)
+{
+    QCryptographicHash sha1(QCryptographicHash::Sha1);
+    sha1.addData(cert.toDer());
+    QByteArray fprint = sha1.result();
+    QByteArray clusterFp = secondaryCert ? mConfig->clusterConfig().secondaryClusterCertFp() : mConfig->clusterConfig().clusterCertFp();
+    if (fprint == clusterFp)
+        return true;
+    if (!mAcceptNewCertificate) {
+        logWarning(QString("rejecting certificate %1, start with --accept-certificate to trust it").arg(QString::fromLatin1(fprint.toHex())));
+        return false;
+    }
+    logWarning(QString("accepting new certificate %1").arg(QString::fromLatin1(fprint.toHex())));
+    if (secondaryCert)
+        mConfig->clusterConfig().setSecondaryClusterCertFp(fprint);
+    else
+        mConfig->clusterConfig().setClusterCertFp(fprint);
+    return true;
+}
+
+bool SxDaemon::sendCommand(const QString &serverName, const QString &command, QString &reply)
+{
+    QLocalSocket socket;
+    socket.connectToServer(serverName);
+    if (!socket.waitForConnected(sReplyTimeout))
+        return false;
+    socket.write((command+"\n").toUtf8());
+    if (!socket.waitForBytesWritten(sReplyTimeout))
+        return false;
+    QByteArray data;
+    while (socket.state() == QLocalSocket::ConnectedState && socket.waitForReadyRead(sReplyTimeout)) {
+        data += socket.readAll();
+    }
+    data += socket.readAll();
+    reply = QString::fromUtf8(data);
+    return !reply.isEmpty();
+}
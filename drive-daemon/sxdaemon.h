@@ -0,0 +1,81 @@
+/*
+ *  Copyright (C) 2012-2016 Skylable Ltd. <info-copyright@skylable.com>
+ *
+ *  This program is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public License
+ *  as published by the Free Software Foundation; either version 2
+ *  of the License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA.
+ *
+ *  Special exception for linking this software with OpenSSL:
+ *
+ *  In addition, as a special exception, Skylable Ltd. gives permission to
+ *  link the code of this program with the OpenSSL library and distribute
+ *  linked combinations including the two. You must obey the GNU General
+ *  Public License in all respects for all of the code used other than
+ *  OpenSSL. You may extend this exception to your version of the program,
+ *  but you are not obligated to do so. If you do not wish to do so, delete
+ *  this exception statement from your version.
+ */
+#ifndef SXDAEMON_H
+#define SXDAEMON_H
+
+#include <QObject>
+#include <QLocalServer>
+#include <QSslCertificate>
+
+#include "sxstate.h"
+
+class SxConfig;
+class SxController;
+class SxMetricsServer;
+class QLocalSocket;
+class QSocketNotifier;
+
+/* Runs the sync engine without a GUI. Status, pause, resume and quit requests are
+ * read line by line from a local socket; certificates are only accepted when they
+ * match the stored fingerprint, or once with acceptNewCertificate */
+class SxDaemon : public QObject
+{
+    Q_OBJECT
+public:
+    SxDaemon(SxConfig *config, bool acceptNewCertificate, QObject *parent = nullptr);
+    ~SxDaemon();
+    bool start(const QString &serverName);
+    static QString serverName(const QString &profile);
+    static bool sendCommand(const QString &serverName, const QString &command, QString &reply);
+
+private slots:
+    void onNewConnection();
+    void onSignal();
+    void onEtaCounters(uint upload, qint64 uploadSize, uint download, qint64 downloadSize, uint remove);
+
+private:
+    QString _execute(const QString &command);
+    QString _status() const;
+    static QString _statusName(SxStatus status);
+    bool _checkCertificate(QSslCertificate &cert, bool secondaryCert);
+    SxConfig *mConfig;
+    SxController *mController;
+    SxMetricsServer *mMetricsServer;
+    QLocalServer mServer;
+    QSocketNotifier *mSignalNotifier;
+    bool mAcceptNewCertificate;
+    uint mUploadCount;
+    qint64 mUploadSize;
+    uint mDownloadCount;
+    qint64 mDownloadSize;
+    uint mRemoveCount;
+    static const int sRequestSizeLimit = 1024;
+    static const int sReplyTimeout = 5000;
+};
+
+#endif // SXDAEMON_H
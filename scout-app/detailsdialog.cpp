@@ -29,6 +29,7 @@
 #include "detailsdialog.h"
 #include "ui_detailsdialog.h"
 #include <QFileDialog>
+#include <QPointer>
 #include <QRadioButton>
 #include <QStandardPaths>
 #include <QTimer>
@@ -95,9 +96,21 @@ void DetailsDialog::refresh()
     ui->labelContent->setText(content);
     if (!ui->tabRevisions->isEnabled())
         return;
+    // cached revisions show up at once, the list is replaced when the cluster replies
+    QPointer<DetailsDialog> dialog(this);
+    mModel->requestRevisions(mVolume, mFiles.first(), [dialog](const QList<QPair<QString, qint64>> &revisions) {
+        if (dialog)
+            dialog->showRevisions(revisions);
+    });
+}
+
+void DetailsDialog::showRevisions(const QList<QPair<QString, qint64>> &revisions)
+{
+    if (revisions == mShownRevisions)
+        return;
+    mShownRevisions = revisions;
     mSelectedRevision = nullptr;
     ui->buttonDownloadRevision->setEnabled(false);
-    auto revisions = mModel->getRevisions(mVolume, mFiles.first());
     auto table = ui->revisionsTableWidget;
     table->setRowCount(0);
     table->setRowCount(revisions.count());
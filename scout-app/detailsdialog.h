@@ -52,12 +52,14 @@ private slots:
     void downloadClicked();
 
 private:
+    void showRevisions(const QList<QPair<QString, qint64>> &revisions);
     Ui::DetailsDialog *ui;
     ScoutModel *mModel;
     QString mVolume;
     QString mDir;
     QStringList mFiles;
     QRadioButton *mSelectedRevision;
+    QList<QPair<QString, qint64>> mShownRevisions;
 };
 
 #endif // DetailsDialog_H
@@ -54,6 +54,14 @@ FileViewDelegate::FileViewDelegate(ScoutModel *model, QTableView *view, QObject
 {
     mModel = model;
     mView = view;
+    mPreviews = nullptr;
+}
+
+void FileViewDelegate::setPreviews(ScoutPreviews *previews)
+{
+    mPreviews = previews;
+    if (mPreviews != nullptr)
+        connect(mPreviews, &ScoutPreviews::previewReady, mView->viewport(), static_cast<void (QWidget::*)()>(&QWidget::update));
 }
 
 void FileViewDelegate::paint(QPainter *painter, const QStyleOptionViewItem &option, const QModelIndex &index) const
@@ -67,6 +75,14 @@ void FileViewDelegate::paint(QPainter *painter, const QStyleOptionViewItem &opti
 
     QString name = mModel->data(index, ScoutModel::NameRole).toString();
     QPixmap mimeIcon = MainWindow::iconForMimeType(mimeType, false);
+    QPixmap preview;
+    if (mPreviews != nullptr && ScoutPreviews::canPreview(mimeType)) {
+        // only painted cells ask, thumbnails for the rest of the directory are never fetched
+        preview = mPreviews->preview(mModel->currentVolume(),
+                                     mModel->data(index, ScoutModel::FullPathRole).toString(),
+                                     mModel->data(index, ScoutModel::RevisionRole).toString(),
+                                     mModel->data(index, ScoutModel::SizeRole).toLongLong());
+    }
 
     painter->save();
     painter->setFont(option.font);
@@ -80,10 +96,7 @@ void FileViewDelegate::paint(QPainter *painter, const QStyleOptionViewItem &opti
     iconRect.setWidth(sIconWidth);
     iconRect.setHeight(sIconHeight);
 
-    QFontMetrics fm(option.font);
-    auto rect = fm.boundingRect(0,0, 150-2*sMargin-2*sTextPadding, 0,
-                                Qt::AlignHCenter | Qt::TextWrapAnywhere,
-                                index.data(ScoutModel::NameRole).toString());
+    auto rect = nameRect(option.font, name);
     int expectedHeight = 3*sMargin+sIconHeight+rect.height();
     int nameRectWidth = rect.width()+2*sTextPadding;
     int nameRectHeight = rect.height()+2*sTextPadding;
@@ -113,7 +126,13 @@ void FileViewDelegate::paint(QPainter *painter, const QStyleOptionViewItem &opti
         painter->drawRoundedRect(rect, 2, 2);
         painter->setPen(Qt::white);
     }
-    painter->drawPixmap(iconRect, mimeIcon);
+    if (preview.isNull())
+        painter->drawPixmap(iconRect, mimeIcon);
+    else {
+        QRect previewRect(QPoint(), preview.size().scaled(iconRect.size(), Qt::KeepAspectRatio));
+        previewRect.moveCenter(iconRect.center());
+        painter->drawPixmap(previewRect, preview);
+    }
     painter->drawText(rect, Qt::AlignCenter | Qt::TextWrapAnywhere, name, &rect);
 
     if (highlight) {
@@ -130,12 +149,25 @@ void FileViewDelegate::paint(QPainter *painter, const QStyleOptionViewItem &opti
 
 QSize FileViewDelegate::sizeHint(const QStyleOptionViewItem &option, const QModelIndex &index) const
 {
-    Q_UNUSED(index)
-    QFontMetrics fm(option.font);
+    auto rect = nameRect(option.font, index.data(ScoutModel::NameRole).toString());
+    return QSize(150, 3*sMargin+sIconHeight+rect.height()+2*sTextPadding);
+}
+
+QRect FileViewDelegate::nameRect(const QFont &font, const QString &name) const
+{
+    if (font != mNameRectsFont || mNameRects.count() >= sNameRectsLimit) {
+        mNameRects.clear();
+        mNameRectsFont = font;
+    }
+    auto it = mNameRects.constFind(name);
+    if (it != mNameRects.constEnd())
+        return it.value();
+    QFontMetrics fm(font);
     auto rect = fm.boundingRect(0,0, 150-2*sMargin-2*sTextPadding, 0,
                                 Qt::AlignHCenter | Qt::TextWrapAnywhere,
-                                index.data(ScoutModel::NameRole).toString());
-    return QSize(150, 3*sMargin+sIconHeight+rect.height()+2*sTextPadding);
+                                name);
+    mNameRects.insert(name, rect);
+    return rect;
 }
 
 QModelIndex FileViewDelegate::lastPointedIndex() const
@@ -889,6 +921,8 @@ QMimeData *FilesTableView::selectionToMimeData() const
     QString volume = mModel->currentVolume();
     QString urlBegin = QString("sx://%1/%2").arg(cluster).arg(volume);
     QStringList textLines;
+    QList<QPair<QString, qint64>> streamFiles;
+    bool streamable = true;
     foreach (auto index, selectionModel()->selectedIndexes()) {
         QString file = index.data(ScoutModel::FullPathRole).toString();
         if (file.isEmpty())
@@ -896,7 +930,19 @@ QMimeData *FilesTableView::selectionToMimeData() const
         QUrl url(urlBegin+file);
         list.append(url);
         textLines.append(urlBegin+file);
+        if (file.endsWith("/"))
+            streamable = false;
+        else
+            streamFiles.append({file, index.data(ScoutModel::SizeRole).toLongLong()});
     }
+#ifdef Q_OS_WIN
+    /* plain files are streamed straight to Explorer, directories still go
+     * through the drop target and the download queue */
+    if (streamable)
+        mimeData->setStreamSource(mModel->cluster(), streamFiles);
+#else
+    Q_UNUSED(streamable);
+#endif
 #ifdef Q_OS_MAC
     mimeData->setData("promisedFilesTypes", "file");
 #endif
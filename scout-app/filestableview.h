@@ -34,6 +34,7 @@
 #include "scoutmodel.h"
 #include "scoutconfig.h"
 #include "scoutmimedata.h"
+#include "scoutpreviews.h"
 
 class FileViewDelegate : public QItemDelegate {
     Q_OBJECT
@@ -46,15 +47,22 @@ public:
     bool isIndexActive(const QModelIndex &index) const;
     static bool canSelect(const QModelIndex &index, const QRect &itemRect, const QRect &selectionRect);
     void setDragTarget(const QModelIndex& index);
+    void setPreviews(ScoutPreviews *previews);
 private:
+    QRect nameRect(const QFont &font, const QString &name) const;
     ScoutModel *mModel;
     QTableView *mView;
+    ScoutPreviews *mPreviews;
     static const int sMargin = 4;
     static const int sIconWidth = 64;
     static const int sIconHeight = 64;
     static const int sTextPadding = 2;
+    static const int sNameRectsLimit = 200000;
     mutable QModelIndex mPointedIndex;
     QModelIndex mDragTargetIndex;
+    // wrapped name bounds, laid out once per name and font
+    mutable QHash<QString, QRect> mNameRects;
+    mutable QFont mNameRectsFont;
 signals:
     void setRowHeight(int row, int height) const;
 };
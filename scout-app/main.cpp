@@ -27,15 +27,22 @@
  */
 
 #include <QApplication>
+#include <QStandardPaths>
 #include "scoutconfig.h"
 #include "mainwindow.h"
 #include "scoutwizard.h"
 #include "versioncheck.h"
 #include "version.h"
 #include "sxlog.h"
+#include "sxblockcache.h"
 #include "logsmodel.h"
 #include "singleapp/qtsingleapplication.h"
 #include "scoutcontroller.h"
+#include "scoutbenchmark.h"
+#include <QJsonDocument>
+#include <iostream>
+
+static const qint64 sBlockCacheSize = 1024*1024*1024;
 
 int main(int argc, char *argv[])
 {
@@ -46,6 +53,17 @@ int main(int argc, char *argv[])
     app.setApplicationVersion(SCOUTVERSION);
     app.setQuitOnLastWindowClosed(false);
 
+    if (app.arguments().count() == 2 && app.arguments().at(1) == "--benchmark") {
+        // the benchmark gets its own settings and caches, not the user's
+        app.setApplicationName("SXScout-benchmark");
+        QStandardPaths::setTestModeEnabled(true);
+        SxLog::instance().setLogLevel(LogLevel::Error);
+        ScoutBenchmark benchmark;
+        benchmark.run({10000, 100000, 500000});
+        std::cerr << benchmark.report().toLocal8Bit().constData() << std::endl;
+        std::cout << QJsonDocument(benchmark.toJson()).toJson().constData();
+        return 0;
+    }
     if (app.arguments().count() > 2) {
         qCritical() << "invalid arguments";
         return 1;
@@ -68,6 +86,8 @@ int main(int argc, char *argv[])
         app.sendMessage("newWindow");
         return 0;
     }
+    // files opened again are served from the blocks of the previous download
+    SxBlockCache::instance().setDirectory(QStandardPaths::writableLocation(QStandardPaths::CacheLocation) + "/blocks", sBlockCacheSize);
     ScoutController mainController;
     QObject::connect(&app, &QtSingleApplication::messageReceived, &mainController, &ScoutController::messageReceived);
     return app.exec();
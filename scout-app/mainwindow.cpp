@@ -66,16 +66,24 @@ QPixmap MainWindow::iconForMimeType(QString mimeType, bool smallImage) {
         {"File/text",        ":/remoteBrowser/file_text"},
         {"File/video",        ":/remoteBrowser/file_video"},
     };
-    QString pixmapName = mimeTypeIcon.value(mimeType);
-    if (pixmapName.isEmpty())
-        return QPixmap(":/remoteBrowser/no_icon.png");
-    if (smallImage)
-        pixmapName+="_small";
-    pixmapName+=".png";
+    // views ask for an icon on every repaint of every cell, each one is loaded once
+    static QHash<QString, QPixmap> loadedIcons;
+    QString cacheKey = smallImage ? mimeType+"_small" : mimeType;
+    auto cached = loadedIcons.constFind(cacheKey);
+    if (cached != loadedIcons.constEnd())
+        return cached.value();
 
-    QPixmap pixmap(pixmapName);
+    QString pixmapName = mimeTypeIcon.value(mimeType);
+    QPixmap pixmap;
+    if (!pixmapName.isEmpty()) {
+        if (smallImage)
+            pixmapName+="_small";
+        pixmapName+=".png";
+        pixmap = QPixmap(pixmapName);
+    }
     if (pixmap.isNull())
-        return QPixmap(":/remoteBrowser/no_icon.png");
+        pixmap = QPixmap(":/remoteBrowser/no_icon.png");
+    loadedIcons.insert(cacheKey, pixmap);
     return pixmap;
 }
 
@@ -131,6 +139,7 @@ MainWindow::MainWindow(ScoutConfig *config, ScoutQueue *queue, QWidget *parent)
     ui->filesView->horizontalHeader()->setDefaultSectionSize(150);
     auto filesViewItemDelegate = new FileViewDelegate(mModel, ui->filesView, this);
     connect(filesViewItemDelegate, &FileViewDelegate::setRowHeight, ui->filesView, &FilesTableView::resizeRowHeight);
+    filesViewItemDelegate->setPreviews(new ScoutPreviews(mModel, this));
     ui->filesView->setItemDelegate(filesViewItemDelegate);
     ui->filesView->horizontalHeader()->setSectionResizeMode(QHeaderView::ResizeToContents);
     ui->filesView->verticalHeader()->setSectionResizeMode(QHeaderView::ResizeToContents);
@@ -11,6 +11,8 @@ greaterThan(QT_MAJOR_VERSION, 4): QT += widgets
 
 CONFIG += c++11
 CONFIG += debug_and_release
+# Entry and Debug log lines are compiled out of release builds
+CONFIG(release, debug|release): DEFINES += SXLOG_MIN_LEVEL=2
 
 TARGET = sxscout
 TEMPLATE = app
@@ -47,7 +49,9 @@ SOURCES += main.cpp \
     scoutcontroller.cpp \
     sizevalidator.cpp \
     openingfiledialog.cpp \
-    taskdialoglistview.cpp
+    taskdialoglistview.cpp \
+    scoutbenchmark.cpp \
+    scoutpreviews.cpp
 
 FORMS += \
     detailsdialog.ui \
@@ -71,7 +75,9 @@ HEADERS += \
     scoutcontroller.h \
     sizevalidator.h \
     openingfiledialog.h \
-    taskdialoglistview.h
+    taskdialoglistview.h \
+    scoutbenchmark.h \
+    scoutpreviews.h
 
 QMAKE_MAC_SDK = macosx10.11
 ICON = assets/scout.icns
@@ -133,6 +139,7 @@ macx {
     PRE_TARGETDEPS += $$PWD/../3rdparty/openssl-osx/lib/libcrypto.a
 }
 else:unix:  LIBS += -lssl -lcrypto
+unix:       LIBS += -lz
 else:win32:LIBS += -L$$PWD/../3rdparty/openssl-win32/lib/ -llibeay32 -lssleay32
 
 RESOURCES += \
@@ -0,0 +1,278 @@
+/*
+ *  Copyright (C) 2012-2016 Skylable Ltd. <info-copyright@skylable.com>
+ *
+ *  This program is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public License
+ *  as published by the Free Software Foundation; either version 2
+ *  of the License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA.
+ *
+ *  Special exception for linking this software with OpenSSL:
+ *
+ *  In addition, as a special exception, Skylable Ltd. gives permission to
+ *  link the code of this program with the OpenSSL library and distribute
+ *  linked combinations including the two. You must obey the GNU General
+ *  Public License in all respects for all of the code used other than
+ *  OpenSSL. You may extend this exception to your version of the program,
+ *  but you are not obligated to do so. If you do not wish to do so, delete
+ *  this exception statement from your version.
+ */
+
+#include "scoutbenchmark.h"
+#include "scoutmodel.h"
+#include "scoutqueue.h"
+#include "filestableview.h"
+#include "sxfileentry.h"
+
+#include <QCoreApplication>
+#include <QElapsedTimer>
+#include <QEvent>
+#include <QHeaderView>
+#include <QScrollBar>
+#include <QJsonArray>
+#include <algorithm>
+
+ScoutBenchmark::ScoutBenchmark() : QObject(nullptr)
+{
+    mQueue = new ScoutQueue(mConfig.clusterConfig());
+    mModel = new ScoutModel(mConfig.clusterConfig(), mQueue);
+    mPainted = false;
+
+    // the same setup as the files view of MainWindow
+    mView = new FilesTableView();
+    mView->setConfig(&mConfig);
+    mView->setModel(mModel);
+    mView->setRootIndex(mModel->filesIndex());
+    mView->horizontalHeader()->setDefaultSectionSize(sItemWidth);
+    auto delegate = new FileViewDelegate(mModel, mView, mView);
+    connect(delegate, &FileViewDelegate::setRowHeight, mView, &FilesTableView::resizeRowHeight);
+    mView->setItemDelegate(delegate);
+    mView->horizontalHeader()->setSectionResizeMode(QHeaderView::ResizeToContents);
+    mView->verticalHeader()->setSectionResizeMode(QHeaderView::ResizeToContents);
+    mView->setVerticalScrollMode(QAbstractItemView::ScrollPerPixel);
+    mView->setHorizontalScrollMode(QAbstractItemView::ScrollPerPixel);
+    mView->verticalScrollBar()->setSingleStep(10);
+    mView->resize(sViewWidth, sViewHeight);
+    mView->viewport()->installEventFilter(this);
+    mView->show();
+
+    // listings are applied as if they came for the root of a volume
+    mModel->mCurrentVolume = "bench";
+    mModel->mCurrentPath = "/";
+}
+
+ScoutBenchmark::~ScoutBenchmark()
+{
+    delete mView;
+    delete mModel;
+    delete mQueue;
+}
+
+void ScoutBenchmark::run(const QList<int> &sizes)
+{
+    foreach (int entries, sizes) {
+        Result result;
+        _measure(entries, result);
+        _measureQueue(entries/10, result);
+        mResults.append(result);
+    }
+}
+
+QString ScoutBenchmark::report() const
+{
+    auto ms = [](qint64 nsecs) {
+        return QString::number(static_cast<double>(nsecs)/1e6, 'f', 2);
+    };
+    QStringList lines;
+    foreach (const Result &result, mResults) {
+        lines.append(QString("%1 entries, %2 columns").arg(result.entries).arg(result.columns));
+        lines.append(QString("  first paint          %1 ms").arg(ms(result.firstPaint)));
+        lines.append(QString("  scroll frame         %1 ms median, %2 ms p95").arg(ms(percentile(result.scrollFrames, 50)), ms(percentile(result.scrollFrames, 95))));
+        lines.append(QString("  jump frame           %1 ms median, %2 ms p95").arg(ms(percentile(result.jumpFrames, 50)), ms(percentile(result.jumpFrames, 95))));
+        lines.append(QString("  create2Dselection    %1 ms").arg(ms(result.create2Dselection)));
+        lines.append(QString("  mapSelectionFrom2D   %1 ms").arg(ms(result.mapSelectionFrom2D)));
+        lines.append(QString("  findNext             %1 ms per key").arg(ms(result.findNext)));
+        lines.append(QString("  queue of %1 tasks    %2 ms append, %3 ms data, %4 ms cancel").arg(result.queueTasks)
+                     .arg(ms(result.queueAppend), ms(result.queueData), ms(result.queueCancel)));
+    }
+    return lines.join("\n");
+}
+
+QJsonObject ScoutBenchmark::toJson() const
+{
+    auto ms = [](qint64 nsecs) {
+        return static_cast<double>(nsecs)/1e6;
+    };
+    auto frames = [&ms](const QVector<qint64> &values) {
+        QJsonObject json;
+        json.insert("medianMs", ms(percentile(values, 50)));
+        json.insert("p95Ms", ms(percentile(values, 95)));
+        json.insert("maxMs", ms(percentile(values, 100)));
+        return json;
+    };
+    QJsonArray jResults;
+    foreach (const Result &result, mResults) {
+        QJsonObject json;
+        json.insert("entries", result.entries);
+        json.insert("columns", result.columns);
+        json.insert("firstPaintMs", ms(result.firstPaint));
+        json.insert("scrollFrames", frames(result.scrollFrames));
+        json.insert("jumpFrames", frames(result.jumpFrames));
+        json.insert("create2DselectionMs", ms(result.create2Dselection));
+        json.insert("mapSelectionFrom2DMs", ms(result.mapSelectionFrom2D));
+        json.insert("findNextMs", ms(result.findNext));
+        json.insert("queueTasks", result.queueTasks);
+        json.insert("queueAppendMs", ms(result.queueAppend));
+        json.insert("queueDataMs", ms(result.queueData));
+        json.insert("queueCancelMs", ms(result.queueCancel));
+        jResults.append(json);
+    }
+    QJsonObject json;
+    json.insert("results", jResults);
+    return json;
+}
+
+bool ScoutBenchmark::eventFilter(QObject *watched, QEvent *event)
+{
+    if (watched == mView->viewport() && event->type() == QEvent::Paint)
+        mPainted = true;
+    return QObject::eventFilter(watched, event);
+}
+
+void ScoutBenchmark::_measure(int entries, Result &result)
+{
+    result.entries = entries;
+    // the previous listing goes away first, like when another directory is opened
+    QList<SxFileEntry*> fileList;
+    mModel->applyFileList(fileList);
+    qDeleteAll(fileList);
+    QCoreApplication::processEvents();
+    result.columns = qMax(1, mView->width()/sItemWidth);
+    mModel->setFilesColumnCount(result.columns);
+
+    fileList = listing(entries);
+    QElapsedTimer timer;
+    timer.start();
+    mModel->applyFileList(fileList);
+    mView->setRowCount(mModel->rowCount(mModel->filesIndex()));
+    result.firstPaint = _waitForPaint() ? timer.nsecsElapsed() : -1;
+    qDeleteAll(fileList);
+
+    // wheel notches from the top, then jumps across the whole listing
+    QScrollBar *scrollBar = mView->verticalScrollBar();
+    scrollBar->setValue(0);
+    QCoreApplication::processEvents();
+    for (int i=0; i<sScrollFrames; i++) {
+        timer.restart();
+        scrollBar->setValue(scrollBar->value() + 3*scrollBar->singleStep());
+        mView->viewport()->repaint();
+        result.scrollFrames.append(timer.nsecsElapsed());
+    }
+    for (int i=0; i<sScrollFrames; i++) {
+        timer.restart();
+        scrollBar->setValue(static_cast<int>(static_cast<qint64>(scrollBar->maximum()) * ((i*37) % sScrollFrames) / sScrollFrames));
+        mView->viewport()->repaint();
+        result.jumpFrames.append(timer.nsecsElapsed());
+    }
+    scrollBar->setValue(0);
+
+    // everything selected, as kept across a change of the column count
+    QList<int> items;
+    items.reserve(entries);
+    for (int i=0; i<entries; i++)
+        items.append(i);
+    timer.restart();
+    QModelIndexList selection = mModel->create2Dselection(items);
+    result.create2Dselection = timer.nsecsElapsed();
+    timer.restart();
+    QList<int> mapped = mModel->mapSelectionFrom2D(selection);
+    result.mapSelectionFrom2D = timer.nsecsElapsed();
+    Q_UNUSED(mapped);
+
+    // '#' starts no name, every press of it goes through the whole listing
+    const QString keys = "asxq#";
+    QModelIndex from;
+    int calls = 0;
+    timer.restart();
+    for (int round=0; round<sFindNextRounds; round++) {
+        foreach (QChar key, keys) {
+            from = mModel->findNext(key, from);
+            ++calls;
+        }
+    }
+    result.findNext = timer.nsecsElapsed()/calls;
+}
+
+void ScoutBenchmark::_measureQueue(int tasks, Result &result)
+{
+    result.queueTasks = tasks;
+    QElapsedTimer timer;
+    timer.start();
+    for (int i=0; i<tasks; i++) {
+        QString name = QString("file%1.bin").arg(i);
+        mQueue->appendTask(new ScoutTask(i%2 == 0, name, "bench", "/tmp/"+name, "/"+name));
+    }
+    result.queueAppend = timer.nsecsElapsed();
+
+    // the tasks dialog reads every role of the rows it shows
+    const QList<int> roles = {ScoutQueue::DirectionRole, ScoutQueue::TitleRole, ScoutQueue::SizeRole, ScoutQueue::ErrorRole};
+    int rows = mQueue->rowCount(mQueue->tasksIndex());
+    timer.restart();
+    for (int i=0; i<rows; i++) {
+        QModelIndex index = mQueue->index(i, 0, mQueue->tasksIndex());
+        foreach (int role, roles) {
+            mQueue->data(index, role);
+        }
+    }
+    result.queueData = timer.nsecsElapsed();
+
+    timer.restart();
+    for (int i=mQueue->pendingCount()-1; i>=0; i--)
+        mQueue->cancelPendingTask(i);
+    result.queueCancel = timer.nsecsElapsed();
+}
+
+bool ScoutBenchmark::_waitForPaint()
+{
+    // the flag is set when the paint event is delivered, it is handled before processEvents returns
+    mPainted = false;
+    QElapsedTimer timer;
+    timer.start();
+    while (!mPainted && timer.elapsed() < sPaintTimeout)
+        QCoreApplication::processEvents(QEventLoop::AllEvents, 50);
+    return mPainted;
+}
+
+QList<SxFileEntry*> ScoutBenchmark::listing(int entries)
+{
+    static const char *sWords[] = {"report", "photo", "invoice", "backup", "notes", "draft", "scan", "music", "video", "archive"};
+    static const char *sExtensions[] = {"jpg", "pdf", "txt", "docx", "mp3", "zip"};
+    QList<SxFileEntry*> list;
+    list.reserve(entries);
+    for (int i=0; i<entries; i++) {
+        quint32 x = static_cast<quint32>(i)*2654435761u;
+        QString name = QString("%1%2-%3").arg(QChar('a' + static_cast<char>((x >> 8) % 26))).arg(sWords[(x >> 16) % 10]).arg(i);
+        // one entry in twenty is a directory
+        if (i % 20 == 0)
+            list.append(new SxFileEntry("/"+name+"/", 0));
+        else
+            list.append(new SxFileEntry("/"+name+"."+sExtensions[(x >> 4) % 6], x % (10*1024*1024), "2016-01-01 00:00:00.000:rev", 1451606400));
+    }
+    return list;
+}
+
+qint64 ScoutBenchmark::percentile(QVector<qint64> values, int percent)
+{
+    if (values.isEmpty())
+        return 0;
+    std::sort(values.begin(), values.end());
+    return values.at(qMin(values.count()-1, values.count()*percent/100));
+}
@@ -0,0 +1,96 @@
+/*
+ *  Copyright (C) 2012-2016 Skylable Ltd. <info-copyright@skylable.com>
+ *
+ *  This program is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public License
+ *  as published by the Free Software Foundation; either version 2
+ *  of the License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA.
+ *
+ *  Special exception for linking this software with OpenSSL:
+ *
+ *  In addition, as a special exception, Skylable Ltd. gives permission to
+ *  link the code of this program with the OpenSSL library and distribute
+ *  linked combinations including the two. You must obey the GNU General
+ *  Public License in all respects for all of the code used other than
+ *  OpenSSL. You may extend this exception to your version of the program,
+ *  but you are not obligated to do so. If you do not wish to do so, delete
+ *  this exception statement from your version.
+ */
+
+#ifndef SCOUTBENCHMARK_H
+#define SCOUTBENCHMARK_H
+
+#include <QObject>
+#include <QList>
+#include <QVector>
+#include <QJsonObject>
+#include "scoutconfig.h"
+
+class ScoutModel;
+class ScoutQueue;
+class FilesTableView;
+class SxFileEntry;
+
+/* Times the browser's hot paths on synthetic listings: the first paint of a
+ * listing, scrolling, the selection mapping done when the column count
+ * changes, type-ahead and the task queue model. Run with sxscout --benchmark,
+ * QT_QPA_PLATFORM=offscreen works without a display */
+class ScoutBenchmark : public QObject
+{
+    Q_OBJECT
+public:
+    ScoutBenchmark();
+    ~ScoutBenchmark();
+    void run(const QList<int> &sizes);
+    QString report() const;
+    QJsonObject toJson() const;
+
+protected:
+    bool eventFilter(QObject *watched, QEvent *event) override;
+
+private:
+    struct Result {
+        int entries;
+        int columns;
+        qint64 firstPaint;
+        QVector<qint64> scrollFrames;
+        QVector<qint64> jumpFrames;
+        qint64 create2Dselection;
+        qint64 mapSelectionFrom2D;
+        qint64 findNext;
+        int queueTasks;
+        qint64 queueAppend;
+        qint64 queueData;
+        qint64 queueCancel;
+    };
+    void _measure(int entries, Result &result);
+    void _measureQueue(int tasks, Result &result);
+    bool _waitForPaint();
+    static QList<SxFileEntry*> listing(int entries);
+    static qint64 percentile(QVector<qint64> values, int percent);
+
+    ScoutConfig mConfig;
+    ScoutQueue *mQueue;
+    ScoutModel *mModel;
+    FilesTableView *mView;
+    bool mPainted;
+    QList<Result> mResults;
+
+    static const int sViewWidth = 1200;
+    static const int sViewHeight = 800;
+    static const int sItemWidth = 150;
+    static const int sScrollFrames = 100;
+    static const int sFindNextRounds = 20;
+    static const int sPaintTimeout = 120000;
+};
+
+#endif // SCOUTBENCHMARK_H
@@ -99,3 +99,8 @@ bool ScoutConfig::cacheEnabled() const
 {
     return mSettings->value("cache/enabled", true).toBool();
 }
+
+int ScoutConfig::parallelTasks() const
+{
+    return mSettings->value("queue/parallelTasks", 3).toInt();
+}
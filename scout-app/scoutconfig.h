@@ -50,6 +50,7 @@ public:
     void setCacheSize(qint64 fileSizeLimit, qint64 cacheSize);
     void setCacheEnabled(bool enabled);
     bool cacheEnabled() const;
+    int parallelTasks() const;
 
 private:
     ScoutShareConfig *mShareConfig;
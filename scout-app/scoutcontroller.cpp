@@ -48,6 +48,7 @@ ScoutController::ScoutController(QObject *parent) : QObject(parent)
 
     mTaskDialog = nullptr;
     mQueue = new ScoutQueue(mConfig.clusterConfig());
+    mQueue->setParallelTasks(mConfig.parallelTasks());
     mQueueThread = new QThread();
     mQueueThread->start(QThread::NormalPriority);
     mQueue->moveToThread(mQueueThread);
@@ -111,6 +112,7 @@ void ScoutController::onClusterConfigChanged()
         mTaskDialog->close();
     delete mQueue;
     mQueue = new ScoutQueue(mConfig.clusterConfig());
+    mQueue->setParallelTasks(mConfig.parallelTasks());
     mQueue->moveToThread(mQueueThread);
     foreach (auto window, mWindows) {
         window->reloadConfig(mQueue);
@@ -0,0 +1,351 @@
+/*
+ *  Copyright (C) 2012-2016 Skylable Ltd. <info-copyright@skylable.com>
+ *
+ *  This program is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public License
+ *  as published by the Free Software Foundation; either version 2
+ *  of the License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA.
+ *
+ *  Special exception for linking this software with OpenSSL:
+ *
+ *  In addition, as a special exception, Skylable Ltd. gives permission to
+ *  link the code of this program with the OpenSSL library and distribute
+ *  linked combinations including the two. You must obey the GNU General
+ *  Public License in all respects for all of the code used other than
+ *  OpenSSL. You may extend this exception to your version of the program,
+ *  but you are not obligated to do so. If you do not wish to do so, delete
+ *  this exception statement from your version.
+ */
+
+#include "scoutpreviews.h"
+#include "scoutmodel.h"
+#include "sxblockcache.h"
+#include "sxcluster.h"
+#include "sxfilter.h"
+#include "sxlog.h"
+#include "sxrangereader.h"
+#include <QBuffer>
+#include <QCryptographicHash>
+#include <QImageReader>
+#include <QTimer>
+#include <QtEndian>
+#include <cstring>
+#include <memory>
+
+ScoutPreviews::ScoutPreviews(ScoutModel *model, QObject *parent) : QObject(parent)
+{
+    mModel = model;
+    mWorker = nullptr;
+    mPixmaps.setMaxCost(sPixmapsLimit);
+    connect(mModel, &ScoutModel::configReloaded, this, &ScoutPreviews::restartWorker);
+    startWorker();
+}
+
+ScoutPreviews::~ScoutPreviews()
+{
+    stopWorker();
+}
+
+bool ScoutPreviews::canPreview(const QString &mimeType)
+{
+    return mimeType == "File/image";
+}
+
+/* called from paint, a missing thumbnail is requested once and the view repainted when it arrives */
+QPixmap ScoutPreviews::preview(const QString &volume, const QString &path, const QString &revision, qint64 size)
+{
+    QString key = volume + ":" + path + "@" + revision;
+    QPixmap *pixmap = mPixmaps.object(key);
+    if (pixmap != nullptr)
+        return *pixmap;
+    if (mWorker == nullptr || size <= 0 || mRequested.contains(key) || mUnavailable.contains(key))
+        return QPixmap();
+    mRequested.insert(key);
+    emit requestPreview(key, volume, path, revision, size);
+    return QPixmap();
+}
+
+void ScoutPreviews::previewFinished(const QString &key, const QImage &thumbnail)
+{
+    if (!mRequested.remove(key))
+        return;
+    if (thumbnail.isNull()) {
+        mUnavailable.insert(key);
+        return;
+    }
+    mPixmaps.insert(key, new QPixmap(QPixmap::fromImage(thumbnail)));
+    emit previewReady();
+}
+
+void ScoutPreviews::previewDropped(const QString &key)
+{
+    // asked again the next time the cell is painted
+    mRequested.remove(key);
+}
+
+void ScoutPreviews::restartWorker()
+{
+    stopWorker();
+    mRequested.clear();
+    mUnavailable.clear();
+    startWorker();
+}
+
+void ScoutPreviews::startWorker()
+{
+    ClusterConfig *config = mModel->clusterConfig();
+    if (config == nullptr)
+        return;
+    mWorker = new ScoutPreviewWorker(config->sxAuth(), config->uuid(), mModel->checkCertCallback());
+    mWorker->moveToThread(&mThread);
+    connect(&mThread, &QThread::finished, mWorker, &QObject::deleteLater);
+    connect(this, &ScoutPreviews::requestPreview, mWorker, &ScoutPreviewWorker::request);
+    connect(mWorker, &ScoutPreviewWorker::finished, this, &ScoutPreviews::previewFinished);
+    connect(mWorker, &ScoutPreviewWorker::dropped, this, &ScoutPreviews::previewDropped);
+    mThread.start(QThread::LowPriority);
+}
+
+void ScoutPreviews::stopWorker()
+{
+    if (mWorker == nullptr)
+        return;
+    mWorker->stop();
+    mThread.quit();
+    mThread.wait();
+    mWorker = nullptr;
+}
+
+ScoutPreviewWorker::ScoutPreviewWorker(const SxAuth &auth, const QByteArray &uuid, std::function<bool (QSslCertificate &, bool)> checkCertCallback)
+    : QObject()
+{
+    mAuth = auth;
+    mUuid = uuid;
+    mCheckCertCallback = checkCertCallback;
+    mCluster = nullptr;
+    mScheduled = false;
+}
+
+ScoutPreviewWorker::~ScoutPreviewWorker()
+{
+    delete mCluster;
+}
+
+void ScoutPreviewWorker::stop()
+{
+    mStopped.store(1);
+}
+
+void ScoutPreviewWorker::request(const QString &key, const QString &volume, const QString &path, const QString &revision, qint64 size)
+{
+    // the cells painted last are the ones on screen now
+    mPending.prepend({key, volume, path, revision, size});
+    while (mPending.count() > sPendingLimit)
+        emit dropped(mPending.takeLast().key);
+    if (!mScheduled) {
+        mScheduled = true;
+        QTimer::singleShot(0, this, SLOT(fetchNext()));
+    }
+}
+
+void ScoutPreviewWorker::fetchNext()
+{
+    // one file at a time, requests queued meanwhile are sorted in first
+    mScheduled = false;
+    if (mPending.isEmpty() || mStopped.load())
+        return;
+    Request request = mPending.takeFirst();
+    emit finished(request.key, fetch(request));
+    if (!mPending.isEmpty()) {
+        mScheduled = true;
+        QTimer::singleShot(0, this, SLOT(fetchNext()));
+    }
+}
+
+QImage ScoutPreviewWorker::fetch(const Request &request)
+{
+    QImage thumbnail;
+    QString hash;
+    if (!request.revision.isEmpty()) {
+        hash = cacheHash(request.volume, request.path, request.revision);
+        if (loadThumbnail(hash, thumbnail))
+            return thumbnail;
+    }
+    SxVolume *sxVolume = getVolume(request.volume);
+    if (sxVolume == nullptr)
+        return thumbnail;
+    // only plain content can be decoded from ranges
+    std::unique_ptr<SxFilter> filter(SxFilter::getActiveFilter(sxVolume));
+    if (filter != nullptr)
+        return thumbnail;
+
+    SxRangeReader reader(mCluster, sxVolume, request.path, request.revision);
+    if (!reader.open()) {
+        logWarning(QString("unable to open %1 for preview: %2").arg(request.path, reader.lastError().errorMessage()));
+        return thumbnail;
+    }
+    if (hash.isEmpty()) {
+        // cached listings carry no revision, the one just opened is used instead
+        hash = cacheHash(request.volume, request.path, reader.revision());
+        if (loadThumbnail(hash, thumbnail))
+            return thumbnail;
+    }
+    const qint64 size = reader.size();
+    QByteArray header;
+    if (!reader.read(0, qMin<qint64>(size, sHeaderSize), header))
+        return thumbnail;
+    QByteArray embedded = exifThumbnail(header);
+    if (!embedded.isEmpty())
+        thumbnail = decodeThumbnail(embedded);
+    if (thumbnail.isNull() && size <= sFullReadLimit) {
+        QByteArray data = header;
+        if (size > header.size()) {
+            QByteArray rest;
+            if (!reader.read(header.size(), size - header.size(), rest))
+                return thumbnail;
+            data.append(rest);
+        }
+        thumbnail = decodeThumbnail(data);
+    }
+    if (!thumbnail.isNull())
+        storeThumbnail(hash, thumbnail);
+    return thumbnail;
+}
+
+SxVolume *ScoutPreviewWorker::getVolume(const QString &volume)
+{
+    if (mCluster == nullptr) {
+        QString errorMessage;
+        mCluster = SxCluster::initializeCluster(mAuth, mUuid, mCheckCertCallback, errorMessage);
+        if (mCluster == nullptr) {
+            logWarning("ScoutPreviewWorker: Unable to initialize cluster: "+errorMessage);
+            return nullptr;
+        }
+        mCluster->reloadVolumes();
+    }
+    SxVolume *sxVolume = mCluster->getSxVolume(volume);
+    if (sxVolume == nullptr && mCluster->reloadVolumes())
+        sxVolume = mCluster->getSxVolume(volume);
+    return sxVolume;
+}
+
+QString ScoutPreviewWorker::cacheHash(const QString &volume, const QString &path, const QString &revision)
+{
+    QCryptographicHash sha1(QCryptographicHash::Sha1);
+    sha1.addData("preview:" + volume.toUtf8() + ":" + path.toUtf8() + "@" + revision.toUtf8());
+    return sha1.result().toHex();
+}
+
+bool ScoutPreviewWorker::loadThumbnail(const QString &hash, QImage &thumbnail)
+{
+    QByteArray slot;
+    if (!SxBlockCache::instance().get(hash, sCacheSlotSize, slot))
+        return false;
+    quint32 length = qFromBigEndian<quint32>(reinterpret_cast<const uchar*>(slot.constData()));
+    if (length == 0 || length > static_cast<quint32>(sCacheSlotSize) - 4)
+        return false;
+    return thumbnail.loadFromData(reinterpret_cast<const uchar*>(slot.constData()) + 4, static_cast<int>(length));
+}
+
+void ScoutPreviewWorker::storeThumbnail(const QString &hash, const QImage &thumbnail)
+{
+    if (!SxBlockCache::instance().enabled())
+        return;
+    QByteArray encoded;
+    QBuffer buffer(&encoded);
+    buffer.open(QIODevice::WriteOnly);
+    if (!thumbnail.save(&buffer, thumbnail.hasAlphaChannel() ? "PNG" : "JPG", 85))
+        return;
+    if (encoded.size() > sCacheSlotSize - 4)
+        return;
+    QByteArray slot(sCacheSlotSize, '\0');
+    qToBigEndian<quint32>(static_cast<quint32>(encoded.size()), reinterpret_cast<uchar*>(slot.data()));
+    memcpy(slot.data() + 4, encoded.constData(), static_cast<size_t>(encoded.size()));
+    SxBlockCache::instance().put(hash, sCacheSlotSize, slot.constData());
+}
+
+/* the JPEG stored in IFD1 of the APP1 Exif segment, empty if there is none within the header */
+QByteArray ScoutPreviewWorker::exifThumbnail(const QByteArray &header)
+{
+    const uchar *data = reinterpret_cast<const uchar*>(header.constData());
+    const int size = header.size();
+    if (size < 4 || data[0] != 0xff || data[1] != 0xd8)
+        return QByteArray();
+    int pos = 2;
+    while (pos + 4 <= size && data[pos] == 0xff) {
+        const uchar marker = data[pos+1];
+        const int length = qFromBigEndian<quint16>(data + pos + 2);
+        // image data follows the start of scan, there are no more metadata segments
+        if (marker == 0xda || length < 2)
+            break;
+        const int segment = pos + 4;
+        const int segmentEnd = qMin(pos + 2 + length, size);
+        if (marker == 0xe1 && segmentEnd - segment > 14 && memcmp(data + segment, "Exif\0\0", 6) == 0) {
+            const int tiff = segment + 6;
+            const int tiffSize = segmentEnd - tiff;
+            const bool littleEndian = data[tiff] == 'I';
+            auto read16 = [&](int offset) -> int {
+                if (offset < 0 || offset + 2 > tiffSize)
+                    return -1;
+                return littleEndian ? qFromLittleEndian<quint16>(data + tiff + offset) : qFromBigEndian<quint16>(data + tiff + offset);
+            };
+            auto read32 = [&](int offset) -> qint64 {
+                if (offset < 0 || offset + 4 > tiffSize)
+                    return -1;
+                return littleEndian ? qFromLittleEndian<quint32>(data + tiff + offset) : qFromBigEndian<quint32>(data + tiff + offset);
+            };
+            if (read16(2) != 42)
+                return QByteArray();
+            qint64 ifd0 = read32(4);
+            int entries = read16(static_cast<int>(ifd0));
+            if (entries < 0)
+                return QByteArray();
+            qint64 ifd1 = read32(static_cast<int>(ifd0 + 2 + entries*12));
+            entries = read16(static_cast<int>(ifd1));
+            if (ifd1 <= 0 || entries < 0)
+                return QByteArray();
+            qint64 thumbnailOffset = -1, thumbnailLength = -1;
+            for (int i=0; i<entries; i++) {
+                int entry = static_cast<int>(ifd1 + 2 + i*12);
+                int tag = read16(entry);
+                if (tag == 0x0201)
+                    thumbnailOffset = read32(entry + 8);
+                else if (tag == 0x0202)
+                    thumbnailLength = read32(entry + 8);
+            }
+            if (thumbnailOffset <= 0 || thumbnailLength <= 0 || thumbnailOffset + thumbnailLength > tiffSize)
+                return QByteArray();
+            return header.mid(tiff + static_cast<int>(thumbnailOffset), static_cast<int>(thumbnailLength));
+        }
+        pos += 2 + length;
+    }
+    return QByteArray();
+}
+
+QImage ScoutPreviewWorker::decodeThumbnail(const QByteArray &data)
+{
+    QBuffer buffer;
+    buffer.setData(data);
+    buffer.open(QIODevice::ReadOnly);
+    QImageReader imageReader(&buffer);
+    QSize size = imageReader.size();
+    if (size.isValid() && (size.width() > sThumbnailSize || size.height() > sThumbnailSize)) {
+        // decoders supporting it skip the detail that would be scaled away anyway
+        size.scale(sThumbnailSize*2, sThumbnailSize*2, Qt::KeepAspectRatio);
+        imageReader.setScaledSize(size);
+    }
+    QImage image = imageReader.read();
+    if (image.isNull())
+        return image;
+    if (image.width() > sThumbnailSize || image.height() > sThumbnailSize)
+        image = image.scaled(sThumbnailSize, sThumbnailSize, Qt::KeepAspectRatio, Qt::SmoothTransformation);
+    return image;
+}
@@ -0,0 +1,133 @@
+/*
+ *  Copyright (C) 2012-2016 Skylable Ltd. <info-copyright@skylable.com>
+ *
+ *  This program is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public License
+ *  as published by the Free Software Foundation; either version 2
+ *  of the License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA.
+ *
+ *  Special exception for linking this software with OpenSSL:
+ *
+ *  In addition, as a special exception, Skylable Ltd. gives permission to
+ *  link the code of this program with the OpenSSL library and distribute
+ *  linked combinations including the two. You must obey the GNU General
+ *  Public License in all respects for all of the code used other than
+ *  OpenSSL. You may extend this exception to your version of the program,
+ *  but you are not obligated to do so. If you do not wish to do so, delete
+ *  this exception statement from your version.
+ */
+
+#ifndef SCOUTPREVIEWS_H
+#define SCOUTPREVIEWS_H
+
+#include <QAtomicInt>
+#include <QCache>
+#include <QImage>
+#include <QObject>
+#include <QPixmap>
+#include <QSet>
+#include <QThread>
+#include <functional>
+#include "sxauth.h"
+
+class QSslCertificate;
+class ScoutModel;
+class ScoutPreviewWorker;
+class SxCluster;
+class SxVolume;
+
+/* Thumbnails of remote images for the cells the files view paints. Nothing is requested
+ * until a cell asks for it, the worker only downloads the byte ranges a thumbnail needs
+ * and keeps the result by revision in the block cache */
+class ScoutPreviews : public QObject
+{
+    Q_OBJECT
+public:
+    explicit ScoutPreviews(ScoutModel *model, QObject *parent = nullptr);
+    ~ScoutPreviews();
+    static bool canPreview(const QString &mimeType);
+    QPixmap preview(const QString &volume, const QString &path, const QString &revision, qint64 size);
+
+signals:
+    void previewReady();
+    void requestPreview(const QString &key, const QString &volume, const QString &path, const QString &revision, qint64 size);
+
+private slots:
+    void previewFinished(const QString &key, const QImage &thumbnail);
+    void previewDropped(const QString &key);
+    void restartWorker();
+
+private:
+    void startWorker();
+    void stopWorker();
+    ScoutModel *mModel;
+    QThread mThread;
+    ScoutPreviewWorker *mWorker;
+    QCache<QString, QPixmap> mPixmaps;
+    QSet<QString> mRequested;
+    QSet<QString> mUnavailable;
+    static const int sPixmapsLimit = 1024;
+};
+
+class ScoutPreviewWorker : public QObject
+{
+    Q_OBJECT
+public:
+    explicit ScoutPreviewWorker(const SxAuth &auth, const QByteArray &uuid, std::function<bool(QSslCertificate&, bool)> checkCertCallback);
+    ~ScoutPreviewWorker();
+    void stop();
+    static const int sThumbnailSize = 64;
+
+signals:
+    void finished(const QString &key, const QImage &thumbnail);
+    void dropped(const QString &key);
+
+public slots:
+    void request(const QString &key, const QString &volume, const QString &path, const QString &revision, qint64 size);
+
+private slots:
+    void fetchNext();
+
+private:
+    struct Request {
+        QString key;
+        QString volume;
+        QString path;
+        QString revision;
+        qint64 size;
+    };
+    QImage fetch(const Request &request);
+    SxVolume *getVolume(const QString &volume);
+    static QString cacheHash(const QString &volume, const QString &path, const QString &revision);
+    static bool loadThumbnail(const QString &hash, QImage &thumbnail);
+    static void storeThumbnail(const QString &hash, const QImage &thumbnail);
+    static QByteArray exifThumbnail(const QByteArray &header);
+    static QImage decodeThumbnail(const QByteArray &data);
+
+    // the embedded EXIF thumbnail always sits in the first APP1 segment
+    static const int sHeaderSize = 64*1024;
+    // files up to this size are downloaded and scaled down when they carry no thumbnail
+    static const qint64 sFullReadLimit = 4*1024*1024;
+    // block cache entries have a fixed size, the encoded thumbnail is padded to it
+    static const int sCacheSlotSize = 24*1024;
+    // cells scrolled out of view fall off the end
+    static const int sPendingLimit = 64;
+    QList<Request> mPending;
+    bool mScheduled;
+    QAtomicInt mStopped;
+    SxAuth mAuth;
+    QByteArray mUuid;
+    std::function<bool(QSslCertificate&, bool)> mCheckCertCallback;
+    SxCluster *mCluster;
+};
+
+#endif // SCOUTPREVIEWS_H
@@ -5,13 +5,15 @@
 #-------------------------------------------------
 
 QT       -= gui
-QT       += sql network core
+QT       += sql network core concurrent
 win32:  QT+= winextras
 macx:   QT+= macextras
 TARGET = scout-core
 TEMPLATE = lib
 CONFIG += staticlib c++11
 CONFIG += debug_and_release
+# Entry and Debug log lines are compiled out of release builds
+CONFIG(release, debug|release): DEFINES += SXLOG_MIN_LEVEL=2
 DEFINES += LIB_LIBRARY
 QMAKE_MAC_SDK = macosx10.11
 
@@ -27,9 +29,11 @@ DEPENDPATH += $$PWD/../sx-api
 
 win32 {
     HEADERS += \
-        winstorage.h
+        winstorage.h \
+        winstream.h
     SOURCES += \
-        winstorage.cpp
+        winstorage.cpp \
+        winstream.cpp
 }
 macx {
     LIBS += \
@@ -41,10 +45,12 @@ HEADERS += \
     scoutqueue.h \
     scoutmodel.h \
     scoutmimedata.h \
-    scoutdatabase.h
+    scoutdatabase.h \
+    scoutsearchindex.h
 
 SOURCES += \
     scoutqueue.cpp \
     scoutmodel.cpp \
     scoutmimedata.cpp \
-    scoutdatabase.cpp
+    scoutdatabase.cpp \
+    scoutsearchindex.cpp
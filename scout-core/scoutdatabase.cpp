@@ -32,9 +32,17 @@
 #include <QSqlQuery>
 #include <QSqlError>
 #include <QStandardPaths>
+#include <QThread>
+#include <QtConcurrent>
+#include <algorithm>
 
 ScoutDatabase::ScoutDatabase()
 {
+    // one writer keeps the writes in the order they were queued, its connection lives as long as the thread
+    mWriterPool.setMaxThreadCount(1);
+    mWriterPool.setExpiryTimeout(-1);
+    mReaderPool.setMaxThreadCount(sReaderThreads);
+    mReaderPool.setExpiryTimeout(-1);
     initializeDatabase();
 }
 
@@ -44,97 +52,243 @@ ScoutDatabase *ScoutDatabase::instance()
     return sDatabase;
 }
 
-bool ScoutDatabase::setFiles(const QString &volume, bool encryptedVolume, const QString &dir, const QString &etag, const QList<SxFileEntry *> &files)
+static QString parentDir(const QString &path)
 {
-    QSqlQuery query(mDatabase);
-    QSet<QString> skippedDirs;
-    if (encryptedVolume) {
-        if (!query.exec("begin transaction"))
-            return false;
-        query.prepare("delete from remoteFiles where volume=:volume");
-        query.bindValue(":volume", volume);
-        if (!query.exec()) {
-            query.exec("rollback transaction");
-            return false;
-        }
-        query = QSqlQuery(mDatabase);
-        if (!query.exec("commit transaction")) {
-            return false;
+    if (path == "/")
+        return "";
+    return path.mid(0, path.lastIndexOf('/', path.length()-2)+1);
+}
+
+QSqlDatabase ScoutDatabase::_connection()
+{
+    // a connection can only be used by the thread that opened it, every thread gets its own
+    QString name = QString("sxRemoteFilesBrowser-%1").arg(reinterpret_cast<quintptr>(QThread::currentThreadId()));
+    if (QSqlDatabase::contains(name))
+        return QSqlDatabase::database(name);
+    QSqlDatabase database = QSqlDatabase::addDatabase("QSQLITE", name);
+    database.setDatabaseName(mDbFile);
+    if (!database.open()) {
+        logError(QString("unable to open %1: %2").arg(mDbFile, database.lastError().text()));
+        return database;
+    }
+    // in WAL mode readers never wait for the writer, only a checkpoint can hold them back briefly
+    QSqlQuery query(database);
+    query.exec("PRAGMA synchronous=NORMAL");
+    query.exec("PRAGMA busy_timeout=5000");
+    return database;
+}
+
+/* never called on the writer thread, it would wait for itself */
+void ScoutDatabase::_waitForWrites()
+{
+    QFuture<void> lastWrite;
+    {
+        QMutexLocker locker(&mWriteMutex);
+        lastWrite = mLastWrite;
+    }
+    lastWrite.waitForFinished();
+}
+
+QFuture<ScoutDatabase::Listing> ScoutDatabase::readListing(const QString &volume, bool encryptedVolume, const QString &dir, const QString &path)
+{
+    return QtConcurrent::run(&mReaderPool, [this, volume, encryptedVolume, dir, path]() {
+        _waitForWrites();
+        Listing listing;
+        listing.etag = _getEtag(volume, dir);
+        listing.ok = _getFiles(volume, encryptedVolume, path, listing.files);
+        return listing;
+    });
+}
+
+QFuture<ScoutDatabase::Listing> ScoutDatabase::storeListing(const QString &volume, bool encryptedVolume, const QString &dir, const QString &etag,
+                                                            const QList<SxFileEntry *> &files, const QString &path)
+{
+    QMutexLocker locker(&mWriteMutex);
+    QFuture<Listing> future = QtConcurrent::run(&mWriterPool, [this, volume, encryptedVolume, dir, etag, files, path]() {
+        Listing listing;
+        listing.ok = _setFiles(volume, encryptedVolume, dir, etag, files);
+        qDeleteAll(files);
+        // read back on the writer connection, the listing includes what was just written
+        if (listing.ok && !path.isEmpty()) {
+            listing.etag = _getEtag(volume, dir);
+            listing.ok = _getFiles(volume, encryptedVolume, path, listing.files);
         }
+        return listing;
+    });
+    mLastWrite = future;
+    return future;
+}
+
+QFuture<QStringList> ScoutDatabase::readEtags(const QStringList &volumes, const QStringList &dirs)
+{
+    return QtConcurrent::run(&mReaderPool, [this, volumes, dirs]() {
+        _waitForWrites();
+        QStringList etags;
+        for (int i=0; i<volumes.count() && i<dirs.count(); i++)
+            etags.append(_getEtag(volumes.at(i), dirs.at(i)));
+        return etags;
+    });
+}
+
+QString ScoutDatabase::getEtag(const QString &volume, const QString &dir)
+{
+    _waitForWrites();
+    return _getEtag(volume, dir);
+}
+
+bool ScoutDatabase::getFiles(const QString &volume, bool encryptedVolume, const QString &dir, QList<SxFileEntry *> &files)
+{
+    _waitForWrites();
+    return _getFiles(volume, encryptedVolume, dir, files);
+}
+
+bool ScoutDatabase::_setFiles(const QString &volume, bool encryptedVolume, const QString &dir, const QString &etag, const QList<SxFileEntry *> &files)
+{
+    QSqlDatabase database = _connection();
+    {
+        QMutexLocker locker(&mCacheMutex);
+        mVolumeTrees.remove(volume);
+    }
+    // rows already stored for this listing, only the differences are written
+    QHash<QString, qint64> existing;
+    QSqlQuery query(database);
+    if (encryptedVolume) {
+        query.prepare("select path, size from remoteFiles where volume=:volume");
     }
     else {
-        QSet<QString> dirs;
-        if (!_getOnlyDirs(volume, dir, dirs, encryptedVolume))
-            return false;
-        foreach (auto entry, files) {
-            if (entry->path().endsWith('/')) {
-                if (dirs.contains(entry->path())) {
-                    skippedDirs.insert(entry->path());
-                    dirs.remove(entry->path());
-                }
-            }
-        }
-        if (!query.exec("begin transaction"))
-            return false;
-        query.prepare("delete from remoteFiles where volume=:volume and path like :path1 and path not like :path2");
-        query.bindValue(":volume", volume);
-        query.bindValue(":path1", dir+"%");
-        query.bindValue(":path2", dir+"%/%");
-        if (!query.exec()) {
-            query.exec("rollback transaction");
-            return false;
-        }
-        foreach (auto dir, dirs) {
-            query = QSqlQuery(mDatabase);
-            query.prepare("delete from remoteFiles where volume=:volume and path like :path");
-            query.bindValue(":volume", volume);
-            query.bindValue(":path", dir+"%");
-            if (!query.exec()) {
-                query.exec("rollback transaction");
-                return false;
-            }
-        }
-        query = QSqlQuery(mDatabase);
-        if (!query.exec("commit transaction")) {
-            return false;
-        }
+        query.prepare("select path, size from remoteFiles where volume=:volume and dir=:dir");
+        query.bindValue(":dir", dir);
     }
-    query = QSqlQuery(mDatabase);
-    if (!query.exec("begin transaction"))
-        return false;
-    query = QSqlQuery(mDatabase);
-    query.prepare("insert into remoteFiles (volume, path, etag) values (:volume, :path, :etag)");
     query.bindValue(":volume", volume);
-    query.bindValue(":path", dir);
-    query.bindValue(":etag", etag);
     if (!query.exec()) {
-        query.exec("rollback transaction");
+        logError(query.lastError().text());
         return false;
     }
+    while (query.next()) {
+        existing.insert(query.value(0).toString(), query.value(1).toLongLong());
+    }
+    existing.remove(dir);
 
+    QStringList insertedPaths;
+    bool dirRemoved = false;
+    query = QSqlQuery(database);
+    if (!query.exec("begin transaction"))
+        return false;
+
+    QSqlQuery insertQuery(database);
+    insertQuery.prepare("insert into remoteFiles (volume, path, dir, size) values (:volume, :path, :dir, :size)");
+    insertQuery.bindValue(":volume", volume);
     foreach (auto entry, files) {
-        if (entry->path().endsWith('/') && skippedDirs.contains(entry->path()))
-            continue;
-        query = QSqlQuery(mDatabase);
-        query.prepare("insert into remoteFiles (volume, path, size) values (:volume, :path, :size)");
-        query.bindValue(":volume", volume);
-        query.bindValue(":path", entry->path());
-        query.bindValue(":size", entry->size());
-        if (!query.exec()) {
-            query.exec("rollback transaction");
-            return false;
+        auto it = existing.find(entry->path());
+        if (it != existing.end()) {
+            // directories keep their own etag and contents
+            bool unchanged = entry->path().endsWith('/') || it.value() == entry->size();
+            existing.erase(it);
+            if (unchanged)
+                continue;
+        }
+        insertQuery.bindValue(":path", entry->path());
+        insertQuery.bindValue(":dir", parentDir(entry->path()));
+        insertQuery.bindValue(":size", entry->size());
+        if (!insertQuery.exec()) {
+            logError(insertQuery.lastError().text());
+            goto rollback;
         }
+        insertedPaths.append(entry->path());
     }
 
-    query = QSqlQuery(mDatabase);
+    {
+        QSqlQuery deleteQuery(database);
+        deleteQuery.prepare("delete from remoteFiles where volume=:volume and path=:path");
+        deleteQuery.bindValue(":volume", volume);
+        QSqlQuery deleteDirQuery(database);
+        // everything below a removed directory, as a range over the primary key
+        deleteDirQuery.prepare("delete from remoteFiles where volume=:volume and path>=:from and path<:to");
+        deleteDirQuery.bindValue(":volume", volume);
+        foreach (auto path, existing.keys()) {
+            if (path.endsWith('/') && !encryptedVolume) {
+                QString to = path;
+                to[to.length()-1] = QChar('/'+1);
+                deleteDirQuery.bindValue(":from", path);
+                deleteDirQuery.bindValue(":to", to);
+                if (!deleteDirQuery.exec()) {
+                    logError(deleteDirQuery.lastError().text());
+                    goto rollback;
+                }
+                dirRemoved = true;
+            }
+            else {
+                deleteQuery.bindValue(":path", path);
+                if (!deleteQuery.exec()) {
+                    logError(deleteQuery.lastError().text());
+                    goto rollback;
+                }
+            }
+        }
+    }
+
+    query = QSqlQuery(database);
+    query.prepare("insert into remoteFiles (volume, path, dir, etag) values (:volume, :path, :dir, :etag)");
+    query.bindValue(":volume", volume);
+    query.bindValue(":path", dir);
+    query.bindValue(":dir", parentDir(dir));
+    query.bindValue(":etag", etag);
+    if (!query.exec())
+        goto rollback;
+
+    query = QSqlQuery(database);
     if (!query.exec("commit transaction"))
         return false;
+    {
+        // the caches follow the committed rows
+        QMutexLocker locker(&mCacheMutex);
+        if (encryptedVolume)
+            mDirSummaries.remove(volume);
+        else
+            _invalidateSummaries(volume, dir);
+        {
+            auto index = mSearchIndexes.find(volume);
+            if (index != mSearchIndexes.end()) {
+                // a removed directory takes its whole subtree along, the index is reloaded on the next search
+                if (dirRemoved)
+                    mSearchIndexes.erase(index);
+                else {
+                    foreach (auto path, existing.keys()) {
+                        index->remove(path);
+                    }
+                    foreach (auto path, insertedPaths) {
+                        index->insert(path);
+                    }
+                    index->insert(dir);
+                }
+            }
+        }
+        if (encryptedVolume) {
+            QList<QPair<QString, qint64>> fileList;
+            fileList.reserve(files.count());
+            foreach (auto entry, files) {
+                fileList.append({entry->path(), entry->size()});
+            }
+            _buildVolumeTree(volume, etag, fileList);
+        }
+    }
     return true;
+
+    rollback:
+    query = QSqlQuery(database);
+    query.exec("rollback transaction");
+    return false;
 }
 
-QString ScoutDatabase::getEtag(const QString &volume, const QString &dir) const
+QString ScoutDatabase::_getEtag(const QString &volume, const QString &dir)
 {
-    QSqlQuery query(mDatabase);
+    if (dir == "/") {
+        QMutexLocker locker(&mCacheMutex);
+        auto tree = mVolumeTrees.constFind(volume);
+        if (tree != mVolumeTrees.constEnd())
+            return tree->etag;
+    }
+    QSqlQuery query(_connection());
     query.prepare("select etag from remoteFiles where volume=:volume and path=:path");
     query.bindValue(":volume", volume);
     query.bindValue(":path", dir);
@@ -147,89 +301,214 @@ QString ScoutDatabase::getEtag(const QString &volume, const QString &dir) const
     return query.value(0).toString();
 }
 
-bool ScoutDatabase::getFiles(const QString &volume, bool encryptedVolume, const QString &dir, QList<SxFileEntry *> &files)
+bool ScoutDatabase::_getFiles(const QString &volume, bool encryptedVolume, const QString &dir, QList<SxFileEntry *> &files)
 {
-    QSet<QString> dirSet;
-    if (!_getOnlyDirs(volume, dir, dirSet, encryptedVolume))
-        return false;
-    QList<SxFileEntry *> fileList;
-    if (!_getOnlyFiles(volume, dir, fileList))
+    if (encryptedVolume) {
+        TreeNode node;
+        {
+            QMutexLocker locker(&mCacheMutex);
+            if (!mVolumeTrees.contains(volume) && !_loadVolumeTree(volume))
+                return false;
+            node = mVolumeTrees.value(volume).nodes.value(dir);
+        }
+        foreach (auto entry, files) {
+            delete entry;
+        }
+        files.clear();
+        foreach (auto dir, node.dirs) {
+            files.append(new SxFileEntry(dir, 0));
+        }
+        foreach (auto file, node.files) {
+            files.append(new SxFileEntry(file.first, file.second));
+        }
+        return true;
+    }
+    QSqlQuery query(_connection());
+    query.prepare("select path, size from remoteFiles where volume=:volume and dir=:dir order by path");
+    query.bindValue(":volume", volume);
+    query.bindValue(":dir", dir);
+    if (!query.exec()) {
+        logError(query.lastError().text());
         return false;
+    }
     foreach (auto entry, files) {
         delete entry;
     }
     files.clear();
-    QStringList dirList = dirSet.toList();
-    qSort(dirList);
-    foreach (auto dir, dirList) {
-        files.append(new SxFileEntry(dir, 0));
-    }
-    foreach (auto entry, fileList) {
-        files.append(entry);
+    // directories first, like the cluster listing
+    QList<SxFileEntry *> fileList;
+    while (query.next()) {
+        QString path = query.value(0).toString();
+        if (path.endsWith("/"))
+            files.append(new SxFileEntry(path, 0));
+        else if (!path.endsWith("/.sxnewdir"))
+            fileList.append(new SxFileEntry(path, query.value(1).toLongLong()));
     }
+    files.append(fileList);
     return true;
 }
 
-bool ScoutDatabase::_getOnlyFiles(const QString &volume, const QString &dir, QList<SxFileEntry *> &files)
+QStringList ScoutDatabase::findFiles(const QString &volume, const QString &text, int limit)
 {
-    QSqlQuery query(mDatabase);
-    query.prepare("select path, size from remoteFiles where volume=:volume and path like :path1 and path not like :path2 order by path");
+    _waitForWrites();
+    QMutexLocker locker(&mCacheMutex);
+    if (!mSearchIndexes.contains(volume) && !_loadSearchIndex(volume))
+        return QStringList();
+    return mSearchIndexes.constFind(volume)->find(text, limit);
+}
+
+bool ScoutDatabase::getDirectorySummary(const QString &volume, bool encryptedVolume, const QString &dir, int &count, qint64 &size)
+{
+    _waitForWrites();
+    {
+        QMutexLocker locker(&mCacheMutex);
+        auto summaries = mDirSummaries.constFind(volume);
+        if (summaries != mDirSummaries.constEnd()) {
+            auto summary = summaries->constFind(dir);
+            if (summary != summaries->constEnd()) {
+                count = summary->count;
+                size = summary->size;
+                return true;
+            }
+        }
+    }
+    // a recursive listing of the whole volume is stored only for encrypted volumes
+    if (_getEtag(volume, encryptedVolume ? "/" : dir).isEmpty())
+        return false;
+
+    QSqlQuery query(_connection());
+    query.setForwardOnly(true);
+    query.prepare("select path, size, etag from remoteFiles where volume=:volume and path>:from and path<:to");
+    QString to = dir;
+    to[to.length()-1] = QChar('/'+1);
     query.bindValue(":volume", volume);
-    query.bindValue(":path1", dir+"%");
-    query.bindValue(":path2", dir+"%/%");
+    query.bindValue(":from", dir);
+    query.bindValue(":to", to);
     if (!query.exec()) {
+        logError(query.lastError().text());
         return false;
     }
-    foreach (auto entry, files) {
-        delete entry;
-    }
-    files.clear();
+    DirSummary summary = {0, 0};
     while (query.next()) {
         QString path = query.value(0).toString();
-        if (path==dir || path.endsWith("/.sxnewdir"))
+        if (path.endsWith('/')) {
+            // subdirectory never opened, its contents are unknown
+            if (!encryptedVolume && query.isNull(2))
+                return false;
             continue;
-        qint64 size = query.value(1).toLongLong();
-        files.append(new SxFileEntry(path, size));
+        }
+        if (path.endsWith("/.sxnewdir"))
+            continue;
+        ++summary.count;
+        summary.size += query.value(1).toLongLong();
+    }
+    {
+        QMutexLocker locker(&mCacheMutex);
+        mDirSummaries[volume].insert(dir, summary);
     }
+    count = summary.count;
+    size = summary.size;
     return true;
 }
 
-bool ScoutDatabase::_getOnlyDirs(const QString &volume, const QString &dir, QSet<QString> &dirs, bool generateDirsFromFiles)
+/* called with the cache mutex held */
+void ScoutDatabase::_invalidateSummaries(const QString &volume, const QString &dir)
 {
-    QSqlQuery query(mDatabase);
-    if (generateDirsFromFiles) {
-        query.prepare("select path from remoteFiles where volume=:volume and path like :path order by path");
-        query.bindValue(":path", dir+"%/%");
+    auto summaries = mDirSummaries.find(volume);
+    if (summaries == mDirSummaries.end())
+        return;
+    for (QString path = dir; !path.isEmpty(); path = parentDir(path)) {
+        summaries->remove(path);
     }
-    else {
-        query.prepare("select path from remoteFiles where volume=:volume and path like :path and path not like :path2 order by path");
-        query.bindValue(":path", dir+"%/");
-        query.bindValue(":path2", dir+"%/%/");
+    // summaries of removed subdirectories are not reachable anymore
+    QString to = dir;
+    to[to.length()-1] = QChar('/'+1);
+    for (auto it = summaries->begin(); it != summaries->end(); ) {
+        if (it.key() > dir && it.key() < to)
+            it = summaries->erase(it);
+        else
+            ++it;
     }
+}
+
+/* called with the cache mutex held */
+bool ScoutDatabase::_loadSearchIndex(const QString &volume)
+{
+    QSqlQuery query(_connection());
+    query.setForwardOnly(true);
+    query.prepare("select path from remoteFiles where volume=:volume");
     query.bindValue(":volume", volume);
-    if (!query.exec())
+    if (!query.exec()) {
+        logError(query.lastError().text());
         return false;
-    dirs.clear();
+    }
+    ScoutSearchIndex &index = mSearchIndexes[volume];
+    index.clear();
+    while (query.next()) {
+        index.insert(query.value(0).toString());
+    }
+    return true;
+}
 
-    if (generateDirsFromFiles) {
-        while (query.next()) {
-            QString full_path = query.value(0).toString();
-            int index = full_path.indexOf('/', dir.length());
-            if (index < 0)
-                continue;
-            QString path = full_path.mid(0, index+1);
-            dirs.insert(path);
-        }
+/* called with the cache mutex held */
+bool ScoutDatabase::_loadVolumeTree(const QString &volume)
+{
+    QSqlQuery query(_connection());
+    query.prepare("select path, size, etag from remoteFiles where volume=:volume");
+    query.bindValue(":volume", volume);
+    if (!query.exec()) {
+        logError(query.lastError().text());
+        return false;
     }
-    else {
-        while (query.next()) {
-            QString path = query.value(0).toString();
-            dirs.insert(path);
+    QString etag;
+    QList<QPair<QString, qint64>> files;
+    while (query.next()) {
+        QString path = query.value(0).toString();
+        if (path == "/") {
+            if (!query.isNull(2))
+                etag = query.value(2).toString();
+            continue;
         }
+        files.append({path, query.value(1).toLongLong()});
     }
+    _buildVolumeTree(volume, etag, files);
     return true;
 }
 
+void ScoutDatabase::_buildVolumeTree(const QString &volume, const QString &etag, const QList<QPair<QString, qint64>> &files)
+{
+    VolumeTree &tree = mVolumeTrees[volume];
+    tree.etag = etag;
+    tree.nodes.clear();
+    tree.nodes.insert("/", TreeNode());
+    auto addDir = [&tree](QString dir) {
+        while (!tree.nodes.contains(dir)) {
+            tree.nodes.insert(dir, TreeNode());
+            QString parent = dir.mid(0, dir.lastIndexOf('/', dir.length()-2)+1);
+            tree.nodes[parent].dirs.append(dir);
+            dir = parent;
+        }
+    };
+    foreach (auto file, files) {
+        const QString &path = file.first;
+        if (!path.startsWith("/"))
+            continue;
+        if (path.endsWith("/")) {
+            addDir(path);
+            continue;
+        }
+        QString parent = path.mid(0, path.lastIndexOf('/')+1);
+        addDir(parent);
+        if (!path.endsWith("/.sxnewdir"))
+            tree.nodes[parent].files.append(file);
+    }
+    for (auto it = tree.nodes.begin(); it != tree.nodes.end(); ++it) {
+        qSort(it->dirs);
+        std::sort(it->files.begin(), it->files.end(), [](const QPair<QString, qint64> &a, const QPair<QString, qint64> &b) {
+            return a.first < b.first;
+        });
+    }
+}
 
 void ScoutDatabase::initializeDatabase()
 {
@@ -237,23 +516,36 @@ void ScoutDatabase::initializeDatabase()
     if (!cacheDir.mkpath(".")) {
         throw std::runtime_error("Unable to create cache directory");
     }
-    static QString dbFile = cacheDir.absoluteFilePath("sxsync.db");
-    QString connectionName = "sxRemoteFilesBrowser";
-    mDatabase = QSqlDatabase::addDatabase("QSQLITE", connectionName);
-    mDatabase.setDatabaseName(dbFile);
-    if (!mDatabase.open()) {
+    mDbFile = cacheDir.absoluteFilePath("sxsync.db");
+    QSqlDatabase database = _connection();
+    if (!database.isOpen()) {
         throw std::runtime_error("Cannot open the database");
     }
 
-    QSqlQuery query(mDatabase);
+    // the journal mode is stored in the file, the connections opened later use it too
+    QSqlQuery query(database);
     query.exec("PRAGMA journal_mode=WAL");
-    query.exec("PRAGMA synchronous=NORMAL");
     query.exec("PRAGMA foreign_keys = ON");
 
-    //query.exec("drop table remoteFiles");
+    // the table is only a cache, a layout without the dir column is dropped and listed again
+    bool hasDirColumn = true;
+    if (query.exec("pragma table_info(remoteFiles)")) {
+        bool tableExists = false;
+        hasDirColumn = false;
+        while (query.next()) {
+            tableExists = true;
+            if (query.value(1).toString() == "dir")
+                hasDirColumn = true;
+        }
+        if (!tableExists)
+            hasDirColumn = true;
+    }
+    if (!hasDirColumn)
+        query.exec("drop table remoteFiles");
     QString createTableQuery =  "create table if not exists remoteFiles ("
                                 "volume text not null, "
                                 "path text not null, "
+                                "dir text not null default '', "
                                 "size number not null default 0, "
                                 "etag text default null,"
                                 "primary key (volume, path) on conflict replace)";
@@ -262,4 +554,8 @@ void ScoutDatabase::initializeDatabase()
         logError(query.lastError().text());
         throw std::runtime_error("Create table failed");
     }
+    if (!query.exec("create index if not exists remoteFilesDir on remoteFiles (volume, dir)")) {
+        logError(query.lastError().text());
+        throw std::runtime_error("Create index failed");
+    }
 }
@@ -32,25 +32,87 @@
 #include <QObject>
 #include <QList>
 #include <QSqlDatabase>
+#include <QHash>
+#include <QMutex>
+#include <QFuture>
+#include <QThreadPool>
 #include "sxfileentry.h"
+#include "scoutsearchindex.h"
 
+/* Cache of remote listings. Listings are written by a single writer thread, reads
+ * use a WAL connection of the calling thread and see every write queued before them.
+ * The async calls run on background threads so the GUI never waits for the disk */
 class ScoutDatabase
 {
 public:
     static ScoutDatabase* instance();
-    bool setFiles(const QString &volume, bool encryptedVolume, const QString &dir, const QString &etag, const QList<SxFileEntry*> &files);
-    QString getEtag(const QString &volume, const QString &dir) const;
+    ScoutDatabase(const ScoutDatabase &) = delete;
+    ScoutDatabase &operator= (const ScoutDatabase &) = delete;
+
+    struct Listing {
+        bool ok = false;
+        QString etag;
+        // owned by whoever takes the result
+        QList<SxFileEntry*> files;
+    };
+    /* etag of dir and the entries of path, dir is "/" for the recursive listing of an encrypted volume */
+    QFuture<Listing> readListing(const QString &volume, bool encryptedVolume, const QString &dir, const QString &path);
+    /* stores the listing of dir and deletes the entries, the result holds what is then cached for path,
+     * nothing is read back when path is empty */
+    QFuture<Listing> storeListing(const QString &volume, bool encryptedVolume, const QString &dir, const QString &etag,
+                                  const QList<SxFileEntry*> &files, const QString &path = QString());
+    QFuture<QStringList> readEtags(const QStringList &volumes, const QStringList &dirs);
+
+    QString getEtag(const QString &volume, const QString &dir);
     bool getFiles(const QString &volume, bool encryptedVolume, const QString &dir, QList<SxFileEntry*> &files);
+    // paths of cached entries whose name contains text, case insensitive
+    QStringList findFiles(const QString &volume, const QString &text, int limit);
+    /* number and total size of the files below dir, false unless every
+     * directory of the subtree has been listed */
+    bool getDirectorySummary(const QString &volume, bool encryptedVolume, const QString &dir, int &count, qint64 &size);
 
 private:
     ScoutDatabase();
-    bool _getOnlyFiles(const QString &volume, const QString &dir, QList<SxFileEntry*> &files);
-    bool _getOnlyDirs(const QString &volume, const QString &dir, QSet<QString> &dirs, bool generateDirsFromFiles);
+    QSqlDatabase _connection();
+    void _waitForWrites();
+    bool _setFiles(const QString &volume, bool encryptedVolume, const QString &dir, const QString &etag, const QList<SxFileEntry*> &files);
+    QString _getEtag(const QString &volume, const QString &dir);
+    bool _getFiles(const QString &volume, bool encryptedVolume, const QString &dir, QList<SxFileEntry*> &files);
+    bool _loadVolumeTree(const QString &volume);
+    void _buildVolumeTree(const QString &volume, const QString &etag, const QList<QPair<QString, qint64>> &files);
+    bool _loadSearchIndex(const QString &volume);
+    void _invalidateSummaries(const QString &volume, const QString &dir);
 
     void initializeDatabase();
 
 private:
-    QSqlDatabase mDatabase;
+    struct TreeNode {
+        QStringList dirs;
+        QList<QPair<QString, qint64>> files;
+    };
+    struct VolumeTree {
+        QString etag;
+        QHash<QString, TreeNode> nodes;
+    };
+    QString mDbFile;
+    QThreadPool mWriterPool;
+    QThreadPool mReaderPool;
+    // the last write queued, reads wait for it so they never see an older listing
+    QMutex mWriteMutex;
+    QFuture<void> mLastWrite;
+    // guards the in-memory caches below, they are used from every thread
+    QMutex mCacheMutex;
+    // recursive listings of unlocked volumes indexed by directory
+    QHash<QString, VolumeTree> mVolumeTrees;
+    // built on the first search in a volume, then kept in step with setFiles
+    QHash<QString, ScoutSearchIndex> mSearchIndexes;
+    struct DirSummary {
+        int count;
+        qint64 size;
+    };
+    // per volume and directory, dropped along the parent chain of every stored listing
+    QHash<QString, QHash<QString, DirSummary>> mDirSummaries;
+    static const int sReaderThreads = 2;
 };
 
 #endif // REMOTEFILESDATABASE_H
@@ -34,11 +34,14 @@
 #include <QDateTime>
 #include <Shlobj.h>
 #include "winstorage.h"
+#include "winstream.h"
+#include "sxcluster.h"
 #pragma comment(lib, "Ole32.lib")
 #endif
 
 ScoutMimeData::ScoutMimeData()
 {
+    mStreamCluster = nullptr;
     qsrand(QDateTime::currentDateTime().toTime_t());
 }
 
@@ -60,9 +63,51 @@ void ScoutMimeData::requestDownloadTo(const QString &localDir)
     emit requestDownload(volume, rootDirectory, files, localDir);
 }
 
+void ScoutMimeData::setStreamSource(SxCluster *cluster, const QList<QPair<QString, qint64> > &files)
+{
+    mStreamCluster = cluster;
+    mStreamFiles = files;
+}
+
+bool ScoutMimeData::isStreamable() const
+{
+    return mStreamCluster != nullptr && !mStreamFiles.isEmpty();
+}
+
+#ifdef Q_OS_WIN
+IStream *ScoutMimeData::createStream(int index)
+{
+    if (!isStreamable() || index < 0 || index >= mStreamFiles.count())
+        return nullptr;
+    SxVolume *volume = mStreamCluster->getSxVolume(QString::fromUtf8(data("sxscout/volume")));
+    if (volume == nullptr)
+        return nullptr;
+    auto file = mStreamFiles.at(index);
+    return new WinStream(mStreamCluster, volume, file.first, file.second);
+}
+#endif
+
 QVariant ScoutMimeData::retrieveData(const QString &mimetype, QVariant::Type preferredType) const
 {
     #if defined Q_OS_WIN
+    if(mimetype == "FileGroupDescriptorW" && isStreamable())
+    {
+        int count = mStreamFiles.count();
+        unsigned int size = sizeof(FILEGROUPDESCRIPTOR) + static_cast<unsigned int>(count-1)*sizeof(FILEDESCRIPTOR);
+        QByteArray buffer(static_cast<int>(size), 0);
+        FILEGROUPDESCRIPTOR *desc = reinterpret_cast<FILEGROUPDESCRIPTOR *>(buffer.data());
+        desc->cItems = static_cast<UINT>(count);
+        for (int i=0; i<count; i++) {
+            const QString &path = mStreamFiles.at(i).first;
+            quint64 fileSize = static_cast<quint64>(mStreamFiles.at(i).second);
+            QString filename = path.mid(path.lastIndexOf('/')+1);
+            desc->fgd[i].dwFlags = FD_FILESIZE | FD_PROGRESSUI;
+            desc->fgd[i].nFileSizeHigh = static_cast<DWORD>(fileSize >> 32);
+            desc->fgd[i].nFileSizeLow = static_cast<DWORD>(fileSize & 0xffffffff);
+            wcsncpy_s(desc->fgd[i].cFileName, MAX_PATH, filename.toStdWString().c_str(), _TRUNCATE);
+        }
+        return buffer;
+    }
     if(mimetype == "FileGroupDescriptorW")
     {
         unsigned int size = sizeof(FILEGROUPDESCRIPTOR);
@@ -153,11 +198,21 @@ bool WinMime::convertFromMime(const FORMATETC &formatetc, const QMimeData *mimeD
 {
     if (formatetc.cfFormat != mFileContentId)
         return false;
-    pmedium->tymed = TYMED_ISTORAGE;
-    pmedium->pUnkForRelease = 0;
-
     auto cScoutMimeData = qobject_cast<const ScoutMimeData*>(mimeData);
     auto scoutMimeData = const_cast<ScoutMimeData*>(cScoutMimeData);
+    if (scoutMimeData->isStreamable()) {
+        // Explorer asks for every file listed in FileGroupDescriptorW by its index
+        IStream *stream = scoutMimeData->createStream(formatetc.lindex);
+        if (stream == nullptr)
+            return false;
+        pmedium->tymed = TYMED_ISTREAM;
+        pmedium->pUnkForRelease = 0;
+        pmedium->pstm = stream;
+        return true;
+    }
+
+    pmedium->tymed = TYMED_ISTORAGE;
+    pmedium->pUnkForRelease = 0;
     pmedium->pstg = new WinStorage(scoutMimeData);
 
     /*
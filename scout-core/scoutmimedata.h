@@ -30,6 +30,9 @@
 #define REMOTEFILESMIMEDATA_H
 
 #include <QMimeData>
+#include <QPair>
+
+class SxCluster;
 
 #ifdef Q_OS_WIN
 #include <QWinMime>
@@ -56,6 +59,13 @@ class ScoutMimeData : public QMimeData
 public:
     ScoutMimeData();
     void requestDownloadTo(const QString& localDir);
+    /* remote files (path, size) which can be handed out one by one as streams
+     * instead of being downloaded before the drop completes */
+    void setStreamSource(SxCluster *cluster, const QList<QPair<QString, qint64>> &files);
+    bool isStreamable() const;
+#ifdef Q_OS_WIN
+    IStream *createStream(int index);
+#endif
 
 signals:
     void requestDownload(const QString &volume, const QString &remoteDir, const QStringList &files, const QString &localDir);
@@ -70,6 +80,8 @@ private:
 #if defined Q_OS_WIN
     WinMime mWinMime;
 #endif
+    SxCluster *mStreamCluster;
+    QList<QPair<QString, qint64>> mStreamFiles;
 };
 
 #endif // REMOTEFILESMIMEDATA_H
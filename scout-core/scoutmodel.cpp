@@ -27,13 +27,18 @@
  */
 
 #include "scoutmodel.h"
+#include "sxclusterpool.h"
 #include "sxlog.h"
+#include "sxrevisioncache.h"
 #include <QDir>
 #include <QFileInfo>
 #include <QSslCertificate>
 #include <sxfilter.h>
 #include <memory>
 #include <QStandardPaths>
+#include <QTimer>
+#include <QDateTime>
+#include <QFutureWatcher>
 
 QStringList listDir(const QString &path) {
     QStringList result;
@@ -79,7 +84,7 @@ ScoutModel::ScoutModel(ClusterConfig* config, ScoutQueue *queue,  QObject *paren
     mFilesCount = 0;
     mFilesColumnCount = 1;
 
-    mCluster = SxCluster::initializeCluster(mClusterConfig->sxAuth(), mClusterConfig->uuid(), mCheckCertCallback, mLastError);
+    mCluster = SxCluster::initializeCluster(mClusterConfig->sxAuth(), mClusterConfig->uuid(), mCheckCertCallback, mLastError, true);
     if (mCluster == nullptr)
         logWarning("ScoutModel: Unable to initialize cluster: "+mLastError);
     else
@@ -89,11 +94,17 @@ ScoutModel::ScoutModel(ClusterConfig* config, ScoutQueue *queue,  QObject *paren
     connect(&mRefreshTimer, &QTimer::timeout, this, &ScoutModel::reloadVolumes);
     mRefreshTimer.setInterval(10000);
     //mRefreshTimer.start();
+    mListingWorker = nullptr;
+    mListingRequest = 0;
+    mViewBlocked = false;
+    startListingWorker();
 }
 
 ScoutModel::~ScoutModel()
 {
+    stopListingWorker();
     delete mCluster;
+    SxClusterPool::instance().clear();
     foreach (auto entry, mFileList) {
         delete entry;
     }
@@ -104,6 +115,16 @@ SxCluster *ScoutModel::cluster() const
     return mCluster;
 }
 
+ClusterConfig *ScoutModel::clusterConfig() const
+{
+    return mClusterConfig;
+}
+
+std::function<bool (QSslCertificate &, bool)> ScoutModel::checkCertCallback() const
+{
+    return mCheckCertCallback;
+}
+
 QModelIndex ScoutModel::index(int row, int column, const QModelIndex &parent) const
 {
     /*
@@ -227,24 +248,16 @@ QVariant ScoutModel::data(const QModelIndex &index, int role) const
                 return mFileList.at(itemIndex)->path();
             }
             if (role == NameRole) {
-                QString name = mFileList.at(itemIndex)->path().mid(mCurrentPath.length());
-                if (name.endsWith("/"))
-                    return name.mid(0, name.length()-1);
-                return name;
+                return fileRoles(itemIndex).name;
             }
             if (role == SizeRole) {
                 return mFileList.at(itemIndex)->size();
             }
+            if (role == RevisionRole) {
+                return mFileList.at(itemIndex)->revision();
+            }
             else if (role == MimeTypeRole) {
-                if (mFileList.at(itemIndex)->path().endsWith("/"))
-                    return "Directory";
-                else {
-                    int index = mFileList.at(itemIndex)->path().lastIndexOf('.');
-                    if (index <= 0)
-                        return "File";
-                    QString ext = mFileList.at(itemIndex)->path().mid(index+1);
-                    return getMimeType(ext);
-                }
+                return fileRoles(itemIndex).mimeType;
             }
         }
     }
@@ -285,6 +298,31 @@ QVariant ScoutModel::data(const QModelIndex &index, int role) const
     return QVariant();
 }
 
+const ScoutModel::FileRoles &ScoutModel::fileRoles(int itemIndex) const
+{
+    // the delegate asks for every visible cell on each repaint, derived roles are computed once per entry
+    if (mFileRoles.count() != mFileList.count())
+        mFileRoles.resize(mFileList.count());
+    FileRoles &roles = mFileRoles[itemIndex];
+    if (!roles.valid) {
+        const QString &path = mFileList.at(itemIndex)->path();
+        roles.name = path.mid(mCurrentPath.length());
+        if (roles.name.endsWith("/")) {
+            roles.name.chop(1);
+            roles.mimeType = "Directory";
+        }
+        else {
+            int index = path.lastIndexOf('.');
+            if (index <= 0)
+                roles.mimeType = "File";
+            else
+                roles.mimeType = getMimeType(path.mid(index+1));
+        }
+        roles.valid = true;
+    }
+    return roles;
+}
+
 QString ScoutModel::currentVolume() const
 {
     return mCurrentVolume;
@@ -315,31 +353,39 @@ void ScoutModel::removeFiles(const QString &volume, const QStringList &paths)
     if (sxVolume == nullptr)
         return;
     QStringList toRemove;
+    QStringList dirsToRemove;
     foreach (QString path, paths) {
-        if (!path.endsWith("/")) {
+        if (!path.endsWith("/"))
             toRemove.append(path);
-        }
-        else {
-            QList<SxFileEntry*> list;
-            QString etag;
-            if (!mCluster->_listFiles(sxVolume, path, true, list, etag)) {
+        else
+            dirsToRemove.append(path);
+    }
+    int removed = 0;
+    int toRemoveCount = toRemove.count()+dirsToRemove.count();
+    auto notify = [this, &volume, &toRemove, &removed, &toRemoveCount](const QString &path) {
+        SxRevisionCache::instance().invalidate(volume, path);
+        ++removed;
+        if (!toRemove.isEmpty())
+            emit signalProgress(toRemove.first(), removed, toRemoveCount);
+    };
+
+    foreach (QString dir, dirsToRemove) {
+        emit signalProgress(dir, removed, toRemoveCount);
+        // a directory counts as a single step, whether the server removes it at once or file by file
+        auto notifyDir = [this, &removed, &toRemoveCount](const QString &path) {
+            emit signalProgress(path, removed, toRemoveCount);
+        };
+        if (!mCluster->deleteDirectory(sxVolume, dir, notifyDir)) {
+            if (mCluster->lastError().errorCode() == SxErrorCode::NotFound) {
+                qDebug() << "directory not found";
                 continue;
             }
-            foreach (auto entry, list) {
-                toRemove.append(entry->path());
-                delete entry;
-            }
+            emit sigError(mCluster->lastError().errorMessage());
+            return;
         }
+        ++removed;
     }
-    int removed = 0;
-    int toRemoveCount = toRemove.count();
-
     while (!toRemove.isEmpty()) {
-        auto notify = [this, &toRemove, &removed, &toRemoveCount](const QString&) {
-            ++removed;
-            if (!toRemove.isEmpty())
-                emit signalProgress(toRemove.first(), removed, toRemoveCount);
-        };
         emit signalProgress(toRemove.first(), removed, toRemoveCount);
         if (!mCluster->deleteFiles(sxVolume, toRemove, notify)) {
             if (mCluster->lastError().errorCode() == SxErrorCode::NotFound) {
@@ -560,6 +606,9 @@ void ScoutModel::reloadClusterConfig(ScoutQueue *queue)
         }
     }
     reloadMeta();
+    // the worker keeps its own connection, it is started again with the new credentials
+    stopListingWorker();
+    startListingWorker();
     mQueue = queue;
     connect(mQueue, &ScoutQueue::fileUploaded, this, &ScoutModel::queueFileUploaded, Qt::QueuedConnection);
     mPrevStack.clear();
@@ -576,6 +625,12 @@ void ScoutModel::setCurrentPath(const QString &volume, const QString &path, bool
         return;
     sWorking = true;
     int count = 0;
+    bool listing = false;
+    bool refreshed = false;
+    // a listing still running for the previous location is dropped when it arrives
+    ++mListingRequest;
+    if (mListingWorker != nullptr)
+        mListingWorker->setLatestRequest(mListingRequest);
 
     if (mCluster == nullptr) {
         mCluster = SxCluster::initializeCluster(mClusterConfig->sxAuth(), mClusterConfig->uuid(), mCheckCertCallback, mLastError);
@@ -584,9 +639,9 @@ void ScoutModel::setCurrentPath(const QString &volume, const QString &path, bool
         emit clusterInitialized();
     }
 
-    if (blockView)
-        emit setViewEnabled(false);
     if (volume.isEmpty()) {
+        if (blockView)
+            emit setViewEnabled(false);
         reloadVolumes();
         count = mVolumes.count();
     }
@@ -595,31 +650,46 @@ void ScoutModel::setCurrentPath(const QString &volume, const QString &path, bool
         if (sxVolume == nullptr)
             goto label0;
 
-        if (mUnlockedVolumes.contains(volume)) {
-            QString etag = mDatabase->getEtag(volume, "/");
-            if (mCluster->_listFiles(sxVolume, "/", true, mFileList, etag)) {
-                mDatabase->setFiles(volume, true, "/", etag, mFileList);
-            }
-            else if (mCluster->lastError().errorCode() != SxErrorCode::NotChanged)
-                goto label0;
-            mDatabase->getFiles(volume, true, path, mFileList);
+        // the cached listing is read off the GUI thread and shown when it arrives, then revalidated in the background
+        bool recursive = mUnlockedVolumes.contains(volume);
+        QString dir = recursive ? "/" : path;
+        if (volume == mCurrentVolume && path == mCurrentPath) {
+            // refreshing the same directory, only cells that changed are updated
+            refreshed = true;
         }
         else {
-            QString etag = mDatabase->getEtag(volume, path);
-            if (!mCluster->_listFiles(sxVolume, path, false, mFileList, etag)) {
-                if (mCluster->lastError().errorCode() != SxErrorCode::NotChanged)
-                    goto label0;
-                mDatabase->getFiles(volume, false, path, mFileList);
-            }
-            else {
-                mDatabase->setFiles(volume, false, path, etag, mFileList);
-            }
+            qDeleteAll(mFileList);
+            mFileList.clear();
+            mFileRoles.clear();
         }
         count = mFileList.count();
+        listing = true;
+        int request = mListingRequest;
+        auto watcher = new QFutureWatcher<ScoutDatabase::Listing>(this);
+        connect(watcher, &QFutureWatcher<ScoutDatabase::Listing>::finished, this, [this, watcher, request, volume, dir, recursive, blockView]() {
+            ScoutDatabase::Listing cached = watcher->result();
+            watcher->deleteLater();
+            if (request != mListingRequest || mReloading) {
+                qDeleteAll(cached.files);
+                return;
+            }
+            if (cached.ok)
+                applyFileList(cached.files);
+            qDeleteAll(cached.files);
+            if (blockView || mViewBlocked) {
+                // without a cached listing there is nothing to browse until the first one arrives
+                mViewBlocked = blockView && cached.etag.isEmpty();
+                emit setViewEnabled(!mViewBlocked);
+            }
+            emit requestListing(request, volume, dir, recursive, cached.etag);
+        });
+        watcher->setFuture(mDatabase->readListing(volume, recursive, dir, path));
     }
 
     label0:
-    if (mCluster != nullptr) {
+    if (listing)
+        mLastError.clear();
+    else if (mCluster != nullptr) {
         auto errorCode = mCluster->lastError().errorCode();
         if (errorCode == SxErrorCode::NoError || errorCode == SxErrorCode::NotChanged)
             mLastError.clear();
@@ -636,14 +706,163 @@ void ScoutModel::setCurrentPath(const QString &volume, const QString &path, bool
     mCurrentPath = path;
     mFilesCount = count;
 
-    if (blockView)
+    // with a listing the view is enabled once the cache has been read
+    if (!listing && (blockView || mViewBlocked)) {
+        mViewBlocked = false;
         emit setViewEnabled(true);
-    if (count > 0) {
+    }
+    if (count > 0 && !refreshed) {
         emit dataChanged(index(0,0,mFilesIndex), index(newRowCount-1, mFilesColumnCount-1, mFilesIndex), {NameRole, FullPathRole, SizeRole, SizeUsedRole, MimeTypeRole});
     }
     sWorking = false;
 }
 
+void ScoutModel::listingFinished(int request, const QString &volume, const QString &dir, bool recursive, const QString &etag,
+                                 const QList<SxFileEntry *> &files, int errorCode, const QString &errorMessage)
+{
+    if (request != mListingRequest || mReloading) {
+        qDeleteAll(files);
+        return;
+    }
+    if (mViewBlocked) {
+        mViewBlocked = false;
+        emit setViewEnabled(true);
+    }
+    if (static_cast<SxErrorCode>(errorCode) == SxErrorCode::NoError) {
+        // stored on the database writer thread, which also reads back the current directory
+        auto watcher = new QFutureWatcher<ScoutDatabase::Listing>(this);
+        connect(watcher, &QFutureWatcher<ScoutDatabase::Listing>::finished, this, [this, watcher, request]() {
+            ScoutDatabase::Listing stored = watcher->result();
+            watcher->deleteLater();
+            if (request == mListingRequest && !mReloading) {
+                if (stored.ok)
+                    applyFileList(stored.files);
+                prefetchTargets();
+            }
+            qDeleteAll(stored.files);
+        });
+        watcher->setFuture(mDatabase->storeListing(volume, recursive, dir, etag, files, mCurrentPath));
+        return;
+    }
+    if (static_cast<SxErrorCode>(errorCode) != SxErrorCode::NotChanged) {
+        mLastError = errorMessage;
+        emit sigError(mLastError);
+    }
+    qDeleteAll(files);
+    prefetchTargets();
+}
+
+void ScoutModel::prefetchTargets()
+{
+    // the directories the user is likely to open next: subdirectories in view, history and the parent
+    static const int sMaxSubdirs = 16;
+    static const int sMaxHistory = 4;
+    QList<QPair<QString, QString>> targets;
+    int subdirs = 0;
+    foreach (auto entry, mFileList) {
+        if (subdirs >= sMaxSubdirs)
+            break;
+        if (entry->path().endsWith("/")) {
+            targets.append({mCurrentVolume, entry->path()});
+            ++subdirs;
+        }
+    }
+    for (int i=0; i<sMaxHistory && i<mPrevStack.count(); i++)
+        targets.append(mPrevStack.at(mPrevStack.count()-1-i));
+    for (int i=0; i<sMaxHistory && i<mNextStack.count(); i++)
+        targets.append(mNextStack.at(mNextStack.count()-1-i));
+    if (mCurrentPath.length() > 1) {
+        int index = mCurrentPath.lastIndexOf("/", mCurrentPath.length()-2);
+        targets.append({mCurrentVolume, mCurrentPath.mid(0, index+1)});
+    }
+
+    QStringList volumes, dirs;
+    foreach (auto target, targets) {
+        // unlocked volumes are listed as a whole, their cache already covers every directory
+        if (target.first.isEmpty() || mUnlockedVolumes.contains(target.first))
+            continue;
+        if (target.first == mCurrentVolume && target.second == mCurrentPath)
+            continue;
+        volumes.append(target.first);
+        dirs.append(target.second);
+    }
+    auto watcher = new QFutureWatcher<QStringList>(this);
+    connect(watcher, &QFutureWatcher<QStringList>::finished, this, [this, watcher, volumes, dirs]() {
+        QStringList etags = watcher->result();
+        watcher->deleteLater();
+        if (!mReloading)
+            emit requestPrefetch(volumes, dirs, etags);
+    });
+    watcher->setFuture(mDatabase->readEtags(volumes, dirs));
+}
+
+void ScoutModel::prefetchFinished(const QString &volume, const QString &dir, const QString &etag, const QList<SxFileEntry *> &files)
+{
+    if (mReloading)
+        qDeleteAll(files);
+    else
+        mDatabase->storeListing(volume, false, dir, etag, files);
+}
+
+void ScoutModel::applyFileList(QList<SxFileEntry *> &fileList)
+{
+    // entries before the first difference keep their cells
+    int first = 0;
+    while (first < fileList.count() && first < mFileList.count()
+           && fileList.at(first)->path() == mFileList.at(first)->path()
+           && fileList.at(first)->size() == mFileList.at(first)->size())
+        ++first;
+    if (first == fileList.count() && first == mFileList.count())
+        return;
+    int count = fileList.count();
+    // with the same number of entries the cells after the last difference stay in place too,
+    // otherwise everything after the first difference moves
+    int last = count-1;
+    if (count == mFileList.count()) {
+        while (last > first
+               && fileList.at(last)->path() == mFileList.at(last)->path()
+               && fileList.at(last)->size() == mFileList.at(last)->size())
+            --last;
+        for (int i=first; i<=last && i<mFileRoles.count(); i++)
+            mFileRoles[i].valid = false;
+    }
+    else if (mFileRoles.count() > first) {
+        mFileRoles.resize(first);
+    }
+    mFileList.swap(fileList);
+    int newRowCount = count / mFilesColumnCount + ((count%mFilesColumnCount) ? 1 : 0 );
+    resizeModel(mFilesIndex, newRowCount, mFilesColumnCount);
+    mFilesCount = count;
+    if (count > first) {
+        emit dataChanged(index(first / mFilesColumnCount, 0, mFilesIndex), index(last / mFilesColumnCount, mFilesColumnCount-1, mFilesIndex), {NameRole, FullPathRole, SizeRole, SizeUsedRole, MimeTypeRole});
+    }
+}
+
+void ScoutModel::startListingWorker()
+{
+    static auto registerFileEntries = qRegisterMetaType<QList<SxFileEntry*>>("QList<SxFileEntry*>");
+    Q_UNUSED(registerFileEntries);
+    mListingWorker = new ScoutListingWorker(mClusterConfig->sxAuth(), mClusterConfig->uuid(), mCheckCertCallback);
+    mListingWorker->setLatestRequest(mListingRequest);
+    mListingWorker->moveToThread(&mListingThread);
+    connect(&mListingThread, &QThread::finished, mListingWorker, &QObject::deleteLater);
+    connect(this, &ScoutModel::requestListing, mListingWorker, &ScoutListingWorker::list);
+    connect(mListingWorker, &ScoutListingWorker::listed, this, &ScoutModel::listingFinished);
+    connect(this, &ScoutModel::requestPrefetch, mListingWorker, &ScoutListingWorker::prefetch);
+    connect(mListingWorker, &ScoutListingWorker::prefetched, this, &ScoutModel::prefetchFinished);
+    mListingThread.start();
+}
+
+void ScoutModel::stopListingWorker()
+{
+    if (mListingWorker == nullptr)
+        return;
+    mListingWorker->setLatestRequest(-1);
+    mListingThread.quit();
+    mListingThread.wait();
+    mListingWorker = nullptr;
+}
+
 void ScoutModel::appendTask(ScoutTask *task)
 {
     if (mQueue == nullptr)
@@ -814,18 +1033,8 @@ void ScoutModel::requestDownload(const QString &volume, const QString &remoteDir
     qint64 size = 0;
     foreach (auto file, files) {
         if (file.endsWith("/")) {
-            QList<SxFileEntry*> list;
-            if (!mCluster->_listFiles(vol, remoteDir+file, true, list, etag)) {
-                qDebug() << "ScoutModel::requestDownload failed" << __LINE__;
-                delete task;
-                return;
-            }
-            foreach (auto entry, list) {
-                task->files.append({entry->path(), entry->size()});
-                size += entry->size();
-                delete entry;
-            }
-            list.clear();
+            // listed by the queue while the task runs
+            task->pendingDirs.append(remoteDir+file);
         }
         else {
             QList<SxFileEntry*> list;
@@ -860,7 +1069,7 @@ void ScoutModel::requestDownload(const QString &volume, const QString &remoteDir
     }
     task->size = size;
 
-    if (task->files.isEmpty())
+    if (task->files.isEmpty() && task->pendingDirs.isEmpty())
         delete task;
     else
         appendTask(task);
@@ -964,8 +1173,17 @@ QPair<int, qint64> ScoutModel::countFiles(const QString &volume, const QStringLi
         return {0, 0};
     }
 
+    bool encryptedVolume = isAesVolume(volume);
     foreach (QString file, files) {
         if (file.endsWith('/')) {
+            int dirCount;
+            qint64 dirSize;
+            // subtrees already listed in full are summed from the cache without listing them again
+            if (mDatabase->getDirectorySummary(volume, encryptedVolume, file, dirCount, dirSize)) {
+                count += dirCount;
+                size += dirSize;
+                continue;
+            }
             QList<SxFileEntry*> list;
             QString etag;
             if (!mCluster->_listFiles(sxVolume, file, true, list, etag)) {
@@ -1016,6 +1234,31 @@ QList<QPair<QString, qint64>> ScoutModel::getRevisions(const QString &volume, co
     return result;
 }
 
+/* the cached list, if any, is handed over at once and the fresh one once the cluster replies */
+void ScoutModel::requestRevisions(const QString &volume, const QString &file, std::function<void(const QList<QPair<QString, qint64>>&)> callback)
+{
+    SxVolume *sxVolume = mCluster->getSxVolume(volume);
+    if (sxVolume == nullptr) {
+        logWarning("unable to get volume "+volume);
+        callback({});
+        return;
+    }
+    auto convert = [](const SxRevisionCache::RevisionList &list) {
+        QList<QPair<QString, qint64>> result;
+        foreach (auto rev, list) {
+            result.append({std::get<0>(rev), std::get<1>(rev)});
+        }
+        return result;
+    };
+    SxRevisionCache::RevisionList cached;
+    if (SxRevisionCache::instance().get(mCluster->uuid(), volume, file, cached))
+        callback(convert(cached));
+    mCluster->listFileRevisionsAsync(sxVolume, file, [callback, convert](bool success, const SxRevisionCache::RevisionList &list) {
+        if (success)
+            callback(convert(list));
+    });
+}
+
 QList<int> ScoutModel::mapSelectionFrom2D(const QModelIndexList &list)
 {
     QList<int> result;
@@ -1036,6 +1279,14 @@ QModelIndexList ScoutModel::create2Dselection(const QList<int> &list)
     return result;
 }
 
+QStringList ScoutModel::findFiles(const QString &text, int limit)
+{
+    // answered from the listings cached for the current volume, no cluster round trip
+    if (mCurrentVolume.isEmpty())
+        return QStringList();
+    return mDatabase->findFiles(mCurrentVolume, text, limit);
+}
+
 QModelIndex ScoutModel::findNext(const QChar &c, const QModelIndex &from)
 {
     int pos;
@@ -1208,22 +1459,22 @@ void ScoutModelHelperThread::executeUpload(const QString &rootDir, const QString
     auto mCheckCert = [this](QSslCertificate &, bool) -> bool {
         return true;
     };
-    SxCluster *mCluster = SxCluster::initializeCluster(mAuth, mUuid, mCheckCert, errorMessage);
+    SxCluster *mCluster = SxClusterPool::instance().acquire(mAuth, mUuid, mCheckCert, errorMessage);
     if (mCluster == nullptr) {
         emit uploadFinished();
         return;
     }
-    connect(this, &ScoutModelHelperThread::abortTask, mCluster, &SxCluster::abort, Qt::DirectConnection);
+    QMetaObject::Connection abortConnection = connect(this, &ScoutModelHelperThread::abortTask, mCluster, &SxCluster::abort, Qt::DirectConnection);
     mCluster->reloadVolumes();
     SxVolume *volume = mCluster->getSxVolume(dstVolume);
     if (volume == nullptr) {
         emit uploadFinished();
-        delete mCluster;
+        releaseCluster(mCluster, abortConnection);
         return;
     }
     mCluster->uploadFiles(rootDir, files, volume, dstDir, mCallback, true);
     emit uploadFinished();
-    delete mCluster;
+    releaseCluster(mCluster, abortConnection);
 }
 
 void ScoutModelHelperThread::executeDownload(const QString &volume, const QString &remoteDir, const QStringList &files, const QString &localDir)
@@ -1232,18 +1483,18 @@ void ScoutModelHelperThread::executeDownload(const QString &volume, const QStrin
     auto mCheckCert = [this](QSslCertificate &, bool) -> bool {
         return true;
     };
-    SxCluster *mCluster = SxCluster::initializeCluster(mAuth, mUuid, mCheckCert, errorMessage);
+    SxCluster *mCluster = SxClusterPool::instance().acquire(mAuth, mUuid, mCheckCert, errorMessage);
     if (mCluster == nullptr) {
         emit uploadFinished();
         qDebug() << "ERROR" << __LINE__;
         return;
     }
-    connect(this, &ScoutModelHelperThread::abortTask, mCluster, &SxCluster::abort, Qt::DirectConnection);
+    QMetaObject::Connection abortConnection = connect(this, &ScoutModelHelperThread::abortTask, mCluster, &SxCluster::abort, Qt::DirectConnection);
     mCluster->reloadVolumes();
     SxVolume *vol = mCluster->getSxVolume(volume);
     if (vol == nullptr) {
         emit uploadFinished();
-        delete mCluster;
+        releaseCluster(mCluster, abortConnection);
         qDebug() << "ERROR" << __LINE__;
         return;
     }
@@ -1257,6 +1508,7 @@ void ScoutModelHelperThread::executeDownload(const QString &volume, const QStrin
             if (!mCluster->_listFiles(vol, file, true, list, etag)) {
                 emit uploadFinished();
                 qDebug() << "ERROR" << __LINE__;
+                releaseCluster(mCluster, abortConnection);
                 return;
             }
             foreach (auto entry, list) {
@@ -1277,6 +1529,7 @@ void ScoutModelHelperThread::executeDownload(const QString &volume, const QStrin
             if (!mCluster->_listFiles(vol, file, false, list, etag)) {
                 emit uploadFinished();
                 qDebug() << "ERROR" << __LINE__;
+                releaseCluster(mCluster, abortConnection);
                 return;
             }
             SxFileEntry* fileEntry = nullptr;
@@ -1296,6 +1549,7 @@ void ScoutModelHelperThread::executeDownload(const QString &volume, const QStrin
             if (fileEntry == nullptr) {
                 emit uploadFinished();
                 qDebug() << "ERROR" << __LINE__;
+                releaseCluster(mCluster, abortConnection);
                 return;
             }
             if (fileEntry->size() == 0) {
@@ -1340,5 +1594,113 @@ void ScoutModelHelperThread::executeDownload(const QString &volume, const QStrin
     }
     disconnect(connection);
     emit uploadFinished();
+    releaseCluster(mCluster, abortConnection);
+}
+
+/* the cluster goes back to the pool for the next batch */
+void ScoutModelHelperThread::releaseCluster(SxCluster *cluster, const QMetaObject::Connection &abortConnection)
+{
+    disconnect(abortConnection);
+    SxClusterPool::instance().release(cluster);
+}
+
+ScoutListingWorker::ScoutListingWorker(const SxAuth &auth, const QByteArray &uuid, std::function<bool (QSslCertificate &, bool)> checkCertCallback)
+    : QObject()
+{
+    mAuth = auth;
+    mUuid = uuid;
+    mCheckCertCallback = checkCertCallback;
+    mCluster = nullptr;
+    mPrefetchScheduled = false;
+}
+
+ScoutListingWorker::~ScoutListingWorker()
+{
     delete mCluster;
 }
+
+void ScoutListingWorker::setLatestRequest(int request)
+{
+    mLatestRequest.store(request);
+}
+
+SxVolume *ScoutListingWorker::getVolume(const QString &volume, QString &errorMessage)
+{
+    if (mCluster == nullptr) {
+        mCluster = SxCluster::initializeCluster(mAuth, mUuid, mCheckCertCallback, errorMessage);
+        if (mCluster == nullptr)
+            return nullptr;
+        mCluster->reloadVolumes();
+    }
+    SxVolume *sxVolume = mCluster->getSxVolume(volume);
+    if (sxVolume == nullptr && mCluster->reloadVolumes())
+        sxVolume = mCluster->getSxVolume(volume);
+    if (sxVolume == nullptr)
+        errorMessage = QString("volume %1 not found").arg(volume);
+    return sxVolume;
+}
+
+void ScoutListingWorker::list(int request, const QString &volume, const QString &dir, bool recursive, const QString &etag)
+{
+    // the user moved on before this request was picked up
+    if (request != mLatestRequest.load())
+        return;
+    QList<SxFileEntry*> files;
+    QString errorMessage;
+    SxVolume *sxVolume = getVolume(volume, errorMessage);
+    if (sxVolume == nullptr) {
+        emit listed(request, volume, dir, recursive, etag, files, static_cast<int>(mCluster == nullptr ? SxErrorCode::UnknownError : SxErrorCode::NotFound), errorMessage);
+        return;
+    }
+    QString newEtag = etag;
+    if (mCluster->_listFiles(sxVolume, dir, recursive, files, newEtag)) {
+        mPrefetchTimes.insert(volume+dir, QDateTime::currentMSecsSinceEpoch());
+        emit listed(request, volume, dir, recursive, newEtag, files, static_cast<int>(SxErrorCode::NoError), QString());
+    }
+    else
+        emit listed(request, volume, dir, recursive, etag, files, static_cast<int>(mCluster->lastError().errorCode()), mCluster->lastError().errorMessage());
+}
+
+void ScoutListingWorker::prefetch(const QStringList &volumes, const QStringList &dirs, const QStringList &etags)
+{
+    // targets of the previous location are not interesting anymore
+    mPrefetchTargets.clear();
+    for (int i=0; i<volumes.count() && i<dirs.count() && i<etags.count(); i++) {
+        mPrefetchTargets.append({volumes.at(i), dirs.at(i), etags.at(i)});
+    }
+    if (!mPrefetchScheduled && !mPrefetchTargets.isEmpty()) {
+        mPrefetchScheduled = true;
+        QTimer::singleShot(0, this, SLOT(prefetchNext()));
+    }
+}
+
+void ScoutListingWorker::prefetchNext()
+{
+    // one directory at a time, requests for the current view queued meanwhile go first
+    mPrefetchScheduled = false;
+    while (!mPrefetchTargets.isEmpty()) {
+        PrefetchTarget target = mPrefetchTargets.takeFirst();
+        qint64 now = QDateTime::currentMSecsSinceEpoch();
+        if (now - mPrefetchTimes.value(target.volume+target.dir, 0) < sPrefetchInterval*1000)
+            continue;
+        QString errorMessage;
+        SxVolume *sxVolume = getVolume(target.volume, errorMessage);
+        if (sxVolume == nullptr)
+            continue;
+        QList<SxFileEntry*> files;
+        QString etag = target.etag;
+        if (mCluster->_listFiles(sxVolume, target.dir, false, files, etag)) {
+            emit prefetched(target.volume, target.dir, etag, files);
+        }
+        else {
+            qDeleteAll(files);
+        }
+        if (mCluster->lastError().errorCode() == SxErrorCode::NoError || mCluster->lastError().errorCode() == SxErrorCode::NotChanged)
+            mPrefetchTimes.insert(target.volume+target.dir, now);
+        break;
+    }
+    if (!mPrefetchTargets.isEmpty()) {
+        mPrefetchScheduled = true;
+        QTimer::singleShot(0, this, SLOT(prefetchNext()));
+    }
+}
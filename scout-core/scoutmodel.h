@@ -31,12 +31,15 @@
 
 #include <QAbstractItemModel>
 #include <QStack>
+#include <QVector>
 #include <QThread>
 #include "sxcluster.h"
 #include "scoutqueue.h"
 #include "scoutdatabase.h"
 #include "clusterconfig.h"
 
+class ScoutListingWorker;
+
 class ScoutModel : public QAbstractItemModel
 {
     Q_OBJECT
@@ -52,6 +55,8 @@ signals:
     void abort();
     void clusterInitialized();
     void sigError(const QString& errorMessage);
+    void requestListing(int request, const QString &volume, const QString &dir, bool recursive, const QString &etag);
+    void requestPrefetch(const QStringList &volumes, const QStringList &dirs, const QStringList &etags);
 
 public slots:
     void cancelClusterTask();
@@ -60,6 +65,8 @@ public slots:
     // QAbstractItemModel interface
 public:
     SxCluster *cluster() const;
+    ClusterConfig *clusterConfig() const;
+    std::function<bool(QSslCertificate& cert, bool secondaryCert)> checkCertCallback() const;
     QModelIndex index(int row, int column, const QModelIndex &parent) const override;
     QModelIndex parent(const QModelIndex &child) const override;
     int rowCount(const QModelIndex &parent) const override;
@@ -104,9 +111,11 @@ public:
     int filesCount() const;
     QPair<int, qint64> countFiles(const QString &volume, const QStringList &files);
     QList<QPair<QString, qint64>> getRevisions(const QString &volume, const QString &file);
+    void requestRevisions(const QString &volume, const QString &file, std::function<void(const QList<QPair<QString, qint64>>&)> callback);
     QList<int> mapSelectionFrom2D(const QModelIndexList &list);
     QModelIndexList create2Dselection(const QList<int> &list);
     QModelIndex findNext(const QChar &c, const QModelIndex &from);
+    QStringList findFiles(const QString &text, int limit);
     bool isAesVolume(const QString &volume);
 
 public:
@@ -115,13 +124,27 @@ public:
         NameRole,
         FullPathRole,
         SizeRole,
-        SizeUsedRole
+        SizeUsedRole,
+        RevisionRole
     };
 private slots:
     void queueFileUploaded(const QString &volume, const QString &path);
+    void listingFinished(int request, const QString &volume, const QString &dir, bool recursive, const QString &etag,
+                         const QList<SxFileEntry*> &files, int errorCode, const QString &errorMessage);
+    void prefetchFinished(const QString &volume, const QString &dir, const QString &etag, const QList<SxFileEntry*> &files);
 
 private:
     void setCurrentPath(const QString &volume, const QString &path, bool blockView);
+    void startListingWorker();
+    void stopListingWorker();
+    void applyFileList(QList<SxFileEntry*> &fileList);
+    struct FileRoles {
+        QString name;
+        QString mimeType;
+        bool valid = false;
+    };
+    const FileRoles &fileRoles(int itemIndex) const;
+    void prefetchTargets();
     void appendTask(ScoutTask *task);
     void copyOrCopyFiles(const QString &srcVolume, const QString &srcRoot, const QStringList &files, const QString &dstVolume, const QString &destination, bool copy);
 private:
@@ -140,6 +163,7 @@ private:
     ClusterConfig *mClusterConfig;
     SxCluster *mCluster;
     QList<SxFileEntry*> mFileList;
+    mutable QVector<FileRoles> mFileRoles;
     QStack<QPair<QString, QString>> mPrevStack;
     QStack<QPair<QString, QString>> mNextStack;
     QSet<QString> mUnlockedVolumes;
@@ -147,6 +171,13 @@ private:
     std::function<bool(QSslCertificate& cert, bool secondaryCert)> mCheckCertCallback;
     QTimer mRefreshTimer;
     QString mLastError;
+    QThread mListingThread;
+    ScoutListingWorker *mListingWorker;
+    int mListingRequest;
+    bool mViewBlocked;
+
+    // feeds synthetic listings to the model without a cluster
+    friend class ScoutBenchmark;
 };
 
 class ScoutModelHelperThread : public QObject {
@@ -165,9 +196,44 @@ private slots:
     void executeUpload(const QString &rootDir, const QStringList &files, const QString &dstVolume, const QString &dstDir);
     void executeDownload(const QString &volume, const QString &remoteDir, const QStringList &files, const QString &localDir);
 private:
+    void releaseCluster(SxCluster *cluster, const QMetaObject::Connection &abortConnection);
     std::function<void(QString, qint64, qint64)> mCallback;
     SxAuth mAuth;
     QByteArray mUuid;
 };
 
+class ScoutListingWorker : public QObject {
+    Q_OBJECT
+public:
+    explicit ScoutListingWorker(const SxAuth &auth, const QByteArray& uuid, std::function<bool(QSslCertificate&, bool)> checkCertCallback);
+    ~ScoutListingWorker();
+    void setLatestRequest(int request);
+signals:
+    void listed(int request, const QString &volume, const QString &dir, bool recursive, const QString &etag,
+                const QList<SxFileEntry*> &files, int errorCode, const QString &errorMessage);
+    void prefetched(const QString &volume, const QString &dir, const QString &etag, const QList<SxFileEntry*> &files);
+public slots:
+    void list(int request, const QString &volume, const QString &dir, bool recursive, const QString &etag);
+    void prefetch(const QStringList &volumes, const QStringList &dirs, const QStringList &etags);
+private slots:
+    void prefetchNext();
+private:
+    SxVolume *getVolume(const QString &volume, QString &errorMessage);
+    struct PrefetchTarget {
+        QString volume;
+        QString dir;
+        QString etag;
+    };
+    // a directory listed recently is not prefetched again
+    static const int sPrefetchInterval = 60;
+    QList<PrefetchTarget> mPrefetchTargets;
+    QHash<QString, qint64> mPrefetchTimes;
+    bool mPrefetchScheduled;
+    SxAuth mAuth;
+    QByteArray mUuid;
+    std::function<bool(QSslCertificate&, bool)> mCheckCertCallback;
+    SxCluster *mCluster;
+    QAtomicInt mLatestRequest;
+};
+
 #endif // ScoutModel_H
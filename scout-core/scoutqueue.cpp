@@ -28,9 +28,13 @@
 
 #include "scoutqueue.h"
 #include "scoutmodel.h"
+#include <QFileInfo>
 #include <QMutexLocker>
-#include <QTemporaryFile>
+#include <memory>
+#include "sxclusterpool.h"
 #include "sxlog.h"
+#include "sxrevisioncache.h"
+#include "sxtrace.h"
 #include "util.h"
 
 ScoutQueue::ScoutQueue(ClusterConfig *config, QObject *parent)
@@ -41,12 +45,35 @@ ScoutQueue::ScoutQueue(ClusterConfig *config, QObject *parent)
     mCluster = nullptr;
     mCurrentTask = nullptr;
     mClusterConfig = config;
-    mCurrentFileSize = 0;
-    mCurrentFileProgress = 0;
-    mCurrentTaskProgress = 0;
+    mCompletedSize = 0;
+    mParallelTasks = 1;
+    mStopping = false;
     connect(this, &ScoutQueue::startTask, this, &ScoutQueue::executeTask, Qt::QueuedConnection);
 }
 
+ScoutQueue::~ScoutQueue()
+{
+    mMutex.lock();
+    mStopping = true;
+    foreach (auto task, mPendingList) {
+        if (task->cluster != nullptr)
+            task->cluster->abort();
+    }
+    if (mCurrentTask != nullptr && mCurrentTask->cluster != nullptr && mCurrentTask->cluster != mCluster)
+        mCurrentTask->cluster->abort();
+    mMutex.unlock();
+    foreach (auto worker, mWorkers) {
+        worker->wait();
+        delete worker;
+    }
+}
+
+void ScoutQueue::setParallelTasks(int parallelTasks)
+{
+    QMutexLocker locker(&mMutex);
+    mParallelTasks = qMax(1, parallelTasks);
+}
+
 void ScoutQueue::appendTask(ScoutTask *task)
 {
     QMutexLocker locker(&mMutex);
@@ -60,7 +87,7 @@ void ScoutQueue::appendTask(ScoutTask *task)
     }
     if (mCurrentTask == nullptr) {
         mCurrentTask = task;
-        mCurrentTaskProgress = 0;
+        mCompletedSize = 0;
         locker.unlock();
         emit dataChanged(mCurrentTaskIndex, mCurrentTaskIndex, {ScoutModel::NameRole, ScoutModel::MimeTypeRole, ScoutModel::SizeRole, ScoutModel::SizeUsedRole});
         emit startTask();
@@ -70,6 +97,7 @@ void ScoutQueue::appendTask(ScoutTask *task)
         beginInsertRows(mTasksIndex, index, index);
         mPendingList.append(task);
         endInsertRows();
+        _startWorkers();
     }
 }
 
@@ -81,11 +109,19 @@ QVariant ScoutQueue::currentTaskData(int role) const
     if (role == DirectionRole)
         return mCurrentTask->upload ? "upload" : "download";
     if (role == TitleRole)
-        return !mCurrentFile.isEmpty() ? mCurrentFile : mCurrentTask->title;
-    if (role == SizeRole)
-        return mCurrentTask->size;
-    if (role == ProgressRole)
-        return mCurrentTaskProgress+mCurrentFileProgress;
+        return !mCurrentTask->currentFile.isEmpty() ? mCurrentTask->currentFile : mCurrentTask->title;
+    if (role == SizeRole || role == ProgressRole) {
+        // tasks transferred by the workers count towards the current one
+        qint64 size = mCompletedSize + mCurrentTask->size;
+        qint64 progress = mCompletedSize + mCurrentTask->progress + mCurrentTask->currentFileProgress;
+        foreach (auto task, mPendingList) {
+            if (task->running) {
+                size += task->size;
+                progress += task->progress + task->currentFileProgress;
+            }
+        }
+        return role == SizeRole ? size : progress;
+    }
     if (role == ErrorRole)
         return mCurrentTask->error;
     return QVariant();
@@ -126,9 +162,10 @@ void ScoutQueue::cancelCurrentTask()
     if (mCurrentTask == nullptr)
         return;
     if (mCurrentTask->error.isEmpty()) {
-        if (mCluster == nullptr)
-            return;
-        mCluster->abort();
+        if (mCurrentTask->cluster != nullptr)
+            mCurrentTask->cluster->abort();
+        else if (mCluster != nullptr)
+            mCluster->abort();
     }
     else {
         delete mCurrentTask;
@@ -155,8 +192,16 @@ void ScoutQueue::cancelPendingTask(int index)
     if (index < mPendingList.count()) {
         beginRemoveRows(mTasksIndex, index, index);
         auto task = mPendingList.takeAt(index);
-        if (task != nullptr)
-            delete task;
+        if (task != nullptr) {
+            // a worker is transferring it, the task is deleted once the transfer stops
+            if (task->running) {
+                task->cancelled = true;
+                if (task->cluster != nullptr)
+                    task->cluster->abort();
+            }
+            else
+                delete task;
+        }
         endRemoveRows();
     }
     else if (index < mPendingList.count()+mFailedTasks.count()) {
@@ -181,7 +226,8 @@ void ScoutQueue::retryCurrentTask()
     if (mCurrentTask == nullptr || mCurrentTask->error.isEmpty())
         return;
     mCurrentTask->error.clear();
-    mCurrentTaskProgress = 0;
+    mCurrentTask->progress = 0;
+    mCompletedSize = 0;
     locker.unlock();
     emit dataChanged(mCurrentTaskIndex, mCurrentTaskIndex, {ScoutModel::NameRole, ScoutModel::MimeTypeRole, ScoutModel::SizeRole, ScoutModel::SizeUsedRole});
     emit startTask();
@@ -199,6 +245,7 @@ void ScoutQueue::retryTask(int index)
             task->error.clear();
             mPendingList.append(task);
             emit dataChanged(ScoutQueue::index(index, 0, mTasksIndex), ScoutQueue::index(index, 0, mTasksIndex), {ErrorRole});
+            _startWorkers();
         }
         else {
             beginMoveRows(mTasksIndex, index, index, mTasksIndex, mPendingList.count());
@@ -206,6 +253,7 @@ void ScoutQueue::retryTask(int index)
             task->error.clear();
             mPendingList.append(task);
             endMoveRows();
+            _startWorkers();
         }
     }
     else {
@@ -249,133 +297,50 @@ void ScoutQueue::executeTask()
     if (mCurrentTask == nullptr)
         return;
     locker.unlock();
-    auto checkSsl = [](QSslCertificate&, bool) -> bool {
-        return true;
-    };
     QString errorMessage;
-    mCluster = SxCluster::initializeCluster(mClusterConfig->sxAuth(), mClusterConfig->uuid(), checkSsl, errorMessage);
+    mCluster = _initializeCluster();
     if (mCluster == nullptr) {
-        logError(errorMessage);
         qDebug() << "executeTask failed" << __LINE__;
         return;
     }
-    mCluster->reloadVolumes();
-    connect(mCluster, &SxCluster::sig_setProgress, [this](qint64 size, qint64) {
-        mMutex.lock();
-        if (size > mCurrentFileSize) {
-            mCurrentTask->size += size-mCurrentFileSize;
-            mCurrentFileSize = size;
-        }
-        mCurrentFileProgress = mCurrentFileSize - size;
-        mMutex.unlock();
-        emit dataChanged(mCurrentTaskIndex, mCurrentTaskIndex, {ScoutModel::SizeRole, ScoutModel::SizeUsedRole});
-    });
     while (true) {
         emit sigShowWarning(!mFailedTasks.isEmpty());
         errorMessage.clear();
-        mCurrentFile.clear();
-        SxVolume *volume = mCluster->getSxVolume(mCurrentTask->volume);
-        if (volume == nullptr) {
-            qDebug() << "executeTask failed" << __LINE__;
-            errorMessage = "unable to find volume";
-            goto endTask;
-        }
-        if (mCurrentTask->upload) {
-            foreach (auto file, mCurrentTask->files) {
-                QString localFile = file.first;
-                QString localFolder = mCurrentTask->localPath;
-                QString remotePath;
-                if (mCurrentTask->remotePath.endsWith("/")) {
-                    QString relativePath = makeRelativeTo(localFolder, localFile);
-                    remotePath = mCurrentTask->remotePath+relativePath.mid(1);
-                }
-                else {
-                    remotePath = mCurrentTask->remotePath;
-                }
-                SxFileEntry fileEntry;
-                QString currentFilename = remotePath.split("/").last();
-                mMutex.lock();
-                mCurrentFile = currentFilename;
-                mCurrentFileSize = file.second;
-                mCurrentFileProgress = 0;
-                mMutex.unlock();
-                emit dataChanged(mCurrentTaskIndex, mCurrentTaskIndex, {ScoutModel::NameRole});
-                QTemporaryFile tmpFile;
-                if (localFile.endsWith("/.sxnewdir")) {
-                    QFile sxnewdir(localFile);
-                    if (!sxnewdir.exists()) {
-                        tmpFile.open();
-                        localFile = tmpFile.fileName();
-                    }
-                }
-                if (!mCluster->uploadFile(volume, remotePath, localFile, fileEntry, nullptr, true)) {
-                    qDebug() << "executeTask failed" << __LINE__;
-                    mCurrentFile.clear();
-                    errorMessage = mCluster->lastError().errorMessage();
-                    goto endTask;
-                }
-                fileUploaded(mCurrentTask->volume, remotePath);
-                mMutex.lock();
-                mCurrentTaskProgress += mCurrentFileSize;
-                mMutex.unlock();
-                emit dataChanged(mCurrentTaskIndex, mCurrentTaskIndex, {ScoutModel::SizeRole, ScoutModel::SizeUsedRole});
-            }
+        mMutex.lock();
+        _startWorkers();
+        ScoutTask *task = mCurrentTask;
+        bool transferredByWorker = task->running;
+        if (transferredByWorker) {
+            while (!task->finished)
+                mTaskFinished.wait(&mMutex);
+            errorMessage = task->transferError;
         }
         else {
-            QString rev;
-            if (mCurrentTask->files.isEmpty()) {
-                rev = mCurrentTask->rev;
-                mCurrentTask->files.append({mCurrentTask->remotePath, mCurrentTask->size});
-            }
-            foreach (auto file, mCurrentTask->files) {
-                QString remoteFile = file.first;
-                QString localFile;
-                if (mCurrentTask->localPath.endsWith("/")) {
-                    if (mCurrentTask->remotePath.endsWith("/")) {
-                        QString relativePath = makeRelativeTo(mCurrentTask->remotePath, remoteFile);
-                        if (relativePath.startsWith("/"))
-                            localFile = mCurrentTask->localPath+relativePath.mid(1);
-                        else
-                            localFile = mCurrentTask->localPath+relativePath;
-                    }
-                    else {
-                        int index = remoteFile.lastIndexOf("/");
-                        localFile = mCurrentTask->localPath + remoteFile.mid(index+1);
-                    }
-                }
-                else {
-                    localFile = mCurrentTask->localPath;
-                }
-                SxFileEntry fileEntry;
-                QString currentFilename = remoteFile.split("/").last();
-                mMutex.lock();
-                mCurrentFile = currentFilename;
-                mCurrentFileSize = file.second;
-                mCurrentFileProgress = 0;
-                mMutex.unlock();
-                emit dataChanged(mCurrentTaskIndex, mCurrentTaskIndex, {ScoutModel::NameRole});
-                if (!mCluster->downloadFile(volume, remoteFile, rev, localFile, fileEntry, 4)) {
-                    qDebug() << "executeTask failed" << __LINE__ << mCluster->lastError().errorMessage();
-                    errorMessage = mCluster->lastError().errorMessage();
-                    goto endTask;
-                }
-                mMutex.lock();
-                mCurrentTaskProgress += mCurrentFileSize;
-                mMutex.unlock();
-                emit dataChanged(mCurrentTaskIndex, mCurrentTaskIndex, {ScoutModel::SizeRole, ScoutModel::SizeUsedRole});
-            }
+            task->running = true;
+            task->cluster = mCluster;
         }
-        endTask:
+        mMutex.unlock();
+        if (!transferredByWorker)
+            _runTask(mCluster, task, errorMessage);
         mMutex.lock();
-        if (errorMessage.isEmpty())
+        task->running = false;
+        task->finished = false;
+        task->cluster = nullptr;
+        task->currentFile.clear();
+        task->currentFileProgress = 0;
+        if (errorMessage.isEmpty()) {
+            mCompletedSize += mCurrentTask->size;
             delete mCurrentTask;
+        }
         else {
             emit sigShowWarning(true);
             mCurrentTask->error = errorMessage;
+            mCurrentTask->progress = 0;
             if (mPendingList.isEmpty()) {
                 mMutex.unlock();
                 emit dataChanged(mCurrentTaskIndex, mCurrentTaskIndex, {ScoutModel::NameRole, ScoutModel::MimeTypeRole, ScoutModel::SizeRole, ScoutModel::SizeUsedRole});
-                delete mCluster;
+                SxClusterPool::instance().release(mCluster);
+                mCluster = nullptr;
                 return;
             }
             int index = mPendingList.length()+mFailedTasks.length();
@@ -396,22 +361,316 @@ void ScoutQueue::executeTask()
                 endRemoveRows();
                 emit dataChanged(mCurrentTaskIndex, mCurrentTaskIndex, {ScoutModel::NameRole, ScoutModel::MimeTypeRole, ScoutModel::SizeRole, ScoutModel::SizeUsedRole});
                 mMutex.unlock();
+                SxClusterPool::instance().release(mCluster);
+                mCluster = nullptr;
                 emit sigShowWarning(true);
                 return;
             }
         }
-        beginRemoveRows(mTasksIndex, 0, 0);
-        mCurrentTask = mPendingList.takeFirst();
+        // a task no worker picked up yet goes first, otherwise the oldest transfer becomes the current one
+        int next = 0;
+        for (int i=0; i<mPendingList.count(); i++) {
+            if (!mPendingList.at(i)->running) {
+                next = i;
+                break;
+            }
+        }
+        beginRemoveRows(mTasksIndex, next, next);
+        mCurrentTask = mPendingList.takeAt(next);
         endRemoveRows();
-        mCurrentTaskProgress = 0;
         emit dataChanged(mCurrentTaskIndex, mCurrentTaskIndex, {ScoutModel::NameRole, ScoutModel::MimeTypeRole, ScoutModel::SizeRole, ScoutModel::SizeUsedRole});
         mMutex.unlock();
     }
-    delete mCluster;
+    SxClusterPool::instance().release(mCluster);
+    mCluster = nullptr;
     emit finished();
     emit sigShowWarning(false);
 }
 
+bool ScoutQueue::_runTask(SxCluster *cluster, ScoutTask *task, QString &errorMessage)
+{
+    quint32 traceId = SxTrace::instance().begin(SxTraceEvent::QueueTask, task->title);
+    auto progressConnection = connect(cluster, &SxCluster::sig_setProgress, [this, task](qint64 size, qint64) {
+        mMutex.lock();
+        if (size > task->currentFileSize) {
+            task->size += size-task->currentFileSize;
+            task->currentFileSize = size;
+        }
+        task->currentFileProgress = task->currentFileSize - size;
+        mMutex.unlock();
+        emit dataChanged(mCurrentTaskIndex, mCurrentTaskIndex, {ScoutModel::SizeRole, ScoutModel::SizeUsedRole});
+    });
+    SxVolume *volume = cluster->getSxVolume(task->volume);
+    if (volume == nullptr) {
+        qDebug() << "executeTask failed" << __LINE__;
+        errorMessage = "unable to find volume";
+        goto end;
+    }
+    if (task->upload) {
+        // markers of empty directories, often missing locally, are created together at the end
+        QList<QPair<QString, quint32>> emptyDirMarkers;
+        foreach (auto file, task->files) {
+            QString localFile = file.first;
+            QString localFolder = task->localPath;
+            QString remotePath;
+            if (task->remotePath.endsWith("/")) {
+                QString relativePath = makeRelativeTo(localFolder, localFile);
+                remotePath = task->remotePath+relativePath.mid(1);
+            }
+            else {
+                remotePath = task->remotePath;
+            }
+            if (localFile.endsWith("/.sxnewdir") && QFileInfo(localFile).size() == 0) {
+                emptyDirMarkers.append({remotePath, 0});
+                continue;
+            }
+            SxFileEntry fileEntry;
+            QString currentFilename = remotePath.split("/").last();
+            mMutex.lock();
+            task->currentFile = currentFilename;
+            task->currentFileSize = file.second;
+            task->currentFileProgress = 0;
+            bool current = task == mCurrentTask;
+            mMutex.unlock();
+            if (current)
+                emit dataChanged(mCurrentTaskIndex, mCurrentTaskIndex, {ScoutModel::NameRole});
+            if (!cluster->uploadFile(volume, remotePath, localFile, fileEntry, nullptr, true)) {
+                qDebug() << "executeTask failed" << __LINE__;
+                mMutex.lock();
+                task->currentFile.clear();
+                mMutex.unlock();
+                errorMessage = cluster->lastError().errorMessage();
+                goto end;
+            }
+            SxRevisionCache::instance().invalidate(task->volume, remotePath);
+            emit fileUploaded(task->volume, remotePath);
+            mMutex.lock();
+            task->progress += task->currentFileSize;
+            task->currentFileProgress = 0;
+            mMutex.unlock();
+            emit dataChanged(mCurrentTaskIndex, mCurrentTaskIndex, {ScoutModel::SizeRole, ScoutModel::SizeUsedRole});
+        }
+        if (!emptyDirMarkers.isEmpty()) {
+            // the cluster may keep the callback past this task, so it owns what it writes to
+            auto markerError = std::make_shared<QString>();
+            auto callback = [markerError](QString, QString, SxError error, QString, quint32) {
+                if (error.errorCode() != SxErrorCode::NoError)
+                    *markerError = error.errorMessage();
+            };
+            QStringList created;
+            bool markersCreated = cluster->createEmptyFiles(volume, emptyDirMarkers, created, callback);
+            cluster->pollUploadJobs(0, callback);
+            foreach (const QString &remotePath, created) {
+                SxRevisionCache::instance().invalidate(task->volume, remotePath);
+                emit fileUploaded(task->volume, remotePath);
+            }
+            if (!markersCreated || !markerError->isEmpty()) {
+                qDebug() << "executeTask failed" << __LINE__;
+                errorMessage = markersCreated ? *markerError : cluster->lastError().errorMessage();
+                goto end;
+            }
+        }
+    }
+    else {
+        QString rev;
+        if (task->files.isEmpty() && task->pendingDirs.isEmpty()) {
+            rev = task->rev;
+            task->files.append({task->remotePath, task->size});
+        }
+        for (int i=0; ; i++) {
+            if (i >= task->files.count()) {
+                if (!_listNextPage(cluster, volume, task, errorMessage))
+                    goto end;
+                if (i >= task->files.count())
+                    break;
+            }
+            auto file = task->files.at(i);
+            QString remoteFile = file.first;
+            QString localFile;
+            if (task->localPath.endsWith("/")) {
+                if (task->remotePath.endsWith("/")) {
+                    QString relativePath = makeRelativeTo(task->remotePath, remoteFile);
+                    if (relativePath.startsWith("/"))
+                        localFile = task->localPath+relativePath.mid(1);
+                    else
+                        localFile = task->localPath+relativePath;
+                }
+                else {
+                    int index = remoteFile.lastIndexOf("/");
+                    localFile = task->localPath + remoteFile.mid(index+1);
+                }
+            }
+            else {
+                localFile = task->localPath;
+            }
+            SxFileEntry fileEntry;
+            QString currentFilename = remoteFile.split("/").last();
+            mMutex.lock();
+            task->currentFile = currentFilename;
+            task->currentFileSize = file.second;
+            task->currentFileProgress = 0;
+            bool current = task == mCurrentTask;
+            mMutex.unlock();
+            if (current)
+                emit dataChanged(mCurrentTaskIndex, mCurrentTaskIndex, {ScoutModel::NameRole});
+            if (!cluster->downloadFile(volume, remoteFile, rev, localFile, fileEntry, 4)) {
+                qDebug() << "executeTask failed" << __LINE__ << cluster->lastError().errorMessage();
+                errorMessage = cluster->lastError().errorMessage();
+                goto end;
+            }
+            mMutex.lock();
+            task->progress += task->currentFileSize;
+            task->currentFileProgress = 0;
+            mMutex.unlock();
+            emit dataChanged(mCurrentTaskIndex, mCurrentTaskIndex, {ScoutModel::SizeRole, ScoutModel::SizeUsedRole});
+        }
+    }
+    end:
+    disconnect(progressConnection);
+    mMutex.lock();
+    qint64 traceBytes = task->progress;
+    mMutex.unlock();
+    SxTrace::instance().end(SxTraceEvent::QueueTask, traceId, traceBytes, errorMessage.isEmpty() ? 0 : 1);
+    return errorMessage.isEmpty();
+}
+
+bool ScoutQueue::_listNextPage(SxCluster *cluster, SxVolume *volume, ScoutTask *task, QString &errorMessage)
+{
+    // the transfer starts with the first page, the task size grows with every page listed
+    while (!task->pendingDirs.isEmpty()) {
+        const QString dir = task->pendingDirs.first();
+        const QString after = task->listedAfter;
+        QList<SxFileEntry*> list;
+        QString etag;
+        if (!cluster->_listFiles(volume, dir, true, list, etag, after.isEmpty() ? dir : after, sDownloadListPage)) {
+            qDebug() << "executeTask failed" << __LINE__ << cluster->lastError().errorMessage();
+            errorMessage = cluster->lastError().errorMessage();
+            return false;
+        }
+        int count = list.count();
+        QList<QPair<QString, qint64>> files;
+        qint64 size = 0;
+        foreach (auto entry, list) {
+            // listings that can't be paged come back whole, skip what is already queued
+            if (after.isEmpty() || entry->path() > after) {
+                files.append({entry->path(), entry->size()});
+                size += entry->size();
+            }
+            delete entry;
+        }
+        mMutex.lock();
+        if (count != sDownloadListPage || files.isEmpty()) {
+            task->pendingDirs.removeFirst();
+            task->listedAfter.clear();
+        }
+        else
+            task->listedAfter = files.last().first;
+        task->files.append(files);
+        task->size += size;
+        mMutex.unlock();
+        emit dataChanged(mCurrentTaskIndex, mCurrentTaskIndex, {ScoutModel::SizeRole, ScoutModel::SizeUsedRole});
+        if (!files.isEmpty())
+            return true;
+    }
+    return true;
+}
+
+SxCluster *ScoutQueue::_initializeCluster()
+{
+    auto checkSsl = [](QSslCertificate&, bool) -> bool {
+        return true;
+    };
+    QString errorMessage;
+    SxCluster *cluster = SxClusterPool::instance().acquire(mClusterConfig->sxAuth(), mClusterConfig->uuid(), checkSsl, errorMessage);
+    if (cluster == nullptr) {
+        logError(errorMessage);
+        return nullptr;
+    }
+    cluster->reloadVolumes();
+    return cluster;
+}
+
+ScoutTask *ScoutQueue::_nextPendingTask() const
+{
+    if (mStopping)
+        return nullptr;
+    foreach (auto task, mPendingList) {
+        if (!task->running)
+            return task;
+    }
+    return nullptr;
+}
+
+void ScoutQueue::_startWorkers()
+{
+    // the current task takes one of the parallel slots
+    while (mWorkers.count() < mParallelTasks-1)
+        mWorkers.append(new ScoutQueueWorker(this));
+    for (int i=0; i<mWorkers.count() && i<mParallelTasks-1; i++) {
+        if (!mWorkers.at(i)->isRunning() && _nextPendingTask() != nullptr)
+            mWorkers.at(i)->start();
+    }
+}
+
+void ScoutQueue::_runWorker()
+{
+    SxCluster *cluster = nullptr;
+    forever {
+        QMutexLocker locker(&mMutex);
+        ScoutTask *task = _nextPendingTask();
+        if (task == nullptr)
+            break;
+        if (cluster == nullptr) {
+            // the cluster has to live in the worker thread
+            locker.unlock();
+            cluster = _initializeCluster();
+            if (cluster == nullptr)
+                return;
+            continue;
+        }
+        task->running = true;
+        task->cluster = cluster;
+        locker.unlock();
+        QString errorMessage;
+        _runTask(cluster, task, errorMessage);
+        locker.relock();
+        task->cluster = nullptr;
+        if (task->cancelled) {
+            delete task;
+            continue;
+        }
+        if (task == mCurrentTask) {
+            // meanwhile it became the current task, executeTask waits for the result
+            task->transferError = errorMessage;
+            task->finished = true;
+            mTaskFinished.wakeAll();
+            continue;
+        }
+        task->running = false;
+        task->currentFile.clear();
+        task->currentFileProgress = 0;
+        int index = mPendingList.indexOf(task);
+        beginRemoveRows(mTasksIndex, index, index);
+        mPendingList.removeAt(index);
+        endRemoveRows();
+        if (errorMessage.isEmpty()) {
+            mCompletedSize += task->size;
+            delete task;
+        }
+        else {
+            task->error = errorMessage;
+            task->progress = 0;
+            int failedIndex = mPendingList.count()+mFailedTasks.count();
+            beginInsertRows(mTasksIndex, failedIndex, failedIndex);
+            mFailedTasks.append(task);
+            endInsertRows();
+            locker.unlock();
+            emit sigShowWarning(true);
+        }
+    }
+    SxClusterPool::instance().release(cluster);
+}
+
 QModelIndex ScoutQueue::index(int row, int column, const QModelIndex &parent) const
 {
     if (parent == mTasksIndex)
@@ -462,6 +721,23 @@ ScoutTask::ScoutTask(bool upload, const QString &title, const QString &volume, c
     this->localPath = localPath;
     this->remotePath = remotePath;
     this->size = 0;
+    this->currentFileSize = 0;
+    this->currentFileProgress = 0;
+    this->progress = 0;
+    this->cluster = nullptr;
+    this->running = false;
+    this->finished = false;
+    this->cancelled = false;
+}
+
+ScoutQueueWorker::ScoutQueueWorker(ScoutQueue *queue) : QThread()
+{
+    mQueue = queue;
+}
+
+void ScoutQueueWorker::run()
+{
+    mQueue->_runWorker();
 }
 
 ScoutTask::~ScoutTask()
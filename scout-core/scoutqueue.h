@@ -32,7 +32,9 @@
 #include <QAbstractItemModel>
 #include <QObject>
 #include <QMutex>
+#include <QThread>
 #include <QVariant>
+#include <QWaitCondition>
 #include "sxcluster.h"
 #include "clusterconfig.h"
 
@@ -46,9 +48,38 @@ struct ScoutTask {
     QString rev;
     qint64 size;
     QList<QPair<QString, qint64>> files;
+    // remote directories listed page by page while their files are downloaded
+    QStringList pendingDirs;
+    QString listedAfter;
     QString title;
     QString error;
     QList<QFile*> tmpFileList;
+    QString currentFile;
+    qint64 currentFileSize;
+    qint64 currentFileProgress;
+    qint64 progress;
+    // set while the task is transferred
+    SxCluster *cluster;
+    bool running;
+    bool finished;
+    bool cancelled;
+    QString transferError;
+};
+
+class ScoutQueue;
+
+/* Transfers pending tasks next to the current one, with its own cluster connection */
+class ScoutQueueWorker : public QThread
+{
+    Q_OBJECT
+public:
+    explicit ScoutQueueWorker(ScoutQueue *queue);
+
+protected:
+    void run() override;
+
+private:
+    ScoutQueue *mQueue;
 };
 
 class ScoutQueue : public QAbstractItemModel
@@ -56,6 +87,8 @@ class ScoutQueue : public QAbstractItemModel
     Q_OBJECT
 public:
     explicit ScoutQueue(ClusterConfig *config, QObject *parent = 0);
+    ~ScoutQueue();
+    void setParallelTasks(int parallelTasks);
     void appendTask(ScoutTask *task);
     QVariant currentTaskData(int role) const;
     QVariant pendingTaskData(int index, int role) const;
@@ -86,19 +119,32 @@ signals:
 private slots:
     void executeTask();
 
+private:
+    bool _runTask(SxCluster *cluster, ScoutTask *task, QString &errorMessage);
+    bool _listNextPage(SxCluster *cluster, SxVolume *volume, ScoutTask *task, QString &errorMessage);
+    void _runWorker();
+    void _startWorkers();
+    ScoutTask *_nextPendingTask() const;
+    SxCluster *_initializeCluster();
+
 private:
     const QModelIndex mCurrentTaskIndex = createIndex(1, 0);
     const QModelIndex mTasksIndex = createIndex(2, 0);
     mutable QMutex mMutex;
+    QWaitCondition mTaskFinished;
     ScoutTask *mCurrentTask;
     SxCluster *mCluster;
-    QString mCurrentFile;
-    qint64 mCurrentFileSize;
-    qint64 mCurrentFileProgress;
-    qint64 mCurrentTaskProgress;
+    // size of the tasks finished since the queue started, the progress covers all of them
+    qint64 mCompletedSize;
     QList<ScoutTask *> mPendingList;
     QList<ScoutTask *> mFailedTasks;
     ClusterConfig *mClusterConfig;
+    QList<ScoutQueueWorker *> mWorkers;
+    int mParallelTasks;
+    bool mStopping;
+    static const int sDownloadListPage = 1000;
+
+    friend class ScoutQueueWorker;
 
     // QAbstractItemModel interface
 public:
@@ -0,0 +1,152 @@
+/*
+ *  Copyright (C) 2012-2016 Skylable Ltd. <info-copyright@skylable.com>
+ *
+ *  This program is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public License
+ *  as published by the Free Software Foundation; either version 2
+ *  of the License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA.
+ *
+ *  Special exception for linking this software with OpenSSL:
+ *
+ *  In addition, as a special exception, Skylable Ltd. gives permission to
+ *  link the code of this program with the OpenSSL library and distribute
+ *  linked combinations including the two. You must obey the GNU General
+ *  Public License in all respects for all of the code used other than
+ *  OpenSSL. You may extend this exception to your version of the program,
+ *  but you are not obligated to do so. If you do not wish to do so, delete
+ *  this exception statement from your version.
+ */
+
+#include "scoutsearchindex.h"
+#include <algorithm>
+
+static const int sGramLength = 3;
+
+ScoutSearchIndex::ScoutSearchIndex()
+{
+    mRemoved = 0;
+}
+
+void ScoutSearchIndex::clear()
+{
+    mPaths.clear();
+    mNames.clear();
+    mIds.clear();
+    mGrams.clear();
+    mRemoved = 0;
+}
+
+QString ScoutSearchIndex::_name(const QString &path)
+{
+    int end = path.endsWith('/') ? path.length()-1 : path.length();
+    int start = path.lastIndexOf('/', end-1)+1;
+    return path.mid(start, end-start).toLower();
+}
+
+quint64 ScoutSearchIndex::_gram(const QString &text, int index)
+{
+    return (static_cast<quint64>(text.at(index).unicode()) << 32)
+            | (static_cast<quint64>(text.at(index+1).unicode()) << 16)
+            | static_cast<quint64>(text.at(index+2).unicode());
+}
+
+void ScoutSearchIndex::insert(const QString &path)
+{
+    if (mIds.contains(path))
+        return;
+    QString name = _name(path);
+    if (name.isEmpty() || name == ".sxnewdir")
+        return;
+    int id = mPaths.count();
+    mPaths.append(path);
+    mNames.append(name);
+    mIds.insert(path, id);
+    for (int i=0; i+sGramLength<=name.length(); i++) {
+        QVector<int> &ids = mGrams[_gram(name, i)];
+        // a trigram repeated in the same name is listed once
+        if (ids.isEmpty() || ids.last() != id)
+            ids.append(id);
+    }
+}
+
+void ScoutSearchIndex::remove(const QString &path)
+{
+    auto it = mIds.find(path);
+    if (it == mIds.end())
+        return;
+    mPaths[it.value()].clear();
+    mNames[it.value()].clear();
+    mIds.erase(it);
+    ++mRemoved;
+    if (mRemoved > mPaths.count()/2)
+        _compact();
+}
+
+bool ScoutSearchIndex::contains(const QString &path) const
+{
+    return mIds.contains(path);
+}
+
+int ScoutSearchIndex::count() const
+{
+    return mIds.count();
+}
+
+void ScoutSearchIndex::_compact()
+{
+    QVector<QString> paths;
+    paths.swap(mPaths);
+    clear();
+    foreach (auto path, paths) {
+        if (!path.isEmpty())
+            insert(path);
+    }
+}
+
+QStringList ScoutSearchIndex::find(const QString &text, int limit) const
+{
+    QStringList result;
+    QString needle = text.toLower();
+    if (needle.isEmpty() || limit <= 0)
+        return result;
+
+    auto match = [&](int id) {
+        const QString &name = mNames.at(id);
+        if (!name.isEmpty() && name.contains(needle))
+            result.append(mPaths.at(id));
+        return result.count() < limit;
+    };
+
+    if (needle.length() < sGramLength) {
+        for (int id=0; id<mNames.count(); id++) {
+            if (!match(id))
+                break;
+        }
+    }
+    else {
+        // the rarest trigram of the query narrows the candidates, the rest is checked on the name
+        const QVector<int> *candidates = nullptr;
+        for (int i=0; i+sGramLength<=needle.length(); i++) {
+            auto it = mGrams.constFind(_gram(needle, i));
+            if (it == mGrams.constEnd())
+                return result;
+            if (candidates == nullptr || it->count() < candidates->count())
+                candidates = &it.value();
+        }
+        foreach (int id, *candidates) {
+            if (!match(id))
+                break;
+        }
+    }
+    std::sort(result.begin(), result.end());
+    return result;
+}
@@ -0,0 +1,193 @@
+/*
+ *  Copyright (C) 2012-2016 Skylable Ltd. <info-copyright@skylable.com>
+ *
+ *  This program is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public License
+ *  as published by the Free Software Foundation; either version 2
+ *  of the License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA.
+ *
+ *  Special exception for linking this software with OpenSSL:
+ *
+ *  In addition, as a special exception, Skylable Ltd. gives permission to
+ *  link the code of this program with the OpenSSL library and distribute
+ *  linked combinations including the two. You must obey the GNU General
+ *  Public License in all respects for all of the code used other than
+ *  OpenSSL. You may extend this exception to your version of the program,
+ *  but you are not obligated to do so. If you do not wish to do so, delete
+ *  this exception statement from your version.
+ */
+
+#include "winstream.h"
+#include "sxrangereader.h"
+#include "sxlog.h"
+#include <cstring>
+
+WinStream::WinStream(SxCluster *cluster, SxVolume *volume, const QString &path, qint64 size)
+{
+    mRefCounter = 1;
+    mReader.reset(new SxRangeReader(cluster, volume, path));
+    mName = path.mid(path.lastIndexOf('/')+1);
+    mSize = size;
+    mPosition = 0;
+}
+
+WinStream::~WinStream()
+{
+}
+
+HRESULT WinStream::QueryInterface(const IID &riid, void **ppvObject)
+{
+    if (ppvObject == nullptr)
+        return E_POINTER;
+    if (IsEqualIID(riid, IID_IUnknown) || IsEqualIID(riid, IID_ISequentialStream) || IsEqualIID(riid, IID_IStream)) {
+        AddRef();
+        *ppvObject = this;
+        return S_OK;
+    }
+    *ppvObject = nullptr;
+    return E_NOINTERFACE;
+}
+
+ULONG WinStream::AddRef()
+{
+    ++mRefCounter;
+    return mRefCounter;
+}
+
+ULONG WinStream::Release()
+{
+    --mRefCounter;
+    if (mRefCounter == 0) {
+        delete this;
+        return 0;
+    }
+    return mRefCounter;
+}
+
+HRESULT WinStream::Read(void *pv, ULONG cb, ULONG *pcbRead)
+{
+    if (pcbRead)
+        *pcbRead = 0;
+    if (pv == nullptr)
+        return STG_E_INVALIDPOINTER;
+    QByteArray data;
+    if (!mReader->read(mPosition, cb, data)) {
+        logWarning(QString("reading %1 failed: %2").arg(mName).arg(mReader->lastError().errorMessage()));
+        return STG_E_READFAULT;
+    }
+    // the listing size may be stale, the opened file knows better
+    mSize = mReader->size();
+    memcpy(pv, data.constData(), static_cast<size_t>(data.size()));
+    mPosition += data.size();
+    if (pcbRead)
+        *pcbRead = static_cast<ULONG>(data.size());
+    return static_cast<ULONG>(data.size()) < cb ? S_FALSE : S_OK;
+}
+
+HRESULT WinStream::Write(const void *pv, ULONG cb, ULONG *pcbWritten)
+{
+    Q_UNUSED(pv);
+    Q_UNUSED(cb);
+    Q_UNUSED(pcbWritten);
+    return STG_E_ACCESSDENIED;
+}
+
+HRESULT WinStream::Seek(LARGE_INTEGER dlibMove, DWORD dwOrigin, ULARGE_INTEGER *plibNewPosition)
+{
+    qint64 position;
+    switch (dwOrigin) {
+    case STREAM_SEEK_SET:
+        position = dlibMove.QuadPart;
+        break;
+    case STREAM_SEEK_CUR:
+        position = mPosition + dlibMove.QuadPart;
+        break;
+    case STREAM_SEEK_END:
+        position = mSize + dlibMove.QuadPart;
+        break;
+    default:
+        return STG_E_INVALIDFUNCTION;
+    }
+    if (position < 0)
+        return STG_E_INVALIDFUNCTION;
+    mPosition = position;
+    if (plibNewPosition)
+        plibNewPosition->QuadPart = static_cast<ULONGLONG>(mPosition);
+    return S_OK;
+}
+
+HRESULT WinStream::SetSize(ULARGE_INTEGER libNewSize)
+{
+    Q_UNUSED(libNewSize);
+    return STG_E_ACCESSDENIED;
+}
+
+HRESULT WinStream::CopyTo(IStream *pstm, ULARGE_INTEGER cb, ULARGE_INTEGER *pcbRead, ULARGE_INTEGER *pcbWritten)
+{
+    Q_UNUSED(pstm);
+    Q_UNUSED(cb);
+    Q_UNUSED(pcbRead);
+    Q_UNUSED(pcbWritten);
+    return E_NOTIMPL;
+}
+
+HRESULT WinStream::Commit(DWORD grfCommitFlags)
+{
+    Q_UNUSED(grfCommitFlags);
+    return S_OK;
+}
+
+HRESULT WinStream::Revert()
+{
+    return S_OK;
+}
+
+HRESULT WinStream::LockRegion(ULARGE_INTEGER libOffset, ULARGE_INTEGER cb, DWORD dwLockType)
+{
+    Q_UNUSED(libOffset);
+    Q_UNUSED(cb);
+    Q_UNUSED(dwLockType);
+    return STG_E_INVALIDFUNCTION;
+}
+
+HRESULT WinStream::UnlockRegion(ULARGE_INTEGER libOffset, ULARGE_INTEGER cb, DWORD dwLockType)
+{
+    Q_UNUSED(libOffset);
+    Q_UNUSED(cb);
+    Q_UNUSED(dwLockType);
+    return STG_E_INVALIDFUNCTION;
+}
+
+HRESULT WinStream::Stat(STATSTG *pstatstg, DWORD grfStatFlag)
+{
+    if (pstatstg == nullptr)
+        return STG_E_INVALIDPOINTER;
+    ZeroMemory(pstatstg, sizeof(STATSTG));
+    if (!(grfStatFlag & STATFLAG_NONAME)) {
+        std::wstring name = mName.toStdWString();
+        size_t bytes = (name.size()+1)*sizeof(wchar_t);
+        pstatstg->pwcsName = static_cast<LPOLESTR>(CoTaskMemAlloc(bytes));
+        if (pstatstg->pwcsName == nullptr)
+            return STG_E_INSUFFICIENTMEMORY;
+        memcpy(pstatstg->pwcsName, name.c_str(), bytes);
+    }
+    pstatstg->type = STGTY_STREAM;
+    pstatstg->cbSize.QuadPart = static_cast<ULONGLONG>(mSize);
+    pstatstg->grfMode = STGM_READ;
+    return S_OK;
+}
+
+HRESULT WinStream::Clone(IStream **ppstm)
+{
+    Q_UNUSED(ppstm);
+    return E_NOTIMPL;
+}
@@ -4,19 +4,23 @@
 #
 #-------------------------------------------------
 
-QT += network core
+QT += network core concurrent
 QT -= gui
 
 TARGET = sx-api
 TEMPLATE = lib
 CONFIG += staticlib c++11
 CONFIG += debug_and_release
+# Entry and Debug log lines are compiled out of release builds
+CONFIG(release, debug|release): DEFINES += SXLOG_MIN_LEVEL=2
 DEFINES += LIB_LIBRARY
 QMAKE_MAC_SDK = macosx10.11
 
 SOURCES += \
     sxcluster.cpp \
+    sxclusterpool.cpp \
     sxquery.cpp \
+    sxrangereader.cpp \
     sxauth.cpp \
     sxqueryresult.cpp \
     sxmeta.cpp \
@@ -25,15 +29,42 @@ SOURCES += \
     sxfile.cpp \
     sxfileentry.cpp \
     sxblock.cpp \
+    sxblocklist.cpp \
+    sxblockcache.cpp \
+    sxsyncblocks.cpp \
+    sxinflightblocks.cpp \
+    sxblockreader.cpp \
+    sxblockwriter.cpp \
+    sxbufferpool.cpp \
+    sxcanceltoken.cpp \
+    sxdownloadplan.cpp \
+    sxrevisioncache.cpp \
+    sxmappedfile.cpp \
+    sxjsonscanner.cpp \
+    sxlistingreader.cpp \
+    sxfiledatareader.cpp \
+    sxbandwidthlimiter.cpp \
+    sxbandwidthshare.cpp \
     sxjob.cpp \
     sxfilter/fake_sx.cpp \
     sxfilter/fake_misc.c \
     sxfilter/filter_aes256.c \
     sxfilter/filter_aes256_new.c \
+    sxfilter/filter_zcomp.c \
     sxfilter.cpp \
+    sxfilterstream.cpp \
+    sxnamecache.cpp \
     sxfilter/crypt_blowfish.c \
     xfile.cpp \
     sxlog.cpp \
+    sxtrace.cpp \
+    sxmetrics.cpp \
+    sxcensus.cpp \
+    sxsyncrecorder.cpp \
+    sxnodehealth.cpp \
+    sxresolver.cpp \
+    sxprofiler.cpp \
+    sxbootstrapcache.cpp \
     volumeconfigwatcher.cpp \
     sxurl.cpp \
     sxerror.cpp \
@@ -42,7 +73,9 @@ SOURCES += \
 
 HEADERS += \
     sxcluster.h \
+    sxclusterpool.h \
     sxquery.h \
+    sxrangereader.h \
     sxauth.h \
     sxqueryresult.h \
     sxmeta.h \
@@ -51,15 +84,43 @@ HEADERS += \
     sxfile.h \
     sxfileentry.h \
     sxblock.h \
+    sxblocklist.h \
+    sxblockcache.h \
+    sxsyncblocks.h \
+    sxinflightblocks.h \
+    sxblockreader.h \
+    sxblockwriter.h \
+    sxbufferpool.h \
+    sxcanceltoken.h \
+    sxdownloadplan.h \
+    sxrevisioncache.h \
+    sxmappedfile.h \
+    sxjsonscanner.h \
+    sxlistingreader.h \
+    sxfiledatareader.h \
+    sxbandwidthlimiter.h \
+    sxbandwidthshare.h \
     sxjob.h \
+    sxuploadstate.h \
     sxfilter/fake_misc.h \
     sxfilter/fake_sx.h \
     sxfilter/filter_aes256.h \
+    sxfilter/filter_zcomp.h \
     sxfilter.h \
+    sxfilterstream.h \
+    sxnamecache.h \
     sxfilter/crypt_blowfish.h \
     sxfilter/sx_input_args.h \
     xfile.h \
     sxlog.h \
+    sxtrace.h \
+    sxmetrics.h \
+    sxcensus.h \
+    sxsyncrecorder.h \
+    sxnodehealth.h \
+    sxresolver.h \
+    sxprofiler.h \
+    sxbootstrapcache.h \
     volumeconfigwatcher.h \
     sxurl.h \
     sxerror.h \
@@ -74,6 +135,8 @@ unix {
 win32 {
     INCLUDEPATH += $$PWD/../3rdparty/openssl-win32/include
     DEPENDPATH += $$PWD/../3rdparty/openssl-win32/include
+    # zcomp uses the zlib bundled with and exported by QtCore
+    INCLUDEPATH += $$[QT_INSTALL_HEADERS]/QtZlib
 }
 macx {
     INCLUDEPATH += $$PWD/../3rdparty/openssl-osx/include
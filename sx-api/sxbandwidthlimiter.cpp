@@ -0,0 +1,90 @@
+/*
+ *  Copyright (C) 2012-2016 Skylable Ltd. <info-copyright@skylable.com>
+ *
+ *  This program is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public License
+ *  as published by the Free Software Foundation; either version 2
+ *  of the License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA.
+ *
+ *  Special exception for linking this software with OpenSSL:
+ *
+ *  In addition, as a special exception, Skylable Ltd. gives permission to
+ *  link the code of this program with the OpenSSL library and distribute
+ *  linked combinations including the two. You must obey the GNU General
+ *  Public License in all respects for all of the code used other than
+ *  OpenSSL. You may extend this exception to your version of the program,
+ *  but you are not obligated to do so. If you do not wish to do so, delete
+ *  this exception statement from your version.
+ */
+
+#include "sxbandwidthlimiter.h"
+#include "sxbandwidthshare.h"
+
+SxBandwidthLimiter::SxBandwidthLimiter()
+{
+    mRate = 0;
+    mTokens = 0;
+    mLastRefill = QDateTime::currentDateTime();
+}
+
+SxBandwidthLimiter::~SxBandwidthLimiter()
+{
+}
+
+void SxBandwidthLimiter::setRate(qint64 bytesPerSecond)
+{
+    QMutexLocker locker(&mMutex);
+    if (bytesPerSecond < 0)
+        bytesPerSecond = 0;
+    if (mRate == bytesPerSecond)
+        return;
+    mRate = bytesPerSecond;
+    mTokens = qMin(mTokens, static_cast<double>(mRate));
+    mLastRefill = QDateTime::currentDateTime();
+}
+
+/* limiters with the same key divide their rate by the number of them transferring
+ * at the moment, an empty key makes the limit local again */
+void SxBandwidthLimiter::setShareKey(const QString &key)
+{
+    QMutexLocker locker(&mMutex);
+    if (key.isEmpty())
+        mShare.reset();
+    else if (!mShare || mShare->key() != key)
+        mShare.reset(new SxBandwidthShare(key));
+}
+
+qint64 SxBandwidthLimiter::rate() const
+{
+    QMutexLocker locker(&mMutex);
+    return mRate;
+}
+
+/* Takes bytes from the bucket and returns how long (in ms) the caller has to wait
+ * before sending them. The bucket holds at most one second worth of tokens, bigger
+ * requests go into debt which is paid by the requests that follow. */
+int SxBandwidthLimiter::reserve(qint64 bytes)
+{
+    QMutexLocker locker(&mMutex);
+    if (mRate <= 0 || bytes <= 0)
+        return 0;
+    qint64 rate = mShare ? mRate / mShare->activeCount() : mRate;
+    if (rate <= 0)
+        rate = 1;
+    QDateTime now = QDateTime::currentDateTime();
+    mTokens = qMin(mTokens + rate * mLastRefill.msecsTo(now) / 1000.0, static_cast<double>(rate));
+    mLastRefill = now;
+    mTokens -= bytes;
+    if (mTokens >= 0)
+        return 0;
+    return static_cast<int>(qMin(-mTokens * 1000 / rate, 60000.0));
+}
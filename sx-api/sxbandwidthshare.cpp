@@ -0,0 +1,115 @@
+/*
+ *  Copyright (C) 2012-2016 Skylable Ltd. <info-copyright@skylable.com>
+ *
+ *  This program is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public License
+ *  as published by the Free Software Foundation; either version 2
+ *  of the License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA.
+ *
+ *  Special exception for linking this software with OpenSSL:
+ *
+ *  In addition, as a special exception, Skylable Ltd. gives permission to
+ *  link the code of this program with the OpenSSL library and distribute
+ *  linked combinations including the two. You must obey the GNU General
+ *  Public License in all respects for all of the code used other than
+ *  OpenSSL. You may extend this exception to your version of the program,
+ *  but you are not obligated to do so. If you do not wish to do so, delete
+ *  this exception statement from your version.
+ */
+
+#include "sxbandwidthshare.h"
+#include "sxlog.h"
+
+#include <QAtomicInt>
+#include <QCoreApplication>
+#include <QDateTime>
+#include <cstring>
+
+SxBandwidthShare::SxBandwidthShare(const QString &key)
+    : mKey(key), mMemory(key)
+{
+    static QAtomicInt sCounter;
+    mOwner = (static_cast<quint64>(QCoreApplication::applicationPid()) << 16) | (static_cast<quint64>(sCounter.fetchAndAddRelaxed(1)) & 0xffff);
+    if (mOwner == 0)
+        mOwner = 1;
+    mSlot = -1;
+    mCount = 1;
+    mLastRefresh = 0;
+}
+
+SxBandwidthShare::~SxBandwidthShare()
+{
+    if (mSlot < 0 || !mMemory.isAttached() || !mMemory.lock())
+        return;
+    Slot *slots = static_cast<Slot*>(mMemory.data());
+    if (slots[mSlot].owner == mOwner)
+        slots[mSlot].owner = 0;
+    mMemory.unlock();
+}
+
+QString SxBandwidthShare::key() const
+{
+    return mKey;
+}
+
+bool SxBandwidthShare::_attach()
+{
+    if (mMemory.isAttached())
+        return true;
+    if (mMemory.attach())
+        return true;
+    if (mMemory.create(sSlots*static_cast<int>(sizeof(Slot)))) {
+        if (mMemory.lock()) {
+            memset(mMemory.data(), 0, sSlots*sizeof(Slot));
+            mMemory.unlock();
+        }
+        return true;
+    }
+    if (mMemory.error() == QSharedMemory::AlreadyExists && mMemory.attach())
+        return true;
+    logWarning(QString("bandwidth share %1 unavailable: %2").arg(mKey).arg(mMemory.errorString()));
+    return false;
+}
+
+/* marks this participant active and returns how many are active, never less than one;
+ * the shared table is looked at no more than twice a second */
+int SxBandwidthShare::activeCount()
+{
+    qint64 now = QDateTime::currentMSecsSinceEpoch();
+    if (mLastRefresh != 0 && now - mLastRefresh < sRefreshInterval)
+        return mCount;
+    mLastRefresh = now;
+    if (!_attach() || !mMemory.lock())
+        return mCount;
+    Slot *slots = static_cast<Slot*>(mMemory.data());
+    if (mSlot < 0 || slots[mSlot].owner != mOwner) {
+        // slots of participants idle for a while are taken over, whether they still run or not
+        mSlot = -1;
+        for (int i=0; i<sSlots; i++) {
+            if (slots[i].owner == 0 || now - slots[i].lastActive > sActiveWindow) {
+                slots[i].owner = mOwner;
+                mSlot = i;
+                break;
+            }
+        }
+    }
+    if (mSlot >= 0)
+        slots[mSlot].lastActive = now;
+    int count = 0;
+    for (int i=0; i<sSlots; i++) {
+        if (slots[i].owner != 0 && now - slots[i].lastActive <= sActiveWindow)
+            count++;
+    }
+    mMemory.unlock();
+    mCount = count > 0 ? count : 1;
+    return mCount;
+}
@@ -0,0 +1,66 @@
+/*
+ *  Copyright (C) 2012-2016 Skylable Ltd. <info-copyright@skylable.com>
+ *
+ *  This program is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public License
+ *  as published by the Free Software Foundation; either version 2
+ *  of the License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA.
+ *
+ *  Special exception for linking this software with OpenSSL:
+ *
+ *  In addition, as a special exception, Skylable Ltd. gives permission to
+ *  link the code of this program with the OpenSSL library and distribute
+ *  linked combinations including the two. You must obey the GNU General
+ *  Public License in all respects for all of the code used other than
+ *  OpenSSL. You may extend this exception to your version of the program,
+ *  but you are not obligated to do so. If you do not wish to do so, delete
+ *  this exception statement from your version.
+ */
+
+#ifndef SXBANDWIDTHSHARE_H
+#define SXBANDWIDTHSHARE_H
+
+#include <QSharedMemory>
+#include <QString>
+
+/* Splits a bandwidth limit between everyone transferring to the same cluster at the same
+ * time: other profiles running as separate processes, Scout and the extra connections of
+ * this process. Participants register in a small shared memory table and count the ones
+ * that were active during the last seconds */
+class SxBandwidthShare
+{
+public:
+    SxBandwidthShare(const QString &key);
+    ~SxBandwidthShare();
+    SxBandwidthShare(const SxBandwidthShare &) = delete;
+    SxBandwidthShare &operator= (const SxBandwidthShare &) = delete;
+    QString key() const;
+    int activeCount();
+
+private:
+    bool _attach();
+    struct Slot {
+        quint64 owner;
+        qint64 lastActive;
+    };
+    static const int sSlots = 32;
+    static const qint64 sActiveWindow = 2000;
+    static const qint64 sRefreshInterval = 500;
+    QString mKey;
+    QSharedMemory mMemory;
+    quint64 mOwner;
+    int mSlot;
+    int mCount;
+    qint64 mLastRefresh;
+};
+
+#endif // SXBANDWIDTHSHARE_H
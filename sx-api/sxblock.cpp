@@ -27,25 +27,199 @@
  */
 
 #include "sxblock.h"
+#include "sxmetrics.h"
 
-#include <QCryptographicHash>
+#include <openssl/sha.h>
+#include <cstring>
+#include <QElapsedTimer>
+#include <QHash>
+#include <QMutex>
 
-SxBlock::SxBlock(const QString &hash)
+SxBlock::SxBlock(const QString &hash) : mCensus(sizeof(SxBlock))
 {
     mHash = hash;
 }
 
-SxBlock::SxBlock(const QString &hash, const QByteArray &data, const QStringList &nodeList)
+SxBlock::SxBlock(const QString &hash, const QByteArray &data, const QStringList &nodeList) : mCensus(sizeof(SxBlock)+data.size())
 {
     mHash = hash;
     mData = data;
     mNodeList = nodeList;
 }
 
+static inline quint64 checksumRound(quint64 acc, quint64 word)
+{
+    static const quint64 sPrime1 = Q_UINT64_C(0x9e3779b185ebca87);
+    static const quint64 sPrime2 = Q_UINT64_C(0xc2b2ae3d27d4eb4f);
+    acc += word * sPrime2;
+    acc = (acc << 31) | (acc >> 33);
+    return acc * sPrime1;
+}
+
+static inline quint64 checksumData(const char *data, int size)
+{
+    // weak checksum, only used to tell which blocks changed since their hash was computed
+    quint64 lanes[4] = {Q_UINT64_C(0x60ea27eeadc0b5d6), Q_UINT64_C(0xc2b2ae3d27d4eb4f), 0, Q_UINT64_C(0x61c8864e7a143579)};
+    int i = 0;
+    for (; i+32 <= size; i+=32) {
+        quint64 words[4];
+        memcpy(words, data+i, sizeof(words));
+        lanes[0] = checksumRound(lanes[0], words[0]);
+        lanes[1] = checksumRound(lanes[1], words[1]);
+        lanes[2] = checksumRound(lanes[2], words[2]);
+        lanes[3] = checksumRound(lanes[3], words[3]);
+    }
+    quint64 result = static_cast<quint64>(size);
+    for (int l=0; l<4; l++)
+        result = checksumRound(result ^ checksumRound(0, lanes[l]), static_cast<quint64>(l));
+    for (; i < size; i++)
+        result = checksumRound(result, static_cast<unsigned char>(data[i]));
+    result ^= result >> 33;
+    result *= Q_UINT64_C(0xc2b2ae3d27d4eb4f);
+    result ^= result >> 29;
+    return result;
+}
+
+static inline bool isZeroData(const char *data, int size)
+{
+    // 64 bytes per round with no branches inside, the compiler turns it into vector ors
+    int i = 0;
+    for (; i+64 <= size; i+=64) {
+        quint64 words[8];
+        memcpy(words, data+i, sizeof(words));
+        if ((words[0] | words[1] | words[2] | words[3] | words[4] | words[5] | words[6] | words[7]) != 0)
+            return false;
+    }
+    for (; i < size; i++) {
+        if (data[i])
+            return false;
+    }
+    return true;
+}
+
+/* the kernels are instantiated for the 4k, 16k and 1M blocks an SX cluster
+ * hands out, with the size known at compile time the tails vanish and the
+ * loops get unrolled */
+template <int Size>
+static bool isZeroFixed(const char *data, int)
+{
+    return isZeroData(data, Size);
+}
+
+template <int Size>
+static quint64 checksumFixed(const char *data, int)
+{
+    return checksumData(data, Size);
+}
+
+static bool isZeroAny(const char *data, int size)
+{
+    return isZeroData(data, size);
+}
+
+static quint64 checksumAny(const char *data, int size)
+{
+    return checksumData(data, size);
+}
+
+struct BlockKernels {
+    int size;
+    bool (*isZero)(const char *, int);
+    quint64 (*checksum)(const char *, int);
+};
+
+static const BlockKernels sBlockKernels[] = {
+    {4096, isZeroFixed<4096>, checksumFixed<4096>},
+    {16384, isZeroFixed<16384>, checksumFixed<16384>},
+    {1048576, isZeroFixed<1048576>, checksumFixed<1048576>}
+};
+
+static const BlockKernels sGenericKernels = {0, isZeroAny, checksumAny};
+
+static const BlockKernels &blockKernels(int size)
+{
+    for (const BlockKernels &kernels : sBlockKernels) {
+        if (kernels.size == size)
+            return kernels;
+    }
+    return sGenericKernels;
+}
+
 QByteArray SxBlock::hashBlock(const QByteArray& data, const QByteArray& salt) {
-    QCryptographicHash sha1(QCryptographicHash::Sha1);
-    if(!salt.isEmpty())
-        sha1.addData(salt);
-    sha1.addData(data);
-    return sha1.result().toHex();
+    return hashBlock(data.constData(), data.size(), salt);
+}
+
+QByteArray SxBlock::hashBlock(const char *data, int size, const QByteArray &salt)
+{
+    if (isZeroBlock(data, size))
+        return zeroBlockHash(size, salt);
+    SHA_CTX ctx;
+    unsigned char digest[SHA_DIGEST_LENGTH];
+    SHA1_Init(&ctx);
+    if (!salt.isEmpty())
+        SHA1_Update(&ctx, salt.constData(), static_cast<size_t>(salt.size()));
+    SHA1_Update(&ctx, data, static_cast<size_t>(size));
+    SHA1_Final(digest, &ctx);
+    return QByteArray::fromRawData(reinterpret_cast<const char*>(digest), SHA_DIGEST_LENGTH).toHex();
+}
+
+QList<QByteArray> SxBlock::hashBlocks(const char *data, int blockCount, int blockSize, const QByteArray &salt)
+{
+    QElapsedTimer timer;
+    timer.start();
+    QList<QByteArray> result;
+    SHA_CTX saltCtx;
+    SHA1_Init(&saltCtx);
+    if (!salt.isEmpty())
+        SHA1_Update(&saltCtx, salt.constData(), static_cast<size_t>(salt.size()));
+    unsigned char digest[SHA_DIGEST_LENGTH];
+    QByteArray zeroHash;
+    const BlockKernels &kernels = blockKernels(blockSize);
+    for (int i=0; i<blockCount; i++) {
+        const char *block = data + static_cast<qint64>(i)*blockSize;
+        if (kernels.isZero(block, blockSize)) {
+            if (zeroHash.isEmpty())
+                zeroHash = zeroBlockHash(blockSize, salt);
+            result.append(zeroHash);
+            continue;
+        }
+        SHA_CTX ctx = saltCtx;
+        SHA1_Update(&ctx, block, static_cast<size_t>(blockSize));
+        SHA1_Final(digest, &ctx);
+        result.append(QByteArray::fromRawData(reinterpret_cast<const char*>(digest), SHA_DIGEST_LENGTH).toHex());
+    }
+    SxMetrics::instance().addHashing(static_cast<qint64>(blockCount)*blockSize, timer.nsecsElapsed());
+    return result;
+}
+
+quint64 SxBlock::checksumBlock(const char *data, int size)
+{
+    return blockKernels(size).checksum(data, size);
+}
+
+bool SxBlock::isZeroBlock(const char *data, int size)
+{
+    return blockKernels(size).isZero(data, size);
+}
+
+QByteArray SxBlock::zeroBlockHash(int size, const QByteArray &salt)
+{
+    static QMutex sMutex;
+    static QHash<QPair<QByteArray, int>, QByteArray> sCache;
+    QMutexLocker locker(&sMutex);
+    auto key = qMakePair(salt, size);
+    auto it = sCache.constFind(key);
+    if (it != sCache.constEnd())
+        return it.value();
+    QByteArray zeros(size, '\0');
+    SHA_CTX ctx;
+    unsigned char digest[SHA_DIGEST_LENGTH];
+    SHA1_Init(&ctx);
+    if (!salt.isEmpty())
+        SHA1_Update(&ctx, salt.constData(), static_cast<size_t>(salt.size()));
+    SHA1_Update(&ctx, zeros.constData(), static_cast<size_t>(size));
+    SHA1_Final(digest, &ctx);
+    QByteArray hash = QByteArray(reinterpret_cast<const char*>(digest), SHA_DIGEST_LENGTH).toHex();
+    sCache.insert(key, hash);
+    return hash;
 }
@@ -31,6 +31,7 @@
 
 #include <QObject>
 #include <QStringList>
+#include "sxcensus.h"
 
 class SxCluster;
 class SxFile;
@@ -41,10 +42,16 @@ public:
     SxBlock(const QString& hash);
     SxBlock(const QString& mHash, const QByteArray& mData, const QStringList& mNodeList);
     static QByteArray hashBlock(const QByteArray &data, const QByteArray &salt);
+    static QByteArray hashBlock(const char *data, int size, const QByteArray &salt);
+    static QList<QByteArray> hashBlocks(const char *data, int blockCount, int blockSize, const QByteArray &salt);
+    static quint64 checksumBlock(const char *data, int size);
+    static bool isZeroBlock(const char *data, int size);
+    static QByteArray zeroBlockHash(int size, const QByteArray &salt);
 private:
     QString mHash;
     QByteArray mData;
     QStringList mNodeList;
+    SxCensusEntry<SxCensus::Block> mCensus;
 
     friend class SxCluster;
     friend class SxFile;
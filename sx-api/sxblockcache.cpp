@@ -0,0 +1,177 @@
+/*
+ *  Copyright (C) 2012-2016 Skylable Ltd. <info-copyright@skylable.com>
+ *
+ *  This program is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public License
+ *  as published by the Free Software Foundation; either version 2
+ *  of the License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA.
+ *
+ *  Special exception for linking this software with OpenSSL:
+ *
+ *  In addition, as a special exception, Skylable Ltd. gives permission to
+ *  link the code of this program with the OpenSSL library and distribute
+ *  linked combinations including the two. You must obey the GNU General
+ *  Public License in all respects for all of the code used other than
+ *  OpenSSL. You may extend this exception to your version of the program,
+ *  but you are not obligated to do so. If you do not wish to do so, delete
+ *  this exception statement from your version.
+ */
+
+#include "sxblockcache.h"
+#include "sxlog.h"
+
+#include <QDir>
+#include <QDirIterator>
+#include <QFile>
+#include <QFileInfo>
+#include <algorithm>
+
+SxBlockCache &SxBlockCache::instance()
+{
+    static SxBlockCache sInstance;
+    return sInstance;
+}
+
+SxBlockCache::SxBlockCache()
+{
+    mSizeLimit = 0;
+    mSize = 0;
+    mUseCounter = 0;
+}
+
+void SxBlockCache::setDirectory(const QString &directory, qint64 sizeLimit)
+{
+    QMutexLocker locker(&mMutex);
+    mEntries.clear();
+    mSize = 0;
+    mSizeLimit = sizeLimit;
+    mDirectory = directory;
+    if (mDirectory.isEmpty() || sizeLimit <= 0) {
+        mDirectory.clear();
+        return;
+    }
+    if (!QDir(mDirectory).mkpath(".")) {
+        logWarning("unable to create block cache directory " + mDirectory);
+        mDirectory.clear();
+        return;
+    }
+    _load();
+    _evict();
+}
+
+bool SxBlockCache::enabled() const
+{
+    QMutexLocker locker(&mMutex);
+    return !mDirectory.isEmpty();
+}
+
+/* keys look like <blockSize>/<hash>, files are spread over 256 subdirectories */
+QString SxBlockCache::_path(const QString &key) const
+{
+    int index = key.indexOf('/');
+    return mDirectory + "/" + key.left(index) + "/" + key.mid(index+1, 2) + "/" + key.mid(index+1);
+}
+
+/* the order of blocks from an earlier run follows their modification time */
+void SxBlockCache::_load()
+{
+    QList<QPair<qint64, QString>> found;
+    QDirIterator it(mDirectory, QDir::Files, QDirIterator::Subdirectories);
+    while (it.hasNext()) {
+        it.next();
+        QFileInfo info = it.fileInfo();
+        QString blockSize = info.dir().absolutePath().section('/', -2, -2);
+        if (info.fileName().startsWith('.')) {
+            QFile::remove(info.absoluteFilePath());
+            continue;
+        }
+        QString key = blockSize + "/" + info.fileName();
+        found.append({info.lastModified().toMSecsSinceEpoch(), key});
+        mEntries.insert(key, {info.size(), 0});
+        mSize += info.size();
+    }
+    std::sort(found.begin(), found.end());
+    foreach (auto pair, found) {
+        mEntries[pair.second].lastUse = ++mUseCounter;
+    }
+    logVerbose(QString("block cache: %1 blocks, %2 bytes").arg(mEntries.count()).arg(mSize));
+}
+
+/* trims the cache to 90% of its limit so it isn't trimmed again on every new block */
+void SxBlockCache::_evict()
+{
+    if (mSize <= mSizeLimit)
+        return;
+    QList<QPair<qint64, QString>> order;
+    for (auto it = mEntries.constBegin(); it != mEntries.constEnd(); ++it) {
+        order.append({it.value().lastUse, it.key()});
+    }
+    std::sort(order.begin(), order.end());
+    const qint64 target = mSizeLimit / 10 * 9;
+    foreach (auto pair, order) {
+        if (mSize <= target)
+            break;
+        QFile::remove(_path(pair.second));
+        mSize -= mEntries.take(pair.second).size;
+    }
+}
+
+bool SxBlockCache::get(const QString &hash, int blockSize, QByteArray &data)
+{
+    QMutexLocker locker(&mMutex);
+    if (mDirectory.isEmpty())
+        return false;
+    QString key = QString::number(blockSize) + "/" + hash;
+    auto it = mEntries.find(key);
+    if (it == mEntries.end())
+        return false;
+    QFile file(_path(key));
+    if (!file.open(QIODevice::ReadOnly) || (data = file.read(blockSize)).size() != blockSize) {
+        mSize -= it.value().size;
+        mEntries.erase(it);
+        file.remove();
+        return false;
+    }
+    it.value().lastUse = ++mUseCounter;
+    return true;
+}
+
+void SxBlockCache::put(const QString &hash, int blockSize, const char *data)
+{
+    QMutexLocker locker(&mMutex);
+    if (mDirectory.isEmpty() || hash.size() < 2)
+        return;
+    QString key = QString::number(blockSize) + "/" + hash;
+    auto it = mEntries.find(key);
+    if (it != mEntries.end()) {
+        it.value().lastUse = ++mUseCounter;
+        return;
+    }
+    // written under a temporary name first, an interrupted write never looks like a block
+    QString path = _path(key);
+    QFileInfo info(path);
+    QString tmpPath = info.absolutePath() + "/." + info.fileName();
+    if (!QDir(info.absolutePath()).mkpath("."))
+        return;
+    QFile file(tmpPath);
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate))
+        return;
+    bool ok = file.write(data, blockSize) == blockSize;
+    file.close();
+    if (!ok || !QFile::rename(tmpPath, path)) {
+        QFile::remove(tmpPath);
+        return;
+    }
+    mEntries.insert(key, {blockSize, ++mUseCounter});
+    mSize += blockSize;
+    _evict();
+}
@@ -0,0 +1,68 @@
+/*
+ *  Copyright (C) 2012-2016 Skylable Ltd. <info-copyright@skylable.com>
+ *
+ *  This program is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public License
+ *  as published by the Free Software Foundation; either version 2
+ *  of the License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA.
+ *
+ *  Special exception for linking this software with OpenSSL:
+ *
+ *  In addition, as a special exception, Skylable Ltd. gives permission to
+ *  link the code of this program with the OpenSSL library and distribute
+ *  linked combinations including the two. You must obey the GNU General
+ *  Public License in all respects for all of the code used other than
+ *  OpenSSL. You may extend this exception to your version of the program,
+ *  but you are not obligated to do so. If you do not wish to do so, delete
+ *  this exception statement from your version.
+ */
+
+#ifndef SXBLOCKCACHE_H
+#define SXBLOCKCACHE_H
+
+#include <QByteArray>
+#include <QHash>
+#include <QMutex>
+#include <QString>
+
+/* Process wide on-disk cache of downloaded blocks, one file per block named after its
+ * salted hash. The total size is bounded, the least recently used blocks go first.
+ * Disabled until a directory is set */
+class SxBlockCache
+{
+public:
+    static SxBlockCache& instance();
+    SxBlockCache(const SxBlockCache &) = delete;
+    SxBlockCache &operator= (const SxBlockCache &) = delete;
+    void setDirectory(const QString &directory, qint64 sizeLimit);
+    bool enabled() const;
+    bool get(const QString &hash, int blockSize, QByteArray &data);
+    void put(const QString &hash, int blockSize, const char *data);
+
+private:
+    SxBlockCache();
+    QString _path(const QString &key) const;
+    void _load();
+    void _evict();
+    struct Entry {
+        qint64 size;
+        qint64 lastUse;
+    };
+    mutable QMutex mMutex;
+    QString mDirectory;
+    qint64 mSizeLimit;
+    qint64 mSize;
+    qint64 mUseCounter;
+    QHash<QString, Entry> mEntries;
+};
+
+#endif // SXBLOCKCACHE_H
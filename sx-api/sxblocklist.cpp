@@ -0,0 +1,100 @@
+/*
+ *  Copyright (C) 2012-2016 Skylable Ltd. <info-copyright@skylable.com>
+ *
+ *  This program is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public License
+ *  as published by the Free Software Foundation; either version 2
+ *  of the License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA.
+ *
+ *  Special exception for linking this software with OpenSSL:
+ *
+ *  In addition, as a special exception, Skylable Ltd. gives permission to
+ *  link the code of this program with the OpenSSL library and distribute
+ *  linked combinations including the two. You must obey the GNU General
+ *  Public License in all respects for all of the code used other than
+ *  OpenSSL. You may extend this exception to your version of the program,
+ *  but you are not obligated to do so. If you do not wish to do so, delete
+ *  this exception statement from your version.
+ */
+
+#include "sxblocklist.h"
+
+SxBlockList::SxBlockList()
+{
+}
+
+SxBlockList::SxBlockList(const QStringList &hashes)
+{
+    reserve(hashes.count());
+    foreach (const QString &hash, hashes) {
+        append(hash);
+    }
+}
+
+bool SxBlockList::append(const QString &hash)
+{
+    QByteArray digest = QByteArray::fromHex(hash.toLatin1());
+    if (hash.length() != 2*sDigestSize || digest.size() != sDigestSize)
+        return false;
+    mDigests.append(digest);
+    return true;
+}
+
+void SxBlockList::reserve(int count)
+{
+    mDigests.reserve(count*sDigestSize);
+}
+
+void SxBlockList::clear()
+{
+    mDigests.clear();
+}
+
+int SxBlockList::count() const
+{
+    return mDigests.size()/sDigestSize;
+}
+
+bool SxBlockList::isEmpty() const
+{
+    return mDigests.isEmpty();
+}
+
+QString SxBlockList::at(int index) const
+{
+    return QString::fromLatin1(digest(index).toHex());
+}
+
+QByteArray SxBlockList::digest(int index) const
+{
+    return mDigests.mid(index*sDigestSize, sDigestSize);
+}
+
+QStringList SxBlockList::toStringList() const
+{
+    QStringList result;
+    result.reserve(count());
+    for (int i=0; i<count(); i++) {
+        result.append(at(i));
+    }
+    return result;
+}
+
+bool SxBlockList::operator==(const SxBlockList &other) const
+{
+    return mDigests == other.mDigests;
+}
+
+bool SxBlockList::operator!=(const SxBlockList &other) const
+{
+    return mDigests != other.mDigests;
+}
@@ -0,0 +1,214 @@
+/*
+ *  Copyright (C) 2012-2016 Skylable Ltd. <info-copyright@skylable.com>
+ *
+ *  This program is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public License
+ *  as published by the Free Software Foundation; either version 2
+ *  of the License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA.
+ *
+ *  Special exception for linking this software with OpenSSL:
+ *
+ *  In addition, as a special exception, Skylable Ltd. gives permission to
+ *  link the code of this program with the OpenSSL library and distribute
+ *  linked combinations including the two. You must obey the GNU General
+ *  Public License in all respects for all of the code used other than
+ *  OpenSSL. You may extend this exception to your version of the program,
+ *  but you are not obligated to do so. If you do not wish to do so, delete
+ *  this exception statement from your version.
+ */
+
+#include "sxblockreader.h"
+#include "sxbufferpool.h"
+#include "sxfilterstream.h"
+#include "sxlog.h"
+#include "sxmappedfile.h"
+#include <cstring>
+
+SxBlockReader::SxBlockReader(const QString &path, const int blockSize, const int bufferSize, const int bufferCount)
+    : mPath(path), mBlockSize(blockSize), mBufferSize(bufferSize)
+{
+    mSource = nullptr;
+    mStreamCacheSize = 0;
+    mStreamPos = 0;
+    mFile = nullptr;
+    mStopped = false;
+    mFailed = false;
+    mBufferCount = bufferCount;
+    for (int i=0; i<bufferCount; i++) {
+        mFreeBuffers.append(SxBufferPool::instance().acquire(bufferSize));
+    }
+}
+
+SxBlockReader::SxBlockReader(SxFilterSource *source, const QSet<qint64> &wanted, const int blockSize, const int bufferSize, const int bufferCount)
+    : SxBlockReader(source->localPath(), blockSize, bufferSize, bufferCount)
+{
+    mSource = source;
+    mWanted = wanted;
+    mStreamPos = source->pos();
+}
+
+SxBlockReader::~SxBlockReader()
+{
+    stop();
+    wait();
+    // buffers still lent out were dropped by the caller together with their queries
+    int returned = 0;
+    for (QByteArray &buffer : mFreeBuffers) {
+        SxBufferPool::instance().release(buffer, mBufferSize);
+        ++returned;
+    }
+    for (QByteArray &buffer : mReady) {
+        SxBufferPool::instance().release(buffer, mBufferSize);
+        ++returned;
+    }
+    for (int i=returned; i<mBufferCount; i++) {
+        SxBufferPool::instance().discard(mBufferSize);
+    }
+}
+
+void SxBlockReader::enqueue(quint64 id, const QList<qint64> &offsets)
+{
+    QMutexLocker locker(&mMutex);
+    mRequests.append({id, offsets});
+    mRequestsCondition.wakeOne();
+}
+
+/* bodyHash is the hex encoded sha1 of the data, computed while the buffer was filled */
+bool SxBlockReader::take(quint64 id, QByteArray &data, QByteArray &bodyHash)
+{
+    QMutexLocker locker(&mMutex);
+    while (!mReady.contains(id)) {
+        if (mFailed || mStopped)
+            return false;
+        mReadyCondition.wait(&mMutex);
+    }
+    data = mReady.take(id);
+    bodyHash = mReadyHashes.take(id);
+    return true;
+}
+
+void SxBlockReader::release(QByteArray &data)
+{
+    QMutexLocker locker(&mMutex);
+    mFreeBuffers.append(data);
+    data.clear();
+    mRequestsCondition.wakeOne();
+}
+
+void SxBlockReader::stop()
+{
+    QMutexLocker locker(&mMutex);
+    mStopped = true;
+    mRequestsCondition.wakeAll();
+    mReadyCondition.wakeAll();
+}
+
+void SxBlockReader::run()
+{
+    SxMappedFile file(mPath);
+    if (!mSource && !file.open()) {
+        logWarning("unable to open file" + mPath);
+        QMutexLocker locker(&mMutex);
+        mFailed = true;
+        mReadyCondition.wakeAll();
+        return;
+    }
+    mFile = &file;
+    forever {
+        QPair<quint64, QList<qint64> > request;
+        QByteArray buffer;
+        {
+            QMutexLocker locker(&mMutex);
+            while (!mStopped && (mRequests.isEmpty() || mFreeBuffers.isEmpty()))
+                mRequestsCondition.wait(&mMutex);
+            if (mStopped)
+                return;
+            request = mRequests.takeFirst();
+            buffer = mFreeBuffers.takeFirst();
+        }
+        qint64 dataLen = static_cast<qint64>(request.second.count())*mBlockSize;
+        if (dataLen > mBufferSize)
+            buffer.reserve(static_cast<int>(dataLen));
+        buffer.resize(static_cast<int>(dataLen));
+        QCryptographicHash hash(QCryptographicHash::Sha1);
+        bool failed = mSource ? !readStream(request.second, buffer.data(), hash) : !readFile(request.second, buffer.data(), hash);
+        QMutexLocker locker(&mMutex);
+        if (failed) {
+            logWarning("reading blocks from " + mPath + " failed");
+            mFailed = true;
+            mReadyCondition.wakeAll();
+            return;
+        }
+        mReady.insert(request.first, buffer);
+        mReadyHashes.insert(request.first, hash.result().toHex());
+        mReadyCondition.wakeAll();
+    }
+}
+
+bool SxBlockReader::readFile(const QList<qint64> &offsets, char *data, QCryptographicHash &hash)
+{
+    const qint64 fileSize = mFile->size();
+    foreach (qint64 offset, offsets) {
+        if (offset >= fileSize)
+            return false;
+        qint64 toRead = qMin(static_cast<qint64>(mBlockSize), fileSize - offset);
+        if (!mFile->read(offset, data, toRead))
+            return false;
+        if (toRead < mBlockSize)
+            memset(data+toRead, 0, static_cast<size_t>(mBlockSize-toRead));
+        hash.addData(data, mBlockSize);
+        data+=mBlockSize;
+    }
+    return true;
+}
+
+/* The filtered content can only be produced sequentially. Blocks which will be
+ * requested later are kept in memory when passed, anything else behind the current
+ * position means processing the file again from the beginning. */
+bool SxBlockReader::readStream(const QList<qint64> &offsets, char *data, QCryptographicHash &hash)
+{
+    foreach (qint64 offset, offsets) {
+        if (mStreamCache.contains(offset)) {
+            QByteArray block = mStreamCache.take(offset);
+            mStreamCacheSize -= block.size();
+            memcpy(data, block.constData(), static_cast<size_t>(mBlockSize));
+            hash.addData(data, mBlockSize);
+            data+=mBlockSize;
+            continue;
+        }
+        if (offset < mStreamPos) {
+            logVerbose(QString("restarting filter stream of %1 at %2").arg(mPath).arg(offset));
+            if (!mSource->rewind())
+                return false;
+            mStreamPos = 0;
+        }
+        QByteArray block(mBlockSize, 0);
+        while (mStreamPos <= offset) {
+            qint64 bytes = mSource->read(block.data(), mBlockSize);
+            if (bytes <= 0)
+                return false;
+            if (bytes < mBlockSize)
+                memset(block.data()+bytes, 0, static_cast<size_t>(mBlockSize-bytes));
+            if (mStreamPos != offset && mWanted.contains(mStreamPos) && !mStreamCache.contains(mStreamPos)
+                    && mStreamCacheSize + mBlockSize <= sStreamCacheLimit) {
+                mStreamCache.insert(mStreamPos, block);
+                mStreamCacheSize += mBlockSize;
+                block = QByteArray(mBlockSize, 0);
+            }
+            mStreamPos += mBlockSize;
+        }
+        memcpy(data, block.constData(), static_cast<size_t>(mBlockSize));
+        hash.addData(data, mBlockSize);
+        data+=mBlockSize;
+    }
+    return true;
+}
@@ -0,0 +1,85 @@
+/*
+ *  Copyright (C) 2012-2016 Skylable Ltd. <info-copyright@skylable.com>
+ *
+ *  This program is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public License
+ *  as published by the Free Software Foundation; either version 2
+ *  of the License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA.
+ *
+ *  Special exception for linking this software with OpenSSL:
+ *
+ *  In addition, as a special exception, Skylable Ltd. gives permission to
+ *  link the code of this program with the OpenSSL library and distribute
+ *  linked combinations including the two. You must obey the GNU General
+ *  Public License in all respects for all of the code used other than
+ *  OpenSSL. You may extend this exception to your version of the program,
+ *  but you are not obligated to do so. If you do not wish to do so, delete
+ *  this exception statement from your version.
+ */
+
+#ifndef SXBLOCKREADER_H
+#define SXBLOCKREADER_H
+
+#include <QThread>
+#include <QFile>
+#include <QMutex>
+#include <QWaitCondition>
+#include <QHash>
+#include <QList>
+#include <QPair>
+#include <QSet>
+#include <QCryptographicHash>
+
+class SxFilterSource;
+class SxMappedFile;
+
+class SxBlockReader : public QThread
+{
+public:
+    SxBlockReader(const QString &path, const int blockSize, const int bufferSize, const int bufferCount);
+    SxBlockReader(SxFilterSource *source, const QSet<qint64> &wanted, const int blockSize, const int bufferSize, const int bufferCount);
+    ~SxBlockReader();
+    void enqueue(quint64 id, const QList<qint64> &offsets);
+    bool take(quint64 id, QByteArray &data, QByteArray &bodyHash);
+    void release(QByteArray &data);
+    void stop();
+
+protected:
+    void run() override;
+
+private:
+    bool readFile(const QList<qint64> &offsets, char *data, QCryptographicHash &hash);
+    bool readStream(const QList<qint64> &offsets, char *data, QCryptographicHash &hash);
+
+    const QString mPath;
+    SxFilterSource *mSource;
+    QSet<qint64> mWanted;
+    QHash<qint64, QByteArray> mStreamCache;
+    qint64 mStreamCacheSize;
+    qint64 mStreamPos;
+    static const qint64 sStreamCacheLimit = 64*1024*1024;
+    SxMappedFile *mFile;
+    const int mBlockSize;
+    const int mBufferSize;
+    int mBufferCount;
+    bool mStopped;
+    bool mFailed;
+    QList<QPair<quint64, QList<qint64> > > mRequests;
+    QHash<quint64, QByteArray> mReady;
+    QHash<quint64, QByteArray> mReadyHashes;
+    QList<QByteArray> mFreeBuffers;
+    QMutex mMutex;
+    QWaitCondition mRequestsCondition;
+    QWaitCondition mReadyCondition;
+};
+
+#endif // SXBLOCKREADER_H
@@ -0,0 +1,143 @@
+/*
+ *  Copyright (C) 2012-2016 Skylable Ltd. <info-copyright@skylable.com>
+ *
+ *  This program is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public License
+ *  as published by the Free Software Foundation; either version 2
+ *  of the License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA.
+ *
+ *  Special exception for linking this software with OpenSSL:
+ *
+ *  In addition, as a special exception, Skylable Ltd. gives permission to
+ *  link the code of this program with the OpenSSL library and distribute
+ *  linked combinations including the two. You must obey the GNU General
+ *  Public License in all respects for all of the code used other than
+ *  OpenSSL. You may extend this exception to your version of the program,
+ *  but you are not obligated to do so. If you do not wish to do so, delete
+ *  this exception statement from your version.
+ */
+
+#include "sxblockwriter.h"
+#include "sxlog.h"
+#include "xfile.h"
+
+SxBlockWriter::SxBlockWriter(const QString &path, qint64 queueLimit)
+    : mPath(path), mQueueLimit(queueLimit)
+{
+    mQueued = 0;
+    mWriting = false;
+    mStopped = false;
+    mFailed = false;
+}
+
+SxBlockWriter::~SxBlockWriter()
+{
+    stop();
+    wait();
+}
+
+bool SxBlockWriter::enqueue(const QList<QPair<qint64, qint64> > &ranges, const char *data)
+{
+    qint64 size = 0;
+    for (const auto &range : ranges) {
+        size = qMax(size, range.second);
+    }
+    Request request;
+    request.ranges = ranges;
+    request.data = QByteArray(data, static_cast<int>(size));
+    QMutexLocker locker(&mMutex);
+    // a single block larger than the limit still goes through once the queue is empty
+    while (!mFailed && !mStopped && mQueued > 0 && mQueued + size > mQueueLimit)
+        mDoneCondition.wait(&mMutex);
+    if (mFailed || mStopped)
+        return false;
+    mQueued += size;
+    mRequests.append(request);
+    mRequestsCondition.wakeOne();
+    return true;
+}
+
+QList<qint64> SxBlockWriter::takeWritten()
+{
+    QMutexLocker locker(&mMutex);
+    QList<qint64> written;
+    written.swap(mWritten);
+    return written;
+}
+
+bool SxBlockWriter::sync()
+{
+    QMutexLocker locker(&mMutex);
+    while (!mFailed && !mStopped && (!mRequests.isEmpty() || mWriting))
+        mDoneCondition.wait(&mMutex);
+    return !mFailed;
+}
+
+QString SxBlockWriter::errorString() const
+{
+    QMutexLocker locker(&mMutex);
+    return mErrorString;
+}
+
+void SxBlockWriter::stop()
+{
+    QMutexLocker locker(&mMutex);
+    mStopped = true;
+    mRequestsCondition.wakeAll();
+    mDoneCondition.wakeAll();
+}
+
+void SxBlockWriter::run()
+{
+    // a handle of its own, the download loop keeps using its QFile for everything else
+    QFile file(mPath);
+    if (!file.open(QIODevice::ReadWrite | QIODevice::Unbuffered)) {
+        logWarning("unable to open file " + mPath);
+        QMutexLocker locker(&mMutex);
+        mFailed = true;
+        mErrorString = file.errorString();
+        mDoneCondition.wakeAll();
+        return;
+    }
+    forever {
+        Request request;
+        {
+            QMutexLocker locker(&mMutex);
+            while (!mStopped && mRequests.isEmpty())
+                mRequestsCondition.wait(&mMutex);
+            if (mStopped)
+                return;
+            request = mRequests.takeFirst();
+            mWriting = true;
+        }
+        bool failed = false;
+        for (const auto &range : request.ranges) {
+            if (!XFile::writeAt(&file, range.first, request.data.constData(), range.second)) {
+                failed = true;
+                break;
+            }
+        }
+        QMutexLocker locker(&mMutex);
+        mWriting = false;
+        mQueued -= request.data.size();
+        if (failed) {
+            mFailed = true;
+            mErrorString = file.errorString();
+            mDoneCondition.wakeAll();
+            return;
+        }
+        for (const auto &range : request.ranges) {
+            mWritten.append(range.first);
+        }
+        mDoneCondition.wakeAll();
+    }
+}
@@ -0,0 +1,77 @@
+/*
+ *  Copyright (C) 2012-2016 Skylable Ltd. <info-copyright@skylable.com>
+ *
+ *  This program is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public License
+ *  as published by the Free Software Foundation; either version 2
+ *  of the License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA.
+ *
+ *  Special exception for linking this software with OpenSSL:
+ *
+ *  In addition, as a special exception, Skylable Ltd. gives permission to
+ *  link the code of this program with the OpenSSL library and distribute
+ *  linked combinations including the two. You must obey the GNU General
+ *  Public License in all respects for all of the code used other than
+ *  OpenSSL. You may extend this exception to your version of the program,
+ *  but you are not obligated to do so. If you do not wish to do so, delete
+ *  this exception statement from your version.
+ */
+
+#ifndef SXBLOCKWRITER_H
+#define SXBLOCKWRITER_H
+
+#include <QThread>
+#include <QFile>
+#include <QMutex>
+#include <QWaitCondition>
+#include <QList>
+#include <QPair>
+
+/* writes downloaded blocks to the part file on its own thread, so the download
+ * loop goes back to the network while the disk catches up */
+class SxBlockWriter : public QThread
+{
+public:
+    SxBlockWriter(const QString &path, qint64 queueLimit);
+    ~SxBlockWriter();
+    // data is copied, waits while more than queueLimit bytes are queued
+    bool enqueue(const QList<QPair<qint64, qint64> > &ranges, const char *data);
+    // offsets of the ranges written since the last call
+    QList<qint64> takeWritten();
+    // waits until everything queued is written
+    bool sync();
+    QString errorString() const;
+    void stop();
+
+protected:
+    void run() override;
+
+private:
+    struct Request {
+        QList<QPair<qint64, qint64> > ranges;
+        QByteArray data;
+    };
+    const QString mPath;
+    const qint64 mQueueLimit;
+    qint64 mQueued;
+    bool mWriting;
+    bool mStopped;
+    bool mFailed;
+    QString mErrorString;
+    QList<Request> mRequests;
+    QList<qint64> mWritten;
+    mutable QMutex mMutex;
+    QWaitCondition mRequestsCondition;
+    QWaitCondition mDoneCondition;
+};
+
+#endif // SXBLOCKWRITER_H
@@ -0,0 +1,110 @@
+/*
+ *  Copyright (C) 2012-2016 Skylable Ltd. <info-copyright@skylable.com>
+ *
+ *  This program is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public License
+ *  as published by the Free Software Foundation; either version 2
+ *  of the License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA.
+ *
+ *  Special exception for linking this software with OpenSSL:
+ *
+ *  In addition, as a special exception, Skylable Ltd. gives permission to
+ *  link the code of this program with the OpenSSL library and distribute
+ *  linked combinations including the two. You must obey the GNU General
+ *  Public License in all respects for all of the code used other than
+ *  OpenSSL. You may extend this exception to your version of the program,
+ *  but you are not obligated to do so. If you do not wish to do so, delete
+ *  this exception statement from your version.
+ */
+
+#include "sxbootstrapcache.h"
+#include "sxlog.h"
+
+#include <QCoreApplication>
+#include <QCryptographicHash>
+#include <QDataStream>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QSaveFile>
+#include <QStandardPaths>
+
+QString SxBootstrapCache::path(const QByteArray &uuid, const SxAuth &auth)
+{
+    // the user info differs between users of the same cluster
+    QByteArray user = QCryptographicHash::hash(auth.clusterName().toUtf8() + auth.token_user(), QCryptographicHash::Sha1).toHex().left(16);
+    QString cacheDir = QStandardPaths::writableLocation(QStandardPaths::GenericCacheLocation) + "/" + QCoreApplication::organizationName();
+    return cacheDir + "/sx-session/" + uuid + "/bootstrap-" + user + ".bin";
+}
+
+bool SxBootstrapCache::load(const QByteArray &uuid, const SxAuth &auth, SxBootstrapState &state)
+{
+    QString statePath = path(uuid, auth);
+    QFile stateFile(statePath);
+    if (!stateFile.open(QIODevice::ReadOnly))
+        return false;
+    QDataStream stream(&stateFile);
+    quint32 magic = 0, version = 0;
+    stream >> magic >> version;
+    if (magic != sMagic || version != sVersion) {
+        stateFile.close();
+        QFile::remove(statePath);
+        return false;
+    }
+    qint32 volumeCount = 0;
+    stream >> state.saved >> state.nodes >> state.applianceNodes >> state.networkConfiguration >> state.clusterMeta
+           >> state.username >> state.quota >> state.quotaUsed >> state.userDesc >> volumeCount;
+    state.volumes.clear();
+    for (qint32 i=0; i<volumeCount && stream.status() == QDataStream::Ok; i++) {
+        SxBootstrapState::Volume volume;
+        stream >> volume.name >> volume.owner >> volume.size >> volume.usedSize >> volume.canRead >> volume.canWrite
+               >> volume.globalId >> volume.nodes >> volume.meta >> volume.customMeta;
+        state.volumes.append(volume);
+    }
+    stream >> state.sessionTickets;
+    stateFile.close();
+    if (stream.status() != QDataStream::Ok || state.nodes.isEmpty()) {
+        logWarning("invalid bootstrap cache " + statePath);
+        QFile::remove(statePath);
+        return false;
+    }
+    return true;
+}
+
+bool SxBootstrapCache::store(const QByteArray &uuid, const SxAuth &auth, const SxBootstrapState &state)
+{
+    QString statePath = path(uuid, auth);
+    if (!QDir().mkpath(QFileInfo(statePath).absolutePath()))
+        return false;
+    QSaveFile stateFile(statePath);
+    if (!stateFile.open(QIODevice::WriteOnly))
+        return false;
+    QDataStream stream(&stateFile);
+    stream << sMagic << sVersion;
+    stream << state.saved << state.nodes << state.applianceNodes << state.networkConfiguration << state.clusterMeta
+           << state.username << state.quota << state.quotaUsed << state.userDesc << static_cast<qint32>(state.volumes.count());
+    foreach (const SxBootstrapState::Volume &volume, state.volumes) {
+        stream << volume.name << volume.owner << volume.size << volume.usedSize << volume.canRead << volume.canWrite
+               << volume.globalId << volume.nodes << volume.meta << volume.customMeta;
+    }
+    stream << state.sessionTickets;
+    if (stream.status() != QDataStream::Ok || !stateFile.commit()) {
+        logWarning("unable to save bootstrap cache " + statePath);
+        return false;
+    }
+    return true;
+}
+
+void SxBootstrapCache::remove(const QByteArray &uuid, const SxAuth &auth)
+{
+    QFile::remove(path(uuid, auth));
+}
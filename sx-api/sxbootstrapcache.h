@@ -0,0 +1,84 @@
+/*
+ *  Copyright (C) 2012-2016 Skylable Ltd. <info-copyright@skylable.com>
+ *
+ *  This program is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public License
+ *  as published by the Free Software Foundation; either version 2
+ *  of the License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA.
+ *
+ *  Special exception for linking this software with OpenSSL:
+ *
+ *  In addition, as a special exception, Skylable Ltd. gives permission to
+ *  link the code of this program with the OpenSSL library and distribute
+ *  linked combinations including the two. You must obey the GNU General
+ *  Public License in all respects for all of the code used other than
+ *  OpenSSL. You may extend this exception to your version of the program,
+ *  but you are not obligated to do so. If you do not wish to do so, delete
+ *  this exception statement from your version.
+ */
+
+#ifndef SXBOOTSTRAPCACHE_H
+#define SXBOOTSTRAPCACHE_H
+
+#include <QDateTime>
+#include <QHash>
+#include <QStringList>
+#include <QVariant>
+#include "sxauth.h"
+
+/* Cluster state as last seen by initializeCluster and reloadVolumes */
+struct SxBootstrapState
+{
+    struct Volume {
+        QString name;
+        QString owner;
+        qint64 size;
+        qint64 usedSize;
+        bool canRead;
+        bool canWrite;
+        QString globalId;
+        QStringList nodes;
+        QHash<QString, QByteArray> meta;
+        QHash<QString, QByteArray> customMeta;
+    };
+    QDateTime saved;
+    QStringList nodes;
+    bool applianceNodes = false;
+    QStringList networkConfiguration;
+    QHash<QString, QByteArray> clusterMeta;
+    QString username;
+    qint64 quota = 0;
+    qint64 quotaUsed = 0;
+    QHash<QString, QVariant> userDesc;
+    QList<Volume> volumes;
+    QHash<QString, QByteArray> sessionTickets;
+};
+
+/* Persists the bootstrap state per cluster and user, so a restarted client
+ * can work from it while the cluster is queried again in the background.
+ * The cache is shared by all the applications of the organization, a
+ * client started next to a running one begins with its nodes, volume
+ * locations and TLS sessions */
+class SxBootstrapCache
+{
+public:
+    static bool load(const QByteArray &uuid, const SxAuth &auth, SxBootstrapState &state);
+    static bool store(const QByteArray &uuid, const SxAuth &auth, const SxBootstrapState &state);
+    static void remove(const QByteArray &uuid, const SxAuth &auth);
+
+private:
+    static QString path(const QByteArray &uuid, const SxAuth &auth);
+    static const quint32 sMagic = 0x53584253;
+    static const quint32 sVersion = 2;
+};
+
+#endif // SXBOOTSTRAPCACHE_H
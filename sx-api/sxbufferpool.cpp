@@ -0,0 +1,137 @@
+/*
+ *  Copyright (C) 2012-2016 Skylable Ltd. <info-copyright@skylable.com>
+ *
+ *  This program is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public License
+ *  as published by the Free Software Foundation; either version 2
+ *  of the License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA.
+ *
+ *  Special exception for linking this software with OpenSSL:
+ *
+ *  In addition, as a special exception, Skylable Ltd. gives permission to
+ *  link the code of this program with the OpenSSL library and distribute
+ *  linked combinations including the two. You must obey the GNU General
+ *  Public License in all respects for all of the code used other than
+ *  OpenSSL. You may extend this exception to your version of the program,
+ *  but you are not obligated to do so. If you do not wish to do so, delete
+ *  this exception statement from your version.
+ */
+
+#include "sxbufferpool.h"
+#include "sxlog.h"
+#include "sxcensus.h"
+
+#include <QElapsedTimer>
+
+SxBufferPool &SxBufferPool::instance()
+{
+    static SxBufferPool sInstance;
+    return sInstance;
+}
+
+SxBufferPool::SxBufferPool()
+{
+    mBudget = 256*1024*1024;
+    mInUse = 0;
+    mIdle = 0;
+}
+
+void SxBufferPool::setBudget(qint64 budget)
+{
+    QMutexLocker locker(&mMutex);
+    mBudget = budget;
+    _trimIdle(0);
+    mReleased.wakeAll();
+}
+
+qint64 SxBufferPool::budget() const
+{
+    QMutexLocker locker(&mMutex);
+    return mBudget;
+}
+
+QByteArray SxBufferPool::acquire(int size)
+{
+    const int sizeClass = _sizeClass(size);
+    QMutexLocker locker(&mMutex);
+    QList<QByteArray> &free = mFree[sizeClass];
+    QByteArray data;
+    if (!free.isEmpty()) {
+        data = free.takeLast();
+        mIdle -= sizeClass;
+    }
+    else {
+        QElapsedTimer timer;
+        timer.start();
+        while (mInUse > 0 && mInUse + sizeClass > mBudget) {
+            qint64 left = sWaitLimit - timer.elapsed();
+            if (left <= 0 || !mReleased.wait(&mMutex, static_cast<unsigned long>(left))) {
+                logVerbose(QString("transfer buffers over budget: %1 bytes in use").arg(mInUse));
+                break;
+            }
+        }
+        _trimIdle(sizeClass);
+    }
+    mInUse += sizeClass;
+    locker.unlock();
+    SxCensus::add(SxCensus::TransferBuffer, sizeClass);
+    if (data.capacity() < sizeClass)
+        data.reserve(sizeClass);
+    data.resize(size);
+    return data;
+}
+
+void SxBufferPool::release(QByteArray &data, int size)
+{
+    const int sizeClass = _sizeClass(size);
+    SxCensus::remove(SxCensus::TransferBuffer, sizeClass);
+    QMutexLocker locker(&mMutex);
+    mInUse = qMax<qint64>(0, mInUse - sizeClass);
+    // a buffer still shared with someone else would be copied on the next write,
+    // one grown past its class would upset the idle accounting
+    if (data.isDetached() && data.capacity() == sizeClass && mInUse + mIdle + sizeClass <= mBudget) {
+        // the capacity was reserved, shrinking keeps the allocation
+        data.resize(0);
+        mFree[sizeClass].append(data);
+        mIdle += sizeClass;
+    }
+    data = QByteArray();
+    mReleased.wakeAll();
+}
+
+void SxBufferPool::discard(int size)
+{
+    SxCensus::remove(SxCensus::TransferBuffer, _sizeClass(size));
+    QMutexLocker locker(&mMutex);
+    mInUse = qMax<qint64>(0, mInUse - _sizeClass(size));
+    mReleased.wakeAll();
+}
+
+int SxBufferPool::_sizeClass(int size)
+{
+    int sizeClass = sMinSizeClass;
+    while (sizeClass < size && sizeClass < (1 << 30))
+        sizeClass <<= 1;
+    return sizeClass;
+}
+
+void SxBufferPool::_trimIdle(qint64 needed)
+{
+    auto it = mFree.begin();
+    while (mInUse + mIdle + needed > mBudget && it != mFree.end()) {
+        while (!it.value().isEmpty() && mInUse + mIdle + needed > mBudget) {
+            it.value().removeLast();
+            mIdle -= it.key();
+        }
+        ++it;
+    }
+}
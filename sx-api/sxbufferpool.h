@@ -0,0 +1,87 @@
+/*
+ *  Copyright (C) 2012-2016 Skylable Ltd. <info-copyright@skylable.com>
+ *
+ *  This program is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public License
+ *  as published by the Free Software Foundation; either version 2
+ *  of the License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA.
+ *
+ *  Special exception for linking this software with OpenSSL:
+ *
+ *  In addition, as a special exception, Skylable Ltd. gives permission to
+ *  link the code of this program with the OpenSSL library and distribute
+ *  linked combinations including the two. You must obey the GNU General
+ *  Public License in all respects for all of the code used other than
+ *  OpenSSL. You may extend this exception to your version of the program,
+ *  but you are not obligated to do so. If you do not wish to do so, delete
+ *  this exception statement from your version.
+ */
+
+#ifndef SXBUFFERPOOL_H
+#define SXBUFFERPOOL_H
+
+#include <QByteArray>
+#include <QHash>
+#include <QList>
+#include <QMutex>
+#include <QWaitCondition>
+
+/* Process wide pool of transfer buffers. Buffers are reused by size class and the memory
+ * held by all transfers together is kept within a budget: acquire waits for other
+ * transfers to release their buffers, and gives up waiting after a while so a single
+ * transfer needing more than the budget can still make progress */
+class SxBufferPool
+{
+public:
+    static SxBufferPool& instance();
+    SxBufferPool(const SxBufferPool &) = delete;
+    SxBufferPool &operator= (const SxBufferPool &) = delete;
+    void setBudget(qint64 budget);
+    qint64 budget() const;
+    QByteArray acquire(int size);
+    // gives back a buffer acquired with the given size, data is left empty
+    void release(QByteArray &data, int size);
+    // the holder dropped a buffer acquired with this size instead of releasing it
+    void discard(int size);
+
+private:
+    SxBufferPool();
+    static int _sizeClass(int size);
+    void _trimIdle(qint64 needed);
+    static const int sMinSizeClass = 64*1024;
+    static const int sWaitLimit = 1000;
+    mutable QMutex mMutex;
+    QWaitCondition mReleased;
+    qint64 mBudget;
+    qint64 mInUse;
+    qint64 mIdle;
+    QHash<int, QList<QByteArray>> mFree;
+};
+
+/* Pool buffer held for the lifetime of the object */
+class SxPooledBuffer
+{
+public:
+    explicit SxPooledBuffer(int size) : mData(SxBufferPool::instance().acquire(size)), mSize(size) {}
+    ~SxPooledBuffer() { SxBufferPool::instance().release(mData, mSize); }
+    SxPooledBuffer(const SxPooledBuffer &) = delete;
+    SxPooledBuffer &operator= (const SxPooledBuffer &) = delete;
+    char *data() { return mData.data(); }
+    const char *constData() const { return mData.constData(); }
+    int size() const { return mData.size(); }
+
+private:
+    QByteArray mData;
+    const int mSize;
+};
+
+#endif // SXBUFFERPOOL_H
@@ -0,0 +1,54 @@
+/*
+ *  Copyright (C) 2012-2016 Skylable Ltd. <info-copyright@skylable.com>
+ *
+ *  This program is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public License
+ *  as published by the Free Software Foundation; either version 2
+ *  of the License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA.
+ *
+ *  Special exception for linking this software with OpenSSL:
+ *
+ *  In addition, as a special exception, Skylable Ltd. gives permission to
+ *  link the code of this program with the OpenSSL library and distribute
+ *  linked combinations including the two. You must obey the GNU General
+ *  Public License in all respects for all of the code used other than
+ *  OpenSSL. You may extend this exception to your version of the program,
+ *  but you are not obligated to do so. If you do not wish to do so, delete
+ *  this exception statement from your version.
+ */
+#ifndef SXCANCELTOKEN_H
+#define SXCANCELTOKEN_H
+
+#include <atomic>
+#include <memory>
+
+/* Cancellation flag shared by all copies of a token. A child token is cancelled together
+ * with its parent but can be cancelled on its own; checking a token takes an atomic load
+ * per level and no lock, so it can be polled per block from any thread */
+class SxCancelToken
+{
+public:
+    SxCancelToken();
+    SxCancelToken child() const;
+    void cancel() const;
+    bool isCancelled() const;
+
+private:
+    struct State {
+        mutable std::atomic<bool> cancelled;
+        std::shared_ptr<const State> parent;
+    };
+    explicit SxCancelToken(const std::shared_ptr<const State> &state);
+    std::shared_ptr<const State> mState;
+};
+
+#endif // SXCANCELTOKEN_H
@@ -0,0 +1,87 @@
+/*
+ *  Copyright (C) 2012-2016 Skylable Ltd. <info-copyright@skylable.com>
+ *
+ *  This program is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public License
+ *  as published by the Free Software Foundation; either version 2
+ *  of the License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA.
+ *
+ *  Special exception for linking this software with OpenSSL:
+ *
+ *  In addition, as a special exception, Skylable Ltd. gives permission to
+ *  link the code of this program with the OpenSSL library and distribute
+ *  linked combinations including the two. You must obey the GNU General
+ *  Public License in all respects for all of the code used other than
+ *  OpenSSL. You may extend this exception to your version of the program,
+ *  but you are not obligated to do so. If you do not wish to do so, delete
+ *  this exception statement from your version.
+ */
+
+#include "sxcensus.h"
+
+#include <QStringList>
+
+QAtomicInteger<qint64> SxCensus::sCounts[SxCensus::KindCount];
+QAtomicInteger<qint64> SxCensus::sBytes[SxCensus::KindCount];
+
+qint64 SxCensus::count(Kind kind)
+{
+    return sCounts[kind].load();
+}
+
+qint64 SxCensus::bytes(Kind kind)
+{
+    return sBytes[kind].load();
+}
+
+const char *SxCensus::name(Kind kind)
+{
+    switch (kind) {
+    case Task:
+        return "task";
+    case Block:
+        return "block";
+    case FileEntry:
+        return "fileEntry";
+    case Query:
+        return "query";
+    case QueryResult:
+        return "queryResult";
+    case TransferBuffer:
+        return "transferBuffer";
+    default:
+        return "";
+    }
+}
+
+QString SxCensus::report()
+{
+    QStringList parts;
+    for (int i=0; i<KindCount; i++) {
+        Kind kind = static_cast<Kind>(i);
+        parts.append(QString("%1: %2 (%3 kB)").arg(name(kind)).arg(count(kind)).arg(bytes(kind)/1024));
+    }
+    return parts.join(", ");
+}
+
+QJsonObject SxCensus::toJson()
+{
+    QJsonObject json;
+    for (int i=0; i<KindCount; i++) {
+        Kind kind = static_cast<Kind>(i);
+        QJsonObject jKind;
+        jKind.insert("count", static_cast<double>(count(kind)));
+        jKind.insert("bytes", static_cast<double>(bytes(kind)));
+        json.insert(name(kind), jKind);
+    }
+    return json;
+}
@@ -0,0 +1,99 @@
+/*
+ *  Copyright (C) 2012-2016 Skylable Ltd. <info-copyright@skylable.com>
+ *
+ *  This program is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public License
+ *  as published by the Free Software Foundation; either version 2
+ *  of the License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA.
+ *
+ *  Special exception for linking this software with OpenSSL:
+ *
+ *  In addition, as a special exception, Skylable Ltd. gives permission to
+ *  link the code of this program with the OpenSSL library and distribute
+ *  linked combinations including the two. You must obey the GNU General
+ *  Public License in all respects for all of the code used other than
+ *  OpenSSL. You may extend this exception to your version of the program,
+ *  but you are not obligated to do so. If you do not wish to do so, delete
+ *  this exception statement from your version.
+ */
+
+#ifndef SXCENSUS_H
+#define SXCENSUS_H
+
+#include <QAtomicInteger>
+#include <QJsonObject>
+#include <QString>
+
+/* Process wide count of the live heavy objects and their approximate size,
+ * cheap enough to stay enabled in release builds. Bytes are the object size
+ * plus the payload known when it was created */
+class SxCensus
+{
+public:
+    enum Kind {
+        Task,
+        Block,
+        FileEntry,
+        Query,
+        QueryResult,
+        TransferBuffer,
+        KindCount
+    };
+    static void add(Kind kind, qint64 bytes)
+    {
+        sCounts[kind].fetchAndAddRelaxed(1);
+        sBytes[kind].fetchAndAddRelaxed(bytes);
+    }
+    static void remove(Kind kind, qint64 bytes)
+    {
+        sCounts[kind].fetchAndAddRelaxed(-1);
+        sBytes[kind].fetchAndAddRelaxed(-bytes);
+    }
+    static void resize(Kind kind, qint64 delta)
+    {
+        sBytes[kind].fetchAndAddRelaxed(delta);
+    }
+    static qint64 count(Kind kind);
+    static qint64 bytes(Kind kind);
+    static const char *name(Kind kind);
+    static QString report();
+    static QJsonObject toJson();
+
+private:
+    static QAtomicInteger<qint64> sCounts[KindCount];
+    static QAtomicInteger<qint64> sBytes[KindCount];
+};
+
+/* Member keeping its owner counted in the census, copies count as new objects */
+template <SxCensus::Kind K>
+class SxCensusEntry
+{
+public:
+    explicit SxCensusEntry(qint64 bytes = 0) : mBytes(bytes) { SxCensus::add(K, mBytes); }
+    SxCensusEntry(const SxCensusEntry &other) : mBytes(other.mBytes) { SxCensus::add(K, mBytes); }
+    ~SxCensusEntry() { SxCensus::remove(K, mBytes); }
+    SxCensusEntry &operator= (const SxCensusEntry &other)
+    {
+        setBytes(other.mBytes);
+        return *this;
+    }
+    void setBytes(qint64 bytes)
+    {
+        SxCensus::resize(K, bytes - mBytes);
+        mBytes = bytes;
+    }
+
+private:
+    qint64 mBytes;
+};
+
+#endif // SXCENSUS_H
@@ -30,10 +30,24 @@
 #include "sxquery.h"
 #include "sxqueryresult.h"
 #include "sxfilter.h"
+#include "sxblockcache.h"
+#include "sxsyncblocks.h"
+#include "sxinflightblocks.h"
+#include "sxblockreader.h"
+#include "sxblockwriter.h"
+#include "sxmappedfile.h"
+#include "sxfilterstream.h"
+#include "sxlistingreader.h"
+#include "sxfiledatareader.h"
+#include "sxrevisioncache.h"
+#include "sxdownloadplan.h"
+#include "sxbufferpool.h"
 
 #include <memory>
+#include <vector>
 #include <QNetworkReply>
 #include <QEventLoop>
+#include <QElapsedTimer>
 #include <QDebug>
 #include <QHostInfo>
 #include <QJsonDocument>
@@ -41,6 +55,7 @@
 #include <QJsonArray>
 #include <QFileInfo>
 #include <QSslCertificate>
+#include <QSslConfiguration>
 #include <QPair>
 #include <QTemporaryFile>
 #include <QDir>
@@ -48,9 +63,22 @@
 #include <QUuid>
 #include <QNetworkInterface>
 #include <QCoreApplication>
+#include <QBitArray>
+#include <QCryptographicHash>
+#include <QDataStream>
+#include <QSaveFile>
+#include <QtConcurrent>
 #include "xfile.h"
 #include "sxlog.h"
+#include "sxtrace.h"
+#include "sxmetrics.h"
+#include "sxnodehealth.h"
+#include "sxsyncrecorder.h"
+#include "sxresolver.h"
+#include "sxprofiler.h"
+#include "sxbootstrapcache.h"
 #include "volumeconfigwatcher.h"
+#include "util.h"
 
 #ifdef Q_OS_LINUX
     #ifndef _GNU_SOURCE
@@ -61,6 +89,91 @@
 
 QString SxCluster::sClientVersion = "unknown";
 
+namespace {
+// drops the pages of a transferred file from the page cache when the transfer is over,
+// so a bulk sync doesn't push the working set of the user out of memory
+class PageCacheRelease {
+public:
+    PageCacheRelease(const QString &fileName) : mFileName(fileName) {}
+    ~PageCacheRelease() { XFile::releaseCache(mFileName); }
+private:
+    QString mFileName;
+};
+
+// groups the blocks of an upload by their replica node set, so a chunk for a target node
+// is filled from whole buckets instead of rescanning every pending block
+class BlockBuckets {
+public:
+    BlockBuckets() : mFirst(0), mCount(0) {}
+    void add(SxBlock *block, const QStringList &nodeList) {
+        QStringList sorted = nodeList;
+        sorted.sort();
+        QString key = sorted.join('\n');
+        auto it = mIndex.constFind(key);
+        int bucket;
+        if (it == mIndex.constEnd()) {
+            bucket = mNodes.size();
+            mIndex.insert(key, bucket);
+            mNodes.append(nodeList);
+            mBlocks.append(QList<SxBlock*>());
+            foreach (const QString &node, nodeList)
+                mByNode[node].append(bucket);
+        }
+        else
+            bucket = it.value();
+        mBlocks[bucket].append(block);
+        mFirst = qMin(mFirst, bucket);
+        ++mCount;
+    }
+    bool isEmpty() const { return mCount == 0; }
+    // node list of the oldest bucket which still has blocks
+    QStringList firstNodes() {
+        while (mBlocks.at(mFirst).isEmpty())
+            ++mFirst;
+        return mNodes.at(mFirst);
+    }
+    // takes up to maxBlocks blocks stored on target, nodes gets the nodes shared by all of them
+    void take(const QString &target, int maxBlocks, QList<SxBlock*> &blocks, QSet<QString> &nodes) {
+        bool first = true;
+        foreach (int bucket, mByNode.value(target)) {
+            QList<SxBlock*> &list = mBlocks[bucket];
+            if (list.isEmpty())
+                continue;
+            if (first)
+                nodes = mNodes.at(bucket).toSet();
+            else
+                nodes &= mNodes.at(bucket).toSet();
+            first = false;
+            while (!list.isEmpty() && blocks.size() < maxBlocks) {
+                blocks.append(list.takeFirst());
+                --mCount;
+            }
+            if (blocks.size() >= maxBlocks)
+                break;
+        }
+    }
+private:
+    QHash<QString, int> mIndex;
+    QList<QStringList> mNodes;
+    QList<QList<SxBlock*>> mBlocks;
+    QHash<QString, QList<int>> mByNode;
+    int mFirst;
+    int mCount;
+};
+
+// one file of SxCluster::downloadFiles(), written to its part file as shared batches come in
+struct BatchDownload {
+    BatchDownload(SxVolume *volume, const QString &path, const QString &localPath)
+        : file(volume, path, "", true), localPath(localPath), missing(0), failed(false) {}
+    SxFile file;
+    QString localPath;
+    QString partName;
+    std::unique_ptr<QFile> part;
+    int missing;
+    bool failed;
+};
+}
+
 static const QHash<QNetworkReply::NetworkError, QString> sNetworkError = {
     {QNetworkReply::ConnectionRefusedError,             QT_TRANSLATE_NOOP("SxErrorMessage","Remote server refused the connection.")},
     {QNetworkReply::RemoteHostClosedError,              QT_TRANSLATE_NOOP("SxErrorMessage","Remote server closed connection prematurely, before the entire reply was received and processed.")},
@@ -94,6 +207,45 @@ QString retriveClusterUuid(QNetworkReply *reply) {
     return QString();
 }
 
+static const quint32 sDownloadStateMagic = 0x53584450;
+
+static bool loadDownloadState(const QString &statePath, const QString &revision, qint64 size, int blockSize, QBitArray &completed)
+{
+    QFile stateFile(statePath);
+    if (!stateFile.open(QIODevice::ReadOnly))
+        return false;
+    QDataStream stream(&stateFile);
+    quint32 magic;
+    QString stateRevision;
+    qint64 stateSize;
+    qint32 stateBlockSize;
+    QBitArray stateCompleted;
+    stream >> magic >> stateRevision >> stateSize >> stateBlockSize >> stateCompleted;
+    stateFile.close();
+    if (stream.status() != QDataStream::Ok || magic != sDownloadStateMagic || stateRevision != revision ||
+            stateSize != size || stateBlockSize != blockSize || stateCompleted.size() != completed.size()) {
+        QFile::remove(statePath);
+        return false;
+    }
+    completed = stateCompleted;
+    return true;
+}
+
+static bool saveDownloadState(const QString &statePath, const QString &revision, qint64 size, int blockSize, const QBitArray &completed)
+{
+    QSaveFile stateFile(statePath);
+    if (!stateFile.open(QIODevice::WriteOnly))
+        return false;
+    QDataStream stream(&stateFile);
+    stream << sDownloadStateMagic << revision << size << static_cast<qint32>(blockSize) << completed;
+    if (stream.status() != QDataStream::Ok || !stateFile.commit()) {
+        logWarning("unable to save download state " + statePath);
+        return false;
+    }
+    XFile::makeInvisible(statePath, true);
+    return true;
+}
+
 SxQueryResult * processReply(QNetworkReply* reply, QString clusterUuid) {
     logEntry("");
     SxErrorCode error = SxErrorCode::NoError;
@@ -263,11 +415,25 @@ SxCluster::SxCluster(const SxAuth& auth, QByteArray uuid, const QStringList& nod
     mClusterUuid = uuid;
     mNodeList = nodes;
     mNetworkAccessManager = new QNetworkAccessManager(this);
+    mNetworkManagerFailures = 0;
+    mHttp2Enabled = false;
+    mDeltaDownload = false;
+    mLastUploadSavedBytes = 0;
     mTimeDrift = 0;
     mViaSxCache = false;
     mCallbackConfirmCert = nullptr;
     mCallbackGetInput = nullptr;
     mUseApplianceNodeList = false;
+    mBootstrapCache = false;
+    mVolumesFromCache = false;
+    mBootstrapPending = 0;
+    mBootstrapFailed = false;
+    mUploadConnectionLimit = sUploadConnectionLimit;
+    mUploadNodeConnectionLimit = sUploadNodeConnectionLimit;
+    mUploadJobsTimer = new QTimer(this);
+    mUploadJobsTimer->setSingleShot(true);
+    connect(mUploadJobsTimer, &QTimer::timeout, this, &SxCluster::onUploadJobsPollTimeout);
+    mUploadJobsCallback = nullptr;
 }
 
 SxCluster::~SxCluster()
@@ -291,7 +457,7 @@ QString SxCluster::getClientVersion()
     return sClientVersion;
 }
 
-SxCluster *SxCluster::initializeCluster(const SxAuth &auth, QByteArray uuid, std::function<bool(QSslCertificate &, bool)> checkSslCallback, QString &errorMessage)
+SxCluster *SxCluster::initializeCluster(const SxAuth &auth, QByteArray uuid, std::function<bool(QSslCertificate &, bool)> checkSslCallback, QString &errorMessage, bool bootstrapCache)
 {
     logEntry("");
     errorMessage.clear();
@@ -300,12 +466,14 @@ SxCluster *SxCluster::initializeCluster(const SxAuth &auth, QByteArray uuid, std
         logWarning(errorMessage);
         return nullptr;
     }
+    if (bootstrapCache) {
+        SxCluster *c = initializeFromCache(auth, uuid, checkSslCallback);
+        if (c)
+            return c;
+    }
     QStringList nodes;
     if (auth.initialAddress().isEmpty()) {
-        QHostInfo hostInfo = QHostInfo::fromName(auth.clusterName());
-        foreach (QHostAddress address, hostInfo.addresses()) {
-            nodes << address.toString();
-        }
+        nodes = SxResolver::instance().resolve(auth.clusterName());
     }
     else {
         nodes << auth.initialAddress();
@@ -316,13 +484,10 @@ SxCluster *SxCluster::initializeCluster(const SxAuth &auth, QByteArray uuid, std
         return nullptr;
     }
     SxCluster *c = new SxCluster(auth, uuid, nodes);
+    c->mBootstrapCache = bootstrapCache;
     c->mNetworkConfiguration = QNetworkInterface::allAddresses();
     c->setCheckSslCallback(checkSslCallback);
-    if (!c->_listNodes(c->mNodeList))
-        goto onError;
-    if(!c->_getClusterMetadata(c->mMeta))
-        logWarning("GetClusterMeta failed: " + c->lastError().errorMessage());
-    if (!c->_getUserDetails(c->mUserInfo))
+    if (!c->_bootstrap())
         goto onError;
 
     if (c->mMeta.contains("appliance_ip_list")) {
@@ -353,6 +518,7 @@ SxCluster *SxCluster::initializeCluster(const SxAuth &auth, QByteArray uuid, std
     }
 
     logVerbose("node list: "+c->mNodeList.join(", "));
+    c->storeBootstrapState();
     return c;
 
     onError:
@@ -362,15 +528,208 @@ SxCluster *SxCluster::initializeCluster(const SxAuth &auth, QByteArray uuid, std
     return nullptr;
 }
 
+static QStringList addressList(const QList<QHostAddress> &addresses)
+{
+    QStringList list;
+    foreach (QHostAddress address, addresses) {
+        list.append(address.toString());
+    }
+    list.sort();
+    return list;
+}
+
+SxCluster *SxCluster::initializeFromCache(const SxAuth &auth, QByteArray uuid, std::function<bool(QSslCertificate &, bool)> checkSslCallback)
+{
+    SxBootstrapState state;
+    if (!SxBootstrapCache::load(uuid, auth, state))
+        return nullptr;
+    if (!state.saved.isValid() || state.saved.secsTo(QDateTime::currentDateTime()) > sBootstrapCacheTtl)
+        return nullptr;
+    QList<QHostAddress> networkConfiguration = QNetworkInterface::allAddresses();
+    // private appliance addresses were only tested from the network they were found on
+    if (state.applianceNodes && addressList(networkConfiguration) != state.networkConfiguration)
+        return nullptr;
+
+    SxCluster *c = new SxCluster(auth, uuid, state.nodes);
+    c->mBootstrapCache = true;
+    c->mNetworkConfiguration = networkConfiguration;
+    c->setCheckSslCallback(checkSslCallback);
+    c->mUseApplianceNodeList = state.applianceNodes;
+    foreach (QString key, state.clusterMeta.keys()) {
+        c->mMeta.setValue(key, state.clusterMeta.value(key));
+    }
+    c->mUserInfo.mUsername = state.username;
+    c->mUserInfo.mQuota = state.quota;
+    c->mUserInfo.mQuotaUsed = state.quotaUsed;
+    c->mUserInfo.mDesc = state.userDesc;
+    foreach (const SxBootstrapState::Volume &cached, state.volumes) {
+        SxVolume *volume = new SxVolume(c, cached.name, cached.owner, cached.size, cached.usedSize, cached.canRead, cached.canWrite, cached.globalId);
+        volume->setNodeList(cached.nodes);
+        foreach (QString key, cached.meta.keys()) {
+            volume->meta().setValue(key, cached.meta.value(key));
+        }
+        foreach (QString key, cached.customMeta.keys()) {
+            volume->customMeta().setValue(key, cached.customMeta.value(key));
+        }
+        c->mVolumeList.append(volume);
+    }
+    c->mVolumesFromCache = !state.volumes.isEmpty();
+    c->mSessionTickets = state.sessionTickets;
+    logInfo(QString("cluster state restored from bootstrap cache saved %1").arg(state.saved.toString(Qt::ISODate)));
+    c->revalidateBootstrap();
+    return c;
+}
+
+bool SxCluster::_bootstrap()
+{
+    logEntry("");
+    // none of the bootstrap queries depends on another
+    SxQuery nodesQuery("/?nodeList", SxQuery::GET, QByteArray());
+    SxQuery metaQuery("/?clusterMeta", SxQuery::GET, QByteArray());
+    SxQuery userQuery("/.self", SxQuery::GET, QByteArray());
+    QStringList nodesTargets = mNodeList;
+    QStringList metaTargets = mNodeList;
+    QStringList userTargets = mNodeList;
+    QHash<SxQuery*, QStringList*> queries;
+    queries.insert(&nodesQuery, &nodesTargets);
+    queries.insert(&metaQuery, &metaTargets);
+    queries.insert(&userQuery, &userTargets);
+    QStringList nodeList;
+    while (!queries.isEmpty()) {
+        auto selectResult = querySelect(queries);
+        std::unique_ptr<SxQueryResult> queryResult(selectResult.second);
+        if (!queryResult || selectResult.first == nullptr) {
+            if (queryResult)
+                mLastError = queryResult->error();
+            abortAllQueries();
+            return false;
+        }
+        queries.remove(selectResult.first);
+        bool failed = false;
+        if (selectResult.first == &nodesQuery)
+            failed = !_listNodesProcessReply(queryResult.get(), nodeList);
+        else if (selectResult.first == &userQuery)
+            failed = !_getUserDetailsProcessReply(queryResult.get(), mUserInfo);
+        else if (!_getClusterMetadataProcessReply(queryResult.get(), mMeta))
+            logWarning("GetClusterMeta failed: " + lastError().errorMessage());
+        if (failed) {
+            abortAllQueries();
+            return false;
+        }
+    }
+    mNodeList = nodeList;
+    return true;
+}
+
+void SxCluster::revalidateBootstrap()
+{
+    // every answer refreshes its part of the restored state, the others stay as they were
+    mBootstrapPending = 0;
+    mBootstrapFailed = false;
+    auto revalidate = [this](SxQuery *query, std::function<bool(SxQueryResult*)> process) {
+        ++mBootstrapPending;
+        sendQueryAsync(query, mNodeList, [this, process](SxQueryResult *result) {
+            std::unique_ptr<SxQueryResult> queryResult(result);
+            // a blocking call of the owner may be waiting on the same event loop
+            SxError lastError = mLastError;
+            bool processed = process(queryResult.get());
+            mLastError = lastError;
+            onBootstrapRevalidated(processed, queryResult->error());
+        });
+    };
+    revalidate(new SxQuery("/?nodeList", SxQuery::GET, QByteArray()), [this](SxQueryResult *result) {
+        QStringList nodeList;
+        if (!_listNodesProcessReply(result, nodeList))
+            return false;
+        if (!mUseApplianceNodeList)
+            mNodeList = nodeList;
+        return true;
+    });
+    revalidate(new SxQuery("/?clusterMeta", SxQuery::GET, QByteArray()), [this](SxQueryResult *result) {
+        return _getClusterMetadataProcessReply(result, mMeta);
+    });
+    revalidate(new SxQuery("/.self", SxQuery::GET, QByteArray()), [this](SxQueryResult *result) {
+        return _getUserDetailsProcessReply(result, mUserInfo);
+    });
+    revalidate(new SxQuery("/?volumeList", SxQuery::GET, QByteArray()), [this, revalidate](SxQueryResult *result) {
+        if (!_listVolumesProcessReply(result, mVolumeList, false))
+            return false;
+        foreach (SxVolume *volume, mVolumeList) {
+            QString name = volume->name();
+            revalidate(_locateVolumeMakeQuery(volume, 0, nullptr), [this, name](SxQueryResult *result) {
+                SxVolume *volume = getSxVolume(name);
+                return volume && _locateVolumeProcessReply(volume, result, 0, nullptr);
+            });
+        }
+        return true;
+    });
+}
+
+void SxCluster::onBootstrapRevalidated(bool processed, const SxError &error)
+{
+    if (!processed) {
+        mBootstrapFailed = true;
+        // the cached state belongs to credentials or a cluster that are no longer valid
+        if (error.errorCode() == SxErrorCode::InvalidCredentials || error.errorCode() == SxErrorCode::InvalidServer) {
+            logWarning("bootstrap cache rejected: " + error.errorMessage());
+            SxBootstrapCache::remove(mClusterUuid, mSxAuth);
+            mBootstrapCache = false;
+        }
+    }
+    if (--mBootstrapPending > 0)
+        return;
+    if (mBootstrapFailed)
+        logInfo("cluster state revalidation incomplete, keeping the bootstrap cache");
+    else {
+        logVerbose("cluster state revalidated");
+        storeBootstrapState();
+    }
+}
+
+void SxCluster::storeBootstrapState()
+{
+    if (!mBootstrapCache)
+        return;
+    SxBootstrapState state;
+    state.saved = QDateTime::currentDateTime();
+    state.nodes = mNodeList;
+    state.applianceNodes = mUseApplianceNodeList;
+    state.networkConfiguration = addressList(mNetworkConfiguration);
+    foreach (QString key, mMeta.keys()) {
+        state.clusterMeta.insert(key, mMeta.value(key));
+    }
+    state.username = mUserInfo.mUsername;
+    state.quota = mUserInfo.mQuota;
+    state.quotaUsed = mUserInfo.mQuotaUsed;
+    state.userDesc = mUserInfo.mDesc;
+    foreach (const SxVolume *volume, mVolumeList) {
+        SxBootstrapState::Volume cached;
+        cached.name = volume->name();
+        cached.owner = volume->owner();
+        cached.size = volume->size();
+        cached.usedSize = volume->usedSize();
+        cached.canRead = volume->canRead();
+        cached.canWrite = volume->canWrite();
+        cached.globalId = volume->globalId();
+        cached.nodes = volume->nodeList();
+        foreach (QString key, volume->meta().keys()) {
+            cached.meta.insert(key, volume->meta().value(key));
+        }
+        foreach (QString key, volume->customMeta().keys()) {
+            cached.customMeta.insert(key, volume->customMeta().value(key));
+        }
+        state.volumes.append(cached);
+    }
+    state.sessionTickets = mSessionTickets;
+    SxBootstrapCache::store(mClusterUuid, mSxAuth, state);
+}
+
 bool SxCluster::getClusterUUID(const QString &cluster, const QString &initialAddress, const bool &ssl, const int &port, QString &uuid, QString &errorMessage, int timeout)
 {
     uuid.clear();
     QStringList nodes;
     if (initialAddress.isEmpty()) {
-        QHostInfo hostInfo = QHostInfo::fromName(cluster);
-        foreach (QHostAddress address, hostInfo.addresses()) {
-            nodes << address.toString();
-        }
+        nodes = SxResolver::instance().resolve(cluster);
     }
     else {
         nodes << initialAddress;
@@ -379,7 +738,19 @@ bool SxCluster::getClusterUUID(const QString &cluster, const QString &initialAdd
         errorMessage = QT_TRANSLATE_NOOP("SxErrorMessage", "Unable to locate cluster nodes");
         return false;
     }
-    while (!nodes.isEmpty()) {
+    // race the addresses: the next one is tried when the previous one fails or takes
+    // longer than sConnectRaceDelay, the first valid reply wins
+    QNetworkAccessManager man;
+    connect(&man, &QNetworkAccessManager::sslErrors, [](QNetworkReply* r, const QList<QSslError>&) {
+        r->ignoreSslErrors();
+    });
+    QEventLoop loop;
+    QTimer raceTimer;
+    raceTimer.setSingleShot(true);
+    QList<QNetworkReply*> replies;
+    std::function<void()> startNext = [&]() {
+        if (!uuid.isEmpty() || nodes.isEmpty())
+            return;
         QString urlString = (ssl ? "https://" : "http://") + nodes.takeFirst();
         if ((ssl && port != 443) || (!ssl && port != 80)) {
             urlString += ":"+QString::number(port);
@@ -389,38 +760,47 @@ bool SxCluster::getClusterUUID(const QString &cluster, const QString &initialAdd
         QNetworkRequest req(url);
         req.setHeader(QNetworkRequest::UserAgentHeader, "sxqt-"+SxCluster::getClientVersion());
         req.setRawHeader("SX-Cluster-Name", cluster.toUtf8());
-        QNetworkAccessManager man;
-        connect(&man, &QNetworkAccessManager::sslErrors, [](QNetworkReply* r, const QList<QSslError>&) {
-            r->ignoreSslErrors();
-        });
         QNetworkReply *reply = man.get(req);
-        QEventLoop loop;
-        connect(reply, &QNetworkReply::finished, [&loop, reply, &uuid, &errorMessage]() {
+        replies.append(reply);
+        connect(reply, &QNetworkReply::finished, [&, reply]() {
+            replies.removeOne(reply);
+            if (!uuid.isEmpty())
+                return;
             if (reply->rawHeader("Server").startsWith("libres3")) {
                 errorMessage = QT_TRANSLATE_NOOP("SxErrorMessage", "You must connect directly to SX, not LibreS3.");
-                loop.quit();
-                return;
             }
-            uuid = retriveClusterUuid(reply);
-            if (reply->error() != QNetworkReply::NoError)
-                errorMessage = reply->errorString();
             else {
-                if (uuid.isEmpty()) {
-                    errorMessage = QT_TRANSLATE_NOOP("SxErrorMessage", "Unable to find cluster UUID - not a valid SX node.");
-                }
+                uuid = retriveClusterUuid(reply);
+                if (reply->error() != QNetworkReply::NoError)
+                    errorMessage = reply->errorString();
                 else {
-                    errorMessage.clear();
+                    if (uuid.isEmpty()) {
+                        errorMessage = QT_TRANSLATE_NOOP("SxErrorMessage", "Unable to find cluster UUID - not a valid SX node.");
+                    }
+                    else {
+                        errorMessage.clear();
+                    }
                 }
             }
-            loop.quit();
+            if (!uuid.isEmpty() || (replies.isEmpty() && nodes.isEmpty()))
+                loop.quit();
+            else if (replies.isEmpty())
+                startNext();
         });
         if (timeout < 0)
             QTimer::singleShot(sTimeoutInitial*1000, reply, SLOT(abort()));
         else
             QTimer::singleShot(timeout*1000, reply, SLOT(abort()));
-        loop.exec();
-        if (!uuid.isEmpty())
-            break;
+        if (!nodes.isEmpty())
+            raceTimer.start(sConnectRaceDelay);
+    };
+    connect(&raceTimer, &QTimer::timeout, [&startNext]() { startNext(); });
+    startNext();
+    loop.exec();
+    raceTimer.stop();
+    foreach (QNetworkReply *reply, replies) {
+        reply->disconnect();
+        reply->abort();
     }
     return !uuid.isEmpty();
 }
@@ -554,6 +934,48 @@ SxQueryResult *SxCluster::sendQuery(SxQuery *query, QStringList targetList, cons
     return result.second;
 }
 
+void SxCluster::sendQueryAsync(SxQuery *query, QStringList targetList, std::function<void (SxQueryResult *)> callback, const QString &etag)
+{
+    logEntry("");
+    if (targetList.isEmpty()) {
+        delete query;
+        QTimer::singleShot(0, this, [callback]() {
+            callback(new SxQueryResult("", 0, SxError(SxErrorCode::InvalidArgument, "empty target list", "empty target list"), QByteArray{}, false, ""));
+        });
+        return;
+    }
+    QString target = SxNodeHealth::instance().takeTarget(targetList);
+    QNetworkRequest req = query->makeRequest(target, mSxAuth, mTimeDrift, etag);
+    QNetworkReply *reply = sendNetworkRequest(query, req, false);
+    // keep the reply away from querySelect and abortAllQueries, it belongs to no blocking operation
+    mAsyncTimers.insert(reply, mActiveTimers.take(reply));
+    connect(reply, &QNetworkReply::finished, this, [this, reply, query, targetList, callback, etag]() {
+        QTimer *timer = mAsyncTimers.take(reply);
+        if (timer) {
+            timer->stop();
+            timer->deleteLater();
+        }
+        reply->deleteLater();
+        if (reply->manager() != mNetworkAccessManager)
+            tryRemoveNetworkAccessManager(reply->manager());
+        std::unique_ptr<SxQueryResult> result(processReply(reply, mClusterUuid));
+        SxNodeHealth::instance().report(result->host(), result->error().errorCode());
+        static const QList<SxErrorCode> retryOnError = {
+            SxErrorCode::Timeout,
+            SxErrorCode::NetworkError,
+            SxErrorCode::SslError,
+            SxErrorCode::TooManyRequests
+        };
+        if (retryOnError.contains(result->error().errorCode()) && !targetList.isEmpty()) {
+            logWarning(QString("Query %1 to %2 failed, trying next node").arg(query->number).arg(result->host()));
+            sendQueryAsync(query, targetList, callback, etag);
+            return;
+        }
+        delete query;
+        callback(result.release());
+    });
+}
+
 QNetworkReply * SxCluster::sendNetworkRequest(SxQuery* query, QNetworkRequest req, bool seccondAttempt, int delay)
 {
     logEntry("");
@@ -563,10 +985,26 @@ QNetworkReply * SxCluster::sendNetworkRequest(SxQuery* query, QNetworkRequest re
         timer.setSingleShot(true);
         QEventLoop loop;
         connect(&timer, &QTimer::timeout, [&loop]() { loop.exit(); });
+        connect(this, &SxCluster::sig_exit_loop, &loop, &QEventLoop::quit);
         timer.start(seccondAttempt ? 1000 : delay);
         loop.exec();
     }
 
+#if QT_VERSION >= QT_VERSION_CHECK(5,5,0)
+    if (req.url().scheme() == "https") {
+        QSslConfiguration config = req.sslConfiguration();
+        config.setSslOption(QSsl::SslOptionDisableSessionPersistence, false);
+        QByteArray ticket = mSessionTickets.value(req.url().host());
+        if (!ticket.isEmpty())
+            config.setSessionTicket(ticket);
+        req.setSslConfiguration(config);
+    }
+#endif
+#if QT_VERSION >= QT_VERSION_CHECK(5,8,0)
+    if (mHttp2Enabled)
+        req.setAttribute(QNetworkRequest::HTTP2AllowedAttribute, true);
+#endif
+
     QNetworkReply *reply;
     switch (query->queryType()) {
     case SxQuery::GET:
@@ -584,12 +1022,51 @@ QNetworkReply * SxCluster::sendNetworkRequest(SxQuery* query, QNetworkRequest re
         reply = mNetworkAccessManager->head(req);
     }
 
-    if (seccondAttempt)
+    if (seccondAttempt) {
         reply->setProperty("seccondAttempt", true);
+        SxMetrics::instance().addRetry(req.url().host());
+    }
     reply->setProperty("startTime", QDateTime::currentDateTime());
+    {
+        QString method = "GET";
+        if (query->queryType() == SxQuery::PUT || query->queryType() == SxQuery::JOB_PUT)
+            method = "PUT";
+        else if (query->queryType() == SxQuery::DELETE || query->queryType() == SxQuery::JOB_DELETE)
+            method = "DELETE";
+        else if (query->queryType() == SxQuery::HEAD)
+            method = "HEAD";
+        QString operation = req.url().path().startsWith("/.data/") ? "BLOCK "+method : method;
+        QString node = req.url().host();
+        quint32 traceId = SxTrace::instance().begin(SxTraceEvent::Request, method+" "+node);
+        qint64 sent = query->body().size();
+        QElapsedTimer elapsed;
+        elapsed.start();
+        // connected first, so the reply is still unread when the request ends
+        connect(reply, &QNetworkReply::finished, [reply, traceId, sent, node, operation, elapsed]() {
+            QVariant status = reply->attribute(QNetworkRequest::HttpStatusCodeAttribute);
+            qint64 received = reply->bytesAvailable();
+            bool failed = reply->error() != QNetworkReply::NoError;
+            SxMetrics::instance().addRequest(node, operation, elapsed.elapsed(), sent, received, failed);
+            if (operation == "BLOCK PUT")
+                SxProfiler::instance().add("block send", elapsed.nsecsElapsed());
+            else if (operation == "BLOCK GET")
+                SxProfiler::instance().add("block receive", elapsed.nsecsElapsed());
+            SxTrace::instance().end(SxTraceEvent::Request, traceId, sent + received,
+                                    status.isValid() ? status.toInt() : -static_cast<int>(reply->error()));
+            SxSyncRecorder::instance().reply(node, operation, status.isValid() ? status.toInt() : -static_cast<int>(reply->error()),
+                                             sent, received, elapsed.elapsed());
+        });
+    }
 
     QTimer *timer = new QTimer(this);
     timer->setSingleShot(true);
+#if QT_VERSION >= QT_VERSION_CHECK(5,5,0)
+    connect(reply, &QNetworkReply::encrypted, [this, reply]() {
+        QByteArray ticket = reply->sslConfiguration().sessionTicket();
+        if (!ticket.isEmpty())
+            mSessionTickets.insert(reply->url().host(), ticket);
+    });
+#endif
     connect(reply, &QNetworkReply::sslErrors, [this, timer, reply](const QList<QSslError> &errors) {
        if (checkSsl(reply, timer, errors))
            reply->ignoreSslErrors();
@@ -617,7 +1094,7 @@ void SxCluster::tryRemoveNetworkAccessManager(QNetworkAccessManager *manager)
 {
     logEntry("");
     bool canDelete = true;
-    foreach (QNetworkReply* reply, mActiveQueries.keys()) {
+    foreach (QNetworkReply* reply, mActiveQueries.keys() + mAsyncTimers.keys()) {
         if (reply->manager() == manager) {
             canDelete = false;
             break;
@@ -631,51 +1108,38 @@ void SxCluster::tryRemoveNetworkAccessManager(QNetworkAccessManager *manager)
         mNetworkManagersToRemove.insert(manager);
 }
 
-bool SxCluster::_filter_data_process(QFile *inFile, QFile *outFile, SxFilter *filter, QString file, bool download)
+bool SxCluster::_hashFilteredData(SxFilterSource *source, int blockSize, QStringList &blocks, qint64 &size)
 {
     logEntry("");
-    Q_UNUSED(file);
-	const int buff_size = 8192;
-	std::unique_ptr<char[]> inbuff(new char[buff_size]);
-	std::unique_ptr<char[]> outbuff(new char[buff_size]);
-
-    //char *inbuff, *outbuff;
-    qint64 bread, bwrite;
-    sxf_action_t action = SXF_ACTION_NORMAL;
-
-    while ((bread = inFile->read(inbuff.get(), buff_size))>0) {
-        if (QCoreApplication::instance()->thread() == QThread::currentThread()){
+    blocks.clear();
+    size = 0;
+    if (blockSize <= 0)
+        return false;
+    const int batchSize = qMax(1, sFilterHashBatchSize / blockSize);
+    SxPooledBuffer buffer(batchSize*blockSize);
+    forever {
+        if (QCoreApplication::instance()->thread() == QThread::currentThread()) {
             QEventLoop loop;
             loop.processEvents(QEventLoop::AllEvents, 10);
         }
         if (aborted())
             return false;
-        if (inFile->pos()==inFile->size())
-            action = SXF_ACTION_DATA_END;
-        do {
-            bwrite = filter->dataProcess(inbuff.get(), bread, outbuff.get(), buff_size, download ? SXF_MODE_DOWNLOAD : SXF_MODE_UPLOAD, &action);
-            if (bwrite < 0) {
-                QString errorMessage = QT_TRANSLATE_NOOP("SxErrorMessage", "Filter %1 dataProcess failed");
-                mLastError = SxError(SxErrorCode::FilterError,
-                                     errorMessage.arg(filter->shortname()),
-                                     QCoreApplication::translate("SxErrorMessage",  errorMessage.toUtf8().constData()).arg(filter->shortname()));
-                return false;
-            }
-            if (outFile->write(outbuff.get(), bwrite) != bwrite) {
-                QString errorMessage = QT_TRANSLATE_NOOP("SxErrorMessage", "Failed to write file %1");
-                mLastError = SxError(SxErrorCode::IOError,
-                                     errorMessage.arg(outFile->fileName()),
-                                     QCoreApplication::translate("SxErrorMessage",  errorMessage.toUtf8().constData()).arg(outFile->fileName()));
-                return false;
-            }
+        qint64 bytes = source->read(buffer.data(), buffer.size());
+        if (bytes < 0) {
+            mLastError = SxError(SxErrorCode::FilterError, "filter data process failed", QCoreApplication::translate("SxErrorMessage", "filter data process failed"));
+            return false;
         }
-        while (action == SXF_ACTION_REPEAT);
-    }
-    if (!outFile->flush()) {
-        QString errorMessage = QT_TRANSLATE_NOOP("SxErrorMessage", "Failed to flush file %1");
-        mLastError = SxError(SxErrorCode::IOError,
-                             errorMessage.arg(outFile->fileName()),
-                             QCoreApplication::translate("SxErrorMessage",  errorMessage.toUtf8().constData()).arg(outFile->fileName()));
+        if (bytes == 0)
+            break;
+        size += bytes;
+        int count = static_cast<int>((bytes + blockSize - 1) / blockSize);
+        if (bytes < static_cast<qint64>(count)*blockSize)
+            memset(buffer.data()+bytes, 0, static_cast<size_t>(static_cast<qint64>(count)*blockSize - bytes));
+        foreach (const QByteArray &hash, SxBlock::hashBlocks(buffer.constData(), count, blockSize, mClusterUuid)) {
+            blocks.append(QString::fromUtf8(hash));
+        }
+        if (bytes < buffer.size())
+            break;
     }
     return true;
 }
@@ -713,6 +1177,7 @@ void SxCluster::storeReplyTime(QNetworkReply *reply)
         if (!property.isValid())
             return;
         int t = static_cast<int>(property.toDateTime().msecsTo(now));
+        storeNodeLatency(reply->url().host(), t);
         if (t>mInitialReplyTimeMax)
             mInitialReplyTimeMax = t;
         ++mInitialReplyTimeCount;
@@ -738,16 +1203,100 @@ void SxCluster::storeReplyTime(QNetworkReply *reply)
     reply->setProperty("progressTime", now);
 }
 
+void SxCluster::storeNodeLatency(const QString &node, int latency)
+{
+    if (!mNodeStats.contains(node)) {
+        mNodeStats.insert(node, {latency, 0});
+        return;
+    }
+    NodeStats &stats = mNodeStats[node];
+    stats.latency = (stats.latency*3 + latency)/4;
+}
+
+void SxCluster::storeNodeThroughput(const QString &node, qint64 bytes, qint64 msecs)
+{
+    if (msecs <= 0 || bytes < sNodeThroughputMinBytes)
+        return;
+    qint64 throughput = bytes*1000/msecs;
+    NodeStats &stats = mNodeStats[node];
+    if (stats.throughput == 0)
+        stats.throughput = throughput;
+    else
+        stats.throughput = (stats.throughput*3 + throughput)/4;
+}
+
+QString SxCluster::selectNode(const QStringList &nodes) const
+{
+    if (nodes.isEmpty())
+        return QString::null;
+    if (nodes.count() == 1)
+        return nodes.first();
+    int bestLatency = -1;
+    bool useThroughput = true;
+    foreach (QString node, nodes) {
+        if (!mNodeStats.contains(node)) {
+            useThroughput = false;
+            continue;
+        }
+        const NodeStats &stats = mNodeStats[node];
+        if (bestLatency < 0 || stats.latency < bestLatency)
+            bestLatency = stats.latency;
+        if (stats.throughput == 0)
+            useThroughput = false;
+    }
+    if (bestLatency < 0)
+        return nodes.value(qrand()%nodes.count());
+
+    // weight replicas by throughput over latency once every node is measured,
+    // before that by inverse square latency with unmeasured nodes treated as the fastest ones
+    QList<double> weights;
+    double sum = 0;
+    foreach (QString node, nodes) {
+        double weight;
+        if (useThroughput) {
+            const NodeStats &stats = mNodeStats[node];
+            weight = stats.throughput/(stats.latency+10.0);
+        }
+        else {
+            int latency = mNodeStats.contains(node) ? mNodeStats.value(node).latency : bestLatency;
+            weight = 1.0/((latency+10.0)*(latency+10.0));
+        }
+        weights.append(weight);
+        sum += weight;
+    }
+    double value = sum*qrand()/(static_cast<double>(RAND_MAX)+1.0);
+    for (int i=0; i<nodes.count(); i++) {
+        value -= weights.at(i);
+        if (value < 0)
+            return nodes.at(i);
+    }
+    return nodes.last();
+}
+
+int SxCluster::nodeLatency(const QString &node) const
+{
+    return mNodeStats.contains(node) ? mNodeStats.value(node).latency : 0;
+}
+
+/* called by the thread running the operations; workers poll a copy of cancelToken() */
 bool SxCluster::aborted() const
 {
-    QMutexLocker locker(&mAbortedMutex);
-    return m_Aborted;
+    return mOperationToken.isCancelled();
 }
 
+/* clearing starts a new operation; a cancelled task token keeps it cancelled */
 void SxCluster::setAborted(bool aborted)
 {
-    QMutexLocker locker(&mAbortedMutex);
-    m_Aborted = aborted;
+    QMutexLocker locker(&mTokenMutex);
+    if (aborted)
+        mOperationToken.cancel();
+    else if (mOperationToken.isCancelled())
+        mOperationToken = mTaskToken.child();
+}
+
+SxCancelToken SxCluster::cancelToken() const
+{
+    return mOperationToken;
 }
 
 bool SxCluster::checkNetworkConfigurationChanged()
@@ -756,6 +1305,11 @@ bool SxCluster::checkNetworkConfigurationChanged()
         return false;
     }
     mNetworkConfiguration = QNetworkInterface::allAddresses();
+    mNodeStats.clear();
+    mHttp2Nodes.clear();
+    SxNodeHealth::instance().reset();
+    SxResolver::instance().clear();
+    invalidateLocateCache();
     if (mUseApplianceNodeList) {
         bool needReinit = false;
         foreach (QString ip, mNodeList) {
@@ -773,10 +1327,7 @@ bool SxCluster::checkNetworkConfigurationChanged()
             mUseApplianceNodeList = false;
             QStringList nodes;
             if (mSxAuth.initialAddress().isEmpty()) {
-                QHostInfo hostInfo = QHostInfo::fromName(mSxAuth.clusterName());
-                foreach (QHostAddress address, hostInfo.addresses()) {
-                    nodes << address.toString();
-                }
+                nodes = SxResolver::instance().resolve(mSxAuth.clusterName());
             }
             else {
                 nodes << mSxAuth.initialAddress();
@@ -845,12 +1396,52 @@ void SxCluster::abortAllQueries()
     emit sig_exit_loop();
 }
 
-QPair<SxQuery *, SxQueryResult *> SxCluster::querySelect(QHash<SxQuery *, QStringList*> &queries, const QString &etag)
+void SxCluster::abortQuery(SxQuery *query)
+{
+    QNetworkReply *reply = mActiveQueries.key(query, nullptr);
+    if (!reply)
+        return;
+    mActiveQueries.remove(reply);
+    QTimer *timer = mActiveTimers.take(reply);
+    if (timer) {
+        timer->stop();
+        timer->deleteLater();
+    }
+    reply->disconnect();
+    if (!reply->isFinished())
+        reply->abort();
+    if (reply->manager() != mNetworkAccessManager)
+        tryRemoveNetworkAccessManager(reply->manager());
+    reply->deleteLater();
+}
+
+QString SxCluster::activeQueryHost(SxQuery *query) const
+{
+    QNetworkReply *reply = mActiveQueries.key(query, nullptr);
+    if (!reply)
+        return QString();
+    return reply->url().host();
+}
+
+QPair<SxQuery *, SxQueryResult *> SxCluster::querySelect(QHash<SxQuery *, QStringList*> &queries, const QString &etag, int wakeupTime, bool *wokenUp)
 {
     logEntry("");
     setAborted(false);
     QEventLoop loop;
     connect(this, &SxCluster::sig_exit_loop, &loop, &QEventLoop::quit);
+    // with wakeupTime set, return with no query once it passes without any reply
+    QTimer wakeup;
+    bool woken = false;
+    if (wokenUp)
+        *wokenUp = false;
+    if (wakeupTime >= 0) {
+        wakeup.setSingleShot(true);
+        connect(&wakeup, &QTimer::timeout, [&loop, &woken]() {
+            woken = true;
+            loop.exit(0);
+        });
+        wakeup.start(wakeupTime);
+    }
     QNetworkReply* currentReply = nullptr;
     SxQuery *currentQuerry = nullptr;
     QSet<QString> activeTargets;
@@ -890,12 +1481,13 @@ QPair<SxQuery *, SxQueryResult *> SxCluster::querySelect(QHash<SxQuery *, QStrin
                 abortAllQueries();
                 return QPair<SxQuery*, SxQueryResult*>(query, result.release());
             }
-            QString target = targetList->takeFirst();
+            QString target = SxNodeHealth::instance().takeTarget(*targetList);
             int delay = 0;
-            if (activeTargets.contains(target)) {
+            if (activeTargets.contains(target) && !mHttp2Nodes.contains(target)) {
                 activeTargets.clear();
                 delay = 50;
             }
+            delay = qMax(delay, qMax(mUploadLimiter.reserve(query->body().size()), mDownloadLimiter.reserve(query->expectedSize())));
             QNetworkRequest req = query->makeRequest(target, mSxAuth, mTimeDrift, etag);
             reply = sendNetworkRequest(query, req, false, delay);
             mActiveQueries.insert(reply, query);
@@ -909,7 +1501,9 @@ QPair<SxQuery *, SxQueryResult *> SxCluster::querySelect(QHash<SxQuery *, QStrin
            loop.exit(0);
         });
     }
-    loop.exec();
+    // a reply may have finished while a delayed request was waiting
+    if (currentReply == nullptr)
+        loop.exec();
     if (aborted()) {
         foreach (QNetworkReply* reply, mActiveQueries.keys()) {
             auto timer = mActiveTimers.take(reply);
@@ -922,6 +1516,13 @@ QPair<SxQuery *, SxQueryResult *> SxCluster::querySelect(QHash<SxQuery *, QStrin
     }
 
     if (currentReply == nullptr) {
+        if (woken) {
+            foreach (QNetworkReply *reply, mActiveQueries.keys()) {
+                disconnect(reply, &QNetworkReply::finished, 0, 0);
+            }
+            if (wokenUp)
+                *wokenUp = true;
+        }
         return QPair<SxQuery *, SxQueryResult *>(nullptr, nullptr);
     }
 
@@ -940,6 +1541,11 @@ QPair<SxQuery *, SxQueryResult *> SxCluster::querySelect(QHash<SxQuery *, QStrin
             mTimeDrift = QDateTime::currentDateTime().secsTo(dt);
     }
     result.reset(processReply(currentReply, mClusterUuid));
+    SxNodeHealth::instance().report(result->host(), result->error().errorCode());
+#if QT_VERSION >= QT_VERSION_CHECK(5,8,0)
+    if (mHttp2Enabled && currentReply->attribute(QNetworkRequest::HTTP2WasUsedAttribute).toBool())
+        mHttp2Nodes.insert(currentReply->url().host());
+#endif
     if (result->error().errorCode() == SxErrorCode::SslError && result->error().errorMessage()=="NULL certificate") {
         if (!currentReply->property("seccondAttempt").isValid()) {
             logWarning(QString("Peer cert is null, retrying to the same node: %1 (%2)").arg(result->host()).arg(currentQuerry->number));
@@ -960,6 +1566,11 @@ QPair<SxQuery *, SxQueryResult *> SxCluster::querySelect(QHash<SxQuery *, QStrin
         }
     }
     if (result->error().errorCode() == SxErrorCode::NoError || result->error().errorCode() == SxErrorCode::NotChanged) {
+        if (currentReply->manager() == mNetworkAccessManager)
+            mNetworkManagerFailures = 0;
+        QVariant startTime = currentReply->property("startTime");
+        if (startTime.isValid())
+            storeNodeThroughput(result->host(), currentQuerry->body().size() + result->data().size(), startTime.toDateTime().msecsTo(QDateTime::currentDateTime()));
         return QPair<SxQuery *, SxQueryResult *>(currentQuerry, result.release());
     }
     static const QList<SxErrorCode> finishOnError = {
@@ -972,7 +1583,9 @@ QPair<SxQuery *, SxQueryResult *> SxCluster::querySelect(QHash<SxQuery *, QStrin
     }
     if (result->error().errorCode() == SxErrorCode::Timeout) {
         logWarning(QString("Connection to %1 timeout (%2)").arg(result->host()).arg(currentQuerry->number));
-        if (currentReply->manager() == mNetworkAccessManager) {
+        if (currentReply->manager() == mNetworkAccessManager && ++mNetworkManagerFailures >= sNetworkManagerMaxFailures) {
+            logWarning("Too many failures, restarting NetworkAccessManager");
+            mNetworkManagerFailures = 0;
             tryRemoveNetworkAccessManager(mNetworkAccessManager);
             mNetworkAccessManager = new QNetworkAccessManager(this);
         }
@@ -985,8 +1598,9 @@ QPair<SxQuery *, SxQueryResult *> SxCluster::querySelect(QHash<SxQuery *, QStrin
         goto sendQueries;
     }
     if (result->error().errorCode() == SxErrorCode::NetworkError) {
-        if (currentReply->manager() == mNetworkAccessManager) {
+        if (currentReply->manager() == mNetworkAccessManager && ++mNetworkManagerFailures >= sNetworkManagerMaxFailures) {
             logWarning("Try to restart NetworkAccessManager");
+            mNetworkManagerFailures = 0;
             tryRemoveNetworkAccessManager(mNetworkAccessManager);
             mNetworkAccessManager = new QNetworkAccessManager(this);
         }
@@ -1116,6 +1730,12 @@ bool SxCluster::checkSsl(QNetworkReply *reply, QTimer* , const QList<QSslError>
             return false;
         }
     }
+    QByteArray verifiedKey = peerCert.toDer();
+    verifiedKey.append(mUseApplianceNodeList ? '\1' : '\0');
+    foreach (const QSslError &error, errors)
+        verifiedKey.append(static_cast<char>(error.error()));
+    if (mVerifiedCerts.contains(verifiedKey))
+        return true;
     for(int i=0; i<errors.size(); i++) {
         if(errors.at(i).error() == QSslError::HostNameMismatch) {
             QString errorMessage;
@@ -1163,19 +1783,25 @@ bool SxCluster::checkSsl(QNetworkReply *reply, QTimer* , const QList<QSslError>
             return false;
         }
     }
+    mVerifiedCerts.insert(verifiedKey);
     return true;
 }
 
 bool SxCluster::_listNodes(QStringList& nodeList)
 {
     logEntry("");
-    QStringList newNodes;
     SxQuery query("/?nodeList", SxQuery::GET, QByteArray());
     std::unique_ptr<SxQueryResult> queryResult(sendQuery(&query, mNodeList));
     if (!queryResult)
         return false;
+    return _listNodesProcessReply(queryResult.get(), nodeList);
+}
+
+bool SxCluster::_listNodesProcessReply(SxQueryResult *queryResult, QStringList &nodeList)
+{
+    QStringList newNodes;
     QJsonDocument json;
-    if (!parseJson(queryResult.get(), json))
+    if (!parseJson(queryResult, json))
         return false;
     {
         if(!json.object().value("nodeList").isArray()) {
@@ -1207,8 +1833,13 @@ bool SxCluster::_getUserDetails(SxUserInfo &userInfo)
     std::unique_ptr<SxQueryResult> queryResult(sendQuery(&query, mNodeList));
     if (!queryResult)
         return false;
+    return _getUserDetailsProcessReply(queryResult.get(), userInfo);
+}
+
+bool SxCluster::_getUserDetailsProcessReply(SxQueryResult *queryResult, SxUserInfo &userInfo)
+{
     QJsonDocument json;
-    if (!parseJson(queryResult.get(), json))
+    if (!parseJson(queryResult, json))
         return false;
     {
         if (json.object().keys().count() != 1) {
@@ -1253,8 +1884,13 @@ bool SxCluster::_listVolumes(QList<SxVolume *> &volumeList)
     std::unique_ptr<SxQueryResult> queryResult(sendQuery(&query, mNodeList));
     if (!queryResult)
         return false;
+    return _listVolumesProcessReply(queryResult.get(), volumeList, true);
+}
+
+bool SxCluster::_listVolumesProcessReply(SxQueryResult *queryResult, QList<SxVolume *> &volumeList, bool removeMissing)
+{
     QJsonDocument json;
-    if (!parseJson(queryResult.get(), json))
+    if (!parseJson(queryResult, json))
         return false;
     {
         if (!json.object().value("volumeList").isObject()) {
@@ -1274,8 +1910,9 @@ bool SxCluster::_listVolumes(QList<SxVolume *> &volumeList)
             }
         }
 
+        // volumes may still be in use while the state is revalidated in the background
         foreach (SxVolume* volume, volumeList) {
-            if (!jList.keys().contains(volume->name())) {
+            if (removeMissing && !jList.keys().contains(volume->name())) {
                 delete volume;
                 volumeList.removeOne(volume);
             }
@@ -1324,17 +1961,31 @@ bool SxCluster::_locateVolume(SxVolume *volume, qint64 fileSize, int *blockSize)
     logEntry("");
     if (!testVolume(volume))
         return false;
+    std::unique_ptr<SxQuery> query(_locateVolumeMakeQuery(volume, fileSize, blockSize));
+    std::unique_ptr<SxQueryResult> queryResult(sendQuery(query.get(), mNodeList));
+    if (!queryResult) {
+        invalidateLocateCache(volume->name());
+        return false;
+    }
+    return _locateVolumeProcessReply(volume, queryResult.get(), fileSize, blockSize);
+}
+
+SxQuery *SxCluster::_locateVolumeMakeQuery(SxVolume *volume, qint64 fileSize, int *blockSize)
+{
     QString queryString = "/"+volume->name()+"?o=locate&volumeMeta&customVolumeMeta";
     if (fileSize && blockSize) {
         queryString+="&size="+QString::number(fileSize);
     }
-    SxQuery query(queryString, SxQuery::GET, QByteArray());
-    std::unique_ptr<SxQueryResult> queryResult(sendQuery(&query, mNodeList));
-    if (!queryResult)
-        return false;
+    return new SxQuery(queryString, SxQuery::GET, QByteArray());
+}
+
+bool SxCluster::_locateVolumeProcessReply(SxVolume *volume, SxQueryResult *queryResult, qint64 fileSize, int *blockSize)
+{
     QJsonDocument json;
-    if (!parseJson(queryResult.get(), json))
+    if (!parseJson(queryResult, json)) {
+        invalidateLocateCache(volume->name());
         return false;
+    }
     {
         if (!json.object().value("nodeList").isArray())
             goto badReplyContent;
@@ -1364,6 +2015,8 @@ bool SxCluster::_locateVolume(SxVolume *volume, qint64 fileSize, int *blockSize)
                     goto badReplyContent;
             }
         }
+        if (volume->nodeList() != nodeList)
+            invalidateLocateCache(volume->name());
         volume->setNodeList(nodeList);
         if (fileSize && blockSize)
             *blockSize = tmpBlockSize;
@@ -1412,11 +2065,72 @@ bool SxCluster::_locateVolume(SxVolume *volume, qint64 fileSize, int *blockSize)
     }
     return true;
     badReplyContent:
+    invalidateLocateCache(volume->name());
     mLastError = SxError::errorBadReplyContent();
     logWarning(mLastError.errorMessage());
     return false;
 }
 
+bool SxCluster::locateVolumeCached(SxVolume *volume, qint64 fileSize, int *blockSize)
+{
+    if (mLocateCacheTime.contains(volume->name()) &&
+            mLocateCacheTime.value(volume->name()).secsTo(QDateTime::currentDateTime()) > sLocateCacheTtl)
+        invalidateLocateCache(volume->name());
+    if (fileSize > 0 && !volume->nodeList().isEmpty()) {
+        foreach (const LocateCacheEntry &entry, mLocateCache.value(volume->name())) {
+            if (fileSize >= entry.minSize && fileSize <= entry.maxSize) {
+                *blockSize = entry.blockSize;
+                return true;
+            }
+        }
+    }
+    if (!_locateVolume(volume, fileSize, blockSize))
+        return false;
+    if (fileSize <= 0)
+        return true;
+    if (!mLocateCacheTime.contains(volume->name()))
+        mLocateCacheTime.insert(volume->name(), QDateTime::currentDateTime());
+    // block size grows with file size, so sizes between two samples share their block size
+    QList<LocateCacheEntry> &entries = mLocateCache[volume->name()];
+    for (int i=0; i<entries.count(); i++) {
+        LocateCacheEntry &entry = entries[i];
+        if (entry.blockSize == *blockSize) {
+            entry.minSize = qMin(entry.minSize, fileSize);
+            entry.maxSize = qMax(entry.maxSize, fileSize);
+            return true;
+        }
+    }
+    entries.append({fileSize, fileSize, *blockSize});
+    return true;
+}
+
+/* block size of a file from the locate cache alone, false when it would take a query */
+bool SxCluster::cachedBlockSize(const QString &volume, qint64 fileSize, int &blockSize) const
+{
+    if (fileSize <= 0 || !mLocateCacheTime.contains(volume) ||
+            mLocateCacheTime.value(volume).secsTo(QDateTime::currentDateTime()) > sLocateCacheTtl)
+        return false;
+    foreach (const LocateCacheEntry &entry, mLocateCache.value(volume)) {
+        if (fileSize >= entry.minSize && fileSize <= entry.maxSize) {
+            blockSize = entry.blockSize;
+            return true;
+        }
+    }
+    return false;
+}
+
+void SxCluster::invalidateLocateCache(const QString &volume)
+{
+    if (volume.isEmpty()) {
+        mLocateCache.clear();
+        mLocateCacheTime.clear();
+    }
+    else {
+        mLocateCache.remove(volume);
+        mLocateCacheTime.remove(volume);
+    }
+}
+
 bool SxCluster::_getClusterMetadata(SxMeta &clusterMeta)
 {
     logEntry("");
@@ -1424,8 +2138,13 @@ bool SxCluster::_getClusterMetadata(SxMeta &clusterMeta)
     std::unique_ptr<SxQueryResult> queryResult(sendQuery(&query, mNodeList));
     if (!queryResult)
         return false;
+    return _getClusterMetadataProcessReply(queryResult.get(), clusterMeta);
+}
+
+bool SxCluster::_getClusterMetadataProcessReply(SxQueryResult *queryResult, SxMeta &clusterMeta)
+{
     QJsonDocument json;
-    if (!parseJson(queryResult.get(), json))
+    if (!parseJson(queryResult, json))
         return false;
     {
         if (!json.object().value("clusterMeta").isObject())
@@ -1455,7 +2174,14 @@ bool SxCluster::_listFiles(SxVolume *volume, QList<SxFileEntry *> &fileList, QSt
     return _listFiles(volume, "", true, fileList, etag, after, limit);
 }
 
-bool SxCluster::_listFiles(SxVolume *volume, const QString pathFilter, bool recursive, QList<SxFileEntry *> &fileList, QString &etag, const QString &after, const qint64 limit)
+bool SxCluster::_listFiles(SxVolume *volume, std::function<bool (QList<SxFileEntry *> &)> consumer, QString &etag)
+{
+    QList<SxFileEntry*> fileList;
+    return _listFiles(volume, "", true, fileList, etag, QString(), 0, consumer);
+}
+
+bool SxCluster::_listFiles(SxVolume *volume, const QString pathFilter, bool recursive, QList<SxFileEntry *> &fileList, QString &etag, const QString &after, const qint64 limit,
+                           std::function<bool(QList<SxFileEntry*>&)> consumer)
 {
     logEntry("");
     if (!testVolume(volume))
@@ -1492,44 +2218,39 @@ bool SxCluster::_listFiles(SxVolume *volume, const QString pathFilter, bool recu
     std::unique_ptr<SxQueryResult> queryResult(sendQuery(&query, volume->nodeList(), etag));
     if (!queryResult)
         return false;
-    QJsonDocument json;
-    if (!parseJson(queryResult.get(), json))
+    if (queryResult->error().errorCode() != SxErrorCode::NoError) {
+        QJsonDocument json;
+        parseJson(queryResult.get(), json);
         return false;
+    }
 
     {
         QList<SxFileEntry *> directories;
         QSet<QString> directoriesInEncryptedDir;
 
-        if (!json.object().value("fileList").isObject())
-            goto badReplyContent;
-        QJsonObject jFileList = json.object().value("fileList").toObject();
-        auto iterator = jFileList.begin();
-        while (iterator != jFileList.end()) {
-            QString path = iterator.key();
+        // large listings are walked entry by entry instead of as a single document
+        SxListingReader reader(queryResult->data());
+        SxFileEntry fileEntry;
+        bool complete;
+        while (reader.next(fileEntry, complete)) {
+            const QString &path = fileEntry.mPath;
+            if (consumer && fileList.count() >= sListBatchSize) {
+                if (!consumer(fileList))
+                    goto aborted;
+                fileList.clear();
+            }
             if (recursive || !path.endsWith("/")) {
-                QJsonObject jFileEntry = iterator.value().toObject();
-                if (!jFileEntry.value("fileSize").isDouble() ||
-                        !jFileEntry.value("blockSize").isDouble() ||
-                        !jFileEntry.value("createdAt").isDouble() ||
-                        !jFileEntry.value("fileRevision").isString() ) {
+                if (!complete)
                     goto badReplyContent;
-                }
-                SxFileEntry *entry = new SxFileEntry();
                 if (!recursive && path.endsWith("/.sxnewdir"))
-                {
-                   delete entry;
-                   goto endBlock;
-                }
-                entry->mPath = path;
-                entry->mSize = jFileEntry.value("fileSize").toVariant().toLongLong();
-                entry->mCreatedAt = jFileEntry.value("createdAt").toVariant().toUInt();
-                entry->mBlockSize = jFileEntry.value("blockSize").toInt();
-                entry->mRevision = jFileEntry.value("fileRevision").toString();
+                    goto endBlock;
+                SxFileEntry *entry = new SxFileEntry(fileEntry);
 
                 if (filter && filter->filemetaProcess()) {
                     SxFile f(volume, entry->mPath, entry->mRevision, false);
-                    if (jFileEntry.value("fileMeta").isObject()) {
-                        if (!_setFileMetadata(f, jFileEntry.value("fileMeta").toObject()))
+                    if (!reader.fileMeta().isEmpty()) {
+                        QJsonObject jMeta = QJsonDocument::fromJson(reader.fileMeta()).object();
+                        if (!_setFileMetadata(f, jMeta))
                             goto clean;
                     }
                     else {
@@ -1624,7 +2345,17 @@ bool SxCluster::_listFiles(SxVolume *volume, const QString pathFilter, bool recu
                 directories.append(entry);
             }
             endBlock:
-            iterator++;
+            continue;
+        }
+        if (reader.failed())
+            goto badReplyContent;
+        if (consumer) {
+            fileList = directories + fileList;
+            if (!fileList.isEmpty() && !consumer(fileList))
+                goto aborted;
+            fileList.clear();
+            etag = queryResult->etag();
+            return true;
         }
         if (filter && filter->filemetaProcess()) {
             auto lessThan = [](SxFileEntry *e1, SxFileEntry *e2) -> bool {
@@ -1640,6 +2371,9 @@ bool SxCluster::_listFiles(SxVolume *volume, const QString pathFilter, bool recu
     }
 
     return true;
+    aborted:
+    mLastError = SxError(SxErrorCode::AbortedByUser, "listing aborted", QCoreApplication::translate("SxErrorMessage", "listing aborted"));
+    goto clean;
     badReplyContent:
     mLastError = SxError::errorBadReplyContent();
     logWarning(mLastError.errorMessage());
@@ -1651,12 +2385,208 @@ bool SxCluster::_listFiles(SxVolume *volume, const QString pathFilter, bool recu
     return false;
 }
 
+bool SxCluster::listFilesPaged(SxVolume *volume, std::function<bool (QList<SxFileEntry *> &)> consumer, QString &etag)
+{
+    logEntry("");
+    if (!testVolume(volume))
+        return false;
+    {
+        // filemeta filters need the whole listing with metadata, keep the single request there
+        std::unique_ptr<SxFilter> filter(SxFilter::getActiveFilter(volume));
+        if (filter && filter->filemetaProcess())
+            return _listFiles(volume, consumer, etag);
+    }
+    FunctionBlocker fb(this, Q_FUNC_INFO);
+    if (fb.exit())
+        return false;
+
+    // pages are chained by 'after', so the volume is split by top level directories instead;
+    // every directory is paged on its own and the directories are fetched concurrently
+    struct Partition {
+        QString prefix;
+        QString after;
+        QList<SxFileEntry*> entries;
+        bool done;
+    };
+    std::vector<Partition> partitions;
+    QString newEtag;
+    SxFileEntry fileEntry;
+    bool complete;
+    QJsonDocument json;
+    {
+        SxQuery query("/"+volume->name()+"?o=list&recursive", SxQuery::HEAD, QByteArray());
+        std::unique_ptr<SxQueryResult> queryResult(sendQuery(&query, volume->nodeList(), etag));
+        if (!queryResult)
+            return false;
+        if (queryResult->error().errorCode() != SxErrorCode::NoError) {
+            parseJson(queryResult.get(), json);
+            return false;
+        }
+        newEtag = queryResult->etag();
+    }
+    {
+        SxQuery query("/"+volume->name()+"?o=list", SxQuery::GET, QByteArray());
+        std::unique_ptr<SxQueryResult> queryResult(sendQuery(&query, volume->nodeList()));
+        if (!queryResult)
+            return false;
+        if (queryResult->error().errorCode() != SxErrorCode::NoError) {
+            parseJson(queryResult.get(), json);
+            return false;
+        }
+        SxListingReader reader(queryResult->data());
+        while (reader.next(fileEntry, complete)) {
+            if (fileEntry.path().endsWith("/")) {
+                partitions.push_back({fileEntry.path(), QString(), {}, false});
+                continue;
+            }
+            if (!complete) {
+                mLastError = SxError::errorBadReplyContent();
+                break;
+            }
+            if (partitions.empty() || !partitions.back().prefix.isEmpty())
+                partitions.push_back({QString(), QString(), {}, true});
+            partitions.back().entries.append(new SxFileEntry(fileEntry));
+        }
+        if (reader.failed())
+            mLastError = SxError::errorBadReplyContent();
+    }
+
+    QStringList nodes = volume->nodeList();
+    int concurrency = qBound(1, nodes.count(), sListMaxParallelPages);
+    int inFlight = 0;
+    size_t launchIndex = 0;
+    size_t emitIndex = 0;
+    bool failed = mLastError.errorCode() != SxErrorCode::NoError;
+    QList<SxFileEntry*> batch;
+    QEventLoop loop;
+
+    // entries are handed over in listing order, whatever order the pages arrive in
+    auto emitReady = [&]() -> bool {
+        while (emitIndex < partitions.size()) {
+            Partition &p = partitions[emitIndex];
+            batch.append(p.entries);
+            p.entries.clear();
+            if (batch.count() >= sListBatchSize) {
+                bool result = consumer(batch);
+                batch.clear();
+                if (!result)
+                    return false;
+            }
+            if (!p.done)
+                break;
+            ++emitIndex;
+        }
+        return true;
+    };
+    std::function<void(size_t)> requestPage = [&](size_t index) {
+        const Partition &p = partitions[index];
+        QString queryString = "/"+volume->name()+"?o=list&recursive&filter="+QUrl::toPercentEncoding(p.prefix, "/");
+        queryString += QString("&limit=%1").arg(sListPageSize);
+        if (!p.after.isEmpty())
+            queryString += "&after="+QUrl::toPercentEncoding(p.after.mid(1), "/");
+        int shift = static_cast<int>(index % static_cast<size_t>(nodes.count()));
+        QStringList targets = nodes.mid(shift) + nodes.mid(0, shift);
+        ++inFlight;
+        sendQueryAsync(new SxQuery(queryString, SxQuery::GET, QByteArray()), targets, [&, index](SxQueryResult *result) {
+            std::unique_ptr<SxQueryResult> queryResult(result);
+            --inFlight;
+            Partition &p = partitions[index];
+            int count = 0;
+            if (!failed && aborted()) {
+                mLastError = SxError(SxErrorCode::AbortedByUser, "listing aborted", QCoreApplication::translate("SxErrorMessage", "listing aborted"));
+                failed = true;
+            }
+            else if (!failed && queryResult->error().errorCode() != SxErrorCode::NoError) {
+                parseJson(queryResult.get(), json);
+                failed = true;
+            }
+            else if (!failed) {
+                SxListingReader reader(queryResult->data());
+                while (reader.next(fileEntry, complete)) {
+                    ++count;
+                    p.after = fileEntry.path();
+                    if (!fileEntry.path().startsWith(p.prefix))
+                        continue;
+                    if (!complete) {
+                        failed = true;
+                        break;
+                    }
+                    p.entries.append(new SxFileEntry(fileEntry));
+                }
+                if (failed || reader.failed()) {
+                    mLastError = SxError::errorBadReplyContent();
+                    logWarning(mLastError.errorMessage());
+                    failed = true;
+                }
+            }
+            if (!failed) {
+                if (count < sListPageSize)
+                    p.done = true;
+                else
+                    requestPage(index);
+                if (!emitReady()) {
+                    mLastError = SxError(SxErrorCode::AbortedByUser, "listing aborted", QCoreApplication::translate("SxErrorMessage", "listing aborted"));
+                    failed = true;
+                }
+            }
+            while (!failed && inFlight < concurrency && launchIndex < partitions.size()) {
+                if (!partitions[launchIndex].done)
+                    requestPage(launchIndex);
+                ++launchIndex;
+            }
+            if (inFlight == 0)
+                loop.quit();
+        });
+    };
+
+    setAborted(false);
+    while (!failed && inFlight < concurrency && launchIndex < partitions.size()) {
+        if (!partitions[launchIndex].done)
+            requestPage(launchIndex);
+        ++launchIndex;
+    }
+    if (!failed && !emitReady()) {
+        mLastError = SxError(SxErrorCode::AbortedByUser, "listing aborted", QCoreApplication::translate("SxErrorMessage", "listing aborted"));
+        failed = true;
+    }
+    // the callbacks refer to this frame, never leave it with a page in flight
+    if (inFlight > 0)
+        loop.exec();
+    if (!failed && !batch.isEmpty()) {
+        if (!consumer(batch)) {
+            mLastError = SxError(SxErrorCode::AbortedByUser, "listing aborted", QCoreApplication::translate("SxErrorMessage", "listing aborted"));
+            failed = true;
+        }
+    }
+    foreach (SxFileEntry *entry, batch) {
+        delete entry;
+    }
+    for (Partition &p : partitions) {
+        foreach (SxFileEntry *entry, p.entries) {
+            delete entry;
+        }
+    }
+    if (failed)
+        return false;
+    etag = newEtag;
+    return true;
+}
+
 bool SxCluster::_getFile(SxFile &file, bool silence)
 {
     logEntry("");
     if(!testFile(file))
         return false;
 
+    std::unique_ptr<SxQuery> query(_getFileMakeQuery(file));
+    std::unique_ptr<SxQueryResult> queryResult(sendQuery(query.get(), file.mVolume->nodeList()));
+    if (!queryResult)
+        return false;
+    return _getFileProcessReply(file, queryResult.get(), silence);
+}
+
+SxQuery *SxCluster::_getFileMakeQuery(SxFile &file)
+{
     QString queryString = "/"+file.mVolume->name();
     if (file.mRemotePath.startsWith("/"))
         queryString += QUrl::toPercentEncoding(file.mRemotePath, "/");
@@ -1664,14 +2594,34 @@ bool SxCluster::_getFile(SxFile &file, bool silence)
         queryString += "/"+QUrl::toPercentEncoding(file.mRemotePath, "/");
     if (!file.mRevision.isEmpty())
         queryString += "?rev="+file.mRevision;
+    return new SxQuery(queryString, SxQuery::GET, QByteArray());
+}
 
-    SxQuery query(queryString, SxQuery::GET, QByteArray());
-    std::unique_ptr<SxQueryResult> queryResult(sendQuery(&query, file.mVolume->nodeList()));
-    if (!queryResult)
-        return false;
-
+bool SxCluster::_getFileProcessReply(SxFile &file, SxQueryResult *queryResult, bool silence)
+{
+    if (queryResult->error().errorCode() == SxErrorCode::NoError) {
+        // block lists of large files are decoded without a document tree,
+        // anything unexpected is left to the generic parser below
+        SxFileDataReader reader(queryResult->data());
+        QString blockHash;
+        QStringList blockNodes;
+        file.clearBlocks();
+        while (reader.next(blockHash, blockNodes))
+            file.appendBlock(blockHash, blockNodes);
+        qint64 size = reader.fileSize();
+        int blockSize = reader.blockSize();
+        if (reader.complete() && blockSize > 0 &&
+                reader.blockCount() == size/blockSize + (size%blockSize?1:0)) {
+            file.mRevision = reader.revision();
+            file.mRemoteSize = size;
+            file.mCreatedAt = reader.createdAt();
+            file.mBlockSize = blockSize;
+            return true;
+        }
+        file.clearBlocks();
+    }
     QJsonDocument json;
-    if (!parseJson(queryResult.get(), json, silence))
+    if (!parseJson(queryResult, json, silence))
         return false;
 
     {
@@ -1776,8 +2726,20 @@ bool SxCluster::_setFileMetadata(SxFile &file, const QJsonObject &jMeta)
 bool SxCluster::_initializeFile(SxFile &file)
 {
     logEntry("");
+    sxProfile("initialize file");
     if(!testFile(file))
         return false;
+    std::unique_ptr<SxQuery> query(_initializeFileMakeQuery(file));
+    if (!query)
+        return false;
+    std::unique_ptr<SxQueryResult> queryResult(sendQuery(query.get(), file.mVolume->nodeList()));
+    if (!queryResult)
+        return false;
+    return _initializeFileProcessReply(file, queryResult.get());
+}
+
+SxQuery *SxCluster::_initializeFileMakeQuery(SxFile &file)
+{
     QString queryString = "/"+file.mVolume->name();
     if (file.mRemotePath.startsWith("/"))
         queryString += QUrl::toPercentEncoding(file.mRemotePath, "/");
@@ -1790,7 +2752,7 @@ bool SxCluster::_initializeFile(SxFile &file)
         if (blockCount != file.mBlocks.count()) {
             mLastError = SxError(SxErrorCode::UnknownError, "file size/blocks mismatch", QCoreApplication::translate("SxErrorMessage",  "file size/blocks mismatch"));
             logWarning(mLastError.errorMessage());
-            return false;
+            return nullptr;
         }
     }
 
@@ -1821,12 +2783,13 @@ bool SxCluster::_initializeFile(SxFile &file)
     }
 
     QJsonDocument jRequest(jObject);
-    SxQuery query(queryString, SxQuery::PUT, jRequest.toJson());
-    std::unique_ptr<SxQueryResult> queryResult(sendQuery(&query, file.mVolume->nodeList()));
-    if (!queryResult)
-        return false;
+    return new SxQuery(queryString, SxQuery::PUT, jRequest.toJson());
+}
+
+bool SxCluster::_initializeFileProcessReply(SxFile &file, SxQueryResult *queryResult)
+{
     QJsonDocument json;
-    if (!parseJson(queryResult.get(), json))
+    if (!parseJson(queryResult, json))
         return false;
 
     if (!json.object().value("uploadToken").isString()
@@ -1844,12 +2807,13 @@ bool SxCluster::_initializeFile(SxFile &file)
                     jUploadData.value(hash).toArray().count()==0)
                 goto badReplyContent;
             QJsonArray jNodes = jUploadData.value(hash).toArray();
-            block->mNodeList.clear();
+            QStringList nodeList;
             foreach (QJsonValue jNode, jNodes) {
                 if (!jNode.isString() || jNode.toString().isEmpty())
                     goto badReplyContent;
-                block->mNodeList.append(jNode.toString());
+                nodeList.append(jNode.toString());
             }
+            block->mNodeList = file.sharedNodeList(nodeList);
             file.mBlocksToSend.append(block);
         }
     }
@@ -1904,12 +2868,13 @@ bool SxCluster::_initializeFileAddChunk(SxFile &file, int extendSeq)
                     jUploadData.value(hash).toArray().count()==0)
                 goto badReplyContent;
             QJsonArray jNodes = jUploadData.value(hash).toArray();
-            block->mNodeList.clear();
+            QStringList nodeList;
             foreach (QJsonValue jNode, jNodes) {
                 if (!jNode.isString() || jNode.toString().isEmpty())
                     goto badReplyContent;
-                block->mNodeList.append(jNode.toString());
+                nodeList.append(jNode.toString());
             }
+            block->mNodeList = file.sharedNodeList(nodeList);
             file.mBlocksToSend.append(block);
         }
     }
@@ -1944,13 +2909,24 @@ bool SxCluster::_createBlocks(const QString &uploadToken, const int blockSize, c
 
 bool SxCluster::_flushFile(SxFile& file, SxJob &job)
 {
-    QString queryString = QString("/.upload/%1").arg(file.mUploadToken);
-    SxQuery query(queryString, SxQuery::JOB_PUT, QByteArray());
-    std::unique_ptr<SxQueryResult> queryResult(sendQuery(&query, {file.mUploadPollTarget}));
+    sxProfile("flush file");
+    std::unique_ptr<SxQuery> query(_flushFileMakeQuery(file));
+    std::unique_ptr<SxQueryResult> queryResult(sendQuery(query.get(), {file.mUploadPollTarget}));
     if (!queryResult)
         return false;
+    return _flushFileProcessReply(file, queryResult.get(), job);
+}
+
+SxQuery *SxCluster::_flushFileMakeQuery(SxFile &file)
+{
+    QString queryString = QString("/.upload/%1").arg(file.mUploadToken);
+    return new SxQuery(queryString, SxQuery::JOB_PUT, QByteArray());
+}
+
+bool SxCluster::_flushFileProcessReply(SxFile &file, SxQueryResult *queryResult, SxJob &job)
+{
     QJsonDocument json;
-    if (!parseJson(queryResult.get(), json))
+    if (!parseJson(queryResult, json))
         return false;
     if (json.object().value("requestId").toString("").isEmpty() ||
             json.object().value("minPollInterval").toInt(0) <= 0 ||
@@ -1965,17 +2941,30 @@ bool SxCluster::_flushFile(SxFile& file, SxJob &job)
 
 bool SxCluster::_poll(SxJob &job)
 {
+    sxProfile("poll");
     if (aborted())
         return false;
-    if (job.mRequestId.isEmpty())
+    std::unique_ptr<SxQuery> query(_pollMakeQuery(job));
+    if (!query)
         return false;
-    QString queryString = QString("/.results/%1").arg(job.mRequestId);
-    SxQuery query(queryString, SxQuery::GET, QByteArray());
-    std::unique_ptr<SxQueryResult> queryResult(sendQuery(&query, {job.mTarget}));
+    std::unique_ptr<SxQueryResult> queryResult(sendQuery(query.get(), {job.mTarget}));
     if (!queryResult)
         return false;
+    return _pollProcessReply(job, queryResult.get());
+}
+
+SxQuery *SxCluster::_pollMakeQuery(const SxJob &job)
+{
+    if (job.mRequestId.isEmpty())
+        return nullptr;
+    QString queryString = QString("/.results/%1").arg(job.mRequestId);
+    return new SxQuery(queryString, SxQuery::GET, QByteArray());
+}
+
+bool SxCluster::_pollProcessReply(SxJob &job, SxQueryResult *queryResult)
+{
     QJsonDocument json;
-    if (!parseJson(queryResult.get(), json))
+    if (!parseJson(queryResult, json))
         return false;
     static const QStringList statusList = {"OK", "ERROR", "PENDING"};
     if (json.object().value("requestId").toString("")!=job.mRequestId ||
@@ -2004,17 +2993,27 @@ bool SxCluster::_deleteFile(SxFile &file, SxJob &job)
     if (!testFile(file))
         return false;
 
+    std::unique_ptr<SxQuery> query(_deleteFileMakeQuery(file));
+    std::unique_ptr<SxQueryResult> queryResult(sendQuery(query.get(), file.mVolume->nodeList()));
+    if (!queryResult)
+        return false;
+    return _deleteFileProcessReply(queryResult.get(), job);
+}
+
+SxQuery *SxCluster::_deleteFileMakeQuery(SxFile &file)
+{
     QString remotePath = QString::fromUtf8(QUrl::toPercentEncoding(file.mRemotePath, "/"));
     if (remotePath.startsWith("/")) {
         remotePath = remotePath.mid(1);
     }
     QString queryString = QString("/%1/%2").arg(file.mVolume->name()).arg(remotePath);
-    SxQuery query(queryString, SxQuery::JOB_DELETE, QByteArray());
-    std::unique_ptr<SxQueryResult> queryResult(sendQuery(&query, file.mVolume->nodeList()));
-    if (!queryResult)
-        return false;
+    return new SxQuery(queryString, SxQuery::JOB_DELETE, QByteArray());
+}
+
+bool SxCluster::_deleteFileProcessReply(SxQueryResult *queryResult, SxJob &job)
+{
     QJsonDocument json;
-    if (!parseJson(queryResult.get(), json))
+    if (!parseJson(queryResult, json))
         return false;
     if (json.object().value("requestId").toString("").isEmpty() ||
             json.object().value("minPollInterval").toInt(0) <= 0 ||
@@ -2179,7 +3178,11 @@ SxQuery *SxCluster::_getBlocksMakeQuery(const QList<SxBlock *> &blockList, const
     foreach (QString key, keys) {
         queryString+=key;
     }
-    return new SxQuery(queryString, SxQuery::GET, QByteArray());
+    {
+        SxQuery *query = new SxQuery(queryString, SxQuery::GET, QByteArray());
+        query->setExpectedSize(static_cast<qint64>(keys.count())*blockSize);
+        return query;
+    }
 
     invalidArgument:
     mLastError = SxError(SxErrorCode::UnknownError, "invalid blocks list", QCoreApplication::translate("SxErrorMessage", "invalid blocks list"));
@@ -2188,6 +3191,14 @@ SxQuery *SxCluster::_getBlocksMakeQuery(const QList<SxBlock *> &blockList, const
 }
 
 bool SxCluster::_getBlocksProcessReply(SxQueryResult *queryResult, const int blockSize, QStringList &keys, QHash<QString, SxBlock *> &hash)
+{
+    return _getBlocksProcessReply(queryResult, blockSize, keys, hash, [blockSize](SxBlock *block, const char *data) -> bool {
+        block->mData = QByteArray(data, blockSize);
+        return true;
+    });
+}
+
+bool SxCluster::_getBlocksProcessReply(SxQueryResult *queryResult, const int blockSize, QStringList &keys, QHash<QString, SxBlock *> &hash, std::function<bool(SxBlock *, const char *)> processBlock)
 {
     logEntry("");
     const QByteArray& data = queryResult->data();
@@ -2199,7 +3210,8 @@ bool SxCluster::_getBlocksProcessReply(SxQueryResult *queryResult, const int blo
         QString key = keys.at(i);
         SxBlock *block = hash.value(key);
         int offset = i*blockSize;
-        block->mData = data.mid(offset, blockSize);
+        if (!processBlock(block, data.constData()+offset))
+            return false;
     }
     return true;
     badReplyContent:
@@ -2208,6 +3220,35 @@ bool SxCluster::_getBlocksProcessReply(SxQueryResult *queryResult, const int blo
     return false;
 }
 
+/* rehashes the blocks of a reply, split across the global thread pool;
+ * the returned keys are those whose data doesn't match */
+QSet<QString> SxCluster::_corruptBlocks(SxQueryResult *query, const int blockSize, const QStringList &keys)
+{
+    QSet<QString> corrupt;
+    const QByteArray &data = query->data();
+    const int blockCount = keys.count();
+    if (blockSize <= 0 || data.count() != blockCount*blockSize)
+        return corrupt;
+    auto hashRange = [&data, blockSize, this](int first, int last) -> QList<QByteArray> {
+        return SxBlock::hashBlocks(data.constData()+static_cast<qint64>(first)*blockSize, last-first, blockSize, mClusterUuid);
+    };
+    const int rangeSize = qMax(1, sVerifyRangeSize/blockSize);
+    QList<QFuture<QList<QByteArray>>> futures;
+    for (int first=rangeSize; first<blockCount; first+=rangeSize) {
+        futures.append(QtConcurrent::run(hashRange, first, qMin(first+rangeSize, blockCount)));
+    }
+    // the first range is hashed on this thread
+    QList<QByteArray> hashes = hashRange(0, qMin(rangeSize, blockCount));
+    foreach (auto future, futures) {
+        hashes.append(future.result());
+    }
+    for (int i=0; i<blockCount; i++) {
+        if (QString::fromUtf8(hashes.at(i)) != keys.at(i))
+            corrupt.insert(keys.at(i));
+    }
+    return corrupt;
+}
+
 void SxCluster::setFilterInputCallback(std::function<int(sx_input_args &)> get_input)
 {
     logEntry("");
@@ -2226,11 +3267,94 @@ void SxCluster::setFindIdenticalFilesCallback(std::function<bool(const QString&,
     mFindIdenticalFilesCallback = callback;
 }
 
+void SxCluster::setFindCopySourceCallback(std::function<bool(const QString&, const QString&, const QString&, qint64, int&, QStringList&)> callback)
+{
+    logEntry("");
+    mFindCopySourceCallback = callback;
+}
+
+void SxCluster::setKnownBlocksCallback(std::function<bool (const QString &, const QString &, int, QVector<QPair<quint64, QString> > &)> callback)
+{
+    logEntry("");
+    mKnownBlocksCallback = callback;
+}
+
+void SxCluster::setUploadStateCallbacks(std::function<bool (const QString &, const QString &, SxUploadState &)> loadState, std::function<void (const QString &, const QString &, const SxUploadState *)> storeState)
+{
+    logEntry("");
+    mLoadUploadState = loadState;
+    mStoreUploadState = storeState;
+}
+
+/* called with the temporary file and its destination right before a download is renamed into place */
+void SxCluster::setCommitCallback(std::function<void (const QString &, const QString &)> callback)
+{
+    logEntry("");
+    mCommitCallback = callback;
+}
+
+/* the token of the task the following operations belong to, cancelling it cancels them */
+void SxCluster::setCancelToken(const SxCancelToken &token)
+{
+    QMutexLocker locker(&mTokenMutex);
+    mTaskToken = token;
+    mOperationToken = token.child();
+}
+
+void SxCluster::setHttp2Enabled(bool enabled)
+{
+    logEntry(enabled ? "true" : "false");
+#if QT_VERSION >= QT_VERSION_CHECK(5,8,0)
+    mHttp2Enabled = enabled;
+#else
+    if (enabled)
+        logWarning("HTTP/2 requires Qt 5.8 or newer");
+#endif
+    if (!mHttp2Enabled)
+        mHttp2Nodes.clear();
+}
+
+void SxCluster::setBandwidthLimits(qint64 uploadLimit, qint64 downloadLimit)
+{
+    if (uploadLimit != mUploadLimiter.rate() || downloadLimit != mDownloadLimiter.rate())
+        logInfo(QString("bandwidth limits, upload: %1, download: %2").arg(uploadLimit).arg(downloadLimit));
+    mUploadLimiter.setRate(uploadLimit);
+    mDownloadLimiter.setRate(downloadLimit);
+    // every profile and connection to this cluster draws from the same limit
+    if (!mClusterUuid.isEmpty()) {
+        mUploadLimiter.setShareKey("sxbandwidth-up-"+QString::fromLatin1(mClusterUuid));
+        mDownloadLimiter.setShareKey("sxbandwidth-down-"+QString::fromLatin1(mClusterUuid));
+    }
+}
+
+void SxCluster::setDeltaDownload(bool enabled)
+{
+    logEntry(enabled ? "true" : "false");
+    mDeltaDownload = enabled;
+}
+
+qint64 SxCluster::lastUploadSavedBytes() const
+{
+    return mLastUploadSavedBytes;
+}
+
+void SxCluster::setUploadConnectionLimit(int connectionLimit, int nodeConnectionLimit)
+{
+    logEntry(QString("connectionLimit: %1, nodeConnectionLimit: %2").arg(connectionLimit).arg(nodeConnectionLimit));
+    mUploadConnectionLimit = connectionLimit > 0 ? connectionLimit : sUploadConnectionLimit;
+    mUploadNodeConnectionLimit = nodeConnectionLimit > 0 ? nodeConnectionLimit : sUploadNodeConnectionLimit;
+}
+
 SxError SxCluster::lastError() const
 {
     return mLastError;
 }
 
+void SxCluster::clearLastError()
+{
+    mLastError = SxError();
+}
+
 int SxCluster::getInput(sx_input_args &args) const
 {
     logEntry("");
@@ -2250,16 +3374,15 @@ bool SxCluster::reloadClusterNodes()
 
     QStringList nodes;
     if (mSxAuth.initialAddress().isEmpty()) {
-        QHostInfo hostInfo = QHostInfo::fromName(mSxAuth.clusterName());
-        foreach (QHostAddress address, hostInfo.addresses()) {
-            nodes << address.toString();
-        }
+        nodes = SxResolver::instance().resolve(mSxAuth.clusterName());
     }
     else {
         nodes << mSxAuth.initialAddress();
     }
 
     if (_listNodes(nodes)) {
+        if (mNodeList != nodes)
+            invalidateLocateCache();
         mNodeList = nodes;
         return true;
     }
@@ -2272,14 +3395,61 @@ bool SxCluster::reloadVolumes()
     if (fb.exit())
         return false;
     logEntry("");
+    if (mVolumesFromCache) {
+        // the restored volumes are revalidated in the background
+        mVolumesFromCache = false;
+        return true;
+    }
     if (!_listVolumes(mVolumeList)) {
         return false;
     }
-    foreach (SxVolume* vol, mVolumeList) {
-        if (!_locateVolume(vol, 0,0 ))
-            return false;
+    // up to sLocateWindow volumes are located at once, each volume starts on the next node
+    // so the queries are spread over the cluster instead of queueing on its first node
+    QHash<SxQuery*, QStringList*> queries;
+    QHash<SxQuery*, SxVolume*> queryVolumes;
+    QList<SxVolume*> toLocate = mVolumeList;
+    int nextNode = 0;
+    bool located = true;
+    while (!toLocate.isEmpty() || !queries.isEmpty()) {
+        while (!toLocate.isEmpty() && queries.size() < sLocateWindow) {
+            SxVolume *vol = toLocate.takeFirst();
+            QStringList *targets = new QStringList(mNodeList);
+            for (int i=0; !targets->isEmpty() && i<nextNode%targets->size(); i++) {
+                targets->append(targets->takeFirst());
+            }
+            ++nextNode;
+            SxQuery *query = _locateVolumeMakeQuery(vol, 0, nullptr);
+            queries.insert(query, targets);
+            queryVolumes.insert(query, vol);
+        }
+        auto selectResult = querySelect(queries);
+        std::unique_ptr<SxQueryResult> queryResult(selectResult.second);
+        if (!queryResult || selectResult.first == nullptr) {
+            if (queryResult)
+                mLastError = queryResult->error();
+            located = false;
+            break;
+        }
+        SxQuery *query = selectResult.first;
+        delete queries.take(query);
+        SxVolume *volume = queryVolumes.take(query);
+        delete query;
+        if (!_locateVolumeProcessReply(volume, queryResult.get(), 0, nullptr)) {
+            located = false;
+            break;
+        }
     }
-    return true;
+    if (!queries.isEmpty()) {
+        foreach (SxQuery* query, queries.keys()) {
+            delete queries.value(query);
+            delete query;
+        }
+        abortAllQueries();
+        return false;
+    }
+    if (located)
+        storeBootstrapState();
+    return located;
 }
 
 bool SxCluster::reloadClusterMeta()
@@ -2302,6 +3472,7 @@ bool SxCluster::uploadFile(SxVolume *volume, QString path, QString localFile, Sx
         return false;
     logInfo(QString("start upload, volume: %1, file: %2").arg(volume->name()).arg(path));
     setAborted(false);
+    PageCacheRelease cacheRelease(localFile);
     QFileInfo fileInfo(localFile);
     if (!fileInfo.exists()) {
         logWarning("FILE " + localFile + " doesn't exists");
@@ -2313,8 +3484,6 @@ bool SxCluster::uploadFile(SxVolume *volume, QString path, QString localFile, Sx
         mLastError = SxError(SxErrorCode::UnknownError, "file size is too large", QCoreApplication::translate("SxErrorMessage", "file size is too large"));
         return false;
     }
-    QTemporaryFile tmpFile(fileInfo.absolutePath() + "/._sdrvtmpXXXXXX");
-    QString dataPath = localFile;
     std::unique_ptr<SxFilter> filter(SxFilter::getActiveFilter(volume));
     if (filter && filter->dataPrepare()) {
         uint counter = volume->customMeta().changeCounter();
@@ -2328,27 +3497,6 @@ bool SxCluster::uploadFile(SxVolume *volume, QString path, QString localFile, Sx
             logWarning(mLastError.errorMessage());
             return false;
         }
-        if (filter->dataProcess()) {
-            QFile inputFile(localFile);
-            if (!inputFile.open(QIODevice::ReadOnly)) {
-                logWarning("unable to open file" + inputFile.fileName());
-                return false;
-            }
-            XFile::makeInvisible(tmpFile.fileName(), true);
-            if (!tmpFile.open()) {
-                logWarning("unable to open file" + tmpFile.fileName());
-                return false;
-            }
-            if (!_filter_data_process(&inputFile, &tmpFile, filter.get(), path, false)) {
-                logWarning("data process failed");
-                return false;
-            }
-            inputFile.close();
-            tmpFile.close();
-            dataPath = tmpFile.fileName();
-            if (callback)
-                pollUploadJobs(sUploadJobsLimit, callback);
-        }
         if (counter != volume->customMeta().changeCounter()) {
             if (!_setVolumeCustomMeta(volume)) {
                 return false;
@@ -2356,31 +3504,115 @@ bool SxCluster::uploadFile(SxVolume *volume, QString path, QString localFile, Sx
         }
     }
 
-    int blockSize = 0;
-    if (!_locateVolume(volume, QFile(dataPath).size(), &blockSize))
-        return false;
-
     fileInfo.refresh();
     uint mtime = fileInfo.lastModified().toTime_t();
-    SxFile file(volume, path, mClusterUuid, dataPath, blockSize, QFile(localFile).size(), [this]()->bool {return aborted();}, multipart);
+    int blockSize = 0;
+    std::unique_ptr<SxFilterSource> filterSource;
+    QStringList filteredBlocks;
+    qint64 filteredSize = 0;
+    // a copy of an already synchronised file takes over its block list instead of being hashed
+    int copyBlockSize = 0;
+    QStringList copyBlocks;
+    bool copied = !filter && !multipart && mFindCopySourceCallback && fileInfo.size() > 0 &&
+            mFindCopySourceCallback(volume->name(), path, localFile, fileInfo.size(), copyBlockSize, copyBlocks);
+    if (filter && filter->dataProcess()) {
+        // the processed data is hashed here and produced again while uploading, never stored on disk
+        filterSource.reset(new SxFilterSource(volume, path, localFile));
+        if (!filterSource->open() || !locateVolumeCached(volume, fileInfo.size(), &blockSize)) {
+            if (mLastError.errorCode() == SxErrorCode::NoError) {
+                QString message = QT_TRANSLATE_NOOP("SxErrorMessage", "Filter %1 dataProcess failed");
+                mLastError = SxError(SxErrorCode::FilterError, message.arg(filter->shortname()), QCoreApplication::translate("SxErrorMessage", message.toUtf8().constData()).arg(filter->shortname()));
+            }
+            return false;
+        }
+        forever {
+            if (!_hashFilteredData(filterSource.get(), blockSize, filteredBlocks, filteredSize))
+                return false;
+            int filteredBlockSize = 0;
+            if (!locateVolumeCached(volume, filteredSize, &filteredBlockSize))
+                return false;
+            if (filteredBlockSize == blockSize)
+                break;
+            blockSize = filteredBlockSize;
+            if (!filterSource->rewind()) {
+                mLastError = SxError(SxErrorCode::IOError, "unable to read file", "unable to read file");
+                return false;
+            }
+        }
+    }
+    else if (!locateVolumeCached(volume, fileInfo.size(), &blockSize))
+        return false;
+    if (copied && copyBlockSize != blockSize)
+        copied = false;
+    if (copied)
+        logVerbose(QString("file %1 is a copy of a synchronised file").arg(path));
+    // blocks unchanged since the last upload are not hashed again
+    QVector<QPair<quint64, QString>> knownBlocks;
+    if (!filterSource && !copied && mKnownBlocksCallback && fileInfo.size() > blockSize)
+        mKnownBlocksCallback(volume->name(), path, blockSize, knownBlocks);
+
+    std::unique_ptr<SxFile> uploadedFile(filterSource ?
+                                             new SxFile(volume, path, mClusterUuid, filteredBlocks, blockSize, filteredSize, fileInfo.size(), multipart) :
+                                         copied ?
+                                             new SxFile(volume, path, mClusterUuid, copyBlocks, blockSize, fileInfo.size(), fileInfo.size()) :
+                                             new SxFile(volume, path, mClusterUuid, localFile, blockSize, fileInfo.size(), cancelToken(), multipart, knownBlocks));
+    SxFile &file = *uploadedFile;
     if (aborted())
         return false;
     if (!file.multipart()) {
+        // probe for an identical remote file and initialize the upload at the same time,
+        // an unused upload token simply expires on the server
         SxFile remoteFile(volume, path, "", true);
-        if (_getFile(remoteFile, true)) {
-            if (file.haveEqualContent(remoteFile)) {
-                fileEntry.mPath = path;
-                fileEntry.mRevision = remoteFile.mRevision;
-                fileEntry.mCreatedAt = fileInfo.lastModified().toTime_t();
-                fileEntry.mSize = remoteFile.mRemoteSize;
-                fileEntry.mBlockSize = remoteFile.mBlockSize;
-                fileEntry.mBlocks.clear();
-                foreach(auto block, remoteFile.mBlocks) {
-                    fileEntry.mBlocks.append(block->mHash);
-                }
-                logVerbose(QString("skiping upload of file %1").arg(path));
-                return true;
-            }
+        std::unique_ptr<SxQuery> getQuery(_getFileMakeQuery(remoteFile));
+        std::unique_ptr<SxQuery> initQuery(_initializeFileMakeQuery(file));
+        if (!testFile(file) || !initQuery) {
+            fileEntry.mSize = file.mRemoteSize;
+            return false;
+        }
+        QStringList getTargets = volume->nodeList();
+        QStringList initTargets = volume->nodeList();
+        QHash<SxQuery*, QStringList*> queries;
+        queries.insert(getQuery.get(), &getTargets);
+        queries.insert(initQuery.get(), &initTargets);
+        bool remoteFound = false;
+        bool initialized = false;
+        SxError initError;
+        while (!queries.isEmpty()) {
+            auto selectResult = querySelect(queries);
+            std::unique_ptr<SxQueryResult> queryResult(selectResult.second);
+            if (!queryResult || selectResult.first == nullptr) {
+                if (queryResult)
+                    mLastError = queryResult->error();
+                return false;
+            }
+            queries.remove(selectResult.first);
+            if (selectResult.first == getQuery.get()) {
+                remoteFound = _getFileProcessReply(remoteFile, queryResult.get(), true);
+            }
+            else {
+                initialized = _initializeFileProcessReply(file, queryResult.get());
+                initError = mLastError;
+            }
+        }
+        if (remoteFound) {
+            if (file.haveEqualContent(remoteFile)) {
+                fileEntry.mPath = path;
+                fileEntry.mRevision = remoteFile.mRevision;
+                fileEntry.mCreatedAt = fileInfo.lastModified().toTime_t();
+                fileEntry.mSize = remoteFile.mRemoteSize;
+                fileEntry.mBlockSize = remoteFile.mBlockSize;
+                fileEntry.mBlocks = remoteFile.blockList();
+                if (file.mChecksums.size() == file.mBlocks.size())
+                    fileEntry.mChecksums = file.mChecksums;
+                logVerbose(QString("skiping upload of file %1").arg(path));
+                return true;
+            }
+        }
+        if (!initialized) {
+            mLastError = initError;
+            fileEntry.mSize = file.mRemoteSize;
+            invalidateLocateCache(volume->name());
+            return false;
         }
     }
     fileInfo.refresh();
@@ -2392,12 +3624,25 @@ bool SxCluster::uploadFile(SxVolume *volume, QString path, QString localFile, Sx
         mLastError = SxError(SxErrorCode::SoftError, "file changed before upload", QCoreApplication::translate("SxErrorMessage", "file changed before upload"));
         return false;
     }
-    if (!_initializeFile(file)) {
+    bool resumed = false;
+    if (file.multipart() && mLoadUploadState && mStoreUploadState) {
+        SxUploadState state;
+        if (mLoadUploadState(volume->name(), path, state)) {
+            if (state.size == file.mRemoteSize && state.mtime == mtime && state.blockSize == blockSize && file.restoreChunks(state.blocks)) {
+                file.mUploadToken = state.uploadToken;
+                file.mUploadPollTarget = state.pollTarget;
+                resumed = true;
+                logInfo(QString("resuming upload of %1 at block %2").arg(path).arg(file.mBlocks.count()));
+            }
+            else
+                mStoreUploadState(volume->name(), path, nullptr);
+        }
+    }
+    if (file.multipart() && !resumed && !_initializeFile(file)) {
         fileEntry.mSize = file.mRemoteSize;
+        invalidateLocateCache(volume->name());
         return false;
     }
-    if (callback)
-        pollUploadJobs(sUploadJobsLimit, callback);
     qint64 uploadSize;
     qint64 uploadSkipped = 0;
     qint64 chunkSize = 0;
@@ -2412,96 +3657,258 @@ bool SxCluster::uploadFile(SxVolume *volume, QString path, QString localFile, Sx
         uploadSize = static_cast<qint64>(file.mBlocksToSend.size())*blockSize;
     qint64 uploaded = 0;
     QDateTime uploadStart = QDateTime::currentDateTime();
+    mLastUploadSavedBytes = 0;
+    if (!file.multipart())
+        mLastUploadSavedBytes = static_cast<qint64>(file.mBlocks.size() - file.mBlocksToSend.size())*blockSize;
 
     sendChunk:
     if (file.multipart()) {
         uploadSkipped+=(chunkSize-static_cast<qint64>(file.mBlocksToSend.size())*blockSize);
+        mLastUploadSavedBytes = uploadSkipped;
+        // the next chunk is sized to take sMultipartChunkTime at the upload speed seen so far,
+        // and hashed while this one is sent
+        qint64 elapsed = uploadStart.msecsTo(QDateTime::currentDateTime());
+        qint64 speed = 0;
+        if (uploaded > 0 && elapsed > 0)
+            speed = uploaded*1000/elapsed;
+        else {
+            int nodes = 0;
+            foreach (const QString &node, volume->nodeList()) {
+                qint64 throughput = mNodeStats.value(node).throughput;
+                if (throughput > 0) {
+                    speed += throughput;
+                    ++nodes;
+                }
+            }
+            if (nodes)
+                speed = speed/nodes*qMax(1, qMin(nodes, mUploadConnectionLimit));
+        }
+        if (speed > 0)
+            file.setNextChunkSize(speed*sMultipartChunkTime);
+        file.prefetchNextChunk();
     }
     if (!file.mBlocksToSend.isEmpty()) {
+        static const int dataLimit = 4*1024*1024;
         auto offsets = file.getBlocksOffsets();
-        auto toSent = QList<SxBlock*>(file.mBlocksToSend);
-
-        while (!toSent.isEmpty()) {
-            static const int dataLimit = 4*1024*1024;
+        BlockBuckets toSent;
+        // blocks another upload is sending are waited for instead of being sent again
+        SxInflightBlocks &inflight = SxInflightBlocks::instance();
+        QSet<SxBlock*> claimedBlocks;
+        QList<SxBlock*> inflightBlocks;
+        foreach (SxBlock *block, file.mBlocksToSend) {
+            if (inflight.claim(volume->name(), block->mHash)) {
+                claimedBlocks.insert(block);
+                toSent.add(block, block->mNodeList);
+            }
+            else
+                inflightBlocks.append(block);
+        }
+        QList<QPair<quint64, UploadChunkInfo> > plannedChunks;
+        QHash<SxQuery*, QStringList*> activeQueries;
+        QHash<SxQuery*, QPair<QStringList, QList<SxBlock*> > > activeQueriesHelper;
+        QHash<QString, int> nodeQueriesCounter;
+        QHash<QString, int> nodePlannedCounter;
+        QString queryString = QString("/.data/%1/%2").arg(blockSize).arg(file.mUploadToken);
+        quint64 chunkId = 0;
+        bool failed = false;
+        const int bufferCount = mUploadConnectionLimit + sUploadReadAhead;
+        std::unique_ptr<SxBlockReader> reader;
+        if (filterSource) {
+            QSet<qint64> wanted;
+            foreach (SxBlock *block, file.mBlocksToSend) {
+                wanted.insert(offsets.value(block).first());
+            }
+            reader.reset(new SxBlockReader(filterSource.get(), wanted, blockSize, dataLimit, bufferCount));
+        }
+        else
+            reader.reset(new SxBlockReader(localFile, blockSize, dataLimit, bufferCount));
+        reader->start();
 
+        while (!toSent.isEmpty() || !plannedChunks.isEmpty() || !activeQueries.isEmpty() || !inflightBlocks.isEmpty()) {
             fileInfo.refresh();
             if (!fileInfo.exists()) {
                 mLastError = SxError(SxErrorCode::NotFound, "file removed before upload", QCoreApplication::translate("SxErrorMessage", "file removed before upload"));
-                return false;
+                failed = true;
+                break;
             }
             if (mtime != fileInfo.lastModified().toTime_t()) {
                 mLastError = SxError(SxErrorCode::SoftError, "file changed before upload", QCoreApplication::translate("SxErrorMessage", "file changed before upload"));
-                return false;
+                failed = true;
+                break;
+            }
+            if (toSent.isEmpty() && plannedChunks.isEmpty() && activeQueries.isEmpty()) {
+                SxBlock *block = inflightBlocks.takeFirst();
+                if (inflight.wait(volume->name(), block->mHash, cancelToken())) {
+                    uploadSkipped += blockSize;
+                    if (!file.multipart())
+                        mLastUploadSavedBytes += blockSize;
+                    continue;
+                }
+                if (aborted()) {
+                    mLastError = SxError(SxErrorCode::AbortedByUser, "upload aborted", QCoreApplication::translate("SxErrorMessage", "upload aborted"));
+                    failed = true;
+                    break;
+                }
+                // the other upload failed to send it
+                if (inflight.claim(volume->name(), block->mHash)) {
+                    claimedBlocks.insert(block);
+                    toSent.add(block, block->mNodeList);
+                }
+                else
+                    inflightBlocks.append(block);
+                continue;
+            }
+
+            while (plannedChunks.count() + activeQueries.count() < bufferCount && !toSent.isEmpty()) {
+                QString target;
+                foreach (QString node, toSent.firstNodes()) {
+                    int load = nodeQueriesCounter.value(node, 0) + nodePlannedCounter.value(node, 0);
+                    int targetLoad = nodeQueriesCounter.value(target, 0) + nodePlannedCounter.value(target, 0);
+                    if (target.isEmpty() || load < targetLoad || (load == targetLoad && nodeLatency(node) < nodeLatency(target)))
+                        target = node;
+                }
+
+                UploadChunkInfo chunk;
+                QSet<QString> targetNodes;
+                toSent.take(target, qMax(1, (dataLimit+blockSize-1)/blockSize), chunk.blocks, targetNodes);
+                targetNodes.remove(target);
+                chunk.nodes = targetNodes.toList();
+                chunk.nodes.prepend(target);
+
+                QList<qint64> chunkOffsets;
+                foreach (SxBlock *block, chunk.blocks) {
+                    chunkOffsets.append(offsets.value(block).first());
+                }
+                reader->enqueue(chunkId, chunkOffsets);
+                plannedChunks.append({chunkId, chunk});
+                ++nodePlannedCounter[target];
+                ++chunkId;
             }
 
-            QList<SxBlock*> chunk;
-            chunk.append(toSent.takeFirst());
-            QSet<QString> targetNodes = chunk.first()->mNodeList.toSet();
+            while (activeQueries.count() < mUploadConnectionLimit && !plannedChunks.isEmpty()) {
+                QString target;
+                foreach (QString node, plannedChunks.first().second.nodes) {
+                    int counter = nodeQueriesCounter.value(node, 0);
+                    if (counter >= mUploadNodeConnectionLimit)
+                        continue;
+                    if (target.isEmpty() || counter < nodeQueriesCounter.value(target, 0))
+                        target = node;
+                }
+                if (target.isEmpty())
+                    break;
 
-            foreach (SxBlock *block, toSent) {
-                if (chunk.size()*blockSize >= dataLimit)
+                auto planned = plannedChunks.takeFirst();
+                --nodePlannedCounter[planned.second.nodes.first()];
+                QByteArray data;
+                QByteArray bodyHash;
+                if (!reader->take(planned.first, data, bodyHash)) {
+                    mLastError = SxError(SxErrorCode::IOError, "unable to read file", "unable to read file");
+                    failed = true;
                     break;
-                QSet<QString> intersection = block->mNodeList.toSet() & targetNodes;
-                if (intersection.isEmpty())
-                    continue;
-                chunk.append(block);
-                toSent.removeOne(block);
-                targetNodes = intersection;
-            }
-            qint64 dataLen = chunk.size()*blockSize;
-            char* rawData = new char[dataLen];
-            qint64 dataOffset = 0;
-
-            foreach (SxBlock *block, chunk) {
-                qint64 offset = offsets.value(block).first();
-                if (!file.readBlock(offset, blockSize, rawData+dataOffset))
-                {
-                    logWarning("reading block " + block->mHash + " failed");
-                    delete [] rawData;
-                    return false;
                 }
-                dataOffset+=blockSize;
+                QStringList targets = planned.second.nodes;
+                targets.removeOne(target);
+                targets.prepend(target);
+                SxQuery *query = new SxQuery(queryString, SxQuery::PUT, data, bodyHash);
+                activeQueries.insert(query, new QStringList(targets));
+                activeQueriesHelper.insert(query, {targets, planned.second.blocks});
+                ++nodeQueriesCounter[target];
             }
-            QStringList target = {targetNodes.toList().first()};
-            const QByteArray data = QByteArray::fromRawData(rawData, static_cast<int>(dataLen));
-            if (!_createBlocks(file.mUploadToken, blockSize, data, target)) {
-                if (mLastError.errorCode() == SxErrorCode::AbortedByUser) {
-                    delete [] rawData;
-                    return false;
+            if (failed || activeQueries.isEmpty()) {
+                failed = true;
+                break;
+            }
+
+            auto selectResult = querySelect(activeQueries);
+            SxQuery* currentQuerry = selectResult.first;
+            std::unique_ptr<SxQueryResult> queryResult(selectResult.second);
+            if (!queryResult || currentQuerry == nullptr) {
+                if (queryResult)
+                    mLastError = queryResult->error();
+                failed = true;
+                break;
+            }
+            auto queryHelper = activeQueriesHelper.take(currentQuerry);
+            const QStringList &targets = queryHelper.first;
+            const QList<SxBlock*> &chunk = queryHelper.second;
+            --nodeQueriesCounter[targets.first()];
+            delete activeQueries.take(currentQuerry);
+            QByteArray data = currentQuerry->body();
+            delete currentQuerry;
+            reader->release(data);
+
+            if (queryResult->error().errorCode() != SxErrorCode::NoError) {
+                if (queryResult->error().errorCode() == SxErrorCode::AbortedByUser) {
+                    mLastError = queryResult->error();
+                    failed = true;
+                    break;
                 }
+                QJsonDocument jDoc;
+                parseJson(queryResult.get(), jDoc);
                 foreach (SxBlock *block, chunk) {
-                    foreach (QString node, targetNodes) {
+                    foreach (QString node, targets) {
                         block->mNodeList.removeOne(node);
                     }
                     if (block->mNodeList.isEmpty()) {
-                        delete [] rawData;
-                        return false;
+                        failed = true;
+                        break;
                     }
-                    toSent.append(block);
+                    toSent.add(block, block->mNodeList);
                 }
+                if (failed)
+                    break;
             }
             else {
-                uploaded += dataLen;
+                foreach (SxBlock *block, chunk) {
+                    inflight.release(volume->name(), block->mHash, true);
+                    claimedBlocks.remove(block);
+                }
+                uploaded += static_cast<qint64>(chunk.size())*blockSize;
                 double uploadTime = uploadStart.msecsTo(QDateTime::currentDateTime())/1000.0;
                 if (uploadTime > 0) {
                     qint64 speed = static_cast<qint64>(uploaded / uploadTime);
+                    if (mUploadLimiter.rate() > 0)
+                        speed = qMin(speed, mUploadLimiter.rate());
                     qint64 size = uploadSize - uploaded - uploadSkipped;
                     emit sig_setProgress(size, speed);
                 }
             }
-            if (callback)
-                pollUploadJobs(sUploadJobsLimit, callback);
-            delete [] rawData;
+        }
+        if (failed) {
+            foreach (SxBlock *block, claimedBlocks) {
+                inflight.release(volume->name(), block->mHash, false);
+            }
+            foreach (SxQuery* query, activeQueries.keys()) {
+                delete activeQueries.value(query);
+                delete query;
+            }
+            abortAllQueries();
+            invalidateLocateCache(volume->name());
+            return false;
         }
     }
     double uploadTime = uploadStart.msecsTo(QDateTime::currentDateTime())/1000.0;
     if (uploadTime > 0) {
         qint64 speed = static_cast<qint64>(uploaded / uploadTime);
+        if (mUploadLimiter.rate() > 0)
+            speed = qMin(speed, mUploadLimiter.rate());
         qint64 size = uploadSize - uploaded - uploadSkipped;
         emit sig_setProgress(size, speed);
     }
 
     if (file.multipart() && file.canReadNextChunk()) {
+        if (mStoreUploadState) {
+            SxUploadState state;
+            state.size = file.mRemoteSize;
+            state.mtime = mtime;
+            state.blockSize = blockSize;
+            state.uploadToken = file.mUploadToken;
+            state.pollTarget = file.mUploadPollTarget;
+            foreach (SxBlock* block, file.mBlocks) {
+                state.blocks.append(block->mHash);
+            }
+            mStoreUploadState(volume->name(), path, &state);
+        }
         int blockCount = file.mBlocks.count();
         if (!file.readNextChunk()) {
             mLastError = SxError(SxErrorCode::IOError, "unable to read file", "unable to read file");
@@ -2510,12 +3917,21 @@ bool SxCluster::uploadFile(SxVolume *volume, QString path, QString localFile, Sx
         chunkSize = (file.mBlocks.count() - blockCount)*file.mBlockSize;
         if (!_initializeFileAddChunk(file, blockCount)) {
             fileEntry.mSize = file.mRemoteSize;
+            // the upload token may have expired on the server, start over next time
+            if (resumed && mStoreUploadState)
+                mStoreUploadState(volume->name(), path, nullptr);
             return false;
         }
         goto sendChunk;
     }
 
+    SxMetrics::instance().addDedupSavings(mLastUploadSavedBytes);
+    if (mLastUploadSavedBytes > 0)
+        logInfo(QString("deduplication saved %1 of %2 bytes uploading %3").arg(mLastUploadSavedBytes).arg(static_cast<qint64>(file.mBlocks.size())*blockSize).arg(path));
+
     std::unique_ptr<SxJob> job(new SxJob());
+    if (file.multipart() && mStoreUploadState)
+        mStoreUploadState(volume->name(), path, nullptr);
     if (!_flushFile(file, *job)) {
         return false;
     }
@@ -2524,10 +3940,9 @@ bool SxCluster::uploadFile(SxVolume *volume, QString path, QString localFile, Sx
     fileEntry.mSize = 0;
     fileEntry.mRevision = "";
     fileEntry.mBlockSize = file.mBlockSize;
-    fileEntry.mBlocks.clear();
-    foreach(auto block, file.mBlocks) {
-        fileEntry.mBlocks.append(block->mHash);
-    }
+    fileEntry.mBlocks = file.blockList();
+    if (file.mChecksums.size() == file.mBlocks.size())
+        fileEntry.mChecksums = file.mChecksums;
 
     if (callback == nullptr) {
         while (job->mStatus == SxJob::PENDING) {
@@ -2550,12 +3965,17 @@ bool SxCluster::uploadFile(SxVolume *volume, QString path, QString localFile, Sx
         return true;
     }
     else {
-        QStringList blocks;
-        foreach (SxBlock* block, file.mBlocks) {
-            blocks.append(block->mHash);
+        SxBlockList blocks = file.blockList();
+        int interval = job->mInterval;
+        {
+            QMutexLocker locker(&mUploadJobMutex);
+            mUploadJobs.insert(job.release(), {volume, path, fileInfo.lastModified().toTime_t(), QDateTime::currentDateTime(), file.mRemoteSize, blocks, false});
         }
-        mUploadJobs.insert(job.release(), {volume, path, fileInfo.lastModified().toTime_t(), QDateTime::currentDateTime(), file.mRemoteSize, blocks});
-        pollUploadJobs(sUploadJobsLimit, callback);
+        mUploadJobsCallback = callback;
+        if (uploadJobsCount() > sUploadJobsLimit)
+            pollUploadJobs(sUploadJobsLimit, callback);
+        else
+            scheduleUploadJobsPoll(interval);
         return true;
     }
 }
@@ -2586,13 +4006,108 @@ bool SxCluster::createEmptyFile(SxVolume *volume, QString path)
     return true;
 }
 
-QString radomValueFromList(QStringList &list) {
-    if (list.isEmpty())
-        return QString::null;
-    if (list.count()==1)
-        return list.first();
-    int random_value = qrand();
-    return list.value(random_value%list.count());
+/* creates zero-length files, e.g. the .sxnewdir markers of empty directories, without a round
+ * trip per file: the initialize and flush queries of up to sEmptyFilesWindow files are in flight
+ * at once and the flush jobs join the upload jobs polled in the background, whose results reach
+ * callback like the ones of uploadFile(). files holds the paths with their local mtimes, created
+ * the paths flushed before a failure */
+bool SxCluster::createEmptyFiles(SxVolume *volume, const QList<QPair<QString, quint32>> &files, QStringList &created, std::function<void (QString, QString, SxError, QString, quint32)> callback)
+{
+    FunctionBlocker fb(this, Q_FUNC_INFO);
+    if (fb.exit())
+        return false;
+    if (volume == nullptr || callback == nullptr)
+        return false;
+    logInfo(QString("creating %1 empty files, volume: %2").arg(files.count()).arg(volume->name()));
+    setAborted(false);
+    struct Creation {
+        bool flushing;
+        quint32 mTime;
+        std::unique_ptr<SxFile> file;
+        std::unique_ptr<SxQuery> query;
+        QStringList targets;
+    };
+    QHash<SxQuery*, QStringList*> queries;
+    QHash<SxQuery*, Creation*> creations;
+    int next = 0;
+    bool failed = false;
+    // polls go out from the event loop while the queries are waited for
+    mUploadJobsCallback = callback;
+
+    auto sendStage = [&queries, &creations](Creation *creation, bool flushing, SxQuery *query, const QStringList &targets) {
+        creation->flushing = flushing;
+        creation->query.reset(query);
+        creation->targets = targets;
+        queries.insert(query, &creation->targets);
+        creations.insert(query, creation);
+    };
+
+    forever {
+        if (aborted()) {
+            mLastError = SxError(SxErrorCode::AbortedByUser, "upload aborted", QCoreApplication::translate("SxErrorMessage", "upload aborted"));
+            failed = true;
+            break;
+        }
+        while (next < files.size() && creations.size() < sEmptyFilesWindow && uploadJobsCount() < sEmptyFilesJobsLimit) {
+            Creation *creation = new Creation();
+            creation->mTime = files.at(next).second;
+            creation->file.reset(new SxFile(volume, files.at(next++).first, "", true));
+            SxQuery *query = _initializeFileMakeQuery(*creation->file);
+            if (query == nullptr) {
+                delete creation;
+                failed = true;
+                break;
+            }
+            sendStage(creation, false, query, volume->nodeList());
+        }
+        if (failed)
+            break;
+        if (creations.isEmpty()) {
+            if (next >= files.size())
+                break;
+            // too many jobs pending, let the background polls catch up
+            pollUploadJobs(sEmptyFilesJobsLimit/2, callback);
+            continue;
+        }
+
+        auto selectResult = querySelect(queries);
+        std::unique_ptr<SxQueryResult> queryResult(selectResult.second);
+        if (!queryResult || selectResult.first == nullptr) {
+            if (queryResult)
+                mLastError = queryResult->error();
+            failed = true;
+            break;
+        }
+        queries.remove(selectResult.first);
+        std::unique_ptr<Creation> creation(creations.take(selectResult.first));
+        SxFile &file = *creation->file;
+        if (!creation->flushing) {
+            if (!_initializeFileProcessReply(file, queryResult.get())) {
+                failed = true;
+                break;
+            }
+            sendStage(creation.release(), true, _flushFileMakeQuery(file), {file.mUploadPollTarget});
+            continue;
+        }
+        std::unique_ptr<SxJob> job(new SxJob());
+        if (!_flushFileProcessReply(file, queryResult.get(), *job)) {
+            failed = true;
+            break;
+        }
+        created.append(file.mRemotePath);
+        int interval = job->mInterval;
+        {
+            QMutexLocker locker(&mUploadJobMutex);
+            mUploadJobs.insert(job.release(), {volume, file.mRemotePath, creation->mTime, QDateTime::currentDateTime(), file.mRemoteSize, file.blockList(), false});
+        }
+        scheduleUploadJobsPoll(interval);
+    }
+    if (failed) {
+        abortAllQueries();
+        qDeleteAll(creations);
+        return false;
+    }
+    return true;
 }
 
 bool SxCluster::listFileRevisions(SxVolume *volume, const QString &path, QList<std::tuple<QString, qint64, quint32>> &list)
@@ -2604,26 +4119,73 @@ bool SxCluster::listFileRevisions(SxVolume *volume, const QString &path, QList<s
     SxFile file(volume, path, "", true);
     if(!testFile(file))
         return false;
-    QString queryString = "/"+file.mVolume->name();
-    if (file.mRemotePath.startsWith("/"))
-        queryString += QUrl::toPercentEncoding(file.mRemotePath, "/");
-    else
-        queryString += "/"+QUrl::toPercentEncoding(file.mRemotePath, "/");
-    queryString+="?fileRevisions";
-    SxQuery query(queryString, SxQuery::GET, QByteArray());
+    SxQuery query(_fileRevisionsQuery(file), SxQuery::GET, QByteArray());
     std::unique_ptr<SxQueryResult> queryResult(sendQuery(&query, volume->nodeList()));
     if (!queryResult)
         return false;
     QJsonDocument json;
     if (!parseJson(queryResult.get(), json))
         return false;
+    if (!_parseFileRevisions(json, list)) {
+        mLastError = SxError::errorBadReplyContent();
+        logWarning(mLastError.errorMessage());
+        return false;
+    }
+    SxRevisionCache::instance().put(mClusterUuid, volume->name(), path, list);
+    return true;
+}
+
+/* same as listFileRevisions without waiting for the reply, the callback runs from the
+ * event loop of the cluster thread */
+void SxCluster::listFileRevisionsAsync(SxVolume *volume, const QString &path, std::function<void(bool, const QList<std::tuple<QString, qint64, quint32>>&)> callback)
+{
+    logInfo(QString("volume: %1, file: %2").arg(volume->name()).arg(path));
+    SxFile file(volume, path, "", true);
+    if (!testFile(file)) {
+        QTimer::singleShot(0, this, [callback]() {
+            callback(false, {});
+        });
+        return;
+    }
+    QString volName = volume->name();
+    sendQueryAsync(new SxQuery(_fileRevisionsQuery(file), SxQuery::GET, QByteArray()), volume->nodeList(), [this, volName, path, callback](SxQueryResult *result) {
+        std::unique_ptr<SxQueryResult> queryResult(result);
+        QList<std::tuple<QString, qint64, quint32>> list;
+        QJsonDocument json;
+        if (!parseJson(queryResult.get(), json)) {
+            callback(false, list);
+            return;
+        }
+        if (!_parseFileRevisions(json, list)) {
+            mLastError = SxError::errorBadReplyContent();
+            logWarning(mLastError.errorMessage());
+            callback(false, list);
+            return;
+        }
+        SxRevisionCache::instance().put(mClusterUuid, volName, path, list);
+        callback(true, list);
+    });
+}
+
+QString SxCluster::_fileRevisionsQuery(const SxFile &file) const
+{
+    QString queryString = "/"+file.mVolume->name();
+    if (file.mRemotePath.startsWith("/"))
+        queryString += QUrl::toPercentEncoding(file.mRemotePath, "/");
+    else
+        queryString += "/"+QUrl::toPercentEncoding(file.mRemotePath, "/");
+    return queryString+"?fileRevisions";
+}
+
+bool SxCluster::_parseFileRevisions(const QJsonDocument &json, QList<std::tuple<QString, qint64, quint32>> &list)
+{
     auto jRevisions = json.object().value("fileRevisions");
     if (!jRevisions.isObject())
-        goto badReplyContent;
+        return false;
     foreach (QString key, jRevisions.toObject().keys()) {
         auto jRev = jRevisions.toObject().value(key).toObject();
         if (!jRev.value("blockSize").isDouble() || !jRev.value("fileSize").isDouble() || !jRev.value("createdAt").isDouble())
-            goto badReplyContent;
+            return false;
     }
     list.clear();
     foreach (QString key, jRevisions.toObject().keys()) {
@@ -2631,11 +4193,6 @@ bool SxCluster::listFileRevisions(SxVolume *volume, const QString &path, QList<s
         list.append(std::make_tuple(key, jRev.value("fileSize").toVariant().toLongLong(), jRev.value("createdAt").toVariant().toUInt()));
     }
     return true;
-    badReplyContent:
-    file.clearBlocks();
-    mLastError = SxError::errorBadReplyContent();
-    logWarning(mLastError.errorMessage());
-    return false;
 }
 
 bool SxCluster::getFileRevision(SxVolume *volume, const QString &path, const QString &node, QString &revision)
@@ -2725,6 +4282,7 @@ bool SxCluster::restoreFileRevision(SxVolume *volume, const QString &source, con
     }
     if (job.mStatus == SxJob::ERROR)
         return false;
+    SxRevisionCache::instance().invalidate(volume->name(), destination);
     return true;
 }
 
@@ -2749,6 +4307,8 @@ bool SxCluster::copyFile(SxVolume *srcVolume, const QString &source, SxVolume *d
     dest.fakeFile(file.mRemoteSize, blocks, file.mBlockSize);
     if (!_initializeFile(dest))
         return false;
+    if (!_copyMissingBlocks(file, dest))
+        return false;
     SxJob job;
     if (!_flushFile(dest, job))
         return false;
@@ -2762,139 +4322,118 @@ bool SxCluster::copyFile(SxVolume *srcVolume, const QString &source, SxVolume *d
     return true;
 }
 
-bool SxCluster::copyFiles(SxVolume *srcVolume, const QString &srcDir, const QStringList &files, SxVolume *dstVolume, const QString &dstDir, std::function<void(int, int)> progressCallback)
+bool SxCluster::_copyMissingBlocks(SxFile &source, SxFile &destination)
 {
-    FunctionBlocker fb(this, Q_FUNC_INFO);
-    if (fb.exit())
-        return false;
-    if (srcVolume == nullptr || dstVolume == nullptr || srcDir.isEmpty() || dstDir.isEmpty() || files.isEmpty())
-        return false;
-    QList<SxJob> jobs;
-    int done = 0;
-    progressCallback(done, files.size());
-    foreach (auto f, files) {
-        QString source = srcDir+f;
-        QString destination = dstDir+f;
-        SxFile file(srcVolume, source, "", true);
-        if(!testFile(file))
-            return false;
-        if (!_getFile(file))
+    // copies reuse the block list of the source and never pass through a local file, only blocks
+    // missing on the destination nodes are read from the source nodes and sent there from memory
+    if (destination.mBlocksToSend.isEmpty())
+        return true;
+    logVerbose(QString("copying %1 blocks to the nodes of %2").arg(destination.mBlocksToSend.count()).arg(destination.mVolume->name()));
+    QMap<QString, QList<SxBlock*>> groups;
+    foreach (SxBlock *block, destination.mBlocksToSend) {
+        SxBlock *sourceBlock = source.mUniqueBlocks.value(block->mHash, nullptr);
+        if (sourceBlock == nullptr || sourceBlock->mNodeList.isEmpty()) {
+            mLastError = SxError::errorBadReplyContent();
+            logWarning(mLastError.errorMessage());
             return false;
-        SxFile dest(dstVolume, destination, "", true);
-        QStringList blocks;
-        foreach (auto b, file.mBlocks) {
-            blocks.append(b->mHash);
         }
-        dest.fakeFile(file.mRemoteSize, blocks, file.mBlockSize);
-        if (!_initializeFile(dest))
-            return false;
-        SxJob job;
-        if (!_flushFile(dest, job))
-            return false;
-        jobs.append(job);
-        while (jobs.size() > 30) {
-            jobs.first().waitInterval();
-            auto it = jobs.begin();
-            while (it != jobs.end()) {
-                if (!_poll(*it))
-                    return false;
-                if (it->mStatus == SxJob::ERROR)
-                    return false;
-                if (it->mStatus == SxJob::OK) {
-                    it = jobs.erase(it);
-                    ++done;
-                    progressCallback(done, files.size());
-                }
-                else
-                    ++it;
+        // a batch is read from one set of nodes and written to one set of nodes
+        groups[sourceBlock->mNodeList.join(",")+"|"+block->mNodeList.join(",")].append(block);
+    }
+    const int blockSize = destination.mBlockSize;
+    const int batchSize = qBound(1, sCopyBatchSize/blockSize, 30);
+    foreach (auto group, groups) {
+        for (int i=0; i<group.count(); i+=batchSize) {
+            if (aborted()) {
+                mLastError = SxError(SxErrorCode::AbortedByUser, "copy aborted", QCoreApplication::translate("SxErrorMessage", "copy aborted"));
+                return false;
             }
-        }
-        auto it = jobs.begin();
-        while (it != jobs.end()) {
-            if (!_poll(*it))
+            QList<SxBlock*> batch = group.mid(i, batchSize);
+            QList<SxBlock*> sourceBatch;
+            foreach (SxBlock *block, batch) {
+                sourceBatch.append(source.mUniqueBlocks.value(block->mHash));
+            }
+            QStringList keys;
+            QHash<QString, SxBlock*> hash;
+            std::unique_ptr<SxQuery> query(_getBlocksMakeQuery(sourceBatch, blockSize, keys, hash));
+            if (!query)
                 return false;
-            if (it->mStatus == SxJob::ERROR)
+            std::unique_ptr<SxQueryResult> queryResult(sendQuery(query.get(), sourceBatch.first()->mNodeList));
+            if (!queryResult)
+                return false;
+            if (queryResult->error().errorCode() != SxErrorCode::NoError) {
+                QJsonDocument jDoc;
+                parseJson(queryResult.get(), jDoc);
                 return false;
-            if (it->mStatus == SxJob::OK) {
-                it = jobs.erase(it);
-                ++done;
-                progressCallback(done, files.size());
             }
-            else
-                ++it;
-        }
-    }
-    while (!jobs.isEmpty()) {
-        jobs.first().waitInterval();
-        auto it = jobs.begin();
-        while (it != jobs.end()) {
-            if (!_poll(*it))
+            QByteArray data;
+            data.reserve(keys.count()*blockSize);
+            if (!_getBlocksProcessReply(queryResult.get(), blockSize, keys, hash, [&data, blockSize](SxBlock *, const char *blockData) -> bool {
+                                        data.append(blockData, blockSize);
+                                        return true;
+                                    }))
                 return false;
-            if (it->mStatus == SxJob::ERROR)
+            queryResult.reset();
+            if (!_createBlocks(destination.mUploadToken, blockSize, data, batch.first()->mNodeList))
                 return false;
-            if (it->mStatus == SxJob::OK) {
-                it = jobs.erase(it);
-                ++done;
-                progressCallback(done, files.size());
-            }
-            else
-                ++it;
         }
     }
     return true;
 }
 
+bool SxCluster::copyFiles(SxVolume *srcVolume, const QString &srcDir, const QStringList &files, SxVolume *dstVolume, const QString &dstDir, std::function<void(int, int)> progressCallback)
+{
+    FunctionBlocker fb(this, Q_FUNC_INFO);
+    if (fb.exit())
+        return false;
+    return _transferFiles(srcVolume, srcDir, files, dstVolume, dstDir, false, progressCallback);
+}
+
 bool SxCluster::moveFiles(SxVolume *srcVolume, const QString &srcDir, const QStringList &files, SxVolume *dstVolume, const QString &dstDir, std::function<void (int, int)> progressCallback)
 {
     FunctionBlocker fb(this, Q_FUNC_INFO);
     if (fb.exit())
         return false;
+    return _transferFiles(srcVolume, srcDir, files, dstVolume, dstDir, true, progressCallback);
+}
+
+bool SxCluster::_transferFiles(SxVolume *srcVolume, const QString &srcDir, const QStringList &files, SxVolume *dstVolume, const QString &dstDir, bool move, std::function<void (int, int)> progressCallback)
+{
     if (srcVolume == nullptr || dstVolume == nullptr || srcDir.isEmpty() || dstDir.isEmpty() || files.isEmpty())
         return false;
+    // every file goes through get, initialize, flush and for a move delete; up to sTransferWindow
+    // files are on the way at once, each one with a single query in flight
+    enum Stage {
+        GetSource,
+        InitializeDestination,
+        FlushDestination,
+        DeleteSource
+    };
+    struct Transfer {
+        Stage stage;
+        std::unique_ptr<SxFile> source;
+        std::unique_ptr<SxFile> destination;
+        std::unique_ptr<SxQuery> query;
+        QStringList targets;
+    };
+    const int total = move ? 2*files.size() : files.size();
+    QHash<SxQuery*, QStringList*> queries;
+    QHash<SxQuery*, Transfer*> transfers;
+    QList<Transfer*> blockCopies;
     QList<SxJob> jobs;
+    int next = 0;
     int done = 0;
-    progressCallback(done, files.size());
-    foreach (auto f, files) {
-        QString source = srcDir+f;
-        QString destination = dstDir+f;
-        SxFile file(srcVolume, source, "", true);
-        if(!testFile(file))
-            return false;
-        if (!_getFile(file))
-            return false;
-        SxFile dest(dstVolume, destination, "", true);
-        QStringList blocks;
-        foreach (auto b, file.mBlocks) {
-            blocks.append(b->mHash);
-        }
-        dest.fakeFile(file.mRemoteSize, blocks, file.mBlockSize);
-        if (!_initializeFile(dest))
-            return false;
-        SxJob jobFlush, jobDelete;
-        if (!_flushFile(dest, jobFlush))
-            return false;
-        jobs.append(jobFlush);
-        if (!_deleteFile(file, jobDelete))
-            return false;
-        jobs.append(jobDelete);
-
-        while (jobs.size() > 30) {
-            jobs.first().waitInterval();
-            auto it = jobs.begin();
-            while (it != jobs.end()) {
-                if (!_poll(*it))
-                    return false;
-                if (it->mStatus == SxJob::ERROR)
-                    return false;
-                if (it->mStatus == SxJob::OK) {
-                    it = jobs.erase(it);
-                    ++done;
-                    progressCallback(done, 2*files.size());
-                }
-                else
-                    ++it;
-            }
-        }
+    bool failed = false;
+    progressCallback(done, total);
+
+    auto sendStage = [&queries, &transfers](Transfer *transfer, Stage stage, SxQuery *query, const QStringList &targets) {
+        transfer->stage = stage;
+        transfer->query.reset(query);
+        transfer->targets = targets;
+        queries.insert(query, &transfer->targets);
+        transfers.insert(query, transfer);
+    };
+    auto pollJobs = [this, &jobs, &done, total, progressCallback]() -> bool {
         auto it = jobs.begin();
         while (it != jobs.end()) {
             if (!_poll(*it))
@@ -2904,28 +4443,119 @@ bool SxCluster::moveFiles(SxVolume *srcVolume, const QString &srcDir, const QStr
             if (it->mStatus == SxJob::OK) {
                 it = jobs.erase(it);
                 ++done;
-                progressCallback(done, 2*files.size());
+                progressCallback(done, total);
             }
             else
                 ++it;
         }
-    }
-    while (!jobs.isEmpty()) {
-        jobs.first().waitInterval();
-        auto it = jobs.begin();
-        while (it != jobs.end()) {
-            if (!_poll(*it))
-                return false;
-            if (it->mStatus == SxJob::ERROR)
-                return false;
-            if (it->mStatus == SxJob::OK) {
-                it = jobs.erase(it);
-                ++done;
-                progressCallback(done, 2*files.size());
+        return true;
+    };
+
+    forever {
+        while (next < files.size() && transfers.size() < sTransferWindow && jobs.size() < sTransferJobsLimit && blockCopies.isEmpty()) {
+            const QString &f = files.at(next++);
+            Transfer *transfer = new Transfer();
+            transfer->source.reset(new SxFile(srcVolume, srcDir+f, "", true));
+            transfer->destination.reset(new SxFile(dstVolume, dstDir+f, "", true));
+            if (!testFile(*transfer->source) || !testFile(*transfer->destination)) {
+                delete transfer;
+                failed = true;
+                break;
             }
-            else
-                ++it;
+            sendStage(transfer, GetSource, _getFileMakeQuery(*transfer->source), srcVolume->nodeList());
+        }
+        if (failed)
+            break;
+        if (transfers.isEmpty() && !blockCopies.isEmpty()) {
+            Transfer *transfer = blockCopies.takeFirst();
+            if (!_copyMissingBlocks(*transfer->source, *transfer->destination)) {
+                delete transfer;
+                failed = true;
+                break;
+            }
+            sendStage(transfer, FlushDestination, _flushFileMakeQuery(*transfer->destination), {transfer->destination->mUploadPollTarget});
+            continue;
+        }
+        if (transfers.isEmpty()) {
+            // polls and block copies go through their own blocking queries, so they wait for a moment without transfers
+            if (jobs.isEmpty())
+                break;
+            jobs.first().waitInterval();
+            if (!pollJobs()) {
+                failed = true;
+                break;
+            }
+            continue;
+        }
+
+        auto selectResult = querySelect(queries);
+        std::unique_ptr<SxQueryResult> queryResult(selectResult.second);
+        if (!queryResult || selectResult.first == nullptr) {
+            if (queryResult)
+                mLastError = queryResult->error();
+            failed = true;
+            break;
+        }
+        queries.remove(selectResult.first);
+        std::unique_ptr<Transfer> transfer(transfers.take(selectResult.first));
+        SxFile &source = *transfer->source;
+        SxFile &destination = *transfer->destination;
+        SxJob job;
+        switch (transfer->stage) {
+        case GetSource: {
+            if (!_getFileProcessReply(source, queryResult.get(), false)) {
+                failed = true;
+                break;
+            }
+            QStringList blocks;
+            foreach (auto b, source.mBlocks) {
+                blocks.append(b->mHash);
+            }
+            destination.fakeFile(source.mRemoteSize, blocks, source.mBlockSize);
+            SxQuery *query = _initializeFileMakeQuery(destination);
+            if (query == nullptr) {
+                failed = true;
+                break;
+            }
+            sendStage(transfer.release(), InitializeDestination, query, dstVolume->nodeList());
+            break;
+        }
+        case InitializeDestination:
+            if (!_initializeFileProcessReply(destination, queryResult.get())) {
+                failed = true;
+                break;
+            }
+            if (!destination.mBlocksToSend.isEmpty()) {
+                blockCopies.append(transfer.release());
+                break;
+            }
+            sendStage(transfer.release(), FlushDestination, _flushFileMakeQuery(destination), {destination.mUploadPollTarget});
+            break;
+        case FlushDestination:
+            if (!_flushFileProcessReply(destination, queryResult.get(), job)) {
+                failed = true;
+                break;
+            }
+            jobs.append(job);
+            if (move)
+                sendStage(transfer.release(), DeleteSource, _deleteFileMakeQuery(source), srcVolume->nodeList());
+            break;
+        case DeleteSource:
+            if (!_deleteFileProcessReply(queryResult.get(), job)) {
+                failed = true;
+                break;
+            }
+            jobs.append(job);
+            break;
         }
+        if (failed)
+            break;
+    }
+    if (failed) {
+        abortAllQueries();
+        qDeleteAll(transfers);
+        qDeleteAll(blockCopies);
+        return false;
     }
     return true;
 }
@@ -2956,6 +4586,8 @@ bool SxCluster::uploadFiles(const QString &localDir, const QStringList &files, S
         progressCallback(currentFile, done, 0);
     };
     QMetaObject::Connection connection = connect(this, &SxCluster::sig_setProgress, setProgress);
+    // markers of empty directories, often missing locally, are created together at the end
+    QList<QPair<QString, quint32>> emptyDirMarkers;
 
     foreach (QString file, files) {
         if (aborted())
@@ -2965,13 +4597,9 @@ bool SxCluster::uploadFiles(const QString &localDir, const QStringList &files, S
         currentFileSize = fileInfo.size();
         progressCallback(currentFile, done, 0);
         QString remotePath = dstDir+file.mid(localDir.length()+1);
-        QTemporaryFile tmpFile;
-        if (file.endsWith("/.sxnewdir")) {
-            QFile sxnewdir(file);
-            if (!sxnewdir.exists()) {
-                tmpFile.open();
-                file = tmpFile.fileName();
-            }
+        if (file.endsWith("/.sxnewdir") && currentFileSize == 0) {
+            emptyDirMarkers.append({remotePath, 0});
+            continue;
         }
         SxFileEntry fileEntry;
         if (!uploadFile(dstVolume, remotePath, file, fileEntry, callback, multipart)) {
@@ -2984,6 +4612,9 @@ bool SxCluster::uploadFiles(const QString &localDir, const QStringList &files, S
     }
     progressCallback(currentFile, done, 0);
     disconnect(connection);
+    QStringList created;
+    if (!emptyDirMarkers.isEmpty() && !createEmptyFiles(dstVolume, emptyDirMarkers, created, callback))
+        return false;
     pollUploadJobs(0, callback);
     return true;
 }
@@ -2996,46 +4627,133 @@ int SxCluster::uploadJobsCount() const
 
 bool SxCluster::pollUploadJobs(int jobLimit, std::function<void (QString, QString, SxError, QString, quint32)> callback)
 {
-    QMutexLocker locker(&mUploadJobMutex);
-    if (mUploadJobs.isEmpty())
+    setAborted(false);
+    mUploadJobsCallback = callback;
+    if (uploadJobsCount() == 0)
         return true;
-    do {
-        int counter = 0;
+    onUploadJobsPollTimeout();
+    while (uploadJobsCount() > jobLimit && !aborted()) {
+        QEventLoop loop;
+        connect(this, &SxCluster::sig_exit_loop, &loop, &QEventLoop::quit);
+        connect(this, &SxCluster::sig_uploadJobsChanged, &loop, &QEventLoop::quit);
+        loop.exec();
+    }
+    return true;
+}
+
+int SxCluster::nextUploadJobsPoll() const
+{
+    QDateTime now = QDateTime::currentDateTime();
+    qint64 nextPoll = -1;
+    foreach (auto job, mUploadJobs.keys()) {
+        if (mUploadJobs.value(job).polling)
+            continue;
+        qint64 remaining = qMax(Q_INT64_C(0), job->mInterval - mUploadJobs.value(job).lastPollTime.msecsTo(now));
+        if (nextPoll < 0 || remaining < nextPoll)
+            nextPoll = remaining;
+    }
+    return static_cast<int>(nextPoll);
+}
+
+void SxCluster::scheduleUploadJobsPoll(int delay)
+{
+    if (delay < 0)
+        return;
+    if (mUploadJobsTimer->isActive() && mUploadJobsTimer->remainingTime() <= delay)
+        return;
+    mUploadJobsTimer->start(delay);
+}
+
+void SxCluster::onUploadJobsPollTimeout()
+{
+    if (!mUploadJobsCallback)
+        return;
+    QList<std::tuple<SxJob*, SxQuery*, QString>> polls;
+    {
+        QMutexLocker locker(&mUploadJobMutex);
+        QDateTime now = QDateTime::currentDateTime();
+        QHash<QString, int> targetCounter;
         foreach (auto job, mUploadJobs.keys()) {
-            auto jobInfo = mUploadJobs[job];
-            auto timeElapsed = jobInfo.lastPollTime.msecsTo(QDateTime::currentDateTime());
-            if (timeElapsed > job->mInterval) {
-                ++counter;
-                if (job->mInterval < job->mMaxPollInterval)
-                    job->mInterval+=100;
-                if (_poll(*job)) {
-                    if (job->mStatus == SxJob::PENDING) {
-                        jobInfo.lastPollTime = QDateTime::currentDateTime();
-                    }
-                    else if (job->mStatus == SxJob::ERROR) {
-                        callback(jobInfo.volume->name(), jobInfo.path, mLastError, "", jobInfo.mTime);
-                        mUploadJobs.remove(job);
-                        delete job;
-                    }
-                    else {
-                        QString rev;
-                        SxFile test(jobInfo.volume, jobInfo.path, "", true);
-                        if (_getFile(test)) {
-                            if (test.haveEqualContent(test)) {
-                                rev = test.mRevision;
-                            }
-                        }
-                        callback(jobInfo.volume->name(), jobInfo.path, SxError(SxErrorCode::NoError, "", ""), rev, jobInfo.mTime);
-                        mUploadJobs.remove(job);
-                        delete job;
-                    }
-                }
-            }
+            if (mUploadJobs.value(job).polling)
+                ++targetCounter[job->mTarget];
         }
-        if (counter == 0)
-            mUploadJobs.keys().first()->waitInterval();
-    } while (mUploadJobs.count() > jobLimit);
-    return true;
+        foreach (auto job, mUploadJobs.keys()) {
+            UploadJobInfo &jobInfo = mUploadJobs[job];
+            if (jobInfo.polling || jobInfo.lastPollTime.msecsTo(now) < job->mInterval)
+                continue;
+            if (targetCounter.value(job->mTarget) >= sUploadJobsPollBatch)
+                continue;
+            SxQuery *query = _pollMakeQuery(*job);
+            if (query == nullptr)
+                continue;
+            ++targetCounter[job->mTarget];
+            jobInfo.polling = true;
+            polls.append(std::make_tuple(job, query, job->mTarget));
+        }
+        scheduleUploadJobsPoll(nextUploadJobsPoll());
+    }
+    foreach (auto poll, polls) {
+        SxJob *job = std::get<0>(poll);
+        sendQueryAsync(std::get<1>(poll), {std::get<2>(poll)}, [this, job](SxQueryResult *queryResult) {
+            onUploadJobPolled(job, queryResult);
+        });
+    }
+}
+
+void SxCluster::onUploadJobPolled(SxJob *job, SxQueryResult *result)
+{
+    std::unique_ptr<SxQueryResult> queryResult(result);
+    QMutexLocker locker(&mUploadJobMutex);
+    if (!mUploadJobs.contains(job))
+        return;
+    UploadJobInfo &jobInfo = mUploadJobs[job];
+    jobInfo.polling = false;
+    jobInfo.lastPollTime = QDateTime::currentDateTime();
+    job->increaseInterval();
+    // replies arrive in the middle of other operations, keep their error state intact
+    SxError lastError = mLastError;
+    bool polled = _pollProcessReply(*job, queryResult.get());
+    mLastError = lastError;
+    if (!polled || job->mStatus == SxJob::PENDING) {
+        scheduleUploadJobsPoll(nextUploadJobsPoll());
+        return;
+    }
+    auto callback = mUploadJobsCallback;
+    if (job->mStatus == SxJob::ERROR) {
+        UploadJobInfo info = mUploadJobs.take(job);
+        scheduleUploadJobsPoll(nextUploadJobsPoll());
+        locker.unlock();
+        callback(info.volume->name(), info.path, SxError(SxErrorCode::UnknownError, job->mMessage, job->mMessage), "", info.mTime);
+        delete job;
+        emit sig_uploadJobsChanged();
+        return;
+    }
+    // the job stays counted until its revision is known
+    jobInfo.polling = true;
+    UploadJobInfo info = jobInfo;
+    scheduleUploadJobsPoll(nextUploadJobsPoll());
+    locker.unlock();
+    SxFile *test = new SxFile(info.volume, info.path, "", true);
+    sendQueryAsync(_getFileMakeQuery(*test), info.volume->nodeList(), [this, job, test, info, callback](SxQueryResult *result) {
+        std::unique_ptr<SxQueryResult> queryResult(result);
+        std::unique_ptr<SxFile> testFile(test);
+        {
+            QMutexLocker locker(&mUploadJobMutex);
+            if (!mUploadJobs.contains(job))
+                return;
+            mUploadJobs.remove(job);
+            delete job;
+        }
+        SxError lastError = mLastError;
+        QString rev;
+        if (_getFileProcessReply(*test, queryResult.get(), true) && test->mRemoteSize == info.remoteSize) {
+            if (test->blockList() == info.blocks)
+                rev = test->mRevision;
+        }
+        mLastError = lastError;
+        callback(info.volume->name(), info.path, SxError(SxErrorCode::NoError, "", ""), rev, info.mTime);
+        emit sig_uploadJobsChanged();
+    });
 }
 
 void SxCluster::clearUploadJobs()
@@ -3047,6 +4765,96 @@ void SxCluster::clearUploadJobs()
     mUploadJobs.clear();
 }
 
+bool SxCluster::findShiftedBlocks(const QString &oldFilePath, const SxFile &file, QFile *target, SxDownloadPlan &plan)
+{
+    QFile oldFile(oldFilePath);
+    if (!oldFile.open(QIODevice::ReadOnly))
+        return true;
+    const int blockSize = file.mBlockSize;
+    const qint64 oldFileSize = oldFile.size();
+    if (oldFileSize < blockSize)
+        return true;
+    const uchar *mapped = oldFile.map(0, oldFileSize);
+    if (!mapped)
+        return true;
+    const char *data = reinterpret_cast<const char*>(mapped);
+
+    const int pendingBefore = plan.pendingCount();
+    auto hashAt = [this, data, blockSize](qint64 offset) -> QString {
+        return QString::fromUtf8(SxBlock::hashBlock(data + offset, blockSize, mClusterUuid));
+    };
+
+    QList<qint64> shifts;
+    qint64 budget = sDeltaScanBudget;
+    const qint64 window = qMin<qint64>(blockSize, budget / (2*qint64(blockSize)));
+    qint64 reused = 0;
+    bool failed = false;
+    QDateTime eventsTime = QDateTime::currentDateTime();
+    for (int index=0; index<file.mBlocks.count() && !plan.isEmpty(); index++) {
+        SxBlock *block = file.mBlocks.at(index);
+        if (!plan.isPending(block))
+            continue;
+        if (eventsTime.msecsTo(QDateTime::currentDateTime()) > 100) {
+            if (QCoreApplication::instance()->thread() == QThread::currentThread()) {
+                QEventLoop loop;
+                loop.processEvents(QEventLoop::AllEvents, 10);
+            }
+            eventsTime = QDateTime::currentDateTime();
+        }
+        if (aborted()) {
+            failed = true;
+            break;
+        }
+        const qint64 remoteOffset = static_cast<qint64>(index)*blockSize;
+        qint64 found = -1;
+        for (int i=0; i<shifts.count() && found < 0; i++) {
+            qint64 offset = remoteOffset + shifts.at(i);
+            if (offset >= 0 && offset + blockSize <= oldFileSize && hashAt(offset) == block->mHash) {
+                found = offset;
+                shifts.move(i, 0);
+            }
+        }
+        // look for a new shift around the block position while the scan budget allows it
+        for (qint64 shift=1; found < 0 && shift<=window && budget > 0; shift++) {
+            foreach (qint64 offset, QList<qint64>({remoteOffset - shift, remoteOffset + shift})) {
+                if (offset < 0 || offset + blockSize > oldFileSize)
+                    continue;
+                budget -= blockSize;
+                if (hashAt(offset) == block->mHash) {
+                    found = offset;
+                    shifts.prepend(offset - remoteOffset);
+                    while (shifts.count() > sDeltaMaxShifts)
+                        shifts.removeLast();
+                    break;
+                }
+            }
+        }
+        if (found < 0)
+            continue;
+        foreach (qint64 offset, plan.offsets(block)) {
+            qint64 toWrite = blockSize;
+            if (file.mRemoteSize-offset < toWrite)
+                toWrite = file.mRemoteSize-offset;
+            if (!XFile::writeAt(target, offset, data + found, toWrite)) {
+                mLastError = SxError(SxErrorCode::IOError, target->errorString(), target->errorString());
+                failed = true;
+                break;
+            }
+        }
+        if (failed)
+            break;
+        plan.setPending(block, false);
+        reused += blockSize;
+    }
+    oldFile.unmap(const_cast<uchar*>(mapped));
+    if (aborted())
+        return false;
+    if (plan.pendingCount() != pendingBefore) {
+        logVerbose(QString("reused %1 bytes of shifted content from %2").arg(reused).arg(oldFilePath));
+    }
+    return true;
+}
+
 bool SxCluster::downloadFile(SxVolume *volume, QString path, QString localFilePath, SxFileEntry &fileEntry, int connectionLimit)
 {
     return downloadFile(volume, path, "", localFilePath, fileEntry, connectionLimit);
@@ -3068,10 +4876,16 @@ bool SxCluster::downloadFile(SxVolume *volume, QString path, QString rev, QStrin
     }
     emit sig_setDownloadSize(file.remoteSize());
     QString tmpName;
+    std::unique_ptr<QTemporaryFile> decryptedFile;
+    std::unique_ptr<SxFilterStream> decryptStream;
+    std::unique_ptr<SxBlockWriter> blockWriter;
+    QFile partReader;
+    int decryptedBlocks = 0;
     QDateTime start;
     qint64 downloaded, downloadSize;
     QHash<SxQuery*, QPair<QStringList*, QHash<QString, SxBlock*>* > > activeQueriesHelper;
     QHash<SxQuery*, QStringList*> activeQueries;
+    QHash<SxQuery*, QDateTime> activeQueriesStart;
 
     if (connectionLimit == 0 && file.mBlocks.size()>0) {
         connectionLimit = file.mBlocks.first()->mNodeList.count();
@@ -3112,8 +4926,14 @@ bool SxCluster::downloadFile(SxVolume *volume, QString path, QString rev, QStrin
         return false;
     }
 
-    std::unique_ptr<QTemporaryFile> tmpFile(new QTemporaryFile(parentDir.absolutePath() + "/._sdrvtmpXXXXXX"));
-    if (!tmpFile->open()) {
+    QString partName = parentDir.absolutePath() + "/._sdrvtmp-" + QCryptographicHash::hash(localFileInfo.fileName().toUtf8(), QCryptographicHash::Sha1).toHex().left(16);
+    QString stateName = partName + ".state";
+    QBitArray completedBlocks(file.mBlocks.count());
+    bool resumed = QFileInfo(partName).size() == file.mRemoteSize &&
+            loadDownloadState(stateName, file.mRevision, file.mRemoteSize, file.mBlockSize, completedBlocks);
+    QDateTime stateSaved = QDateTime::currentDateTime();
+    std::unique_ptr<QFile> tmpFile(new QFile(partName));
+    if (!tmpFile->open(resumed ? QIODevice::ReadWrite : QIODevice::ReadWrite | QIODevice::Truncate)) {
         mLastError = SxError(SxErrorCode::IOError, "unable to open tempfile", QCoreApplication::translate("SxErrorMessage", "unable to open tempfile"));
         logWarning("unable to open file" + localFilePath);
         return false;
@@ -3131,16 +4951,112 @@ bool SxCluster::downloadFile(SxVolume *volume, QString path, QString rev, QStrin
 #endif
         mLastError = SxError(SxErrorCode::IOError, "unable to resize file", QCoreApplication::translate("SxErrorMessage", "unable to resize file"));
         logWarning("unable to resize file" + localFilePath);
-        return false;
+        tmpFile->remove();
+        QFile::remove(stateName);
+        return false;
+    }
+    SxDownloadPlan plan(file.mBlocks, file.mBlockSize);
+    if (resumed && file.mBlockSize > 0) {
+        for (int i=0; i<plan.blockCount(); i++) {
+            SxBlock *block = plan.block(i);
+            bool done = true;
+            foreach (qint64 offset, plan.offsets(block)) {
+                if (!completedBlocks.testBit(static_cast<int>(offset/file.mBlockSize))) {
+                    done = false;
+                    break;
+                }
+            }
+            if (done)
+                plan.setPending(block, false);
+        }
+        logInfo(QString("resuming download of %1, %2 of %3 blocks left").arg(path).arg(plan.pendingCount()).arg(plan.blockCount()));
+    }
+    if (file.mBlockSize > 0) {
+        // all-zero blocks are never fetched, their ranges become holes in the part file
+        SxBlock *zeroBlock = file.mUniqueBlocks.value(QString::fromUtf8(SxBlock::zeroBlockHash(file.mBlockSize, mClusterUuid)), nullptr);
+        if (zeroBlock && plan.isPending(zeroBlock)) {
+            const QVector<qint64> &offsets = plan.offsets(zeroBlock);
+            for (int i=0; i<offsets.count(); ) {
+                qint64 first = offsets.at(i);
+                qint64 last = first + file.mBlockSize;
+                while (++i < offsets.count() && offsets.at(i) == last)
+                    last += file.mBlockSize;
+                if (!XFile::zeroRange(tmpFile.get(), first, qMin(last, file.mRemoteSize) - first)) {
+                    mLastError = SxError(SxErrorCode::IOError, tmpFile->errorString(), tmpFile->errorString());
+                    return false;
+                }
+            }
+            foreach (qint64 offset, offsets) {
+                completedBlocks.setBit(static_cast<int>(offset/file.mBlockSize));
+            }
+            plan.setPending(zeroBlock, false);
+            logVerbose(QString("%1: %2 zero blocks left as holes").arg(path).arg(offsets.count()));
+        }
+    }
+    if (SxBlockCache::instance().enabled() && file.mBlockSize > 0) {
+        QByteArray blockData;
+        int hits = 0;
+        for (int i=plan.first(); i>=0; i=plan.next(i+1)) {
+            SxBlock *block = plan.block(i);
+            if (!SxBlockCache::instance().get(block->mHash, file.mBlockSize, blockData)
+                    || QString::fromUtf8(SxBlock::hashBlock(blockData, mClusterUuid)) != block->mHash)
+                continue;
+            foreach (qint64 offset, plan.offsets(block)) {
+                qint64 toWrite = qMin<qint64>(file.mBlockSize, file.mRemoteSize - offset);
+                if (!XFile::writeAt(tmpFile.get(), offset, blockData.constData(), toWrite)) {
+                    mLastError = SxError(SxErrorCode::IOError, tmpFile->errorString(), tmpFile->errorString());
+                    return false;
+                }
+                completedBlocks.setBit(static_cast<int>(offset/file.mBlockSize));
+            }
+            plan.setPending(block, false);
+            ++hits;
+        }
+        if (hits)
+            logVerbose(QString("%1: %2 blocks read from the block cache").arg(path).arg(hits));
+    }
+    if (file.mBlockSize > 0) {
+        // blocks other downloads of this sync already fetched are copied from their files
+        QByteArray blockData;
+        qint64 saved = 0;
+        for (int i=plan.first(); i>=0; i=plan.next(i+1)) {
+            SxBlock *block = plan.block(i);
+            if (!SxSyncBlocks::instance().read(block->mHash, file.mBlockSize, mClusterUuid, blockData))
+                continue;
+            foreach (qint64 offset, plan.offsets(block)) {
+                qint64 toWrite = qMin<qint64>(file.mBlockSize, file.mRemoteSize - offset);
+                if (!XFile::writeAt(tmpFile.get(), offset, blockData.constData(), toWrite)) {
+                    mLastError = SxError(SxErrorCode::IOError, tmpFile->errorString(), tmpFile->errorString());
+                    return false;
+                }
+                completedBlocks.setBit(static_cast<int>(offset/file.mBlockSize));
+            }
+            plan.setPending(block, false);
+            saved += file.mBlockSize;
+        }
+        if (saved) {
+            logVerbose(QString("%1: %2 bytes copied from files of this sync").arg(path).arg(saved));
+            SxMetrics::instance().addDownloadDedupSavings(saved);
+        }
     }
-    auto blocksOffsets = file.getBlocksOffsets();
-    auto toDownload = blocksOffsets.keys();
 
     const int batchLimit = 4*1024*1024;
+    const int batchLimitMax = 16*1024*1024;
     int blocksLimit = 30;
+    int blocksLimitMax = 30;
     if (blocksLimit * file.mBlockSize > batchLimit) {
         blocksLimit = batchLimit/file.mBlockSize;
     }
+    if (blocksLimitMax * file.mBlockSize > batchLimitMax) {
+        blocksLimitMax = batchLimitMax/file.mBlockSize;
+    }
+    if (file.mBlockSize > 0) {
+        int memoryLimit = static_cast<int>(sDownloadMemoryLimit / (static_cast<qint64>(blocksLimitMax)*file.mBlockSize));
+        if (memoryLimit < 1)
+            memoryLimit = 1;
+        if (connectionLimit > memoryLimit)
+            connectionLimit = memoryLimit;
+    }
 
     if (!filter || !filter->dataProcess()) {
         if (mGetLocalBlocks && file.mRemoteSize > 0) {
@@ -3153,82 +5069,108 @@ bool SxCluster::downloadFile(SxVolume *volume, QString path, QString rev, QStrin
                 mLastError = SxError(SxErrorCode::IOError, "creating tempFile failed", "creating tempFile failed");
                 return false;
             }
-            foreach (auto block, toDownload) {
-                if (!missingBlocks.contains(block->mHash)) {
-                    toDownload.removeOne(block);
-                }
+            for (int i=plan.first(); i>=0; i=plan.next(i+1)) {
+                if (!missingBlocks.contains(plan.block(i)->mHash))
+                    plan.setPending(plan.block(i), false);
             }
         }
         else if (localFileInfo.exists())
         {
             mtime = localFileInfo.lastModified();
-            auto lambda = [&file, &toDownload, &blocksOffsets, &tmpFile, this](const QString& hash, const QByteArray& data) -> bool {
-                if (file.mUniqueBlocks.contains(hash)) {
-                    SxBlock* block = file.mUniqueBlocks.value(hash);
-                    if (toDownload.contains(block)) {
-                       auto list = blocksOffsets.value(block);
-                       foreach (qint64 offset, list) {
-                           if (!tmpFile->seek(offset)) {
-                               mLastError = SxError(SxErrorCode::IOError, tmpFile->errorString(), tmpFile->errorString());
-                               return false;
-                           }
-                           qint64 toWrite = file.mBlockSize;
-                           if (tmpFile->size()-offset < toWrite)
-                               toWrite = tmpFile->size()-offset;
-                           if (tmpFile->write(data.constData(), toWrite) != toWrite) {
-                               mLastError = SxError(SxErrorCode::IOError, tmpFile->errorString(), tmpFile->errorString());
-                               return false;
-                           }
-                       }
-                       toDownload.removeOne(block);
+            SxMappedFile oldFile(localFileInfo.absoluteFilePath(), false);
+            if (oldFile.open() && file.mBlockSize > 0) {
+                const int blockSize = file.mBlockSize;
+                const qint64 oldFileSize = oldFile.size();
+                const qint64 blockCount = (oldFileSize + blockSize - 1) / blockSize;
+                auto readBlock = [oldFileSize, blockSize](SxMappedFile &source, qint64 index, QByteArray &data) -> bool {
+                    qint64 offset = index*blockSize;
+                    int size = static_cast<int>(qMin<qint64>(blockSize, oldFileSize - offset));
+                    data.resize(blockSize);
+                    if (!source.read(offset, data.data(), size))
+                        return false;
+                    if (size < blockSize)
+                        memset(data.data() + size, 0, static_cast<size_t>(blockSize - size));
+                    return true;
+                };
+                const QString oldFilePath = localFileInfo.absoluteFilePath();
+                const SxCancelToken token = cancelToken();
+                auto scanRange = [this, &file, &readBlock, &oldFilePath, &token, oldFileSize, blockSize](qint64 first, qint64 last) -> QList<QPair<qint64, SxBlock*>> {
+                    QList<QPair<qint64, SxBlock*>> matches;
+                    SxMappedFile source(oldFilePath);
+                    if (!source.open())
+                        return matches;
+                    QByteArray data;
+                    for (qint64 i=first; i<last; i++) {
+                        if (token.isCancelled())
+                            break;
+                        QString hash;
+                        const char *mapped = (i+1)*blockSize <= oldFileSize ? source.map(i*blockSize, blockSize) : nullptr;
+                        if (mapped)
+                            hash = QString::fromUtf8(SxBlock::hashBlock(mapped, blockSize, mClusterUuid));
+                        else if (readBlock(source, i, data))
+                            hash = QString::fromUtf8(SxBlock::hashBlock(data, mClusterUuid));
+                        else
+                            break;
+                        SxBlock *block = file.mUniqueBlocks.value(hash, nullptr);
+                        if (block)
+                            matches.append({i, block});
                     }
+                    return matches;
+                };
+
+                int workers = qMax(1, QThread::idealThreadCount());
+                qint64 rangeSize = qMax<qint64>(sOldFileScanBlocks, (blockCount + workers - 1) / workers);
+                QList<QFuture<QList<QPair<qint64, SxBlock*>>>> futures;
+                for (qint64 first=0; first<blockCount; first+=rangeSize) {
+                    futures.append(QtConcurrent::run(scanRange, first, qMin(first+rangeSize, blockCount)));
                 }
-                return true;
-            };
-
-            QFile oldFile(localFileInfo.absoluteFilePath());
-            if (oldFile.open(QIODevice::ReadOnly)) {
-                int blockSize = file.mBlockSize;
-                qint64 offset = 0;
-                qint64 oldFileSize = oldFile.size();
-                QByteArray blockData;
                 bool failed = false;
-                while(offset + blockSize <= oldFileSize) {
-                    if (QCoreApplication::instance()->thread() == QThread::currentThread()){
-                        QEventLoop loop;
-                        loop.processEvents(QEventLoop::AllEvents, 10);
-                    }
-                    if (aborted()) {
-                        return false;
-                    }
-                    offset+=blockSize;
-                    blockData = oldFile.read(blockSize);
-                    if (blockData.size() != blockSize) {
-                        failed = true;
-                        break;
-                    }
-                    QString hash = QString::fromUtf8(SxBlock::hashBlock(blockData,mClusterUuid));
-                    if (!lambda(hash, blockData)) {
-                        failed = true;
-                        break;
+                QByteArray blockData;
+                for (int f=0; f<futures.count(); f++) {
+                    auto &future = futures[f];
+                    while (!future.isFinished()) {
+                        if (QCoreApplication::instance()->thread() == QThread::currentThread()) {
+                            QEventLoop loop;
+                            loop.processEvents(QEventLoop::AllEvents, 10);
+                        }
+                        else
+                            future.waitForFinished();
                     }
-                }
-                if (oldFileSize - offset > 0 && !failed) {
-                    int size = static_cast<int>(oldFileSize - offset);
-                    blockData = oldFile.read(size);
-                    if (blockData.size() == size) {
-                        blockData.resize(blockSize);
-                        for (int i=size; i<blockSize; i++) {
-                            blockData[i]=0;
+                    if (failed || aborted())
+                        continue;
+                    foreach (auto match, future.result()) {
+                        SxBlock *block = match.second;
+                        if (!plan.isPending(block))
+                            continue;
+                        if (!readBlock(oldFile, match.first, blockData)) {
+                            failed = true;
+                            break;
+                        }
+                        foreach (qint64 offset, plan.offsets(block)) {
+                            qint64 toWrite = file.mBlockSize;
+                            if (file.mRemoteSize-offset < toWrite)
+                                toWrite = file.mRemoteSize-offset;
+                            if (!XFile::writeAt(tmpFile.get(), offset, blockData.constData(), toWrite)) {
+                                mLastError = SxError(SxErrorCode::IOError, tmpFile->errorString(), tmpFile->errorString());
+                                failed = true;
+                                break;
+                            }
                         }
-                        QString hash = QString::fromUtf8(SxBlock::hashBlock(blockData,mClusterUuid));
-                        lambda(hash, blockData);
+                        if (failed)
+                            break;
+                        plan.setPending(block, false);
                     }
                 }
+                if (aborted())
+                    return false;
             }
         }
+        if (mDeltaDownload && !plan.isEmpty() && localFileInfo.exists() && file.mBlockSize > 0) {
+            if (!findShiftedBlocks(localFileInfo.absoluteFilePath(), file, tmpFile.get(), plan))
+                return false;
+        }
     }
-    else if (mFindIdenticalFilesCallback && file.mRemoteSize > 0) {
+    else if (mFindIdenticalFilesCallback && file.mRemoteSize > 0 && !resumed) {
         QStringList blockList;
         QList<QPair<QString, quint32>> files;
         foreach (auto block, file.mBlocks) {
@@ -3283,7 +5225,6 @@ bool SxCluster::downloadFile(SxVolume *volume, QString path, QString rev, QStrin
                         mLastError = SxError(SxErrorCode::IOError, tmpFile->errorString(), tmpFile->errorString());
                         return false;
                     }
-                    tmpFile->setAutoRemove(false);
                     tmpFile->close();
                     tmpName = tmpFile->fileName();
                     goto renameFile;
@@ -3303,38 +5244,118 @@ bool SxCluster::downloadFile(SxVolume *volume, QString path, QString rev, QStrin
             }
         }
     }
+    if (filter && filter->dataProcess()) {
+        // decrypt the completed prefix of the file while the rest is still being downloaded
+        decryptedFile.reset(new QTemporaryFile(localFileInfo.absolutePath() + "/._sdrvtmpXXXXXX"));
+        partReader.setFileName(partName);
+        if (!decryptedFile->open() || !partReader.open(QIODevice::ReadOnly | QIODevice::Unbuffered)) {
+            mLastError = SxError(SxErrorCode::IOError, "failed to create temporary file", QCoreApplication::translate("SxErrorMessage", "failed to create temporary file"));
+            goto cleanMemory;
+        }
+        XFile::makeInvisible(decryptedFile->fileName(), true);
+        // plan indexes follow the first offset of each block, so batches come in file order
+        decryptStream.reset(new SxFilterStream(filter.get(), SXF_MODE_DOWNLOAD));
+    }
     {
         downloaded = 0;
-        downloadSize = static_cast<qint64>(toDownload.size())*file.mBlockSize;
+        downloadSize = static_cast<qint64>(plan.pendingCount())*file.mBlockSize;
         start = QDateTime::currentDateTime();
-
-        while (!toDownload.isEmpty() || !activeQueries.isEmpty()) {
+        blockWriter.reset(new SxBlockWriter(partName, sDownloadWriteQueue));
+        blockWriter->start();
+        // blocks count as completed once they are on disk, not when they are handed to the writer
+        auto collectWritten = [&]() {
+            foreach (qint64 offset, blockWriter->takeWritten()) {
+                int index = static_cast<int>(offset/file.mBlockSize);
+                completedBlocks.setBit(index);
+                if (!decryptStream)
+                    SxSyncBlocks::instance().add(file.mBlocks.at(index)->mHash, file.mBlockSize, partName, offset);
+            }
+        };
+        auto decryptCompleted = [&]() -> bool {
+            if (!decryptStream)
+                return true;
+            const int blockCount = file.mBlocks.count();
+            const int batchBlocks = qMax(1, sFilterHashBatchSize / file.mBlockSize);
+            SxPooledBuffer data(batchBlocks*file.mBlockSize);
+            while (decryptedBlocks < blockCount && completedBlocks.testBit(decryptedBlocks)) {
+                int count = 1;
+                while (count < batchBlocks && decryptedBlocks + count < blockCount && completedBlocks.testBit(decryptedBlocks + count))
+                    ++count;
+                qint64 offset = static_cast<qint64>(decryptedBlocks)*file.mBlockSize;
+                qint64 size = qMin<qint64>(static_cast<qint64>(count)*file.mBlockSize, file.mRemoteSize - offset);
+                if (!partReader.seek(offset) || partReader.read(data.data(), size) != size) {
+                    mLastError = SxError(SxErrorCode::IOError, partReader.errorString(), partReader.errorString());
+                    return false;
+                }
+                decryptedBlocks += count;
+                bool ok = decryptStream->process(data.constData(), size, decryptedBlocks == blockCount, [&decryptedFile](const char *out, qint64 outSize)->bool {
+                    return decryptedFile->write(out, outSize) == outSize;
+                });
+                if (!ok) {
+                    QString message = QT_TRANSLATE_NOOP("SxErrorMessage", "Filter %1 dataProcess failed");
+                    mLastError = SxError(SxErrorCode::FilterError, message.arg(filter->shortname()), QCoreApplication::translate("SxErrorMessage", message.toUtf8().constData()).arg(filter->shortname()));
+                    return false;
+                }
+            }
+            return true;
+        };
+        if (!decryptCompleted())
+            goto cleanMemory;
+
+        // a batch running longer than the p95 reply time of its node is also requested
+        // from another replica, the copy which finishes first is used and the other one dropped
+        QHash<SxQuery*, SxQuery*> hedgePartners;
+        QHash<QString, QList<qint64>> blockReplyTimes;
+        qint64 hedgedSize = 0;
+        const qint64 hedgeBudget = downloadSize*sHedgeBudgetPercent/100;
+        auto hedgeDelay = [&](SxQuery *query) -> qint64 {
+            QString host = activeQueryHost(query);
+            if (host.isEmpty())
+                return -1;
+            QList<qint64> samples = blockReplyTimes.value(host);
+            if (samples.count() < sHedgeMinSamples)
+                return -1;
+            qSort(samples);
+            qint64 p95 = samples.at(qMin(samples.count()-1, samples.count()*95/100));
+            return qMax<qint64>(p95*activeQueriesHelper.value(query).first->count(), sHedgeMinDelay);
+        };
+        auto dropQuery = [&](SxQuery *query) {
+            abortQuery(query);
+            auto helper = activeQueriesHelper.take(query);
+            delete helper.first;
+            delete helper.second;
+            delete activeQueries.take(query);
+            activeQueriesStart.remove(query);
+            delete query;
+        };
+
+        while (!plan.isEmpty() || !activeQueries.isEmpty()) {
             if (mtime.isValid()) {
                 localFileInfo.refresh();
                 if (mtime != localFileInfo.lastModified()) {
                     logWarning(QString("file %1 changed during download").arg(localFileInfo.absoluteFilePath()));
                     mLastError = SxError(SxErrorCode::UnknownError, "file changed during download", QCoreApplication::translate("SxErrorMessage", "file changed during download"));
-                    abortAllQueries();
-                    return false;
+                    goto cleanMemory;
                 }
             }
             while (activeQueriesHelper.count() < connectionLimit) {
                 QList<SxBlock*> batch;
-                if (toDownload.isEmpty())
+                const int first = plan.first();
+                if (first < 0)
                     break;
-                batch.append(toDownload.takeFirst());
-                QString target = radomValueFromList(batch.first()->mNodeList);
+                batch.append(plan.block(first));
+                plan.setPending(batch.first(), false);
+                QString target = selectNode(batch.first()->mNodeList);
                 QSet<QString> nodeCounter;
                 foreach (auto node, batch.first()->mNodeList) {
                     nodeCounter.insert(node);
                 }
 
-                foreach (SxBlock* block, toDownload) {
-                    if (batch.count() >= blocksLimit)
-                        break;
+                for (int i=plan.next(first+1); i>=0 && batch.count() < blocksLimit; i=plan.next(i+1)) {
+                    SxBlock *block = plan.block(i);
                     if (block->mNodeList.contains(target)) {
                         batch.append(block);
-                        toDownload.removeAll(block);
+                        plan.setPending(block, false);
                         foreach (auto node, nodeCounter) {
                             if (!block->mNodeList.contains(node))
                                 nodeCounter.remove(node);
@@ -3354,31 +5375,89 @@ bool SxCluster::downloadFile(SxVolume *volume, QString path, QString rev, QStrin
                 }
                 activeQueries.insert(query, targets);
                 activeQueriesHelper.insert(query, {keys, hashMap});
+                activeQueriesStart.insert(query, QDateTime::currentDateTime());
             }
 
-            auto selectResult = querySelect(activeQueries);
+            qint64 wakeupTime = -1;
+            if (hedgeBudget > 0) {
+                QDateTime now = QDateTime::currentDateTime();
+                foreach (SxQuery *query, activeQueries.keys()) {
+                    if (hedgePartners.contains(query) || activeQueries.value(query)->isEmpty())
+                        continue;
+                    qint64 delay = hedgeDelay(query);
+                    if (delay < 0)
+                        continue;
+                    QHash<QString, SxBlock*> *hashMap = activeQueriesHelper.value(query).second;
+                    qint64 size = static_cast<qint64>(hashMap->count())*file.mBlockSize;
+                    if (hedgedSize + size > hedgeBudget)
+                        continue;
+                    qint64 remaining = delay - activeQueriesStart.value(query).msecsTo(now);
+                    if (remaining > 0) {
+                        if (wakeupTime < 0 || remaining < wakeupTime)
+                            wakeupTime = remaining;
+                        continue;
+                    }
+                    QStringList *keys = new QStringList();
+                    QHash<QString, SxBlock*> *hedgeMap = new QHash<QString, SxBlock*>();
+                    SxQuery *hedge = _getBlocksMakeQuery(hashMap->values(), file.mBlockSize, *keys, *hedgeMap);
+                    if (!hedge) {
+                        delete keys;
+                        delete hedgeMap;
+                        continue;
+                    }
+                    QStringList *targets = new QStringList(activeQueries.value(query)->takeFirst());
+                    logVerbose(QString("%1: batch of %2 blocks is late, requesting it from %3").arg(activeQueryHost(query)).arg(keys->count()).arg(targets->first()));
+                    activeQueries.insert(hedge, targets);
+                    activeQueriesHelper.insert(hedge, {keys, hedgeMap});
+                    activeQueriesStart.insert(hedge, now);
+                    hedgePartners.insert(query, hedge);
+                    hedgePartners.insert(hedge, query);
+                    hedgedSize += size;
+                }
+            }
+
+            bool wokenUp = false;
+            auto selectResult = querySelect(activeQueries, QString(), static_cast<int>(wakeupTime), &wokenUp);
+            if (wokenUp)
+                continue;
 
             SxQuery* currentQuerry = selectResult.first;
             std::unique_ptr<SxQueryResult> queryResult(selectResult.second);
             if (!queryResult)
-                return false;
+                goto cleanMemory;
             auto queryHelper = activeQueriesHelper.value(currentQuerry);
             QStringList *keys = queryHelper.first;
             QHash<QString, SxBlock*> *hashMap = queryHelper.second;
 
             ++mNodeQuerriesCounter[queryResult->host()];
+            qint64 replyTime = activeQueriesStart.take(currentQuerry).msecsTo(QDateTime::currentDateTime());
+            SxQuery *partner = hedgePartners.value(currentQuerry, nullptr);
+            if (partner) {
+                hedgePartners.remove(currentQuerry);
+                hedgePartners.insert(partner, nullptr);
+                if (queryResult->error().errorCode() != SxErrorCode::NoError && queryResult->error().errorCode() != SxErrorCode::AbortedByUser) {
+                    // the other copy of this batch is still running
+                    logVerbose(QString("%1: hedged batch failed: %2").arg(queryResult->host()).arg(queryResult->error().errorMessage()));
+                    dropQuery(currentQuerry);
+                    continue;
+                }
+                hedgePartners.remove(partner);
+                dropQuery(partner);
+            }
             if (queryResult->error().errorCode() == SxErrorCode::Timeout || queryResult->error().errorCode() == SxErrorCode::SslError) {
                 logWarning(queryResult->error().errorMessage());
                 if (connectionLimit > 1)
                     --connectionLimit;
+                if (blocksLimit > 1) {
+                    blocksLimit /= 2;
+                    logVerbose(QString("batch size decreased to %1 blocks").arg(blocksLimit));
+                }
                 foreach (SxBlock* block, hashMap->values()) {
                     if (block->mNodeList.isEmpty()) {
                         logWarning("failed to get block " + block->mHash + " (all nodes failed)");
-                        tmpFile->close();
-                        tmpFile->remove();
                         goto cleanMemory;
                     }
-                    toDownload.append(block);
+                    plan.setPending(block, true);
                 }
             }
             else if (queryResult->error().errorCode() != SxErrorCode::NoError) {
@@ -3391,50 +5470,94 @@ bool SxCluster::downloadFile(SxVolume *volume, QString path, QString rev, QStrin
                     QJsonDocument jDoc;
                     parseJson(queryResult.get(), jDoc);
                 }
-                tmpFile->close();
-                tmpFile->remove();
                 goto cleanMemory;
             }
             else {
-                if (!_getBlocksProcessReply(queryResult.get(), file.mBlockSize, *keys, *hashMap)) {
-                    tmpFile->close();
-                    tmpFile->remove();
+                // blocks not matching their hash are dropped and fetched again from another replica,
+                // the previous batches are still being written meanwhile
+                QSet<QString> corrupt = _corruptBlocks(queryResult.get(), file.mBlockSize, *keys);
+                if (!corrupt.isEmpty()) {
+                    logWarning(QString("%1: %2 of %3 blocks don't match their hash").arg(queryResult->host()).arg(corrupt.count()).arg(keys->count()));
+                    SxNodeHealth::instance().reportCorruptData(queryResult->host());
+                    foreach (const QString &key, corrupt) {
+                        SxBlock *block = hashMap->value(key);
+                        if (block->mNodeList.isEmpty()) {
+                            logWarning("failed to get block " + block->mHash + " (all replicas corrupt or failed)");
+                            mLastError = SxError::errorBadReplyContent();
+                            goto cleanMemory;
+                        }
+                        plan.setPending(block, true);
+                    }
+                }
+                bool writeFailed = false;
+                bool writeAborted = false;
+                auto writeBlock = [&](SxBlock *block, const char *blockData) -> bool {
+                    if (QCoreApplication::instance()->thread() == QThread::currentThread()){
+                        QEventLoop loop;
+                        loop.processEvents(QEventLoop::AllEvents, 10);
+                    }
+                    if (aborted()) {
+                        writeAborted = true;
+                        return false;
+                    }
+                    if (corrupt.contains(block->mHash))
+                        return true;
+                    QList<QPair<qint64, qint64> > ranges;
+                    foreach (auto offset, plan.offsets(block)) {
+                        qint64 toWrite = file.mBlockSize;
+                        if (file.mRemoteSize-offset < file.mBlockSize)
+                            toWrite = file.mRemoteSize-offset;
+                        ranges.append({offset, toWrite});
+                    }
+                    if (!blockWriter->enqueue(ranges, blockData)) {
+                        mLastError = SxError(SxErrorCode::IOError, blockWriter->errorString(), blockWriter->errorString());
+                        writeFailed = true;
+                        return false;
+                    }
+                    SxBlockCache::instance().put(block->mHash, file.mBlockSize, blockData);
+                    return true;
+                };
+                if (!_getBlocksProcessReply(queryResult.get(), file.mBlockSize, *keys, *hashMap, writeBlock)) {
+                    if (writeAborted)
+                        goto cleanMemory;
+                    if (writeFailed)
+                        goto io_error;
                     logWarning("failed to get blocks");
                     goto cleanMemory;
                 }
+                collectWritten();
+                if (!decryptCompleted())
+                    goto cleanMemory;
+                if (stateSaved.msecsTo(QDateTime::currentDateTime()) > sDownloadStateInterval && tmpFile->flush()) {
+                    saveDownloadState(stateName, file.mRevision, file.mRemoteSize, file.mBlockSize, completedBlocks);
+                    stateSaved = QDateTime::currentDateTime();
+                }
 
-                foreach (SxBlock* block, hashMap->values()) {
-                    auto offsetList = blocksOffsets.value(block);
-                    foreach (auto offset, offsetList) {
-                        if (QCoreApplication::instance()->thread() == QThread::currentThread()){
-                            QEventLoop loop;
-                            loop.processEvents(QEventLoop::AllEvents, 10);
-                        }
-                        if (aborted()) {
-                            return false;
-                        }
-                        if (!tmpFile->seek(offset)) {
-                            mLastError = SxError(SxErrorCode::IOError, tmpFile->errorString(), tmpFile->errorString());
-                            goto io_error;
-                        }
-
-                        qint64 toWrite = file.mBlockSize;
-                        if (tmpFile->size()-offset < file.mBlockSize)
-                            toWrite = tmpFile->size()-offset;
-                        if (tmpFile->write(block->mData.constData(), toWrite) != toWrite) {
-                            mLastError = SxError(SxErrorCode::IOError, tmpFile->errorString(), tmpFile->errorString());
-                            goto io_error;
-                        }
+                downloaded += static_cast<qint64>(keys->count()-corrupt.count())*file.mBlockSize;
+                if (!keys->isEmpty()) {
+                    QList<qint64> &samples = blockReplyTimes[queryResult->host()];
+                    samples.append(replyTime/keys->count());
+                    while (samples.count() > sHedgeSamples)
+                        samples.removeFirst();
+                }
+                if (replyTime > 0) {
+                    qint64 batchSpeed = static_cast<qint64>(keys->count())*file.mBlockSize*1000/replyTime;
+                    if (replyTime < sDownloadBatchTime/2 && keys->count() >= blocksLimit && blocksLimit < blocksLimitMax) {
+                        blocksLimit = qMin(blocksLimit*2, blocksLimitMax);
+                        logVerbose(QString("%1: %2/s, batch size increased to %3 blocks").arg(queryResult->host()).arg(formatSize(batchSpeed)).arg(blocksLimit));
+                    }
+                    else if (replyTime > sDownloadBatchTime && blocksLimit > 1) {
+                        blocksLimit = qMax(blocksLimit/2, 1);
+                        logVerbose(QString("%1: %2/s, batch size decreased to %3 blocks").arg(queryResult->host()).arg(formatSize(batchSpeed)).arg(blocksLimit));
                     }
-                    block->mData.clear();
                 }
-
-                downloaded += static_cast<qint64>(keys->count())*file.mBlockSize;
                 double downloadTime = start.msecsTo(QDateTime::currentDateTime())/1000.0;
                 qint64 speed = 0;
                 if (downloadTime>0) {
                     qint64 size = downloadSize - downloaded;
                     speed = static_cast<qint64>(downloaded/downloadTime);
+                    if (mDownloadLimiter.rate() > 0)
+                        speed = qMin(speed, mDownloadLimiter.rate());
                     emit sig_setProgress(size, speed);
                 }
             }
@@ -3446,6 +5569,14 @@ bool SxCluster::downloadFile(SxVolume *volume, QString path, QString rev, QStrin
                 delete targets;
             delete currentQuerry;
         }
+        if (!blockWriter->sync()) {
+            mLastError = SxError(SxErrorCode::IOError, blockWriter->errorString(), blockWriter->errorString());
+            goto io_error;
+        }
+        collectWritten();
+        blockWriter.reset(nullptr);
+        if (!decryptCompleted())
+            goto cleanMemory;
         if (!tmpFile->flush()) {
             mLastError = SxError(SxErrorCode::IOError, tmpFile->errorString(), tmpFile->errorString());
             goto io_error;
@@ -3465,26 +5596,19 @@ bool SxCluster::downloadFile(SxVolume *volume, QString path, QString rev, QStrin
     }
 
     {
-        if (filter && filter->dataProcess()) {
-            logVerbose("start processing file");
-            QTemporaryFile decryptedFile(localFileInfo.absolutePath() + "/._sdrvtmpXXXXXX");
-            if (!decryptedFile.open() || !tmpFile->open()) {
-                mLastError = SxError(SxErrorCode::IOError, "failed to create temporary file", QCoreApplication::translate("SxErrorMessage", "failed to create temporary file"));
-                return false;
-            }
-            XFile::makeInvisible(decryptedFile.fileName(), true);
-            if (!_filter_data_process(tmpFile.get(), &decryptedFile, filter.get(), localFilePath, true)) {
-                QString message = QT_TRANSLATE_NOOP("SxErrorMessage", "Filter %1 dataProcess failed");
-                mLastError = SxError(SxErrorCode::FilterError, message.arg(filter->shortname()), QCoreApplication::translate("SxErrorMessage", message.toUtf8().constData()).arg(filter->shortname()));
+        if (decryptStream) {
+            if (decryptedBlocks != file.mBlocks.count() || !decryptedFile->flush()) {
+                if (mLastError.errorCode() == SxErrorCode::NoError)
+                    mLastError = SxError(SxErrorCode::IOError, decryptedFile->errorString(), decryptedFile->errorString());
                 return false;
             }
-            tmpFile->close();
-            decryptedFile.close();
-            decryptedFile.setAutoRemove(false);
-            tmpName = decryptedFile.fileName();
+            partReader.close();
+            tmpFile->remove();
+            decryptedFile->close();
+            decryptedFile->setAutoRemove(false);
+            tmpName = decryptedFile->fileName();
         }
         else {
-            tmpFile->setAutoRemove(false);
             tmpName = tmpFile->fileName();
         }
         tmpFile.reset(nullptr);
@@ -3501,6 +5625,8 @@ bool SxCluster::downloadFile(SxVolume *volume, QString path, QString rev, QStrin
     renameFile:
     {
         fileEntry.mCreatedAt = 0;
+        if (mCommitCallback)
+            mCommitCallback(tmpName, localFilePath);
         if (!XFile::safeRename(tmpName, localFilePath)) {
             logWarning("safe rename failed, create conflict file");
             QTemporaryFile conflicted(localFileInfo.absolutePath() +
@@ -3520,6 +5646,8 @@ bool SxCluster::downloadFile(SxVolume *volume, QString path, QString rev, QStrin
             QString conflictedFilename = conflicted.fileName();
             conflicted.setAutoRemove(false);
             conflicted.close();
+            if (mCommitCallback)
+                mCommitCallback(tmpName, conflictedFilename);
             if(!XFile::safeRename(tmpName, conflictedFilename)) {
                 conflicted.remove();
                 if(!QFile::rename(tmpName, conflictedFilename)) {
@@ -3535,28 +5663,47 @@ bool SxCluster::downloadFile(SxVolume *volume, QString path, QString rev, QStrin
             else
                 fileEntry.mCreatedAt = QFileInfo(conflictedFilename).lastModified().toTime_t();
             XFile::makeInvisible(conflictedFilename, false);
+            SxSyncBlocks::instance().renameFile(tmpName, conflictedFilename);
         }
         else {
             XFile::makeInvisible(localFilePath, false);
+            SxSyncBlocks::instance().renameFile(tmpName, localFilePath);
             fileEntry.mCreatedAt = QFileInfo(localFilePath).lastModified().toTime_t();
         }
+        QFile::remove(stateName);
     }
 
     fileEntry.mPath = path;
     fileEntry.mSize = file.mRemoteSize;
     fileEntry.mRevision = file.mRevision;
     fileEntry.mBlockSize = file.mBlockSize;
-    fileEntry.mBlocks.clear();
-    foreach (auto block, file.mBlocks) {
-        fileEntry.mBlocks.append(block->mHash);
-    }
+    fileEntry.mBlocks = file.blockList();
+    XFile::releaseCache(localFilePath);
     return true;
 
     io_error:
     logWarning("I/O error: "+mLastError.errorMessage());
+    blockWriter.reset(nullptr);
+    tmpFile->close();
+    tmpFile->remove();
+    SxSyncBlocks::instance().removeFile(partName);
+    QFile::remove(stateName);
+    tmpFile.reset(nullptr);
 
     cleanMemory:
-    foreach (auto pair, activeQueriesHelper) {
+    if (blockWriter) {
+        // whatever reached the disk is kept for the resumed download
+        blockWriter->sync();
+        foreach (qint64 offset, blockWriter->takeWritten()) {
+            completedBlocks.setBit(static_cast<int>(offset/file.mBlockSize));
+        }
+        blockWriter.reset(nullptr);
+    }
+    if (tmpFile && tmpFile->isOpen() && tmpFile->flush()) {
+        tmpFile->close();
+        saveDownloadState(stateName, file.mRevision, file.mRemoteSize, file.mBlockSize, completedBlocks);
+    }
+    foreach (auto pair, activeQueriesHelper) {
         delete pair.first;
         delete pair.second;
     }
@@ -3567,6 +5714,465 @@ bool SxCluster::downloadFile(SxVolume *volume, QString path, QString rev, QStrin
     return false;
 }
 
+/* downloads a group of small files at once: their block lists are requested in parallel and
+ * the blocks of all files share the /.data/ batches, so a file costs no round trips of its own;
+ * files missing from fileEntries afterwards are left to downloadFile() */
+bool SxCluster::downloadFiles(SxVolume *volume, const QList<QPair<QString, QString>> &files, QHash<QString, SxFileEntry> &fileEntries, int connectionLimit)
+{
+    FunctionBlocker fb(this, Q_FUNC_INFO);
+    if (fb.exit())
+        return false;
+    logInfo(QString("volume: %1, files: %2").arg(volume->name()).arg(files.count()));
+    setAborted(false);
+    mLastError = SxError();
+    fileEntries.clear();
+    {
+        // filtered volumes need the per file filter setup of downloadFile()
+        std::unique_ptr<SxFilter> filter(SxFilter::getActiveFilter(volume));
+        if (filter && (filter->dataPrepare() || filter->dataProcess()))
+            return true;
+    }
+    if (connectionLimit == 0)
+        connectionLimit = qMax(2, volume->nodeList().count());
+
+    struct BatchQuery {
+        QStringList keys;
+        QHash<QString, SxBlock*> hash;
+        int blockSize;
+    };
+    std::vector<std::unique_ptr<BatchDownload>> downloads;
+    QHash<SxQuery*, QStringList*> activeQueries;
+    QHash<SxQuery*, BatchDownload*> metaQueries;
+    QHash<SxQuery*, BatchQuery> blockQueries;
+    QMap<int, QList<SxBlock*>> pending;
+    QHash<QString, QList<QPair<BatchDownload*, qint64>>> targets;
+    qint64 downloadSize = 0;
+    qint64 downloaded = 0;
+    QDateTime start;
+    QList<BatchDownload*> finished;
+
+    // finished files are put in place together: one sync makes all their part files durable
+    // before any of them replaces a file, then the renames and one sync per directory; a
+    // crash in between leaves part files, which the next download of the file truncates
+    auto commitFiles = [&]() {
+        if (finished.isEmpty())
+            return;
+        if (!XFile::syncFileSystem(finished.first()->partName))
+            logWarning(QString("unable to sync %1 downloaded files").arg(finished.count()));
+        QSet<QString> dirs;
+        foreach (BatchDownload *download, finished) {
+            if (mCommitCallback)
+                mCommitCallback(download->partName, download->localPath);
+            if (!XFile::safeRename(download->partName, download->localPath)) {
+                QFile::remove(download->partName);
+                SxSyncBlocks::instance().removeFile(download->partName);
+                download->failed = true;
+                continue;
+            }
+            XFile::makeInvisible(download->localPath, false);
+            SxSyncBlocks::instance().renameFile(download->partName, download->localPath);
+            dirs.insert(QFileInfo(download->localPath).absolutePath());
+            SxFileEntry fileEntry;
+            fileEntry.mPath = download->path;
+            fileEntry.mSize = download->file.mRemoteSize;
+            fileEntry.mRevision = download->file.mRevision;
+            fileEntry.mBlockSize = download->file.mBlockSize;
+            fileEntry.mBlocks = download->file.blockList();
+            fileEntry.mCreatedAt = QFileInfo(download->localPath).lastModified().toTime_t();
+            fileEntries.insert(download->path, fileEntry);
+        }
+        foreach (const QString &dir, dirs) {
+            XFile::syncDirectory(dir);
+        }
+        finished.clear();
+    };
+    auto cleanup = [&]() {
+        commitFiles();
+        foreach (SxQuery *query, activeQueries.keys()) {
+            delete activeQueries.value(query);
+            delete query;
+        }
+        activeQueries.clear();
+        abortAllQueries();
+        for (auto &download : downloads) {
+            if (download->part) {
+                download->part->close();
+                download->part->remove();
+                download->part.reset(nullptr);
+                SxSyncBlocks::instance().removeFile(download->partName);
+            }
+        }
+    };
+    auto failFile = [](BatchDownload *download) {
+        download->failed = true;
+        if (download->part) {
+            download->part->close();
+            download->part->remove();
+            download->part.reset(nullptr);
+            SxSyncBlocks::instance().removeFile(download->partName);
+        }
+    };
+    auto finishFile = [&](BatchDownload *download) {
+        if (!download->part->flush()) {
+            logWarning(QString("unable to write %1: %2").arg(download->partName).arg(download->part->errorString()));
+            failFile(download);
+            return;
+        }
+        download->part->close();
+        download->part.reset(nullptr);
+        finished.append(download);
+    };
+    auto writeBlock = [&](const QString &hash, int blockSize, const char *data) {
+        bool registered = false;
+        foreach (auto target, targets.take(hash)) {
+            BatchDownload *download = target.first;
+            if (download->failed)
+                continue;
+            qint64 toWrite = qMin<qint64>(blockSize, download->file.mRemoteSize - target.second);
+            if (!XFile::writeAt(download->part.get(), target.second, data, toWrite)) {
+                logWarning(QString("unable to write %1: %2").arg(download->partName).arg(download->part->errorString()));
+                failFile(download);
+                continue;
+            }
+            if (!registered) {
+                SxSyncBlocks::instance().add(hash, blockSize, download->partName, target.second);
+                registered = true;
+            }
+            if (--download->missing == 0)
+                finishFile(download);
+        }
+    };
+    auto failBlock = [&](const QString &hash) {
+        foreach (auto target, targets.take(hash)) {
+            failFile(target.first);
+        }
+    };
+
+    foreach (auto pair, files) {
+        downloads.emplace_back(new BatchDownload(volume, pair.first, pair.second));
+    }
+
+    // block lists of all files, sTransferWindow requests at a time
+    for (size_t next = 0; next < downloads.size() || !activeQueries.isEmpty(); ) {
+        while (next < downloads.size() && activeQueries.count() < sTransferWindow) {
+            BatchDownload *download = downloads.at(next++).get();
+            if (!testFile(download->file)) {
+                download->failed = true;
+                continue;
+            }
+            SxQuery *query = _getFileMakeQuery(download->file);
+            activeQueries.insert(query, new QStringList(volume->nodeList()));
+            metaQueries.insert(query, download);
+        }
+        if (activeQueries.isEmpty())
+            break;
+        auto selectResult = querySelect(activeQueries);
+        std::unique_ptr<SxQueryResult> queryResult(selectResult.second);
+        if (!queryResult || selectResult.first == nullptr) {
+            if (queryResult)
+                mLastError = queryResult->error();
+            cleanup();
+            return false;
+        }
+        BatchDownload *download = metaQueries.take(selectResult.first);
+        delete activeQueries.take(selectResult.first);
+        delete selectResult.first;
+        if (queryResult->error().errorCode() == SxErrorCode::AbortedByUser) {
+            mLastError = queryResult->error();
+            cleanup();
+            return false;
+        }
+        if (!_getFileProcessReply(download->file, queryResult.get(), true))
+            download->failed = true;
+    }
+
+    for (auto &item : downloads) {
+        BatchDownload *download = item.get();
+        if (download->failed)
+            continue;
+        SxFile &file = download->file;
+        QFileInfo localFileInfo(download->localPath);
+        // a local file is updated by downloadFile(), which reuses its blocks
+        if (localFileInfo.exists()) {
+            download->failed = true;
+            continue;
+        }
+        QDir parentDir(localFileInfo.absolutePath());
+        if (!parentDir.exists() && !parentDir.mkpath(".")) {
+            download->failed = true;
+            continue;
+        }
+        download->partName = parentDir.absolutePath() + "/._sdrvtmp-" + QCryptographicHash::hash(localFileInfo.fileName().toUtf8(), QCryptographicHash::Sha1).toHex().left(16);
+        // an interrupted download is resumed by downloadFile()
+        if (QFile::exists(download->partName + ".state")) {
+            download->failed = true;
+            continue;
+        }
+        download->part.reset(new QFile(download->partName));
+        if (!download->part->open(QIODevice::ReadWrite | QIODevice::Truncate)) {
+            download->part.reset(nullptr);
+            download->failed = true;
+            continue;
+        }
+        XFile::makeInvisible(download->partName, true);
+        if (!download->part->resize(file.mRemoteSize)) {
+            failFile(download);
+            continue;
+        }
+        if (file.mBlockSize > 0) {
+            // all-zero blocks are already there in the resized part file
+            QString zeroHash = QString::fromUtf8(SxBlock::zeroBlockHash(file.mBlockSize, mClusterUuid));
+            for (int i=0; i<file.mBlocks.count(); i++) {
+                SxBlock *block = file.mBlocks.at(i);
+                if (block->mHash == zeroHash)
+                    continue;
+                auto &blockTargets = targets[block->mHash];
+                if (blockTargets.isEmpty()) {
+                    pending[file.mBlockSize].append(block);
+                    downloadSize += file.mBlockSize;
+                }
+                blockTargets.append({download, static_cast<qint64>(i)*file.mBlockSize});
+                ++download->missing;
+            }
+        }
+        if (download->missing == 0)
+            finishFile(download);
+    }
+
+    {
+        // blocks from the block cache and from files of this sync aren't fetched
+        const bool blockCache = SxBlockCache::instance().enabled();
+        QByteArray blockData;
+        qint64 saved = 0;
+        for (auto it = pending.begin(); it != pending.end(); ++it) {
+            const int blockSize = it.key();
+            QList<SxBlock*> &blocks = it.value();
+            for (int i=0; i<blocks.count(); ) {
+                SxBlock *block = blocks.at(i);
+                bool found = blockCache && SxBlockCache::instance().get(block->mHash, blockSize, blockData)
+                        && QString::fromUtf8(SxBlock::hashBlock(blockData, mClusterUuid)) == block->mHash;
+                if (!found && SxSyncBlocks::instance().read(block->mHash, blockSize, mClusterUuid, blockData)) {
+                    found = true;
+                    saved += blockSize;
+                }
+                if (!found) {
+                    ++i;
+                    continue;
+                }
+                writeBlock(block->mHash, blockSize, blockData.constData());
+                blocks.removeAt(i);
+                downloadSize -= blockSize;
+            }
+        }
+        if (saved)
+            SxMetrics::instance().addDownloadDedupSavings(saved);
+    }
+
+    emit sig_setDownloadSize(downloadSize);
+    start = QDateTime::currentDateTime();
+    const int batchLimit = 4*1024*1024;
+    while (true) {
+        while (activeQueries.count() < connectionLimit) {
+            auto it = pending.begin();
+            while (it != pending.end() && it.value().isEmpty())
+                ++it;
+            if (it == pending.end())
+                break;
+            const int blockSize = it.key();
+            QList<SxBlock*> &blocks = it.value();
+            const int blocksLimit = qBound(1, batchLimit/blockSize, 30);
+            QList<SxBlock*> batch;
+            batch.append(blocks.takeFirst());
+            QString target = selectNode(batch.first()->mNodeList);
+            QSet<QString> nodeCounter = QSet<QString>::fromList(batch.first()->mNodeList);
+            for (int i=0; i<blocks.count() && batch.count() < blocksLimit; ) {
+                SxBlock *block = blocks.at(i);
+                if (!block->mNodeList.contains(target)) {
+                    ++i;
+                    continue;
+                }
+                nodeCounter.intersect(QSet<QString>::fromList(block->mNodeList));
+                batch.append(blocks.takeAt(i));
+            }
+            BatchQuery batchQuery;
+            batchQuery.blockSize = blockSize;
+            SxQuery *query = _getBlocksMakeQuery(batch, blockSize, batchQuery.keys, batchQuery.hash);
+            if (!query) {
+                cleanup();
+                return false;
+            }
+            QStringList *nodes = new QStringList(nodeCounter.toList());
+            foreach (SxBlock *block, batch) {
+                foreach (QString node, *nodes) {
+                    block->mNodeList.removeOne(node);
+                }
+            }
+            activeQueries.insert(query, nodes);
+            blockQueries.insert(query, batchQuery);
+        }
+        if (activeQueries.isEmpty())
+            break;
+
+        auto selectResult = querySelect(activeQueries);
+        std::unique_ptr<SxQueryResult> queryResult(selectResult.second);
+        if (!queryResult || selectResult.first == nullptr) {
+            if (queryResult)
+                mLastError = queryResult->error();
+            cleanup();
+            return false;
+        }
+        SxQuery *query = selectResult.first;
+        BatchQuery batchQuery = blockQueries.take(query);
+        delete activeQueries.take(query);
+        delete query;
+
+        SxErrorCode errorCode = queryResult->error().errorCode();
+        if (errorCode == SxErrorCode::AbortedByUser || aborted()) {
+            mLastError = SxError(SxErrorCode::AbortedByUser, "download aborted", QCoreApplication::translate("SxErrorMessage", "download aborted"));
+            cleanup();
+            return false;
+        }
+        if (errorCode == SxErrorCode::Timeout || errorCode == SxErrorCode::SslError) {
+            logWarning(queryResult->error().errorMessage());
+            if (connectionLimit > 1)
+                --connectionLimit;
+            foreach (SxBlock *block, batchQuery.hash) {
+                if (block->mNodeList.isEmpty()) {
+                    logWarning("failed to get block " + block->mHash + " (all nodes failed)");
+                    failBlock(block->mHash);
+                }
+                else
+                    pending[batchQuery.blockSize].append(block);
+            }
+            continue;
+        }
+        if (errorCode != SxErrorCode::NoError) {
+            logWarning("download failed: " + queryResult->error().errorMessage());
+            foreach (QString hash, batchQuery.keys) {
+                failBlock(hash);
+            }
+            continue;
+        }
+        const int blockSize = batchQuery.blockSize;
+        bool processed = _getBlocksProcessReply(queryResult.get(), blockSize, batchQuery.keys, batchQuery.hash, [&](SxBlock *block, const char *data) -> bool {
+            writeBlock(block->mHash, blockSize, data);
+            SxBlockCache::instance().put(block->mHash, blockSize, data);
+            return true;
+        });
+        if (!processed) {
+            foreach (QString hash, batchQuery.keys) {
+                failBlock(hash);
+            }
+            continue;
+        }
+        if (QCoreApplication::instance()->thread() == QThread::currentThread()) {
+            QEventLoop loop;
+            loop.processEvents(QEventLoop::AllEvents, 10);
+        }
+        downloaded += static_cast<qint64>(batchQuery.keys.count())*blockSize;
+        double downloadTime = start.msecsTo(QDateTime::currentDateTime())/1000.0;
+        if (downloadTime > 0) {
+            qint64 speed = static_cast<qint64>(downloaded/downloadTime);
+            if (mDownloadLimiter.rate() > 0)
+                speed = qMin(speed, mDownloadLimiter.rate());
+            emit sig_setProgress(downloadSize - downloaded, speed);
+        }
+    }
+    cleanup();
+    logVerbose(QString("downloaded %1 of %2 files in shared batches").arg(fileEntries.count()).arg(files.count()));
+    mLastError = SxError();
+    return true;
+}
+
+/* fetches the block list of a remote file for reading it with readBlocks() */
+bool SxCluster::openRemoteFile(SxFile &file)
+{
+    FunctionBlocker fb(this, Q_FUNC_INFO);
+    if (fb.exit())
+        return false;
+    logInfo(QString("volume: %1, file: %2").arg(file.mVolume->name()).arg(file.mRemotePath));
+    mLastError = SxError();
+    std::unique_ptr<SxFilter> filter(SxFilter::getActiveFilter(file.mVolume));
+    if (filter && filter->dataProcess()) {
+        // filtered content can only be produced from the beginning of the file
+        mLastError = SxError(SxErrorCode::FilterError, "partial download is not possible on filtered volumes",
+                             QCoreApplication::translate("SxErrorMessage", "partial download is not possible on filtered volumes"));
+        return false;
+    }
+    if (!_getFile(file)) {
+        logWarning(mLastError.errorMessage());
+        return false;
+    }
+    return true;
+}
+
+/* downloads the given blocks of a file opened with openRemoteFile(), batched per set of
+ * replicas; processBlock gets the index and data of each block, zero blocks are
+ * reported with null data and never requested */
+bool SxCluster::readBlocks(SxFile &file, const QList<int> &blocks, std::function<void(int, const char*)> processBlock)
+{
+    FunctionBlocker fb(this, Q_FUNC_INFO);
+    if (fb.exit())
+        return false;
+    setAborted(false);
+    mLastError = SxError();
+    const int blockSize = file.mBlockSize;
+    const QString zeroHash = QString::fromUtf8(SxBlock::zeroBlockHash(blockSize, mClusterUuid));
+    QHash<SxBlock*, QList<int>> positions;
+    QMap<QString, QList<SxBlock*>> groups;
+    QByteArray cached;
+    foreach (int index, blocks) {
+        if (index < 0 || index >= file.mBlocks.count())
+            continue;
+        SxBlock *block = file.mBlocks.at(index);
+        if (block->mHash == zeroHash) {
+            processBlock(index, nullptr);
+            continue;
+        }
+        if (!positions.contains(block) && SxBlockCache::instance().get(block->mHash, blockSize, cached)
+                && QString::fromUtf8(SxBlock::hashBlock(cached, mClusterUuid)) == block->mHash) {
+            processBlock(index, cached.constData());
+            continue;
+        }
+        if (!positions.contains(block))
+            groups[block->mNodeList.join(",")].append(block);
+        positions[block].append(index);
+    }
+
+    const int batchSize = qBound(1, sCopyBatchSize/blockSize, 30);
+    foreach (auto group, groups) {
+        for (int i=0; i<group.count(); i+=batchSize) {
+            if (aborted()) {
+                mLastError = SxError(SxErrorCode::AbortedByUser, "download aborted", QCoreApplication::translate("SxErrorMessage", "download aborted"));
+                return false;
+            }
+            QList<SxBlock*> batch = group.mid(i, batchSize);
+            QStringList keys;
+            QHash<QString, SxBlock*> hash;
+            std::unique_ptr<SxQuery> query(_getBlocksMakeQuery(batch, blockSize, keys, hash));
+            if (!query)
+                return false;
+            std::unique_ptr<SxQueryResult> queryResult(sendQuery(query.get(), batch.first()->mNodeList));
+            if (!queryResult)
+                return false;
+            if (queryResult->error().errorCode() != SxErrorCode::NoError) {
+                QJsonDocument jDoc;
+                parseJson(queryResult.get(), jDoc);
+                return false;
+            }
+            if (!_getBlocksProcessReply(queryResult.get(), blockSize, keys, hash, [&positions, &processBlock, blockSize](SxBlock *block, const char *blockData) -> bool {
+                                        foreach (int index, positions.value(block)) {
+                                            processBlock(index, blockData);
+                                        }
+                                        SxBlockCache::instance().put(block->mHash, blockSize, blockData);
+                                        return true;
+                                    }))
+                return false;
+        }
+    }
+    return true;
+}
+
 bool SxCluster::deleteFile(SxVolume *volume, QString path)
 {
     FunctionBlocker fb(this, Q_FUNC_INFO);
@@ -3592,52 +6198,122 @@ bool SxCluster::deleteFiles(SxVolume *volume, QStringList &filesToRemove, std::f
     FunctionBlocker fb(this, Q_FUNC_INFO);
     if (fb.exit())
         return false;
-    logInfo(QString("volume: %1, files: %2").arg(volume->name()).arg(filesToRemove.join(", ")));
-    QList <SxJob*> pending;
-    QHash <SxJob*, QString> map;
-    const int maxPending = 30;
-    while (!filesToRemove.isEmpty() || !pending.isEmpty()) {
-        foreach (SxJob* job, pending) {
-            if (job->mStatus == SxJob::ERROR) {
+    logInfo(QString("volume: %1, files: %2").arg(volume->name()).arg(filesToRemove.count()));
+    return _deleteFiles(volume, filesToRemove, onRemove);
+}
+
+bool SxCluster::deleteDirectory(SxVolume *volume, const QString &dir, std::function<void(const QString&)> onRemove)
+{
+    FunctionBlocker fb(this, Q_FUNC_INFO);
+    if (fb.exit())
+        return false;
+    if (!testVolume(volume) || dir.isEmpty() || !dir.endsWith("/"))
+        return false;
+    logInfo(QString("volume: %1, dir: %2").arg(volume->name()).arg(dir));
+
+    static const QRegExp sGlobChars("[*?\\[\\]\\\\]");
+    std::unique_ptr<SxFilter> filter(SxFilter::getActiveFilter(volume));
+    if ((filter && filter->dataPrepare()) || dir == "/" || dir.contains(sGlobChars)) {
+        // the server side delete matches a pattern, fall back to removing the listed files
+        QList<SxFileEntry*> list;
+        QString etag;
+        if (!_listFiles(volume, dir, true, list, etag))
+            return false;
+        QStringList files;
+        foreach (auto entry, list) {
+            files.append(entry->path());
+            delete entry;
+        }
+        return _deleteFiles(volume, files, onRemove);
+    }
+    SxJob job;
+    if (!_massDelete(volume, dir, job))
+        return false;
+    while (job.mStatus == SxJob::PENDING) {
+        job.waitInterval();
+        if (!_poll(job))
+            return false;
+    }
+    if (job.mStatus == SxJob::ERROR)
+        return false;
+    logVerbose("REMOVED: " + dir);
+    onRemove(dir);
+    return true;
+}
+
+bool SxCluster::_deleteFiles(SxVolume *volume, QStringList &filesToRemove, std::function<void(const QString&)> onRemove)
+{
+    // up to sDeleteWindow delete queries are in flight at once, the jobs they return
+    // are polled together whenever no query is on the way
+    QStringList targets = volume->nodeList();
+    QHash<SxQuery*, QStringList*> queries;
+    QHash<SxQuery*, QString> paths;
+    QList<QPair<SxJob, QString>> jobs;
+    while (!filesToRemove.isEmpty() || !queries.isEmpty() || !jobs.isEmpty()) {
+        while (!filesToRemove.isEmpty() && queries.size() < sDeleteWindow && queries.size()+jobs.size() < sTransferJobsLimit) {
+            SxFile file(volume, filesToRemove.first(), "", true);
+            if (!testFile(file))
                 goto onError;
-            }
-            else if (job->mStatus == SxJob::OK) {
-                logVerbose("REMOVED: " + map.value(job));
-                onRemove(map.value(job));
-                map.remove(job);
-                pending.removeOne(job);
-                delete job;
-            }
-            else {
-                if (!_poll(*job))
-                    goto onError;
-            }
+            SxQuery *query = _deleteFileMakeQuery(file);
+            queries.insert(query, &targets);
+            paths.insert(query, filesToRemove.takeFirst());
         }
-        while (pending.size() < maxPending && !filesToRemove.isEmpty()) {
-            QString path = filesToRemove.takeFirst();
-            SxFile file(volume, path, "", true);
-            SxJob *job = new SxJob();
-            pending.append(job);
-            map.insert(job, path);
-            if (!_deleteFile(file, *job))
+        if (!queries.isEmpty()) {
+            auto selectResult = querySelect(queries);
+            std::unique_ptr<SxQueryResult> queryResult(selectResult.second);
+            if (!queryResult || selectResult.first == nullptr) {
+                if (queryResult)
+                    mLastError = queryResult->error();
                 goto onError;
-            if (!_poll(*job))
+            }
+            std::unique_ptr<SxQuery> query(selectResult.first);
+            queries.remove(query.get());
+            QString path = paths.take(query.get());
+            SxJob job;
+            if (!_deleteFileProcessReply(queryResult.get(), job))
                 goto onError;
+            jobs.append({job, path});
+            continue;
+        }
+        jobs.first().first.waitInterval();
+        auto it = jobs.begin();
+        while (it != jobs.end()) {
+            if (!_poll(it->first) || it->first.mStatus == SxJob::ERROR)
+                goto onError;
+            if (it->first.mStatus == SxJob::OK) {
+                logVerbose("REMOVED: " + it->second);
+                onRemove(it->second);
+                it = jobs.erase(it);
+            }
+            else
+                ++it;
         }
-        if (!pending.isEmpty())
-            pending.last()->waitInterval();
     }
     return true;
     onError:
     logWarning("remove files failed");
     abortAllQueries();
-    foreach (SxJob *job, pending) {
-        delete job;
-    }
-
+    qDeleteAll(queries.keys());
     return false;
 }
 
+bool SxCluster::_massDelete(SxVolume *volume, const QString &dir, SxJob &job)
+{
+    if (!testVolume(volume))
+        return false;
+    if (dir.isEmpty() || dir == "/" || !dir.endsWith("/"))
+        return false;
+
+    QString queryString = QString("/%1?filter=%2&recursive")
+            .arg(volume->name())
+            .arg(QString::fromUtf8(QUrl::toPercentEncoding(dir.startsWith('/') ? dir.mid(1) : dir, "/")));
+    SxQuery query(queryString, SxQuery::JOB_DELETE, QByteArray());
+    std::unique_ptr<SxQueryResult> queryResult(sendQuery(&query, volume->nodeList()));
+    if (!queryResult)
+        return false;
+    return _deleteFileProcessReply(queryResult.get(), job);
+}
+
 bool SxCluster::rename(SxVolume *volume, const QString &source, const QString &destination)
 {
     FunctionBlocker fb(this, Q_FUNC_INFO);
@@ -3720,6 +6396,170 @@ bool SxCluster::checkFileConsistency(SxVolume *volume, const QString &path, QStr
     return true;
 }
 
+/* checks many files with one listing per directory and node instead of one query per file
+ * and node; listings of different nodes run in parallel, only inconsistent files are reported */
+bool SxCluster::checkFilesConsistency(SxVolume *volume, const QStringList &paths, QHash<QString, QStringList> &inconsistentRevisions)
+{
+    inconsistentRevisions.clear();
+    if (volume->nodeList().isEmpty())
+        return false;
+    if (_remoteNamesDiffer(volume)) {
+        foreach (const QString &path, paths) {
+            QStringList revisions;
+            if (!checkFileConsistency(volume, path, revisions))
+                return false;
+            if (!revisions.isEmpty())
+                inconsistentRevisions.insert(path, revisions);
+        }
+        return true;
+    }
+    FunctionBlocker fb(this, Q_FUNC_INFO);
+    if (fb.exit())
+        return false;
+
+    setAborted(false);
+    bool done = false;
+    SxError error;
+    QEventLoop loop;
+    checkFilesConsistencyAsync(volume, paths, cancelToken(), [&](const SxError &result, const QHash<QString, QStringList> &inconsistent) {
+        error = result;
+        inconsistentRevisions = inconsistent;
+        done = true;
+        loop.quit();
+    });
+    // the callback refers to this frame, never leave it with a listing in flight
+    if (!done)
+        loop.exec();
+    if (error.errorCode() != SxErrorCode::NoError) {
+        mLastError = error;
+        return false;
+    }
+    return true;
+}
+
+/* state of one checkFilesConsistencyAsync call, owned by the listings in flight */
+struct SxCluster::ConsistencyCheck {
+    QString volume;
+    QStringList nodes;
+    QMap<QString, QSet<QString>> directories;
+    QHash<QString, QVector<QString>> revisions;
+    QList<QPair<QString, int>> listings;
+    int concurrency;
+    int inFlight;
+    int launchIndex;
+    SxError error;
+    SxCancelToken token;
+    std::function<void(const SxError&, const QHash<QString, QStringList>&)> callback;
+};
+
+/* same as checkFilesConsistency without waiting for the listings, the callback runs from the
+ * event loop of the cluster thread once all of them are done; returns false without calling
+ * it when the volume has no nodes or its remote names can't be matched against the paths.
+ * Doesn't touch lastError, so it can run while a blocking operation is in progress */
+bool SxCluster::checkFilesConsistencyAsync(SxVolume *volume, const QStringList &paths, const SxCancelToken &token, std::function<void(const SxError&, const QHash<QString, QStringList>&)> callback)
+{
+    if (volume->nodeList().isEmpty() || _remoteNamesDiffer(volume))
+        return false;
+    auto check = std::make_shared<ConsistencyCheck>();
+    check->volume = volume->name();
+    check->nodes = volume->nodeList();
+    foreach (const QString &path, paths) {
+        QString p = path.startsWith("/") ? path : "/"+path;
+        check->directories[p.left(p.lastIndexOf('/')+1)].insert(p);
+        check->revisions.insert(p, QVector<QString>(check->nodes.count()));
+    }
+    for (auto it = check->directories.constBegin(); it != check->directories.constEnd(); ++it) {
+        for (int i=0; i<check->nodes.count(); i++)
+            check->listings.append({it.key(), i});
+    }
+    check->concurrency = qBound(1, check->nodes.count(), sListMaxParallelPages);
+    check->inFlight = 0;
+    check->launchIndex = 0;
+    check->token = token;
+    check->callback = callback;
+    if (check->listings.isEmpty()) {
+        QTimer::singleShot(0, this, [callback]() {
+            callback(SxError(), {});
+        });
+        return true;
+    }
+    _launchConsistencyListings(check);
+    return true;
+}
+
+void SxCluster::_launchConsistencyListings(const std::shared_ptr<ConsistencyCheck> &check)
+{
+    bool failed = check->error.errorCode() != SxErrorCode::NoError;
+    while (!failed && check->inFlight < check->concurrency && check->launchIndex < check->listings.count()) {
+        const QPair<QString, int> listing = check->listings.at(check->launchIndex++);
+        QString queryString = "/"+check->volume+"?o=list";
+        if (listing.first != "/")
+            queryString += "&filter="+QUrl::toPercentEncoding(listing.first.mid(1), "/");
+        ++check->inFlight;
+        sendQueryAsync(new SxQuery(queryString, SxQuery::GET, QByteArray()), {check->nodes.at(listing.second)}, [this, check, listing](SxQueryResult *result) {
+            std::unique_ptr<SxQueryResult> queryResult(result);
+            --check->inFlight;
+            bool failed = check->error.errorCode() != SxErrorCode::NoError;
+            if (!failed && check->token.isCancelled()) {
+                check->error = SxError(SxErrorCode::AbortedByUser, "consistency check aborted", QCoreApplication::translate("SxErrorMessage", "consistency check aborted"));
+            }
+            else if (!failed && queryResult->error().errorCode() != SxErrorCode::NoError) {
+                check->error = queryResult->error();
+                logWarning(check->error.errorMessage());
+            }
+            else if (!failed) {
+                const QSet<QString> &wanted = check->directories[listing.first];
+                SxListingReader reader(queryResult->data());
+                QString path;
+                QJsonObject jFileEntry;
+                while (reader.next(path, jFileEntry)) {
+                    if (!wanted.contains(path))
+                        continue;
+                    auto jRev = jFileEntry.value("fileRevision");
+                    if (jRev.isString())
+                        check->revisions[path][listing.second] = jRev.toString();
+                }
+                if (reader.failed()) {
+                    check->error = SxError::errorBadReplyContent();
+                    logWarning(check->error.errorMessage());
+                }
+            }
+            _launchConsistencyListings(check);
+            if (check->inFlight > 0)
+                return;
+            QHash<QString, QStringList> inconsistentRevisions;
+            if (check->error.errorCode() != SxErrorCode::NoError) {
+                check->callback(check->error, inconsistentRevisions);
+                return;
+            }
+            for (auto it = check->revisions.constBegin(); it != check->revisions.constEnd(); ++it) {
+                const QVector<QString> &list = it.value();
+                bool consistent = true;
+                QSet<QString> revisionSet;
+                foreach (const QString &rev, list) {
+                    if (rev != list.first())
+                        consistent = false;
+                    if (!rev.isEmpty())
+                        revisionSet.insert(rev);
+                }
+                if (!consistent) {
+                    logWarning(QString("inconsistency detected: %1%2").arg(check->volume).arg(it.key()));
+                    inconsistentRevisions.insert(it.key(), revisionSet.toList());
+                }
+            }
+            check->callback(SxError(), inconsistentRevisions);
+        });
+    }
+}
+
+/* remote names of volumes with a filemeta filter differ from local ones, a listing can't be
+ * matched against local paths */
+bool SxCluster::_remoteNamesDiffer(SxVolume *volume) const
+{
+    std::unique_ptr<SxFilter> filter(SxFilter::getActiveFilter(volume));
+    return filter && filter->filemetaProcess();
+}
+
 const QList<const SxVolume *> SxCluster::volumeList() const
 {
     QList<const SxVolume*> list;
@@ -3802,7 +6642,7 @@ bool SxCluster::changePassword(const QString &oldToken, const QString &newToken)
 bool SxCluster::getAllVolnodesEtag(SxVolume *volume, QList<QPair<QString, QString> > &result)
 {
     result.clear();
-    if (volume==nullptr && volume->nodeList().isEmpty())
+    if (volume == nullptr || volume->nodeList().isEmpty())
         return false;
     QString queryString = "/"+volume->name()+"?o=list&recursive";
     foreach (auto node, volume->nodeList()) {
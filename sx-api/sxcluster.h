@@ -47,11 +47,16 @@
 #include "sxfile.h"
 #include "sxfileentry.h"
 #include "sxjob.h"
+#include "sxuploadstate.h"
+#include "sxbandwidthlimiter.h"
 #include "sxfilter/sx_input_args.h"
 #include "sxerror.h"
+#include "sxcanceltoken.h"
 
 class SxQuery;
 class SxQueryResult;
+class SxFilterSource;
+class SxDownloadPlan;
 
 class SXQuery {
     // TODO: REMOVE ME
@@ -69,7 +74,21 @@ private:
         quint32 mTime;
         QDateTime lastPollTime;
         qint64 remoteSize;
-        QStringList blocks;
+        SxBlockList blocks;
+        bool polling;
+    };
+    struct NodeStats {
+        int latency;
+        qint64 throughput;
+    };
+    struct LocateCacheEntry {
+        qint64 minSize;
+        qint64 maxSize;
+        int blockSize;
+    };
+    struct UploadChunkInfo {
+        QList<SxBlock*> blocks;
+        QStringList nodes;
     };
     class FunctionBlocker {
     public:
@@ -85,7 +104,7 @@ private:
     SxCluster(const SxAuth& auth, QByteArray uuid, const QStringList &nodes);
 public:
     ~SxCluster();
-    static SxCluster* initializeCluster(const SxAuth& auth, QByteArray uuid, std::function<bool(QSslCertificate &, bool)> checkSslCallback, QString &errorMessage);
+    static SxCluster* initializeCluster(const SxAuth& auth, QByteArray uuid, std::function<bool(QSslCertificate &, bool)> checkSslCallback, QString &errorMessage, bool bootstrapCache=false);
     static bool getClusterUUID(const QString& cluster, const QString& initialAddress, const bool& ssl, const int& port, QString &uuid, QString &errorMessage, int timeout=-1);
     static bool getEnterpriseAuth(const QString &server, const QString &user, const QString &password, const QString &device, std::function<bool(const QSslCertificate &,bool)> checkCert, SxUrl &sx_url, QString &errorMessage);
     static void setClientVersion(const QString& version);
@@ -94,15 +113,29 @@ public:
     void setFilterInputCallback(std::function<int(sx_input_args&)> get_input);
     void setGetLocalBlocksCallback(std::function<bool(QFile *, qint64, int, const QStringList&, QSet<QString>&)> callback);
     void setFindIdenticalFilesCallback(std::function<bool(const QString&, qint64, int, const QStringList&, QList<QPair<QString, quint32>>&)> callback);
+    void setFindCopySourceCallback(std::function<bool(const QString&, const QString&, const QString&, qint64, int&, QStringList&)> callback);
+    void setKnownBlocksCallback(std::function<bool(const QString&, const QString&, int, QVector<QPair<quint64, QString>>&)> callback);
+    void setUploadStateCallbacks(std::function<bool(const QString&, const QString&, SxUploadState&)> loadState, std::function<void(const QString&, const QString&, const SxUploadState*)> storeState);
+    void setCommitCallback(std::function<void(const QString&, const QString&)> callback);
+    void setCancelToken(const SxCancelToken &token);
+    void setUploadConnectionLimit(int connectionLimit, int nodeConnectionLimit);
+    void setHttp2Enabled(bool enabled);
+    void setDeltaDownload(bool enabled);
+    void setBandwidthLimits(qint64 uploadLimit, qint64 downloadLimit);
+    qint64 lastUploadSavedBytes() const;
     SxError lastError() const;
+    void clearLastError();
     int getInput(sx_input_args &args) const;
     bool checkNetworkConfigurationChanged();
     bool rename(SxVolume* volume, const QString &source, const QString &destination);
     bool checkFileConsistency(SxVolume* volume, const QString &path, QStringList& inconsistentRevisions);
+    bool checkFilesConsistency(SxVolume* volume, const QStringList &paths, QHash<QString, QStringList> &inconsistentRevisions);
+    bool checkFilesConsistencyAsync(SxVolume* volume, const QStringList &paths, const SxCancelToken &token, std::function<void(const SxError&, const QHash<QString, QStringList>&)> callback);
     bool reloadClusterNodes();
     bool reloadVolumes();
     bool reloadClusterMeta();
     bool listFileRevisions(SxVolume* volume, const QString &path, QList<std::tuple<QString, qint64, quint32> > &list);
+    void listFileRevisionsAsync(SxVolume* volume, const QString &path, std::function<void(bool, const QList<std::tuple<QString, qint64, quint32>>&)> callback);
     bool getFileRevision(SxVolume* volume, const QString &path, const QString &node, QString &revision);
     bool restoreFileRevision(SxVolume *volume, const QString &source, const QString &rev, const QString &destination);
     bool copyFile(SxVolume *srcVolume, const QString &source, SxVolume *dstVolume, const QString &destination);
@@ -114,39 +147,73 @@ public:
     void clearUploadJobs();
     bool uploadFile(SxVolume* volume, QString path, QString localFile, SxFileEntry &fileRevision, std::function<void(QString, QString, SxError, QString, quint32)> callback=nullptr, bool multipart=false);
     bool createEmptyFile(SxVolume* volume, QString path);
+    bool createEmptyFiles(SxVolume* volume, const QList<QPair<QString, quint32>> &files, QStringList &created, std::function<void(QString, QString, SxError, QString, quint32)> callback);
     bool downloadFile(SxVolume* volume, QString path, QString localFile, SxFileEntry &fileEntry, int connectionLimit);
     bool downloadFile(SxVolume* volume, QString path, QString rev, QString localFile, SxFileEntry &fileEntry, int connectionLimit);
+    bool downloadFiles(SxVolume* volume, const QList<QPair<QString, QString>> &files, QHash<QString, SxFileEntry> &fileEntries, int connectionLimit);
+    bool openRemoteFile(SxFile &file);
+    bool readBlocks(SxFile &file, const QList<int> &blocks, std::function<void(int, const char*)> processBlock);
     bool deleteFile(SxVolume* volume, QString path);
     bool deleteFiles(SxVolume* volume, QStringList& filesToRemove, std::function<void(const QString &)>);
+    bool deleteDirectory(SxVolume* volume, const QString &dir, std::function<void(const QString &)>);
     const QList<const SxVolume*> volumeList() const;
     SxVolume *getSxVolume(const QString &volume);
     bool changePassword(const QString &newToken);
     bool changePassword(const QString& oldToken, const QString &newToken);
     bool getAllVolnodesEtag(SxVolume* volume, QList<QPair<QString, QString>> &result);
+    bool listFilesPaged(SxVolume* volume, std::function<bool(QList<SxFileEntry*>&)> consumer, QString &etag);
+    void invalidateLocateCache(const QString &volume=QString());
+    bool cachedBlockSize(const QString &volume, qint64 fileSize, int &blockSize) const;
 
     // REST-API
     bool _listNodes(QStringList& nodeList);
+    bool _listNodesProcessReply(SxQueryResult *queryResult, QStringList &nodeList);
     bool _getUserDetails(SxUserInfo &userInfo);
+    bool _getUserDetailsProcessReply(SxQueryResult *queryResult, SxUserInfo &userInfo);
     bool _listVolumes(QList<SxVolume*> &volumeList);
+    bool _listVolumesProcessReply(SxQueryResult *queryResult, QList<SxVolume*> &volumeList, bool removeMissing);
     bool _locateVolume(SxVolume* volume, qint64 fileSize, int* blockSize);
+    SxQuery* _locateVolumeMakeQuery(SxVolume* volume, qint64 fileSize, int* blockSize);
+    bool _locateVolumeProcessReply(SxVolume* volume, SxQueryResult *queryResult, qint64 fileSize, int* blockSize);
     bool _getClusterMetadata(SxMeta &clusterMeta);
+    bool _getClusterMetadataProcessReply(SxQueryResult *queryResult, SxMeta &clusterMeta);
     bool _listFiles(SxVolume* volume, QList<SxFileEntry*>& fileList, QString &etag, const QString &after=QString(), const qint64 limit=0);
-    bool _listFiles(SxVolume* volume, const QString path, bool recursive, QList<SxFileEntry*>& fileList, QString &etag, const QString &after=QString(), const qint64 limit=0);
+    bool _listFiles(SxVolume* volume, std::function<bool(QList<SxFileEntry*>&)> consumer, QString &etag);
+    bool _listFiles(SxVolume* volume, const QString path, bool recursive, QList<SxFileEntry*>& fileList, QString &etag, const QString &after=QString(), const qint64 limit=0,
+                    std::function<bool(QList<SxFileEntry*>&)> consumer=nullptr);
+    QString _fileRevisionsQuery(const SxFile &file) const;
+    static bool _parseFileRevisions(const QJsonDocument &json, QList<std::tuple<QString, qint64, quint32>> &list);
     bool _getFile(SxFile &file, bool silence=false);
+    SxQuery* _getFileMakeQuery(SxFile &file);
+    bool _getFileProcessReply(SxFile &file, SxQueryResult *queryResult, bool silence);
     bool _getFileMetadata(SxFile &file);
     bool _setFileMetadata(SxFile &file, const QJsonObject &jMeta);
     bool _initializeFile(SxFile &file);
+    SxQuery* _initializeFileMakeQuery(SxFile &file);
+    bool _initializeFileProcessReply(SxFile &file, SxQueryResult *queryResult);
     bool _initializeFileAddChunk(SxFile &file, int extendSeq);
     bool _createBlocks(const QString& uploadToken, const int blockSize, const QByteArray &data, const QStringList &nodes);
     bool _flushFile(SxFile &file, SxJob& job);
+    SxQuery* _flushFileMakeQuery(SxFile &file);
+    bool _flushFileProcessReply(SxFile &file, SxQueryResult *queryResult, SxJob &job);
     bool _poll(SxJob& job);
+    SxQuery* _pollMakeQuery(const SxJob &job);
+    bool _pollProcessReply(SxJob &job, SxQueryResult *queryResult);
     bool _deleteFile(SxFile &file, SxJob& job);
+    SxQuery* _deleteFileMakeQuery(SxFile &file);
+    bool _deleteFileProcessReply(SxQueryResult *queryResult, SxJob &job);
+    bool _deleteFiles(SxVolume* volume, QStringList& filesToRemove, std::function<void(const QString &)> onRemove);
+    bool _massDelete(SxVolume* volume, const QString &dir, SxJob &job);
+    bool _copyMissingBlocks(SxFile &source, SxFile &destination);
+    bool _transferFiles(SxVolume *srcVolume, const QString &srcDir, const QStringList &files, SxVolume *dstVolume, const QString &dstDir, bool move, std::function<void(int, int)> progressCallback);
     bool _rename(SxVolume* volume, const QString &source, const QString &destination);
     bool _massRename(SxVolume* volume, const QString &source, const QString &destination, SxJob &job);
     bool _getBlocks(const QList<SxBlock*> &blockList, const int blockSize);
     bool _setVolumeCustomMeta(SxVolume *volume);
     SxQuery* _getBlocksMakeQuery(const QList<SxBlock*> &blockList, const int blockSize, QStringList &keys, QHash<QString, SxBlock *> &hash);
     bool _getBlocksProcessReply(SxQueryResult *query, const int blockSize, QStringList &keys, QHash<QString, SxBlock *> &hash);
+    bool _getBlocksProcessReply(SxQueryResult *query, const int blockSize, QStringList &keys, QHash<QString, SxBlock *> &hash, std::function<bool(SxBlock*, const char*)> processBlock);
+    QSet<QString> _corruptBlocks(SxQueryResult *query, const int blockSize, const QStringList &keys);
 
     // GETTERS
     const QStringList& nodes() const;
@@ -159,54 +226,137 @@ public:
 public slots:
     void abort();
 
+private slots:
+    void onUploadJobsPollTimeout();
+
 signals:
     void sig_exit_loop();
     void sig_setProgress(qint64 size, qint64 speed);
     void sig_setDownloadSize(qint64 size);
+    void sig_uploadJobsChanged();
 
 private:
+    static SxCluster* initializeFromCache(const SxAuth& auth, QByteArray uuid, std::function<bool(QSslCertificate &, bool)> checkSslCallback);
+    bool _bootstrap();
+    void revalidateBootstrap();
+    void onBootstrapRevalidated(bool processed, const SxError &error);
+    void storeBootstrapState();
     bool checkSsl(QNetworkReply *reply, QTimer *timer, const QList<QSslError> &errors);
     SxQueryResult* sendQuery(SxQuery* query, QStringList targetList, const QString &etag=QString());
-    QPair<SxQuery*, SxQueryResult*> querySelect(QHash<SxQuery *, QStringList *> &queries, const QString &etag=QString());
+    void sendQueryAsync(SxQuery* query, QStringList targetList, std::function<void(SxQueryResult*)> callback, const QString &etag=QString());
+    struct ConsistencyCheck;
+    void _launchConsistencyListings(const std::shared_ptr<ConsistencyCheck> &check);
+    bool _remoteNamesDiffer(SxVolume *volume) const;
+    QPair<SxQuery*, SxQueryResult*> querySelect(QHash<SxQuery *, QStringList *> &queries, const QString &etag=QString(), int wakeupTime=-1, bool *wokenUp=nullptr);
     inline bool testVolume(SxVolume* volume);
     inline bool testFile(SxFile &file);
     inline bool parseJson(SxQueryResult* queryResult, QJsonDocument& jDoc, bool silence=false);
     inline bool parseJobJson(QJsonDocument& json, QString pollTarget, SxJob &job);
     void abortAllQueries();
+    void abortQuery(SxQuery *query);
+    QString activeQueryHost(SxQuery *query) const;
     QNetworkReply *sendNetworkRequest(SxQuery *query, QNetworkRequest req, bool seccondAttempt, int delay=0);
     void tryRemoveNetworkAccessManager(QNetworkAccessManager* manager);
-    bool _filter_data_process(QFile *inFile, QFile *outFile, SxFilter* filter, QString file, bool download);
+    bool _hashFilteredData(SxFilterSource *source, int blockSize, QStringList &blocks, qint64 &size);
+    bool findShiftedBlocks(const QString &oldFilePath, const SxFile &file, QFile *target, SxDownloadPlan &plan);
     void storeReplyTime(QNetworkReply* reply);
+    int nextUploadJobsPoll() const;
+    void scheduleUploadJobsPoll(int delay);
+    void onUploadJobPolled(SxJob *job, SxQueryResult *result);
+    bool locateVolumeCached(SxVolume *volume, qint64 fileSize, int *blockSize);
+    void storeNodeLatency(const QString &node, int latency);
+    void storeNodeThroughput(const QString &node, qint64 bytes, qint64 msecs);
+    QString selectNode(const QStringList &nodes) const;
+    int nodeLatency(const QString &node) const;
     bool aborted() const;
     void setAborted(bool aborted);
+    SxCancelToken cancelToken() const;
 
 private:
     static const int sUploadJobsLimit = 10;
+    static const int sUploadJobsPollBatch = 16;
+    static const int sUploadConnectionLimit = 4;
+    static const int sUploadNodeConnectionLimit = 2;
+    static const int sUploadReadAhead = 2;
+    static const int sMultipartChunkTime = 60;
+    static const qint64 sDownloadMemoryLimit = 32*1024*1024;
+    static const int sDownloadBatchTime = 2000;
+    static const qint64 sDownloadWriteQueue = 16*1024*1024;
+    static const int sHedgeBudgetPercent = 10;
+    static const int sHedgeMinSamples = 5;
+    static const int sHedgeSamples = 20;
+    static const int sHedgeMinDelay = 500;
+    static const int sDownloadStateInterval = 5000;
+    static const int sOldFileScanBlocks = 64;
+    static const int sVerifyRangeSize = 1024*1024;
+    static const int sFilterHashBatchSize = 4*1024*1024;
+    static const int sListBatchSize = 10000;
+    static const int sListPageSize = 10000;
+    static const int sListMaxParallelPages = 8;
+    static const int sTransferWindow = 8;
+    static const int sTransferJobsLimit = 30;
+    static const int sEmptyFilesWindow = 32;
+    static const int sEmptyFilesJobsLimit = 100;
+    static const int sDeleteWindow = 16;
+    static const int sCopyBatchSize = 16*1024*1024;
+    static const qint64 sDeltaScanBudget = 256*1024*1024;
+    static const int sDeltaMaxShifts = 8;
+    static const qint64 sNodeThroughputMinBytes = 256*1024;
+    static const int sNetworkManagerMaxFailures = 3;
+    static const int sConnectRaceDelay = 250;
+    static const int sLocateCacheTtl = 300;
+    static const int sLocateWindow = 8;
+    static const int sBootstrapCacheTtl = 7*24*3600;
     QHash <SxJob*, UploadJobInfo> mUploadJobs;
+    QTimer *mUploadJobsTimer;
+    std::function<void(QString, QString, SxError, QString, quint32)> mUploadJobsCallback;
     SxAuth mSxAuth;
     SxUserInfo mUserInfo;
     QStringList mNodeList;
     QNetworkAccessManager *mNetworkAccessManager;
+    int mNetworkManagerFailures;
+    QHash<QString, QByteArray> mSessionTickets;
+    bool mHttp2Enabled;
+    bool mDeltaDownload;
+    SxBandwidthLimiter mUploadLimiter;
+    SxBandwidthLimiter mDownloadLimiter;
+    qint64 mLastUploadSavedBytes;
+    QSet<QString> mHttp2Nodes;
     qint64 mTimeDrift;
     bool mViaSxCache;
     std::function<bool(QSslCertificate &, bool)> mCallbackConfirmCert;
     std::function<int(sx_input_args &)> mCallbackGetInput;
     std::function<bool(QFile *, qint64, int, const QStringList&, QSet<QString>&)> mGetLocalBlocks;
     std::function<bool(const QString&, qint64, int, const QStringList&, QList<QPair<QString, quint32>>&)> mFindIdenticalFilesCallback;
+    std::function<bool(const QString&, const QString&, const QString&, qint64, int&, QStringList&)> mFindCopySourceCallback;
+    std::function<bool(const QString&, const QString&, int, QVector<QPair<quint64, QString>>&)> mKnownBlocksCallback;
+    std::function<bool(const QString&, const QString&, SxUploadState&)> mLoadUploadState;
+    std::function<void(const QString&, const QString&, const SxUploadState*)> mStoreUploadState;
+    std::function<void(const QString&, const QString&)> mCommitCallback;
     QByteArray m_certFprint;
     QByteArray m_applianceCertFprint;
+    // certificates with the ssl errors they were accepted with, checked once per session
+    QSet<QByteArray> mVerifiedCerts;
     QByteArray mClusterUuid;
     SxError mLastError;
     SxMeta mMeta;
     QHash<QNetworkReply*, SxQuery*> mActiveQueries;
     QHash<QNetworkReply*, QTimer*> mActiveTimers;
+    QHash<QNetworkReply*, QTimer*> mAsyncTimers;
     QSet<QNetworkAccessManager*> mNetworkManagersToRemove;
     QList<SxVolume*> mVolumeList;
-    bool m_Aborted;
-    mutable QMutex mAbortedMutex;
+    // operations poll mOperationToken, a child of mTaskToken; both are replaced only by the
+    // thread running the operations, other threads read them under mTokenMutex
+    SxCancelToken mTaskToken;
+    SxCancelToken mOperationToken;
+    mutable QMutex mTokenMutex;
     mutable QMutex mUploadJobMutex;
     QList<QHostAddress> mNetworkConfiguration;
     bool mUseApplianceNodeList;
+    bool mBootstrapCache;
+    bool mVolumesFromCache;
+    int mBootstrapPending;
+    bool mBootstrapFailed;
     int mTimeoutProgress;
     int mTimeoutInitial;
     int mTimeoutMultiplier;
@@ -217,8 +367,15 @@ private:
     int mProgressReplyTimeMax;
     int mProgressReplyTimeCount;
     QString mCurrentFunctionName;
+    int mUploadConnectionLimit;
+    int mUploadNodeConnectionLimit;
+    QHash<QString, NodeStats> mNodeStats;
+    QHash<QString, QList<LocateCacheEntry> > mLocateCache;
+    QHash<QString, QDateTime> mLocateCacheTime;
 
     friend class SxCluster::FunctionBlocker;
+    // reaches the reply parsers without a server
+    friend class SxBenchmarks;
 };
 
 #endif
@@ -0,0 +1,131 @@
+/*
+ *  Copyright (C) 2012-2016 Skylable Ltd. <info-copyright@skylable.com>
+ *
+ *  This program is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public License
+ *  as published by the Free Software Foundation; either version 2
+ *  of the License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA.
+ *
+ *  Special exception for linking this software with OpenSSL:
+ *
+ *  In addition, as a special exception, Skylable Ltd. gives permission to
+ *  link the code of this program with the OpenSSL library and distribute
+ *  linked combinations including the two. You must obey the GNU General
+ *  Public License in all respects for all of the code used other than
+ *  OpenSSL. You may extend this exception to your version of the program,
+ *  but you are not obligated to do so. If you do not wish to do so, delete
+ *  this exception statement from your version.
+ */
+#include "sxclusterpool.h"
+#include "sxauth.h"
+#include "sxcluster.h"
+#include "sxlog.h"
+
+#include <QDateTime>
+#include <QThread>
+
+SxClusterPool &SxClusterPool::instance()
+{
+    static SxClusterPool sInstance;
+    return sInstance;
+}
+
+SxClusterPool::SxClusterPool()
+{
+}
+
+SxClusterPool::~SxClusterPool()
+{
+    clear();
+}
+
+QString SxClusterPool::_key(const SxAuth &auth, const QByteArray &uuid)
+{
+    return QString("%1|%2|%3|%4|%5").arg(auth.clusterName(), auth.initialAddress(), QString::number(auth.port()),
+                                         QString::fromLatin1(auth.token_user().toHex()), QString::fromLatin1(uuid));
+}
+
+/* the most recently released cluster of the same user goes first, expired ones are dropped */
+SxCluster *SxClusterPool::acquire(const SxAuth &auth, const QByteArray &uuid, std::function<bool(QSslCertificate &, bool)> checkSslCallback, QString &errorMessage)
+{
+    const QString key = _key(auth, uuid);
+    const qint64 now = QDateTime::currentMSecsSinceEpoch();
+    SxCluster *cluster = nullptr;
+    QList<SxCluster*> expired;
+    {
+        QMutexLocker locker(&mMutex);
+        for (int i=mIdle.count()-1; i>=0; i--) {
+            const Idle &idle = mIdle.at(i);
+            if (now - idle.released > sIdleTimeout*1000)
+                expired.append(mIdle.takeAt(i).cluster);
+            else if (cluster == nullptr && idle.key == key)
+                cluster = mIdle.takeAt(i).cluster;
+        }
+    }
+    foreach (SxCluster *c, expired) {
+        delete c;
+    }
+    if (cluster != nullptr) {
+        logVerbose("reusing pooled cluster");
+        // objects without a thread can be pulled into the current one
+        cluster->moveToThread(QThread::currentThread());
+        cluster->setCheckSslCallback(checkSslCallback);
+        cluster->setCancelToken(SxCancelToken());
+        cluster->checkNetworkConfigurationChanged();
+    }
+    else {
+        cluster = SxCluster::initializeCluster(auth, uuid, checkSslCallback, errorMessage, true);
+        if (cluster == nullptr)
+            return nullptr;
+    }
+    QMutexLocker locker(&mMutex);
+    mLeased.insert(cluster, key);
+    return cluster;
+}
+
+void SxClusterPool::release(SxCluster *cluster)
+{
+    if (cluster == nullptr)
+        return;
+    QString key;
+    {
+        QMutexLocker locker(&mMutex);
+        key = mLeased.take(cluster);
+    }
+    // clusters still waiting for upload jobs or running elsewhere are not worth keeping
+    if (key.isEmpty() || cluster->uploadJobsCount() > 0 || cluster->thread() != QThread::currentThread()) {
+        delete cluster;
+        return;
+    }
+    cluster->setCheckSslCallback(nullptr);
+    cluster->moveToThread(nullptr);
+    SxCluster *evicted = nullptr;
+    {
+        QMutexLocker locker(&mMutex);
+        if (mIdle.count() >= sIdleLimit)
+            evicted = mIdle.takeFirst().cluster;
+        mIdle.append({cluster, key, QDateTime::currentMSecsSinceEpoch()});
+    }
+    delete evicted;
+}
+
+void SxClusterPool::clear()
+{
+    QList<Idle> idle;
+    {
+        QMutexLocker locker(&mMutex);
+        idle.swap(mIdle);
+    }
+    foreach (const Idle &entry, idle) {
+        delete entry.cluster;
+    }
+}
@@ -0,0 +1,73 @@
+/*
+ *  Copyright (C) 2012-2016 Skylable Ltd. <info-copyright@skylable.com>
+ *
+ *  This program is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public License
+ *  as published by the Free Software Foundation; either version 2
+ *  of the License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA.
+ *
+ *  Special exception for linking this software with OpenSSL:
+ *
+ *  In addition, as a special exception, Skylable Ltd. gives permission to
+ *  link the code of this program with the OpenSSL library and distribute
+ *  linked combinations including the two. You must obey the GNU General
+ *  Public License in all respects for all of the code used other than
+ *  OpenSSL. You may extend this exception to your version of the program,
+ *  but you are not obligated to do so. If you do not wish to do so, delete
+ *  this exception statement from your version.
+ */
+#ifndef SXCLUSTERPOOL_H
+#define SXCLUSTERPOOL_H
+
+#include <QByteArray>
+#include <QHash>
+#include <QList>
+#include <QMutex>
+#include <QSslCertificate>
+#include <QString>
+#include <functional>
+
+class SxAuth;
+class SxCluster;
+
+/* Process wide pool of idle clusters, so transfer helpers and queue workers start with a
+ * bootstrapped cluster and its open connections instead of initializing a new one.
+ * A released cluster is detached from its thread and pulled into the thread acquiring it;
+ * holders disconnect their own signals and leave no callbacks but the ssl one behind */
+class SxClusterPool
+{
+public:
+    static SxClusterPool& instance();
+    SxClusterPool(const SxClusterPool &) = delete;
+    SxClusterPool &operator= (const SxClusterPool &) = delete;
+    SxCluster *acquire(const SxAuth &auth, const QByteArray &uuid, std::function<bool(QSslCertificate &, bool)> checkSslCallback, QString &errorMessage);
+    // takes over the cluster, it is deleted when it can't be kept; must be called from its thread
+    void release(SxCluster *cluster);
+    void clear();
+
+private:
+    SxClusterPool();
+    ~SxClusterPool();
+    static QString _key(const SxAuth &auth, const QByteArray &uuid);
+    static const int sIdleLimit = 4;
+    static const int sIdleTimeout = 5*60;
+    struct Idle {
+        SxCluster *cluster;
+        QString key;
+        qint64 released;
+    };
+    QMutex mMutex;
+    QList<Idle> mIdle;
+    QHash<SxCluster*, QString> mLeased;
+};
+
+#endif // SXCLUSTERPOOL_H
@@ -0,0 +1,103 @@
+/*
+ *  Copyright (C) 2012-2016 Skylable Ltd. <info-copyright@skylable.com>
+ *
+ *  This program is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public License
+ *  as published by the Free Software Foundation; either version 2
+ *  of the License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA.
+ *
+ *  Special exception for linking this software with OpenSSL:
+ *
+ *  In addition, as a special exception, Skylable Ltd. gives permission to
+ *  link the code of this program with the OpenSSL library and distribute
+ *  linked combinations including the two. You must obey the GNU General
+ *  Public License in all respects for all of the code used other than
+ *  OpenSSL. You may extend this exception to your version of the program,
+ *  but you are not obligated to do so. If you do not wish to do so, delete
+ *  this exception statement from your version.
+ */
+
+#include "sxdownloadplan.h"
+
+SxDownloadPlan::SxDownloadPlan(const QList<SxBlock *> &blocks, int blockSize)
+{
+    mIndex.reserve(blocks.count());
+    for (int i=0; i<blocks.count(); i++) {
+        SxBlock *block = blocks.at(i);
+        auto it = mIndex.constFind(block);
+        int index;
+        if (it == mIndex.constEnd()) {
+            index = mBlocks.count();
+            mIndex.insert(block, index);
+            mBlocks.append(block);
+            mOffsets.append(QVector<qint64>());
+        }
+        else
+            index = it.value();
+        mOffsets[index].append(i*static_cast<qint64>(blockSize));
+    }
+    mPending.fill(true, mBlocks.count());
+    mPendingCount = mBlocks.count();
+    mFirstPending = 0;
+}
+
+bool SxDownloadPlan::isPending(SxBlock *block) const
+{
+    auto it = mIndex.constFind(block);
+    return it != mIndex.constEnd() && mPending.testBit(it.value());
+}
+
+void SxDownloadPlan::setPending(SxBlock *block, bool pending)
+{
+    auto it = mIndex.constFind(block);
+    if (it == mIndex.constEnd())
+        return;
+    int index = it.value();
+    if (mPending.testBit(index) == pending)
+        return;
+    mPending.setBit(index, pending);
+    if (pending) {
+        ++mPendingCount;
+        if (index < mFirstPending)
+            mFirstPending = index;
+    }
+    else
+        --mPendingCount;
+}
+
+const QVector<qint64> &SxDownloadPlan::offsets(SxBlock *block) const
+{
+    static const QVector<qint64> sEmpty;
+    auto it = mIndex.constFind(block);
+    if (it == mIndex.constEnd())
+        return sEmpty;
+    return mOffsets.at(it.value());
+}
+
+int SxDownloadPlan::next(int from) const
+{
+    if (mPendingCount == 0)
+        return -1;
+    for (int i=qMax(from, mFirstPending); i<mPending.size(); i++) {
+        if (mPending.testBit(i))
+            return i;
+    }
+    return -1;
+}
+
+int SxDownloadPlan::first() const
+{
+    int index = next(mFirstPending);
+    if (index >= 0)
+        mFirstPending = index;
+    return index;
+}
@@ -0,0 +1,67 @@
+/*
+ *  Copyright (C) 2012-2016 Skylable Ltd. <info-copyright@skylable.com>
+ *
+ *  This program is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public License
+ *  as published by the Free Software Foundation; either version 2
+ *  of the License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA.
+ *
+ *  Special exception for linking this software with OpenSSL:
+ *
+ *  In addition, as a special exception, Skylable Ltd. gives permission to
+ *  link the code of this program with the OpenSSL library and distribute
+ *  linked combinations including the two. You must obey the GNU General
+ *  Public License in all respects for all of the code used other than
+ *  OpenSSL. You may extend this exception to your version of the program,
+ *  but you are not obligated to do so. If you do not wish to do so, delete
+ *  this exception statement from your version.
+ */
+
+#ifndef SXDOWNLOADPLAN_H
+#define SXDOWNLOADPLAN_H
+
+#include <QBitArray>
+#include <QHash>
+#include <QList>
+#include <QVector>
+
+class SxBlock;
+
+/* Bookkeeping of the blocks a download still needs. Unique blocks get a dense index in
+ * the order of their first occurrence in the file, their offsets are computed once and
+ * the pending ones are kept in a bitset, so lookups and removals are O(1) */
+class SxDownloadPlan
+{
+public:
+    SxDownloadPlan(const QList<SxBlock*> &blocks, int blockSize);
+    int blockCount() const { return mBlocks.count(); }
+    int pendingCount() const { return mPendingCount; }
+    bool isEmpty() const { return mPendingCount == 0; }
+    SxBlock *block(int index) const { return mBlocks.at(index); }
+    bool isPending(SxBlock *block) const;
+    void setPending(SxBlock *block, bool pending);
+    // offsets of all copies of the block in the file, in ascending order
+    const QVector<qint64> &offsets(SxBlock *block) const;
+    // first pending index not lower than from, -1 when there is none
+    int next(int from) const;
+    int first() const;
+
+private:
+    QVector<SxBlock*> mBlocks;
+    QVector<QVector<qint64>> mOffsets;
+    QHash<SxBlock*, int> mIndex;
+    QBitArray mPending;
+    int mPendingCount;
+    mutable int mFirstPending;
+};
+
+#endif // SXDOWNLOADPLAN_H
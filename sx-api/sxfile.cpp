@@ -29,8 +29,15 @@
 #include "sxfile.h"
 #include <QCryptographicHash>
 #include <QDebug>
+#include "sxbufferpool.h"
 #include "sxfilter.h"
 #include "sxlog.h"
+#include "sxmappedfile.h"
+#include "sxprofiler.h"
+#include <QThread>
+#include <QVector>
+#include <QtConcurrent>
+#include <cstring>
 
 SxFile::SxFile(SxVolume *volume, const QString& path, const QString &revision, bool localFile)
 {
@@ -43,12 +50,14 @@ SxFile::SxFile(SxVolume *volume, const QString& path, const QString &revision, b
     mCreatedAt = 0;
     mBlockSize = 0;
     mMultipart = false;
-    mIsAbortedCb = nullptr;
+    mChunkSize = cChunkSize;
+    mNextChunkOffset = 0;
+    mNextChunkEnd = 0;
     if (localFile)
         cryptRemoteName(localFile);
 }
 
-SxFile::SxFile(SxVolume *volume, const QString &path, const QByteArray& salt, const QString &localFile, const int blockSize, const qint64 localSize, std::function<bool()> isAborted, bool multipart)
+SxFile::SxFile(SxVolume *volume, const QString &path, const QByteArray& salt, const QString &localFile, const int blockSize, const qint64 localSize, const SxCancelToken &cancelToken, bool multipart, const QVector<QPair<quint64, QString>> &knownBlocks)
 {
     mVolume = volume;
     mLocalPath = path;
@@ -57,10 +66,14 @@ SxFile::SxFile(SxVolume *volume, const QString &path, const QByteArray& salt, co
     mCreatedAt = 0;
     mLocalSize =localSize;
     mMultipart = multipart;
+    mChunkSize = qMin(cChunkSize, chunkSizeLimit());
+    mNextChunkOffset = 0;
+    mNextChunkEnd = 0;
     cryptRemoteName(true);
     mLocalFile.setFileName(localFile);
-    mIsAbortedCb = isAborted;
+    mCancelToken = cancelToken;
     mSalt = salt;
+    mKnownBlocks = knownBlocks;
 
     if (mLocalFile.size() == 0) {
         mRemoteSize = 0;
@@ -68,59 +81,50 @@ SxFile::SxFile(SxVolume *volume, const QString &path, const QByteArray& salt, co
         return;
     }
 
-    if (mLocalFile.open(QIODevice::ReadOnly)) {
-        mRemoteSize = mLocalFile.size();
-        if (mRemoteSize <= cChunkSize) {
-            mMultipart = false;
-        }
-        mBlockSize = blockSize;
-        QByteArray blockData;
-
-        qint64 offset = 0;
-        qint64 readLimit = mMultipart ? cChunkSize : mRemoteSize;
-
-        while(offset + blockSize <= readLimit) {
-            if (isAborted != nullptr && isAborted())
-                return;
-            offset+=blockSize;
-            blockData = mLocalFile.read(blockSize);
-            if (blockData.size() != blockSize)
-                goto onFileReadError;
-            QString hash = QString::fromUtf8(SxBlock::hashBlock(blockData,salt));
-            appendBlock(hash, QStringList());
-        }
-        if (readLimit - offset > 0) {
-            int size = static_cast<int>(readLimit - offset);
-            blockData = mLocalFile.read(size);
-            if (blockData.size() != size)
-                goto onFileReadError;
-            blockData.resize(blockSize);
-            for (int i=size; i<blockSize; i++) {
-                blockData[i]=0;
-            }
-            QString hash = QString::fromUtf8(SxBlock::hashBlock(blockData,salt));
-            appendBlock(hash, QStringList());
-        }
+    mRemoteSize = mLocalFile.size();
+    if (mRemoteSize <= cChunkSize) {
+        mMultipart = false;
     }
-    else {
-        logWarning("unable to open file");
+    mBlockSize = blockSize;
+    if (!hashBlocks(0, mMultipart ? mChunkSize : mRemoteSize)) {
+        mChecksums.clear();
         mLocalSize = 0;
         mRemoteSize = 0;
         mBlockSize = 0;
     }
-    mLocalFile.close();
-    return;
-    onFileReadError:
-    logWarning("read error");
-    mLocalFile.close();
-    mLocalSize = 0;
-    mRemoteSize = 0;
-    mBlockSize = 0;
-    return;
+}
+
+SxFile::SxFile(SxVolume *volume, const QString &path, const QByteArray &salt, const QStringList &blocks, const int blockSize, const qint64 remoteSize, const qint64 localSize, bool multipart)
+{
+    mVolume = volume;
+    mLocalPath = path;
+    mRemotePath = path;
+    mRevision = "";
+    mCreatedAt = 0;
+    mLocalSize = localSize;
+    mRemoteSize = remoteSize;
+    mBlockSize = blockSize;
+    mMultipart = multipart && remoteSize > cChunkSize;
+    mChunkSize = qMin(cChunkSize, chunkSizeLimit());
+    mNextChunkOffset = 0;
+    mNextChunkEnd = 0;
+    cryptRemoteName(true);
+    mSalt = salt;
+
+    if (mRemoteSize == 0) {
+        mLocalSize = 0;
+        return;
+    }
+    int count = mMultipart ? static_cast<int>(mChunkSize / blockSize) : blocks.count();
+    for (int i=0; i<count && i<blocks.count(); i++) {
+        appendBlock(blocks.at(i), QStringList());
+    }
+    mPendingBlocks = blocks.mid(count);
 }
 
 SxFile::~SxFile()
 {
+    mNextChunk.waitForFinished();
     clearBlocks();
 }
 
@@ -152,6 +156,16 @@ bool SxFile::haveEqualContent(SxFile &other) const
     return true;
 }
 
+SxBlockList SxFile::blockList() const
+{
+    SxBlockList result;
+    result.reserve(mBlocks.count());
+    foreach (SxBlock *block, mBlocks) {
+        result.append(block->mHash);
+    }
+    return result;
+}
+
 void SxFile::fakeFile(qint64 fileSize, QStringList blockList, int blockSize)
 {
     mLocalSize = mRemoteSize = fileSize;
@@ -182,6 +196,16 @@ qint64 SxFile::remoteSize() const
     return mRemoteSize;
 }
 
+int SxFile::blockSize() const
+{
+    return mBlockSize;
+}
+
+int SxFile::blockCount() const
+{
+    return mBlocks.count();
+}
+
 QString SxFile::revision() const
 {
     return mRevision;
@@ -192,60 +216,78 @@ bool SxFile::multipart() const
     return mMultipart;
 }
 
+/* the chunk size follows the upload speed, bounded by the transfer memory budget,
+ * block aligned and taking effect with the next chunk read or prefetched */
+void SxFile::setNextChunkSize(qint64 size)
+{
+    if (mBlockSize <= 0)
+        return;
+    size = qBound(cMinChunkSize, size, qMax(cMinChunkSize, chunkSizeLimit()));
+    mChunkSize = qMax<qint64>(mBlockSize, size / mBlockSize * mBlockSize);
+}
+
+qint64 SxFile::chunkSizeLimit() const
+{
+    qint64 budget = SxBufferPool::instance().budget();
+    if (budget <= 0)
+        return cMaxChunkSize;
+    return qMin(cMaxChunkSize, budget);
+}
+
+/* hashes the next chunk in the background while the current one is being sent,
+ * readNextChunk() picks up the result */
+void SxFile::prefetchNextChunk()
+{
+    if (!mMultipart || mBlockSize <= 0 || mNextChunkEnd > 0 || !mPendingBlocks.isEmpty() || !mLocalFile.exists())
+        return;
+    qint64 offset = static_cast<qint64>(mBlockSize)*mBlocks.count();
+    if (offset >= mRemoteSize)
+        return;
+    qint64 end = qMin(offset+mChunkSize, mRemoteSize);
+    mNextChunkOffset = offset;
+    mNextChunkEnd = end;
+    mNextHashes.clear();
+    mNextChecksums.clear();
+    mNextChunk = QtConcurrent::run([this, offset, end]() -> bool {
+        return hashChunk(offset, end, mNextHashes, mNextChecksums);
+    });
+}
+
 void SxFile::clearBlocks()
 {
-    foreach (SxBlock* block, mUniqueBlocks.values()) {
-        mBlocks.removeAll(block);
-        mBlocksToSend.removeAll(block);
-        delete block;
-    }
+    // every block in mBlocks and mBlocksToSend is owned by mUniqueBlocks
+    qDeleteAll(mUniqueBlocks);
     mUniqueBlocks.clear();
-    Q_ASSERT(mBlocks.isEmpty());
-    Q_ASSERT(mBlocksToSend.isEmpty());
+    mBlocks.clear();
+    mBlocksToSend.clear();
+    mNodeLists.clear();
+    mChecksums.clear();
 }
 
 void SxFile::appendBlock(const QString &hash, const QStringList &nodeList)
 {
-    SxBlock *block;
-    if (mUniqueBlocks.contains(hash))
-        block = mUniqueBlocks.value(hash);
-    else {
-        block = new SxBlock(hash, QByteArray(), nodeList);
-        mUniqueBlocks.insert(hash, block);
-    }
-    mBlocks.append(block);
+    auto it = mUniqueBlocks.find(hash);
+    if (it == mUniqueBlocks.end())
+        it = mUniqueBlocks.insert(hash, new SxBlock(hash, QByteArray(), sharedNodeList(nodeList)));
+    mBlocks.append(it.value());
 }
 
-bool SxFile::readBlock(qint64 offset, int blockSize, char* data)
+QStringList SxFile::sharedNodeList(const QStringList &nodeList)
 {
-    if (!mLocalFile.open(QIODevice::ReadOnly)) {
-        logWarning("unable to open file" + mLocalFile.fileName());
-        return false;
-    }
-    if (mLocalFile.size() <= offset) {
-        mLocalFile.close();
-        return false;
-    }
-    mLocalFile.seek(offset);
-    int toRead;
-    if (offset + blockSize > mLocalFile.size())
-        toRead = static_cast<int>(mLocalFile.size() - offset);
-    else
-        toRead = blockSize;
-
-    qint64 readen = mLocalFile.read(data, toRead);
-
-    mLocalFile.close();
-    if (readen != toRead) {
-        return false;
-    }
-    for (int i=static_cast<int>(readen); i<blockSize; i++)
-        data[i]=0;
-    return true;
+    // blocks are spread over a handful of replica sets, so the node lists are shared between blocks
+    if (nodeList.isEmpty())
+        return nodeList;
+    QString key = nodeList.join(',');
+    auto it = mNodeLists.find(key);
+    if (it == mNodeLists.end())
+        it = mNodeLists.insert(key, nodeList);
+    return it.value();
 }
 
 bool SxFile::canReadNextChunk() const
 {
+    if (!mPendingBlocks.isEmpty())
+        return true;
     if (!mLocalFile.exists())
         return false;
     return (mLocalSize > mBlocks.count()*static_cast<qint64>(mBlockSize));
@@ -255,48 +297,208 @@ bool SxFile::readNextChunk()
 {
     if (!canReadNextChunk())
         return false;
-    if (!mLocalFile.open(QIODevice::ReadOnly)) {
-        logWarning("unable to open file" + mLocalFile.fileName());
-        return false;
+    if (!mPendingBlocks.isEmpty()) {
+        int count = static_cast<int>(qMin<qint64>(mChunkSize / mBlockSize, mPendingBlocks.count()));
+        for (int i=0; i<count; i++) {
+            appendBlock(mPendingBlocks.at(i), QStringList());
+        }
+        mPendingBlocks = mPendingBlocks.mid(count);
+        return true;
     }
-
-    QByteArray blockData;
     qint64 offset = static_cast<qint64>(mBlockSize)*mBlocks.count();
-    if (!mLocalFile.seek(offset)) {
-        logWarning("seek failed");
-        mLocalFile.close();
+    if (mNextChunkEnd > 0) {
+        bool hashed = mNextChunk.result() && mNextChunkOffset == offset;
+        mNextChunkEnd = 0;
+        if (hashed) {
+            foreach (const QString &hash, mNextHashes) {
+                appendBlock(hash, QStringList());
+            }
+            mChecksums += mNextChecksums;
+        }
+        mNextHashes.clear();
+        mNextChecksums.clear();
+        if (hashed)
+            return true;
+    }
+    return hashBlocks(offset, qMin(offset+mChunkSize, mRemoteSize));
+}
+
+bool SxFile::restoreChunks(const QStringList &blocks)
+{
+    if (blocks.count() < mBlocks.count() || static_cast<qint64>(blocks.count())*mBlockSize > mRemoteSize + mBlockSize)
         return false;
+    for (int i=0; i<mBlocks.count(); i++) {
+        if (mBlocks.at(i)->mHash != blocks.at(i))
+            return false;
     }
-    qint64 readLimit = qMin(offset+cChunkSize, mRemoteSize);
-    while(offset + mBlockSize <= readLimit) {
-        if (mIsAbortedCb != nullptr && mIsAbortedCb()) {
-            mLocalFile.close();
+    const int known = mBlocks.count();
+    for (int i=known; i<blocks.count() && i-known<mPendingBlocks.count(); i++) {
+        if (mPendingBlocks.at(i-known) != blocks.at(i))
             return false;
-        }
-        offset+=mBlockSize;
-        blockData = mLocalFile.read(mBlockSize);
-        if (blockData.size() != mBlockSize) {
-            mLocalFile.close();
+    }
+    for (int i=known; i<blocks.count(); i++) {
+        appendBlock(blocks.at(i), QStringList());
+    }
+    mPendingBlocks = mPendingBlocks.mid(blocks.count()-known);
+    mBlocksToSend.clear();
+    return true;
+}
+
+static QAtomicInt sHashingThreads;
+
+/* caps the threads hashing a single file, 0 means one per core */
+void SxFile::setHashingThreads(int threads)
+{
+    sHashingThreads.store(threads);
+}
+
+/* hashes a local file ahead of its upload, in the same form as the blocks known from the
+ * last upload; the upload then only checksums the file and hashes blocks changed since */
+bool SxFile::prepareBlocks(const QString &localFile, int blockSize, const QByteArray &salt, QVector<QPair<quint64, QString>> &blocks, const SxCancelToken &cancelToken)
+{
+    static const qint64 sBatchSize = 1024*1024;
+    blocks.clear();
+    if (blockSize <= 0)
+        return false;
+    SxMappedFile file(localFile);
+    if (!file.open())
+        return false;
+    const qint64 size = file.size();
+    const qint64 blockCount = (size + blockSize - 1) / blockSize;
+    const int batchSize = static_cast<int>(qMax<qint64>(1, sBatchSize / blockSize));
+    SxPooledBuffer buffer(batchSize*blockSize);
+    blocks.reserve(static_cast<int>(blockCount));
+    for (qint64 i=0; i<blockCount; i+=batchSize) {
+        if (cancelToken.isCancelled())
             return false;
+        int count = static_cast<int>(qMin<qint64>(batchSize, blockCount - i));
+        qint64 toRead = qMin(static_cast<qint64>(count)*blockSize, size - i*blockSize);
+        const char *data = nullptr;
+        if (toRead == static_cast<qint64>(count)*blockSize)
+            data = file.map(i*blockSize, toRead);
+        if (!data) {
+            if (!file.read(i*blockSize, buffer.data(), toRead))
+                return false;
+            if (toRead < static_cast<qint64>(count)*blockSize)
+                memset(buffer.data()+toRead, 0, static_cast<size_t>(static_cast<qint64>(count)*blockSize-toRead));
+            data = buffer.data();
+        }
+        auto hashes = SxBlock::hashBlocks(data, count, blockSize, salt);
+        for (int j=0; j<count; j++) {
+            blocks.append({SxBlock::checksumBlock(data+static_cast<qint64>(j)*blockSize, blockSize), QString::fromUtf8(hashes.at(j))});
         }
-        QString hash = QString::fromUtf8(SxBlock::hashBlock(blockData,mSalt));
+    }
+    return true;
+}
+
+bool SxFile::hashBlocks(qint64 offset, qint64 readLimit)
+{
+    QVector<QString> hashes;
+    QVector<quint64> checksums;
+    if (!hashChunk(offset, readLimit, hashes, checksums))
+        return false;
+    foreach (const QString &hash, hashes) {
         appendBlock(hash, QStringList());
     }
-    if (readLimit - offset > 0) {
-        int size = static_cast<int>(readLimit - offset);
-        blockData = mLocalFile.read(size);
-        if (blockData.size() != size) {
-            mLocalFile.close();
+    mChecksums += checksums;
+    return true;
+}
+
+/* hashes blocks of the local file without touching the block list, safe to run
+ * on another thread while the file is being sent */
+bool SxFile::hashChunk(qint64 offset, qint64 readLimit, QVector<QString> &hashes, QVector<quint64> &checksums)
+{
+    sxProfile("hashing");
+    const qint64 blockCount = (readLimit - offset + mBlockSize - 1) / mBlockSize;
+    if (blockCount <= 0)
+        return true;
+    int workers = QThread::idealThreadCount();
+    if (sHashingThreads.load() > 0)
+        workers = qMin(workers, sHashingThreads.load());
+    if (workers < 1 || blockCount < cParallelHashBlocks)
+        workers = 1;
+    else if (workers > blockCount / cParallelHashBlocks)
+        workers = static_cast<int>(blockCount / cParallelHashBlocks);
+
+    hashes = QVector<QString>(static_cast<int>(blockCount));
+    checksums = QVector<quint64>(static_cast<int>(blockCount));
+    QAtomicInt reused;
+    const qint64 firstBlock = offset / mBlockSize;
+    auto hashRange = [this, offset, readLimit, firstBlock, &hashes, &checksums, &reused](qint64 first, qint64 last) -> bool {
+        SxMappedFile file(mLocalFile.fileName());
+        if (!file.open()) {
+            logWarning("unable to open file" + mLocalFile.fileName());
             return false;
         }
-        blockData.resize(mBlockSize);
-        for (int i=size; i<mBlockSize; i++) {
-            blockData[i]=0;
+        const int batchSize = static_cast<int>(qMax<qint64>(1, cHashBatchSize / mBlockSize));
+        SxPooledBuffer buffer(batchSize*mBlockSize);
+        for (qint64 i=first; i<last; i+=batchSize) {
+            if (mCancelToken.isCancelled())
+                return false;
+            int count = static_cast<int>(qMin<qint64>(batchSize, last - i));
+            qint64 toRead = qMin(static_cast<qint64>(count)*mBlockSize, readLimit - offset - i*mBlockSize);
+            // full batches are hashed straight from the mapping, a short tail needs padding
+            const char *data = nullptr;
+            if (toRead == static_cast<qint64>(count)*mBlockSize)
+                data = file.map(offset + i*mBlockSize, toRead);
+            if (!data) {
+                if (!file.read(offset + i*mBlockSize, buffer.data(), toRead)) {
+                    logWarning("read error");
+                    return false;
+                }
+                if (toRead < static_cast<qint64>(count)*mBlockSize)
+                    memset(buffer.data()+toRead, 0, static_cast<size_t>(static_cast<qint64>(count)*mBlockSize-toRead));
+                data = buffer.data();
+            }
+            // blocks with the same checksum as in the last upload keep their hash,
+            // runs of changed blocks in between are hashed together
+            int changed = 0;
+            for (int j=0; j<=count; j++) {
+                const int index = static_cast<int>(i)+j;
+                bool known = false;
+                if (j < count) {
+                    checksums[index] = SxBlock::checksumBlock(data+static_cast<qint64>(j)*mBlockSize, mBlockSize);
+                    const qint64 knownIndex = firstBlock + index;
+                    if (knownIndex < mKnownBlocks.size() && mKnownBlocks.at(static_cast<int>(knownIndex)).first == checksums.at(index)
+                            && !mKnownBlocks.at(static_cast<int>(knownIndex)).second.isEmpty()) {
+                        hashes[index] = mKnownBlocks.at(static_cast<int>(knownIndex)).second;
+                        reused.ref();
+                        known = true;
+                    }
+                }
+                if (j < count && !known)
+                    continue;
+                if (j > changed) {
+                    auto batchHashes = SxBlock::hashBlocks(data+static_cast<qint64>(changed)*mBlockSize, j-changed, mBlockSize, mSalt);
+                    for (int k=0; k<j-changed; k++) {
+                        hashes[static_cast<int>(i)+changed+k] = QString::fromUtf8(batchHashes.at(k));
+                    }
+                }
+                changed = j+1;
+            }
+        }
+        return true;
+    };
+
+    bool result = true;
+    if (workers == 1) {
+        result = hashRange(0, blockCount);
+    }
+    else {
+        QList<QFuture<bool>> futures;
+        qint64 rangeSize = (blockCount + workers - 1) / workers;
+        for (qint64 first=0; first<blockCount; first+=rangeSize) {
+            futures.append(QtConcurrent::run(hashRange, first, qMin(first+rangeSize, blockCount)));
+        }
+        foreach (auto future, futures) {
+            if (!future.result())
+                result = false;
         }
-        QString hash = QString::fromUtf8(SxBlock::hashBlock(blockData,mSalt));
-        appendBlock(hash, QStringList());
     }
-    mLocalFile.close();
+    if (!result)
+        return false;
+    if (reused.load() > 0)
+        logVerbose(QString("reused %1 of %2 block hashes of %3").arg(reused.load()).arg(blockCount).arg(mLocalPath));
     return true;
 }
 
@@ -312,22 +514,10 @@ void SxFile::cryptRemoteName(bool localFile)
 
 QHash<SxBlock *, QList<qint64> > SxFile::getBlocksOffsets()
 {
-    QHash<SxBlock *, QList<qint64>* > tmpList;
-    foreach (SxBlock* block, mUniqueBlocks) {
-        tmpList.insert(block, new QList<qint64>());
-    }
-    for (int i=0; i<mBlocks.count(); i++) {
-        qint64 offset = i*static_cast<qint64>(mBlockSize);
-        SxBlock* block = mBlocks.at(i);
-        tmpList.value(block)->append(offset);
-    }
     QHash<SxBlock *, QList<qint64> > list;
-    foreach (SxBlock* block, mUniqueBlocks) {
-        QList<qint64>* nodes = tmpList.take(block);
-        list.insert(block, *nodes);
-        delete nodes;
+    list.reserve(mUniqueBlocks.count());
+    for (int i=0; i<mBlocks.count(); i++) {
+        list[mBlocks.at(i)].append(i*static_cast<qint64>(mBlockSize));
     }
-
-    Q_ASSERT(tmpList.isEmpty());
     return list;
 }
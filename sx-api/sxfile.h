@@ -31,10 +31,13 @@
 
 #include <QObject>
 #include <QFile>
+#include <QVector>
+#include <QFuture>
 #include "sxvolume.h"
 #include "sxblock.h"
+#include "sxblocklist.h"
 #include "sxmeta.h"
-#include <functional>
+#include "sxcanceltoken.h"
 
 class SxCluster;
 class SxFilter;
@@ -43,7 +46,8 @@ class SxFile
 {
 public:
     SxFile(SxVolume* volume, const QString &path, const QString &revision, bool localFile);
-    SxFile(SxVolume* volume, const QString &path, const QByteArray &salt, const QString& localFile, const int blockSize, const qint64 localSize, std::function<bool()> isAborted=nullptr, bool multipart=false);
+    SxFile(SxVolume* volume, const QString &path, const QByteArray &salt, const QString& localFile, const int blockSize, const qint64 localSize, const SxCancelToken &cancelToken=SxCancelToken(), bool multipart=false, const QVector<QPair<quint64, QString>> &knownBlocks=QVector<QPair<quint64, QString>>());
+    SxFile(SxVolume* volume, const QString &path, const QByteArray &salt, const QStringList &blocks, const int blockSize, const qint64 remoteSize, const qint64 localSize, bool multipart=false);
     ~SxFile();
 
     bool haveEqualContent(SxFile& oter) const;
@@ -53,16 +57,27 @@ public:
     void fakeFile(qint64 fileSize, QStringList blockList, int blockSize);
     void print();
     qint64 remoteSize() const;
+    int blockSize() const;
+    int blockCount() const;
     QString revision() const;
     bool multipart() const;
+    void setNextChunkSize(qint64 size);
+    void prefetchNextChunk();
+    SxBlockList blockList() const;
+    static void setHashingThreads(int threads);
+    static bool prepareBlocks(const QString &localFile, int blockSize, const QByteArray &salt, QVector<QPair<quint64, QString>> &blocks, const SxCancelToken &cancelToken);
 
 private:
     void clearBlocks();
     QHash<SxBlock*, QList<qint64>> getBlocksOffsets();
     void appendBlock(const QString& hash, const QStringList& nodeList);
-    bool readBlock(qint64 offset, int blockSize, char *data);
+    QStringList sharedNodeList(const QStringList &nodeList);
     bool canReadNextChunk() const;
     bool readNextChunk();
+    bool restoreChunks(const QStringList &blocks);
+    bool hashBlocks(qint64 offset, qint64 readLimit);
+    bool hashChunk(qint64 offset, qint64 readLimit, QVector<QString> &hashes, QVector<quint64> &checksums);
+    qint64 chunkSizeLimit() const;
 
 private:
     SxVolume* mVolume;
@@ -77,15 +92,32 @@ private:
     QString mUploadToken;
     QString mUploadPollTarget;
     bool mMultipart;
-    std::function<bool()> mIsAbortedCb;
+    SxCancelToken mCancelToken;
     QByteArray mSalt;
 
     QHash<QString, SxBlock*> mUniqueBlocks;
     QList<SxBlock*> mBlocks;
     QList<SxBlock*> mBlocksToSend;
+    QStringList mPendingBlocks;
+    QHash<QString, QStringList> mNodeLists;
+    // weak checksums of mBlocks, and of the blocks hashed the last time the file was uploaded
+    QVector<quint64> mChecksums;
+    QVector<QPair<quint64, QString>> mKnownBlocks;
 
     void cryptRemoteName(bool localFile);
+    // files above cChunkSize are sent in chunks, sized between the limits by setNextChunkSize()
     const qint64 cChunkSize = 128*1024*1024;
+    const qint64 cMinChunkSize = 16*1024*1024;
+    const qint64 cMaxChunkSize = 512*1024*1024;
+    qint64 mChunkSize;
+    // the chunk hashed in the background by prefetchNextChunk()
+    QFuture<bool> mNextChunk;
+    qint64 mNextChunkOffset;
+    qint64 mNextChunkEnd;
+    QVector<QString> mNextHashes;
+    QVector<quint64> mNextChecksums;
+    const qint64 cParallelHashBlocks = 64;
+    const qint64 cHashBatchSize = 1024*1024;
 
     QFile mLocalFile;
 
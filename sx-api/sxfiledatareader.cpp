@@ -0,0 +1,191 @@
+/*
+ *  Copyright (C) 2012-2016 Skylable Ltd. <info-copyright@skylable.com>
+ *
+ *  This program is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public License
+ *  as published by the Free Software Foundation; either version 2
+ *  of the License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA.
+ *
+ *  Special exception for linking this software with OpenSSL:
+ *
+ *  In addition, as a special exception, Skylable Ltd. gives permission to
+ *  link the code of this program with the OpenSSL library and distribute
+ *  linked combinations including the two. You must obey the GNU General
+ *  Public License in all respects for all of the code used other than
+ *  OpenSSL. You may extend this exception to your version of the program,
+ *  but you are not obligated to do so. If you do not wish to do so, delete
+ *  this exception statement from your version.
+ */
+
+#include "sxfiledatareader.h"
+
+namespace {
+enum Attribute {
+    BlockSize = 1,
+    CreatedAt = 2,
+    FileSize = 4,
+    FileRevision = 8,
+    FileData = 16,
+    AllAttributes = 31
+};
+}
+
+SxFileDataReader::SxFileDataReader(const QByteArray &data) : SxJsonScanner(data)
+{
+    mStarted = false;
+    mInFileData = false;
+    mFinished = false;
+    mFailed = false;
+    mFound = 0;
+    mBlockCount = 0;
+    mBlockSize = 0;
+    mCreatedAt = 0;
+    mFileSize = 0;
+}
+
+bool SxFileDataReader::next(QString &hash, QStringList &nodes)
+{
+    if (mFinished || mFailed)
+        return false;
+    if (!mStarted) {
+        mStarted = true;
+        if (!skipChar('{'))
+            goto onError;
+        if (atChar('}')) {
+            mFinished = true;
+            return false;
+        }
+    }
+    forever {
+        if (mInFileData) {
+            if (atChar(']')) {
+                mPos++;
+                mInFileData = false;
+                continue;
+            }
+            if (mBlockCount > 0 && !skipChar(','))
+                goto onError;
+            if (!readBlock(hash, nodes))
+                goto onError;
+            mBlockCount++;
+            return true;
+        }
+        if (mFound) {
+            if (atChar('}')) {
+                mPos++;
+                mFinished = true;
+                return false;
+            }
+            if (!skipChar(','))
+                goto onError;
+        }
+        if (!readAttribute())
+            goto onError;
+    }
+    onError:
+    mFailed = true;
+    return false;
+}
+
+bool SxFileDataReader::failed() const
+{
+    return mFailed;
+}
+
+bool SxFileDataReader::complete() const
+{
+    return mFinished && mFound == AllAttributes;
+}
+
+int SxFileDataReader::blockCount() const
+{
+    return mBlockCount;
+}
+
+int SxFileDataReader::blockSize() const
+{
+    return mBlockSize;
+}
+
+uint SxFileDataReader::createdAt() const
+{
+    return mCreatedAt;
+}
+
+qint64 SxFileDataReader::fileSize() const
+{
+    return mFileSize;
+}
+
+QString SxFileDataReader::revision() const
+{
+    return mRevision;
+}
+
+bool SxFileDataReader::readAttribute()
+{
+    // unknown keys (error replies included) make the reader fail, the caller
+    // then falls back to the generic parser
+    skipWhitespace();
+    QString key;
+    if (!readString(key) || !skipChar(':'))
+        return false;
+    skipWhitespace();
+    double value;
+    if (key == "fileData") {
+        if ((mFound & FileData) || !skipChar('['))
+            return false;
+        mFound |= FileData;
+        mInFileData = true;
+        return true;
+    }
+    if (key == "fileRevision") {
+        mFound |= FileRevision;
+        return readString(mRevision);
+    }
+    if (!readNumber(value))
+        return false;
+    if (key == "blockSize") {
+        mFound |= BlockSize;
+        mBlockSize = static_cast<int>(value);
+    }
+    else if (key == "createdAt") {
+        mFound |= CreatedAt;
+        mCreatedAt = static_cast<uint>(value);
+    }
+    else if (key == "fileSize") {
+        mFound |= FileSize;
+        mFileSize = static_cast<qint64>(value);
+    }
+    else
+        return false;
+    return true;
+}
+
+bool SxFileDataReader::readBlock(QString &hash, QStringList &nodes)
+{
+    // every block is a single key object: { "hash": [ "node", ... ] }
+    nodes.clear();
+    if (!skipChar('{'))
+        return false;
+    skipWhitespace();
+    if (!readString(hash) || !skipChar(':') || !skipChar('['))
+        return false;
+    do {
+        QString node;
+        skipWhitespace();
+        if (!readString(node) || node.isEmpty())
+            return false;
+        nodes.append(node);
+    } while (skipChar(','));
+    return skipChar(']') && skipChar('}');
+}
@@ -29,12 +29,12 @@
 #include "sxfileentry.h"
 #include <QDebug>
 
-SxFileEntry::SxFileEntry()
+SxFileEntry::SxFileEntry() : mCensus(sizeof(SxFileEntry))
 {
 
 }
 
-SxFileEntry::SxFileEntry(const QString &path, qint64 size, const QString &revision, const uint &createdAt)
+SxFileEntry::SxFileEntry(const QString &path, qint64 size, const QString &revision, const uint &createdAt) : mCensus(sizeof(SxFileEntry))
 {
     mPath = path;
     mSize = size;
@@ -43,7 +43,7 @@ SxFileEntry::SxFileEntry(const QString &path, qint64 size, const QString &revisi
     mBlockSize = 0;
 }
 
-QStringList SxFileEntry::blocks() const
+SxBlockList SxFileEntry::blocks() const
 {
     return mBlocks;
 }
@@ -78,3 +78,8 @@ int SxFileEntry::blockSize() const
 {
     return mBlockSize;
 }
+
+QVector<quint64> SxFileEntry::checksums() const
+{
+    return mChecksums;
+}
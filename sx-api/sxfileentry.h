@@ -31,12 +31,16 @@
 
 #include <QObject>
 #include <QStringList>
+#include <QVector>
+#include "sxblocklist.h"
+#include "sxcensus.h"
 
 class SxCluster;
 
 class SxFileEntry
 {
     friend class SxCluster;
+    friend class SxListingReader;
 public:
     SxFileEntry();
     SxFileEntry(const QString &path, qint64 size, const QString &revision=QString(), const uint &createdAt=0);
@@ -46,8 +50,9 @@ public:
     qint64 size() const;
     QString revision() const;
     uint createdTime() const;
-    QStringList blocks() const;
+    SxBlockList blocks() const;
     int blockSize() const;
+    QVector<quint64> checksums() const;
 
 private:
     QString mPath;
@@ -55,7 +60,9 @@ private:
     QString mRevision;
     uint mCreatedAt;
     int mBlockSize;
-    QStringList mBlocks;
+    SxBlockList mBlocks;
+    QVector<quint64> mChecksums;
+    SxCensusEntry<SxCensus::FileEntry> mCensus;
 };
 
 #endif // SXFILEINFO_H
@@ -28,20 +28,27 @@
 
 #include "sxfilter.h"
 #include "sxfilter/filter_aes256.h"
+#include "sxfilter/filter_zcomp.h"
 #include <QDir>
 #include <QStandardPaths>
 #include <QDebug>
 #include <QThread>
 #include <QCoreApplication>
 #include <QTranslator>
+#include <QCryptographicHash>
 #include "sxcluster.h"
 #include "sxlog.h"
+#include "sxprofiler.h"
+#include "sxnamecache.h"
 
 QMap<QString, sxc_filter_t*> SxFilter::m_registeredFilters;
+QHash<QString, SxFilter::CachedContext> SxFilter::m_cachedContexts;
+QMutex SxFilter::m_cacheMutex;
 
 namespace RegisterFilters {
     const bool registerAES = SxFilter::registerActiveFilter(&sxc_filter_aes256);
     const bool registerAESnew = SxFilter::registerActiveFilter(&sxc_filter_aes_256_new);
+    const bool registerZcomp = SxFilter::registerActiveFilter(&sxc_filter_zcomp);
 }
 
 const QString SxFilter::configDir() const
@@ -99,6 +106,7 @@ SxFilter::SxFilter(sxc_filter_t *filter, SxVolume *volume) :
     m_ctx = 0;
     m_volume = volume;
     m_needFinish = false;
+    m_parallelJobs = qMax(1, QThread::idealThreadCount());
 }
 
 SxFilter::SxFilter(const SxFilter &other)
@@ -110,21 +118,99 @@ SxFilter::SxFilter(const SxFilter &other)
     m_error = QString();
     m_lastWarning = QString();
     m_needFinish = false;
+    m_parallelJobs = other.m_parallelJobs;
 }
 
 SxFilter::~SxFilter()
 {
-    m_volume = 0;
     if (m_needFinish && m_filter->data_finish)
     {
         m_filter->data_finish(this, &m_ctx, m_sxf_mode);
     }
+    cacheContext();
+    m_volume = 0;
     if (m_filter->shutdown)
     {
         m_filter->shutdown(this, m_ctx);
     }
 }
 
+QByteArray SxFilter::contextFingerprint() const
+{
+    QCryptographicHash hash(QCryptographicHash::Sha1);
+    hash.addData(m_volume->meta().value(uuid()+"-cfg"));
+    QList<QString> keys = m_volume->customMeta().keys();
+    qSort(keys);
+    foreach (const QString &key, keys) {
+        hash.addData(key.toUtf8());
+        hash.addData(m_volume->customMeta().value(key));
+    }
+    return hash.result();
+}
+
+/* a prepared filter context holds the volume keys, reusing it spares reading
+ * the key file (or deriving the keys) for every processed file */
+void SxFilter::takeCachedContext()
+{
+    if (m_ctx || m_volume == nullptr)
+        return;
+    const QString key = configDir();
+    CachedContext cached;
+    {
+        QMutexLocker locker(&m_cacheMutex);
+        if (!m_cachedContexts.contains(key))
+            return;
+        cached = m_cachedContexts.take(key);
+    }
+    if (cached.filter == m_filter && cached.fingerprint == contextFingerprint()) {
+        m_ctx = cached.ctx;
+        return;
+    }
+    if (cached.filter->shutdown)
+        cached.filter->shutdown(this, cached.ctx);
+}
+
+void SxFilter::cacheContext()
+{
+    if (!m_ctx || m_volume == nullptr || !m_error.isEmpty())
+        return;
+    // only the current aes256 filter can prepare an already used context
+    if (m_filter != &sxc_filter_aes_256_new)
+        return;
+    CachedContext cached;
+    cached.filter = m_filter;
+    cached.volume = m_volume->name();
+    cached.fingerprint = contextFingerprint();
+    cached.ctx = m_ctx;
+    const QString key = configDir();
+    QMutexLocker locker(&m_cacheMutex);
+    if (m_cachedContexts.contains(key))
+        return;
+    m_cachedContexts.insert(key, cached);
+    m_ctx = 0;
+}
+
+void SxFilter::dropCachedContexts(const QString &volume)
+{
+    QList<CachedContext> dropped;
+    {
+        QMutexLocker locker(&m_cacheMutex);
+        auto it = m_cachedContexts.begin();
+        while (it != m_cachedContexts.end()) {
+            if (volume.isEmpty() || it.value().volume == volume) {
+                dropped.append(it.value());
+                it = m_cachedContexts.erase(it);
+            }
+            else
+                ++it;
+        }
+    }
+    foreach (const CachedContext &cached, dropped) {
+        if (cached.filter->shutdown)
+            cached.filter->shutdown(nullptr, cached.ctx);
+    }
+}
+
 SxFilter *SxFilter::getActiveFilter(SxVolume *volume)
 {
     if (volume == nullptr)
@@ -248,6 +334,7 @@ bool SxFilter::isAes256() const
 bool SxFilter::dataPrepare(QString path, SxMeta &customMeta, sxf_mode_t sxf_mode)
 {
     Q_ASSERT(m_filter->data_prepare);
+    takeCachedContext();
     const QByteArray cfg = m_volume->meta().value(uuid()+"-cfg");
     unsigned int cfg_len = static_cast<unsigned int>(cfg.length());
     m_needFinish = true;
@@ -258,6 +345,7 @@ bool SxFilter::dataPrepare(QString path, SxMeta &customMeta, sxf_mode_t sxf_mode
 qint64 SxFilter::dataProcess(char *inbuff, qint64 inbuffSize, char *outbuff, qint64 outbuffSize, sxf_mode_t sxf_mode, sxf_action_t *action)
 {
     Q_ASSERT(m_filter->data_process);
+    sxProfile("filter data");
     m_needFinish = true;
     m_sxf_mode = sxf_mode;
     ssize_t size = m_filter->data_process(this, m_ctx, inbuff, static_cast<size_t>(inbuffSize), outbuff, static_cast<size_t>(outbuffSize), sxf_mode, action);
@@ -276,6 +364,7 @@ bool SxFilter::filemetaProcess(QString name, QString &newName, bool localToRemot
     while(src[nslashes] == '/')
             nslashes++;
     src = src + nslashes;
+    takeCachedContext();
     const QByteArray cfg = m_volume->meta().value(uuid()+"-cfg");
     auto cfg_len = static_cast<unsigned int>(cfg.length());
 
@@ -296,13 +385,29 @@ bool SxFilter::filemetaProcess(QString name, QString &newName, bool localToRemot
 bool SxFilter::filemetaProcess(SxFile &file, bool localToRemote)
 {
     int result;
+    // encrypted names are deterministic, remember them instead of repeating the crypto on every listing
+    const bool cacheNames = m_filter == &sxc_filter_aes_256_new && m_volume->customMeta().contains("aes256_encrypt_meta");
+    const QByteArray fingerprint = cacheNames ? contextFingerprint() : QByteArray();
+    SxNameCache *names = SxNameCache::instance();
     if (localToRemote) {
         qint64 size = file.mLocalSize;
+        QByteArray encryptedMeta;
+        if (cacheNames && names->findRemote(m_volume->name(), fingerprint, file.mLocalPath, size, file.mRemotePath, encryptedMeta)) {
+            file.mMeta.setValue("aesEncryptedMeta", encryptedMeta);
+            return true;
+        }
         result = filemetaProcess(file.mLocalPath, file.mRemotePath, localToRemote, size, file.mMeta, m_volume->customMeta());
+        if (result && cacheNames)
+            names->insert(m_volume->name(), fingerprint, file.mLocalPath, size, file.mRemotePath, file.mMeta.value("aesEncryptedMeta"));
     }
     else {
         file.mLocalSize = file.mRemoteSize;
+        const QByteArray encryptedMeta = cacheNames ? file.mMeta.value("aesEncryptedMeta") : QByteArray();
+        if (!encryptedMeta.isEmpty() && names->findLocal(m_volume->name(), fingerprint, encryptedMeta, file.mLocalPath, file.mLocalSize))
+            return true;
         result = filemetaProcess(file.mRemotePath, file.mLocalPath, localToRemote, file.mLocalSize, file.mMeta, m_volume->customMeta());
+        if (result && !encryptedMeta.isEmpty())
+            names->insert(m_volume->name(), fingerprint, file.mLocalPath, file.mLocalSize, file.mRemotePath, encryptedMeta);
     }
     return result;
 }
@@ -314,6 +419,16 @@ void SxFilter::dataFinish(sxf_mode_t sxf_mode)
     m_filter->data_finish(this, &m_ctx, sxf_mode);
 }
 
+void SxFilter::setParallelJobs(int jobs)
+{
+    m_parallelJobs = qMax(1, jobs);
+}
+
+int SxFilter::parallelJobs() const
+{
+    return m_parallelJobs;
+}
+
 void SxFilter::setLastWarning(QString error)
 {
     m_lastWarning = error;
@@ -30,6 +30,8 @@
 #define ACTIVEFILTER_H
 
 #include <QMap>
+#include <QHash>
+#include <QMutex>
 #include <QString>
 #include <QObject>
 #include "sxmeta.h"
@@ -48,6 +50,7 @@ public:
     static bool isFilterSupported(const SxVolume* volume);
     static bool registerActiveFilter(sxc_filter_t* filter);
     static bool testFilterConfig(SxVolume* volume);
+    static void dropCachedContexts(const QString &volume = QString());
 
     QString uuid() const;
     QString shortname() const;
@@ -67,6 +70,8 @@ public:
     bool filemetaProcess(QString name, QString &newName, bool localToRemote, qint64 &size, SxMeta &fileMeta, SxMeta &volumeMeta);
     bool filemetaProcess(SxFile& file, bool localToRemote);
     void dataFinish(sxf_mode_t sxf_mode);
+    void setParallelJobs(int jobs);
+    int parallelJobs() const;
 
     void setLastWarning(QString error);
     QString lastWarning() const;
@@ -85,8 +90,19 @@ public:
 private:
     SxFilter(sxc_filter_t* filter, SxVolume* volume);
     const QString configDir() const;
+    QByteArray contextFingerprint() const;
+    void takeCachedContext();
+    void cacheContext();
 private:
+    struct CachedContext {
+        const sxc_filter_t *filter;
+        QString volume;
+        QByteArray fingerprint;
+        void *ctx;
+    };
     static QMap<QString, sxc_filter_t*> m_registeredFilters;
+    static QHash<QString, CachedContext> m_cachedContexts;
+    static QMutex m_cacheMutex;
     const sxc_filter_t* m_filter;
     void *m_ctx;
     QString m_lastWarning;
@@ -95,6 +111,7 @@ private:
     SxVolume* m_volume;
     bool m_needFinish;
     sxf_mode_t m_sxf_mode;
+    int m_parallelJobs;
 };
 
 namespace ActiveFilterUtils
@@ -32,6 +32,7 @@
 #include <QString>
 #include "sxfilter.h"
 #include <QFuture>
+#include <QtConcurrent>
 #include "sxlog.h"
 
 int (*filter_get_input)(sxc_input_t type, const char* prompt, char *in, int insize) = 0;
@@ -119,6 +120,25 @@ int sxc_meta_setval(sxc_meta_t *meta, const char *key, const void *value, unsign
     return 0;
 }
 
+unsigned int sxc_filter_parallel_jobs(const sxf_handle_t *handle)
+{
+    const SxFilter *filter = static_cast<const SxFilter*>(handle);
+    if (!filter)
+        return 1;
+    return static_cast<unsigned int>(filter->parallelJobs());
+}
+
+void sxc_filter_parallel_run(const sxf_handle_t *handle, void (*job)(void *arg, unsigned int index), void *arg, unsigned int count)
+{
+    Q_UNUSED(handle);
+    QVector<unsigned int> jobs(static_cast<int>(count));
+    for (unsigned int i=0; i<count; i++)
+        jobs[static_cast<int>(i)] = i;
+    QtConcurrent::blockingMap(jobs, [job, arg](unsigned int index) {
+        job(arg, index);
+    });
+}
+
 uint64_t sxc_file_get_size(const sxc_file_t *file)
 {
     return file->size;
@@ -122,6 +122,8 @@ int sxc_filter_msg(const sxf_handle_t *handle, int level, const char *format, ..
 int sxc_filter_get_input(const sxf_handle_t *h, sxc_input_t type, const char *prompt, const char *def, char *in, unsigned int insize);
 int sxc_meta_getval(sxc_meta_t *meta, const char *key, const void **value, unsigned int *value_len);
 int sxc_meta_setval(sxc_meta_t *meta, const char *key, const void *value, unsigned int value_len);
+unsigned int sxc_filter_parallel_jobs(const sxf_handle_t *handle);
+void sxc_filter_parallel_run(const sxf_handle_t *handle, void (*job)(void *arg, unsigned int index), void *arg, unsigned int count);
 
 #ifdef __cplusplus
 } /* extern "C" */
@@ -65,6 +65,8 @@
 #define MAC_SIZE 32
 #define SALT_SIZE 16
 #define FP_SIZE (SALT_SIZE + KEY_SIZE)
+#define MAX_PARALLEL_JOBS 64
+#define MAX_PARALLEL_BLOCKS 256
 
 #ifdef HMAC_UPDATE_RETURNS_INT
 #define hmac_init_ex HMAC_Init_ex
@@ -83,6 +85,13 @@
 #define F_OK 0
 #endif
 
+/* private cipher and MAC contexts of a thread processing a range of blocks */
+struct aes256_worker {
+    EVP_CIPHER_CTX cctx;
+    HMAC_CTX hmac;
+    int err, decrypt_err;
+};
+
 struct aes256_ctx {
     EVP_CIPHER_CTX ectx, dctx;
     HMAC_CTX ivhash;
@@ -96,6 +105,8 @@ struct aes256_ctx {
     char *cfgdir;
     int decrypt_err;
     sxf_mode_t crypto_inited;
+    struct aes256_worker *workers;
+    unsigned int nworkers;
 };
 
 
@@ -247,6 +258,23 @@ static int keyfp(const sxf_handle_t *handle, const unsigned char *key, unsigned
     return -1;
 }
 
+static void workers_free(struct aes256_ctx *actx)
+{
+    unsigned int i;
+
+    if(!actx->workers)
+	return;
+    for(i = 0; i < actx->nworkers; i++) {
+	EVP_CIPHER_CTX_cleanup(&actx->workers[i].cctx);
+	HMAC_CTX_cleanup(&actx->workers[i].hmac);
+    }
+    memset(actx->workers, 0, actx->nworkers * sizeof(struct aes256_worker));
+    munlock(actx->workers, actx->nworkers * sizeof(struct aes256_worker));
+    free(actx->workers);
+    actx->workers = NULL;
+    actx->nworkers = 0;
+}
+
 static int aes256_shutdown(const sxf_handle_t *handle, void *ctx)
 {
     (void)handle;
@@ -255,6 +283,7 @@ static int aes256_shutdown(const sxf_handle_t *handle, void *ctx)
     if(!actx)
 	return 0;
 
+    workers_free(actx);
     free(actx->keyfile);
     free(actx->cfgdir);
     memset(actx, 0, sizeof(struct aes256_ctx));
@@ -486,6 +515,7 @@ static int data_prepare(const sxf_handle_t *handle, void **ctx, const char *file
     actx = (struct aes256_ctx*)*ctx;
 
     if(actx->crypto_inited) {
+	workers_free(actx);
 	HMAC_CTX_cleanup(&actx->hmac);
 	HMAC_CTX_cleanup(&actx->ivhash);
 	memset(actx->key, 0, sizeof(actx->key));
@@ -555,11 +585,261 @@ static int hmac_compare(const unsigned char *hmac1, const unsigned char *hmac2,
 }
 
 
+/* derives the IV of the next filter block from the data and the IV of the previous block */
+static int derive_iv(const sxf_handle_t *handle, struct aes256_ctx *actx, const unsigned char *in, unsigned int inlen, unsigned char *iv)
+{
+    unsigned char mac[EVP_MAX_MD_SIZE];
+    unsigned int ivlen;
+
+    if (hmac_init_ex(&actx->ivhash, NULL, 0, NULL, NULL) != 1) {
+        ERROR("hmac_init_ex failed(1)");
+        return -1;
+    }
+    if (hmac_update(&actx->ivhash, actx->ivmac, sizeof(actx->ivmac)) != 1 ||
+        hmac_update(&actx->ivhash, in, inlen) != 1) {
+        ERROR("EVP_DigestUpdate failed");
+        return -1;
+    }
+    if (hmac_final(&actx->ivhash, mac, &ivlen) != 1) {
+        ERROR("DigestFinal_ex failed");
+        return -1;
+    }
+    if (ivlen < IV_SIZE) {
+        ERROR("Wrong digest size: %d", ivlen);
+        return -1;
+    }
+    memcpy(actx->ivmac, mac, ivlen);
+    memcpy(iv, mac, IV_SIZE);
+    return 0;
+}
+
+/* encrypts one filter block: IV | AES-256-CBC(data) | MAC, the IV must be
+ * already stored at the beginning of the output */
+static int encrypt_data(const sxf_handle_t *handle, EVP_CIPHER_CTX *ectx, HMAC_CTX *hmac, const unsigned char *in, unsigned int inlen, unsigned char *out, unsigned int *outlen)
+{
+    unsigned char mac[EVP_MAX_MD_SIZE];
+    unsigned int maclen, bytes;
+    int final;
+
+    if(!EVP_EncryptInit_ex(ectx, NULL, NULL, NULL, out)) {
+        ERROR("EVP_EncryptInit_ex failed");
+        return -1;
+    }
+    if(!EVP_EncryptUpdate(ectx, out + IV_SIZE, (int *) &bytes, in, inlen)) {
+        ERROR("EVP_EncryptUpdate failed");
+        return -1;
+    }
+    bytes += IV_SIZE;
+    if(!EVP_EncryptFinal_ex(ectx, out + bytes, &final)) {
+        ERROR("EVP_EncryptFinal_ex failed");
+        return -1;
+    }
+    bytes += final;
+    if (hmac_init_ex(hmac, NULL, 0, NULL, NULL) != 1) {
+        ERROR("hmac_init_ex failed");
+        return -1;
+    }
+    if (hmac_update(hmac, out, bytes) != 1) {
+        ERROR("hmac_update failed");
+        return -1;
+    }
+    if (hmac_final(hmac, mac, &maclen) != 1) {
+        ERROR("hmac_final failed");
+        return -1;
+    }
+    maclen /= 2;
+    if (maclen != MAC_SIZE) {
+        ERROR("Bad MAC size: %d", maclen);
+        return -1;
+    }
+    memcpy(out + bytes, mac, maclen);
+    *outlen = bytes + maclen;
+    return 0;
+}
+
+static int decrypt_data(const sxf_handle_t *handle, EVP_CIPHER_CTX *dctx, HMAC_CTX *hmac, const unsigned char *in, unsigned int inlen, unsigned char *out, unsigned int *outlen, int *decrypt_err)
+{
+    unsigned char mac[EVP_MAX_MD_SIZE];
+    unsigned int maclen, bytes;
+    int final;
+
+    if (hmac_init_ex(hmac, NULL, 0, NULL, NULL) != 1) {
+        ERROR("hmac_init_ex failed");
+        return -1;
+    }
+    if (inlen < IV_SIZE + MAC_SIZE) {
+        ERROR("Incomplete data: %d bytes", inlen);
+        return -1;
+    }
+    inlen -= MAC_SIZE;
+    if (hmac_update(hmac, in, inlen) != 1) {
+        ERROR("hmac_update failed");
+        return -1;
+    }
+    if (hmac_final(hmac, mac, &maclen) != 1) {
+        ERROR("hmac_final failed");
+        return -1;
+    }
+    maclen /= 2;
+    if (maclen != MAC_SIZE) {
+        ERROR("Bad HMAC size: %d bytes", maclen);
+        return -1;
+    }
+    if (hmac_compare(in + inlen, mac, maclen)) {
+        ERROR("HMAC mismatch (Invalid password/key file or broken data)");
+        *decrypt_err = 1;
+        return -1;
+    }
+    if(!EVP_DecryptInit_ex(dctx, NULL, NULL, NULL, in)) {
+        ERROR("EVP_DecryptInit_ex failed");
+        return -1;
+    }
+    if(!EVP_DecryptUpdate(dctx, out, (int *) &bytes, in + IV_SIZE, inlen - IV_SIZE)) {
+        ERROR("EVP_DecryptUpdate failed");
+        return -1;
+    }
+    if(!EVP_DecryptFinal_ex(dctx, out + bytes, &final)) {
+        ERROR("EVP_DecryptFinal_ex failed (Invalid password/key file or broken data)");
+        *decrypt_err = 1;
+        return -1;
+    }
+    *outlen = bytes + final;
+    return 0;
+}
+
+static int encrypt_block(const sxf_handle_t *handle, struct aes256_ctx *actx, const unsigned char *in, unsigned int inlen, unsigned char *out, unsigned int *outlen)
+{
+    if(derive_iv(handle, actx, in, inlen, out))
+        return -1;
+    return encrypt_data(handle, &actx->ectx, &actx->hmac, in, inlen, out, outlen);
+}
+
+static int decrypt_block(const sxf_handle_t *handle, struct aes256_ctx *actx, const unsigned char *in, unsigned int inlen, unsigned char *out, unsigned int *outlen)
+{
+    return decrypt_data(handle, &actx->dctx, &actx->hmac, in, inlen, out, outlen, &actx->decrypt_err);
+}
+
+static int workers_init(struct aes256_ctx *actx, unsigned int count, sxf_mode_t mode)
+{
+    unsigned int i;
+
+    if(actx->workers)
+        return 0;
+    actx->workers = (struct aes256_worker *) calloc(count, sizeof(struct aes256_worker));
+    if(!actx->workers)
+        return -1;
+    mlock(actx->workers, count * sizeof(struct aes256_worker));
+    actx->nworkers = count;
+    for(i = 0; i < count; i++) {
+        EVP_CIPHER_CTX_init(&actx->workers[i].cctx);
+        HMAC_CTX_init(&actx->workers[i].hmac);
+    }
+    for(i = 0; i < count; i++) {
+        if(!EVP_CIPHER_CTX_copy(&actx->workers[i].cctx, mode == SXF_MODE_UPLOAD ? &actx->ectx : &actx->dctx) ||
+           !HMAC_CTX_copy(&actx->workers[i].hmac, &actx->hmac)) {
+            workers_free(actx);
+            return -1;
+        }
+    }
+    return 0;
+}
+
+struct aes256_batch {
+    struct aes256_ctx *actx;
+    sxf_mode_t mode;
+    const unsigned char *in;
+    unsigned char *out;
+    unsigned int bsize, nblocks, njobs;
+    unsigned int outlen[MAX_PARALLEL_BLOCKS];
+};
+
+/* runs on a host thread, messages are only logged since the handle is not thread safe */
+static void batch_job(void *arg, unsigned int index)
+{
+    struct aes256_batch *batch = (struct aes256_batch *) arg;
+    struct aes256_worker *w = &batch->actx->workers[index];
+    unsigned int i, first = index * batch->nblocks / batch->njobs, last = (index + 1) * batch->nblocks / batch->njobs;
+    const sxf_handle_t *handle = NULL;
+
+    w->err = 0;
+    for(i = first; i < last && !w->err; i++) {
+        const unsigned char *src = batch->in + (size_t) i * batch->bsize;
+        unsigned char *dst = batch->out + (size_t) i * sizeof(batch->actx->blk);
+        if(batch->mode == SXF_MODE_UPLOAD)
+            w->err = encrypt_data(handle, &w->cctx, &w->hmac, src, batch->bsize, dst, &batch->outlen[i]);
+        else
+            w->err = decrypt_data(handle, &w->cctx, &w->hmac, src, batch->bsize, dst, &batch->outlen[i], &w->decrypt_err);
+    }
+}
+
+/* processes whole blocks on the host's threads; only the IV chain is computed
+ * serially, so the output is identical to processing the blocks one by one.
+ * Returns 1 if the blocks were processed, 0 if the caller should do it itself */
+static int parallel_blocks(const sxf_handle_t *handle, struct aes256_ctx *actx, const unsigned char *in, unsigned int nblocks, unsigned int bsize, unsigned char *out, size_t *outlen, sxf_mode_t mode)
+{
+    struct aes256_batch *batch;
+    unsigned int i, njobs = sxc_filter_parallel_jobs(handle);
+    int ret = -1, failed = 0;
+    size_t produced = 0;
+
+    if(njobs > MAX_PARALLEL_JOBS)
+        njobs = MAX_PARALLEL_JOBS;
+    if(actx->workers && njobs > actx->nworkers)
+        njobs = actx->nworkers;
+    if(njobs > nblocks)
+        njobs = nblocks;
+    if(njobs < 2 || workers_init(actx, njobs, mode))
+        return 0;
+    if(!(batch = (struct aes256_batch *) malloc(sizeof(*batch))))
+        return 0;
+
+    if(mode == SXF_MODE_UPLOAD) {
+        for(i = 0; i < nblocks; i++)
+            if(derive_iv(handle, actx, in + (size_t) i * bsize, bsize, out + (size_t) i * sizeof(actx->blk)))
+                goto batch_err;
+    }
+    batch->actx = actx;
+    batch->mode = mode;
+    batch->in = in;
+    batch->out = out;
+    batch->bsize = bsize;
+    batch->nblocks = nblocks;
+    batch->njobs = njobs;
+    sxc_filter_parallel_run(handle, batch_job, batch, njobs);
+
+    for(i = 0; i < njobs; i++) {
+        if(actx->workers[i].decrypt_err)
+            actx->decrypt_err = 1;
+        if(actx->workers[i].err)
+            failed = 1;
+    }
+    if(failed) {
+        if(actx->decrypt_err)
+            ERROR("HMAC mismatch (Invalid password/key file or broken data)");
+        else
+            ERROR("Failed to process data blocks");
+        goto batch_err;
+    }
+    /* decrypted blocks may be shorter than their slot, close the gaps */
+    for(i = 0; i < nblocks; i++) {
+        unsigned char *src = out + (size_t) i * sizeof(actx->blk);
+        if(src != out + produced)
+            memmove(out + produced, src, batch->outlen[i]);
+        produced += batch->outlen[i];
+    }
+    *outlen = produced;
+    ret = 1;
+batch_err:
+    free(batch);
+    return ret;
+}
+
 static ssize_t aes256_data_process(const sxf_handle_t *handle, void *ctx, const void *in, size_t insize, void *out, size_t outsize, sxf_mode_t mode, sxf_action_t *action)
 {
 	struct aes256_ctx *actx = (struct aes256_ctx*)ctx;
 	unsigned int bytes;
 	unsigned int bsize = mode == SXF_MODE_UPLOAD ? FILTER_BLOCK_SIZE : sizeof(actx->in);
+	size_t produced = 0;
 
     if(*action == SXF_ACTION_REPEAT && actx->data_out_left) {
 	if(actx->data_out_left > outsize) {
@@ -587,6 +867,48 @@ static ssize_t aes256_data_process(const sxf_handle_t *handle, void *ctx, const
     if(*action == SXF_ACTION_DATA_END)
 	actx->data_end = 1;
 
+    /* fast path: process as many whole blocks as fit in the output buffer
+     * directly between the caller's buffers, without staging them in the context */
+    if(!actx->inbytes) {
+        size_t nblocks = (insize - actx->data_in) / bsize;
+        if(nblocks > outsize / sizeof(actx->blk))
+            nblocks = outsize / sizeof(actx->blk);
+        if(nblocks > MAX_PARALLEL_BLOCKS)
+            nblocks = MAX_PARALLEL_BLOCKS;
+        if(nblocks > 1) {
+            int r = parallel_blocks(handle, actx, (const unsigned char *) in + actx->data_in, nblocks, bsize, out, &produced, mode);
+            if(r < 0)
+                return -1;
+            if(r)
+                actx->data_in += nblocks * bsize;
+        }
+    }
+    while(!actx->inbytes && insize - actx->data_in >= bsize && outsize - produced >= sizeof(actx->blk)) {
+        const unsigned char *src = (const unsigned char *) in + actx->data_in;
+        unsigned char *dst = (unsigned char *) out + produced;
+        if(mode == SXF_MODE_UPLOAD) {
+            if(encrypt_block(handle, actx, src, bsize, dst, &bytes))
+                return -1;
+        } else {
+            if(decrypt_block(handle, actx, src, bsize, dst, &bytes))
+                return -1;
+        }
+        actx->data_in += bsize;
+        produced += bytes;
+    }
+    if(produced) {
+	if(actx->data_in == insize) {
+	    if(!actx->data_end)
+		*action = SXF_ACTION_NORMAL;
+	    else
+		*action = SXF_ACTION_DATA_END;
+	    actx->data_in = 0;
+	} else {
+	    *action = SXF_ACTION_REPEAT;
+	}
+	return produced;
+    }
+
     if(insize - actx->data_in >= bsize - actx->inbytes) {
 	bytes = bsize - actx->inbytes;
 	memcpy(&actx->in[actx->inbytes], (unsigned char *) in + actx->data_in, bytes);
@@ -600,108 +922,13 @@ static ssize_t aes256_data_process(const sxf_handle_t *handle, void *ctx, const
     }
 
     if(actx->inbytes == bsize || (actx->inbytes && (*action == SXF_ACTION_DATA_END || actx->data_end))) {
-        unsigned char mac[EVP_MAX_MD_SIZE], ivaes[IV_SIZE];
-        unsigned int maclen;
         int final;
 	if(mode == SXF_MODE_UPLOAD) {
-            unsigned int ivlen;
-            if (hmac_init_ex(&actx->ivhash, NULL, 0, NULL, NULL) != 1) {
-                ERROR("hmac_init_ex failed(1)");
-                return -1;
-            }
-            if (hmac_update(&actx->ivhash, actx->ivmac, sizeof(actx->ivmac)) != 1 ||
-                hmac_update(&actx->ivhash, actx->in, actx->inbytes) != 1) {
-                ERROR("EVP_DigestUpdate failed");
-                return -1;
-            }
-            if (hmac_final(&actx->ivhash, mac, &ivlen) != 1) {
-                ERROR("DigestFinal_ex failed");
-                return -1;
-            }
-            if (ivlen < IV_SIZE) {
-                ERROR("Wrong digest size: %d", ivlen);
-                return -1;
-            }
-            /* calculate iv of next block using iv of previous block */
-            memcpy(actx->ivmac, mac, ivlen);
-            memcpy(ivaes, mac, IV_SIZE);
-            memcpy(actx->blk, ivaes, IV_SIZE);
-	    if(!EVP_EncryptInit_ex(&actx->ectx, NULL, NULL, NULL, ivaes)) {
-		ERROR("EVP_EncryptInit_ex failed");
-		return -1;
-	    }
-	    if(!EVP_EncryptUpdate(&actx->ectx, actx->blk + IV_SIZE, (int *) &actx->blkbytes, actx->in, actx->inbytes)) {
-		ERROR("EVP_EncryptUpdate failed");
-		return -1;
-	    }
-            actx->blkbytes += IV_SIZE;
-	    if(!EVP_EncryptFinal_ex(&actx->ectx, actx->blk + actx->blkbytes, &final)) {
-		ERROR("EVP_EncryptFinal_ex failed");
+	    if(encrypt_block(handle, actx, actx->in, actx->inbytes, actx->blk, &actx->blkbytes))
 		return -1;
-	    }
-            if (hmac_init_ex(&actx->hmac, NULL, 0, NULL, NULL) != 1) {
-                ERROR("hmac_init_ex failed");
-                return -1;
-            }
-            actx->blkbytes += final;
-            if (hmac_update(&actx->hmac, actx->blk, actx->blkbytes) != 1) {
-                ERROR("hmac_update failed");
-                return -1;
-            }
-            if (hmac_final(&actx->hmac, mac, &maclen) != 1) {
-                ERROR("hmac_final failed");
-                return -1;
-            }
-            maclen /= 2;
-            if (maclen != MAC_SIZE) {
-                ERROR("Bad MAC size: %d", maclen);
-                return -1;
-            }
-            memcpy(actx->blk + actx->blkbytes, mac, maclen);
-            actx->blkbytes += maclen;
 	} else {
-            if (hmac_init_ex(&actx->hmac, NULL, 0, NULL, NULL) != 1) {
-                ERROR("hmac_init_ex failed");
-                return -1;
-            }
-            if (actx->inbytes < IV_SIZE + MAC_SIZE) {
-                ERROR("Incomplete data: %d bytes", actx->inbytes);
-                return -1;
-            }
-            actx->inbytes -= MAC_SIZE;
-            if (hmac_update(&actx->hmac, actx->in, actx->inbytes) != 1) {
-                ERROR("hmac_update failed");
-                return -1;
-            }
-            if (hmac_final(&actx->hmac, mac, &maclen) != 1) {
-                ERROR("hmac_final failed");
-                return -1;
-            }
-            maclen /= 2;
-            if (maclen != MAC_SIZE) {
-                ERROR("Bad HMAC size: %d bytes", maclen);
-                return -1;
-            }
-            if (hmac_compare(actx->in + actx->inbytes, mac, maclen)) {
-                ERROR("HMAC mismatch (Invalid password/key file or broken data)");
-		actx->decrypt_err = 1;
-                return -1;
-            }
-            memcpy(ivaes, actx->in, IV_SIZE);
-	    if(!EVP_DecryptInit_ex(&actx->dctx, NULL, NULL, NULL, ivaes)) {
-		ERROR("EVP_DecryptInit_ex failed");
-		return -1;
-	    }
-	    if(!EVP_DecryptUpdate(&actx->dctx, actx->blk, (int *) &actx->blkbytes, actx->in + IV_SIZE, actx->inbytes - IV_SIZE)) {
-		ERROR("EVP_DecryptUpdate failed");
-		return -1;
-	    }
-	    if(!EVP_DecryptFinal_ex(&actx->dctx, actx->blk + actx->blkbytes, &final)) {
-		ERROR("EVP_DecryptFinal_ex failed (Invalid password/key file or broken data)");
-		actx->decrypt_err = 1;
+	    if(decrypt_block(handle, actx, actx->in, actx->inbytes, actx->blk, &actx->blkbytes))
 		return -1;
-	    }
-            actx->blkbytes += final;
 	}
 	actx->inbytes = 0;
 
@@ -742,6 +969,7 @@ static int aes256_data_finish(const sxf_handle_t *handle, void **ctx, sxf_mode_t
     if(!actx || !actx->crypto_inited)
 	return 0;
 
+    workers_free(actx);
     HMAC_CTX_cleanup(&actx->hmac);
     HMAC_CTX_cleanup(&actx->ivhash);
     memset(actx->key, 0, sizeof(actx->key));
@@ -0,0 +1,216 @@
+/*
+ *  Copyright (C) 2012-2016 Skylable Ltd. <info-copyright@skylable.com>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License version 2 as
+ *  published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA.
+ *
+ *  Special exception for linking this software with OpenSSL:
+ *
+ *  In addition, as a special exception, Skylable Ltd. gives permission to
+ *  link the code of this program with the OpenSSL library and distribute
+ *  linked combinations including the two. You must obey the GNU General
+ *  Public License in all respects for all of the code used other than
+ *  OpenSSL. You may extend this exception to your version of the program,
+ *  but you are not obligated to do so. If you do not wish to do so, delete
+ *  this exception statement from your version.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <zlib.h>
+
+#include "fake_sx.h"
+#include "filter_zcomp.h"
+
+#define ERROR(...)	sxc_filter_msg(handle, SX_LOG_ERR, __VA_ARGS__)
+
+/* the volume configuration is a single byte holding the compression level */
+#define DEFAULT_LEVEL 6
+
+struct zcomp_ctx {
+    z_stream strm;
+    int initialized;
+    int data_end;
+    int in_progress;
+    sxf_mode_t mode;
+};
+
+static int zcomp_init(const sxf_handle_t *handle, void **ctx)
+{
+    (void)handle;
+    *ctx = NULL;
+    return 0;
+}
+
+static void zcomp_end(struct zcomp_ctx *zctx)
+{
+    if(zctx->initialized) {
+	if(zctx->mode == SXF_MODE_UPLOAD)
+	    deflateEnd(&zctx->strm);
+	else
+	    inflateEnd(&zctx->strm);
+	zctx->initialized = 0;
+    }
+}
+
+static int zcomp_shutdown(const sxf_handle_t *handle, void *ctx)
+{
+    (void)handle;
+    if(ctx) {
+	zcomp_end((struct zcomp_ctx*)ctx);
+	free(ctx);
+    }
+    return 0;
+}
+
+static int zcomp_configure(const sxf_handle_t *handle, const char *cfgstr, const char *cfgdir, void **cfgdata, unsigned int *cfgdata_len)
+{
+    unsigned char *level;
+    int value = DEFAULT_LEVEL;
+    (void)cfgdir;
+
+    if(cfgstr && *cfgstr) {
+	if(strncmp(cfgstr, "level=", 6) || sscanf(cfgstr + 6, "%d", &value) != 1 || value < 1 || value > 9) {
+	    ERROR("Invalid configuration '%s', expected level=N with N between 1 and 9", cfgstr);
+	    return -1;
+	}
+    }
+    level = (unsigned char*)malloc(1);
+    if(!level) {
+	ERROR("OOM");
+	return -1;
+    }
+    *level = (unsigned char)value;
+    *cfgdata = level;
+    *cfgdata_len = 1;
+    return 0;
+}
+
+static int zcomp_data_prepare(const sxf_handle_t *handle, void **ctx, const char *filename, const char *cfgdir, const void *cfgdata, unsigned int cfgdata_len, sxc_meta_t *custom_meta, sxf_mode_t mode)
+{
+    struct zcomp_ctx *zctx = (struct zcomp_ctx*)*ctx;
+    int level = DEFAULT_LEVEL, ret;
+    (void)filename;
+    (void)cfgdir;
+    (void)custom_meta;
+
+    if(cfgdata && cfgdata_len == 1)
+	level = *(const unsigned char*)cfgdata;
+    if(level < 1 || level > 9) {
+	ERROR("Invalid compression level %d", level);
+	return -1;
+    }
+    if(!zctx) {
+	zctx = (struct zcomp_ctx*)calloc(1, sizeof(struct zcomp_ctx));
+	if(!zctx) {
+	    ERROR("OOM");
+	    return -1;
+	}
+	*ctx = zctx;
+    }
+    zcomp_end(zctx);
+    memset(&zctx->strm, 0, sizeof(zctx->strm));
+    zctx->mode = mode;
+    zctx->data_end = 0;
+    zctx->in_progress = 0;
+    if(mode == SXF_MODE_UPLOAD)
+	ret = deflateInit(&zctx->strm, level);
+    else
+	ret = inflateInit(&zctx->strm);
+    if(ret != Z_OK) {
+	ERROR("Failed to initialize zlib: %d", ret);
+	return -1;
+    }
+    zctx->initialized = 1;
+    return 0;
+}
+
+/* The same input is passed again for as long as SXF_ACTION_REPEAT is returned,
+ * zlib keeps track of how much of it was already consumed */
+static ssize_t zcomp_data_process(const sxf_handle_t *handle, void *ctx, const void *in, size_t insize, void *out, size_t outsize, sxf_mode_t mode, sxf_action_t *action)
+{
+    struct zcomp_ctx *zctx = (struct zcomp_ctx*)ctx;
+    int ret;
+    size_t produced;
+
+    if(!zctx || !zctx->initialized) {
+	ERROR("Filter not prepared");
+	return -1;
+    }
+    if(*action != SXF_ACTION_REPEAT || !zctx->in_progress) {
+	if(*action == SXF_ACTION_DATA_END)
+	    zctx->data_end = 1;
+	zctx->strm.next_in = (Bytef*)in;
+	zctx->strm.avail_in = (uInt)insize;
+	zctx->in_progress = 1;
+    }
+    zctx->strm.next_out = (Bytef*)out;
+    zctx->strm.avail_out = (uInt)outsize;
+
+    if(mode == SXF_MODE_UPLOAD)
+	ret = deflate(&zctx->strm, zctx->data_end ? Z_FINISH : Z_NO_FLUSH);
+    else
+	ret = inflate(&zctx->strm, Z_NO_FLUSH);
+    if(ret != Z_OK && ret != Z_STREAM_END && ret != Z_BUF_ERROR) {
+	ERROR("zlib %s failed: %s", mode == SXF_MODE_UPLOAD ? "deflate" : "inflate", zctx->strm.msg ? zctx->strm.msg : "unknown error");
+	return -1;
+    }
+    produced = outsize - zctx->strm.avail_out;
+
+    if(ret == Z_STREAM_END || (zctx->strm.avail_in == 0 && zctx->strm.avail_out != 0 && !(zctx->data_end && mode == SXF_MODE_UPLOAD))) {
+	if(ret != Z_STREAM_END && zctx->data_end) {
+	    ERROR("Compressed data is truncated");
+	    return -1;
+	}
+	zctx->in_progress = 0;
+	*action = zctx->data_end ? SXF_ACTION_DATA_END : SXF_ACTION_NORMAL;
+    } else {
+	*action = SXF_ACTION_REPEAT;
+    }
+    return (ssize_t)produced;
+}
+
+static int zcomp_data_finish(const sxf_handle_t *handle, void **ctx, sxf_mode_t mode)
+{
+    (void)handle;
+    (void)mode;
+    if(*ctx) {
+	zcomp_end((struct zcomp_ctx*)*ctx);
+	free(*ctx);
+	*ctx = NULL;
+    }
+    return 0;
+}
+
+sxc_filter_t sxc_filter_zcomp={
+    SXF_ABI_VERSION,
+    "zcomp",
+    "Compress files using zlib",
+    "The filter automatically compresses and decompresses all data using the zlib library.",
+    "\n\tlevel=N (set compression level: 1-9)",
+    "d5dcaa0f-5ca0-4a98-9576-401cd4fd4bbb",
+    SXF_TYPE_COMPRESS,
+    {1, 5},
+    zcomp_init,
+    zcomp_shutdown,
+    zcomp_configure,
+    zcomp_data_prepare,
+    zcomp_data_process,
+    zcomp_data_finish,
+    NULL,
+    NULL,
+    NULL,
+    NULL,
+    NULL
+};
@@ -0,0 +1,134 @@
+/*
+ *  Copyright (C) 2012-2016 Skylable Ltd. <info-copyright@skylable.com>
+ *
+ *  This program is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public License
+ *  as published by the Free Software Foundation; either version 2
+ *  of the License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA.
+ *
+ *  Special exception for linking this software with OpenSSL:
+ *
+ *  In addition, as a special exception, Skylable Ltd. gives permission to
+ *  link the code of this program with the OpenSSL library and distribute
+ *  linked combinations including the two. You must obey the GNU General
+ *  Public License in all respects for all of the code used other than
+ *  OpenSSL. You may extend this exception to your version of the program,
+ *  but you are not obligated to do so. If you do not wish to do so, delete
+ *  this exception statement from your version.
+ */
+
+#include "sxfilterstream.h"
+#include "sxlog.h"
+#include <cstring>
+
+SxFilterStream::SxFilterStream(SxFilter *filter, sxf_mode_t mode)
+    : mOutput(sOutputBufferSize)
+{
+    mFilter = filter;
+    mMode = mode;
+}
+
+bool SxFilterStream::process(const char *data, qint64 size, bool last, std::function<bool (const char *, qint64)> output)
+{
+    sxf_action_t action = last ? SXF_ACTION_DATA_END : SXF_ACTION_NORMAL;
+    do {
+        qint64 produced = mFilter->dataProcess(const_cast<char*>(data), size, mOutput.data(), mOutput.size(), mMode, &action);
+        if (produced < 0)
+            return false;
+        if (produced > 0 && !output(mOutput.constData(), produced))
+            return false;
+    }
+    while (action == SXF_ACTION_REPEAT);
+    return true;
+}
+
+SxFilterSource::SxFilterSource(SxVolume *volume, const QString &remotePath, const QString &localPath)
+    : mInput(localPath), mInputBuffer(sInputBufferSize)
+{
+    mVolume = volume;
+    mRemotePath = remotePath;
+    mCustomMeta = volume->customMeta();
+    mPendingPos = 0;
+    mPos = 0;
+    mFinished = false;
+}
+
+bool SxFilterSource::open()
+{
+    mStream.reset();
+    mFilter.reset(SxFilter::getActiveFilter(mVolume));
+    if (!mFilter || !mFilter->dataProcess())
+        return false;
+    SxMeta customMeta = mCustomMeta;
+    if (mFilter->dataPrepare() && !mFilter->dataPrepare(mRemotePath, customMeta, SXF_MODE_UPLOAD)) {
+        logWarning("filter data prepare failed: " + mFilter->lastWarning());
+        return false;
+    }
+    if (!mInput.isOpen() && !mInput.open(QIODevice::ReadOnly)) {
+        logWarning("unable to open file" + mInput.fileName());
+        return false;
+    }
+    mStream.reset(new SxFilterStream(mFilter.get(), SXF_MODE_UPLOAD));
+    mPending.clear();
+    mPendingPos = 0;
+    mPos = 0;
+    mFinished = false;
+    return true;
+}
+
+bool SxFilterSource::rewind()
+{
+    if (!mInput.isOpen() || !mInput.seek(0))
+        return false;
+    return open();
+}
+
+qint64 SxFilterSource::read(char *data, qint64 maxSize)
+{
+    if (!mStream)
+        return -1;
+    while (mPending.size() - mPendingPos < maxSize && !mFinished) {
+        if (mPendingPos > 0) {
+            mPending.remove(0, mPendingPos);
+            mPendingPos = 0;
+        }
+        qint64 bytes = mInput.read(mInputBuffer.data(), mInputBuffer.size());
+        if (bytes < 0) {
+            logWarning("unable to read file" + mInput.fileName());
+            return -1;
+        }
+        mFinished = mInput.atEnd();
+        bool ok = mStream->process(mInputBuffer.constData(), bytes, mFinished, [this](const char *out, qint64 size)->bool {
+            mPending.append(out, static_cast<int>(size));
+            return true;
+        });
+        if (!ok) {
+            logWarning("filter data process failed: " + mFilter->lastWarning());
+            return -1;
+        }
+    }
+    qint64 bytes = qMin(maxSize, static_cast<qint64>(mPending.size() - mPendingPos));
+    memcpy(data, mPending.constData() + mPendingPos, static_cast<size_t>(bytes));
+    mPendingPos += static_cast<int>(bytes);
+    mPos += bytes;
+    return bytes;
+}
+
+qint64 SxFilterSource::pos() const
+{
+    return mPos;
+}
+
+QString SxFilterSource::localPath() const
+{
+    return mInput.fileName();
+}
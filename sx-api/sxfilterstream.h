@@ -0,0 +1,81 @@
+/*
+ *  Copyright (C) 2012-2016 Skylable Ltd. <info-copyright@skylable.com>
+ *
+ *  This program is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public License
+ *  as published by the Free Software Foundation; either version 2
+ *  of the License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA.
+ *
+ *  Special exception for linking this software with OpenSSL:
+ *
+ *  In addition, as a special exception, Skylable Ltd. gives permission to
+ *  link the code of this program with the OpenSSL library and distribute
+ *  linked combinations including the two. You must obey the GNU General
+ *  Public License in all respects for all of the code used other than
+ *  OpenSSL. You may extend this exception to your version of the program,
+ *  but you are not obligated to do so. If you do not wish to do so, delete
+ *  this exception statement from your version.
+ */
+
+#ifndef SXFILTERSTREAM_H
+#define SXFILTERSTREAM_H
+
+#include <QByteArray>
+#include <QFile>
+#include <functional>
+#include <memory>
+#include "sxfilter.h"
+#include "sxbufferpool.h"
+
+/* Feeds data through the filter data_process callback and hands the output
+ * to the given function as soon as it is produced */
+class SxFilterStream
+{
+public:
+    SxFilterStream(SxFilter *filter, sxf_mode_t mode);
+    bool process(const char *data, qint64 size, bool last, std::function<bool(const char*, qint64)> output);
+
+private:
+    SxFilter *mFilter;
+    sxf_mode_t mMode;
+    SxPooledBuffer mOutput;
+    static const int sOutputBufferSize = 1024*1024;
+};
+
+/* Sequential reader returning the filtered content of a local file, used to
+ * upload to filtered volumes without writing the processed data to disk */
+class SxFilterSource
+{
+public:
+    SxFilterSource(SxVolume *volume, const QString &remotePath, const QString &localPath);
+    bool open();
+    bool rewind();
+    qint64 read(char *data, qint64 maxSize);
+    qint64 pos() const;
+    QString localPath() const;
+
+private:
+    SxVolume *mVolume;
+    QString mRemotePath;
+    SxMeta mCustomMeta;
+    QFile mInput;
+    std::unique_ptr<SxFilter> mFilter;
+    std::unique_ptr<SxFilterStream> mStream;
+    SxPooledBuffer mInputBuffer;
+    QByteArray mPending;
+    int mPendingPos;
+    qint64 mPos;
+    bool mFinished;
+    static const int sInputBufferSize = 1024*1024;
+};
+
+#endif // SXFILTERSTREAM_H
@@ -0,0 +1,77 @@
+/*
+ *  Copyright (C) 2012-2016 Skylable Ltd. <info-copyright@skylable.com>
+ *
+ *  This program is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public License
+ *  as published by the Free Software Foundation; either version 2
+ *  of the License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA.
+ *
+ *  Special exception for linking this software with OpenSSL:
+ *
+ *  In addition, as a special exception, Skylable Ltd. gives permission to
+ *  link the code of this program with the OpenSSL library and distribute
+ *  linked combinations including the two. You must obey the GNU General
+ *  Public License in all respects for all of the code used other than
+ *  OpenSSL. You may extend this exception to your version of the program,
+ *  but you are not obligated to do so. If you do not wish to do so, delete
+ *  this exception statement from your version.
+ */
+
+#include "sxinflightblocks.h"
+
+SxInflightBlocks &SxInflightBlocks::instance()
+{
+    static SxInflightBlocks sInstance;
+    return sInstance;
+}
+
+SxInflightBlocks::SxInflightBlocks()
+{
+}
+
+/* blocks are placed per volume, keys look like <volume>/<hash> */
+bool SxInflightBlocks::claim(const QString &volume, const QString &hash)
+{
+    QString key = volume + "/" + hash;
+    QMutexLocker locker(&mMutex);
+    if (mBlocks.contains(key))
+        return false;
+    mBlocks.insert(key, std::make_shared<Entry>(Entry{false, false}));
+    return true;
+}
+
+void SxInflightBlocks::release(const QString &volume, const QString &hash, bool sent)
+{
+    QMutexLocker locker(&mMutex);
+    std::shared_ptr<Entry> entry = mBlocks.take(volume + "/" + hash);
+    if (!entry)
+        return;
+    entry->done = true;
+    entry->sent = sent;
+    mReleased.wakeAll();
+}
+
+/* returns true once the upload holding the block has sent it, false if the block is not
+ * claimed, its PUT failed or the token was cancelled */
+bool SxInflightBlocks::wait(const QString &volume, const QString &hash, const SxCancelToken &token)
+{
+    QMutexLocker locker(&mMutex);
+    std::shared_ptr<Entry> entry = mBlocks.value(volume + "/" + hash);
+    if (!entry)
+        return false;
+    while (!entry->done) {
+        if (token.isCancelled())
+            return false;
+        mReleased.wait(&mMutex, sWaitSlice);
+    }
+    return entry->sent;
+}
@@ -0,0 +1,65 @@
+/*
+ *  Copyright (C) 2012-2016 Skylable Ltd. <info-copyright@skylable.com>
+ *
+ *  This program is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public License
+ *  as published by the Free Software Foundation; either version 2
+ *  of the License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA.
+ *
+ *  Special exception for linking this software with OpenSSL:
+ *
+ *  In addition, as a special exception, Skylable Ltd. gives permission to
+ *  link the code of this program with the OpenSSL library and distribute
+ *  linked combinations including the two. You must obey the GNU General
+ *  Public License in all respects for all of the code used other than
+ *  OpenSSL. You may extend this exception to your version of the program,
+ *  but you are not obligated to do so. If you do not wish to do so, delete
+ *  this exception statement from your version.
+ */
+
+#ifndef SXINFLIGHTBLOCKS_H
+#define SXINFLIGHTBLOCKS_H
+
+#include <QHash>
+#include <QMutex>
+#include <QString>
+#include <QWaitCondition>
+#include <memory>
+#include "sxcanceltoken.h"
+
+/* Process wide registry of the blocks being sent by the uploads in progress, so two files
+ * sharing a block don't send it twice when the initialization of both reported it missing.
+ * An upload claims the blocks it sends and releases them once the PUT is over, another one
+ * needing a claimed block waits for the release and sends it itself only if that PUT failed */
+class SxInflightBlocks
+{
+public:
+    static SxInflightBlocks& instance();
+    SxInflightBlocks(const SxInflightBlocks &) = delete;
+    SxInflightBlocks &operator= (const SxInflightBlocks &) = delete;
+    bool claim(const QString &volume, const QString &hash);
+    void release(const QString &volume, const QString &hash, bool sent);
+    bool wait(const QString &volume, const QString &hash, const SxCancelToken &token);
+
+private:
+    SxInflightBlocks();
+    struct Entry {
+        bool done;
+        bool sent;
+    };
+    static const int sWaitSlice = 200;
+    QMutex mMutex;
+    QWaitCondition mReleased;
+    QHash<QString, std::shared_ptr<Entry>> mBlocks;
+};
+
+#endif // SXINFLIGHTBLOCKS_H
@@ -55,3 +55,10 @@ void SxJob::waitInterval()
     loop.exec();
 }
 
+void SxJob::increaseInterval()
+{
+    mInterval = qMax(mInterval*2, mMinPollInterval);
+    if (mInterval > mMaxPollInterval)
+        mInterval = mMaxPollInterval;
+}
+
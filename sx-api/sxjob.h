@@ -44,6 +44,7 @@ public:
 
     SxJob();
     void waitInterval();
+    void increaseInterval();
 private:
     QString mRequestId;
     qint32 mMinPollInterval;
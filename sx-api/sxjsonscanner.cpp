@@ -0,0 +1,167 @@
+/*
+ *  Copyright (C) 2012-2016 Skylable Ltd. <info-copyright@skylable.com>
+ *
+ *  This program is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public License
+ *  as published by the Free Software Foundation; either version 2
+ *  of the License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA.
+ *
+ *  Special exception for linking this software with OpenSSL:
+ *
+ *  In addition, as a special exception, Skylable Ltd. gives permission to
+ *  link the code of this program with the OpenSSL library and distribute
+ *  linked combinations including the two. You must obey the GNU General
+ *  Public License in all respects for all of the code used other than
+ *  OpenSSL. You may extend this exception to your version of the program,
+ *  but you are not obligated to do so. If you do not wish to do so, delete
+ *  this exception statement from your version.
+ */
+
+#include "sxjsonscanner.h"
+
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <cstring>
+
+SxJsonScanner::SxJsonScanner(const QByteArray &data) : mData(data)
+{
+    mPos = 0;
+}
+
+void SxJsonScanner::skipWhitespace()
+{
+    while (mPos < mData.size()) {
+        char c = mData.at(mPos);
+        if (c != ' ' && c != '\t' && c != '\n' && c != '\r')
+            break;
+        mPos++;
+    }
+}
+
+bool SxJsonScanner::skipChar(char c)
+{
+    skipWhitespace();
+    if (mPos >= mData.size() || mData.at(mPos) != c)
+        return false;
+    mPos++;
+    return true;
+}
+
+bool SxJsonScanner::atChar(char c)
+{
+    skipWhitespace();
+    return mPos < mData.size() && mData.at(mPos) == c;
+}
+
+bool SxJsonScanner::skipString(bool *escaped)
+{
+    if (mPos >= mData.size() || mData.at(mPos) != '"')
+        return false;
+    const char *data = mData.constData();
+    const char *begin = data + mPos + 1;
+    const char *end = data + mData.size();
+    const char *p = begin;
+    forever {
+        const char *quote = static_cast<const char *>(memchr(p, '"', end - p));
+        if (!quote)
+            return false;
+        // the quote is escaped only if preceded by an odd number of backslashes
+        const char *b = quote;
+        while (b > begin && b[-1] == '\\')
+            b--;
+        p = quote;
+        if ((quote - b) % 2 == 0)
+            break;
+        p++;
+    }
+    if (escaped)
+        *escaped = memchr(begin, '\\', p - begin) != nullptr;
+    mPos = static_cast<int>(p - data) + 1;
+    return true;
+}
+
+bool SxJsonScanner::readString(QString &result)
+{
+    int start = mPos;
+    bool escaped;
+    if (!skipString(&escaped))
+        return false;
+    if (!escaped) {
+        result = QString::fromUtf8(mData.constData()+start+1, mPos-start-2);
+        return true;
+    }
+    // rare: let the JSON parser decode the escape sequences
+    QByteArray array = "[" + QByteArray::fromRawData(mData.constData()+start, mPos-start) + "]";
+    QJsonParseError error;
+    QJsonDocument json = QJsonDocument::fromJson(array, &error);
+    if (error.error != QJsonParseError::NoError || !json.isArray())
+        return false;
+    result = json.array().at(0).toString();
+    return true;
+}
+
+bool SxJsonScanner::readNumber(double &result)
+{
+    if (mPos >= mData.size())
+        return false;
+    char c = mData.at(mPos);
+    if (c != '-' && (c < '0' || c > '9'))
+        return false;
+    int start = mPos;
+    while (mPos < mData.size()) {
+        c = mData.at(mPos);
+        if (c == ',' || c == '}' || c == ']' || c == ' ' || c == '\t' || c == '\n' || c == '\r')
+            break;
+        mPos++;
+    }
+    bool ok;
+    result = QByteArray::fromRawData(mData.constData()+start, mPos-start).toDouble(&ok);
+    return ok;
+}
+
+bool SxJsonScanner::skipValue()
+{
+    if (mPos >= mData.size())
+        return false;
+    char c = mData.at(mPos);
+    if (c == '"')
+        return skipString(nullptr);
+    if (c != '{' && c != '[') {
+        while (mPos < mData.size()) {
+            c = mData.at(mPos);
+            if (c == ',' || c == '}' || c == ']' || c == ' ' || c == '\t' || c == '\n' || c == '\r')
+                break;
+            mPos++;
+        }
+        return true;
+    }
+    int depth = 0;
+    while (mPos < mData.size()) {
+        c = mData.at(mPos);
+        if (c == '"') {
+            // skip the string without decoding it
+            if (!skipString(nullptr))
+                return false;
+            continue;
+        }
+        else if (c == '{' || c == '[')
+            depth++;
+        else if (c == '}' || c == ']') {
+            if (--depth == 0) {
+                mPos++;
+                return true;
+            }
+        }
+        mPos++;
+    }
+    return false;
+}
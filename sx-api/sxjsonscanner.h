@@ -0,0 +1,56 @@
+/*
+ *  Copyright (C) 2012-2016 Skylable Ltd. <info-copyright@skylable.com>
+ *
+ *  This program is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public License
+ *  as published by the Free Software Foundation; either version 2
+ *  of the License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA.
+ *
+ *  Special exception for linking this software with OpenSSL:
+ *
+ *  In addition, as a special exception, Skylable Ltd. gives permission to
+ *  link the code of this program with the OpenSSL library and distribute
+ *  linked combinations including the two. You must obey the GNU General
+ *  Public License in all respects for all of the code used other than
+ *  OpenSSL. You may extend this exception to your version of the program,
+ *  but you are not obligated to do so. If you do not wish to do so, delete
+ *  this exception statement from your version.
+ */
+
+#ifndef SXJSONSCANNER_H
+#define SXJSONSCANNER_H
+
+#include <QByteArray>
+#include <QString>
+
+/* Minimal forward-only JSON tokenizer shared by the streaming reply readers.
+ * Strings are located with memchr and only decoded by QJsonDocument when
+ * they contain escape sequences, so no document tree is ever built */
+class SxJsonScanner
+{
+protected:
+    explicit SxJsonScanner(const QByteArray &data);
+    void skipWhitespace();
+    bool skipChar(char c);
+    bool atChar(char c);
+    bool readString(QString &result);
+    bool readNumber(double &result);
+    bool skipValue();
+
+    const QByteArray &mData;
+    int mPos;
+
+private:
+    bool skipString(bool *escaped);
+};
+
+#endif // SXJSONSCANNER_H
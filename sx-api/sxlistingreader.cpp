@@ -0,0 +1,187 @@
+/*
+ *  Copyright (C) 2012-2016 Skylable Ltd. <info-copyright@skylable.com>
+ *
+ *  This program is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public License
+ *  as published by the Free Software Foundation; either version 2
+ *  of the License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA.
+ *
+ *  Special exception for linking this software with OpenSSL:
+ *
+ *  In addition, as a special exception, Skylable Ltd. gives permission to
+ *  link the code of this program with the OpenSSL library and distribute
+ *  linked combinations including the two. You must obey the GNU General
+ *  Public License in all respects for all of the code used other than
+ *  OpenSSL. You may extend this exception to your version of the program,
+ *  but you are not obligated to do so. If you do not wish to do so, delete
+ *  this exception statement from your version.
+ */
+
+#include "sxlistingreader.h"
+#include "sxfileentry.h"
+
+#include <QJsonDocument>
+
+SxListingReader::SxListingReader(const QByteArray &data) : SxJsonScanner(data)
+{
+    mStarted = false;
+    mFinished = false;
+    mFailed = false;
+    mFileMetaStart = 0;
+    mFileMetaEnd = 0;
+}
+
+bool SxListingReader::next(QString &path, QJsonObject &entry)
+{
+    if (!nextKey(path))
+        return false;
+    int start = mPos;
+    if (!skipValue())
+        goto onError;
+    {
+        QJsonParseError error;
+        QJsonDocument json = QJsonDocument::fromJson(QByteArray::fromRawData(mData.constData()+start, mPos-start), &error);
+        if (error.error != QJsonParseError::NoError)
+            goto onError;
+        entry = json.object();
+    }
+    return true;
+    onError:
+    mFailed = true;
+    return false;
+}
+
+bool SxListingReader::next(SxFileEntry &entry, bool &complete)
+{
+    if (!nextKey(entry.mPath))
+        return false;
+    entry.mSize = 0;
+    entry.mCreatedAt = 0;
+    entry.mBlockSize = 0;
+    entry.mRevision.clear();
+    mFileMetaStart = mFileMetaEnd = 0;
+    {
+        int found = 0;
+        if (!skipChar('{'))
+            goto onError;
+        if (!atChar('}')) {
+            forever {
+                QString key;
+                if (!readString(key) || !skipChar(':'))
+                    goto onError;
+                skipWhitespace();
+                double value;
+                if (key == "fileSize" || key == "blockSize" || key == "createdAt") {
+                    if (!readNumber(value)) {
+                        if (!skipValue())
+                            goto onError;
+                    }
+                    else if (key == "fileSize") {
+                        entry.mSize = static_cast<qint64>(value);
+                        found |= 1;
+                    }
+                    else if (key == "blockSize") {
+                        entry.mBlockSize = static_cast<int>(value);
+                        found |= 2;
+                    }
+                    else {
+                        entry.mCreatedAt = static_cast<uint>(value);
+                        found |= 4;
+                    }
+                }
+                else if (key == "fileRevision" && atChar('"')) {
+                    if (!readString(entry.mRevision))
+                        goto onError;
+                    found |= 8;
+                }
+                else {
+                    int start = mPos;
+                    if (!skipValue())
+                        goto onError;
+                    if (key == "fileMeta" && mData.at(start) == '{') {
+                        mFileMetaStart = start;
+                        mFileMetaEnd = mPos;
+                    }
+                }
+                if (atChar('}'))
+                    break;
+                if (!skipChar(','))
+                    goto onError;
+                skipWhitespace();
+            }
+        }
+        mPos++;
+        complete = found == 15;
+    }
+    return true;
+    onError:
+    mFailed = true;
+    return false;
+}
+
+QByteArray SxListingReader::fileMeta() const
+{
+    return QByteArray::fromRawData(mData.constData()+mFileMetaStart, mFileMetaEnd-mFileMetaStart);
+}
+
+bool SxListingReader::failed() const
+{
+    return mFailed;
+}
+
+bool SxListingReader::nextKey(QString &path)
+{
+    if (mFinished || mFailed)
+        return false;
+    if (!mStarted) {
+        mStarted = true;
+        if (!findFileList())
+            goto onError;
+        if (atChar('}')) {
+            mFinished = true;
+            return false;
+        }
+    }
+    else {
+        if (atChar('}')) {
+            mFinished = true;
+            return false;
+        }
+        if (!skipChar(','))
+            goto onError;
+        skipWhitespace();
+    }
+    if (!readString(path) || !skipChar(':'))
+        goto onError;
+    skipWhitespace();
+    return true;
+    onError:
+    mFailed = true;
+    return false;
+}
+
+bool SxListingReader::findFileList()
+{
+    if (!skipChar('{'))
+        return false;
+    forever {
+        skipWhitespace();
+        QString key;
+        if (!readString(key) || !skipChar(':'))
+            return false;
+        skipWhitespace();
+        if (key == "fileList")
+            return skipChar('{');
+        if (!skipValue() || !skipChar(','))
+            return false;
+    }
+}
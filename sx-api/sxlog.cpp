@@ -27,12 +27,14 @@
  */
 
 #include "sxlog.h"
+#include "sxtrace.h"
 #include <iostream>
 
 #include <QDataStream>
 #include <QDir>
 #include <QFile>
 #include <QStandardPaths>
+#include <algorithm>
 #ifdef Q_OS_WIN
 #include <Windows.h>
 #endif
@@ -43,40 +45,156 @@ SxLog &SxLog::instance()
     return sInstance;
 }
 
-void SxLog::log(LogLevel type, const QString &func, const QString &message) const {
-    QMutexLocker locker(&mMutex);
-    if (type < mLogLevel)
-        return;
-    QString logLine;
-    switch (type) {
-    case LogLevel::Entry: {
-        logLine = "ENTRY";
-    } break;
-    case LogLevel::Debug: {
-        logLine = "DEBUG";
-    } break;
-    case LogLevel::Verbose: {
-        logLine = "VERB.";
-    } break;
-    case LogLevel::Info: {
-        logLine = "INFO ";
-    } break;
-    case LogLevel::Warning: {
-        logLine = "WARN ";
-    } break;
-    case LogLevel::Error: {
-        logLine = "ERROR";
-    } break;
+SxLogRing::SxLogRing() : mHead(0), mTail(0)
+{
+}
+
+bool SxLogRing::push(SxLogEntry &entry)
+{
+    quint32 head = mHead.load();
+    if (head - mTail.loadAcquire() >= sSize)
+        return false;
+    std::swap(mEntries[head % sSize], entry);
+    mHead.storeRelease(head+1);
+    return true;
+}
+
+bool SxLogRing::pop(SxLogEntry &entry)
+{
+    quint32 tail = mTail.load();
+    if (tail == mHead.loadAcquire())
+        return false;
+    std::swap(entry, mEntries[tail % sSize]);
+    mEntries[tail % sSize] = SxLogEntry();
+    mTail.storeRelease(tail+1);
+    return true;
+}
+
+bool SxLogRing::isEmpty() const
+{
+    return mTail.loadAcquire() == mHead.loadAcquire();
+}
+
+SxLogWriter::SxLogWriter(SxLog *log) : QThread()
+{
+    mLog = log;
+    setProperty("name", "log");
+}
+
+void SxLogWriter::run()
+{
+    while (!mLog->mStopping.load()) {
+        mLog->mWakeMutex.lock();
+        mLog->mWake.wait(&mLog->mWakeMutex, SxLog::sWriteInterval);
+        mLog->mWakeMutex.unlock();
+        mLog->_writePending();
     }
+    mLog->_writePending();
+}
 
-    QString thread;
-    QDateTime currentDateTime = QDateTime::currentDateTime();
+bool SxLog::isEnabled(LogLevel type) const
+{
+    return static_cast<int>(type) >= mLogLevel.load();
+}
+
+SxLogRing *SxLog::_ring() const
+{
+    if (!mThreadRing.hasLocalData()) {
+        std::shared_ptr<SxLogRing> ring(new SxLogRing());
+        QMutexLocker locker(&mRingsMutex);
+        mRings.append(ring);
+        mThreadRing.setLocalData(ring);
+    }
+    return mThreadRing.localData().get();
+}
+
+void SxLog::log(LogLevel type, const QString &func, const QString &message) const {
+    if (!isEnabled(type))
+        return;
+    SxLogEntry entry;
+    entry.type = type;
+    entry.func = func;
+    entry.message = message;
+    entry.dateTime = QDateTime::currentDateTime();
     if (QThread::currentThread()->property("name").isValid())
-        thread = QThread::currentThread()->property("name").toString().leftJustified(10, ' ', true);
+        entry.thread = QThread::currentThread()->property("name").toString().leftJustified(10, ' ', true);
     else
-        thread = QString("0x%1").arg(reinterpret_cast<quintptr>(QThread::currentThread()), 8, 16, QChar('0'));
-    QString time = currentDateTime.toString(Qt::ISODate);
-    logLine += QString(" | %1 | %2 | %3 | %4").arg(thread, time, func, message);
+        entry.thread = QString("0x%1").arg(reinterpret_cast<quintptr>(QThread::currentThread()), 8, 16, QChar('0'));
+
+    SxLogRing *ring = _ring();
+    while (!ring->push(entry)) {
+        if (mStopping.load() || QThread::currentThread() == mWriter) {
+            // nobody is going to empty the queue, write it from this thread
+            _writePending();
+            continue;
+        }
+        mWake.wakeOne();
+        QThread::yieldCurrentThread();
+    }
+    if (type >= LogLevel::Warning || mStopping.load())
+        mWake.wakeOne();
+}
+
+bool SxLog::_writePending() const
+{
+    // mMutex keeps batches drained by different threads in order
+    QMutexLocker locker(&mMutex);
+    QList<SxLogEntry> entries;
+    {
+        QMutexLocker ringsLocker(&mRingsMutex);
+        auto it = mRings.begin();
+        while (it != mRings.end()) {
+            SxLogEntry entry;
+            while ((*it)->pop(entry))
+                entries.append(entry);
+            // the thread that owned the queue is gone
+            if (it->use_count() == 1 && (*it)->isEmpty())
+                it = mRings.erase(it);
+            else
+                ++it;
+        }
+    }
+    if (entries.isEmpty())
+        return false;
+    // queues are drained one after another, restore the order across threads
+    std::stable_sort(entries.begin(), entries.end(), [](const SxLogEntry &e1, const SxLogEntry &e2) -> bool {
+        return e1.dateTime < e2.dateTime;
+    });
+    _writeLines(entries);
+    return true;
+}
+
+void SxLog::_writeLines(const QList<SxLogEntry> &entries) const
+{
+    QByteArray data;
+    foreach (const SxLogEntry &entry, entries) {
+        QString logLine;
+        switch (entry.type) {
+        case LogLevel::Entry: {
+            logLine = "ENTRY";
+        } break;
+        case LogLevel::Debug: {
+            logLine = "DEBUG";
+        } break;
+        case LogLevel::Verbose: {
+            logLine = "VERB.";
+        } break;
+        case LogLevel::Info: {
+            logLine = "INFO ";
+        } break;
+        case LogLevel::Warning: {
+            logLine = "WARN ";
+        } break;
+        case LogLevel::Error: {
+            logLine = "ERROR";
+        } break;
+        }
+        QString time = entry.dateTime.toString(Qt::ISODate);
+        logLine += QString(" | %1 | %2 | %3 | %4\n").arg(entry.thread, time, entry.func, entry.message);
+        data.append(logLine.toLocal8Bit());
+        if (mLogModel != nullptr)
+            mLogModel->appendLog(entry.type, entry.func, entry.message, entry.dateTime, entry.thread);
+    }
     QDir cacheDir(QStandardPaths::writableLocation(QStandardPaths::CacheLocation));
     cacheDir.mkdir("log");
     if (logFile == nullptr) {
@@ -84,11 +202,10 @@ void SxLog::log(LogLevel type, const QString &func, const QString &message) cons
         if (!logFile->open(QIODevice::WriteOnly | QIODevice::Append)) {
             delete logFile;
             logFile = nullptr;
-			return;
+            return;
         }
     }
     if (logFile->isOpen()) {
-        QByteArray data = (logLine+"\n").toLocal8Bit();
         logFile->write(data);
         logFile->flush();
         if (logFile->size() >= mLogFileSizeLimit) {
@@ -103,14 +220,16 @@ void SxLog::log(LogLevel type, const QString &func, const QString &message) cons
             }
         }
     }
-    if (mLogModel != nullptr)
-        mLogModel->appendLog(type, func, message, currentDateTime, thread);
+}
+
+void SxLog::flush()
+{
+    while (_writePending());
 }
 
 void SxLog::setLogLevel(LogLevel level)
 {
-    QMutexLocker locker(&mMutex);
-    mLogLevel = level;
+    mLogLevel.store(static_cast<int>(level));
 }
 
 void SxLog::setLogModel(LogModelInterface *model)
@@ -184,41 +303,71 @@ QByteArray gzip_compress(const QByteArray& data)
 
 bool SxLog::exportLogs(const QString &file)
 {
-    QByteArray uncommpressed;
     QFile out_file(file);
     if (!out_file.open(QIODevice::WriteOnly))
         return false;
 
+    flush();
+    // all files are opened at once, a rotation during the export doesn't shift them
+    QList<QFile*> inputs;
+    QList<qint64> sizes;
     QMutexLocker locker(&mMutex);
-    for (int i = 9; i >= 0; i--) {
-        QFileInfo finfo(nameTemplate.arg(i));
-        if (finfo.exists()) {
-            QFile in_file(finfo.filePath());
-            if (!in_file.open(QIODevice::ReadOnly)) {
-                out_file.close();
-                out_file.remove();
-                return false;
-            }
-            uncommpressed.append(in_file.readAll());
-            in_file.close();
+    foreach (const QString &name, logFiles()) {
+        QFile *in_file = new QFile(name);
+        inputs.append(in_file);
+        if (!in_file->open(QIODevice::ReadOnly)) {
+            locker.unlock();
+            qDeleteAll(inputs);
+            out_file.close();
+            out_file.remove();
+            return false;
         }
+        sizes.append(in_file->size());
     }
+    locker.unlock();
 
-    if (uncommpressed.isEmpty())
-        return false;
-    QByteArray commpressed = gzip_compress(uncommpressed);
-    uncommpressed.clear();
+    // every chunk is written as a separate gzip member, concatenated members are still a valid .gz file
+    qint64 exported = 0;
+    bool failed = false;
+    for (int i=0; i<inputs.count() && !failed; i++) {
+        qint64 left = sizes.at(i);
+        while (left > 0) {
+            QByteArray chunk = inputs.at(i)->read(qMin(left, mExportChunkSize));
+            if (chunk.isEmpty())
+                break;
+            left -= chunk.size();
+            exported += chunk.size();
+            if (out_file.write(gzip_compress(chunk)) < 0) {
+                failed = true;
+                break;
+            }
+        }
+    }
+    qDeleteAll(inputs);
 
-    out_file.write(commpressed);
-    if (!out_file.flush()) {
+    if (failed || exported == 0 || !out_file.flush()) {
         out_file.close();
         out_file.remove();
         return false;
     }
     out_file.close();
+    // the transfer trace goes next to the logs, ready for a trace viewer
+    if (SxTrace::instance().isEnabled())
+        SxTrace::exportChromeTrace(SxTrace::instance().traceFile(), file+".trace.json");
     return true;
 }
 
+QStringList SxLog::logFiles() const
+{
+    QStringList files;
+    for (int i = 9; i >= 0; i--) {
+        QString name = nameTemplate.arg(i);
+        if (QFileInfo::exists(name))
+            files.append(name);
+    }
+    return files;
+}
+
 void SxLog::removeLogFiles()
 {
     QMutexLocker locker(&mMutex);
@@ -232,7 +381,7 @@ void SxLog::removeLogFiles()
 SxLog::SxLog()
 {
     mLogModel = nullptr;
-    mLogLevel = LogLevel::Entry;
+    mLogLevel.store(static_cast<int>(LogLevel::Entry));
 #ifdef Q_OS_WIN
     hConsole = GetStdHandle(STD_OUTPUT_HANDLE);
 #endif
@@ -241,4 +390,21 @@ SxLog::SxLog()
     QDir dir;
     dir.mkpath(QFileInfo(nameTemplate).absolutePath());
     logFile = nullptr;
+    mStopping.store(0);
+    mWriter = new SxLogWriter(this);
+    mWriter->start(QThread::LowPriority);
+}
+
+SxLog::~SxLog()
+{
+    mStopping.store(1);
+    mWake.wakeOne();
+    mWriter->wait();
+    delete mWriter;
+    flush();
+    if (logFile != nullptr) {
+        logFile->close();
+        delete logFile;
+        logFile = nullptr;
+    }
 }
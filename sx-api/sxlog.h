@@ -34,6 +34,10 @@
 #include <QDateTime>
 #include <QMutex>
 #include <QFile>
+#include <QAtomicInteger>
+#include <QThreadStorage>
+#include <QWaitCondition>
+#include <memory>
 
 enum class LogLevel {
     Entry,
@@ -50,33 +54,94 @@ public:
     virtual void appendLog(LogLevel type, const QString &func, const QString &message, const QDateTime &dateTime, const QString& thread) = 0;
 };
 
+struct SxLogEntry {
+    LogLevel type;
+    QString func;
+    QString message;
+    QDateTime dateTime;
+    QString thread;
+};
+
+/* Single producer, single consumer queue of log entries, one for every logging thread */
+class SxLogRing
+{
+public:
+    SxLogRing();
+    bool push(SxLogEntry &entry);
+    bool pop(SxLogEntry &entry);
+    bool isEmpty() const;
+    static const quint32 sSize = 1024;
+private:
+    SxLogEntry mEntries[sSize];
+    QAtomicInteger<quint32> mHead;
+    QAtomicInteger<quint32> mTail;
+};
+
+class SxLog;
+
+class SxLogWriter : public QThread
+{
+    Q_OBJECT
+public:
+    explicit SxLogWriter(SxLog *log);
+protected:
+    void run() override;
+private:
+    SxLog *mLog;
+};
+
 class SxLog
 {
 public:
     static SxLog& instance();
     SxLog(const SxLog &) = delete;
     SxLog &operator= (const SxLog &) = delete;
+    ~SxLog();
+    bool isEnabled(LogLevel type) const;
     void log(LogLevel type, const QString &func, const QString &message) const;
+    void flush();
     void setLogLevel(LogLevel level);
     void setLogModel(LogModelInterface* model);
     bool exportLogs(const QString &file);
+    QStringList logFiles() const;
     void removeLogFiles();
 private:
     SxLog();
-    LogLevel mLogLevel;
+    SxLogRing *_ring() const;
+    bool _writePending() const;
+    void _writeLines(const QList<SxLogEntry> &entries) const;
+    QAtomicInt mLogLevel;
     void* hConsole;
     mutable QMutex mMutex;
     LogModelInterface *mLogModel;
     QString nameTemplate;
     const qint64 mLogFileSizeLimit = 20*1024*1024;
+    const qint64 mExportChunkSize = 1024*1024;
     mutable QFile *logFile;
+    // lines are queued by the logging threads and written in batches by mWriter
+    mutable QMutex mRingsMutex;
+    mutable QList<std::shared_ptr<SxLogRing>> mRings;
+    mutable QThreadStorage<std::shared_ptr<SxLogRing>> mThreadRing;
+    mutable QMutex mWakeMutex;
+    mutable QWaitCondition mWake;
+    QAtomicInt mStopping;
+    SxLogWriter *mWriter;
+    static const int sWriteInterval = 200;
+
+    friend class SxLogWriter;
 };
 
-#define logEntry(message)   SxLog::instance().log(LogLevel::Entry,   Q_FUNC_INFO, message)
-#define logDebug(message)   SxLog::instance().log(LogLevel::Debug,   Q_FUNC_INFO, message)
-#define logVerbose(message) SxLog::instance().log(LogLevel::Verbose, Q_FUNC_INFO, message)
-#define logInfo(message)    SxLog::instance().log(LogLevel::Info,    Q_FUNC_INFO, message)
-#define logWarning(message) SxLog::instance().log(LogLevel::Warning, Q_FUNC_INFO, message)
-#define logError(message)   SxLog::instance().log(LogLevel::Error,   Q_FUNC_INFO, message)
+// levels below SXLOG_MIN_LEVEL are compiled out, the message is only built when its level is logged
+#ifndef SXLOG_MIN_LEVEL
+#define SXLOG_MIN_LEVEL 0
+#endif
+#define SXLOG_ENABLED(level) (static_cast<int>(level) >= SXLOG_MIN_LEVEL && SxLog::instance().isEnabled(level))
+
+#define logEntry(message)   (SXLOG_ENABLED(LogLevel::Entry)   ? SxLog::instance().log(LogLevel::Entry,   Q_FUNC_INFO, message) : void())
+#define logDebug(message)   (SXLOG_ENABLED(LogLevel::Debug)   ? SxLog::instance().log(LogLevel::Debug,   Q_FUNC_INFO, message) : void())
+#define logVerbose(message) (SXLOG_ENABLED(LogLevel::Verbose) ? SxLog::instance().log(LogLevel::Verbose, Q_FUNC_INFO, message) : void())
+#define logInfo(message)    (SXLOG_ENABLED(LogLevel::Info)    ? SxLog::instance().log(LogLevel::Info,    Q_FUNC_INFO, message) : void())
+#define logWarning(message) (SXLOG_ENABLED(LogLevel::Warning) ? SxLog::instance().log(LogLevel::Warning, Q_FUNC_INFO, message) : void())
+#define logError(message)   (SXLOG_ENABLED(LogLevel::Error)   ? SxLog::instance().log(LogLevel::Error,   Q_FUNC_INFO, message) : void())
 
 #endif // SXDEBUG_H
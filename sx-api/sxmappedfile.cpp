@@ -0,0 +1,165 @@
+/*
+ *  Copyright (C) 2012-2016 Skylable Ltd. <info-copyright@skylable.com>
+ *
+ *  This program is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public License
+ *  as published by the Free Software Foundation; either version 2
+ *  of the License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA.
+ *
+ *  Special exception for linking this software with OpenSSL:
+ *
+ *  In addition, as a special exception, Skylable Ltd. gives permission to
+ *  link the code of this program with the OpenSSL library and distribute
+ *  linked combinations including the two. You must obey the GNU General
+ *  Public License in all respects for all of the code used other than
+ *  OpenSSL. You may extend this exception to your version of the program,
+ *  but you are not obligated to do so. If you do not wish to do so, delete
+ *  this exception statement from your version.
+ */
+
+#include "sxmappedfile.h"
+
+#ifdef Q_OS_WIN
+#include <QDir>
+#include <Windows.h>
+#include <io.h>
+#include <Fcntl.h>
+#else
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+#include <cstring>
+
+SxMappedFile::SxMappedFile(const QString &path, bool sequential)
+    : mFile(path)
+{
+    mSize = 0;
+    mSequential = sequential;
+    mWindow = nullptr;
+    mWindowOffset = 0;
+    mWindowSize = 0;
+    mPrefetched = 0;
+}
+
+SxMappedFile::~SxMappedFile()
+{
+    unmapWindow();
+}
+
+bool SxMappedFile::open()
+{
+#ifdef Q_OS_WIN
+    if (mSequential) {
+        // read-ahead for the plain read fallback and faster page recycling
+        QString name = QDir::toNativeSeparators(mFile.fileName());
+        HANDLE fh = CreateFileW((const WCHAR *)name.constData(), GENERIC_READ,
+                                FILE_SHARE_DELETE | FILE_SHARE_READ | FILE_SHARE_WRITE,
+                                NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+        if (fh != INVALID_HANDLE_VALUE) {
+            int fd = _open_osfhandle((intptr_t)fh, _O_RDONLY | _O_BINARY);
+            if (fd == -1)
+                CloseHandle(fh);
+            else if (!mFile.open(fd, QIODevice::ReadOnly, QFileDevice::AutoCloseHandle))
+                _close(fd);
+        }
+    }
+#endif
+    if (!mFile.isOpen() && !mFile.open(QIODevice::ReadOnly))
+        return false;
+    mSize = mFile.size();
+#ifdef POSIX_FADV_SEQUENTIAL
+    if (mSequential)
+        posix_fadvise(mFile.handle(), 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif
+    return true;
+}
+
+qint64 SxMappedFile::size() const
+{
+    return mSize;
+}
+
+void SxMappedFile::unmapWindow()
+{
+    if (mWindow)
+        mFile.unmap(mWindow);
+    mWindow = nullptr;
+    mWindowSize = 0;
+}
+
+/* returns a pointer to size bytes at offset which stays valid until the next call,
+ * nullptr if the range can't be mapped (then read() falls back to plain reads) */
+const char *SxMappedFile::map(qint64 offset, qint64 size)
+{
+    if (offset < 0 || size <= 0 || offset + size > mSize)
+        return nullptr;
+    if (!mWindow || offset < mWindowOffset || offset + size > mWindowOffset + mWindowSize) {
+        unmapWindow();
+        qint64 windowSize = mSize;
+        if (sizeof(void*) < 8) {
+            mWindowOffset = offset & ~(qint64(1024*1024)-1);
+            windowSize = sWindowSize;
+            if (offset + size - mWindowOffset > windowSize)
+                windowSize = offset + size - mWindowOffset;
+        }
+        else
+            mWindowOffset = 0;
+        windowSize = qMin(windowSize, mSize - mWindowOffset);
+        mWindow = mFile.map(mWindowOffset, windowSize);
+        if (!mWindow)
+            return nullptr;
+        mWindowSize = windowSize;
+        mPrefetched = offset;
+#ifndef Q_OS_WIN
+        if (mSequential) {
+            const quintptr pageMask = static_cast<quintptr>(sysconf(_SC_PAGESIZE)) - 1;
+            quintptr start = reinterpret_cast<quintptr>(mWindow) & ~pageMask;
+            madvise(reinterpret_cast<void*>(start), static_cast<size_t>(reinterpret_cast<quintptr>(mWindow) + mWindowSize - start), MADV_SEQUENTIAL);
+        }
+#endif
+    }
+    if (mSequential)
+        prefetch(offset + size);
+    return reinterpret_cast<const char*>(mWindow) + (offset - mWindowOffset);
+}
+
+/* asks for the next few megabytes ahead of the reader, so the disk stays busy
+ * while the current data is hashed or sent */
+void SxMappedFile::prefetch(qint64 offset)
+{
+#ifndef Q_OS_WIN
+    if (offset < mPrefetched)
+        return;
+    qint64 end = qMin(offset + sPrefetchSize, mWindowOffset + mWindowSize);
+    if (end <= offset)
+        return;
+    const quintptr pageMask = static_cast<quintptr>(sysconf(_SC_PAGESIZE)) - 1;
+    quintptr start = reinterpret_cast<quintptr>(mWindow + (offset - mWindowOffset)) & ~pageMask;
+    madvise(reinterpret_cast<void*>(start), static_cast<size_t>(reinterpret_cast<quintptr>(mWindow + (end - mWindowOffset)) - start), MADV_WILLNEED);
+    mPrefetched = end;
+#else
+    Q_UNUSED(offset);
+#endif
+}
+
+bool SxMappedFile::read(qint64 offset, char *data, qint64 size)
+{
+    const char *mapped = map(offset, size);
+    if (mapped) {
+        memcpy(data, mapped, static_cast<size_t>(size));
+        return true;
+    }
+    if (!mFile.seek(offset))
+        return false;
+    return mFile.read(data, size) == size;
+}
@@ -0,0 +1,62 @@
+/*
+ *  Copyright (C) 2012-2016 Skylable Ltd. <info-copyright@skylable.com>
+ *
+ *  This program is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public License
+ *  as published by the Free Software Foundation; either version 2
+ *  of the License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA.
+ *
+ *  Special exception for linking this software with OpenSSL:
+ *
+ *  In addition, as a special exception, Skylable Ltd. gives permission to
+ *  link the code of this program with the OpenSSL library and distribute
+ *  linked combinations including the two. You must obey the GNU General
+ *  Public License in all respects for all of the code used other than
+ *  OpenSSL. You may extend this exception to your version of the program,
+ *  but you are not obligated to do so. If you do not wish to do so, delete
+ *  this exception statement from your version.
+ */
+
+#ifndef SXMAPPEDFILE_H
+#define SXMAPPEDFILE_H
+
+#include <QFile>
+
+/* Read-only view of a file through memory mappings. On 64-bit builds the whole file
+ * is mapped once, 32-bit builds slide a window over it so files over 4GB still work.
+ * Not thread-safe, every thread should use its own instance. */
+class SxMappedFile
+{
+public:
+    SxMappedFile(const QString &path, bool sequential = true);
+    ~SxMappedFile();
+    bool open();
+    qint64 size() const;
+    const char *map(qint64 offset, qint64 size);
+    bool read(qint64 offset, char *data, qint64 size);
+
+private:
+    void unmapWindow();
+    void prefetch(qint64 offset);
+
+    QFile mFile;
+    qint64 mSize;
+    bool mSequential;
+    uchar *mWindow;
+    qint64 mWindowOffset;
+    qint64 mWindowSize;
+    qint64 mPrefetched;
+    static const qint64 sWindowSize = 64*1024*1024;
+    static const qint64 sPrefetchSize = 8*1024*1024;
+};
+
+#endif // SXMAPPEDFILE_H
@@ -0,0 +1,352 @@
+/*
+ *  Copyright (C) 2012-2016 Skylable Ltd. <info-copyright@skylable.com>
+ *
+ *  This program is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public License
+ *  as published by the Free Software Foundation; either version 2
+ *  of the License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA.
+ *
+ *  Special exception for linking this software with OpenSSL:
+ *
+ *  In addition, as a special exception, Skylable Ltd. gives permission to
+ *  link the code of this program with the OpenSSL library and distribute
+ *  linked combinations including the two. You must obey the GNU General
+ *  Public License in all respects for all of the code used other than
+ *  OpenSSL. You may extend this exception to your version of the program,
+ *  but you are not obligated to do so. If you do not wish to do so, delete
+ *  this exception statement from your version.
+ */
+
+#include "sxmetrics.h"
+#include "sxcensus.h"
+
+#include <QFile>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QStringList>
+
+const QVector<qint64> SxMetrics::sBuckets = {5, 10, 25, 50, 100, 250, 500, 1000, 2500, 5000, 10000};
+
+SxMetrics &SxMetrics::instance()
+{
+    static SxMetrics sInstance;
+    return sInstance;
+}
+
+SxMetrics::SxMetrics()
+{
+    reset();
+}
+
+SxMetrics::Histogram::Histogram() : buckets(sBuckets.count()+1, 0)
+{
+    count = 0;
+    sum = 0;
+    max = 0;
+}
+
+void SxMetrics::Histogram::add(qint64 value)
+{
+    int i = 0;
+    while (i < sBuckets.count() && value > sBuckets.at(i))
+        ++i;
+    ++buckets[i];
+    ++count;
+    sum += value;
+    if (value > max)
+        max = value;
+}
+
+qint64 SxMetrics::Histogram::percentile(int percent) const
+{
+    // upper bound of the bucket holding the percentile
+    if (count == 0)
+        return 0;
+    qint64 rank = (count*percent + 99)/100;
+    qint64 seen = 0;
+    for (int i=0; i<sBuckets.count(); i++) {
+        seen += buckets.at(i);
+        if (seen >= rank)
+            return qMin(sBuckets.at(i), max);
+    }
+    return max;
+}
+
+QJsonObject SxMetrics::Histogram::toJson() const
+{
+    QJsonArray jBuckets;
+    for (int i=0; i<buckets.count(); i++) {
+        QJsonObject jBucket;
+        jBucket.insert("le", i < sBuckets.count() ? QJsonValue(static_cast<double>(sBuckets.at(i))) : QJsonValue(QString("inf")));
+        jBucket.insert("count", static_cast<double>(buckets.at(i)));
+        jBuckets.append(jBucket);
+    }
+    QJsonObject json;
+    json.insert("count", static_cast<double>(count));
+    json.insert("sum", static_cast<double>(sum));
+    json.insert("max", static_cast<double>(max));
+    json.insert("buckets", jBuckets);
+    return json;
+}
+
+void SxMetrics::addRequest(const QString &node, const QString &operation, qint64 msecs, qint64 bytesSent, qint64 bytesReceived, bool failed)
+{
+    QMutexLocker locker(&mMutex);
+    mLatency[{node, operation}].add(msecs);
+    mBytesSent += bytesSent;
+    mBytesReceived += bytesReceived;
+    if (failed)
+        ++mFailures[{node, operation}];
+}
+
+void SxMetrics::addRetry(const QString &node)
+{
+    QMutexLocker locker(&mMutex);
+    ++mRetries[node];
+}
+
+void SxMetrics::addDedupSavings(qint64 bytes)
+{
+    QMutexLocker locker(&mMutex);
+    mDedupSaved += bytes;
+}
+
+void SxMetrics::addDownloadDedupSavings(qint64 bytes)
+{
+    QMutexLocker locker(&mMutex);
+    mDownloadDedupSaved += bytes;
+}
+
+void SxMetrics::addHashing(qint64 bytes, qint64 nsecs)
+{
+    QMutexLocker locker(&mMutex);
+    mHashedBytes += bytes;
+    mHashNsecs += nsecs;
+}
+
+void SxMetrics::addDatabaseTransaction(qint64 msecs)
+{
+    QMutexLocker locker(&mMutex);
+    mDatabaseTransactions.add(msecs);
+}
+
+void SxMetrics::addTaskError()
+{
+    QMutexLocker locker(&mMutex);
+    ++mTaskErrors;
+}
+
+void SxMetrics::setQueueState(uint uploads, qint64 uploadBytes, uint downloads, qint64 downloadBytes, uint removes)
+{
+    QMutexLocker locker(&mMutex);
+    mQueueUploads = uploads;
+    mQueueUploadBytes = uploadBytes;
+    mQueueDownloads = downloads;
+    mQueueDownloadBytes = downloadBytes;
+    mQueueRemoves = removes;
+}
+
+void SxMetrics::setDatabaseSize(qint64 databaseBytes, qint64 walBytes)
+{
+    QMutexLocker locker(&mMutex);
+    mDatabaseBytes = databaseBytes;
+    mDatabaseWalBytes = walBytes;
+}
+
+void SxMetrics::reset()
+{
+    QMutexLocker locker(&mMutex);
+    mStarted = QDateTime::currentDateTime();
+    mLatency.clear();
+    mRetries.clear();
+    mFailures.clear();
+    mBytesSent = 0;
+    mBytesReceived = 0;
+    mDedupSaved = 0;
+    mDownloadDedupSaved = 0;
+    mHashedBytes = 0;
+    mHashNsecs = 0;
+    mDatabaseTransactions = Histogram();
+    mTaskErrors = 0;
+    mQueueUploads = 0;
+    mQueueUploadBytes = 0;
+    mQueueDownloads = 0;
+    mQueueDownloadBytes = 0;
+    mQueueRemoves = 0;
+    mDatabaseBytes = 0;
+    mDatabaseWalBytes = 0;
+}
+
+static QString formatSize(qint64 bytes)
+{
+    if (bytes >= 1024*1024*1024)
+        return QString("%1 GB").arg(static_cast<double>(bytes)/(1024*1024*1024), 0, 'f', 2);
+    if (bytes >= 1024*1024)
+        return QString("%1 MB").arg(static_cast<double>(bytes)/(1024*1024), 0, 'f', 2);
+    if (bytes >= 1024)
+        return QString("%1 kB").arg(static_cast<double>(bytes)/1024, 0, 'f', 1);
+    return QString("%1 B").arg(bytes);
+}
+
+QString SxMetrics::report() const
+{
+    QMutexLocker locker(&mMutex);
+    QStringList lines;
+    qint64 seconds = qMax<qint64>(1, mStarted.secsTo(QDateTime::currentDateTime()));
+    lines.append(QString("since %1").arg(mStarted.toString(Qt::ISODate)));
+    lines.append(QString("sent: %1 (%2/s), received: %3 (%4/s)")
+                 .arg(formatSize(mBytesSent)).arg(formatSize(mBytesSent/seconds))
+                 .arg(formatSize(mBytesReceived)).arg(formatSize(mBytesReceived/seconds)));
+    lines.append(QString("deduplication saved: %1 uploading, %2 downloading").arg(formatSize(mDedupSaved)).arg(formatSize(mDownloadDedupSaved)));
+    lines.append(QString("task errors: %1").arg(mTaskErrors));
+    double hashRate = mHashNsecs > 0 ? static_cast<double>(mHashedBytes)*1e9/mHashNsecs : 0;
+    lines.append(QString("hashed: %1 at %2/s").arg(formatSize(mHashedBytes)).arg(formatSize(static_cast<qint64>(hashRate))));
+    lines.append(QString("database transactions: %1, average %2 ms, p95 %3 ms, max %4 ms")
+                 .arg(mDatabaseTransactions.count)
+                 .arg(mDatabaseTransactions.count ? mDatabaseTransactions.sum/mDatabaseTransactions.count : 0)
+                 .arg(mDatabaseTransactions.percentile(95))
+                 .arg(mDatabaseTransactions.max));
+    lines.append(QString("database size: %1, wal: %2").arg(formatSize(mDatabaseBytes)).arg(formatSize(mDatabaseWalBytes)));
+    lines.append(QString());
+    lines.append(QString("%1 %2 %3 %4 %5 %6 %7 %8")
+                 .arg("node", -24).arg("operation", -12).arg("requests", 9).arg("failed", 7)
+                 .arg("avg ms", 7).arg("p50 ms", 7).arg("p95 ms", 7).arg("max ms", 7));
+    for (auto it = mLatency.constBegin(); it != mLatency.constEnd(); ++it) {
+        const Histogram &h = it.value();
+        lines.append(QString("%1 %2 %3 %4 %5 %6 %7 %8")
+                     .arg(it.key().first, -24).arg(it.key().second, -12)
+                     .arg(h.count, 9).arg(mFailures.value(it.key()), 7)
+                     .arg(h.count ? h.sum/h.count : 0, 7).arg(h.percentile(50), 7)
+                     .arg(h.percentile(95), 7).arg(h.max, 7));
+    }
+    if (!mRetries.isEmpty()) {
+        lines.append(QString());
+        for (auto it = mRetries.constBegin(); it != mRetries.constEnd(); ++it)
+            lines.append(QString("retries on %1: %2").arg(it.key()).arg(it.value()));
+    }
+    lines.append(QString());
+    lines.append(QString("live objects: %1").arg(SxCensus::report()));
+    return lines.join("\n");
+}
+
+QJsonObject SxMetrics::toJson() const
+{
+    QMutexLocker locker(&mMutex);
+    QJsonArray jRequests;
+    for (auto it = mLatency.constBegin(); it != mLatency.constEnd(); ++it) {
+        QJsonObject jRequest;
+        jRequest.insert("node", it.key().first);
+        jRequest.insert("operation", it.key().second);
+        jRequest.insert("failed", static_cast<double>(mFailures.value(it.key())));
+        jRequest.insert("latencyMs", it.value().toJson());
+        jRequests.append(jRequest);
+    }
+    QJsonObject jRetries;
+    for (auto it = mRetries.constBegin(); it != mRetries.constEnd(); ++it)
+        jRetries.insert(it.key(), static_cast<double>(it.value()));
+    QJsonObject json;
+    json.insert("since", mStarted.toString(Qt::ISODate));
+    json.insert("timestamp", QDateTime::currentDateTime().toString(Qt::ISODate));
+    json.insert("bytesSent", static_cast<double>(mBytesSent));
+    json.insert("bytesReceived", static_cast<double>(mBytesReceived));
+    json.insert("dedupSavedBytes", static_cast<double>(mDedupSaved));
+    json.insert("downloadDedupSavedBytes", static_cast<double>(mDownloadDedupSaved));
+    json.insert("taskErrors", static_cast<double>(mTaskErrors));
+    json.insert("hashedBytes", static_cast<double>(mHashedBytes));
+    json.insert("hashNsecs", static_cast<double>(mHashNsecs));
+    json.insert("databaseTransactionMs", mDatabaseTransactions.toJson());
+    json.insert("databaseBytes", static_cast<double>(mDatabaseBytes));
+    json.insert("databaseWalBytes", static_cast<double>(mDatabaseWalBytes));
+    json.insert("requests", jRequests);
+    json.insert("retries", jRetries);
+    json.insert("liveObjects", SxCensus::toJson());
+    return json;
+}
+
+static QByteArray labelValue(const QString &value)
+{
+    QByteArray result = value.toUtf8();
+    result.replace('\\', "\\\\");
+    result.replace('"', "\\\"");
+    result.replace('\n', "\\n");
+    return '"'+result+'"';
+}
+
+void SxMetrics::Histogram::writeOpenMetrics(QByteArray &out, const QByteArray &name, const QByteArray &labels) const
+{
+    QByteArray prefix = labels.isEmpty() ? QByteArray() : labels+",";
+    qint64 cumulative = 0;
+    for (int i=0; i<buckets.count(); i++) {
+        cumulative += buckets.at(i);
+        QByteArray le = i < sBuckets.count() ? QByteArray::number(sBuckets.at(i)) : QByteArray("+Inf");
+        out += name+"_bucket{"+prefix+"le=\""+le+"\"} "+QByteArray::number(cumulative)+"\n";
+    }
+    QByteArray braces = labels.isEmpty() ? QByteArray() : "{"+labels+"}";
+    out += name+"_count"+braces+" "+QByteArray::number(count)+"\n";
+    out += name+"_sum"+braces+" "+QByteArray::number(sum)+"\n";
+}
+
+QByteArray SxMetrics::openMetrics() const
+{
+    QMutexLocker locker(&mMutex);
+    QByteArray out;
+    out += "# TYPE sx_queue_tasks gauge\n";
+    out += "sx_queue_tasks{type=\"upload\"} "+QByteArray::number(mQueueUploads)+"\n";
+    out += "sx_queue_tasks{type=\"download\"} "+QByteArray::number(mQueueDownloads)+"\n";
+    out += "sx_queue_tasks{type=\"remove\"} "+QByteArray::number(mQueueRemoves)+"\n";
+    out += "# TYPE sx_queue_bytes gauge\n# UNIT sx_queue_bytes bytes\n";
+    out += "sx_queue_bytes{type=\"upload\"} "+QByteArray::number(mQueueUploadBytes)+"\n";
+    out += "sx_queue_bytes{type=\"download\"} "+QByteArray::number(mQueueDownloadBytes)+"\n";
+    out += "# TYPE sx_transfer_bytes counter\n# UNIT sx_transfer_bytes bytes\n";
+    out += "sx_transfer_bytes_total{direction=\"sent\"} "+QByteArray::number(mBytesSent)+"\n";
+    out += "sx_transfer_bytes_total{direction=\"received\"} "+QByteArray::number(mBytesReceived)+"\n";
+    out += "# TYPE sx_dedup_saved_bytes counter\n# UNIT sx_dedup_saved_bytes bytes\n";
+    out += "sx_dedup_saved_bytes_total "+QByteArray::number(mDedupSaved)+"\n";
+    out += "# TYPE sx_download_dedup_saved_bytes counter\n# UNIT sx_download_dedup_saved_bytes bytes\n";
+    out += "sx_download_dedup_saved_bytes_total "+QByteArray::number(mDownloadDedupSaved)+"\n";
+    out += "# TYPE sx_hashed_bytes counter\n# UNIT sx_hashed_bytes bytes\n";
+    out += "sx_hashed_bytes_total "+QByteArray::number(mHashedBytes)+"\n";
+    out += "# TYPE sx_hash_seconds counter\n# UNIT sx_hash_seconds seconds\n";
+    out += "sx_hash_seconds_total "+QByteArray::number(static_cast<double>(mHashNsecs)/1e9, 'f', 6)+"\n";
+    out += "# TYPE sx_task_errors counter\n";
+    out += "sx_task_errors_total "+QByteArray::number(mTaskErrors)+"\n";
+    out += "# TYPE sx_retries counter\n";
+    for (auto it = mRetries.constBegin(); it != mRetries.constEnd(); ++it)
+        out += "sx_retries_total{node="+labelValue(it.key())+"} "+QByteArray::number(it.value())+"\n";
+    out += "# TYPE sx_request_failures counter\n";
+    for (auto it = mFailures.constBegin(); it != mFailures.constEnd(); ++it)
+        out += "sx_request_failures_total{node="+labelValue(it.key().first)+",operation="+labelValue(it.key().second)+"} "+QByteArray::number(it.value())+"\n";
+    out += "# TYPE sx_request_latency_milliseconds histogram\n";
+    for (auto it = mLatency.constBegin(); it != mLatency.constEnd(); ++it)
+        it.value().writeOpenMetrics(out, "sx_request_latency_milliseconds", "node="+labelValue(it.key().first)+",operation="+labelValue(it.key().second));
+    out += "# TYPE sx_database_transaction_milliseconds histogram\n";
+    mDatabaseTransactions.writeOpenMetrics(out, "sx_database_transaction_milliseconds", QByteArray());
+    out += "# TYPE sx_database_bytes gauge\n# UNIT sx_database_bytes bytes\n";
+    out += "sx_database_bytes{file=\"main\"} "+QByteArray::number(mDatabaseBytes)+"\n";
+    out += "sx_database_bytes{file=\"wal\"} "+QByteArray::number(mDatabaseWalBytes)+"\n";
+    out += "# TYPE sx_live_objects gauge\n";
+    for (int i=0; i<SxCensus::KindCount; i++)
+        out += "sx_live_objects{kind=\""+QByteArray(SxCensus::name(static_cast<SxCensus::Kind>(i)))+"\"} "+QByteArray::number(SxCensus::count(static_cast<SxCensus::Kind>(i)))+"\n";
+    out += "# TYPE sx_live_object_bytes gauge\n# UNIT sx_live_object_bytes bytes\n";
+    for (int i=0; i<SxCensus::KindCount; i++)
+        out += "sx_live_object_bytes{kind=\""+QByteArray(SxCensus::name(static_cast<SxCensus::Kind>(i)))+"\"} "+QByteArray::number(SxCensus::bytes(static_cast<SxCensus::Kind>(i)))+"\n";
+    out += "# EOF\n";
+    return out;
+}
+
+bool SxMetrics::exportJson(const QString &file) const
+{
+    QFile out(file);
+    if (!out.open(QIODevice::WriteOnly))
+        return false;
+    return out.write(QJsonDocument(toJson()).toJson()) > 0;
+}
@@ -0,0 +1,99 @@
+/*
+ *  Copyright (C) 2012-2016 Skylable Ltd. <info-copyright@skylable.com>
+ *
+ *  This program is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public License
+ *  as published by the Free Software Foundation; either version 2
+ *  of the License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA.
+ *
+ *  Special exception for linking this software with OpenSSL:
+ *
+ *  In addition, as a special exception, Skylable Ltd. gives permission to
+ *  link the code of this program with the OpenSSL library and distribute
+ *  linked combinations including the two. You must obey the GNU General
+ *  Public License in all respects for all of the code used other than
+ *  OpenSSL. You may extend this exception to your version of the program,
+ *  but you are not obligated to do so. If you do not wish to do so, delete
+ *  this exception statement from your version.
+ */
+
+#ifndef SXMETRICS_H
+#define SXMETRICS_H
+
+#include <QString>
+#include <QMap>
+#include <QPair>
+#include <QMutex>
+#include <QVector>
+#include <QDateTime>
+#include <QJsonObject>
+
+/* Process wide counters and latency histograms, shared by every cluster connection */
+class SxMetrics
+{
+public:
+    static SxMetrics& instance();
+    SxMetrics(const SxMetrics &) = delete;
+    SxMetrics &operator= (const SxMetrics &) = delete;
+    void addRequest(const QString &node, const QString &operation, qint64 msecs, qint64 bytesSent, qint64 bytesReceived, bool failed);
+    void addRetry(const QString &node);
+    void addDedupSavings(qint64 bytes);
+    void addDownloadDedupSavings(qint64 bytes);
+    void addHashing(qint64 bytes, qint64 nsecs);
+    void addDatabaseTransaction(qint64 msecs);
+    void addTaskError();
+    void setQueueState(uint uploads, qint64 uploadBytes, uint downloads, qint64 downloadBytes, uint removes);
+    void setDatabaseSize(qint64 databaseBytes, qint64 walBytes);
+    void reset();
+    QString report() const;
+    QJsonObject toJson() const;
+    QByteArray openMetrics() const;
+    bool exportJson(const QString &file) const;
+
+private:
+    SxMetrics();
+    struct Histogram {
+        Histogram();
+        void add(qint64 value);
+        qint64 percentile(int percent) const;
+        QJsonObject toJson() const;
+        void writeOpenMetrics(QByteArray &out, const QByteArray &name, const QByteArray &labels) const;
+        QVector<qint64> buckets;
+        qint64 count;
+        qint64 sum;
+        qint64 max;
+    };
+    // upper bounds in milliseconds, the last bucket takes everything above
+    static const QVector<qint64> sBuckets;
+    mutable QMutex mMutex;
+    QDateTime mStarted;
+    QMap<QPair<QString, QString>, Histogram> mLatency;
+    QMap<QString, qint64> mRetries;
+    QMap<QPair<QString, QString>, qint64> mFailures;
+    qint64 mBytesSent;
+    qint64 mBytesReceived;
+    qint64 mDedupSaved;
+    qint64 mDownloadDedupSaved;
+    qint64 mHashedBytes;
+    qint64 mHashNsecs;
+    Histogram mDatabaseTransactions;
+    qint64 mTaskErrors;
+    uint mQueueUploads;
+    qint64 mQueueUploadBytes;
+    uint mQueueDownloads;
+    qint64 mQueueDownloadBytes;
+    uint mQueueRemoves;
+    qint64 mDatabaseBytes;
+    qint64 mDatabaseWalBytes;
+};
+
+#endif // SXMETRICS_H
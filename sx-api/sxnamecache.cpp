@@ -0,0 +1,124 @@
+/*
+ *  Copyright (C) 2012-2016 Skylable Ltd. <info-copyright@skylable.com>
+ *
+ *  This program is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public License
+ *  as published by the Free Software Foundation; either version 2
+ *  of the License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA.
+ *
+ *  Special exception for linking this software with OpenSSL:
+ *
+ *  In addition, as a special exception, Skylable Ltd. gives permission to
+ *  link the code of this program with the OpenSSL library and distribute
+ *  linked combinations including the two. You must obey the GNU General
+ *  Public License in all respects for all of the code used other than
+ *  OpenSSL. You may extend this exception to your version of the program,
+ *  but you are not obligated to do so. If you do not wish to do so, delete
+ *  this exception statement from your version.
+ */
+
+#include "sxnamecache.h"
+
+SxNameCache::SxNameCache()
+{
+}
+
+SxNameCache::~SxNameCache()
+{
+    qDeleteAll(mVolumes);
+}
+
+SxNameCache *SxNameCache::instance()
+{
+    static SxNameCache instance;
+    return &instance;
+}
+
+SxNameCache::VolumeNames *SxNameCache::volumeNames(const QString &volume, const QByteArray &fingerprint, bool create)
+{
+    VolumeNames *names = mVolumes.value(volume, nullptr);
+    if (names && names->fingerprint != fingerprint) {
+        names->byEncryptedMeta.clear();
+        names->byLocalName.clear();
+        names->fingerprint = fingerprint;
+    }
+    if (!names && create) {
+        names = new VolumeNames();
+        names->fingerprint = fingerprint;
+        names->byEncryptedMeta.setMaxCost(sMaxNamesPerVolume);
+        names->byLocalName.setMaxCost(sMaxNamesPerVolume);
+        mVolumes.insert(volume, names);
+    }
+    return names;
+}
+
+QString SxNameCache::localKey(const QString &localName, qint64 localSize)
+{
+    return QString::number(localSize) + ":" + localName;
+}
+
+bool SxNameCache::findLocal(const QString &volume, const QByteArray &fingerprint, const QByteArray &encryptedMeta, QString &localName, qint64 &localSize)
+{
+    QMutexLocker locker(&mMutex);
+    VolumeNames *names = volumeNames(volume, fingerprint, false);
+    if (!names)
+        return false;
+    Entry *entry = names->byEncryptedMeta.object(encryptedMeta);
+    if (!entry)
+        return false;
+    localName = entry->localName;
+    localSize = entry->localSize;
+    return true;
+}
+
+bool SxNameCache::findRemote(const QString &volume, const QByteArray &fingerprint, const QString &localName, qint64 localSize, QString &remoteName, QByteArray &encryptedMeta)
+{
+    QMutexLocker locker(&mMutex);
+    VolumeNames *names = volumeNames(volume, fingerprint, false);
+    if (!names)
+        return false;
+    Entry *entry = names->byLocalName.object(localKey(localName, localSize));
+    if (!entry)
+        return false;
+    remoteName = entry->remoteName;
+    encryptedMeta = entry->encryptedMeta;
+    return true;
+}
+
+void SxNameCache::insert(const QString &volume, const QByteArray &fingerprint, const QString &localName, qint64 localSize, const QString &remoteName, const QByteArray &encryptedMeta)
+{
+    if (encryptedMeta.isEmpty())
+        return;
+    QMutexLocker locker(&mMutex);
+    VolumeNames *names = volumeNames(volume, fingerprint, true);
+    auto createEntry = [&]() -> Entry* {
+        Entry *entry = new Entry();
+        entry->localName = localName;
+        entry->localSize = localSize;
+        entry->remoteName = remoteName.startsWith("/") ? remoteName : "/" + remoteName;
+        entry->encryptedMeta = encryptedMeta;
+        return entry;
+    };
+    names->byEncryptedMeta.insert(encryptedMeta, createEntry());
+    names->byLocalName.insert(localKey(localName, localSize), createEntry());
+}
+
+void SxNameCache::clear(const QString &volume)
+{
+    QMutexLocker locker(&mMutex);
+    if (volume.isEmpty()) {
+        qDeleteAll(mVolumes);
+        mVolumes.clear();
+    }
+    else
+        delete mVolumes.take(volume);
+}
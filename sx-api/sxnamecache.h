@@ -0,0 +1,70 @@
+/*
+ *  Copyright (C) 2012-2016 Skylable Ltd. <info-copyright@skylable.com>
+ *
+ *  This program is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public License
+ *  as published by the Free Software Foundation; either version 2
+ *  of the License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA.
+ *
+ *  Special exception for linking this software with OpenSSL:
+ *
+ *  In addition, as a special exception, Skylable Ltd. gives permission to
+ *  link the code of this program with the OpenSSL library and distribute
+ *  linked combinations including the two. You must obey the GNU General
+ *  Public License in all respects for all of the code used other than
+ *  OpenSSL. You may extend this exception to your version of the program,
+ *  but you are not obligated to do so. If you do not wish to do so, delete
+ *  this exception statement from your version.
+ */
+
+#ifndef SXNAMECACHE_H
+#define SXNAMECACHE_H
+
+#include <QCache>
+#include <QHash>
+#include <QMutex>
+#include <QString>
+
+/* Bounded cache of plain <-> encrypted file names of filtered volumes, shared
+ * by all listings so every name is only processed by the filter once */
+class SxNameCache
+{
+public:
+    static SxNameCache *instance();
+    bool findLocal(const QString &volume, const QByteArray &fingerprint, const QByteArray &encryptedMeta, QString &localName, qint64 &localSize);
+    bool findRemote(const QString &volume, const QByteArray &fingerprint, const QString &localName, qint64 localSize, QString &remoteName, QByteArray &encryptedMeta);
+    void insert(const QString &volume, const QByteArray &fingerprint, const QString &localName, qint64 localSize, const QString &remoteName, const QByteArray &encryptedMeta);
+    void clear(const QString &volume = QString());
+
+private:
+    SxNameCache();
+    ~SxNameCache();
+    struct Entry {
+        QString localName;
+        qint64 localSize;
+        QString remoteName;
+        QByteArray encryptedMeta;
+    };
+    struct VolumeNames {
+        QByteArray fingerprint;
+        QCache<QByteArray, Entry> byEncryptedMeta;
+        QCache<QString, Entry> byLocalName;
+    };
+    VolumeNames *volumeNames(const QString &volume, const QByteArray &fingerprint, bool create);
+    static QString localKey(const QString &localName, qint64 localSize);
+
+    QMutex mMutex;
+    QHash<QString, VolumeNames*> mVolumes;
+    static const int sMaxNamesPerVolume = 100000;
+};
+
+#endif // SXNAMECACHE_H
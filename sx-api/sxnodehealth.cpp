@@ -0,0 +1,157 @@
+/*
+ *  Copyright (C) 2012-2016 Skylable Ltd. <info-copyright@skylable.com>
+ *
+ *  This program is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public License
+ *  as published by the Free Software Foundation; either version 2
+ *  of the License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA.
+ *
+ *  Special exception for linking this software with OpenSSL:
+ *
+ *  In addition, as a special exception, Skylable Ltd. gives permission to
+ *  link the code of this program with the OpenSSL library and distribute
+ *  linked combinations including the two. You must obey the GNU General
+ *  Public License in all respects for all of the code used other than
+ *  OpenSSL. You may extend this exception to your version of the program,
+ *  but you are not obligated to do so. If you do not wish to do so, delete
+ *  this exception statement from your version.
+ */
+
+#include "sxnodehealth.h"
+#include "sxlog.h"
+
+SxNodeHealth &SxNodeHealth::instance()
+{
+    static SxNodeHealth sInstance;
+    return sInstance;
+}
+
+SxNodeHealth::SxNodeHealth()
+{
+    mClock.start();
+}
+
+SxNodeHealth::Node::Node()
+{
+    state = State::Closed;
+    failures = 0;
+    cooldown = sCooldown;
+    openedAt = 0;
+    probeStarted = -1;
+}
+
+bool SxNodeHealth::_allowRequest(Node &node, qint64 now)
+{
+    switch (node.state) {
+    case State::Closed:
+        return true;
+    case State::Open:
+        if (now - node.openedAt < node.cooldown)
+            return false;
+        node.state = State::HalfOpen;
+        node.probeStarted = now;
+        return true;
+    case State::HalfOpen:
+        // the probe reply may never be reported if its query got aborted
+        if (node.probeStarted >= 0 && now - node.probeStarted < sProbeTimeout)
+            return false;
+        node.probeStarted = now;
+        return true;
+    }
+    return true;
+}
+
+QString SxNodeHealth::takeTarget(QStringList &targets)
+{
+    if (targets.isEmpty())
+        return QString();
+    QMutexLocker locker(&mMutex);
+    qint64 now = mClock.elapsed();
+    int fallback = 0;
+    qint64 fallbackRetry = -1;
+    for (int i=0; i<targets.count(); i++) {
+        auto it = mNodes.find(targets.at(i));
+        if (it == mNodes.end() || _allowRequest(it.value(), now))
+            return targets.takeAt(i);
+        qint64 retry = it->state == State::Open ? it->openedAt + it->cooldown : it->probeStarted + sProbeTimeout;
+        if (fallbackRetry < 0 || retry < fallbackRetry) {
+            fallbackRetry = retry;
+            fallback = i;
+        }
+    }
+    // every node is skipped, use the one which is due first rather than fail the query
+    return targets.takeAt(fallback);
+}
+
+void SxNodeHealth::report(const QString &node, SxErrorCode errorCode)
+{
+    if (node.isEmpty() || errorCode == SxErrorCode::AbortedByUser)
+        return;
+    bool failed = errorCode == SxErrorCode::Timeout || errorCode == SxErrorCode::NetworkError;
+    QMutexLocker locker(&mMutex);
+    if (!failed) {
+        auto it = mNodes.find(node);
+        if (it == mNodes.end())
+            return;
+        if (it->state != State::Closed)
+            logInfo(QString("node %1 is reachable again").arg(node));
+        mNodes.erase(it);
+        return;
+    }
+    Node &stats = mNodes[node];
+    qint64 now = mClock.elapsed();
+    ++stats.failures;
+    if (stats.state == State::HalfOpen) {
+        stats.cooldown = stats.cooldown*2 > sMaxCooldown ? sMaxCooldown : stats.cooldown*2;
+        stats.state = State::Open;
+        stats.openedAt = now;
+        logWarning(QString("node %1 is still unreachable, skipping it for %2s").arg(node).arg(stats.cooldown/1000));
+    }
+    else if (stats.state == State::Closed && stats.failures >= sFailureThreshold) {
+        stats.state = State::Open;
+        stats.openedAt = now;
+        logWarning(QString("node %1 failed %2 times, skipping it for %3s").arg(node).arg(stats.failures).arg(stats.cooldown/1000));
+    }
+}
+
+/* a reply whose block data doesn't match the requested hashes opens the breaker
+ * right away, the transfer itself succeeded so report() counted it as a success */
+void SxNodeHealth::reportCorruptData(const QString &node)
+{
+    if (node.isEmpty())
+        return;
+    QMutexLocker locker(&mMutex);
+    Node &stats = mNodes[node];
+    ++stats.failures;
+    if (stats.state == State::Open)
+        return;
+    if (stats.state == State::HalfOpen)
+        stats.cooldown = stats.cooldown*2 > sMaxCooldown ? sMaxCooldown : stats.cooldown*2;
+    stats.state = State::Open;
+    stats.openedAt = mClock.elapsed();
+    logWarning(QString("node %1 returned corrupt block data, skipping it for %2s").arg(node).arg(stats.cooldown/1000));
+}
+
+SxNodeHealth::State SxNodeHealth::state(const QString &node) const
+{
+    QMutexLocker locker(&mMutex);
+    auto it = mNodes.constFind(node);
+    if (it == mNodes.constEnd())
+        return State::Closed;
+    return it->state;
+}
+
+void SxNodeHealth::reset()
+{
+    QMutexLocker locker(&mMutex);
+    mNodes.clear();
+}
@@ -0,0 +1,79 @@
+/*
+ *  Copyright (C) 2012-2016 Skylable Ltd. <info-copyright@skylable.com>
+ *
+ *  This program is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public License
+ *  as published by the Free Software Foundation; either version 2
+ *  of the License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA.
+ *
+ *  Special exception for linking this software with OpenSSL:
+ *
+ *  In addition, as a special exception, Skylable Ltd. gives permission to
+ *  link the code of this program with the OpenSSL library and distribute
+ *  linked combinations including the two. You must obey the GNU General
+ *  Public License in all respects for all of the code used other than
+ *  OpenSSL. You may extend this exception to your version of the program,
+ *  but you are not obligated to do so. If you do not wish to do so, delete
+ *  this exception statement from your version.
+ */
+
+#ifndef SXNODEHEALTH_H
+#define SXNODEHEALTH_H
+
+#include <QHash>
+#include <QMutex>
+#include <QString>
+#include <QStringList>
+#include <QElapsedTimer>
+#include "sxerror.h"
+
+/* Process wide circuit breaker for cluster nodes, shared by every cluster connection.
+ * After sFailureThreshold consecutive timeouts or network errors a node is skipped for
+ * a cooldown period, then a single probe request decides if it is back */
+class SxNodeHealth
+{
+public:
+    enum class State {
+        Closed,
+        Open,
+        HalfOpen
+    };
+    static SxNodeHealth& instance();
+    SxNodeHealth(const SxNodeHealth &) = delete;
+    SxNodeHealth &operator= (const SxNodeHealth &) = delete;
+    QString takeTarget(QStringList &targets);
+    void report(const QString &node, SxErrorCode errorCode);
+    void reportCorruptData(const QString &node);
+    State state(const QString &node) const;
+    void reset();
+
+private:
+    SxNodeHealth();
+    struct Node {
+        Node();
+        State state;
+        int failures;
+        qint64 cooldown;
+        qint64 openedAt;
+        qint64 probeStarted;
+    };
+    bool _allowRequest(Node &node, qint64 now);
+    static const int sFailureThreshold = 3;
+    static const qint64 sCooldown = 30*1000;
+    static const qint64 sMaxCooldown = 5*60*1000;
+    static const qint64 sProbeTimeout = 2*60*1000;
+    mutable QMutex mMutex;
+    QElapsedTimer mClock;
+    QHash<QString, Node> mNodes;
+};
+
+#endif // SXNODEHEALTH_H
@@ -0,0 +1,118 @@
+/*
+ *  Copyright (C) 2012-2016 Skylable Ltd. <info-copyright@skylable.com>
+ *
+ *  This program is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public License
+ *  as published by the Free Software Foundation; either version 2
+ *  of the License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA.
+ *
+ *  Special exception for linking this software with OpenSSL:
+ *
+ *  In addition, as a special exception, Skylable Ltd. gives permission to
+ *  link the code of this program with the OpenSSL library and distribute
+ *  linked combinations including the two. You must obey the GNU General
+ *  Public License in all respects for all of the code used other than
+ *  OpenSSL. You may extend this exception to your version of the program,
+ *  but you are not obligated to do so. If you do not wish to do so, delete
+ *  this exception statement from your version.
+ */
+
+#include "sxprofiler.h"
+
+#include <QStringList>
+
+SxProfiler &SxProfiler::instance()
+{
+    static SxProfiler sInstance;
+    return sInstance;
+}
+
+SxProfiler::SxProfiler()
+{
+    mWallTime.start();
+}
+
+SxProfiler::Phase::Phase()
+{
+    calls = 0;
+    nsecs = 0;
+    max = 0;
+}
+
+bool SxProfiler::isEnabled() const
+{
+    return mEnabled.load() != 0;
+}
+
+void SxProfiler::setEnabled(bool enabled)
+{
+    if (enabled && !isEnabled())
+        reset();
+    mEnabled.store(enabled ? 1 : 0);
+}
+
+void SxProfiler::add(const char *phase, qint64 nsecs)
+{
+    if (!isEnabled())
+        return;
+    QMutexLocker locker(&mMutex);
+    Phase &p = mPhases[QByteArray(phase)];
+    ++p.calls;
+    p.nsecs += nsecs;
+    if (nsecs > p.max)
+        p.max = nsecs;
+}
+
+void SxProfiler::reset()
+{
+    QMutexLocker locker(&mMutex);
+    mPhases.clear();
+    mWallTime.restart();
+}
+
+QString SxProfiler::report() const
+{
+    QMutexLocker locker(&mMutex);
+    qint64 wall = qMax<qint64>(1, mWallTime.nsecsElapsed());
+    QStringList lines;
+    // phases running on several threads at once can add up to more than the wall time
+    lines.append(QString("profiled for %1 s").arg(static_cast<double>(wall)/1e9, 0, 'f', 1));
+    lines.append(QString("%1 %2 %3 %4 %5 %6")
+                 .arg("phase", -20).arg("calls", 9).arg("total ms", 10)
+                 .arg("avg ms", 9).arg("max ms", 9).arg("wall %", 7));
+    for (auto it = mPhases.constBegin(); it != mPhases.constEnd(); ++it) {
+        const Phase &p = it.value();
+        lines.append(QString("%1 %2 %3 %4 %5 %6")
+                     .arg(QString::fromLatin1(it.key()), -20).arg(p.calls, 9)
+                     .arg(static_cast<double>(p.nsecs)/1e6, 10, 'f', 1)
+                     .arg(static_cast<double>(p.nsecs)/1e6/p.calls, 9, 'f', 2)
+                     .arg(static_cast<double>(p.max)/1e6, 9, 'f', 1)
+                     .arg(static_cast<double>(p.nsecs)*100/wall, 7, 'f', 1));
+    }
+    return lines.join("\n");
+}
+
+SxProfileScope::SxProfileScope(const char *phase)
+{
+    if (SxProfiler::instance().isEnabled()) {
+        mPhase = phase;
+        mTimer.start();
+    }
+    else
+        mPhase = nullptr;
+}
+
+SxProfileScope::~SxProfileScope()
+{
+    if (mPhase)
+        SxProfiler::instance().add(mPhase, mTimer.nsecsElapsed());
+}
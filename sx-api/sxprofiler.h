@@ -0,0 +1,80 @@
+/*
+ *  Copyright (C) 2012-2016 Skylable Ltd. <info-copyright@skylable.com>
+ *
+ *  This program is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public License
+ *  as published by the Free Software Foundation; either version 2
+ *  of the License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA.
+ *
+ *  Special exception for linking this software with OpenSSL:
+ *
+ *  In addition, as a special exception, Skylable Ltd. gives permission to
+ *  link the code of this program with the OpenSSL library and distribute
+ *  linked combinations including the two. You must obey the GNU General
+ *  Public License in all respects for all of the code used other than
+ *  OpenSSL. You may extend this exception to your version of the program,
+ *  but you are not obligated to do so. If you do not wish to do so, delete
+ *  this exception statement from your version.
+ */
+
+#ifndef SXPROFILER_H
+#define SXPROFILER_H
+
+#include <QString>
+#include <QMap>
+#include <QMutex>
+#include <QAtomicInt>
+#include <QElapsedTimer>
+
+/* Time spent in the main sync phases, collected when profiling is enabled and reported on exit */
+class SxProfiler
+{
+public:
+    static SxProfiler& instance();
+    SxProfiler(const SxProfiler &) = delete;
+    SxProfiler &operator= (const SxProfiler &) = delete;
+    bool isEnabled() const;
+    void setEnabled(bool enabled);
+    void add(const char *phase, qint64 nsecs);
+    void reset();
+    QString report() const;
+
+private:
+    SxProfiler();
+    struct Phase {
+        Phase();
+        qint64 calls;
+        qint64 nsecs;
+        qint64 max;
+    };
+    QAtomicInt mEnabled;
+    mutable QMutex mMutex;
+    QMap<QByteArray, Phase> mPhases;
+    QElapsedTimer mWallTime;
+};
+
+class SxProfileScope
+{
+public:
+    explicit SxProfileScope(const char *phase);
+    ~SxProfileScope();
+private:
+    const char *mPhase;
+    QElapsedTimer mTimer;
+};
+
+#define SXPROFILE_CONCAT_(a, b) a##b
+#define SXPROFILE_CONCAT(a, b) SXPROFILE_CONCAT_(a, b)
+// times the rest of the enclosing block as the given phase
+#define sxProfile(phase) SxProfileScope SXPROFILE_CONCAT(_sxProfileScope, __LINE__)(phase)
+
+#endif // SXPROFILER_H
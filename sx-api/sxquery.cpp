@@ -27,26 +27,132 @@
  */
 
 #include "sxquery.h"
-#include <QMessageAuthenticationCode>
+#include <QDateTime>
+#include <QHash>
+#include <QMutex>
+#include <QMutexLocker>
 #include <QNetworkRequest>
 #include <QSslConfiguration>
+#include <openssl/sha.h>
+#include <cstdio>
+#include <cstring>
+#include <memory>
 #include "sxcluster.h"
 #include "sxlog.h"
 
 static int number_generator = 0;
-const QStringList SxQuery::m_months = {"Jan", "Feb", "Mar", "Apr", "May", "Jun", "Jul", "Aug", "Sep", "Oct", "Nov", "Dec"};
-const QStringList SxQuery::m_wdays = { "Mon", "Tue", "Wed", "Thu", "Fri", "Sat", "Sun"};
 
-SxQuery::SxQuery(const QString &path, const SxQuery::QueryType &type, const QByteArray &body) : number(number_generator++)
+/* the parts of a request signature that don't change from one request to the next, built
+ * once and shared by every thread sending queries: the date of the current second, the
+ * hmac states after the padded token key and the scheme, host and port of each node */
+struct HmacKey {
+    SHA_CTX inner;
+    SHA_CTX outer;
+};
+
+static QMutex sRequestCacheMutex;
+static qint64 sDateSecond = -1;
+static QByteArray sDate;
+static QHash<QByteArray, std::shared_ptr<const HmacKey>> sHmacKeys;
+static QHash<QString, QString> sUrlPrefixes;
+static const int sHmacKeysLimit = 16;
+static const int sUrlPrefixesLimit = 256;
+
+// RFC 1123 date, the format the cluster checks the signature against
+static QByteArray httpDate(qint64 second)
+{
+    static const char *weekDays[] = {"Mon", "Tue", "Wed", "Thu", "Fri", "Sat", "Sun"};
+    static const char *months[] = {"Jan", "Feb", "Mar", "Apr", "May", "Jun", "Jul", "Aug", "Sep", "Oct", "Nov", "Dec"};
+    QMutexLocker locker(&sRequestCacheMutex);
+    if (second != sDateSecond) {
+        QDateTime dateTime = QDateTime::fromMSecsSinceEpoch(second*1000, Qt::UTC);
+        QDate date = dateTime.date();
+        QTime time = dateTime.time();
+        char buffer[32];
+        snprintf(buffer, sizeof(buffer), "%s, %02d %s %04d %02d:%02d:%02d GMT",
+                 weekDays[date.dayOfWeek()-1], date.day(), months[date.month()-1], date.year(),
+                 time.hour(), time.minute(), time.second());
+        sDateSecond = second;
+        sDate = QByteArray(buffer);
+    }
+    return sDate;
+}
+
+static std::shared_ptr<const HmacKey> hmacKey(const QByteArray &key)
+{
+    QMutexLocker locker(&sRequestCacheMutex);
+    auto cached = sHmacKeys.constFind(key);
+    if (cached != sHmacKeys.constEnd())
+        return cached.value();
+    unsigned char block[SHA_CBLOCK] = {0};
+    if (key.size() > SHA_CBLOCK)
+        SHA1(reinterpret_cast<const unsigned char*>(key.constData()), static_cast<size_t>(key.size()), block);
+    else
+        memcpy(block, key.constData(), static_cast<size_t>(key.size()));
+    unsigned char innerPad[SHA_CBLOCK];
+    unsigned char outerPad[SHA_CBLOCK];
+    for (int i=0; i<SHA_CBLOCK; i++) {
+        innerPad[i] = block[i] ^ 0x36;
+        outerPad[i] = block[i] ^ 0x5c;
+    }
+    auto hmac = std::make_shared<HmacKey>();
+    SHA1_Init(&hmac->inner);
+    SHA1_Update(&hmac->inner, innerPad, SHA_CBLOCK);
+    SHA1_Init(&hmac->outer);
+    SHA1_Update(&hmac->outer, outerPad, SHA_CBLOCK);
+    if (sHmacKeys.size() >= sHmacKeysLimit)
+        sHmacKeys.clear();
+    sHmacKeys.insert(key, hmac);
+    return hmac;
+}
+
+static QString urlPrefix(const QString &target, const SxAuth &sxAuth)
+{
+    QString key = target+(sxAuth.use_ssl() ? "|s|" : "|p|")+QString::number(sxAuth.port());
+    QMutexLocker locker(&sRequestCacheMutex);
+    auto cached = sUrlPrefixes.constFind(key);
+    if (cached != sUrlPrefixes.constEnd())
+        return cached.value();
+    QString prefix = (sxAuth.use_ssl() ? "https://" : "http://")
+            + target
+            + ((sxAuth.use_ssl() && sxAuth.port() != 443) || (!sxAuth.use_ssl() && sxAuth.port() != 80) ? ":" + QString::number(sxAuth.port()) : "");
+    if (sUrlPrefixes.size() >= sUrlPrefixesLimit)
+        sUrlPrefixes.clear();
+    sUrlPrefixes.insert(key, prefix);
+    return prefix;
+}
+
+/* json replies (listings, locate, metadata) are worth compressing, block data is not */
+static bool defaultCompressedReply(const QString &path, SxQuery::QueryType type)
+{
+    if (type != SxQuery::GET)
+        return false;
+    return !path.startsWith("/.data/") && !path.startsWith(".data/");
+}
+
+SxQuery::SxQuery(const QString &path, const SxQuery::QueryType &type, const QByteArray &body) : number(number_generator++), mCensus(sizeof(SxQuery)+body.size())
 {
     mPath = path;
     mQueryType = type;
     mBody = body;
+    mExpectedSize = 0;
+    mCompressedReply = defaultCompressedReply(path, type);
     QCryptographicHash sha1(QCryptographicHash::Sha1);
     sha1.addData(body);
     mBodyHash = sha1.result().toHex();
 }
 
+/* bodyHash is the hex encoded sha1 of body, already computed by the caller */
+SxQuery::SxQuery(const QString &path, const SxQuery::QueryType &type, const QByteArray &body, const QByteArray &bodyHash) : number(number_generator++), mCensus(sizeof(SxQuery)+body.size())
+{
+    mPath = path;
+    mQueryType = type;
+    mBody = body;
+    mExpectedSize = 0;
+    mCompressedReply = defaultCompressedReply(path, type);
+    mBodyHash = bodyHash;
+}
+
 SxQuery::~SxQuery()
 {
 }
@@ -79,65 +185,69 @@ QNetworkRequest SxQuery::makeRequest(const QString& target, const SxAuth& sxAuth
     else
         path = "/"+mPath;
 
-    QUrl url((sxAuth.use_ssl() ? "https://" : "http://")
-            + target
-            + ((sxAuth.use_ssl() && sxAuth.port() != 443) || (!sxAuth.use_ssl() && sxAuth.port() != 80) ? ":" + QString::number(sxAuth.port()) : "")
-            + path, QUrl::TolerantMode);
+    QUrl url(urlPrefix(target, sxAuth) + path, QUrl::TolerantMode);
 
     if(!url.isValid())
         return ret;
     url.setUrl(url.toEncoded(QUrl::NormalizePathSegments));
 
-    QMessageAuthenticationCode hmac(QCryptographicHash::Sha1, sxAuth.token_key());
+    QByteArray message;
     switch(mQueryType) {
     case GET:
-        hmac.addData("GET");
+        message = "GET";
         break;
     case PUT:
     case JOB_PUT:
-        hmac.addData("PUT");
+        message = "PUT";
         break;
     case DELETE:
     case JOB_DELETE:
-        hmac.addData("DELETE");
+        message = "DELETE";
         break;
     case HEAD:
-        hmac.addData("HEAD");
+        message = "HEAD";
         break;
     }
-    hmac.addData("\n");
+    message.append('\n');
+
+    message.append(url.toEncoded(QUrl::RemoveScheme | QUrl::RemoveAuthority).mid(1));
+    message.append('\n');
 
-    hmac.addData(url.toEncoded(QUrl::RemoveScheme | QUrl::RemoveAuthority).mid(1));
-    hmac.addData("\n");
+    QByteArray date = httpDate(QDateTime::currentMSecsSinceEpoch()/1000 + time_drift);
+    message.append(date);
+    message.append('\n');
 
-    QDateTime qdt = QDateTime::currentDateTimeUtc();
-    qdt = qdt.addSecs(time_drift);
-    QString dtstr =
-        m_wdays.at(qdt.date().dayOfWeek() - 1) + ", " +
-        qdt.toString("dd") + " " +
-        m_months.at(qdt.date().month() - 1) + " " +
-        qdt.toString("yyyy hh:mm:ss") + " GMT";
-    hmac.addData(dtstr.toUtf8());
-    hmac.addData("\n");
+    message.append(mBodyHash);
+    message.append('\n');
 
-    hmac.addData(mBodyHash);
-    hmac.addData("\n");
+    // hmac-sha1 continued from the states kept for the key
+    std::shared_ptr<const HmacKey> key = hmacKey(sxAuth.token_key());
+    unsigned char digest[SHA_DIGEST_LENGTH];
+    SHA_CTX ctx = key->inner;
+    SHA1_Update(&ctx, message.constData(), static_cast<size_t>(message.size()));
+    SHA1_Final(digest, &ctx);
+    ctx = key->outer;
+    SHA1_Update(&ctx, digest, SHA_DIGEST_LENGTH);
+    SHA1_Final(digest, &ctx);
 
     ret.setUrl(url);
     ret.setHeader(QNetworkRequest::UserAgentHeader, "sxqt-"+SxCluster::getClientVersion());
-    ret.setRawHeader("Date", dtstr.toUtf8());
+    ret.setRawHeader("Date", date);
     if (!etag.isEmpty())
     {
         ret.setRawHeader("If-None-Match", etag.toUtf8());
     }
     QByteArray auth = sxAuth.token_user();
-    auth.append(hmac.result());
+    auth.append(reinterpret_cast<const char*>(digest), SHA_DIGEST_LENGTH);
     auth.append(QByteArray(2, 0));
     ret.setRawHeader("Authorization", QString(QString("SKY ") + auth.toBase64()).toUtf8());
     ret.setRawHeader("SX-Cluster-Name", sxAuth.clusterName().toUtf8());
 
     if(!mBody.isEmpty())
         ret.setHeader(QNetworkRequest::ContentTypeHeader, "application/octet-stream");
+    // without the header Qt asks for gzip and deflate and inflates the reply while it arrives
+    if (!mCompressedReply)
+        ret.setRawHeader("Accept-Encoding", "identity");
 
     return ret;
 }
@@ -146,3 +256,23 @@ const QByteArray &SxQuery::body() const
 {
     return mBody;
 }
+
+qint64 SxQuery::expectedSize() const
+{
+    return mExpectedSize;
+}
+
+void SxQuery::setExpectedSize(qint64 size)
+{
+    mExpectedSize = size;
+}
+
+bool SxQuery::compressedReply() const
+{
+    return mCompressedReply;
+}
+
+void SxQuery::setCompressedReply(bool compressed)
+{
+    mCompressedReply = compressed;
+}
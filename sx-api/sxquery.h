@@ -33,6 +33,7 @@
 #include <QNetworkRequest>
 
 #include "sxauth.h"
+#include "sxcensus.h"
 
 class SxQuery {
 public:
@@ -45,19 +46,24 @@ public:
         JOB_DELETE
     };
     SxQuery(const QString& path, const QueryType& type, const QByteArray &body);
+    SxQuery(const QString& path, const QueryType& type, const QByteArray &body, const QByteArray &bodyHash);
     ~SxQuery();
     QueryType queryType();
     QNetworkRequest makeRequest(const QString &target, const SxAuth &sxAuth, const qint64 time_drift, const QString &etag);
     const QByteArray& body() const;
+    qint64 expectedSize() const;
+    void setExpectedSize(qint64 size);
+    bool compressedReply() const;
+    void setCompressedReply(bool compressed);
     const int number;
 private:
     QString mPath;
     QueryType mQueryType;
     QByteArray mBody;
     QByteArray mBodyHash;
-
-    static const QStringList m_months;
-    static const QStringList m_wdays;
+    qint64 mExpectedSize;
+    bool mCompressedReply;
+    SxCensusEntry<SxCensus::Query> mCensus;
 };
 
 #endif // SXQUERY_H
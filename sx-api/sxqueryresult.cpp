@@ -29,14 +29,14 @@
 #include "sxqueryresult.h"
 #include <QDebug>
 
-SxQueryResult::SxQueryResult()
+SxQueryResult::SxQueryResult() : mCensus(sizeof(SxQueryResult))
 {
     mError = SxError(SxErrorCode::UnknownError, "", "", "", "");
     mReturnCode = 0;
     mViaSxCache = false;
 }
 
-SxQueryResult::SxQueryResult(const QString& host, int returnCode, const SxError& error, const  QByteArray &data, const bool &viaSxCache, const QString &etag)
+SxQueryResult::SxQueryResult(const QString& host, int returnCode, const SxError& error, const  QByteArray &data, const bool &viaSxCache, const QString &etag) : mCensus(sizeof(SxQueryResult)+data.size())
 {
     mHost = host;
     mError = error;
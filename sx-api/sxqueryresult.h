@@ -32,6 +32,7 @@
 #include <QObject>
 #include <QByteArray>
 #include "sxerror.h"
+#include "sxcensus.h"
 
 class SxQueryResult
 {
@@ -53,6 +54,7 @@ private:
     bool mViaSxCache;
     QString mEtag;
     int mReturnCode;
+    SxCensusEntry<SxCensus::QueryResult> mCensus;
 };
 
 #endif // SXQUERYRESULT_H
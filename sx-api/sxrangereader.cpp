@@ -0,0 +1,172 @@
+/*
+ *  Copyright (C) 2012-2016 Skylable Ltd. <info-copyright@skylable.com>
+ *
+ *  This program is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public License
+ *  as published by the Free Software Foundation; either version 2
+ *  of the License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA.
+ *
+ *  Special exception for linking this software with OpenSSL:
+ *
+ *  In addition, as a special exception, Skylable Ltd. gives permission to
+ *  link the code of this program with the OpenSSL library and distribute
+ *  linked combinations including the two. You must obey the GNU General
+ *  Public License in all respects for all of the code used other than
+ *  OpenSSL. You may extend this exception to your version of the program,
+ *  but you are not obligated to do so. If you do not wish to do so, delete
+ *  this exception statement from your version.
+ */
+
+#include "sxrangereader.h"
+#include "sxcluster.h"
+#include "sxfile.h"
+#include "sxlog.h"
+
+#include <cstring>
+
+SxRangeReader::SxRangeReader(SxCluster *cluster, SxVolume *volume, const QString &path, const QString &revision)
+{
+    mCluster = cluster;
+    mFile.reset(new SxFile(volume, path, revision, true));
+    mOpened = false;
+    mCacheSize = 0;
+    mNextOffset = -1;
+    mReadAhead = 0;
+}
+
+SxRangeReader::~SxRangeReader()
+{
+}
+
+bool SxRangeReader::open()
+{
+    if (mOpened)
+        return true;
+    if (!mCluster->openRemoteFile(*mFile)) {
+        mLastError = mCluster->lastError();
+        return false;
+    }
+    mOpened = true;
+    return true;
+}
+
+qint64 SxRangeReader::size() const
+{
+    return mOpened ? mFile->remoteSize() : -1;
+}
+
+/* the revision being read, resolved on open when none was given */
+QString SxRangeReader::revision() const
+{
+    return mOpened ? mFile->revision() : QString();
+}
+
+SxError SxRangeReader::lastError() const
+{
+    return mLastError;
+}
+
+bool SxRangeReader::read(qint64 offset, qint64 length, QByteArray &data)
+{
+    data.clear();
+    if (!open())
+        return false;
+    if (offset < 0 || length < 0) {
+        mLastError = SxError(SxErrorCode::UnknownError, "invalid range", QCoreApplication::translate("SxErrorMessage", "invalid range"));
+        return false;
+    }
+    const qint64 fileSize = mFile->remoteSize();
+    if (offset >= fileSize || length == 0)
+        return true;
+    length = qMin(length, fileSize - offset);
+    const int blockSize = mFile->blockSize();
+    const int firstBlock = static_cast<int>(offset / blockSize);
+    const int lastBlock = static_cast<int>((offset + length - 1) / blockSize);
+
+    // every read continuing the previous one doubles the read-ahead window
+    const int readAheadMax = static_cast<int>(qMax<qint64>(1, sReadAheadLimit / blockSize));
+    if (offset == mNextOffset)
+        mReadAhead = qBound(1, mReadAhead*2, readAheadMax);
+    else
+        mReadAhead = 0;
+    mNextOffset = offset + length;
+
+    QList<int> needed;
+    QList<int> covering;
+    for (int i=firstBlock; i<=lastBlock; i++) {
+        covering.append(i);
+        if (!mCache.contains(i))
+            needed.append(i);
+    }
+    if (!needed.isEmpty() || mReadAhead > 0) {
+        for (int i=lastBlock+1; i<=lastBlock+mReadAhead && i<mFile->blockCount(); i++) {
+            if (!mCache.contains(i))
+                needed.append(i);
+        }
+    }
+    if (!needed.isEmpty()) {
+        bool ok = mCluster->readBlocks(*mFile, needed, [this](int index, const char *blockData) {
+            _cacheBlock(index, blockData);
+        });
+        if (!ok) {
+            mLastError = mCluster->lastError();
+            return false;
+        }
+    }
+
+    data.resize(static_cast<int>(length));
+    foreach (int index, covering) {
+        qint64 blockStart = static_cast<qint64>(index)*blockSize;
+        qint64 from = qMax(offset, blockStart);
+        qint64 to = qMin(offset + length, blockStart + blockSize);
+        auto it = mCache.constFind(index);
+        if (it == mCache.constEnd()) {
+            mLastError = SxError::errorBadReplyContent();
+            data.clear();
+            return false;
+        }
+        if (it.value().isEmpty())
+            memset(data.data() + (from - offset), 0, static_cast<size_t>(to - from));
+        else
+            memcpy(data.data() + (from - offset), it.value().constData() + (from - blockStart), static_cast<size_t>(to - from));
+        mCacheOrder.removeOne(index);
+        mCacheOrder.append(index);
+    }
+    _evict(covering);
+    return true;
+}
+
+/* zero blocks are cached as empty arrays */
+void SxRangeReader::_cacheBlock(int index, const char *data)
+{
+    if (mCache.contains(index))
+        return;
+    QByteArray block;
+    if (data)
+        block = QByteArray(data, mFile->blockSize());
+    mCacheSize += block.size();
+    mCache.insert(index, block);
+    mCacheOrder.append(index);
+}
+
+void SxRangeReader::_evict(const QList<int> &keep)
+{
+    for (int i=0; i<mCacheOrder.count() && mCacheSize > sCacheLimit; ) {
+        int index = mCacheOrder.at(i);
+        if (keep.contains(index)) {
+            i++;
+            continue;
+        }
+        mCacheSize -= mCache.take(index).size();
+        mCacheOrder.removeAt(i);
+    }
+}
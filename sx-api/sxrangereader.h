@@ -0,0 +1,73 @@
+/*
+ *  Copyright (C) 2012-2016 Skylable Ltd. <info-copyright@skylable.com>
+ *
+ *  This program is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public License
+ *  as published by the Free Software Foundation; either version 2
+ *  of the License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA.
+ *
+ *  Special exception for linking this software with OpenSSL:
+ *
+ *  In addition, as a special exception, Skylable Ltd. gives permission to
+ *  link the code of this program with the OpenSSL library and distribute
+ *  linked combinations including the two. You must obey the GNU General
+ *  Public License in all respects for all of the code used other than
+ *  OpenSSL. You may extend this exception to your version of the program,
+ *  but you are not obligated to do so. If you do not wish to do so, delete
+ *  this exception statement from your version.
+ */
+
+#ifndef SXRANGEREADER_H
+#define SXRANGEREADER_H
+
+#include <QByteArray>
+#include <QHash>
+#include <QList>
+#include <memory>
+#include "sxerror.h"
+
+class SxCluster;
+class SxFile;
+class SxVolume;
+
+/* Random access to the content of a remote file. Only the blocks covering a read are
+ * downloaded, recently used blocks stay in a small cache and sequential reads fetch
+ * a growing window of blocks ahead. */
+class SxRangeReader
+{
+public:
+    SxRangeReader(SxCluster *cluster, SxVolume *volume, const QString &path, const QString &revision = QString());
+    ~SxRangeReader();
+    bool open();
+    qint64 size() const;
+    QString revision() const;
+    bool read(qint64 offset, qint64 length, QByteArray &data);
+    SxError lastError() const;
+
+private:
+    void _cacheBlock(int index, const char *data);
+    void _evict(const QList<int> &keep);
+
+    SxCluster *mCluster;
+    std::unique_ptr<SxFile> mFile;
+    bool mOpened;
+    SxError mLastError;
+    QHash<int, QByteArray> mCache;
+    QList<int> mCacheOrder;
+    qint64 mCacheSize;
+    qint64 mNextOffset;
+    int mReadAhead;
+    static const qint64 sCacheLimit = 32*1024*1024;
+    static const qint64 sReadAheadLimit = 8*1024*1024;
+};
+
+#endif // SXRANGEREADER_H
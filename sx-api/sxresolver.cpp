@@ -0,0 +1,124 @@
+/*
+ *  Copyright (C) 2012-2016 Skylable Ltd. <info-copyright@skylable.com>
+ *
+ *  This program is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public License
+ *  as published by the Free Software Foundation; either version 2
+ *  of the License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA.
+ *
+ *  Special exception for linking this software with OpenSSL:
+ *
+ *  In addition, as a special exception, Skylable Ltd. gives permission to
+ *  link the code of this program with the OpenSSL library and distribute
+ *  linked combinations including the two. You must obey the GNU General
+ *  Public License in all respects for all of the code used other than
+ *  OpenSSL. You may extend this exception to your version of the program,
+ *  but you are not obligated to do so. If you do not wish to do so, delete
+ *  this exception statement from your version.
+ */
+
+#include "sxresolver.h"
+#include "sxlog.h"
+
+#include <QEventLoop>
+#include <QFutureWatcher>
+#include <QHostAddress>
+#include <QHostInfo>
+#include <QTimer>
+#include <QtConcurrent>
+
+SxResolver &SxResolver::instance()
+{
+    static SxResolver sInstance;
+    return sInstance;
+}
+
+SxResolver::SxResolver()
+{
+    mClock.start();
+}
+
+QStringList SxResolver::_lookup(const QString &host)
+{
+    QHostInfo hostInfo = QHostInfo::fromName(host);
+    // alternate address families, so the first connection attempts do not all
+    // go through a family which may be broken on this network
+    QStringList first, second;
+    QAbstractSocket::NetworkLayerProtocol firstProtocol = QAbstractSocket::UnknownNetworkLayerProtocol;
+    foreach (QHostAddress address, hostInfo.addresses()) {
+        if (firstProtocol == QAbstractSocket::UnknownNetworkLayerProtocol)
+            firstProtocol = address.protocol();
+        if (address.protocol() == firstProtocol)
+            first.append(address.toString());
+        else
+            second.append(address.toString());
+    }
+    QStringList addresses;
+    while (!first.isEmpty() || !second.isEmpty()) {
+        if (!first.isEmpty())
+            addresses.append(first.takeFirst());
+        if (!second.isEmpty())
+            addresses.append(second.takeFirst());
+    }
+
+    QMutexLocker locker(&mMutex);
+    Entry &entry = mCache[host];
+    entry.refreshing = false;
+    // a failed lookup keeps the previous addresses
+    if (!addresses.isEmpty()) {
+        entry.addresses = addresses;
+        entry.resolved = mClock.elapsed();
+    }
+    else if (entry.addresses.isEmpty()) {
+        mCache.remove(host);
+    }
+    return addresses;
+}
+
+QStringList SxResolver::resolve(const QString &host, int timeout)
+{
+    QHostAddress literal;
+    if (literal.setAddress(host))
+        return {host};
+    {
+        QMutexLocker locker(&mMutex);
+        auto it = mCache.find(host);
+        if (it != mCache.end() && !it->addresses.isEmpty()) {
+            if (mClock.elapsed() - it->resolved < sTtl)
+                return it->addresses;
+            if (!it->refreshing) {
+                it->refreshing = true;
+                QtConcurrent::run(this, &SxResolver::_lookup, host);
+            }
+            return it->addresses;
+        }
+    }
+    QFutureWatcher<QStringList> watcher;
+    QEventLoop loop;
+    QObject::connect(&watcher, &QFutureWatcher<QStringList>::finished, &loop, &QEventLoop::quit);
+    QTimer::singleShot(timeout, &loop, SLOT(quit()));
+    watcher.setFuture(QtConcurrent::run(this, &SxResolver::_lookup, host));
+    if (!watcher.isFinished())
+        loop.exec();
+    if (!watcher.isFinished()) {
+        // the lookup keeps running and fills the cache for the next attempt
+        logWarning(QString("resolving %1 timed out").arg(host));
+        return QStringList();
+    }
+    return watcher.result();
+}
+
+void SxResolver::clear()
+{
+    QMutexLocker locker(&mMutex);
+    mCache.clear();
+}
@@ -0,0 +1,65 @@
+/*
+ *  Copyright (C) 2012-2016 Skylable Ltd. <info-copyright@skylable.com>
+ *
+ *  This program is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public License
+ *  as published by the Free Software Foundation; either version 2
+ *  of the License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA.
+ *
+ *  Special exception for linking this software with OpenSSL:
+ *
+ *  In addition, as a special exception, Skylable Ltd. gives permission to
+ *  link the code of this program with the OpenSSL library and distribute
+ *  linked combinations including the two. You must obey the GNU General
+ *  Public License in all respects for all of the code used other than
+ *  OpenSSL. You may extend this exception to your version of the program,
+ *  but you are not obligated to do so. If you do not wish to do so, delete
+ *  this exception statement from your version.
+ */
+
+#ifndef SXRESOLVER_H
+#define SXRESOLVER_H
+
+#include <QHash>
+#include <QMutex>
+#include <QString>
+#include <QStringList>
+#include <QElapsedTimer>
+
+/* Process wide cache of resolved cluster addresses. Lookups run in the thread pool,
+ * the caller only waits for them in a local event loop, and an expired entry is
+ * returned as is while it gets refreshed in the background */
+class SxResolver
+{
+public:
+    static SxResolver& instance();
+    SxResolver(const SxResolver &) = delete;
+    SxResolver &operator= (const SxResolver &) = delete;
+    QStringList resolve(const QString &host, int timeout = sResolveTimeout);
+    void clear();
+
+private:
+    SxResolver();
+    struct Entry {
+        QStringList addresses;
+        qint64 resolved;
+        bool refreshing;
+    };
+    QStringList _lookup(const QString &host);
+    static const qint64 sTtl = 5*60*1000;
+    static const int sResolveTimeout = 10*1000;
+    mutable QMutex mMutex;
+    QElapsedTimer mClock;
+    QHash<QString, Entry> mCache;
+};
+
+#endif // SXRESOLVER_H
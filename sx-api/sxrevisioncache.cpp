@@ -0,0 +1,85 @@
+/*
+ *  Copyright (C) 2012-2016 Skylable Ltd. <info-copyright@skylable.com>
+ *
+ *  This program is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public License
+ *  as published by the Free Software Foundation; either version 2
+ *  of the License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA.
+ *
+ *  Special exception for linking this software with OpenSSL:
+ *
+ *  In addition, as a special exception, Skylable Ltd. gives permission to
+ *  link the code of this program with the OpenSSL library and distribute
+ *  linked combinations including the two. You must obey the GNU General
+ *  Public License in all respects for all of the code used other than
+ *  OpenSSL. You may extend this exception to your version of the program,
+ *  but you are not obligated to do so. If you do not wish to do so, delete
+ *  this exception statement from your version.
+ */
+
+#include "sxrevisioncache.h"
+
+#include <algorithm>
+
+SxRevisionCache &SxRevisionCache::instance()
+{
+    static SxRevisionCache sInstance;
+    return sInstance;
+}
+
+SxRevisionCache::SxRevisionCache()
+{
+    mUseCounter = 0;
+}
+
+QString SxRevisionCache::_key(const QString &volume, const QString &path)
+{
+    return volume+(path.startsWith("/") ? path : "/"+path);
+}
+
+bool SxRevisionCache::get(const QByteArray &clusterUuid, const QString &volume, const QString &path, RevisionList &list) const
+{
+    QMutexLocker locker(&mMutex);
+    auto it = mEntries.find(_key(volume, path));
+    if (it == mEntries.end() || it->clusterUuid != clusterUuid)
+        return false;
+    it->lastUse = ++mUseCounter;
+    list = it->revisions;
+    return true;
+}
+
+void SxRevisionCache::put(const QByteArray &clusterUuid, const QString &volume, const QString &path, const RevisionList &list)
+{
+    QMutexLocker locker(&mMutex);
+    mEntries.insert(_key(volume, path), {clusterUuid, list, ++mUseCounter});
+    if (mEntries.count() <= sMaxEntries)
+        return;
+    // drop the least recently used half at once instead of one entry per insert
+    QList<qint64> uses;
+    foreach (const Entry &entry, mEntries) {
+        uses.append(entry.lastUse);
+    }
+    std::nth_element(uses.begin(), uses.begin()+uses.count()/2, uses.end());
+    qint64 threshold = uses.at(uses.count()/2);
+    for (auto it = mEntries.begin(); it != mEntries.end(); ) {
+        if (it->lastUse < threshold)
+            it = mEntries.erase(it);
+        else
+            ++it;
+    }
+}
+
+void SxRevisionCache::invalidate(const QString &volume, const QString &path)
+{
+    QMutexLocker locker(&mMutex);
+    mEntries.remove(_key(volume, path));
+}
@@ -0,0 +1,67 @@
+/*
+ *  Copyright (C) 2012-2016 Skylable Ltd. <info-copyright@skylable.com>
+ *
+ *  This program is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public License
+ *  as published by the Free Software Foundation; either version 2
+ *  of the License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA.
+ *
+ *  Special exception for linking this software with OpenSSL:
+ *
+ *  In addition, as a special exception, Skylable Ltd. gives permission to
+ *  link the code of this program with the OpenSSL library and distribute
+ *  linked combinations including the two. You must obey the GNU General
+ *  Public License in all respects for all of the code used other than
+ *  OpenSSL. You may extend this exception to your version of the program,
+ *  but you are not obligated to do so. If you do not wish to do so, delete
+ *  this exception statement from your version.
+ */
+
+#ifndef SXREVISIONCACHE_H
+#define SXREVISIONCACHE_H
+
+#include <QByteArray>
+#include <QHash>
+#include <QList>
+#include <QMutex>
+#include <QString>
+#include <tuple>
+
+/* Process wide cache of file revision lists, so revision dialogs can show the last known
+ * list at once and refresh it in the background. Entries are dropped whenever the file
+ * is uploaded, downloaded or removed */
+class SxRevisionCache
+{
+public:
+    typedef QList<std::tuple<QString, qint64, quint32>> RevisionList;
+    static SxRevisionCache& instance();
+    SxRevisionCache(const SxRevisionCache &) = delete;
+    SxRevisionCache &operator= (const SxRevisionCache &) = delete;
+    bool get(const QByteArray &clusterUuid, const QString &volume, const QString &path, RevisionList &list) const;
+    void put(const QByteArray &clusterUuid, const QString &volume, const QString &path, const RevisionList &list);
+    void invalidate(const QString &volume, const QString &path);
+
+private:
+    SxRevisionCache();
+    static QString _key(const QString &volume, const QString &path);
+    struct Entry {
+        QByteArray clusterUuid;
+        RevisionList revisions;
+        qint64 lastUse;
+    };
+    static const int sMaxEntries = 1000;
+    mutable QMutex mMutex;
+    mutable qint64 mUseCounter;
+    mutable QHash<QString, Entry> mEntries;
+};
+
+#endif // SXREVISIONCACHE_H
@@ -0,0 +1,125 @@
+/*
+ *  Copyright (C) 2012-2016 Skylable Ltd. <info-copyright@skylable.com>
+ *
+ *  This program is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public License
+ *  as published by the Free Software Foundation; either version 2
+ *  of the License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA.
+ *
+ *  Special exception for linking this software with OpenSSL:
+ *
+ *  In addition, as a special exception, Skylable Ltd. gives permission to
+ *  link the code of this program with the OpenSSL library and distribute
+ *  linked combinations including the two. You must obey the GNU General
+ *  Public License in all respects for all of the code used other than
+ *  OpenSSL. You may extend this exception to your version of the program,
+ *  but you are not obligated to do so. If you do not wish to do so, delete
+ *  this exception statement from your version.
+ */
+
+#include "sxsyncblocks.h"
+#include "sxblock.h"
+
+#include <QFile>
+
+SxSyncBlocks &SxSyncBlocks::instance()
+{
+    static SxSyncBlocks sInstance;
+    return sInstance;
+}
+
+SxSyncBlocks::SxSyncBlocks()
+{
+}
+
+/* keys look like <blockSize>/<hash>, the first location of a block is kept */
+void SxSyncBlocks::add(const QString &hash, int blockSize, const QString &file, qint64 offset)
+{
+    QMutexLocker locker(&mMutex);
+    if (mBlocks.count() >= sBlocksLimit)
+        return;
+    QString key = QString::number(blockSize) + "/" + hash;
+    if (mBlocks.contains(key))
+        return;
+    mBlocks.insert(key, {file, offset});
+    mFiles[file].append(key);
+}
+
+bool SxSyncBlocks::read(const QString &hash, int blockSize, const QByteArray &salt, QByteArray &data)
+{
+    QString key = QString::number(blockSize) + "/" + hash;
+    Location location;
+    {
+        QMutexLocker locker(&mMutex);
+        auto it = mBlocks.constFind(key);
+        if (it == mBlocks.constEnd())
+            return false;
+        location = it.value();
+    }
+    // the last block of a file is shorter, it was hashed padded with zeros
+    QFile file(location.file);
+    data.fill(0, blockSize);
+    qint64 size = -1;
+    if (file.open(QIODevice::ReadOnly) && file.seek(location.offset))
+        size = file.read(data.data(), blockSize);
+    if (size <= 0 || QString::fromUtf8(SxBlock::hashBlock(data, salt)) != hash) {
+        QMutexLocker locker(&mMutex);
+        _remove(key);
+        return false;
+    }
+    return true;
+}
+
+void SxSyncBlocks::renameFile(const QString &oldFile, const QString &newFile)
+{
+    QMutexLocker locker(&mMutex);
+    QStringList keys = mFiles.take(oldFile);
+    if (keys.isEmpty())
+        return;
+    foreach (const QString &key, keys) {
+        auto it = mBlocks.find(key);
+        if (it != mBlocks.end() && it.value().file == oldFile)
+            it.value().file = newFile;
+    }
+    mFiles[newFile].append(keys);
+}
+
+void SxSyncBlocks::removeFile(const QString &file)
+{
+    QMutexLocker locker(&mMutex);
+    foreach (const QString &key, mFiles.take(file)) {
+        auto it = mBlocks.find(key);
+        if (it != mBlocks.end() && it.value().file == file)
+            mBlocks.erase(it);
+    }
+}
+
+void SxSyncBlocks::clear()
+{
+    QMutexLocker locker(&mMutex);
+    mBlocks.clear();
+    mFiles.clear();
+}
+
+void SxSyncBlocks::_remove(const QString &key)
+{
+    auto it = mBlocks.find(key);
+    if (it == mBlocks.end())
+        return;
+    auto files = mFiles.find(it.value().file);
+    if (files != mFiles.end()) {
+        files.value().removeOne(key);
+        if (files.value().isEmpty())
+            mFiles.erase(files);
+    }
+    mBlocks.erase(it);
+}
@@ -0,0 +1,67 @@
+/*
+ *  Copyright (C) 2012-2016 Skylable Ltd. <info-copyright@skylable.com>
+ *
+ *  This program is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public License
+ *  as published by the Free Software Foundation; either version 2
+ *  of the License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA.
+ *
+ *  Special exception for linking this software with OpenSSL:
+ *
+ *  In addition, as a special exception, Skylable Ltd. gives permission to
+ *  link the code of this program with the OpenSSL library and distribute
+ *  linked combinations including the two. You must obey the GNU General
+ *  Public License in all respects for all of the code used other than
+ *  OpenSSL. You may extend this exception to your version of the program,
+ *  but you are not obligated to do so. If you do not wish to do so, delete
+ *  this exception statement from your version.
+ */
+
+#ifndef SXSYNCBLOCKS_H
+#define SXSYNCBLOCKS_H
+
+#include <QByteArray>
+#include <QHash>
+#include <QMutex>
+#include <QString>
+#include <QStringList>
+
+/* Process wide registry of the blocks downloaded during the current sync and where they
+ * were written, so a download needing a block another download already fetched copies it
+ * from that file. Locations follow part files when they are renamed, every read is
+ * verified against the block hash. Cleared by the queue once it runs out of tasks */
+class SxSyncBlocks
+{
+public:
+    static SxSyncBlocks& instance();
+    SxSyncBlocks(const SxSyncBlocks &) = delete;
+    SxSyncBlocks &operator= (const SxSyncBlocks &) = delete;
+    void add(const QString &hash, int blockSize, const QString &file, qint64 offset);
+    bool read(const QString &hash, int blockSize, const QByteArray &salt, QByteArray &data);
+    void renameFile(const QString &oldFile, const QString &newFile);
+    void removeFile(const QString &file);
+    void clear();
+
+private:
+    SxSyncBlocks();
+    void _remove(const QString &key);
+    struct Location {
+        QString file;
+        qint64 offset;
+    };
+    static const int sBlocksLimit = 1000000;
+    mutable QMutex mMutex;
+    QHash<QString, Location> mBlocks;
+    QHash<QString, QStringList> mFiles;
+};
+
+#endif // SXSYNCBLOCKS_H
@@ -0,0 +1,136 @@
+/*
+ *  Copyright (C) 2012-2016 Skylable Ltd. <info-copyright@skylable.com>
+ *
+ *  This program is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public License
+ *  as published by the Free Software Foundation; either version 2
+ *  of the License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA.
+ *
+ *  Special exception for linking this software with OpenSSL:
+ *
+ *  In addition, as a special exception, Skylable Ltd. gives permission to
+ *  link the code of this program with the OpenSSL library and distribute
+ *  linked combinations including the two. You must obey the GNU General
+ *  Public License in all respects for all of the code used other than
+ *  OpenSSL. You may extend this exception to your version of the program,
+ *  but you are not obligated to do so. If you do not wish to do so, delete
+ *  this exception statement from your version.
+ */
+
+#include "sxsyncrecorder.h"
+
+#include <QDateTime>
+#include <QDir>
+#include <QFileInfo>
+#include <QJsonDocument>
+#include <QStandardPaths>
+
+SxSyncRecorder &SxSyncRecorder::instance()
+{
+    static SxSyncRecorder sInstance;
+    return sInstance;
+}
+
+SxSyncRecorder::SxSyncRecorder()
+{
+    mEnabled = false;
+    QString path = QString::fromLocal8Bit(qgetenv("SX_SYNC_RECORD"));
+    if (path.isEmpty())
+        return;
+    if (path == "1")
+        path = QStandardPaths::writableLocation(QStandardPaths::CacheLocation)+"/log/sxsync.jsonl";
+    QDir().mkpath(QFileInfo(path).absolutePath());
+    mFile.setFileName(path);
+    if (!mFile.open(QIODevice::WriteOnly | QIODevice::Append))
+        return;
+    mEnabled = true;
+    mTimer.start();
+    QJsonObject event;
+    event.insert("k", QString("start"));
+    event.insert("time", QDateTime::currentDateTimeUtc().toString(Qt::ISODate));
+    _write(event);
+}
+
+bool SxSyncRecorder::isEnabled() const
+{
+    return mEnabled;
+}
+
+QString SxSyncRecorder::traceFile() const
+{
+    return mFile.fileName();
+}
+
+void SxSyncRecorder::fileChanged(const QString &volume, const QString &path, bool removed, qint64 size)
+{
+    if (!mEnabled)
+        return;
+    QJsonObject event;
+    event.insert("k", QString("fs"));
+    event.insert("v", volume);
+    event.insert("p", path);
+    event.insert("removed", removed);
+    event.insert("size", static_cast<double>(size));
+    _write(event);
+}
+
+void SxSyncRecorder::fileMoved(const QString &volume, const QString &source, const QString &destination)
+{
+    if (!mEnabled)
+        return;
+    QJsonObject event;
+    event.insert("k", QString("move"));
+    event.insert("v", volume);
+    event.insert("src", source);
+    event.insert("p", destination);
+    _write(event);
+}
+
+void SxSyncRecorder::taskStarted(const QString &type, const QString &volume, const QString &path, const QString &source, qint64 size)
+{
+    if (!mEnabled)
+        return;
+    QJsonObject event;
+    event.insert("k", QString("task"));
+    event.insert("type", type);
+    event.insert("v", volume);
+    event.insert("p", path);
+    if (!source.isEmpty())
+        event.insert("src", source);
+    event.insert("size", static_cast<double>(size));
+    _write(event);
+}
+
+void SxSyncRecorder::reply(const QString &node, const QString &operation, int status, qint64 sent, qint64 received, qint64 msecs)
+{
+    if (!mEnabled)
+        return;
+    QJsonObject event;
+    event.insert("k", QString("reply"));
+    event.insert("node", node);
+    event.insert("op", operation);
+    event.insert("status", status);
+    event.insert("sent", static_cast<double>(sent));
+    event.insert("received", static_cast<double>(received));
+    event.insert("ms", static_cast<double>(msecs));
+    _write(event);
+}
+
+void SxSyncRecorder::_write(QJsonObject &event)
+{
+    QMutexLocker locker(&mMutex);
+    event.insert("t", static_cast<double>(mTimer.elapsed()));
+    QByteArray line = QJsonDocument(event).toJson(QJsonDocument::Compact);
+    line.append('\n');
+    mFile.write(line);
+    mFile.flush();
+}
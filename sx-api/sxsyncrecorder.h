@@ -0,0 +1,65 @@
+/*
+ *  Copyright (C) 2012-2016 Skylable Ltd. <info-copyright@skylable.com>
+ *
+ *  This program is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public License
+ *  as published by the Free Software Foundation; either version 2
+ *  of the License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA.
+ *
+ *  Special exception for linking this software with OpenSSL:
+ *
+ *  In addition, as a special exception, Skylable Ltd. gives permission to
+ *  link the code of this program with the OpenSSL library and distribute
+ *  linked combinations including the two. You must obey the GNU General
+ *  Public License in all respects for all of the code used other than
+ *  OpenSSL. You may extend this exception to your version of the program,
+ *  but you are not obligated to do so. If you do not wish to do so, delete
+ *  this exception statement from your version.
+ */
+
+#ifndef SXSYNCRECORDER_H
+#define SXSYNCRECORDER_H
+
+#include <QElapsedTimer>
+#include <QFile>
+#include <QJsonObject>
+#include <QMutex>
+#include <QString>
+
+/* Records the local change notifications, the tasks the queue starts and the
+ * cluster replies (status, sizes and times, never any data) as JSON lines, so
+ * a workload can be replayed offline by sx-bench --replay. Enabled with the
+ * SX_SYNC_RECORD environment variable, set to a file name or to 1 for
+ * sxsync.jsonl in the log directory */
+class SxSyncRecorder
+{
+public:
+    static SxSyncRecorder& instance();
+    SxSyncRecorder(const SxSyncRecorder &) = delete;
+    SxSyncRecorder &operator= (const SxSyncRecorder &) = delete;
+    bool isEnabled() const;
+    QString traceFile() const;
+    void fileChanged(const QString &volume, const QString &path, bool removed, qint64 size);
+    void fileMoved(const QString &volume, const QString &source, const QString &destination);
+    void taskStarted(const QString &type, const QString &volume, const QString &path, const QString &source, qint64 size);
+    void reply(const QString &node, const QString &operation, int status, qint64 sent, qint64 received, qint64 msecs);
+
+private:
+    SxSyncRecorder();
+    void _write(QJsonObject &event);
+    bool mEnabled;
+    QElapsedTimer mTimer;
+    QMutex mMutex;
+    QFile mFile;
+};
+
+#endif // SXSYNCRECORDER_H
@@ -0,0 +1,216 @@
+/*
+ *  Copyright (C) 2012-2016 Skylable Ltd. <info-copyright@skylable.com>
+ *
+ *  This program is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public License
+ *  as published by the Free Software Foundation; either version 2
+ *  of the License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA.
+ *
+ *  Special exception for linking this software with OpenSSL:
+ *
+ *  In addition, as a special exception, Skylable Ltd. gives permission to
+ *  link the code of this program with the OpenSSL library and distribute
+ *  linked combinations including the two. You must obey the GNU General
+ *  Public License in all respects for all of the code used other than
+ *  OpenSSL. You may extend this exception to your version of the program,
+ *  but you are not obligated to do so. If you do not wish to do so, delete
+ *  this exception statement from your version.
+ */
+
+#include "sxtrace.h"
+
+#include <atomic>
+#include <cstring>
+#include <QDateTime>
+#include <QDir>
+#include <QFileInfo>
+#include <QHash>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QMap>
+#include <QStandardPaths>
+#include <QThread>
+
+static const char sTraceMagic[8] = {'S','X','T','R','A','C','E','1'};
+
+static_assert(sizeof(SxTrace::Header) == 64, "unexpected trace header size");
+static_assert(sizeof(SxTrace::Record) == 64, "unexpected trace record size");
+
+SxTrace &SxTrace::instance()
+{
+    static SxTrace sInstance;
+    return sInstance;
+}
+
+SxTrace::SxTrace() : mNext(0), mNextId(0)
+{
+    mHeader = nullptr;
+    mRecords = nullptr;
+    mStartTime = QDateTime::currentMSecsSinceEpoch();
+    mTimer.start();
+    if (qgetenv("SX_TRACE").isEmpty())
+        return;
+    QString path = QStandardPaths::writableLocation(QStandardPaths::CacheLocation)+"/log/sxtrace.bin";
+    QDir().mkpath(QFileInfo(path).absolutePath());
+    const qint64 fileSize = static_cast<qint64>(sizeof(Header)) + static_cast<qint64>(sCapacity)*static_cast<qint64>(sizeof(Record));
+    mFile.setFileName(path);
+    if (!mFile.open(QIODevice::ReadWrite))
+        return;
+    bool valid = mFile.size() == fileSize;
+    if (!valid && !mFile.resize(fileSize)) {
+        mFile.close();
+        return;
+    }
+    uchar *data = mFile.map(0, fileSize);
+    if (data == nullptr) {
+        mFile.close();
+        return;
+    }
+    mHeader = reinterpret_cast<Header*>(data);
+    mRecords = reinterpret_cast<Record*>(data + sizeof(Header));
+    // an existing trace of the same layout is continued, earlier runs stay in the ring
+    if (!valid || memcmp(mHeader->magic, sTraceMagic, sizeof(sTraceMagic)) != 0 ||
+            mHeader->recordSize != sizeof(Record) || mHeader->capacity != sCapacity) {
+        memset(data, 0, static_cast<size_t>(fileSize));
+        memcpy(mHeader->magic, sTraceMagic, sizeof(sTraceMagic));
+        mHeader->recordSize = sizeof(Record);
+        mHeader->capacity = sCapacity;
+    }
+    mHeader->startTime = mStartTime;
+    mNext.store(mHeader->next);
+}
+
+SxTrace::~SxTrace()
+{
+    if (mHeader != nullptr) {
+        mFile.unmap(reinterpret_cast<uchar*>(mHeader));
+        mHeader = nullptr;
+        mRecords = nullptr;
+    }
+    mFile.close();
+}
+
+bool SxTrace::isEnabled() const
+{
+    return mRecords != nullptr;
+}
+
+quint32 SxTrace::begin(SxTraceEvent event, const QString &label)
+{
+    if (!isEnabled())
+        return 0;
+    quint32 id = mNextId.fetchAndAddRelaxed(1)+1;
+    _record('b', event, id, label, 0, 0);
+    return id;
+}
+
+void SxTrace::end(SxTraceEvent event, quint32 id, qint64 bytes, int status)
+{
+    if (!isEnabled() || id == 0)
+        return;
+    _record('e', event, id, QString(), bytes, status);
+}
+
+void SxTrace::instant(SxTraceEvent event, const QString &label, qint64 bytes, int status)
+{
+    if (!isEnabled())
+        return;
+    _record('i', event, 0, label, bytes, status);
+}
+
+QString SxTrace::traceFile() const
+{
+    return mFile.fileName();
+}
+
+void SxTrace::_record(char phase, SxTraceEvent event, quint32 id, const QString &label, qint64 bytes, int status)
+{
+    quint64 index = mNext.fetchAndAddRelaxed(1);
+    Record *record = mRecords + index % sCapacity;
+    // readers skip a slot while its sequence is zero
+    record->sequence = 0;
+    std::atomic_thread_fence(std::memory_order_release);
+    record->timestamp = mStartTime*1000 + mTimer.nsecsElapsed()/1000;
+    record->bytes = bytes;
+    record->thread = static_cast<quint32>(reinterpret_cast<quintptr>(QThread::currentThreadId()));
+    record->id = id;
+    record->status = status;
+    record->event = static_cast<quint16>(event);
+    record->phase = static_cast<quint8>(phase);
+    record->reserved = 0;
+    QByteArray utf8 = label.toUtf8().left(sizeof(record->label)-1);
+    memset(record->label, 0, sizeof(record->label));
+    memcpy(record->label, utf8.constData(), static_cast<size_t>(utf8.size()));
+    std::atomic_thread_fence(std::memory_order_release);
+    record->sequence = index+1;
+    mHeader->next = index+1;
+}
+
+bool SxTrace::exportChromeTrace(const QString &traceFile, const QString &jsonFile)
+{
+    QFile in(traceFile);
+    if (!in.open(QIODevice::ReadOnly))
+        return false;
+    QByteArray data = in.readAll();
+    in.close();
+    if (data.size() < static_cast<int>(sizeof(Header)))
+        return false;
+    const Header *header = reinterpret_cast<const Header*>(data.constData());
+    if (memcmp(header->magic, sTraceMagic, sizeof(sTraceMagic)) != 0 || header->recordSize != sizeof(Record) ||
+            data.size() < static_cast<int>(sizeof(Header) + static_cast<qint64>(header->capacity)*sizeof(Record)))
+        return false;
+    const Record *records = reinterpret_cast<const Record*>(data.constData() + sizeof(Header));
+    QMap<quint64, const Record*> ordered;
+    for (quint32 i=0; i<header->capacity; i++) {
+        const Record &r = records[i];
+        if (r.sequence != 0 && (r.sequence-1) % header->capacity == i)
+            ordered.insert(r.sequence, &r);
+    }
+
+    static const char *sCategories[] = {"request", "task", "commit"};
+    QHash<QPair<quint16, quint32>, QString> names;
+    QJsonArray events;
+    foreach (const Record *r, ordered) {
+        QString category = r->event < 3 ? sCategories[r->event] : "event";
+        QString label = QString::fromUtf8(r->label, static_cast<int>(strnlen(r->label, sizeof(r->label))));
+        QJsonObject event;
+        event.insert("cat", category);
+        event.insert("ph", QString(QChar(r->phase)));
+        event.insert("ts", static_cast<double>(r->timestamp));
+        event.insert("pid", 1);
+        event.insert("tid", static_cast<double>(r->thread));
+        if (r->phase == 'b') {
+            names.insert({r->event, r->id}, label);
+            event.insert("name", label);
+            event.insert("id", static_cast<double>(r->id));
+        }
+        else if (r->phase == 'e') {
+            event.insert("name", names.take({r->event, r->id}));
+            event.insert("id", static_cast<double>(r->id));
+            event.insert("args", QJsonObject{{"bytes", static_cast<double>(r->bytes)}, {"status", r->status}});
+        }
+        else {
+            event.insert("name", label);
+            event.insert("s", QString("t"));
+            event.insert("args", QJsonObject{{"bytes", static_cast<double>(r->bytes)}, {"status", r->status}});
+        }
+        events.append(event);
+    }
+    QFile out(jsonFile);
+    if (!out.open(QIODevice::WriteOnly))
+        return false;
+    QJsonObject root;
+    root.insert("traceEvents", events);
+    root.insert("displayTimeUnit", QString("ms"));
+    return out.write(QJsonDocument(root).toJson(QJsonDocument::Compact)) > 0;
+}
@@ -0,0 +1,92 @@
+/*
+ *  Copyright (C) 2012-2016 Skylable Ltd. <info-copyright@skylable.com>
+ *
+ *  This program is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public License
+ *  as published by the Free Software Foundation; either version 2
+ *  of the License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA.
+ *
+ *  Special exception for linking this software with OpenSSL:
+ *
+ *  In addition, as a special exception, Skylable Ltd. gives permission to
+ *  link the code of this program with the OpenSSL library and distribute
+ *  linked combinations including the two. You must obey the GNU General
+ *  Public License in all respects for all of the code used other than
+ *  OpenSSL. You may extend this exception to your version of the program,
+ *  but you are not obligated to do so. If you do not wish to do so, delete
+ *  this exception statement from your version.
+ */
+
+#ifndef SXTRACE_H
+#define SXTRACE_H
+
+#include <QString>
+#include <QFile>
+#include <QAtomicInteger>
+#include <QElapsedTimer>
+
+enum class SxTraceEvent : quint16 {
+    Request,
+    QueueTask,
+    DatabaseCommit
+};
+
+/* Binary event trace kept in a memory mapped ring file, enabled with the SX_TRACE environment variable */
+class SxTrace
+{
+public:
+    static SxTrace& instance();
+    SxTrace(const SxTrace &) = delete;
+    SxTrace &operator= (const SxTrace &) = delete;
+    ~SxTrace();
+    bool isEnabled() const;
+    quint32 begin(SxTraceEvent event, const QString &label);
+    void end(SxTraceEvent event, quint32 id, qint64 bytes, int status);
+    void instant(SxTraceEvent event, const QString &label, qint64 bytes, int status);
+    QString traceFile() const;
+    static bool exportChromeTrace(const QString &traceFile, const QString &jsonFile);
+
+    struct Header {
+        char magic[8];
+        quint32 recordSize;
+        quint32 capacity;
+        quint64 next;
+        qint64 startTime;
+        char reserved[32];
+    };
+    struct Record {
+        quint64 sequence;
+        qint64 timestamp;
+        qint64 bytes;
+        quint32 thread;
+        quint32 id;
+        qint32 status;
+        quint16 event;
+        quint8 phase;
+        quint8 reserved;
+        char label[24];
+    };
+
+private:
+    SxTrace();
+    void _record(char phase, SxTraceEvent event, quint32 id, const QString &label, qint64 bytes, int status);
+    QFile mFile;
+    Header *mHeader;
+    Record *mRecords;
+    QAtomicInteger<quint64> mNext;
+    QAtomicInteger<quint32> mNextId;
+    QElapsedTimer mTimer;
+    qint64 mStartTime;
+    static const quint32 sCapacity = 65536;
+};
+
+#endif // SXTRACE_H
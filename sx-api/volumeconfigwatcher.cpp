@@ -27,6 +27,8 @@
  */
 
 #include "volumeconfigwatcher.h"
+#include "sxfilter.h"
+#include "sxnamecache.h"
 
 VolumeConfigWatcher::VolumeConfigWatcher(QObject *parent) : QObject(parent)
 {
@@ -41,5 +43,7 @@ VolumeConfigWatcher *VolumeConfigWatcher::instance()
 
 void VolumeConfigWatcher::emitConfigChanged(const QString &volume, const MetaHash &meta, const MetaHash &customMeta)
 {
+    SxNameCache::instance()->clear(volume);
+    SxFilter::dropCachedContexts(volume);
     emit configChanged(volume, meta, customMeta);
 }
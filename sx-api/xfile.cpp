@@ -140,10 +140,75 @@ bool XFile::makeInvisible(const QString &fileName, bool invisible) {
     return SetFileAttributesW((const WCHAR *)fileName.constData(), attribs) != 0;
 }
 
+bool XFile::writeAt(QFile *file, qint64 offset, const char *data, qint64 size) {
+    if (!file->seek(offset))
+        return false;
+    return file->write(data, size) == size;
+}
+
+bool XFile::zeroRange(QFile *file, qint64 offset, qint64 size) {
+    if (size <= 0)
+        return true;
+    if (!file->flush())
+        return false;
+    HANDLE fh = (HANDLE)_get_osfhandle(file->handle());
+    DWORD returned;
+    if (DeviceIoControl(fh, FSCTL_SET_SPARSE, NULL, 0, NULL, 0, &returned, NULL)) {
+        FILE_ZERO_DATA_INFORMATION zero;
+        zero.FileOffset.QuadPart = offset;
+        zero.BeyondFinalZero.QuadPart = offset + size;
+        if (DeviceIoControl(fh, FSCTL_SET_ZERO_DATA, &zero, sizeof(zero), NULL, 0, &returned, NULL))
+            return true;
+    }
+    QByteArray zeros(static_cast<int>(qMin<qint64>(size, 1024*1024)), '\0');
+    while (size > 0) {
+        qint64 chunk = qMin<qint64>(size, zeros.size());
+        if (!writeAt(file, offset, zeros.constData(), chunk))
+            return false;
+        offset += chunk;
+        size -= chunk;
+    }
+    return true;
+}
+
+bool XFile::cloneRange(QFile *source, qint64 sourceOffset, QFile *target, qint64 targetOffset, qint64 size) {
+    Q_UNUSED(source);
+    Q_UNUSED(sourceOffset);
+    Q_UNUSED(target);
+    Q_UNUSED(targetOffset);
+    Q_UNUSED(size);
+    return false;
+}
+
+void XFile::releaseCache(const QString &fileName) {
+    // the cache manager already recycles pages of files read with FILE_FLAG_SEQUENTIAL_SCAN
+    Q_UNUSED(fileName);
+}
+
+bool XFile::syncFileSystem(const QString &fileName) {
+    // flushing a whole volume needs administrator rights, NTFS journals the renames anyway
+    Q_UNUSED(fileName);
+    return true;
+}
+
+bool XFile::syncDirectory(const QString &dirName) {
+    Q_UNUSED(dirName);
+    return true;
+}
+
 #else
 #include <unistd.h>
 #include <fcntl.h>
+#include <sys/stat.h>
+#ifdef Q_OS_LINUX
+#include <linux/falloc.h>
+#include <linux/fs.h>
+#include <sys/ioctl.h>
+#endif
 #include <stdio.h>
+#include <errno.h>
+#include <string.h>
+#include "sxlog.h"
 
 bool XFile::openFor(XFile::xopenFor mode) {
     enum QIODevice::OpenModeFlag qmode = (mode == forRead) ? QIODevice::ReadOnly : QIODevice::ReadWrite;
@@ -178,6 +243,117 @@ bool XFile::makeInvisible(const QString &fileName, bool invisible) {
     return true;
 }
 
+bool XFile::writeAt(QFile *file, qint64 offset, const char *data, qint64 size) {
+    if (!file->flush())
+        return false;
+    int fd = file->handle();
+    while (size > 0) {
+        ssize_t written = ::pwrite(fd, data, static_cast<size_t>(size), static_cast<off_t>(offset));
+        if (written < 0) {
+            if (errno == EINTR)
+                continue;
+            logWarning(QString("pwrite failed: %1").arg(strerror(errno)));
+            return false;
+        }
+        data += written;
+        offset += written;
+        size -= written;
+    }
+    return true;
+}
+
+bool XFile::zeroRange(QFile *file, qint64 offset, qint64 size) {
+    if (size <= 0)
+        return true;
+    if (!file->flush())
+        return false;
+    int fd = file->handle();
+#if defined(Q_OS_LINUX)
+    if (fallocate(fd, FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE, static_cast<off_t>(offset), static_cast<off_t>(size)) == 0)
+        return true;
+#elif defined(F_PUNCHHOLE)
+    struct fpunchhole hole;
+    memset(&hole, 0, sizeof(hole));
+    hole.fp_offset = static_cast<off_t>(offset);
+    hole.fp_length = static_cast<off_t>(size);
+    if (fcntl(fd, F_PUNCHHOLE, &hole) == 0)
+        return true;
+#endif
+    // no hole punching on this filesystem, write the zeros instead
+    static const char sZeros[64*1024] = {};
+    while (size > 0) {
+        qint64 chunk = qMin<qint64>(size, sizeof(sZeros));
+        if (!writeAt(file, offset, sZeros, chunk))
+            return false;
+        offset += chunk;
+        size -= chunk;
+    }
+    return true;
+}
+
+void XFile::releaseCache(const QString &fileName) {
+#ifdef POSIX_FADV_DONTNEED
+    static const off_t sMinSize = 16*1024*1024;
+    int fd = ::open(fileName.toUtf8().constData(), O_RDONLY);
+    if (fd < 0)
+        return;
+    struct stat st;
+    if (fstat(fd, &st) == 0 && st.st_size >= sMinSize)
+        posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+    ::close(fd);
+#else
+    Q_UNUSED(fileName);
+#endif
+}
+
+/* makes the data written to every file of the filesystem holding fileName durable with a
+ * single call, where the system allows it */
+bool XFile::syncFileSystem(const QString &fileName) {
+#ifdef Q_OS_LINUX
+    int fd = ::open(fileName.toUtf8().constData(), O_RDONLY);
+    if (fd < 0)
+        return false;
+    int r = syncfs(fd);
+    ::close(fd);
+    return r == 0;
+#else
+    Q_UNUSED(fileName);
+    sync();
+    return true;
+#endif
+}
+
+/* makes the renames into dirName durable */
+bool XFile::syncDirectory(const QString &dirName) {
+    int fd = ::open(dirName.toUtf8().constData(), O_RDONLY);
+    if (fd < 0)
+        return false;
+    int r = fsync(fd);
+    ::close(fd);
+    return r == 0;
+}
+
+bool XFile::cloneRange(QFile *source, qint64 sourceOffset, QFile *target, qint64 targetOffset, qint64 size) {
+#if defined(Q_OS_LINUX) && defined(FICLONERANGE)
+    if (!target->flush())
+        return false;
+    struct file_clone_range range;
+    memset(&range, 0, sizeof(range));
+    range.src_fd = source->handle();
+    range.src_offset = static_cast<__u64>(sourceOffset);
+    range.src_length = static_cast<__u64>(size);
+    range.dest_offset = static_cast<__u64>(targetOffset);
+    return ioctl(target->handle(), FICLONERANGE, &range) == 0;
+#else
+    Q_UNUSED(source);
+    Q_UNUSED(sourceOffset);
+    Q_UNUSED(target);
+    Q_UNUSED(targetOffset);
+    Q_UNUSED(size);
+    return false;
+#endif
+}
+
 #endif
 
 bool XFile::open(QIODevice::OpenMode flags)
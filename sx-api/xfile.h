@@ -46,6 +46,12 @@ public:
     QFileDevice::FileError error() const;
     static bool safeRename(const QString &oldName, const QString &newName);
     static bool makeInvisible(const QString &fileName, bool invisible);
+    static bool writeAt(QFile *file, qint64 offset, const char *data, qint64 size);
+    static bool zeroRange(QFile *file, qint64 offset, qint64 size);
+    static void releaseCache(const QString &fileName);
+    static bool syncFileSystem(const QString &fileName);
+    static bool syncDirectory(const QString &dirName);
+    static bool cloneRange(QFile *source, qint64 sourceOffset, QFile *target, qint64 targetOffset, qint64 size);
 
 private:
     enum QFileDevice::FileError m_error;
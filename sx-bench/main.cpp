@@ -0,0 +1,151 @@
+/*
+ *  Copyright (C) 2012-2016 Skylable Ltd. <info-copyright@skylable.com>
+ *
+ *  This program is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public License
+ *  as published by the Free Software Foundation; either version 2
+ *  of the License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA.
+ *
+ *  Special exception for linking this software with OpenSSL:
+ *
+ *  In addition, as a special exception, Skylable Ltd. gives permission to
+ *  link the code of this program with the OpenSSL library and distribute
+ *  linked combinations including the two. You must obey the GNU General
+ *  Public License in all respects for all of the code used other than
+ *  OpenSSL. You may extend this exception to your version of the program,
+ *  but you are not obligated to do so. If you do not wish to do so, delete
+ *  this exception statement from your version.
+ */
+
+#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QStandardPaths>
+#include <QTemporaryDir>
+#include <QJsonDocument>
+#include <QFile>
+#include <iostream>
+#include "sxbenchmark.h"
+#include "sxbenchmarks.h"
+#include "sxsyncbenchmark.h"
+#include "sxreplaybenchmark.h"
+#include "sxdatabasebenchmark.h"
+#include "sxwatcherbenchmark.h"
+#include "sxlog.h"
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+    app.setApplicationName("sx-bench");
+    // keeps filter keys and logs away from the user's cache
+    QStandardPaths::setTestModeEnabled(true);
+
+    QCommandLineParser parser;
+    parser.addHelpOption();
+    parser.addOption(QCommandLineOption("output", "Write the results as JSON to <file>", "file"));
+    parser.addOption(QCommandLineOption("repeats", "Measure every benchmark <count> times, 5 by default", "count", "5"));
+    parser.addOption(QCommandLineOption("filter", "Only run the benchmarks with <text> in the name", "text"));
+    parser.addOption(QCommandLineOption("label", "Store <text> with the results, e.g. the release being measured", "text"));
+    parser.addOption(QCommandLineOption("sync", "Also synchronise a synthetic tree with a fake SX node on localhost"));
+    parser.addOption(QCommandLineOption("sync-files", "Number of small files in the synthetic tree, 2000 by default", "count", "2000"));
+    parser.addOption(QCommandLineOption("sync-large-files", "Number of large files in the synthetic tree, 2 by default", "count", "2"));
+    parser.addOption(QCommandLineOption("sync-large-size", "Size of every large file in MB, 200 by default", "MB", "200"));
+    parser.addOption(QCommandLineOption("latency", "Delay every reply of the fake node by <ms>", "ms", "0"));
+    parser.addOption(QCommandLineOption("replay", "Replay a workload recorded with SX_SYNC_RECORD against a fake SX node, "
+                                                  "with the recorded median latency unless --latency is given", "file"));
+    parser.addOption(QCommandLineOption("bandwidth", "Limit the fake node link to <KB/s>, unlimited by default", "KB/s", "0"));
+    parser.addOption(QCommandLineOption("failure-rate", "Fail <percent> of the volume requests to the fake node", "percent", "0"));
+    parser.addOption(QCommandLineOption("database", "Also time the sync database queries on a synthetic volume"));
+    parser.addOption(QCommandLineOption("db-files", "Number of files in the synthetic volume, 1000000 by default", "count", "1000000"));
+    parser.addOption(QCommandLineOption("db-blocks", "Number of blocks of all the files, 50000000 by default", "count", "50000000"));
+    parser.addOption(QCommandLineOption("db-history", "Number of history events, 100000 by default", "count", "100000"));
+    parser.addOption(QCommandLineOption("watcher", "Also storm a scratch directory watched by the filesystem watcher of this platform"));
+    parser.addOption(QCommandLineOption("watcher-creates", "Number of files created in the create storm, 100000 by default", "count", "100000"));
+    parser.addOption(QCommandLineOption("watcher-depth", "Depth of the tree renamed in the rename storm, 32 by default", "levels", "32"));
+    parser.addOption(QCommandLineOption("watcher-churn", "Number of files of the tree churned like a checkout, 30000 by default", "count", "30000"));
+    parser.addOption(QCommandLineOption("watcher-dirs", "Number of watched directories in the directory storm, "
+                                                        "by default just over the inotify watch limit", "count", "0"));
+    parser.process(app);
+
+    SxLog::instance().setLogLevel(LogLevel::Error);
+    QTemporaryDir workDir;
+    if (!workDir.isValid()) {
+        std::cerr << "unable to create a temporary directory" << std::endl;
+        return 1;
+    }
+
+    SxBenchmark bench(parser.value("repeats").toInt(), parser.value("filter"));
+    SxBenchmarks::runAll(bench, workDir.path());
+    QJsonObject jSync;
+    if (parser.isSet("sync")) {
+        SxSyncBenchmark::Options options;
+        options.smallFiles = qMax(0, parser.value("sync-files").toInt());
+        options.largeFiles = qMax(0, parser.value("sync-large-files").toInt());
+        options.largeFileSize = qMax(Q_INT64_C(1), parser.value("sync-large-size").toLongLong())*1024*1024;
+        options.latency = parser.value("latency").toInt();
+        options.bandwidth = parser.value("bandwidth").toLongLong()*1024;
+        options.failureRate = parser.value("failure-rate").toDouble()/100;
+        SxSyncBenchmark sync(options, workDir.path());
+        sync.run(bench);
+        jSync = sync.toJson();
+    }
+    QJsonObject jReplay;
+    if (parser.isSet("replay")) {
+        int latency = parser.isSet("latency") ? qMax(0, parser.value("latency").toInt()) : -1;
+        SxReplayBenchmark replay(parser.value("replay"), latency, workDir.path());
+        replay.run(bench);
+        jReplay = replay.toJson();
+    }
+    QJsonObject jDatabase;
+    if (parser.isSet("database")) {
+        SxDatabaseBenchmark::Options options;
+        options.files = qMax(0, parser.value("db-files").toInt());
+        options.blocks = qMax(Q_INT64_C(0), parser.value("db-blocks").toLongLong());
+        options.historyEvents = qMax(0, parser.value("db-history").toInt());
+        SxDatabaseBenchmark database(options);
+        database.run(bench);
+        jDatabase = database.toJson();
+    }
+    QJsonObject jWatcher;
+    if (parser.isSet("watcher")) {
+        SxWatcherBenchmark::Options options;
+        options.creates = qMax(0, parser.value("watcher-creates").toInt());
+        options.depth = qMax(1, parser.value("watcher-depth").toInt());
+        options.churnFiles = qMax(0, parser.value("watcher-churn").toInt());
+        options.directories = qMax(0, parser.value("watcher-dirs").toInt());
+        SxWatcherBenchmark watcher(options, workDir.path());
+        watcher.run(bench);
+        jWatcher = watcher.toJson();
+    }
+    std::cerr << bench.report().toLocal8Bit().constData() << std::endl;
+
+    QJsonObject json = bench.toJson();
+    json.insert("label", parser.value("label"));
+    if (!jSync.isEmpty())
+        json.insert("sync", jSync);
+    if (!jReplay.isEmpty())
+        json.insert("replay", jReplay);
+    if (!jDatabase.isEmpty())
+        json.insert("database", jDatabase);
+    if (!jWatcher.isEmpty())
+        json.insert("watcher", jWatcher);
+    QByteArray output = QJsonDocument(json).toJson();
+    if (parser.isSet("output")) {
+        QFile file(parser.value("output"));
+        if (!file.open(QIODevice::WriteOnly) || file.write(output) != output.size()) {
+            std::cerr << "unable to write " << parser.value("output").toLocal8Bit().constData() << std::endl;
+            return 1;
+        }
+    }
+    else
+        std::cout << output.constData();
+    return 0;
+}
@@ -0,0 +1,90 @@
+#-------------------------------------------------
+#
+# Benchmarks of the sx-api transfer primitives
+#
+#-------------------------------------------------
+
+QT += network core concurrent sql
+QT -= gui
+
+TARGET = sx-bench
+TEMPLATE = app
+CONFIG += console c++11
+CONFIG -= app_bundle
+CONFIG += debug_and_release
+# Entry and Debug log lines are compiled out of release builds
+CONFIG(release, debug|release): DEFINES += SXLOG_MIN_LEVEL=2
+QMAKE_MAC_SDK = macosx10.11
+
+SOURCES += \
+    main.cpp \
+    sxbenchmark.cpp \
+    sxbenchmarks.cpp \
+    sxfakenode.cpp \
+    sxsyncbenchmark.cpp \
+    sxreplaybenchmark.cpp \
+    sxdatabasebenchmark.cpp \
+    sxwatcherbenchmark.cpp
+
+HEADERS += \
+    sxbenchmark.h \
+    sxbenchmarks.h \
+    sxfakenode.h \
+    sxsyncbenchmark.h \
+    sxreplaybenchmark.h \
+    sxdatabasebenchmark.h \
+    sxwatcherbenchmark.h
+
+INCLUDEPATH += $$PWD/../drive-core $$PWD/../sx-api
+DEPENDPATH += $$PWD/../drive-core $$PWD/../sx-api
+
+win32:CONFIG(release, debug|release): {
+    LIBS += -L$$OUT_PWD/../drive-core/release/ -ldrive-core
+    LIBS += -L$$OUT_PWD/../sx-api/release/ -lsx-api
+}
+else:win32:CONFIG(debug, debug|release): {
+    LIBS += -L$$OUT_PWD/../drive-core/debug/ -ldrive-core
+    LIBS += -L$$OUT_PWD/../sx-api/debug/ -lsx-api
+}
+else:unix: {
+    LIBS += -L$$OUT_PWD/../drive-core/ -ldrive-core
+    LIBS += -L$$OUT_PWD/../sx-api/ -lsx-api
+}
+
+win32-g++:CONFIG(release, debug|release): {
+    PRE_TARGETDEPS += $$OUT_PWD/../drive-core/release/libdrive-core.a
+    PRE_TARGETDEPS += $$OUT_PWD/../sx-api/release/libsx-api.a
+}
+else:win32-g++:CONFIG(debug, debug|release): {
+    PRE_TARGETDEPS += $$OUT_PWD/../drive-core/debug/libdrive-core.a
+    PRE_TARGETDEPS += $$OUT_PWD/../sx-api/debug/libsx-api.a
+}
+else:win32:!win32-g++:CONFIG(release, debug|release): {
+    PRE_TARGETDEPS += $$OUT_PWD/../drive-core/release/drive-core.lib
+    PRE_TARGETDEPS += $$OUT_PWD/../sx-api/release/sx-api.lib
+}
+else:win32:!win32-g++:CONFIG(debug, debug|release): {
+    PRE_TARGETDEPS += $$OUT_PWD/../drive-core/debug/drive-core.lib
+    PRE_TARGETDEPS += $$OUT_PWD/../sx-api/debug/sx-api.lib
+}
+else:unix: {
+    PRE_TARGETDEPS += $$OUT_PWD/../drive-core/libdrive-core.a
+    PRE_TARGETDEPS += $$OUT_PWD/../sx-api/libsx-api.a
+}
+
+macx {
+    INCLUDEPATH += $$PWD/../3rdparty/openssl-osx/include
+    DEPENDPATH += $$PWD/../3rdparty/openssl-osx/include
+    LIBS += -L$$PWD/../3rdparty/openssl-osx/lib/ -lssl -lcrypto
+    PRE_TARGETDEPS += $$PWD/../3rdparty/openssl-osx/lib/libssl.a
+    PRE_TARGETDEPS += $$PWD/../3rdparty/openssl-osx/lib/libcrypto.a
+}
+else:unix:  LIBS += -lssl -lcrypto
+unix:       LIBS += -lz
+else:win32:LIBS += -L$$PWD/../3rdparty/openssl-win32/lib/ -llibeay32 -lssleay32
+
+# power source and user idle time for the sync governor
+macx: LIBS += -framework IOKit -framework ApplicationServices
+win32: LIBS += -luser32
+# process CPU time and working set of the watcher benchmark
+win32: LIBS += -lpsapi
@@ -0,0 +1,178 @@
+/*
+ *  Copyright (C) 2012-2016 Skylable Ltd. <info-copyright@skylable.com>
+ *
+ *  This program is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public License
+ *  as published by the Free Software Foundation; either version 2
+ *  of the License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA.
+ *
+ *  Special exception for linking this software with OpenSSL:
+ *
+ *  In addition, as a special exception, Skylable Ltd. gives permission to
+ *  link the code of this program with the OpenSSL library and distribute
+ *  linked combinations including the two. You must obey the GNU General
+ *  Public License in all respects for all of the code used other than
+ *  OpenSSL. You may extend this exception to your version of the program,
+ *  but you are not obligated to do so. If you do not wish to do so, delete
+ *  this exception statement from your version.
+ */
+
+#include "sxbenchmark.h"
+
+#include <QElapsedTimer>
+#include <QDateTime>
+#include <QJsonArray>
+#include <QStringList>
+#include <QSysInfo>
+#include <QThread>
+#include <algorithm>
+
+SxBenchmark::SxBenchmark(int repeats, const QString &filter)
+{
+    mRepeats = qMax(1, repeats);
+    mFilter = filter;
+}
+
+bool SxBenchmark::isSelected(const QString &name) const
+{
+    return mFilter.isEmpty() || name.contains(mFilter, Qt::CaseInsensitive);
+}
+
+bool SxBenchmark::run(const QString &name, int iterations, qint64 bytesPerIteration, std::function<bool()> body)
+{
+    return run(name, iterations, bytesPerIteration, 0, body);
+}
+
+bool SxBenchmark::run(const QString &name, int iterations, qint64 bytesPerIteration, int filesPerIteration, std::function<bool()> body)
+{
+    if (!isSelected(name))
+        return true;
+    Result result;
+    result.name = name;
+    result.iterations = iterations;
+    result.bytesPerIteration = bytesPerIteration;
+    result.filesPerIteration = filesPerIteration;
+    result.failed = !body();
+    for (int r=0; r<mRepeats && !result.failed; r++) {
+        QElapsedTimer timer;
+        timer.start();
+        for (int i=0; i<iterations; i++) {
+            if (!body()) {
+                result.failed = true;
+                break;
+            }
+        }
+        result.rounds.append(timer.nsecsElapsed()/iterations);
+    }
+    mResults.append(result);
+    return !result.failed;
+}
+
+qint64 SxBenchmark::Result::median() const
+{
+    if (rounds.isEmpty())
+        return 0;
+    QVector<qint64> sorted = rounds;
+    std::sort(sorted.begin(), sorted.end());
+    return sorted.at(sorted.count()/2);
+}
+
+static double megabytesPerSecond(qint64 bytes, qint64 nsecs)
+{
+    if (bytes <= 0 || nsecs <= 0)
+        return 0;
+    return static_cast<double>(bytes)*1e9/nsecs/(1024*1024);
+}
+
+static double filesPerSecond(int files, qint64 nsecs)
+{
+    if (files <= 0 || nsecs <= 0)
+        return 0;
+    return static_cast<double>(files)*1e9/nsecs;
+}
+
+QString SxBenchmark::report() const
+{
+    QStringList lines;
+    lines.append(QString("%1 %2 %3 %4 %5")
+                 .arg("benchmark", -44).arg("iterations", 10).arg("median ns", 12).arg("min ns", 12).arg("MB/s", 9));
+    foreach (const Result &result, mResults) {
+        if (result.failed) {
+            lines.append(QString("%1 FAILED").arg(result.name, -44));
+            continue;
+        }
+        QString line = QString("%1 %2 %3 %4 %5")
+                .arg(result.name, -44).arg(result.iterations, 10).arg(result.median(), 12)
+                .arg(*std::min_element(result.rounds.constBegin(), result.rounds.constEnd()), 12)
+                .arg(megabytesPerSecond(result.bytesPerIteration, result.median()), 9, 'f', 1);
+        if (result.filesPerIteration > 0)
+            line += QString(" %1 files/s").arg(filesPerSecond(result.filesPerIteration, result.median()), 0, 'f', 1);
+        lines.append(line);
+    }
+    return lines.join("\n");
+}
+
+QJsonObject SxBenchmark::toJson() const
+{
+    QJsonArray jResults;
+    foreach (const Result &result, mResults) {
+        QJsonObject jResult;
+        jResult.insert("name", result.name);
+        jResult.insert("failed", result.failed);
+        jResult.insert("iterations", result.iterations);
+        jResult.insert("bytesPerIteration", static_cast<double>(result.bytesPerIteration));
+        QJsonArray jRounds;
+        foreach (qint64 round, result.rounds)
+            jRounds.append(static_cast<double>(round));
+        jResult.insert("nsPerIteration", jRounds);
+        if (!result.rounds.isEmpty()) {
+            jResult.insert("medianNs", static_cast<double>(result.median()));
+            jResult.insert("minNs", static_cast<double>(*std::min_element(result.rounds.constBegin(), result.rounds.constEnd())));
+            jResult.insert("maxNs", static_cast<double>(*std::max_element(result.rounds.constBegin(), result.rounds.constEnd())));
+            jResult.insert("megabytesPerSecond", megabytesPerSecond(result.bytesPerIteration, result.median()));
+            if (result.filesPerIteration > 0)
+                jResult.insert("filesPerSecond", filesPerSecond(result.filesPerIteration, result.median()));
+        }
+        jResults.append(jResult);
+    }
+    QJsonObject json;
+    json.insert("format", 1);
+    json.insert("timestamp", QDateTime::currentDateTime().toString(Qt::ISODate));
+    json.insert("qt", QString(qVersion()));
+#if QT_VERSION >= QT_VERSION_CHECK(5,4,0)
+    json.insert("os", QSysInfo::prettyProductName());
+    json.insert("cpu", QSysInfo::currentCpuArchitecture());
+#endif
+    json.insert("threads", QThread::idealThreadCount());
+#ifdef QT_NO_DEBUG
+    json.insert("build", QString("release"));
+#else
+    json.insert("build", QString("debug"));
+#endif
+    json.insert("repeats", mRepeats);
+    json.insert("results", jResults);
+    return json;
+}
+
+QByteArray SxBenchmark::patternData(int size, quint32 seed)
+{
+    // xorshift, the same input on every machine and every run
+    QByteArray data(size, Qt::Uninitialized);
+    quint32 x = seed ? seed : 1;
+    for (int i=0; i<size; i++) {
+        x ^= x << 13;
+        x ^= x >> 17;
+        x ^= x << 5;
+        data[i] = static_cast<char>(x & 0xff);
+    }
+    return data;
+}
@@ -0,0 +1,66 @@
+/*
+ *  Copyright (C) 2012-2016 Skylable Ltd. <info-copyright@skylable.com>
+ *
+ *  This program is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public License
+ *  as published by the Free Software Foundation; either version 2
+ *  of the License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA.
+ *
+ *  Special exception for linking this software with OpenSSL:
+ *
+ *  In addition, as a special exception, Skylable Ltd. gives permission to
+ *  link the code of this program with the OpenSSL library and distribute
+ *  linked combinations including the two. You must obey the GNU General
+ *  Public License in all respects for all of the code used other than
+ *  OpenSSL. You may extend this exception to your version of the program,
+ *  but you are not obligated to do so. If you do not wish to do so, delete
+ *  this exception statement from your version.
+ */
+
+#ifndef SXBENCHMARK_H
+#define SXBENCHMARK_H
+
+#include <QString>
+#include <QList>
+#include <QVector>
+#include <QJsonObject>
+#include <functional>
+
+/* Runs every benchmark a fixed number of rounds after a warmup,
+ * the median round is what gets compared between releases */
+class SxBenchmark
+{
+public:
+    SxBenchmark(int repeats, const QString &filter);
+    bool isSelected(const QString &name) const;
+    bool run(const QString &name, int iterations, qint64 bytesPerIteration, std::function<bool()> body);
+    bool run(const QString &name, int iterations, qint64 bytesPerIteration, int filesPerIteration, std::function<bool()> body);
+    QString report() const;
+    QJsonObject toJson() const;
+    static QByteArray patternData(int size, quint32 seed);
+
+private:
+    struct Result {
+        QString name;
+        int iterations;
+        qint64 bytesPerIteration;
+        int filesPerIteration;
+        QVector<qint64> rounds;
+        bool failed;
+        qint64 median() const;
+    };
+    int mRepeats;
+    QString mFilter;
+    QList<Result> mResults;
+};
+
+#endif // SXBENCHMARK_H
@@ -0,0 +1,208 @@
+/*
+ *  Copyright (C) 2012-2016 Skylable Ltd. <info-copyright@skylable.com>
+ *
+ *  This program is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public License
+ *  as published by the Free Software Foundation; either version 2
+ *  of the License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA.
+ *
+ *  Special exception for linking this software with OpenSSL:
+ *
+ *  In addition, as a special exception, Skylable Ltd. gives permission to
+ *  link the code of this program with the OpenSSL library and distribute
+ *  linked combinations including the two. You must obey the GNU General
+ *  Public License in all respects for all of the code used other than
+ *  OpenSSL. You may extend this exception to your version of the program,
+ *  but you are not obligated to do so. If you do not wish to do so, delete
+ *  this exception statement from your version.
+ */
+
+#include "sxbenchmarks.h"
+#include "sxbenchmark.h"
+#include "sxblock.h"
+#include "sxfile.h"
+#include "sxcluster.h"
+#include "sxquery.h"
+#include "sxqueryresult.h"
+#include "sxvolume.h"
+#include "sxfilter.h"
+#include "sxfilterstream.h"
+#include "uploadqueue.h"
+
+#include <QFile>
+#include <QHash>
+#include <QStringList>
+#include <cstring>
+#include <memory>
+
+static const int sDataPerRound = 64*1024*1024;
+static const char *sAesFilterUuid = "15b0ac3c404f481ebc986598e4577bbd";
+
+SxAuth SxBenchmarks::benchmarkAuth(int port)
+{
+    // 20 bytes of user id, 20 bytes of key, 2 bytes of padding
+    QString token = QString::fromLatin1(SxBenchmark::patternData(42, 11).toBase64());
+    return SxAuth("bench", "127.0.0.1", false, port, token);
+}
+
+void SxBenchmarks::runAll(SxBenchmark &bench, const QString &workDir)
+{
+    hashing(bench);
+    fileConstruction(bench, workDir);
+    getBlocksReply(bench);
+    requestSigning(bench);
+    aes256(bench, workDir);
+    uploadQueue(bench);
+}
+
+void SxBenchmarks::hashing(SxBenchmark &bench)
+{
+    const QByteArray salt = SxBenchmark::patternData(20, 7);
+    const QList<int> sizes = {4096, 16384, 1024*1024};
+    foreach (int size, sizes) {
+        const QByteArray data = SxBenchmark::patternData(size, 1);
+        bench.run(QString("SxBlock::hashBlock/%1").arg(size), sDataPerRound/size, size, [&data, &salt]() {
+            return !SxBlock::hashBlock(data, salt).isEmpty();
+        });
+    }
+    const int blockCount = 256;
+    const int blockSize = 16384;
+    const QByteArray batch = SxBenchmark::patternData(blockCount*blockSize, 2);
+    bench.run(QString("SxBlock::hashBlocks/%1x%2").arg(blockCount).arg(blockSize), sDataPerRound/batch.size(), batch.size(), [&]() {
+        return SxBlock::hashBlocks(batch.constData(), blockCount, blockSize, salt).count() == blockCount;
+    });
+}
+
+void SxBenchmarks::fileConstruction(SxBenchmark &bench, const QString &workDir)
+{
+    const qint64 size = 32*1024*1024;
+    const QString name = "SxFile/construct 32MB";
+    if (!bench.isSelected(name))
+        return;
+    const QString path = workDir+"/file-32M";
+    if (!writeFile(path, size))
+        return;
+    const QByteArray salt = SxBenchmark::patternData(20, 7);
+    // the warmup round brings the file into the page cache, the rounds measure hashing
+    bench.run(name, 1, size, [&]() {
+        SxFile file(nullptr, "/file-32M", salt, path, 16384, size, []() { return false; });
+        return file.remoteSize() == size;
+    });
+}
+
+void SxBenchmarks::getBlocksReply(SxBenchmark &bench)
+{
+    const int blockCount = 64;
+    const int blockSize = 16384;
+    const QString name = QString("SxCluster::_getBlocksProcessReply/%1x%2").arg(blockCount).arg(blockSize);
+    if (!bench.isSelected(name))
+        return;
+    std::unique_ptr<SxCluster> cluster(new SxCluster(benchmarkAuth(), "bench", {"127.0.0.1"}));
+    QStringList keys;
+    QHash<QString, SxBlock*> hash;
+    for (int i=0; i<blockCount; i++) {
+        QString key = QString::fromLatin1(SxBlock::hashBlock(QByteArray::number(i), QByteArray()));
+        keys.append(key);
+        hash.insert(key, new SxBlock(key));
+    }
+    SxQueryResult reply("127.0.0.1", 200, SxError(), SxBenchmark::patternData(blockCount*blockSize, 3), false, QString());
+    bench.run(name, 256, blockCount*blockSize, [&]() {
+        return cluster->_getBlocksProcessReply(&reply, blockSize, keys, hash);
+    });
+    qDeleteAll(hash);
+}
+
+void SxBenchmarks::requestSigning(SxBenchmark &bench)
+{
+    const SxAuth auth = benchmarkAuth();
+    SxQuery list("/volume?o=list&recursive&filter=dir%2Fsubdir%2F%2A", SxQuery::GET, QByteArray());
+    bench.run("SxQuery::makeRequest/GET", 20000, 0, [&]() {
+        return list.makeRequest("127.0.0.1", auth, 0, QString()).url().isValid();
+    });
+    // the body hash is computed when the query is created
+    const QByteArray body = SxBenchmark::patternData(1024*1024, 4);
+    bench.run("SxQuery::makeRequest/PUT 1MB", 64, body.size(), [&]() {
+        SxQuery put("/.data/16384/token", SxQuery::PUT, body);
+        return put.makeRequest("127.0.0.1", auth, 0, QString()).url().isValid();
+    });
+}
+
+void SxBenchmarks::aes256(SxBenchmark &bench, const QString &workDir)
+{
+    const qint64 size = 16*1024*1024;
+    const QString name = "filter_aes256/encrypt 16MB";
+    if (!bench.isSelected(name))
+        return;
+    const QString path = workDir+"/file-16M";
+    if (!writeFile(path, size))
+        return;
+    std::unique_ptr<SxCluster> cluster(new SxCluster(benchmarkAuth(), "bench", {"127.0.0.1"}));
+    cluster->setFilterInputCallback([](sx_input_args &args) -> int {
+        static const QByteArray password = "benchmark password";
+        if (static_cast<unsigned int>(password.length())+1 > args.insize)
+            return 1;
+        memcpy(args.in, password.constData(), static_cast<size_t>(password.length()));
+        args.in[password.length()] = 0;
+        return 0;
+    });
+    SxVolume volume(cluster.get(), "bench", "bench", Q_INT64_C(1) << 40, 0, true, true, "bench");
+    // salt and the no fingerprint flag, the key file is created in the warmup round
+    QString uuid = ActiveFilterUtils::uuidFormat(QByteArray(sAesFilterUuid));
+    volume.meta().setValue("filterActive", QByteArray::fromHex(sAesFilterUuid));
+    volume.meta().setValue(uuid+"-cfg", SxBenchmark::patternData(17, 5));
+    QByteArray buffer(1024*1024, Qt::Uninitialized);
+    bench.run(name, 1, size, [&]() {
+        SxFilterSource source(&volume, "/file-16M", path);
+        if (!source.open())
+            return false;
+        qint64 total = 0;
+        qint64 bytes;
+        while ((bytes = source.read(buffer.data(), buffer.size())) > 0)
+            total += bytes;
+        return bytes == 0 && total >= size;
+    });
+    SxFilter::dropCachedContexts();
+}
+
+void SxBenchmarks::uploadQueue(SxBenchmark &bench)
+{
+    const int taskCount = 10000;
+    QStringList paths;
+    for (int i=0; i<taskCount; i++)
+        paths.append(QString("/dir%1/file%2").arg(i%100).arg(i));
+    bench.run(QString("UploadQueue/add, remove, take %1").arg(taskCount), 1, 0, [&]() {
+        UploadQueue queue;
+        for (int i=0; i<paths.count(); i++)
+            queue.addTask(paths.at(i), (static_cast<qint64>(i)*7919) % (1024*1024), Q_INT64_C(1) << 40);
+        for (int i=0; i<paths.count(); i+=10)
+            queue.removeTask(paths.at(i));
+        int taken = 0;
+        while (!queue.isEmpty()) {
+            queue.takeFirstTask();
+            ++taken;
+        }
+        return taken == taskCount - taskCount/10;
+    });
+}
+
+bool SxBenchmarks::writeFile(const QString &path, qint64 size)
+{
+    QFile file(path);
+    if (!file.open(QIODevice::WriteOnly))
+        return false;
+    const QByteArray chunk = SxBenchmark::patternData(1024*1024, 9);
+    for (qint64 written = 0; written < size; written += chunk.size()) {
+        if (file.write(chunk.constData(), qMin<qint64>(chunk.size(), size-written)) < 0)
+            return false;
+    }
+    return file.flush();
+}
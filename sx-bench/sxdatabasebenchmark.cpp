@@ -0,0 +1,435 @@
+/*
+ *  Copyright (C) 2012-2016 Skylable Ltd. <info-copyright@skylable.com>
+ *
+ *  This program is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public License
+ *  as published by the Free Software Foundation; either version 2
+ *  of the License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA.
+ *
+ *  Special exception for linking this software with OpenSSL:
+ *
+ *  In addition, as a special exception, Skylable Ltd. gives permission to
+ *  link the code of this program with the OpenSSL library and distribute
+ *  linked combinations including the two. You must obey the GNU General
+ *  Public License in all respects for all of the code used other than
+ *  OpenSSL. You may extend this exception to your version of the program,
+ *  but you are not obligated to do so. If you do not wish to do so, delete
+ *  this exception statement from your version.
+ */
+
+#include "sxdatabasebenchmark.h"
+#include "sxbenchmark.h"
+#include "sxdatabase.h"
+#include "sxfileentry.h"
+
+#include <QDir>
+#include <QFile>
+#include <QElapsedTimer>
+#include <QStandardPaths>
+#include <QSqlDatabase>
+#include <QSqlQuery>
+#include <QSqlError>
+#include <QJsonArray>
+#include <tuple>
+#include <iostream>
+
+static const char *sVolumeName = "bench";
+static const char *sFillConnection = "sxbench_fill";
+static const char *sPlanConnection = "sxbench_plans";
+
+/* copies of the statements SxDatabase runs on the hot paths, kept in step with
+ * sxdatabase.cpp; scans of the temporary staging tables are expected */
+struct PlannedStatement {
+    const char *name;
+    const char *sql;
+    QStringList allowedScans;
+};
+
+static const QList<PlannedStatement> sPlannedStatements = {
+    {"findBlock",
+     "select f.volume, f.path, b.offset from sxBlocks b, sxBlockFiles f where "
+     "b.blockSize = :blockSize and b.hash = :hash and f.id = b.fileId", {}},
+    {"findIdenticalFiles/candidates",
+     "select f.path, f.mTime, bf.id from sxBlocks b, sxBlockFiles bf, sxFiles f where "
+     "b.fileId=bf.id and bf.volume=f.volume and bf.path=f.path and "
+     "f.volume=:volume and f.remoteSize=:remoteSize and "
+     "b.offset=0 and b.hash=:hash and b.blockSize=:blockSize", {}},
+    {"findIdenticalFiles/blocks",
+     "select offset, hash from sxBlocks where fileId=:fileId order by offset", {}},
+    {"getMarkedFiles",
+     "select rowid, path from sxFiles where action=:action and rowid>:rowid and volume=:volume order by rowid limit :limit", {}},
+    {"getHistoryEntries/first",
+     "SELECT rowId, volume, path, eventDate, action FROM sxHistory ORDER BY eventDate DESC, rowId DESC limit :limit", {}},
+    {"getHistoryEntries/older",
+     "SELECT h.rowId, h.volume, h.path, h.eventDate, h.action FROM sxHistory h, (SELECT eventDate, rowId FROM sxHistory WHERE rowId=:rowId) k "
+     "WHERE h.eventDate <= k.eventDate AND (h.eventDate < k.eventDate OR h.rowId < k.rowId) "
+     "ORDER BY h.eventDate DESC, h.rowId DESC limit :limit", {"k"}},
+    {"getNewHistoryEntries",
+     "SELECT rowId, volume, path, eventDate, action FROM sxHistory WHERE rowId > :rowId "
+     "ORDER BY eventDate DESC, rowId DESC limit :limit", {}},
+    {"getRecentHistory",
+     "select h.volume, h.path from sxHistory h where action = 3 or action = 4 "
+     "ORDER BY h.eventDate DESC, h.rowId DESC limit 50", {}},
+    {"finishRemoteFiles/actions",
+     "update sxRemoteFiles set action=(select case "
+     "when sxRemoteFiles.suppressed then :skip "
+     "when f.localRevision is null then (case when f.mTime is null then :download else :upload end) "
+     "when sxRemoteFiles.revision > f.localRevision then :download "
+     "else :skip end "
+     "from sxFiles f where f.volume=:volume and f.path=sxRemoteFiles.path)", {"sxRemoteFiles"}},
+    {"finishRemoteFiles/changes",
+     "update sxFiles set "
+     "remoteRevision=(select s.revision from sxRemoteFiles s where s.path=sxFiles.path), "
+     "remoteSize=(select s.size from sxRemoteFiles s where s.path=sxFiles.path), "
+     "action=(select s.action from sxRemoteFiles s where s.path=sxFiles.path) "
+     "where rowid in (select f.rowid from sxRemoteFiles s, sxFiles f where f.volume=:volume and f.path=s.path and "
+     "(f.remoteRevision is not s.revision or f.remoteSize is not s.size or f.action is not s.action))", {"s", "sxRemoteFiles"}},
+    {"finishRemoteFiles/removed",
+     "update sxFiles set action=:removeLocal "
+     "where volume=:volume and action!=:removeLocal and path not in (select path from sxRemoteFiles)", {"sxRemoteFiles"}},
+    {"updateLocalFiles/unchanged",
+     "update sxFiles set action=:skip "
+     "where volume=:volume and action!=:removeLocal and action!=:skip and "
+     "mTime=(select l.mTime from sxLocalFiles l where l.path=sxFiles.path)", {}}
+};
+
+static quint64 mix(quint64 x)
+{
+    x += Q_UINT64_C(0x9e3779b97f4a7c15);
+    x = (x ^ (x >> 30)) * Q_UINT64_C(0xbf58476d1ce4e5b9);
+    x = (x ^ (x >> 27)) * Q_UINT64_C(0x94d049bb133111eb);
+    return x ^ (x >> 31);
+}
+
+static bool execBatch(QSqlQuery &query, const QList<QVariantList> &columns)
+{
+    for (int i=0; i<columns.count(); i++)
+        query.bindValue(i, columns.at(i));
+    if (query.execBatch())
+        return true;
+    std::cerr << "unable to fill the database: " << query.lastError().text().toLocal8Bit().constData() << std::endl;
+    return false;
+}
+
+SxDatabaseBenchmark::SxDatabaseBenchmark(const Options &options)
+{
+    mOptions = options;
+    mRound = 0;
+    mChangedFiles = 0;
+    mLookup = 0;
+    mFillMsecs = 0;
+    mBlockRows = 0;
+}
+
+void SxDatabaseBenchmark::run(SxBenchmark &bench)
+{
+    const QStringList names = {"database updateRemoteFiles", "database getMarkedFiles", "database updateLocalFiles",
+                               "database findBlock", "database findIdenticalFiles", "database history", "database query plans"};
+    bool selected = false;
+    foreach (QString name, names) {
+        selected = selected || bench.isSelected(name);
+    }
+    if (!selected)
+        return;
+    if (!_fill()) {
+        foreach (QString name, names) {
+            bench.run(name, 1, 0, [] { return false; });
+        }
+        return;
+    }
+    SxDatabase &database = SxDatabase::instance();
+
+    // every round marks another slice of the volume as changed
+    bench.run("database updateRemoteFiles", 1, 0, mOptions.files, [this, &database]() {
+        database.startUpdatingFiles(sVolumeName, nullptr);
+        bool updated = _listing(++mRound);
+        database.endUpdatingFiles();
+        return updated;
+    });
+    database.startUpdatingFiles(sVolumeName, nullptr);
+    bool listed = _listing(++mRound);
+    bench.run("database getMarkedFiles", 1, 0, mChangedFiles, [this, &database, listed]() {
+        return listed && database.getMarkedFiles(sVolumeName, SxDatabase::ACTION::DOWNLOAD).count() == mChangedFiles;
+    });
+    database.endUpdatingFiles();
+    bench.run("database updateLocalFiles", 1, 0, mOptions.files, [this, &database]() {
+        database.startUpdatingFiles(sVolumeName, nullptr);
+        bool updated = _updateLocalFiles(++mRound);
+        database.endUpdatingFiles();
+        return updated;
+    });
+
+    bench.run("database findBlock", mLookupHashes.count(), 0, [this]() {
+        return _findBlock();
+    });
+    if (!mCopyFiles.isEmpty()) {
+        bench.run("database findIdenticalFiles", mCopyFiles.count(), 0, [this]() {
+            return _findIdenticalFiles();
+        });
+    }
+    if (mOptions.historyEvents > 0) {
+        bench.run("database history", 100, 0, [this]() {
+            return _history();
+        });
+    }
+    bench.run("database query plans", 1, 0, [this]() {
+        return _checkPlans();
+    });
+}
+
+QJsonObject SxDatabaseBenchmark::toJson() const
+{
+    QJsonObject jPlans;
+    for (auto it = mPlans.constBegin(); it != mPlans.constEnd(); ++it)
+        jPlans.insert(it.key(), QJsonArray::fromStringList(it.value()));
+    QJsonObject json;
+    json.insert("files", mOptions.files);
+    json.insert("blocks", static_cast<double>(mBlockRows));
+    json.insert("historyEvents", mOptions.historyEvents);
+    json.insert("fillSeconds", static_cast<double>(mFillMsecs)/1000);
+    json.insert("queryPlans", jPlans);
+    json.insert("planRegressions", QJsonArray::fromStringList(mPlanRegressions));
+    return json;
+}
+
+bool SxDatabaseBenchmark::_fill()
+{
+    // the benchmark profile gets a fresh database, SxDatabase creates the schema
+    mDbFile = QDir(QStandardPaths::writableLocation(QStandardPaths::CacheLocation)).absoluteFilePath("sxsync.db");
+    foreach (QString suffix, QStringList({"", "-wal", "-shm"})) {
+        QFile::remove(mDbFile+suffix);
+    }
+    SxDatabase &database = SxDatabase::instance();
+
+    // rows go in directly, through the API the fill would take longer than the benchmarks
+    QElapsedTimer timer;
+    timer.start();
+    bool filled = false;
+    {
+        QSqlDatabase connection = QSqlDatabase::addDatabase("QSQLITE", sFillConnection);
+        connection.setDatabaseName(mDbFile);
+        if (!connection.open()) {
+            std::cerr << "unable to open " << mDbFile.toLocal8Bit().constData() << std::endl;
+            return false;
+        }
+        QSqlQuery query(connection);
+        query.exec("PRAGMA synchronous=OFF");
+        query.exec("begin transaction");
+        query.prepare("insert into sxVolumes (name, owner, size, usedSize, filterType) values (?, ?, 0, 0, 0)");
+        filled = execBatch(query, {{sVolumeName}, {sVolumeName}});
+
+        QSqlQuery files(connection), blockFiles(connection), blocks(connection);
+        files.prepare("insert into sxFiles (volume, path, remoteRevision, localRevision, mTime, remoteSize, action, blockSize) "
+                      "values (?, ?, ?, ?, ?, ?, 0, ?)");
+        blockFiles.prepare("insert into sxBlockFiles (id, volume, path) values (?, ?, ?)");
+        blocks.prepare("insert into sxBlocks (fileId, offset, blockSize, hash) values (?, ?, ?, ?)");
+        mPaths.resize(mOptions.files);
+        mLocalFiles.resize(mOptions.files);
+        for (int first=0; filled && first<mOptions.files; first+=sFillChunk) {
+            QVariantList volumes, paths, revisions, mTimes, sizes, blockSizes, ids;
+            QVariantList fileIds, offsets, sizesOfBlocks, hashes;
+            for (int i=first; i<qMin(first+sFillChunk, mOptions.files); i++) {
+                QString path = QString("/d%1/f%2.bin").arg(i/1000, 4, 10, QChar('0')).arg(i, 7, 10, QChar('0'));
+                mPaths[i] = path;
+                mLocalFiles[i] = SxLocalFile{path, _fileSize(i), sBaseTime + static_cast<uint>(i)};
+                volumes.append(sVolumeName);
+                paths.append(path);
+                revisions.append(revision(0));
+                mTimes.append(sBaseTime + static_cast<uint>(i));
+                sizes.append(_fileSize(i));
+                blockSizes.append(sBlockSize);
+                ids.append(i+1);
+                for (int b=0; b<_blockCount(i); b++) {
+                    fileIds.append(i+1);
+                    offsets.append(static_cast<qint64>(b)*sBlockSize);
+                    sizesOfBlocks.append(sBlockSize);
+                    hashes.append(_blockHash(i, b));
+                }
+            }
+            mBlockRows += fileIds.count();
+            filled = execBatch(files, {volumes, paths, revisions, revisions, mTimes, sizes, blockSizes}) &&
+                    execBatch(blockFiles, {ids, volumes, paths}) &&
+                    execBatch(blocks, {fileIds, offsets, sizesOfBlocks, hashes});
+        }
+
+        QVariantList volumes, paths, actions, eventDates;
+        for (int i=0; filled && i<mOptions.historyEvents; i++) {
+            volumes.append(sVolumeName);
+            paths.append(QString("/d%1/f%2.bin").arg(i%1000, 4, 10, QChar('0')).arg(static_cast<int>(mix(i)%1000000), 7, 10, QChar('0')));
+            actions.append(1 + i%4);
+            eventDates.append(sBaseTime + static_cast<uint>(i)*10);
+        }
+        if (filled) {
+            query.prepare("insert into sxHistory (volume, path, action, eventDate) values (?, ?, ?, ?)");
+            filled = execBatch(query, {volumes, paths, actions, eventDates});
+        }
+        query.exec(filled ? "commit transaction" : "rollback transaction");
+    }
+    QSqlDatabase::removeDatabase(sFillConnection);
+    mFillMsecs = timer.elapsed();
+    if (!filled)
+        return false;
+    // the file index of SxDatabase is reloaded when an update session ends
+    database.startUpdatingFiles(sVolumeName, nullptr);
+    database.endUpdatingFiles();
+
+    for (int i=0; i<sLookups && mOptions.files > 0; i++) {
+        int file = static_cast<int>(mix(i) % static_cast<quint64>(mOptions.files));
+        int block = static_cast<int>(mix(i+sLookups) % static_cast<quint64>(_blockCount(file)));
+        mLookupHashes.append(_blockHash(file, block).toHex());
+    }
+    for (int i=sCopyInterval-1; i<mOptions.files && mCopyFiles.count()<sLookups/5; i+=sCopyInterval)
+        mCopyFiles.append(i);
+    return !mLookupHashes.isEmpty();
+}
+
+bool SxDatabaseBenchmark::_listing(int round)
+{
+    // the listing arrives in pages like the one of SxQueue's remote scan
+    SxDatabase &database = SxDatabase::instance();
+    if (!database.beginRemoteFiles(sVolumeName))
+        return false;
+    mChangedFiles = 0;
+    for (int first=0; first<mOptions.files; first+=sListingPage) {
+        QList<SxFileEntry*> page;
+        for (int i=first; i<qMin(first+sListingPage, mOptions.files); i++) {
+            bool changed = i % sChangeInterval == round % sChangeInterval;
+            if (changed)
+                ++mChangedFiles;
+            page.append(new SxFileEntry(mPaths.at(i), _fileSize(i), revision(changed ? round : 0)));
+        }
+        bool added = database.addRemoteFiles(sVolumeName, page);
+        qDeleteAll(page);
+        if (!added)
+            return false;
+    }
+    return database.finishRemoteFiles(sVolumeName);
+}
+
+bool SxDatabaseBenchmark::_updateLocalFiles(int round)
+{
+    for (int i=0; i<mLocalFiles.count(); i++) {
+        uint mTime = sBaseTime + static_cast<uint>(i);
+        mLocalFiles[i].mTime = i % sChangeInterval == round % sChangeInterval ? mTime + static_cast<uint>(round) : mTime;
+    }
+    return SxDatabase::instance().updateLocalFiles(sVolumeName, mLocalFiles, true);
+}
+
+bool SxDatabaseBenchmark::_findBlock()
+{
+    QList<std::tuple<QString, QString, qint64>> result;
+    const QString &hash = mLookupHashes.at(mLookup++ % mLookupHashes.count());
+    return SxDatabase::instance().findBlock(hash, sBlockSize, result) && !result.isEmpty();
+}
+
+bool SxDatabaseBenchmark::_findIdenticalFiles()
+{
+    // every copy has the same content as the file before it
+    int file = mCopyFiles.at(mLookup++ % mCopyFiles.count());
+    QStringList blocks;
+    for (int b=0; b<_blockCount(file); b++)
+        blocks.append(_blockHash(file, b).toHex());
+    QList<QPair<QString, quint32>> result;
+    return SxDatabase::instance().findIdenticalFiles(sVolumeName, _fileSize(file), sBlockSize, blocks, result) && result.count() >= 2;
+}
+
+bool SxDatabaseBenchmark::_history()
+{
+    SxDatabase &database = SxDatabase::instance();
+    QList<SxDatabase::HistoryEntry> page;
+    if (!database.getHistoryEntries(page, -1, 100) || page.isEmpty())
+        return false;
+    if (!database.getHistoryEntries(page, page.last().rowId, 100))
+        return false;
+    QList<SxDatabase::HistoryEntry> newEntries;
+    if (!database.getNewHistoryEntries(newEntries, qMax(0, mOptions.historyEvents-100), 100))
+        return false;
+    return !database.getRecentHistory(false, 50).isEmpty();
+}
+
+bool SxDatabaseBenchmark::_checkPlans()
+{
+    mPlans.clear();
+    mPlanRegressions.clear();
+    {
+        QSqlDatabase connection = QSqlDatabase::addDatabase("QSQLITE", sPlanConnection);
+        connection.setDatabaseName(mDbFile);
+        if (!connection.open())
+            return false;
+        // the staging tables SxDatabase creates on its own connection
+        QSqlQuery query(connection);
+        query.exec("create temp table if not exists sxRemoteFiles "
+                   "(path text primary key, revision text not null, size integer not null, suppressed integer not null, action integer)");
+        query.exec("create temp table if not exists sxLocalFiles (path text primary key, mTime integer not null)");
+        foreach (const PlannedStatement &statement, sPlannedStatements) {
+            if (!query.exec(QString("explain query plan ")+statement.sql)) {
+                mPlanRegressions.append(QString("%1: %2").arg(statement.name, query.lastError().text()));
+                continue;
+            }
+            QStringList details;
+            while (query.next()) {
+                QString detail = query.value(3).toString();
+                details.append(detail);
+                // "SCAN TABLE sxFiles AS f" before SQLite 3.36, "SCAN f" after
+                QStringList words = detail.split(' ', QString::SkipEmptyParts);
+                if (words.value(0) != "SCAN" || detail.contains(" USING "))
+                    continue;
+                QString table = words.value(1) == "TABLE" ? words.value(2) : words.value(1);
+                QString alias = words.value(words.indexOf("AS")+1);
+                if (table.startsWith("(") || table == "CONSTANT" || table == "SUBQUERY" ||
+                        statement.allowedScans.contains(table) || (words.contains("AS") && statement.allowedScans.contains(alias)))
+                    continue;
+                mPlanRegressions.append(QString("%1: %2").arg(statement.name, detail));
+            }
+            mPlans.insert(statement.name, details);
+        }
+    }
+    QSqlDatabase::removeDatabase(sPlanConnection);
+    foreach (QString regression, mPlanRegressions) {
+        std::cerr << "query plan regression in " << regression.toLocal8Bit().constData() << std::endl;
+    }
+    return mPlanRegressions.isEmpty();
+}
+
+int SxDatabaseBenchmark::_blockCount(int file) const
+{
+    int content = contentOf(file);
+    qint64 count = mOptions.blocks / qMax(1, mOptions.files) + (content < mOptions.blocks % qMax(1, mOptions.files) ? 1 : 0);
+    return static_cast<int>(qBound(Q_INT64_C(1), count, static_cast<qint64>(sMaxBlocksPerFile)));
+}
+
+qint64 SxDatabaseBenchmark::_fileSize(int file) const
+{
+    int content = contentOf(file);
+    return static_cast<qint64>(_blockCount(file)-1)*sBlockSize + 1 + static_cast<qint64>(mix(content) % sBlockSize);
+}
+
+QByteArray SxDatabaseBenchmark::_blockHash(int file, int block) const
+{
+    // one block in ten comes from a small pool shared by the whole volume, like zero blocks
+    quint64 id = static_cast<quint64>(contentOf(file))*sMaxBlocksPerFile + static_cast<quint64>(block);
+    quint64 m = mix(id);
+    quint64 key = m % 10 == 0 ? (Q_UINT64_C(1) << 62) | ((m/10) % sSharedBlocks) : id;
+    quint64 words[3] = {mix(key), mix(key ^ Q_UINT64_C(0x5555555555555555)), mix(key+1)};
+    return QByteArray(reinterpret_cast<const char *>(words), 20);
+}
+
+int SxDatabaseBenchmark::contentOf(int file)
+{
+    return file % sCopyInterval == sCopyInterval-1 ? file-1 : file;
+}
+
+QString SxDatabaseBenchmark::revision(int round)
+{
+    // later rounds sort after the revision the volume was filled with
+    return QString("%1-01-01 00:00:00.000:%2").arg(round > 0 ? 2017 : 2016).arg(round, 8, 10, QChar('0'));
+}
@@ -0,0 +1,97 @@
+/*
+ *  Copyright (C) 2012-2016 Skylable Ltd. <info-copyright@skylable.com>
+ *
+ *  This program is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public License
+ *  as published by the Free Software Foundation; either version 2
+ *  of the License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA.
+ *
+ *  Special exception for linking this software with OpenSSL:
+ *
+ *  In addition, as a special exception, Skylable Ltd. gives permission to
+ *  link the code of this program with the OpenSSL library and distribute
+ *  linked combinations including the two. You must obey the GNU General
+ *  Public License in all respects for all of the code used other than
+ *  OpenSSL. You may extend this exception to your version of the program,
+ *  but you are not obligated to do so. If you do not wish to do so, delete
+ *  this exception statement from your version.
+ */
+
+#ifndef SXDATABASEBENCHMARK_H
+#define SXDATABASEBENCHMARK_H
+
+#include <QString>
+#include <QStringList>
+#include <QVector>
+#include <QList>
+#include <QMap>
+#include <QJsonObject>
+#include "sxfilesystem.h"
+
+class SxBenchmark;
+
+/* Fills the SxDatabase of the benchmark profile with a synthetic volume of the
+ * requested size and times the queries sync runs against it. The plans of the
+ * hot statements are checked too, a full table scan of one of the big tables
+ * means an index went missing or stopped being usable */
+class SxDatabaseBenchmark
+{
+public:
+    struct Options {
+        int files;
+        qint64 blocks;
+        int historyEvents;
+    };
+    explicit SxDatabaseBenchmark(const Options &options);
+    void run(SxBenchmark &bench);
+    QJsonObject toJson() const;
+
+private:
+    bool _fill();
+    bool _listing(int round);
+    bool _updateLocalFiles(int round);
+    bool _findBlock();
+    bool _findIdenticalFiles();
+    bool _history();
+    bool _checkPlans();
+    int _blockCount(int file) const;
+    qint64 _fileSize(int file) const;
+    QByteArray _blockHash(int file, int block) const;
+    static int contentOf(int file);
+    static QString revision(int round);
+
+    Options mOptions;
+    QString mDbFile;
+    QVector<QString> mPaths;
+    QVector<SxLocalFile> mLocalFiles;
+    QStringList mLookupHashes;
+    QList<int> mCopyFiles;
+    int mRound;
+    int mChangedFiles;
+    int mLookup;
+    qint64 mFillMsecs;
+    qint64 mBlockRows;
+    QMap<QString, QStringList> mPlans;
+    QStringList mPlanRegressions;
+
+    static const int sBlockSize = 4096;
+    static const int sMaxBlocksPerFile = 1024;
+    static const int sSharedBlocks = 10000;
+    static const int sCopyInterval = 100;
+    static const int sChangeInterval = 100;
+    static const int sFillChunk = 10000;
+    static const int sListingPage = 10000;
+    static const int sLookups = 1000;
+    static const uint sBaseTime = 1450000000;
+};
+
+#endif // SXDATABASEBENCHMARK_H
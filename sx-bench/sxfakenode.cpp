@@ -0,0 +1,598 @@
+/*
+ *  Copyright (C) 2012-2016 Skylable Ltd. <info-copyright@skylable.com>
+ *
+ *  This program is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public License
+ *  as published by the Free Software Foundation; either version 2
+ *  of the License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA.
+ *
+ *  Special exception for linking this software with OpenSSL:
+ *
+ *  In addition, as a special exception, Skylable Ltd. gives permission to
+ *  link the code of this program with the OpenSSL library and distribute
+ *  linked combinations including the two. You must obey the GNU General
+ *  Public License in all respects for all of the code used other than
+ *  OpenSSL. You may extend this exception to your version of the program,
+ *  but you are not obligated to do so. If you do not wish to do so, delete
+ *  this exception statement from your version.
+ */
+
+#include "sxfakenode.h"
+#include "sxblock.h"
+
+#include <QTcpServer>
+#include <QTcpSocket>
+#include <QTimer>
+#include <QJsonDocument>
+#include <QJsonArray>
+#include <QDateTime>
+#include <QCryptographicHash>
+#include <QMetaObject>
+
+static const qint64 sVolumeSize = Q_INT64_C(1024)*1024*1024*1024;
+static const int sMinPollInterval = 10;
+static const int sMaxPollInterval = 200;
+static const char *sNodeAddress = "127.0.0.1";
+
+static QJsonArray nodeList()
+{
+    QJsonArray jNodes;
+    jNodes.append(QString(sNodeAddress));
+    return jNodes;
+}
+
+SxFakeNode::SxFakeNode(const QByteArray &uuid, const QString &volume)
+{
+    mServer = nullptr;
+    mUuid = uuid;
+    mVolume = volume;
+    mPort = 0;
+    mLinkFreeAt = 0;
+    mLatency = 0;
+    mBandwidth = 0;
+    mFailureRate = 0;
+    mFailureSeed = 1;
+    mStats = {0, 0, 0, 0};
+    mUsedSize = 0;
+    mNextId = 1;
+    mClock.start();
+}
+
+SxFakeNode::~SxFakeNode()
+{
+    if (mThread.isRunning()) {
+        QMetaObject::invokeMethod(this, "_close", Qt::BlockingQueuedConnection);
+        mThread.quit();
+        mThread.wait();
+    }
+}
+
+bool SxFakeNode::start()
+{
+    // replies are produced in a thread of their own, like on a real server
+    mThread.start();
+    moveToThread(&mThread);
+    bool listening = false;
+    QMetaObject::invokeMethod(this, "_listen", Qt::BlockingQueuedConnection, Q_RETURN_ARG(bool, listening));
+    return listening;
+}
+
+quint16 SxFakeNode::port() const
+{
+    return mPort;
+}
+
+void SxFakeNode::setLatency(int msecs)
+{
+    QMutexLocker locker(&mMutex);
+    mLatency = qMax(0, msecs);
+}
+
+void SxFakeNode::setBandwidth(qint64 bytesPerSecond)
+{
+    QMutexLocker locker(&mMutex);
+    mBandwidth = qMax(Q_INT64_C(0), bytesPerSecond);
+}
+
+void SxFakeNode::setFailureRate(double rate, quint32 seed)
+{
+    QMutexLocker locker(&mMutex);
+    mFailureRate = qBound(0.0, rate, 1.0);
+    mFailureSeed = seed ? seed : 1;
+}
+
+void SxFakeNode::reset()
+{
+    QMutexLocker locker(&mMutex);
+    mFiles.clear();
+    mBlocks.clear();
+    mUploads.clear();
+    mJobs.clear();
+    mUsedSize = 0;
+}
+
+SxFakeNode::Stats SxFakeNode::stats() const
+{
+    QMutexLocker locker(&mMutex);
+    return mStats;
+}
+
+int SxFakeNode::blockSizeFor(qint64 fileSize)
+{
+    if (fileSize < 1024*1024)
+        return 4*1024;
+    if (fileSize < 128*1024*1024)
+        return 16*1024;
+    return 1024*1024;
+}
+
+bool SxFakeNode::_listen()
+{
+    mServer = new QTcpServer(this);
+    connect(mServer, &QTcpServer::newConnection, this, &SxFakeNode::onNewConnection);
+    if (!mServer->listen(QHostAddress::LocalHost, 0))
+        return false;
+    mPort = mServer->serverPort();
+    return true;
+}
+
+void SxFakeNode::_close()
+{
+    // the sockets and their pending replies go with the server
+    delete mServer;
+    mServer = nullptr;
+    mBusy.clear();
+}
+
+void SxFakeNode::onNewConnection()
+{
+    while (mServer->hasPendingConnections()) {
+        QTcpSocket *socket = mServer->nextPendingConnection();
+        mBusy.insert(socket, false);
+        connect(socket, &QTcpSocket::disconnected, this, [this, socket]() {
+            mBusy.remove(socket);
+            socket->deleteLater();
+        });
+        connect(socket, &QTcpSocket::readyRead, this, [this, socket]() {
+            _readRequest(socket);
+        });
+    }
+}
+
+void SxFakeNode::_readRequest(QTcpSocket *socket)
+{
+    // one request at a time on every connection, the next one waits in the socket buffer
+    if (mBusy.value(socket, true))
+        return;
+    QByteArray head = socket->peek(sRequestHeadLimit);
+    int headEnd = head.indexOf("\r\n\r\n");
+    if (headEnd < 0) {
+        if (head.size() >= sRequestHeadLimit)
+            socket->abort();
+        return;
+    }
+    QList<QByteArray> lines = head.left(headEnd).split('\n');
+    QList<QByteArray> requestLine = lines.first().trimmed().split(' ');
+    if (requestLine.count() != 3) {
+        socket->abort();
+        return;
+    }
+    qint64 contentLength = 0;
+    for (int i=1; i<lines.count(); i++) {
+        QByteArray line = lines.at(i).trimmed();
+        int colon = line.indexOf(':');
+        if (colon > 0 && line.left(colon).trimmed().toLower() == "content-length")
+            contentLength = line.mid(colon+1).trimmed().toLongLong();
+    }
+    if (socket->bytesAvailable() < headEnd + 4 + contentLength)
+        return;
+    socket->read(headEnd + 4);
+
+    Request request;
+    request.method = requestLine.at(0);
+    request.body = socket->read(contentLength);
+    QByteArray target = requestLine.at(1);
+    int queryStart = target.indexOf('?');
+    request.path = QString::fromUtf8(QByteArray::fromPercentEncoding(target.left(queryStart)));
+    if (queryStart >= 0) {
+        foreach (QByteArray param, target.mid(queryStart+1).split('&')) {
+            int eq = param.indexOf('=');
+            QString key = QString::fromUtf8(QByteArray::fromPercentEncoding(param.left(eq)));
+            QString value = eq < 0 ? QString() : QString::fromUtf8(QByteArray::fromPercentEncoding(param.mid(eq+1)));
+            request.query.insert(key, value);
+        }
+    }
+
+    Reply reply = _handle(request);
+    bool head = request.method == "HEAD";
+    qint64 delay = _replyDelay(request.body.size() + (head ? 0 : reply.body.size()));
+    mBusy[socket] = true;
+    // owned by the socket, a closed connection takes its pending reply along
+    QTimer *timer = new QTimer(socket);
+    timer->setTimerType(Qt::PreciseTimer);
+    timer->setSingleShot(true);
+    connect(timer, &QTimer::timeout, this, [this, socket, timer, reply, head]() {
+        timer->deleteLater();
+        _sendReply(socket, reply, head);
+        mBusy[socket] = false;
+        _readRequest(socket);
+    });
+    timer->start(static_cast<int>(delay));
+}
+
+void SxFakeNode::_sendReply(QTcpSocket *socket, const Reply &reply, bool head)
+{
+    static const QHash<int, QByteArray> statusText = {
+        {200, "OK"},
+        {400, "Bad Request"},
+        {404, "Not Found"},
+        {405, "Method Not Allowed"},
+        {503, "Service Unavailable"}
+    };
+    QByteArray response = "HTTP/1.1 "+QByteArray::number(reply.status)+" "+statusText.value(reply.status, "Error")+"\r\n";
+    response += "SX-Cluster: 2.1.0 ("+mUuid+")\r\n";
+    response += "Content-Type: application/json\r\n";
+    response += "Content-Length: "+QByteArray::number(reply.body.size())+"\r\n\r\n";
+    if (!head)
+        response += reply.body;
+    socket->write(response);
+    QMutexLocker locker(&mMutex);
+    mStats.bytesSent += response.size();
+}
+
+qint64 SxFakeNode::_replyDelay(qint64 bytes)
+{
+    QMutexLocker locker(&mMutex);
+    // all connections share one link, a transfer starts when the previous one is through
+    qint64 now = mClock.nsecsElapsed()/1000;
+    qint64 ready = now;
+    if (mBandwidth > 0) {
+        mLinkFreeAt = qMax(now, mLinkFreeAt) + bytes*1000000/mBandwidth;
+        ready = mLinkFreeAt;
+    }
+    return (ready - now + 999)/1000 + mLatency;
+}
+
+bool SxFakeNode::_injectFailure()
+{
+    if (mFailureRate <= 0)
+        return false;
+    // xorshift, the same requests fail on every run
+    mFailureSeed ^= mFailureSeed << 13;
+    mFailureSeed ^= mFailureSeed >> 17;
+    mFailureSeed ^= mFailureSeed << 5;
+    return (mFailureSeed % 1000000) < mFailureRate*1000000;
+}
+
+SxFakeNode::Reply SxFakeNode::jsonReply(const QJsonObject &json)
+{
+    return {200, QJsonDocument(json).toJson(QJsonDocument::Compact)};
+}
+
+SxFakeNode::Reply SxFakeNode::errorReply(int status, const QString &message)
+{
+    QJsonObject json;
+    json.insert("ErrorMessage", message);
+    return {status, QJsonDocument(json).toJson(QJsonDocument::Compact)};
+}
+
+SxFakeNode::Reply SxFakeNode::_handle(const Request &request)
+{
+    QMutexLocker locker(&mMutex);
+    ++mStats.requests;
+    mStats.bytesReceived += request.body.size();
+    const QString &path = request.path;
+
+    // cluster wide queries never fail, a benchmark unable to connect measures nothing
+    if (path == "/") {
+        if (request.query.contains("nodeList")) {
+            QJsonObject json;
+            json.insert("nodeList", nodeList());
+            return jsonReply(json);
+        }
+        if (request.query.contains("clusterMeta")) {
+            QJsonObject json;
+            json.insert("clusterMeta", QJsonObject());
+            return jsonReply(json);
+        }
+        if (request.query.contains("volumeList")) {
+            QJsonObject jVolume;
+            jVolume.insert("owner", QString("bench"));
+            jVolume.insert("privs", QString("rw"));
+            jVolume.insert("usedSize", static_cast<double>(mUsedSize));
+            jVolume.insert("sizeBytes", static_cast<double>(sVolumeSize));
+            jVolume.insert("globalID", QString());
+            QJsonObject jList;
+            jList.insert(mVolume, jVolume);
+            QJsonObject json;
+            json.insert("volumeList", jList);
+            return jsonReply(json);
+        }
+        return errorReply(404, "Not Found");
+    }
+    if (path == "/.self") {
+        QJsonObject jUser;
+        jUser.insert("userQuota", static_cast<double>(sVolumeSize));
+        jUser.insert("userQuotaUsed", static_cast<double>(mUsedSize));
+        jUser.insert("userDesc", QString());
+        QJsonObject json;
+        json.insert("bench", jUser);
+        return jsonReply(json);
+    }
+    if (_injectFailure()) {
+        ++mStats.injectedFailures;
+        return errorReply(503, "Injected failure");
+    }
+
+    QStringList parts = path.mid(1).split('/');
+    if (parts.first() == ".data" && parts.count() == 3) {
+        int blockSize = parts.at(1).toInt();
+        if (request.method == "PUT")
+            return _putBlocks(blockSize, request.body);
+        return _getBlocks(blockSize, parts.at(2));
+    }
+    if (parts.first() == ".upload" && parts.count() == 2 && request.method == "PUT") {
+        if (request.body.isEmpty())
+            return _flushUpload(parts.at(1));
+        return _extendUpload(parts.at(1), request.body);
+    }
+    if (parts.first() == ".results" && parts.count() == 2) {
+        if (!mJobs.contains(parts.at(1)))
+            return errorReply(404, "Not Found");
+        bool succeeded = mJobs.take(parts.at(1));
+        QJsonObject json;
+        json.insert("requestId", parts.at(1));
+        json.insert("requestStatus", QString(succeeded ? "OK" : "ERROR"));
+        json.insert("requestMessage", QString(succeeded ? "" : "Missing blocks"));
+        return jsonReply(json);
+    }
+    if (parts.first() != mVolume)
+        return errorReply(404, "Not Found");
+    if (parts.count() == 1) {
+        if (request.query.value("o") == "locate")
+            return _locate(request);
+        if (request.query.value("o") == "list")
+            return _list(request);
+        if (request.method == "PUT" && request.query.contains("source"))
+            return _rename(request);
+        return errorReply(400, "Invalid request");
+    }
+    QString filePath = path.mid(mVolume.length()+1);
+    if (request.method == "GET" || request.method == "HEAD")
+        return _getFile(filePath);
+    if (request.method == "PUT")
+        return _initializeFile(filePath, request.body);
+    if (request.method == "DELETE")
+        return _deleteFile(filePath);
+    return errorReply(405, "Method Not Allowed");
+}
+
+SxFakeNode::Reply SxFakeNode::_locate(const Request &request)
+{
+    QJsonObject json;
+    json.insert("nodeList", nodeList());
+    if (request.query.contains("size"))
+        json.insert("blockSize", blockSizeFor(request.query.value("size").toLongLong()));
+    json.insert("volumeMeta", QJsonObject());
+    json.insert("customVolumeMeta", QJsonObject());
+    json.insert("sizeBytes", static_cast<double>(sVolumeSize));
+    json.insert("usedSize", static_cast<double>(mUsedSize));
+    return jsonReply(json);
+}
+
+SxFakeNode::Reply SxFakeNode::_list(const Request &request)
+{
+    // no paging, every listing is returned whole
+    QString prefix = request.query.value("filter");
+    if (!prefix.startsWith("/"))
+        prefix.prepend("/");
+    if (!prefix.endsWith("/"))
+        prefix.append("/");
+    bool recursive = request.query.contains("recursive");
+    QJsonObject jList;
+    auto iterator = mFiles.constBegin();
+    for (; iterator != mFiles.constEnd(); ++iterator) {
+        const QString &path = iterator.key();
+        if (!path.startsWith(prefix))
+            continue;
+        if (!recursive) {
+            int slash = path.indexOf('/', prefix.length());
+            if (slash >= 0) {
+                jList.insert(path.left(slash+1), QJsonObject());
+                continue;
+            }
+        }
+        QJsonObject jFile;
+        jFile.insert("fileSize", static_cast<double>(iterator.value().size));
+        jFile.insert("blockSize", iterator.value().blockSize);
+        jFile.insert("createdAt", static_cast<double>(iterator.value().createdAt));
+        jFile.insert("fileRevision", iterator.value().revision);
+        jList.insert(path, jFile);
+    }
+    QJsonObject json;
+    json.insert("volumeSize", static_cast<double>(sVolumeSize));
+    json.insert("fileList", jList);
+    return jsonReply(json);
+}
+
+SxFakeNode::Reply SxFakeNode::_getFile(const QString &path)
+{
+    if (!mFiles.contains(path))
+        return errorReply(404, "Not Found");
+    const RemoteFile &file = mFiles[path];
+    QJsonArray jFileData;
+    foreach (const QString &hash, file.blocks) {
+        QJsonObject jBlock;
+        jBlock.insert(hash, nodeList());
+        jFileData.append(jBlock);
+    }
+    QJsonObject json;
+    json.insert("blockSize", file.blockSize);
+    json.insert("createdAt", static_cast<double>(file.createdAt));
+    json.insert("fileSize", static_cast<double>(file.size));
+    json.insert("fileRevision", file.revision);
+    json.insert("fileData", jFileData);
+    return jsonReply(json);
+}
+
+static bool parseHashes(const QJsonValue &value, QStringList &hashes)
+{
+    if (!value.isArray())
+        return false;
+    foreach (QJsonValue jHash, value.toArray()) {
+        if (!jHash.isString() || jHash.toString().length() != 40)
+            return false;
+        hashes.append(jHash.toString());
+    }
+    return true;
+}
+
+SxFakeNode::Reply SxFakeNode::_initializeFile(const QString &path, const QByteArray &body)
+{
+    QJsonObject json = QJsonDocument::fromJson(body).object();
+    if (!json.value("fileSize").isDouble())
+        return errorReply(400, "Invalid request content");
+    Upload upload;
+    upload.path = path;
+    upload.size = json.value("fileSize").toVariant().toLongLong();
+    upload.blockSize = blockSizeFor(upload.size);
+    if (upload.size > 0 && !parseHashes(json.value("fileData"), upload.blocks))
+        return errorReply(400, "Invalid request content");
+    QString token = QString("u%1").arg(mNextId++);
+    mUploads.insert(token, upload);
+    return _missingBlocks(token, upload.blocks);
+}
+
+SxFakeNode::Reply SxFakeNode::_extendUpload(const QString &token, const QByteArray &body)
+{
+    if (!mUploads.contains(token))
+        return errorReply(404, "Not Found");
+    QJsonObject json = QJsonDocument::fromJson(body).object();
+    QStringList blocks;
+    if (!json.value("extendSeq").isDouble() || !parseHashes(json.value("fileData"), blocks))
+        return errorReply(400, "Invalid request content");
+    Upload &upload = mUploads[token];
+    upload.blocks = upload.blocks.mid(0, json.value("extendSeq").toInt()) + blocks;
+    return _missingBlocks(token, blocks);
+}
+
+SxFakeNode::Reply SxFakeNode::_missingBlocks(const QString &token, const QStringList &blocks)
+{
+    QJsonObject jUploadData;
+    foreach (const QString &hash, blocks) {
+        if (!mBlocks.contains(hash))
+            jUploadData.insert(hash, nodeList());
+    }
+    QJsonObject json;
+    json.insert("uploadToken", token);
+    json.insert("uploadData", jUploadData);
+    return jsonReply(json);
+}
+
+SxFakeNode::Reply SxFakeNode::_flushUpload(const QString &token)
+{
+    if (!mUploads.contains(token))
+        return errorReply(404, "Not Found");
+    Upload upload = mUploads.take(token);
+    qint64 blockCount = upload.size/upload.blockSize + (upload.size%upload.blockSize ? 1 : 0);
+    bool complete = upload.blocks.count() == blockCount;
+    foreach (const QString &hash, upload.blocks) {
+        if (!mBlocks.contains(hash)) {
+            complete = false;
+            break;
+        }
+    }
+    if (complete) {
+        if (mFiles.contains(upload.path))
+            mUsedSize -= mFiles.value(upload.path).size;
+        RemoteFile file;
+        file.size = upload.size;
+        file.blockSize = upload.blockSize;
+        file.createdAt = QDateTime::currentDateTime().toTime_t();
+        file.revision = QDateTime::currentDateTimeUtc().toString("yyyy-MM-dd hh:mm:ss.zzz") + ":" +
+                QString::fromLatin1(QCryptographicHash::hash((upload.path+token).toUtf8(), QCryptographicHash::Md5).toHex());
+        file.blocks = upload.blocks;
+        mFiles.insert(upload.path, file);
+        mUsedSize += upload.size;
+    }
+    return _jobReply(complete);
+}
+
+SxFakeNode::Reply SxFakeNode::_deleteFile(const QString &path)
+{
+    if (!mFiles.contains(path))
+        return errorReply(404, "Not Found");
+    mUsedSize -= mFiles.take(path).size;
+    return _jobReply(true);
+}
+
+SxFakeNode::Reply SxFakeNode::_rename(const Request &request)
+{
+    QString source = "/" + request.query.value("source");
+    QString destination = "/" + request.query.value("dest");
+    QStringList paths;
+    if (request.query.contains("recursive")) {
+        foreach (const QString &path, mFiles.keys()) {
+            if (path.startsWith(source))
+                paths.append(path);
+        }
+    }
+    else if (mFiles.contains(source))
+        paths.append(source);
+    if (paths.isEmpty())
+        return errorReply(404, "Not Found");
+    foreach (const QString &path, paths) {
+        QString target = destination + path.mid(source.length());
+        if (mFiles.contains(target))
+            mUsedSize -= mFiles.value(target).size;
+        mFiles.insert(target, mFiles.take(path));
+    }
+    return _jobReply(true);
+}
+
+SxFakeNode::Reply SxFakeNode::_jobReply(bool succeeded)
+{
+    QString requestId = QString("j%1").arg(mNextId++);
+    mJobs.insert(requestId, succeeded);
+    QJsonObject json;
+    json.insert("requestId", requestId);
+    json.insert("minPollInterval", sMinPollInterval);
+    json.insert("maxPollInterval", sMaxPollInterval);
+    return jsonReply(json);
+}
+
+SxFakeNode::Reply SxFakeNode::_putBlocks(int blockSize, const QByteArray &body)
+{
+    if (blockSize <= 0 || body.isEmpty() || body.size() % blockSize)
+        return errorReply(400, "Invalid block data");
+    for (int offset=0; offset<body.size(); offset+=blockSize) {
+        QString hash = QString::fromLatin1(SxBlock::hashBlock(body.constData()+offset, blockSize, mUuid));
+        if (!mBlocks.contains(hash))
+            mBlocks.insert(hash, body.mid(offset, blockSize));
+    }
+    return {200, QByteArray()};
+}
+
+SxFakeNode::Reply SxFakeNode::_getBlocks(int blockSize, const QString &hashes)
+{
+    if (blockSize <= 0 || hashes.isEmpty() || hashes.length() % 40 || hashes.length()/40 > sBlocksPerGet)
+        return errorReply(400, "Invalid request");
+    QByteArray data;
+    data.reserve(hashes.length()/40*blockSize);
+    for (int i=0; i<hashes.length(); i+=40) {
+        auto block = mBlocks.constFind(hashes.mid(i, 40));
+        if (block == mBlocks.constEnd() || block.value().size() != blockSize)
+            return errorReply(404, "Not Found");
+        data.append(block.value());
+    }
+    return {200, data};
+}
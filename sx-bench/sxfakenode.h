@@ -0,0 +1,142 @@
+/*
+ *  Copyright (C) 2012-2016 Skylable Ltd. <info-copyright@skylable.com>
+ *
+ *  This program is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public License
+ *  as published by the Free Software Foundation; either version 2
+ *  of the License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA.
+ *
+ *  Special exception for linking this software with OpenSSL:
+ *
+ *  In addition, as a special exception, Skylable Ltd. gives permission to
+ *  link the code of this program with the OpenSSL library and distribute
+ *  linked combinations including the two. You must obey the GNU General
+ *  Public License in all respects for all of the code used other than
+ *  OpenSSL. You may extend this exception to your version of the program,
+ *  but you are not obligated to do so. If you do not wish to do so, delete
+ *  this exception statement from your version.
+ */
+
+#ifndef SXFAKENODE_H
+#define SXFAKENODE_H
+
+#include <QObject>
+#include <QThread>
+#include <QMutex>
+#include <QHash>
+#include <QStringList>
+#include <QElapsedTimer>
+#include <QJsonObject>
+
+class QTcpServer;
+class QTcpSocket;
+
+/* In memory SX node on localhost, implements the part of the REST API used by file
+ * synchronisation. Replies can be delayed, throttled and failed on purpose */
+class SxFakeNode : public QObject
+{
+    Q_OBJECT
+public:
+    struct Stats {
+        qint64 requests;
+        qint64 injectedFailures;
+        qint64 bytesReceived;
+        qint64 bytesSent;
+    };
+    SxFakeNode(const QByteArray &uuid, const QString &volume);
+    ~SxFakeNode();
+    bool start();
+    quint16 port() const;
+    void setLatency(int msecs);
+    void setBandwidth(qint64 bytesPerSecond);
+    void setFailureRate(double rate, quint32 seed);
+    void reset();
+    Stats stats() const;
+
+    static int blockSizeFor(qint64 fileSize);
+
+private slots:
+    bool _listen();
+    void _close();
+    void onNewConnection();
+
+private:
+    struct Request {
+        QByteArray method;
+        QString path;
+        QHash<QString, QString> query;
+        QByteArray body;
+    };
+    struct Reply {
+        int status;
+        QByteArray body;
+    };
+    struct RemoteFile {
+        qint64 size;
+        int blockSize;
+        quint32 createdAt;
+        QString revision;
+        QStringList blocks;
+    };
+    struct Upload {
+        QString path;
+        qint64 size;
+        int blockSize;
+        QStringList blocks;
+    };
+    void _readRequest(QTcpSocket *socket);
+    void _sendReply(QTcpSocket *socket, const Reply &reply, bool head);
+    Reply _handle(const Request &request);
+    Reply _locate(const Request &request);
+    Reply _list(const Request &request);
+    Reply _getFile(const QString &path);
+    Reply _initializeFile(const QString &path, const QByteArray &body);
+    Reply _extendUpload(const QString &token, const QByteArray &body);
+    Reply _flushUpload(const QString &token);
+    Reply _deleteFile(const QString &path);
+    Reply _rename(const Request &request);
+    Reply _jobReply(bool succeeded);
+    Reply _putBlocks(int blockSize, const QByteArray &body);
+    Reply _getBlocks(int blockSize, const QString &hashes);
+    Reply _missingBlocks(const QString &token, const QStringList &blocks);
+    bool _injectFailure();
+    qint64 _replyDelay(qint64 bytes);
+    static Reply jsonReply(const QJsonObject &json);
+    static Reply errorReply(int status, const QString &message);
+
+    QThread mThread;
+    QTcpServer *mServer;
+    QHash<QTcpSocket*, bool> mBusy;
+    QByteArray mUuid;
+    QString mVolume;
+    quint16 mPort;
+    QElapsedTimer mClock;
+    qint64 mLinkFreeAt;
+
+    mutable QMutex mMutex;
+    int mLatency;
+    qint64 mBandwidth;
+    double mFailureRate;
+    quint32 mFailureSeed;
+    Stats mStats;
+    QHash<QString, RemoteFile> mFiles;
+    QHash<QString, QByteArray> mBlocks;
+    QHash<QString, Upload> mUploads;
+    QHash<QString, bool> mJobs;
+    qint64 mUsedSize;
+    int mNextId;
+
+    static const int sRequestHeadLimit = 65536;
+    static const int sBlocksPerGet = 30;
+};
+
+#endif // SXFAKENODE_H
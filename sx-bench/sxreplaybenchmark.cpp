@@ -0,0 +1,383 @@
+/*
+ *  Copyright (C) 2012-2016 Skylable Ltd. <info-copyright@skylable.com>
+ *
+ *  This program is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public License
+ *  as published by the Free Software Foundation; either version 2
+ *  of the License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA.
+ *
+ *  Special exception for linking this software with OpenSSL:
+ *
+ *  In addition, as a special exception, Skylable Ltd. gives permission to
+ *  link the code of this program with the OpenSSL library and distribute
+ *  linked combinations including the two. You must obey the GNU General
+ *  Public License in all respects for all of the code used other than
+ *  OpenSSL. You may extend this exception to your version of the program,
+ *  but you are not obligated to do so. If you do not wish to do so, delete
+ *  this exception statement from your version.
+ */
+
+#include "sxreplaybenchmark.h"
+#include "sxbenchmark.h"
+#include "sxbenchmarks.h"
+#include "sxfakenode.h"
+#include "sxcluster.h"
+#include "sxvolume.h"
+#include "sxfileentry.h"
+
+#include <QDir>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QFileInfo>
+#include <QJsonDocument>
+#include <algorithm>
+#include <iostream>
+
+static const char *sClusterUuid = "5e1f4a2c-8d3b-4f6e-9a7c-0b2d4e6f8a1c";
+static const char *sVolumeName = "replay";
+
+static qint64 median(QVector<qint64> values)
+{
+    if (values.isEmpty())
+        return 0;
+    std::sort(values.begin(), values.end());
+    return values.at(values.count()/2);
+}
+
+SxReplayBenchmark::SxReplayBenchmark(const QString &traceFile, int latency, const QString &workDir)
+{
+    mTraceFile = traceFile;
+    mRootDir = workDir + "/replay-tree";
+    mSeedDir = workDir + "/replay-seed";
+    mLatency = latency;
+    mReplies = 0;
+    mVolume = nullptr;
+}
+
+SxReplayBenchmark::~SxReplayBenchmark()
+{
+    // the cluster has to disconnect before the node goes away
+    mCluster.reset();
+    mNode.reset();
+}
+
+void SxReplayBenchmark::run(SxBenchmark &bench)
+{
+    const QString name = "replay " + QFileInfo(mTraceFile).fileName();
+    if (!bench.isSelected(name))
+        return;
+    if (!_load() || !_connect()) {
+        bench.run(name, 1, 0, [] { return false; });
+        return;
+    }
+    int tasks = 0;
+    foreach (int count, mTaskCounts) {
+        tasks += count;
+    }
+    bench.run(name, 1, 0, tasks, [this]() {
+        return _replay();
+    });
+}
+
+QJsonObject SxReplayBenchmark::toJson() const
+{
+    QJsonObject jPhases;
+    for (auto it = mPhaseNsecs.constBegin(); it != mPhaseNsecs.constEnd(); ++it) {
+        QJsonObject jPhase;
+        jPhase.insert("medianMs", static_cast<double>(median(it.value()))/1e6);
+        jPhase.insert("tasks", mTaskCounts.value(it.key()));
+        jPhase.insert("failed", mFailedTasks.value(it.key()));
+        jPhases.insert(it.key(), jPhase);
+    }
+    QJsonObject json;
+    json.insert("trace", mTraceFile);
+    json.insert("events", mEvents.count());
+    json.insert("recordedReplies", mReplies);
+    json.insert("latency", mLatency);
+    json.insert("remoteSeeds", mRemoteSeeds.count());
+    json.insert("localSeeds", mLocalSeeds.count());
+    json.insert("phases", jPhases);
+    return json;
+}
+
+bool SxReplayBenchmark::_load()
+{
+    QFile file(mTraceFile);
+    if (!file.open(QIODevice::ReadOnly)) {
+        std::cerr << "unable to open " << mTraceFile.toLocal8Bit().constData() << std::endl;
+        return false;
+    }
+    QVector<qint64> replyTimes;
+    while (!file.atEnd()) {
+        QByteArray line = file.readLine().trimmed();
+        if (line.isEmpty())
+            continue;
+        QJsonObject json = QJsonDocument::fromJson(line).object();
+        QString kind = json.value("k").toString();
+        if (kind == "reply") {
+            ++mReplies;
+            // block transfers are timed by the fake node's bandwidth, not its latency
+            if (!json.value("op").toString().startsWith("BLOCK"))
+                replyTimes.append(static_cast<qint64>(json.value("ms").toDouble()));
+            continue;
+        }
+        if (kind != "fs" && kind != "move" && kind != "task")
+            continue;
+        Event event;
+        event.kind = kind;
+        event.type = json.value("type").toString();
+        event.volume = json.value("v").toString();
+        event.path = json.value("p").toString();
+        event.source = json.value("src").toString();
+        event.size = static_cast<qint64>(json.value("size").toDouble());
+        event.removed = json.value("removed").toBool();
+        if (event.volume.isEmpty())
+            continue;
+        mEvents.append(event);
+        if (kind == "task")
+            ++mTaskCounts[event.type];
+    }
+    if (mLatency < 0)
+        mLatency = static_cast<int>(median(replyTimes));
+
+    // files which existed before the recording started are created before the replay
+    QSet<QString> local;
+    QSet<QString> remote;
+    foreach (const Event &event, mEvents) {
+        QString key = remotePath(event.volume, event.path);
+        if (event.kind == "fs") {
+            if (event.removed)
+                local.remove(key);
+            else
+                local.insert(key);
+        }
+        else if (event.kind == "move") {
+            local.remove(remotePath(event.volume, event.source));
+            local.insert(key);
+        }
+        else if (event.type == "UploadFile") {
+            if (!local.contains(key))
+                mLocalSeeds.insert(key, event.size);
+            local.insert(key);
+            remote.insert(key);
+        }
+        else if (event.type == "RemoveLocalFile") {
+            if (!local.contains(key))
+                mLocalSeeds.insert(key, event.size);
+            local.remove(key);
+        }
+        else if (event.type == "DownloadFile" || event.type == "RemoveRemoteFile" || event.type == "CheckFileConsistency") {
+            if (!remote.contains(key))
+                mRemoteSeeds.insert(key, event.size);
+            if (event.type == "DownloadFile") {
+                remote.insert(key);
+                local.insert(key);
+            }
+            else if (event.type == "RemoveRemoteFile")
+                remote.remove(key);
+        }
+        else if (event.type == "MoveRemoteFile") {
+            QString source = remotePath(event.volume, event.source);
+            if (!remote.contains(source))
+                mRemoteSeeds.insert(source, event.size);
+            remote.remove(source);
+            remote.insert(key);
+        }
+    }
+    if (mEvents.isEmpty()) {
+        std::cerr << "no events in " << mTraceFile.toLocal8Bit().constData() << std::endl;
+        return false;
+    }
+    return true;
+}
+
+bool SxReplayBenchmark::_connect()
+{
+    mNode.reset(new SxFakeNode(sClusterUuid, sVolumeName));
+    if (!mNode->start()) {
+        std::cerr << "unable to start the fake SX node" << std::endl;
+        return false;
+    }
+    mNode->setLatency(mLatency);
+    QString errorMessage;
+    mCluster.reset(SxCluster::initializeCluster(SxBenchmarks::benchmarkAuth(mNode->port()), sClusterUuid,
+                                                [](QSslCertificate &, bool) { return true; }, errorMessage));
+    if (!mCluster || !mCluster->reloadVolumes()) {
+        std::cerr << "unable to connect to the fake SX node: "
+                  << (mCluster ? mCluster->lastError().errorMessage() : errorMessage).toLocal8Bit().constData() << std::endl;
+        return false;
+    }
+    mVolume = mCluster->getSxVolume(sVolumeName);
+    return mVolume != nullptr;
+}
+
+bool SxReplayBenchmark::_replay()
+{
+    mNode->reset();
+    mFailedTasks.clear();
+    if (!QDir(mRootDir).removeRecursively() || !QDir(mSeedDir).removeRecursively())
+        return false;
+    QMap<QString, qint64> phases;
+    QElapsedTimer timer;
+    timer.start();
+    if (!_seed())
+        return false;
+    phases["seed"] = timer.nsecsElapsed();
+
+    bool uploadsPending = false;
+    for (int i=0; i<mEvents.count(); i++) {
+        const Event &event = mEvents.at(i);
+        // SxQueue collects the upload jobs once it moves on to other work
+        if (uploadsPending && event.type != "UploadFile") {
+            timer.restart();
+            _pollUploads();
+            uploadsPending = false;
+            phases["UploadFile"] += timer.nsecsElapsed();
+        }
+        timer.restart();
+        QString localPath = _localPath(event.volume, event.path);
+        if (event.kind == "fs") {
+            if (event.removed)
+                QFile::remove(localPath);
+            else if (!_writeFile(localPath, event.size, static_cast<quint32>(qHash(localPath)) ^ static_cast<quint32>(i)))
+                return false;
+        }
+        else if (event.kind == "move") {
+            QDir().mkpath(QFileInfo(localPath).absolutePath());
+            QFile::remove(localPath);
+            QFile::rename(_localPath(event.volume, event.source), localPath);
+        }
+        else if (!_runTask(event, uploadsPending))
+            ++mFailedTasks[event.type];
+        phases[event.kind == "task" ? event.type : QString("filesystem")] += timer.nsecsElapsed();
+    }
+    if (uploadsPending) {
+        timer.restart();
+        _pollUploads();
+        phases["UploadFile"] += timer.nsecsElapsed();
+    }
+    for (auto it = phases.constBegin(); it != phases.constEnd(); ++it)
+        mPhaseNsecs[it.key()].append(it.value());
+    return true;
+}
+
+bool SxReplayBenchmark::_seed()
+{
+    for (auto it = mLocalSeeds.constBegin(); it != mLocalSeeds.constEnd(); ++it) {
+        if (!_writeFile(mRootDir+it.key(), it.value(), static_cast<quint32>(qHash(it.key()))))
+            return false;
+    }
+    for (auto it = mRemoteSeeds.constBegin(); it != mRemoteSeeds.constEnd(); ++it) {
+        if (!_writeFile(mSeedDir+it.key(), it.value(), static_cast<quint32>(qHash(it.key()))))
+            return false;
+    }
+    return _upload(mSeedDir, mRemoteSeeds.keys());
+}
+
+bool SxReplayBenchmark::_writeFile(const QString &localPath, qint64 size, quint32 seed)
+{
+    // contents depend on the path and the event only, every round writes the same data
+    QFileInfo info(localPath);
+    QFile file(localPath);
+    if (!QDir().mkpath(info.absolutePath()) || !file.open(QIODevice::WriteOnly)) {
+        std::cerr << "unable to create " << localPath.toLocal8Bit().constData() << std::endl;
+        return false;
+    }
+    size = qMin(size, sMaxFileSize);
+    for (qint64 written = 0; written < size; written += sFilePiece) {
+        int piece = static_cast<int>(qMin(static_cast<qint64>(sFilePiece), size-written));
+        if (file.write(SxBenchmark::patternData(piece, seed + static_cast<quint32>(written/sFilePiece))) != piece)
+            return false;
+    }
+    return true;
+}
+
+bool SxReplayBenchmark::_upload(const QString &root, const QStringList &paths)
+{
+    bool result = true;
+    auto uploadDone = [&result](QString, QString, SxError error, QString, quint32) {
+        if (error.errorCode() != SxErrorCode::NoError)
+            result = false;
+    };
+    foreach (const QString &path, paths) {
+        SxFileEntry fileEntry;
+        if (!mCluster->uploadFile(mVolume, path, root+path, fileEntry, uploadDone))
+            result = false;
+    }
+    mCluster->pollUploadJobs(0, uploadDone);
+    if (!result)
+        std::cerr << "unable to seed the fake SX node" << std::endl;
+    return result;
+}
+
+void SxReplayBenchmark::_pollUploads()
+{
+    mCluster->pollUploadJobs(0, [this](QString, QString, SxError error, QString, quint32) {
+        if (error.errorCode() != SxErrorCode::NoError)
+            ++mFailedTasks["UploadFile"];
+    });
+}
+
+bool SxReplayBenchmark::_runTask(const Event &event, bool &uploadsPending)
+{
+    const QString path = remotePath(event.volume, event.path);
+    const QString localPath = _localPath(event.volume, event.path);
+    SxFileEntry fileEntry;
+    if (event.type == "UploadFile") {
+        // the file may have changed again and been removed by the time the task ran
+        if (!QFileInfo(localPath).isFile() && !_writeFile(localPath, event.size, static_cast<quint32>(qHash(path))))
+            return false;
+        uploadsPending = true;
+        return mCluster->uploadFile(mVolume, path, localPath, fileEntry, [this](QString, QString, SxError error, QString, quint32) {
+            if (error.errorCode() != SxErrorCode::NoError)
+                ++mFailedTasks["UploadFile"];
+        });
+    }
+    if (event.type == "DownloadFile") {
+        QDir().mkpath(QFileInfo(localPath).absolutePath());
+        return mCluster->downloadFile(mVolume, path, localPath, fileEntry, 0);
+    }
+    if (event.type == "RemoveRemoteFile")
+        return mCluster->deleteFile(mVolume, path);
+    if (event.type == "RemoveLocalFile")
+        return QFile::remove(localPath) || !QFileInfo(localPath).exists();
+    if (event.type == "MoveRemoteFile")
+        return mCluster->rename(mVolume, remotePath(event.volume, event.source), path);
+    if (event.type == "CheckFileConsistency") {
+        QStringList revisions;
+        return mCluster->checkFileConsistency(mVolume, path, revisions);
+    }
+    if (event.type == "ListRemoteFiles" || event.type == "VolumeInitialScan") {
+        QList<SxFileEntry*> fileList;
+        QString etag;
+        bool listed = mCluster->_listFiles(mVolume, fileList, etag);
+        qDeleteAll(fileList);
+        return listed;
+    }
+    if (event.type == "ListVolumes" || event.type == "ListClusterNodes") {
+        bool reloaded = mCluster->reloadVolumes();
+        mVolume = mCluster->getSxVolume(sVolumeName);
+        return reloaded && mVolume != nullptr;
+    }
+    return true;
+}
+
+QString SxReplayBenchmark::_localPath(const QString &volume, const QString &path) const
+{
+    return mRootDir + remotePath(volume, path);
+}
+
+QString SxReplayBenchmark::remotePath(const QString &volume, const QString &path)
+{
+    // every recorded volume becomes a top level directory of the fake node's volume
+    return "/" + volume + (path.startsWith("/") ? path : "/" + path);
+}
@@ -0,0 +1,100 @@
+/*
+ *  Copyright (C) 2012-2016 Skylable Ltd. <info-copyright@skylable.com>
+ *
+ *  This program is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public License
+ *  as published by the Free Software Foundation; either version 2
+ *  of the License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA.
+ *
+ *  Special exception for linking this software with OpenSSL:
+ *
+ *  In addition, as a special exception, Skylable Ltd. gives permission to
+ *  link the code of this program with the OpenSSL library and distribute
+ *  linked combinations including the two. You must obey the GNU General
+ *  Public License in all respects for all of the code used other than
+ *  OpenSSL. You may extend this exception to your version of the program,
+ *  but you are not obligated to do so. If you do not wish to do so, delete
+ *  this exception statement from your version.
+ */
+
+#ifndef SXREPLAYBENCHMARK_H
+#define SXREPLAYBENCHMARK_H
+
+#include <QString>
+#include <QStringList>
+#include <QList>
+#include <QMap>
+#include <QSet>
+#include <QVector>
+#include <QJsonObject>
+#include <memory>
+
+class SxBenchmark;
+class SxFakeNode;
+class SxCluster;
+class SxVolume;
+
+/* Replays a workload recorded with SX_SYNC_RECORD against an SxFakeNode: local
+ * changes are applied to a synthetic tree and every recorded task runs the
+ * SxCluster calls SxQueue makes for it, in the recorded order. Each round starts
+ * from an empty node, files the workload expects to exist already are seeded
+ * first. The time spent in every kind of task is reported separately */
+class SxReplayBenchmark
+{
+public:
+    // a negative latency replays with the median recorded reply time
+    SxReplayBenchmark(const QString &traceFile, int latency, const QString &workDir);
+    ~SxReplayBenchmark();
+    void run(SxBenchmark &bench);
+    QJsonObject toJson() const;
+
+private:
+    struct Event {
+        QString kind;
+        QString type;
+        QString volume;
+        QString path;
+        QString source;
+        qint64 size;
+        bool removed;
+    };
+    bool _load();
+    bool _connect();
+    bool _replay();
+    bool _seed();
+    bool _writeFile(const QString &localPath, qint64 size, quint32 seed);
+    bool _upload(const QString &root, const QStringList &paths);
+    void _pollUploads();
+    bool _runTask(const Event &event, bool &uploadsPending);
+    QString _localPath(const QString &volume, const QString &path) const;
+    static QString remotePath(const QString &volume, const QString &path);
+
+    QString mTraceFile;
+    QString mRootDir;
+    QString mSeedDir;
+    int mLatency;
+    QList<Event> mEvents;
+    QMap<QString, qint64> mRemoteSeeds;
+    QMap<QString, qint64> mLocalSeeds;
+    QMap<QString, int> mTaskCounts;
+    QMap<QString, QVector<qint64>> mPhaseNsecs;
+    QMap<QString, int> mFailedTasks;
+    int mReplies;
+    std::unique_ptr<SxFakeNode> mNode;
+    std::unique_ptr<SxCluster> mCluster;
+    SxVolume *mVolume;
+
+    static const qint64 sMaxFileSize = 64*1024*1024;
+    static const int sFilePiece = 4*1024*1024;
+};
+
+#endif // SXREPLAYBENCHMARK_H
@@ -0,0 +1,248 @@
+/*
+ *  Copyright (C) 2012-2016 Skylable Ltd. <info-copyright@skylable.com>
+ *
+ *  This program is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public License
+ *  as published by the Free Software Foundation; either version 2
+ *  of the License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA.
+ *
+ *  Special exception for linking this software with OpenSSL:
+ *
+ *  In addition, as a special exception, Skylable Ltd. gives permission to
+ *  link the code of this program with the OpenSSL library and distribute
+ *  linked combinations including the two. You must obey the GNU General
+ *  Public License in all respects for all of the code used other than
+ *  OpenSSL. You may extend this exception to your version of the program,
+ *  but you are not obligated to do so. If you do not wish to do so, delete
+ *  this exception statement from your version.
+ */
+
+#include "sxsyncbenchmark.h"
+#include "sxbenchmark.h"
+#include "sxbenchmarks.h"
+#include "sxfakenode.h"
+#include "sxcluster.h"
+#include "sxvolume.h"
+#include "sxfileentry.h"
+
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <iostream>
+
+static const char *sClusterUuid = "5e1f4a2c-8d3b-4f6e-9a7c-0b2d4e6f8a1c";
+static const char *sVolumeName = "bench";
+
+SxSyncBenchmark::SxSyncBenchmark(const Options &options, const QString &workDir)
+{
+    mOptions = options;
+    mSourceDir = workDir + "/sync-source";
+    mTargetDir = workDir + "/sync-target";
+    mVolume = nullptr;
+    mRetries = 0;
+}
+
+SxSyncBenchmark::~SxSyncBenchmark()
+{
+    // the cluster has to disconnect before the node goes away
+    mCluster.reset();
+    mNode.reset();
+}
+
+void SxSyncBenchmark::run(SxBenchmark &bench)
+{
+    const QStringList names = {"sync upload/small files", "sync upload/large files", "sync listing",
+                               "sync download/small files", "sync download/large files"};
+    bool selected = false;
+    foreach (QString name, names) {
+        selected = selected || bench.isSelected(name);
+    }
+    if (!selected)
+        return;
+    if (!_createTree() || !_connect()) {
+        foreach (QString name, names) {
+            bench.run(name, 1, 0, [] { return false; });
+        }
+        return;
+    }
+    const qint64 smallBytes = treeSize(mSourceDir, mSmallFiles);
+    const qint64 largeBytes = treeSize(mSourceDir, mLargeFiles);
+    const QStringList allFiles = mSmallFiles + mLargeFiles;
+
+    // every round starts from an empty node, nothing is deduplicated between rounds
+    bench.run("sync upload/small files", 1, smallBytes, mSmallFiles.count(), [this]() {
+        mNode->reset();
+        return _upload(mSmallFiles);
+    });
+    bench.run("sync upload/large files", 1, largeBytes, mLargeFiles.count(), [this]() {
+        mNode->reset();
+        return _upload(mLargeFiles);
+    });
+
+    mNode->reset();
+    if (!_upload(allFiles))
+        return;
+    bench.run("sync listing", 1, 0, allFiles.count(), [this, &allFiles]() {
+        return _list(allFiles.count());
+    });
+    bench.run("sync download/small files", 1, smallBytes, mSmallFiles.count(), [this]() {
+        return _download(mSmallFiles);
+    });
+    bench.run("sync download/large files", 1, largeBytes, mLargeFiles.count(), [this]() {
+        return _download(mLargeFiles);
+    });
+}
+
+QJsonObject SxSyncBenchmark::toJson() const
+{
+    QJsonObject json;
+    json.insert("smallFiles", mOptions.smallFiles);
+    json.insert("largeFiles", mOptions.largeFiles);
+    json.insert("largeFileSize", static_cast<double>(mOptions.largeFileSize));
+    json.insert("latency", mOptions.latency);
+    json.insert("bandwidth", static_cast<double>(mOptions.bandwidth));
+    json.insert("failureRate", mOptions.failureRate);
+    json.insert("retries", mRetries);
+    if (mNode) {
+        SxFakeNode::Stats stats = mNode->stats();
+        json.insert("requests", static_cast<double>(stats.requests));
+        json.insert("injectedFailures", static_cast<double>(stats.injectedFailures));
+        json.insert("bytesReceived", static_cast<double>(stats.bytesReceived));
+        json.insert("bytesSent", static_cast<double>(stats.bytesSent));
+    }
+    return json;
+}
+
+bool SxSyncBenchmark::_createTree()
+{
+    // sizes and contents depend on the options only, every run syncs the same tree
+    quint32 x = 2463534242u;
+    for (int i=0; i<mOptions.smallFiles; i++) {
+        x ^= x << 13;
+        x ^= x >> 17;
+        x ^= x << 5;
+        int size = 1024 + static_cast<int>(x % (63*1024));
+        QString path = QString("/small/d%1/f%2.bin").arg(i/sFilesPerDirectory, 3, 10, QChar('0')).arg(i, 5, 10, QChar('0'));
+        QFileInfo info(mSourceDir+path);
+        QFile file(info.absoluteFilePath());
+        if (!QDir().mkpath(info.absolutePath()) || !file.open(QIODevice::WriteOnly)) {
+            std::cerr << "unable to create " << info.absoluteFilePath().toLocal8Bit().constData() << std::endl;
+            return false;
+        }
+        if (file.write(SxBenchmark::patternData(size, static_cast<quint32>(i+1))) != size)
+            return false;
+        mSmallFiles.append(path);
+    }
+    for (int i=0; i<mOptions.largeFiles; i++) {
+        QString path = QString("/large/f%1.bin").arg(i);
+        QFileInfo info(mSourceDir+path);
+        QFile file(info.absoluteFilePath());
+        if (!QDir().mkpath(info.absolutePath()) || !file.open(QIODevice::WriteOnly)) {
+            std::cerr << "unable to create " << info.absoluteFilePath().toLocal8Bit().constData() << std::endl;
+            return false;
+        }
+        for (qint64 written = 0; written < mOptions.largeFileSize; written += sLargeFilePiece) {
+            int size = static_cast<int>(qMin(static_cast<qint64>(sLargeFilePiece), mOptions.largeFileSize-written));
+            quint32 seed = static_cast<quint32>(1000000 + i*65536 + written/sLargeFilePiece);
+            if (file.write(SxBenchmark::patternData(size, seed)) != size)
+                return false;
+        }
+        mLargeFiles.append(path);
+    }
+    return true;
+}
+
+bool SxSyncBenchmark::_connect()
+{
+    mNode.reset(new SxFakeNode(sClusterUuid, sVolumeName));
+    if (!mNode->start()) {
+        std::cerr << "unable to start the fake SX node" << std::endl;
+        return false;
+    }
+    mNode->setLatency(mOptions.latency);
+    mNode->setBandwidth(mOptions.bandwidth);
+    mNode->setFailureRate(mOptions.failureRate, 1);
+    QString errorMessage;
+    mCluster.reset(SxCluster::initializeCluster(SxBenchmarks::benchmarkAuth(mNode->port()), sClusterUuid,
+                                                [](QSslCertificate &, bool) { return true; }, errorMessage));
+    if (!mCluster || !mCluster->reloadVolumes()) {
+        std::cerr << "unable to connect to the fake SX node: "
+                  << (mCluster ? mCluster->lastError().errorMessage() : errorMessage).toLocal8Bit().constData() << std::endl;
+        return false;
+    }
+    mVolume = mCluster->getSxVolume(sVolumeName);
+    return mVolume != nullptr;
+}
+
+bool SxSyncBenchmark::_upload(const QStringList &files)
+{
+    // failed files are queued again like failed SxQueue tasks
+    QStringList pending = files;
+    QStringList failedJobs;
+    auto uploadDone = [&failedJobs](QString, QString path, SxError error, QString, quint32) {
+        if (error.errorCode() != SxErrorCode::NoError)
+            failedJobs.append(path);
+    };
+    for (int attempt=0; attempt<sMaxAttempts && !pending.isEmpty(); attempt++) {
+        QStringList failed;
+        foreach (QString path, pending) {
+            SxFileEntry fileEntry;
+            if (!mCluster->uploadFile(mVolume, path, mSourceDir+path, fileEntry, uploadDone))
+                failed.append(path);
+        }
+        mCluster->pollUploadJobs(0, uploadDone);
+        pending = failed + failedJobs;
+        failedJobs.clear();
+        mRetries += pending.count();
+    }
+    return pending.isEmpty();
+}
+
+bool SxSyncBenchmark::_download(const QStringList &files)
+{
+    QStringList pending = files;
+    for (int attempt=0; attempt<sMaxAttempts && !pending.isEmpty(); attempt++) {
+        QStringList failed;
+        foreach (QString path, pending) {
+            SxFileEntry fileEntry;
+            if (!mCluster->downloadFile(mVolume, path, mTargetDir+path, fileEntry, 0))
+                failed.append(path);
+        }
+        pending = failed;
+        mRetries += failed.count();
+    }
+    return pending.isEmpty();
+}
+
+bool SxSyncBenchmark::_list(int expected)
+{
+    for (int attempt=0; attempt<sMaxAttempts; attempt++) {
+        QList<SxFileEntry*> fileList;
+        QString etag;
+        bool listed = mCluster->_listFiles(mVolume, fileList, etag);
+        int count = fileList.count();
+        qDeleteAll(fileList);
+        if (listed)
+            return count == expected;
+        ++mRetries;
+    }
+    return false;
+}
+
+qint64 SxSyncBenchmark::treeSize(const QString &root, const QStringList &files)
+{
+    qint64 size = 0;
+    foreach (QString path, files) {
+        size += QFileInfo(root+path).size();
+    }
+    return size;
+}
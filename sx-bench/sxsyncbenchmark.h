@@ -0,0 +1,83 @@
+/*
+ *  Copyright (C) 2012-2016 Skylable Ltd. <info-copyright@skylable.com>
+ *
+ *  This program is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public License
+ *  as published by the Free Software Foundation; either version 2
+ *  of the License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA.
+ *
+ *  Special exception for linking this software with OpenSSL:
+ *
+ *  In addition, as a special exception, Skylable Ltd. gives permission to
+ *  link the code of this program with the OpenSSL library and distribute
+ *  linked combinations including the two. You must obey the GNU General
+ *  Public License in all respects for all of the code used other than
+ *  OpenSSL. You may extend this exception to your version of the program,
+ *  but you are not obligated to do so. If you do not wish to do so, delete
+ *  this exception statement from your version.
+ */
+
+#ifndef SXSYNCBENCHMARK_H
+#define SXSYNCBENCHMARK_H
+
+#include <QString>
+#include <QStringList>
+#include <QJsonObject>
+#include <memory>
+
+class SxBenchmark;
+class SxFakeNode;
+class SxCluster;
+class SxVolume;
+
+/* Synchronises a synthetic tree with an SxFakeNode through the SxCluster calls
+ * SxQueue makes for its upload, download and listing tasks */
+class SxSyncBenchmark
+{
+public:
+    struct Options {
+        int smallFiles;
+        int largeFiles;
+        qint64 largeFileSize;
+        int latency;
+        qint64 bandwidth;
+        double failureRate;
+    };
+    SxSyncBenchmark(const Options &options, const QString &workDir);
+    ~SxSyncBenchmark();
+    void run(SxBenchmark &bench);
+    QJsonObject toJson() const;
+
+private:
+    bool _createTree();
+    bool _connect();
+    bool _upload(const QStringList &files);
+    bool _download(const QStringList &files);
+    bool _list(int expected);
+    static qint64 treeSize(const QString &root, const QStringList &files);
+
+    Options mOptions;
+    QString mSourceDir;
+    QString mTargetDir;
+    QStringList mSmallFiles;
+    QStringList mLargeFiles;
+    std::unique_ptr<SxFakeNode> mNode;
+    std::unique_ptr<SxCluster> mCluster;
+    SxVolume *mVolume;
+    int mRetries;
+
+    static const int sMaxAttempts = 4;
+    static const int sFilesPerDirectory = 50;
+    static const int sLargeFilePiece = 4*1024*1024;
+};
+
+#endif // SXSYNCBENCHMARK_H
@@ -0,0 +1,529 @@
+/*
+ *  Copyright (C) 2012-2016 Skylable Ltd. <info-copyright@skylable.com>
+ *
+ *  This program is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public License
+ *  as published by the Free Software Foundation; either version 2
+ *  of the License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA.
+ *
+ *  Special exception for linking this software with OpenSSL:
+ *
+ *  In addition, as a special exception, Skylable Ltd. gives permission to
+ *  link the code of this program with the OpenSSL library and distribute
+ *  linked combinations including the two. You must obey the GNU General
+ *  Public License in all respects for all of the code used other than
+ *  OpenSSL. You may extend this exception to your version of the program,
+ *  but you are not obligated to do so. If you do not wish to do so, delete
+ *  this exception statement from your version.
+ */
+
+#include "sxwatcherbenchmark.h"
+#include "sxbenchmark.h"
+#include "sxconfig.h"
+
+#include <QCoreApplication>
+#include <QDir>
+#include <QEventLoop>
+#include <QFile>
+#include <QJsonArray>
+#include <QMutexLocker>
+#include <QThread>
+#include <algorithm>
+#include <iostream>
+
+#if defined Q_OS_WIN
+    #include <windows.h>
+    #include <psapi.h>
+#else
+    #include <sys/resource.h>
+    #include <fcntl.h>
+    #include <unistd.h>
+#endif
+#ifdef Q_OS_MAC
+    #include <mach/mach.h>
+#endif
+
+static const char *sVolumeName = "watcher-bench";
+
+SxWatcherBenchmark::SxWatcherBenchmark(const Options &options, const QString &workDir)
+{
+    mOptions = options;
+    if (mOptions.directories <= 0) {
+        // just past the per user watch limit where there is one, so running out of watches is part of the storm
+        int limit = watchLimit();
+        mOptions.directories = limit > 0 ? qMin(limit + 1000, 300000) : 20000;
+    }
+    mWorkDir = workDir + "/watcher";
+    mRecording = false;
+    mSpurious = 0;
+    mOverflows = 0;
+    mSignals = 0;
+    mClock.start();
+}
+
+void SxWatcherBenchmark::run(SxBenchmark &bench)
+{
+    const int samples = qMin(sDirectorySamples, mOptions.directories);
+    QList<QPair<Storm, int>> storms = {
+        {{"watcher creates",
+          [this](const QString &root) { return _prepareCreates(root); },
+          [this](const QString &root) { return _creates(root); }}, mOptions.creates},
+        {{"watcher deep renames",
+          [this](const QString &root) { return _prepareRenames(root); },
+          [this](const QString &root) { return _renames(root); }}, mOptions.depth*sFilesPerLevel},
+        {{"watcher checkout churn",
+          [this](const QString &root) { return _prepareChurn(root); },
+          [this](const QString &root) { return _churn(root); }}, mOptions.churnFiles},
+        {{"watcher directory limit",
+          [this](const QString &root) { return _prepareDirectories(root); },
+          [this](const QString &root) { return _directories(root); }}, samples}
+    };
+    foreach (auto storm, storms) {
+        bench.run(storm.first.name, 1, 0, storm.second, [this, storm]() {
+            return _runStorm(storm.first);
+        });
+    }
+}
+
+QJsonObject SxWatcherBenchmark::toJson() const
+{
+    QJsonObject jStorms;
+    for (auto it = mResults.constBegin(); it != mResults.constEnd(); ++it) {
+        const Result &result = it.value();
+        QJsonObject jStorm;
+        jStorm.insert("expected", result.expected);
+        jStorm.insert("delivered", result.delivered);
+        jStorm.insert("missed", result.missed);
+        jStorm.insert("spurious", result.spurious);
+        jStorm.insert("overflows", result.overflows);
+        jStorm.insert("signals", result.signalCount);
+        jStorm.insert("watchSeconds", static_cast<double>(result.watchMsecs)/1000);
+        jStorm.insert("stormSeconds", static_cast<double>(result.stormMsecs)/1000);
+        jStorm.insert("medianLatencyMs", static_cast<double>(result.medianLatency));
+        jStorm.insert("p95LatencyMs", static_cast<double>(result.p95Latency));
+        jStorm.insert("maxLatencyMs", static_cast<double>(result.maxLatency));
+        jStorm.insert("deliveredPerSecond", result.deliveryRate);
+        jStorm.insert("cpuSeconds", result.cpuSeconds);
+        jStorm.insert("memoryBytes", static_cast<double>(result.memoryBytes));
+        jStorms.insert(it.key(), jStorm);
+    }
+    QJsonObject json;
+    json.insert("backend", backendName());
+    json.insert("watchLimit", watchLimit());
+    json.insert("creates", mOptions.creates);
+    json.insert("depth", mOptions.depth);
+    json.insert("churnFiles", mOptions.churnFiles);
+    json.insert("directories", mOptions.directories);
+    json.insert("storms", jStorms);
+    return json;
+}
+
+QString SxWatcherBenchmark::backendName()
+{
+#if defined Q_OS_WIN
+    return "ReadDirectoryChangesW";
+#elif defined Q_OS_LINUX
+#ifdef FAN_REPORT_DFID_NAME
+    // SxFilesystem prefers filesystem wide marks when it is allowed to create them
+    int desc = fanotify_init(FAN_CLASS_NOTIF | FAN_REPORT_DFID_NAME | FAN_NONBLOCK | FAN_CLOEXEC, O_RDONLY);
+    if (desc != -1) {
+        close(desc);
+        return "fanotify";
+    }
+#endif
+    return "inotify";
+#elif defined Q_OS_MAC
+    return "FSEvents";
+#else
+    return "QFileSystemWatcher";
+#endif
+}
+
+/* The storm is replayed on an unwatched copy first, the CPU it costs by itself is not counted
+ * against the watcher. Deliveries are recorded on the watcher thread as they are emitted */
+bool SxWatcherBenchmark::_runStorm(const Storm &storm)
+{
+    const QString baseDir = mWorkDir + "/baseline";
+    const QString watchDir = mWorkDir + "/watched";
+    QDir(mWorkDir).removeRecursively();
+    if (!QDir().mkpath(baseDir) || !QDir().mkpath(watchDir)) {
+        std::cerr << "unable to create " << mWorkDir.toLocal8Bit().constData() << std::endl;
+        return false;
+    }
+    mRecording = false;
+    if (!storm.prepare(baseDir))
+        return false;
+    double cpuStart = processCpuTime();
+    if (!storm.storm(baseDir))
+        return false;
+    const double baselineCpu = processCpuTime() - cpuStart;
+    QDir(baseDir).removeRecursively();
+
+    // the watcher reports paths below the resolved root
+    const QString root = QDir(watchDir).canonicalPath();
+    {
+        QMutexLocker locker(&mMutex);
+        mTouched.clear();
+        mLatencies.clear();
+        mDeliveryTimes.clear();
+        mSpurious = 0;
+        mOverflows = 0;
+        mSignals = 0;
+    }
+    // expected paths are registered before the memory baseline is taken
+    mRecording = true;
+    if (!storm.prepare(root)) {
+        mRecording = false;
+        return false;
+    }
+
+    SxConfig config("watcher-bench");
+    config.addVolumeConfig(sVolumeName, root);
+    const qint64 memoryStart = residentMemory();
+    QThread thread;
+    SxFilesystem *filesystem = new SxFilesystem(&config);
+    filesystem->moveToThread(&thread);
+    QObject::connect(&thread, &QThread::finished, filesystem, &QObject::deleteLater);
+    QObject::connect(filesystem, &SxFilesystem::sig_filesModified, [this](const QList<SxFileChange> &changes) {
+        QMutexLocker locker(&mMutex);
+        ++mSignals;
+        foreach (const SxFileChange &change, changes) {
+            _delivered(change.path);
+        }
+    });
+    QObject::connect(filesystem, &SxFilesystem::sig_fileModified, [this](QString, QString path, bool, qint64) {
+        QMutexLocker locker(&mMutex);
+        ++mSignals;
+        _delivered(path);
+    });
+    // removals of files the database never knew end up as cancelled uploads
+    QObject::connect(filesystem, &SxFilesystem::sig_cancelUploadTask, [this](const QString &, const QString &path) {
+        QMutexLocker locker(&mMutex);
+        ++mSignals;
+        _delivered(path);
+    });
+    QObject::connect(filesystem, &SxFilesystem::sig_watchOverflow, [this](const QString &) {
+        QMutexLocker locker(&mMutex);
+        ++mOverflows;
+    });
+    thread.start();
+
+    QElapsedTimer watchTimer;
+    watchTimer.start();
+    QEventLoop loop;
+    QObject::connect(filesystem, &SxFilesystem::sig_watching, &loop, &QEventLoop::quit, Qt::QueuedConnection);
+    QMetaObject::invokeMethod(filesystem, "startWatching", Qt::QueuedConnection);
+    loop.exec();
+    const qint64 watchMsecs = watchTimer.elapsed();
+
+    cpuStart = processCpuTime();
+    const qint64 stormStart = mClock.elapsed();
+    bool stormed = storm.storm(root);
+    const qint64 stormEnd = mClock.elapsed();
+    qint64 memoryPeak = residentMemory();
+    if (stormed) {
+        // sampled while the watcher catches up, the storm itself runs on this thread
+        qint64 quietSince = stormEnd;
+        forever {
+            QThread::msleep(sSampleInterval);
+            memoryPeak = qMax(memoryPeak, residentMemory());
+            const qint64 now = mClock.elapsed();
+            QMutexLocker locker(&mMutex);
+            if (!mDeliveryTimes.isEmpty())
+                quietSince = qMax(quietSince, mDeliveryTimes.last());
+            int expected = 0;
+            foreach (qint64 touched, mTouched) {
+                if (touched >= 0)
+                    ++expected;
+            }
+            if (mLatencies.count() >= expected || now - quietSince >= sSettleMsecs || now - stormEnd >= sMaxSettleMsecs)
+                break;
+        }
+    }
+    const double cpuSeconds = processCpuTime() - cpuStart - baselineCpu;
+    thread.quit();
+    thread.wait();
+    mRecording = false;
+    config.removeVolumeConfig(sVolumeName);
+
+    Result result;
+    {
+        QMutexLocker locker(&mMutex);
+        QList<qint64> latencies = mLatencies.values();
+        std::sort(latencies.begin(), latencies.end());
+        result.expected = 0;
+        foreach (qint64 touched, mTouched) {
+            if (touched >= 0)
+                ++result.expected;
+        }
+        result.delivered = latencies.count();
+        result.missed = result.expected - result.delivered;
+        result.spurious = mSpurious;
+        result.overflows = mOverflows;
+        result.signalCount = mSignals;
+        result.medianLatency = latencies.isEmpty() ? 0 : latencies.at(latencies.count()/2);
+        result.p95Latency = latencies.isEmpty() ? 0 : latencies.at(latencies.count()*95/100);
+        result.maxLatency = latencies.isEmpty() ? 0 : latencies.last();
+        qint64 span = mDeliveryTimes.isEmpty() ? 0 : mDeliveryTimes.last() - mDeliveryTimes.first();
+        result.deliveryRate = span > 0 ? static_cast<double>(mDeliveryTimes.count())*1000/span : 0;
+    }
+    result.watchMsecs = watchMsecs;
+    result.stormMsecs = stormEnd - stormStart;
+    result.cpuSeconds = qMax(0.0, cpuSeconds);
+    result.memoryBytes = qMax(Q_INT64_C(0), memoryPeak - memoryStart);
+    mResults.insert(storm.name, result);
+    QDir(mWorkDir).removeRecursively();
+    return stormed;
+}
+
+void SxWatcherBenchmark::_expect(const QString &path)
+{
+    if (!mRecording)
+        return;
+    QMutexLocker locker(&mMutex);
+    mTouched.insert(path, -1);
+}
+
+void SxWatcherBenchmark::_touch(const QString &path)
+{
+    if (!mRecording)
+        return;
+    QMutexLocker locker(&mMutex);
+    mTouched[path] = mClock.elapsed();
+}
+
+/* called with the mutex held, a path delivered again counts from its last touch */
+void SxWatcherBenchmark::_delivered(const QString &path)
+{
+    const qint64 now = mClock.elapsed();
+    auto it = mTouched.constFind(path);
+    if (it == mTouched.constEnd() || it.value() < 0) {
+        ++mSpurious;
+        return;
+    }
+    mLatencies.insert(path, now - it.value());
+    mDeliveryTimes.append(now);
+}
+
+bool SxWatcherBenchmark::_prepareCreates(const QString &root)
+{
+    for (int i=0; i<mOptions.creates; i+=sFilesPerDirectory) {
+        QString dir = QString("/d%1").arg(i/sFilesPerDirectory, 4, 10, QChar('0'));
+        if (!QDir().mkpath(root + dir))
+            return false;
+        for (int j=i; j<qMin(i+sFilesPerDirectory, mOptions.creates); j++)
+            _expect(QString("%1/f%2").arg(dir).arg(j, 6, 10, QChar('0')));
+    }
+    return true;
+}
+
+bool SxWatcherBenchmark::_creates(const QString &root)
+{
+    const QByteArray content = SxBenchmark::patternData(64, 21);
+    for (int i=0; i<mOptions.creates; i++) {
+        QString path = QString("/d%1/f%2").arg(i/sFilesPerDirectory, 4, 10, QChar('0')).arg(i, 6, 10, QChar('0'));
+        if (!writeFile(root + path, content))
+            return false;
+        _touch(path);
+    }
+    return true;
+}
+
+/* the directory of the given level after the given number of rename rounds, the top
+ * and the middle directory get a new name every round */
+QString SxWatcherBenchmark::_levelDir(int round, int level) const
+{
+    const int middle = mOptions.depth/2;
+    QString dir = QString("/r%1").arg(round);
+    for (int l=2; l<=level; l++) {
+        if (l == middle)
+            dir += QString("/m%1").arg(round);
+        else
+            dir += QString("/n%1").arg(l);
+    }
+    return dir;
+}
+
+bool SxWatcherBenchmark::_prepareRenames(const QString &root)
+{
+    const QByteArray content = SxBenchmark::patternData(64, 22);
+    if (!QDir().mkpath(root + _levelDir(0, mOptions.depth)))
+        return false;
+    for (int level=1; level<=mOptions.depth; level++) {
+        for (int i=0; i<sFilesPerLevel; i++) {
+            if (!writeFile(root + _levelDir(0, level) + QString("/f%1").arg(i), content))
+                return false;
+            _expect(_levelDir(sRenameRounds, level) + QString("/f%1").arg(i));
+        }
+    }
+    return true;
+}
+
+bool SxWatcherBenchmark::_renames(const QString &root)
+{
+    const int middle = mOptions.depth/2;
+    for (int round=0; round<sRenameRounds; round++) {
+        if (!QDir().rename(root + _levelDir(round, 1), root + _levelDir(round+1, 1)))
+            return false;
+        if (middle >= 2 && !QDir().rename(root + _levelDir(round+1, middle-1) + QString("/m%1").arg(round),
+                                           root + _levelDir(round+1, middle)))
+            return false;
+    }
+    // every file below the top directory moved with the last rename
+    for (int level=1; level<=mOptions.depth; level++) {
+        for (int i=0; i<sFilesPerLevel; i++)
+            _touch(_levelDir(sRenameRounds, level) + QString("/f%1").arg(i));
+    }
+    return true;
+}
+
+bool SxWatcherBenchmark::_prepareChurn(const QString &root)
+{
+    const QByteArray content = SxBenchmark::patternData(256, 23);
+    for (int i=0; i<mOptions.churnFiles; i++) {
+        QString dir = QString("/src/d%1").arg(i/sFilesPerDirectory, 3, 10, QChar('0'));
+        if (i % sFilesPerDirectory == 0 && !QDir().mkpath(root + dir))
+            return false;
+        QString path = QString("%1/f%2").arg(dir).arg(i, 6, 10, QChar('0'));
+        if (!writeFile(root + path, content))
+            return false;
+        // a third is removed, a third rewritten and a third left alone
+        if (i % 3 != 2)
+            _expect(path);
+    }
+    for (int i=0; i<mOptions.churnFiles/3; i++)
+        _expect(QString("/src/n%1/f%2").arg(i/sFilesPerDirectory, 3, 10, QChar('0')).arg(i, 6, 10, QChar('0')));
+    return true;
+}
+
+/* what switching branches does to a working tree: files are unlinked and written again
+ * instead of being modified in place, new directories appear with their files */
+bool SxWatcherBenchmark::_churn(const QString &root)
+{
+    const QByteArray content = SxBenchmark::patternData(256, 24);
+    for (int i=0; i<mOptions.churnFiles; i++) {
+        if (i % 3 == 2)
+            continue;
+        QString path = QString("/src/d%1/f%2").arg(i/sFilesPerDirectory, 3, 10, QChar('0')).arg(i, 6, 10, QChar('0'));
+        if (!QFile::remove(root + path))
+            return false;
+        if (i % 3 == 1 && !writeFile(root + path, content))
+            return false;
+        _touch(path);
+    }
+    for (int i=0; i<mOptions.churnFiles/3; i++) {
+        QString dir = QString("/src/n%1").arg(i/sFilesPerDirectory, 3, 10, QChar('0'));
+        if (i % sFilesPerDirectory == 0 && !QDir().mkpath(root + dir))
+            return false;
+        QString path = QString("%1/f%2").arg(dir).arg(i, 6, 10, QChar('0'));
+        if (!writeFile(root + path, content))
+            return false;
+        _touch(path);
+    }
+    return true;
+}
+
+bool SxWatcherBenchmark::_prepareDirectories(const QString &root)
+{
+    const int step = qMax(1, mOptions.directories/sDirectorySamples);
+    for (int i=0; i<mOptions.directories; i++) {
+        QString dir = QString("/p%1/d%2").arg(i/sDirectoriesPerParent, 4, 10, QChar('0')).arg(i, 6, 10, QChar('0'));
+        if (!QDir().mkpath(root + dir))
+            return false;
+        if (i % step == 0)
+            _expect(dir + "/file");
+    }
+    return true;
+}
+
+/* one file in directories spread over the whole tree, the ones watched last are the
+ * first to go without a watch */
+bool SxWatcherBenchmark::_directories(const QString &root)
+{
+    const QByteArray content = SxBenchmark::patternData(64, 25);
+    const int step = qMax(1, mOptions.directories/sDirectorySamples);
+    for (int i=0; i<mOptions.directories; i+=step) {
+        QString path = QString("/p%1/d%2/file").arg(i/sDirectoriesPerParent, 4, 10, QChar('0')).arg(i, 6, 10, QChar('0'));
+        if (!writeFile(root + path, content))
+            return false;
+        _touch(path);
+    }
+    return true;
+}
+
+bool SxWatcherBenchmark::writeFile(const QString &path, const QByteArray &content)
+{
+    QFile file(path);
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate) || file.write(content) != content.size()) {
+        std::cerr << "unable to write " << path.toLocal8Bit().constData() << std::endl;
+        return false;
+    }
+    return true;
+}
+
+int SxWatcherBenchmark::watchLimit()
+{
+#ifdef Q_OS_LINUX
+    QFile file("/proc/sys/fs/inotify/max_user_watches");
+    if (file.open(QIODevice::ReadOnly)) {
+        bool ok;
+        int limit = file.readAll().trimmed().toInt(&ok);
+        if (ok)
+            return limit;
+    }
+#endif
+    return -1;
+}
+
+double SxWatcherBenchmark::processCpuTime()
+{
+#if defined Q_OS_WIN
+    FILETIME creation, exit, kernel, user;
+    if (!GetProcessTimes(GetCurrentProcess(), &creation, &exit, &kernel, &user))
+        return 0;
+    auto seconds = [](const FILETIME &time) {
+        return static_cast<double>((static_cast<quint64>(time.dwHighDateTime) << 32) | time.dwLowDateTime)/1e7;
+    };
+    return seconds(kernel) + seconds(user);
+#else
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) != 0)
+        return 0;
+    return usage.ru_utime.tv_sec + usage.ru_utime.tv_usec/1e6 + usage.ru_stime.tv_sec + usage.ru_stime.tv_usec/1e6;
+#endif
+}
+
+qint64 SxWatcherBenchmark::residentMemory()
+{
+#if defined Q_OS_WIN
+    PROCESS_MEMORY_COUNTERS counters;
+    if (!GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)))
+        return 0;
+    return static_cast<qint64>(counters.WorkingSetSize);
+#elif defined Q_OS_LINUX
+    QFile file("/proc/self/statm");
+    if (!file.open(QIODevice::ReadOnly))
+        return 0;
+    QList<QByteArray> fields = file.readAll().split(' ');
+    if (fields.count() < 2)
+        return 0;
+    return fields.at(1).toLongLong()*sysconf(_SC_PAGESIZE);
+#elif defined Q_OS_MAC
+    mach_task_basic_info info;
+    mach_msg_type_number_t count = MACH_TASK_BASIC_INFO_COUNT;
+    if (task_info(mach_task_self(), MACH_TASK_BASIC_INFO, reinterpret_cast<task_info_t>(&info), &count) != KERN_SUCCESS)
+        return 0;
+    return static_cast<qint64>(info.resident_size);
+#else
+    return 0;
+#endif
+}
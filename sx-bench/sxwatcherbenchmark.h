@@ -0,0 +1,129 @@
+/*
+ *  Copyright (C) 2012-2016 Skylable Ltd. <info-copyright@skylable.com>
+ *
+ *  This program is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public License
+ *  as published by the Free Software Foundation; either version 2
+ *  of the License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA.
+ *
+ *  Special exception for linking this software with OpenSSL:
+ *
+ *  In addition, as a special exception, Skylable Ltd. gives permission to
+ *  link the code of this program with the OpenSSL library and distribute
+ *  linked combinations including the two. You must obey the GNU General
+ *  Public License in all respects for all of the code used other than
+ *  OpenSSL. You may extend this exception to your version of the program,
+ *  but you are not obligated to do so. If you do not wish to do so, delete
+ *  this exception statement from your version.
+ */
+
+#ifndef SXWATCHERBENCHMARK_H
+#define SXWATCHERBENCHMARK_H
+
+#include <QString>
+#include <QStringList>
+#include <QHash>
+#include <QMap>
+#include <QMutex>
+#include <QElapsedTimer>
+#include <QJsonObject>
+#include <functional>
+#include "sxfilesystem.h"
+
+class SxBenchmark;
+
+/* Storms of filesystem events against a scratch directory watched by the SxFilesystem
+ * backend of this platform. For every storm the delay between the last touch of a path
+ * and its delivery, the paths never delivered, the overflows the watcher reported and
+ * the CPU and memory spent on watching are recorded */
+class SxWatcherBenchmark
+{
+public:
+    struct Options {
+        int creates;
+        int depth;
+        int churnFiles;
+        int directories;
+    };
+    SxWatcherBenchmark(const Options &options, const QString &workDir);
+    void run(SxBenchmark &bench);
+    QJsonObject toJson() const;
+    static QString backendName();
+
+private:
+    struct Storm {
+        QString name;
+        std::function<bool(const QString &root)> prepare;
+        std::function<bool(const QString &root)> storm;
+    };
+    struct Result {
+        int expected;
+        int delivered;
+        int missed;
+        int overflows;
+        int spurious;
+        int signalCount;
+        qint64 watchMsecs;
+        qint64 stormMsecs;
+        qint64 medianLatency;
+        qint64 p95Latency;
+        qint64 maxLatency;
+        double deliveryRate;
+        double cpuSeconds;
+        qint64 memoryBytes;
+    };
+    bool _runStorm(const Storm &storm);
+    bool _settle(qint64 stormEnd);
+    void _expect(const QString &path);
+    void _touch(const QString &path);
+    void _delivered(const QString &path);
+    bool _prepareCreates(const QString &root);
+    bool _creates(const QString &root);
+    bool _prepareRenames(const QString &root);
+    bool _renames(const QString &root);
+    bool _prepareChurn(const QString &root);
+    bool _churn(const QString &root);
+    bool _prepareDirectories(const QString &root);
+    bool _directories(const QString &root);
+    static bool writeFile(const QString &path, const QByteArray &content);
+    QString _levelDir(int round, int level) const;
+    static int watchLimit();
+    static double processCpuTime();
+    static qint64 residentMemory();
+
+    Options mOptions;
+    QString mWorkDir;
+    bool mRecording;
+    QElapsedTimer mClock;
+    // written from the watcher thread
+    QMutex mMutex;
+    QHash<QString, qint64> mTouched;
+    QHash<QString, qint64> mLatencies;
+    QList<qint64> mDeliveryTimes;
+    int mSpurious;
+    int mOverflows;
+    int mSignals;
+    QMap<QString, Result> mResults;
+
+    static const int sFilesPerDirectory = 1000;
+    static const int sDirectorySamples = 1000;
+    static const int sRenameRounds = 8;
+    static const int sFilesPerLevel = 16;
+    static const int sDirectoriesPerParent = 500;
+    static const int sSampleInterval = 100;
+    // longer than the quiet time and a notify tick of SxFilesystem, later deliveries count as missed
+    static const int sSettleMsecs = 12000;
+    // a path touched longer ago than the longest hold back of SxFilesystem is delivered by then
+    static const int sMaxSettleMsecs = 60000;
+};
+
+#endif // SXWATCHERBENCHMARK_H
@@ -2,7 +2,7 @@ QMAKE_MAC_SDK = macosx10.11
 TEMPLATE = subdirs
 CONFIG += c++11 debug_and_release
 SUBDIRS += sx-api drive-core common-gui drive-app \
-           scout-core scout-app
+           drive-daemon scout-core scout-app sx-bench
 CONFIG += ordered
 
 win32: {